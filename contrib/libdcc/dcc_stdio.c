@@ -28,6 +28,7 @@
 #define TARGET_REQ_DEBUGMSG_ASCII			0x01
 #define TARGET_REQ_DEBUGMSG_HEXMSG(size)	(0x01 | ((size & 0xff) << 8))
 #define TARGET_REQ_DEBUGCHAR				0x02
+#define TARGET_REQ_RINGBUF					0x03
 
 #if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_6SM__)
 
@@ -155,3 +156,51 @@ void dbg_write_char(char msg)
 {
 	dbg_write(TARGET_REQ_DEBUGCHAR | ((msg & 0xff) << 16));
 }
+
+/* the ring announced to openocd: size, head and tail followed by the data.
+ * only head is written here, openocd moves tail as it reads */
+struct dbg_ring {
+	volatile unsigned long size;
+	volatile unsigned long head;
+	volatile unsigned long tail;
+	unsigned char data[];
+};
+
+static struct dbg_ring *dbg_ring;
+
+void dbg_ring_init(void *buf, unsigned long size)
+{
+	struct dbg_ring *ring = buf;
+
+	ring->size = size - sizeof(*ring);
+	ring->head = 0;
+	ring->tail = 0;
+	dbg_ring = ring;
+
+	/* buf is 256 byte aligned, the low byte carries the request */
+	dbg_write(TARGET_REQ_RINGBUF | (unsigned long)buf);
+}
+
+long dbg_ring_write(const char *msg, long len)
+{
+	struct dbg_ring *ring = dbg_ring;
+	unsigned long head, space;
+	long i;
+
+	if (!ring)
+		return 0;
+
+	head = ring->head;
+	space = (ring->tail + ring->size - head - 1) % ring->size;
+	if ((unsigned long)len > space)
+		len = space;
+
+	for (i = 0; i < len; i++) {
+		ring->data[head] = msg[i];
+		if (++head == ring->size)
+			head = 0;
+	}
+	ring->head = head;
+
+	return len;
+}
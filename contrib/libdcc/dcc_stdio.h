@@ -32,4 +32,9 @@ void dbg_write_u8(const unsigned char *val, long len);
 void dbg_write_str(const char *msg);
 void dbg_write_char(char msg);
 
+/* buf must be 256 byte aligned; dbg_ring_write returns the number of
+ * bytes stored, the rest is dropped while the ring is full */
+void dbg_ring_init(void *buf, unsigned long size);
+long dbg_ring_write(const char *msg, long len);
+
 #endif	/* DCC_STDIO_H */
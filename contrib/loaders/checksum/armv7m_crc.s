@@ -22,6 +22,10 @@
 	parameters:
 	r0 - address in - crc out
 	r1 - char count
+
+	CRC32 (poly 0x04c11db7, MSB first, no final xor), a nibble at a
+	time from a 16 entry table; only ARMv6-M instructions are used so
+	the same code runs on Cortex-M0/M0+/M23 and on HLA adapters.
 */
 
 	.text
@@ -35,37 +39,40 @@
 _start:
 main:
 	mov		r2, r0
+	adds	r3, r0, r1
 	movs	r0, #0
 	mvns	r0, r0
-	ldr		r6, CRC32XOR
-	mov		r3, r1
-	movs	r4, #0
+	adr		r6, crc_table
 	b		ncomp
 nbyte:
-	ldrb	r1, [r2, r4]
-	lsls	r1, r1, #24
-	eors	r0, r0, r1
-	movs	r5, #0
-loop:
-	cmp		r0, #0
-	bge		notset
-	lsls	r0, r0, #1
-	eors	r0, r0, r6
-	b		cont
-notset:
-	lsls	r0, r0, #1
-cont:
-	adds	r5, r5, #1
-	cmp		r5, #8
-	bne		loop
-	adds	r4, r4, #1
+	ldrb	r1, [r2]
+	adds	r2, r2, #1
+	lsrs	r4, r0, #28
+	lsrs	r5, r1, #4
+	eors	r4, r4, r5
+	lsls	r4, r4, #2
+	ldr		r4, [r6, r4]
+	lsls	r0, r0, #4
+	eors	r0, r0, r4
+	lsrs	r4, r0, #28
+	lsls	r5, r1, #28
+	lsrs	r5, r5, #28
+	eors	r4, r4, r5
+	lsls	r4, r4, #2
+	ldr		r4, [r6, r4]
+	lsls	r0, r0, #4
+	eors	r0, r0, r4
 ncomp:
-	cmp		r4, r3
+	cmp		r2, r3
 	bne		nbyte
 	bkpt	#0
 
 	.align	2
 
-CRC32XOR:	.word	0x04c11db7
+crc_table:
+	.word	0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9
+	.word	0x130476dc, 0x17c56b6b, 0x1a864db2, 0x1e475005
+	.word	0x2608edb8, 0x22c9f00f, 0x2f8ad6d6, 0x2b4bcb61
+	.word	0x350c9b64, 0x31cd86d3, 0x3c8ea00a, 0x384fbdbd
 
 	.end
@@ -0,0 +1,90 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Spencer Oliver                                  *
+ *   spen@spen-soft.co.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+/*
+	parameters:
+	r0 - address
+	r1 - chunk size in bytes
+	r2 - chunk count, at least one
+	r3 - address of the result array, one crc word per chunk
+
+	Same CRC32 as armv7m_crc.s (poly 0x04c11db7, MSB first, no final
+	xor), restarted for each chunk; only ARMv6-M instructions are used.
+*/
+
+	.text
+	.syntax unified
+	.cpu cortex-m0
+	.thumb
+	.thumb_func
+
+	.align	2
+
+_start:
+main:
+	mov		r8, r1
+	mov		r9, r2
+	mov		r10, r3
+	adr		r6, crc_table
+nchunk:
+	mov		r3, r0
+	add		r3, r8
+	movs	r2, #0
+	mvns	r2, r2
+	b		ncomp
+nbyte:
+	ldrb	r1, [r0]
+	adds	r0, r0, #1
+	lsrs	r4, r2, #28
+	lsrs	r5, r1, #4
+	eors	r4, r4, r5
+	lsls	r4, r4, #2
+	ldr		r4, [r6, r4]
+	lsls	r2, r2, #4
+	eors	r2, r2, r4
+	lsrs	r4, r2, #28
+	lsls	r5, r1, #28
+	lsrs	r5, r5, #28
+	eors	r4, r4, r5
+	lsls	r4, r4, #2
+	ldr		r4, [r6, r4]
+	lsls	r2, r2, #4
+	eors	r2, r2, r4
+ncomp:
+	cmp		r0, r3
+	bne		nbyte
+	mov		r4, r10
+	stmia	r4!, {r2}
+	mov		r10, r4
+	mov		r4, r9
+	subs	r4, r4, #1
+	mov		r9, r4
+	bne		nchunk
+	bkpt	#0
+
+	.align	2
+
+crc_table:
+	.word	0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9
+	.word	0x130476dc, 0x17c56b6b, 0x1a864db2, 0x1e475005
+	.word	0x2608edb8, 0x22c9f00f, 0x2f8ad6d6, 0x2b4bcb61
+	.word	0x350c9b64, 0x31cd86d3, 0x3c8ea00a, 0x384fbdbd
+
+	.end
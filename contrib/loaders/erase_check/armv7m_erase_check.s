@@ -23,6 +23,9 @@
 	r0 - address in
 	r1 - byte count
 	r2 - mask - result out
+
+	Word aligned regions are checked a word at a time; only ARMv6-M
+	instructions are used so the same code runs on Cortex-M0/M0+/M23.
 */
 
 	.text
@@ -33,6 +36,32 @@
 
 	.align	2
 
+_start:
+	movs	r3, #3
+	tst		r0, r3
+	bne		bcomp
+	movs	r4, #0
+	mvns	r4, r4
+	b		wcomp
+wloop:
+	ldr		r5, [r0]
+	adds	r0, #4
+	ands	r4, r4, r5
+	subs	r1, r1, #4
+wcomp:
+	cmp		r1, #4
+	bhs		wloop
+	/* fold the four byte lanes into the mask */
+	ands	r2, r2, r4
+	lsrs	r4, r4, #8
+	ands	r2, r2, r4
+	lsrs	r4, r4, #8
+	ands	r2, r2, r4
+	lsrs	r4, r4, #8
+	ands	r2, r2, r4
+bcomp:
+	cmp		r1, #0
+	beq		end
 loop:
 	ldrb	r3, [r0]
 	adds	r0, #1
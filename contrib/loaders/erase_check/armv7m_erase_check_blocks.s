@@ -0,0 +1,87 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Spencer Oliver                                  *
+ *   spen@spen-soft.co.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+/*
+	parameters:
+	r0 - block table in: { address, size, result } words per block,
+	     result receives the AND of all bytes of the block
+	r1 - number of blocks
+
+	All blocks are checked in one run; only ARMv6-M instructions are
+	used so the same code runs on Cortex-M0/M0+/M23.
+*/
+
+	.text
+	.syntax unified
+	.cpu cortex-m0
+	.thumb
+	.thumb_func
+
+	.align	2
+
+_start:
+	movs	r6, r0
+	movs	r7, r1
+next:
+	cmp		r7, #0
+	beq		end
+	ldr		r0, [r6, #0]
+	ldr		r1, [r6, #4]
+	movs	r2, #0xff
+	movs	r3, #3
+	tst		r0, r3
+	bne		bcomp
+	movs	r4, #0
+	mvns	r4, r4
+	b		wcomp
+wloop:
+	ldr		r5, [r0]
+	adds	r0, #4
+	ands	r4, r4, r5
+	subs	r1, r1, #4
+wcomp:
+	cmp		r1, #4
+	bhs		wloop
+	/* fold the four byte lanes into the mask */
+	ands	r2, r2, r4
+	lsrs	r4, r4, #8
+	ands	r2, r2, r4
+	lsrs	r4, r4, #8
+	ands	r2, r2, r4
+	lsrs	r4, r4, #8
+	ands	r2, r2, r4
+bcomp:
+	cmp		r1, #0
+	beq		store
+bloop:
+	ldrb	r3, [r0]
+	adds	r0, #1
+	ands	r2, r2, r3
+	subs	r1, r1, #1
+	bne		bloop
+store:
+	str		r2, [r6, #8]
+	adds	r6, #12
+	subs	r7, #1
+	b		next
+end:
+	bkpt	#0
+
+	.end
@@ -0,0 +1,84 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+	.text
+	.syntax unified
+	.arch armv7-m
+	.thumb
+	.thumb_func
+
+	.align 2
+
+/* Spansion 16 bit word programming, fed from the ring buffer of
+ * target_run_flash_async_algorithm() */
+
+/* input parameters - */
+/*	R0 = fifo start, also address of the write pointer */
+/*	R1 = fifo end */
+/*	R2 = destination address */
+/*	R3 = number of writes */
+/*	R4 = flash write command */
+/*	R5 = DQ7 mask in bits 15:0, DQ5 mask in bits 31:16 (0 for DQ7 only) */
+/* temp registers - */
+/*	R6 = read pointer */
+/*	R7 = data being programmed */
+/*	R12 = value read from flash to test status */
+/*	LR = difference between data and status */
+/* unlock registers - */
+/*  R8 = unlock1_addr */
+/*  R9 = unlock1_cmd */
+/*  R10 = unlock2_addr */
+/*  R11 = unlock2_cmd */
+/* on error the read pointer is set to 0 */
+
+	ldr		r6, [r0, #4]		/* read pointer */
+wait_fifo:
+	ldr		r12, [r0, #0]		/* write pointer */
+	cmp		r12, #0
+	beq		done			/* aborted by the host */
+	cmp		r12, r6
+	beq		wait_fifo		/* empty */
+	ldrh	r7, [r6], #2
+	cmp		r6, r1
+	it		cs
+	addcs	r6, r0, #8		/* wrap */
+	str		r6, [r0, #4]		/* the slot can be refilled */
+	strh	r9, [r8]
+	strh	r11, [r10]
+	strh	r4, [r8]
+	strh	r7, [r2]
+busy:
+	ldrh	r12, [r2]
+	eor		lr, r12, r7
+	tst		lr, r5
+	beq		cont			/* b if DQ7 == Data7 */
+	tst		r12, r5, lsr #16
+	beq		busy			/* b if DQ5 low */
+	ldrh	r12, [r2]
+	eor		lr, r12, r7
+	tst		lr, r5
+	beq		cont			/* b if DQ7 == Data7 */
+	movs	r12, #0
+	str		r12, [r0, #4]		/* report failure */
+	b		done
+cont:
+	add		r2, r2, #2
+	subs	r3, r3, #1
+	bne		wait_fifo
+
+done:
+	bkpt	#0
+
+	.end
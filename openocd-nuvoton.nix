@@ -1,4 +1,4 @@
-{ stdenv, lib, fetchurl, libftdi1, libusb, pkgconfig, autoreconfHook }:
+{ stdenv, lib, fetchurl, libftdi1, libusb, zlib, xz, zstd, pkgconfig, autoreconfHook }:
 
 stdenv.mkDerivation rec {
   name = "OpenOCD-Nuvoton";
@@ -6,7 +6,7 @@ stdenv.mkDerivation rec {
   src = ./.;
 
   nativeBuildInputs = [ pkgconfig autoreconfHook ];
-  buildInputs = [ libftdi1 libusb ];
+  buildInputs = [ libftdi1 libusb zlib xz zstd ];
 
   configureFlags = [
     "--enable-jtag_vpi"
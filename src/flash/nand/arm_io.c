@@ -148,6 +148,9 @@ int arm_nandwrite(struct arm_nand_data *nand, uint8_t *data, int size)
 		target_code_src = code_armv4_5;
 	}
 
+	if (nand->chunk_size == 0)
+		return ERROR_NAND_NO_BUFFER;
+
 	if (nand->op != ARM_NAND_WRITE || !nand->copy_area) {
 		retval = arm_code_to_working_area(target, target_code_src, target_code_size,
 				nand->chunk_size, &nand->copy_area);
@@ -156,31 +159,43 @@ int arm_nandwrite(struct arm_nand_data *nand, uint8_t *data, int size)
 	}
 
 	nand->op = ARM_NAND_WRITE;
-
-	/* copy data to work area */
 	target_buf = nand->copy_area->address + target_code_size;
-	retval = target_write_buffer(target, target_buf, size, data);
-	if (retval != ERROR_OK)
-		return retval;
 
 	/* set up parameters */
 	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN);
 	init_reg_param(&reg_params[1], "r1", 32, PARAM_IN);
 	init_reg_param(&reg_params[2], "r2", 32, PARAM_IN);
 
-	buf_set_u32(reg_params[0].value, 0, 32, nand->data);
-	buf_set_u32(reg_params[1].value, 0, 32, target_buf);
-	buf_set_u32(reg_params[2].value, 0, 32, size);
-
 	/* armv4 must exit using a hardware breakpoint */
 	if (arm->is_armv4)
 		exit_var = nand->copy_area->address + target_code_size - 4;
 
-	/* use alg to write data from work area to NAND chip */
-	retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
-			nand->copy_area->address, exit_var, 1000, arm_algo);
-	if (retval != ERROR_OK)
-		LOG_ERROR("error executing hosted NAND write");
+	/* the work area holds one chunk; a whole page plus OOB, or a
+	 * multi-page block, goes through it a chunk at a time */
+	retval = ERROR_OK;
+	while (size > 0) {
+		int count = MIN((unsigned) size, nand->chunk_size);
+
+		/* copy data to work area */
+		retval = target_write_buffer(target, target_buf, count, data);
+		if (retval != ERROR_OK)
+			break;
+
+		buf_set_u32(reg_params[0].value, 0, 32, nand->data);
+		buf_set_u32(reg_params[1].value, 0, 32, target_buf);
+		buf_set_u32(reg_params[2].value, 0, 32, count);
+
+		/* use alg to write data from work area to NAND chip */
+		retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
+				nand->copy_area->address, exit_var, 1000, arm_algo);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("error executing hosted NAND write");
+			break;
+		}
+
+		data += count;
+		size -= count;
+	}
 
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
@@ -258,6 +273,9 @@ int arm_nandread(struct arm_nand_data *nand, uint8_t *data, uint32_t size)
 		target_code_src = code_armv4_5;
 	}
 
+	if (nand->chunk_size == 0)
+		return ERROR_NAND_NO_BUFFER;
+
 	/* create the copy area if not yet available */
 	if (nand->op != ARM_NAND_READ || !nand->copy_area) {
 		retval = arm_code_to_working_area(target, target_code_src, target_code_size,
@@ -274,26 +292,38 @@ int arm_nandread(struct arm_nand_data *nand, uint8_t *data, uint32_t size)
 	init_reg_param(&reg_params[1], "r1", 32, PARAM_IN);
 	init_reg_param(&reg_params[2], "r2", 32, PARAM_IN);
 
-	buf_set_u32(reg_params[0].value, 0, 32, target_buf);
-	buf_set_u32(reg_params[1].value, 0, 32, nand->data);
-	buf_set_u32(reg_params[2].value, 0, 32, size);
-
 	/* armv4 must exit using a hardware breakpoint */
 	if (arm->is_armv4)
 		exit_var = nand->copy_area->address + target_code_size - 4;
 
-	/* use alg to write data from NAND chip to work area */
-	retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
-			nand->copy_area->address, exit_var, 1000, arm_algo);
-	if (retval != ERROR_OK)
-		LOG_ERROR("error executing hosted NAND read");
+	retval = ERROR_OK;
+	while (size > 0) {
+		uint32_t count = MIN(size, nand->chunk_size);
+
+		buf_set_u32(reg_params[0].value, 0, 32, target_buf);
+		buf_set_u32(reg_params[1].value, 0, 32, nand->data);
+		buf_set_u32(reg_params[2].value, 0, 32, count);
+
+		/* use alg to write data from NAND chip to work area */
+		retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
+				nand->copy_area->address, exit_var, 1000, arm_algo);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("error executing hosted NAND read");
+			break;
+		}
+
+		/* read from work area to the host's memory */
+		retval = target_read_buffer(target, target_buf, count, data);
+		if (retval != ERROR_OK)
+			break;
+
+		data += count;
+		size -= count;
+	}
 
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
 	destroy_reg_param(&reg_params[2]);
 
-	/* read from work area to the host's memory */
-	retval = target_read_buffer(target, target_buf, size, data);
-
 	return retval;
 }
@@ -278,7 +278,7 @@ int nand_read_status(struct nand_device *nand, uint8_t *status)
 	return ERROR_OK;
 }
 
-static int nand_poll_ready(struct nand_device *nand, int timeout)
+static int nand_poll_status(struct nand_device *nand, int timeout, uint8_t *status_out)
 {
 	uint8_t status;
 
@@ -295,9 +295,17 @@ static int nand_poll_ready(struct nand_device *nand, int timeout)
 		alive_sleep(1);
 	} while (timeout--);
 
+	*status_out = status;
 	return (status & NAND_STATUS_READY) != 0;
 }
 
+static int nand_poll_ready(struct nand_device *nand, int timeout)
+{
+	uint8_t status;
+
+	return nand_poll_status(nand, timeout, &status);
+}
+
 int nand_probe(struct nand_device *nand)
 {
 	uint8_t manufacturer_id, device_id;
@@ -506,6 +514,10 @@ int nand_erase(struct nand_device *nand, int first_block, int last_block)
 	if ((first_block < 0) || (last_block >= nand->num_blocks))
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	retval = nand_write_flush(nand);
+	if (retval != ERROR_OK)
+		return retval;
+
 	/* make sure we know if a block is bad before erasing it */
 	for (i = first_block; i <= last_block; i++) {
 		if (nand->blocks[i].is_bad == -1) {
@@ -657,10 +669,15 @@ int nand_write_page(struct nand_device *nand, uint32_t page,
 	uint8_t *oob, uint32_t oob_size)
 {
 	uint32_t block;
+	int retval;
 
 	if (!nand->device)
 		return ERROR_NAND_DEVICE_NOT_PROBED;
 
+	retval = nand_write_flush(nand);
+	if (retval != ERROR_OK)
+		return retval;
+
 	block = page / (nand->erase_size / nand->page_size);
 	if (nand->blocks[block].is_erased == 1)
 		nand->blocks[block].is_erased = 0;
@@ -675,9 +692,15 @@ int nand_read_page(struct nand_device *nand, uint32_t page,
 	uint8_t *data, uint32_t data_size,
 	uint8_t *oob, uint32_t oob_size)
 {
+	int retval;
+
 	if (!nand->device)
 		return ERROR_NAND_DEVICE_NOT_PROBED;
 
+	retval = nand_write_flush(nand);
+	if (retval != ERROR_OK)
+		return retval;
+
 	if (nand->use_raw || nand->controller->read_page == NULL)
 		return nand_read_page_raw(nand, page, data, data_size, oob, oob_size);
 	else
@@ -687,9 +710,15 @@ int nand_read_page(struct nand_device *nand, uint32_t page,
 int nand_page_command(struct nand_device *nand, uint32_t page,
 	uint8_t cmd, bool oob_only)
 {
+	int retval;
+
 	if (!nand->device)
 		return ERROR_NAND_DEVICE_NOT_PROBED;
 
+	retval = nand_write_flush(nand);
+	if (retval != ERROR_OK)
+		return retval;
+
 	if (oob_only && NAND_CMD_READ0 == cmd && nand->page_size <= 512)
 		cmd = NAND_CMD_READOOB;
 
@@ -818,23 +847,24 @@ int nand_write_data_page(struct nand_device *nand, uint8_t *data, uint32_t size)
 	return retval;
 }
 
-int nand_write_finish(struct nand_device *nand)
+static int nand_write_wait(struct nand_device *nand)
 {
 	int retval;
 	uint8_t status;
 
-	nand->controller->command(nand, NAND_CMD_PAGEPROG);
-
-	retval = nand->controller->nand_ready ?
-		nand->controller->nand_ready(nand, 100) :
-		nand_poll_ready(nand, 100);
-	if (!retval)
-		return ERROR_NAND_OPERATION_TIMEOUT;
+	if (nand->controller->nand_ready) {
+		if (!nand->controller->nand_ready(nand, 100))
+			return ERROR_NAND_OPERATION_TIMEOUT;
 
-	retval = nand_read_status(nand, &status);
-	if (ERROR_OK != retval) {
-		LOG_ERROR("couldn't read status");
-		return ERROR_NAND_OPERATION_FAILED;
+		retval = nand_read_status(nand, &status);
+		if (ERROR_OK != retval) {
+			LOG_ERROR("couldn't read status");
+			return ERROR_NAND_OPERATION_FAILED;
+		}
+	} else {
+		/* the status that reports ready also has the result */
+		if (!nand_poll_status(nand, 100, &status))
+			return ERROR_NAND_OPERATION_TIMEOUT;
 	}
 
 	if (status & NAND_STATUS_FAIL) {
@@ -846,6 +876,32 @@ int nand_write_finish(struct nand_device *nand)
 	return ERROR_OK;
 }
 
+int nand_write_finish(struct nand_device *nand)
+{
+	nand->controller->command(nand, NAND_CMD_PAGEPROG);
+
+	return nand_write_wait(nand);
+}
+
+/**
+ * Wait for a page program left running by nand_write_page_raw() with
+ * defer_write_status set, and report its result.
+ */
+int nand_write_flush(struct nand_device *nand)
+{
+	int retval;
+
+	if (!nand->write_pending)
+		return ERROR_OK;
+
+	nand->write_pending = false;
+	retval = nand_write_wait(nand);
+	if (retval != ERROR_OK)
+		LOG_ERROR("programming NAND page %" PRIu32 " failed", nand->write_pending_page);
+
+	return retval;
+}
+
 int nand_write_page_raw(struct nand_device *nand, uint32_t page,
 	uint8_t *data, uint32_t data_size,
 	uint8_t *oob, uint32_t oob_size)
@@ -872,5 +928,14 @@ int nand_write_page_raw(struct nand_device *nand, uint32_t page,
 		}
 	}
 
-	return nand_write_finish(nand);
+	nand->controller->command(nand, NAND_CMD_PAGEPROG);
+
+	/* the caller can get the next page ready while this one programs */
+	if (nand->defer_write_status) {
+		nand->write_pending = true;
+		nand->write_pending_page = page;
+		return ERROR_OK;
+	}
+
+	return nand_write_wait(nand);
 }
@@ -67,6 +67,11 @@ struct nand_device {
 	int page_size;
 	int erase_size;
 	bool use_raw;
+	/* let raw page writes return once the program has started, the
+	 * status is checked by the next operation or nand_write_flush() */
+	bool defer_write_status;
+	bool write_pending;
+	uint32_t write_pending_page;
 	int num_blocks;
 	struct nand_block *blocks;
 	struct nand_device *next;
@@ -201,6 +206,7 @@ int nand_write_data_page(struct nand_device *nand,
 			 uint8_t *data, uint32_t size);
 
 int nand_write_finish(struct nand_device *nand);
+int nand_write_flush(struct nand_device *nand);
 
 int nand_read_page_raw(struct nand_device *nand, uint32_t page,
 		       uint8_t *data, uint32_t data_size, uint8_t *oob, uint32_t oob_size);
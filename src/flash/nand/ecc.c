@@ -64,30 +64,47 @@ static const uint8_t nand_ecc_precalc_table[] = {
 	0x00, 0x55, 0x56, 0x03, 0x59, 0x0c, 0x0f, 0x5a, 0x5a, 0x0f, 0x0c, 0x59, 0x03, 0x56, 0x55, 0x00
 };
 
+static inline unsigned int parity32(uint32_t v)
+{
+	v ^= v >> 16;
+	v ^= v >> 8;
+	return (nand_ecc_precalc_table[v & 0xff] >> 6) & 1;
+}
+
 /*
  * nand_calculate_ecc - Calculate 3-byte ECC for 256-byte block
+ *
+ * Every parity bit is linear in the data, so the block is folded four
+ * bytes at a time: "all" is the XOR of every word, line[k] the XOR of
+ * the words whose index has bit k set.  Byte lanes of "all" give the two
+ * low line parity bits, the line[] words the six high ones.
  */
 int nand_calculate_ecc(struct nand_device *nand, const uint8_t *dat, uint8_t *ecc_code)
 {
-	uint8_t idx, reg1, reg2, reg3, tmp1, tmp2;
-	int i;
-
-	/* Initialize variables */
-	reg1 = reg2 = reg3 = 0;
-
-	/* Build up column parity */
-	for (i = 0; i < 256; i++) {
-		/* Get CP0 - CP5 from table */
-		idx = nand_ecc_precalc_table[*dat++];
-		reg1 ^= (idx & 0x3f);
-
-		/* All bit XOR = 1 ? */
-		if (idx & 0x40) {
-			reg3 ^= (uint8_t) i;
-			reg2 ^= ~((uint8_t) i);
-		}
+	uint8_t reg1, reg2, reg3, tmp1, tmp2;
+	uint32_t all = 0, line[6] = { 0 };
+	int i, k;
+
+	for (i = 0; i < 64; i++) {
+		uint32_t w = le_to_h_u32(dat + 4 * i);
+
+		all ^= w;
+		for (k = 0; k < 6; k++)
+			if (i & (1 << k))
+				line[k] ^= w;
 	}
 
+	/* CP0 - CP5 of the XOR of all bytes */
+	reg1 = nand_ecc_precalc_table[(all ^ (all >> 8) ^ (all >> 16) ^ (all >> 24)) & 0xff] & 0x3f;
+
+	/* XOR of the offsets of all bytes with odd parity */
+	reg3 = parity32(all & 0xff00ff00) | (parity32(all & 0xffff0000) << 1);
+	for (k = 0; k < 6; k++)
+		reg3 |= parity32(line[k]) << (k + 2);
+
+	/* the same over the inverted offsets */
+	reg2 = parity32(all) ? ~reg3 : reg3;
+
 	/* Create non-inverted ECC code from line parity */
 	tmp1  = (reg3 & 0x80) >> 0; /* B7 -> B7 */
 	tmp1 |= (reg2 & 0x80) >> 1; /* B7 -> B6 */
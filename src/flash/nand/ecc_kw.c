@@ -73,6 +73,30 @@ static void gf_build_log_exp_table(void)
 	}
 }
 
+/*
+ * Logs of the generator polynomial coefficients, highest power first.
+ */
+static const uint16_t gen_log[8] = {
+	0x21c, 0x181, 0x18e, 0x25f, 0x197, 0x193, 0x237, 0x024,
+};
+
+/*
+ * gf_mul_gen[k][b] = b * (x ^ gen_log[k]), so one reduction step is
+ * eight lookups with no log lookup or zero test in between.
+ */
+static uint16_t gf_mul_gen[8][1024];
+
+static void gf_build_mul_gen_table(void)
+{
+	int k, b;
+
+	for (k = 0; k < 8; k++) {
+		gf_mul_gen[k][0] = 0;
+		for (b = 1; b < 1024; b++)
+			gf_mul_gen[k][b] = gf_exp[gf_log[b] + gen_log[k]];
+	}
+}
+
 
 /*****************************************************************************
  * Reed-Solomon code
@@ -109,6 +133,7 @@ int nand_calculate_ecc_kw(struct nand_device *nand, const uint8_t *data, uint8_t
 
 	if (!tables_initialized) {
 		gf_build_log_exp_table();
+		gf_build_mul_gen_table();
 		tables_initialized = 1;
 	}
 
@@ -130,33 +155,21 @@ int nand_calculate_ecc_kw(struct nand_device *nand, const uint8_t *data, uint8_t
 	 * generator polynomial in every step.
 	 */
 	for (i = 503; i >= -8; i--) {
-		unsigned int d;
+		unsigned int d, t;
 
 		d = 0;
 		if (i >= 0)
 			d = data[i];
 
-		if (r7) {
-			uint16_t *t = gf_exp + gf_log[r7];
-
-			r7 = r6 ^ t[0x21c];
-			r6 = r5 ^ t[0x181];
-			r5 = r4 ^ t[0x18e];
-			r4 = r3 ^ t[0x25f];
-			r3 = r2 ^ t[0x197];
-			r2 = r1 ^ t[0x193];
-			r1 = r0 ^ t[0x237];
-			r0 = d  ^ t[0x024];
-		} else {
-			r7 = r6;
-			r6 = r5;
-			r5 = r4;
-			r4 = r3;
-			r3 = r2;
-			r2 = r1;
-			r1 = r0;
-			r0 = d;
-		}
+		t = r7;
+		r7 = r6 ^ gf_mul_gen[0][t];
+		r6 = r5 ^ gf_mul_gen[1][t];
+		r5 = r4 ^ gf_mul_gen[2][t];
+		r4 = r3 ^ gf_mul_gen[3][t];
+		r3 = r2 ^ gf_mul_gen[4][t];
+		r2 = r1 ^ gf_mul_gen[5][t];
+		r1 = r0 ^ gf_mul_gen[6][t];
+		r0 = d  ^ gf_mul_gen[7][t];
 	}
 
 	ecc[0] = r0;
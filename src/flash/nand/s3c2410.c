@@ -112,5 +112,7 @@ struct nand_flash_controller s3c2410_nand_controller = {
 	.read_data = &s3c2410_read_data,
 	.write_page = s3c24xx_write_page,
 	.read_page = s3c24xx_read_page,
+	.write_block_data = &s3c24xx_write_block_data,
+	.read_block_data = &s3c24xx_read_block_data,
 	.nand_ready = &s3c2410_nand_ready,
 };
@@ -33,12 +33,15 @@ S3C24XX_DEVICE_COMMAND()
 	*info = NULL;
 
 	struct s3c24xx_nand_controller *s3c24xx_info;
-	s3c24xx_info = malloc(sizeof(struct s3c24xx_nand_controller));
+	s3c24xx_info = calloc(1, sizeof(struct s3c24xx_nand_controller));
 	if (s3c24xx_info == NULL) {
 		LOG_ERROR("no memory for nand controller");
 		return -ENOMEM;
 	}
 
+	s3c24xx_info->io.target = nand->target;
+	s3c24xx_info->io.op = ARM_NAND_NONE;
+
 	nand->controller_priv = s3c24xx_info;
 	*info = s3c24xx_info;
 
@@ -115,3 +118,61 @@ int s3c24xx_read_data(struct nand_device *nand, void *data)
 	target_read_u8(target, s3c24xx_info->data, data);
 	return ERROR_OK;
 }
+
+/* move a block through the byte wide data register using a copy loop
+ * on the core, falling back to one target access per byte when there
+ * is no working area for it */
+
+int s3c24xx_write_block_data(struct nand_device *nand, uint8_t *data, int data_size)
+{
+	struct s3c24xx_nand_controller *s3c24xx_info = nand->controller_priv;
+	struct target *target = nand->target;
+	int retval;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("target must be halted to use S3C24XX NAND flash controller");
+		return ERROR_NAND_OPERATION_FAILED;
+	}
+
+	s3c24xx_info->io.data = s3c24xx_info->data;
+	s3c24xx_info->io.chunk_size = nand->page_size;
+
+	retval = arm_nandwrite(&s3c24xx_info->io, data, data_size);
+	if (retval != ERROR_NAND_NO_BUFFER)
+		return retval;
+
+	while (data_size-- > 0) {
+		retval = target_write_u8(target, s3c24xx_info->data, *data++);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
+int s3c24xx_read_block_data(struct nand_device *nand, uint8_t *data, int data_size)
+{
+	struct s3c24xx_nand_controller *s3c24xx_info = nand->controller_priv;
+	struct target *target = nand->target;
+	int retval;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("target must be halted to use S3C24XX NAND flash controller");
+		return ERROR_NAND_OPERATION_FAILED;
+	}
+
+	s3c24xx_info->io.data = s3c24xx_info->data;
+	s3c24xx_info->io.chunk_size = nand->page_size;
+
+	retval = arm_nandread(&s3c24xx_info->io, data, data_size);
+	if (retval != ERROR_NAND_NO_BUFFER)
+		return retval;
+
+	while (data_size-- > 0) {
+		retval = target_read_u8(target, s3c24xx_info->data, data++);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
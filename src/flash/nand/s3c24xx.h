@@ -26,6 +26,7 @@
  */
 
 #include "imp.h"
+#include "arm_io.h"
 #include "s3c24xx_regs.h"
 #include <target/target.h>
 
@@ -35,6 +36,9 @@ struct s3c24xx_nand_controller {
 	uint32_t		 addr;
 	uint32_t		 data;
 	uint32_t		 nfstat;
+
+	/* on-target copy loop for block data */
+	struct arm_nand_data	 io;
 };
 
 /* Default to using the un-translated NAND register based address */
@@ -63,6 +67,11 @@ int s3c24xx_address(struct nand_device *nand, uint8_t address);
 int s3c24xx_write_data(struct nand_device *nand, uint16_t data);
 int s3c24xx_read_data(struct nand_device *nand, void *data);
 
+int s3c24xx_write_block_data(struct nand_device *nand,
+		uint8_t *data, int data_size);
+int s3c24xx_read_block_data(struct nand_device *nand,
+		uint8_t *data, int data_size);
+
 #define s3c24xx_write_page NULL
 #define s3c24xx_read_page NULL
 
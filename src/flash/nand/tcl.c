@@ -249,26 +249,36 @@ COMMAND_HANDLER(handle_nand_write_command)
 	if (ERROR_OK != retval)
 		return retval;
 
+	/* read and ECC the next page while the last one programs */
+	nand->defer_write_status = true;
+
 	uint32_t total_bytes = s.size;
 	while (s.size > 0) {
 		int bytes_read = nand_fileio_read(nand, &s);
 		if (bytes_read <= 0) {
 			command_print(CMD_CTX, "error while reading file");
+			nand_write_flush(nand);
+			nand->defer_write_status = false;
 			return nand_fileio_cleanup(&s);
 		}
 		s.size -= bytes_read;
 
 		retval = nand_write_page(nand, s.address / nand->page_size,
 				s.page, s.page_size, s.oob, s.oob_size);
+		if (ERROR_OK == retval && s.size == 0)
+			retval = nand_write_flush(nand);
 		if (ERROR_OK != retval) {
 			command_print(CMD_CTX, "failed writing file %s "
 				"to NAND flash %s at offset 0x%8.8" PRIx32,
 				CMD_ARGV[1], CMD_ARGV[0], s.address);
+			nand->defer_write_status = false;
 			return nand_fileio_cleanup(&s);
 		}
 		s.address += s.page_size;
 	}
 
+	nand->defer_write_status = false;
+
 	if (nand_fileio_finish(&s) == ERROR_OK) {
 		command_print(CMD_CTX, "wrote file %s to NAND flash %s up to "
 			"offset 0x%8.8" PRIx32 " in %fs (%0.3f KiB/s)",
@@ -1603,6 +1603,125 @@ static int cfi_spansion_write_block_mips(struct flash_bank *bank, const uint8_t
 	return retval;
 }
 
+/* Streams the data through a ring buffer, so the host fills the next
+ * chunk while the core programs the previous one.  Cortex-M only: the
+ * ring pointers are polled while the algorithm runs. */
+static int cfi_spansion_write_block_async(struct flash_bank *bank, const uint8_t *buffer,
+	uint32_t address, uint32_t count)
+{
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+	struct cfi_spansion_pri_ext *pri_ext = cfi_info->pri_ext;
+	struct target *target = bank->target;
+	struct reg_param reg_params[10];
+	struct armv7m_algorithm armv7m_algo;
+	struct working_area *write_algorithm;
+	struct working_area *source;
+	uint32_t buffer_size = 32768;
+	uint32_t dq5_mask = 0;
+	int retval;
+
+	/* see contrib/loaders/flash/armv7m_cfi_span_16_async.s for src */
+	static const uint32_t armv7m_word_16_async_code[] = {
+		0xF8D06846,
+		0xF1BCC000,
+		0xD0290F00,
+		0xD0F845B4,
+		0x7B02F836,
+		0xBF28428E,
+		0x0608F100,
+		0xF8A86046,
+		0xF8AA9000,
+		0xF8A8B000,
+		0x80174000,
+		0xC000F8B2,
+		0x0E07EA8C,
+		0x0F05EA1E,
+		0xEA1CD00E,
+		0xD0F54F15,
+		0xC000F8B2,
+		0x0E07EA8C,
+		0x0F05EA1E,
+		0xF05FD004,
+		0xF8C00C00,
+		0xE003C004,
+		0x0202F102,
+		0xD1D01E5B,
+		0x0000BE00
+	};
+	uint8_t target_code[sizeof(armv7m_word_16_async_code)];
+
+	if (!is_armv7m(target_to_armv7m(target)) || bank->bus_width != 2)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	retval = target_alloc_working_area_try(target, sizeof(target_code), &write_algorithm);
+	if (retval != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	target_buffer_set_u32_array(target, target_code,
+			ARRAY_SIZE(armv7m_word_16_async_code), armv7m_word_16_async_code);
+	retval = target_write_buffer(target, write_algorithm->address,
+			sizeof(target_code), target_code);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, write_algorithm);
+		return retval;
+	}
+
+	while (target_alloc_working_area_try(target, buffer_size, &source) != ERROR_OK) {
+		buffer_size /= 2;
+		if (buffer_size <= 256) {
+			target_free_working_area(target, write_algorithm);
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+	}
+
+	/* without DQ5 the loader polls DQ7 only */
+	if (cfi_info->status_poll_mask & (1 << 5))
+		dq5_mask = cfi_command_val(bank, 0x20);
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);	/* fifo start */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* fifo end */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_IN_OUT);	/* destination */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* number of writes */
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);	/* write command */
+	init_reg_param(&reg_params[5], "r5", 32, PARAM_OUT);	/* DQ7 and DQ5 masks */
+	init_reg_param(&reg_params[6], "r8", 32, PARAM_OUT);
+	init_reg_param(&reg_params[7], "r9", 32, PARAM_OUT);
+	init_reg_param(&reg_params[8], "r10", 32, PARAM_OUT);
+	init_reg_param(&reg_params[9], "r11", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, source->address);
+	buf_set_u32(reg_params[1].value, 0, 32, source->address + source->size);
+	buf_set_u32(reg_params[2].value, 0, 32, address);
+	buf_set_u32(reg_params[3].value, 0, 32, count / 2);
+	buf_set_u32(reg_params[4].value, 0, 32, cfi_command_val(bank, 0xA0));
+	buf_set_u32(reg_params[5].value, 0, 32, cfi_command_val(bank, 0x80) | (dq5_mask << 16));
+	buf_set_u32(reg_params[6].value, 0, 32, flash_address(bank, 0, pri_ext->_unlock1));
+	buf_set_u32(reg_params[7].value, 0, 32, 0xaaaaaaaa);
+	buf_set_u32(reg_params[8].value, 0, 32, flash_address(bank, 0, pri_ext->_unlock2));
+	buf_set_u32(reg_params[9].value, 0, 32, 0x55555555);
+
+	armv7m_algo.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_algo.core_mode = ARM_MODE_THREAD;
+
+	retval = target_run_flash_async_algorithm(target, buffer, count / 2, 2,
+			0, NULL,
+			10, reg_params,
+			source->address, source->size,
+			write_algorithm->address, 0,
+			&armv7m_algo);
+	if (retval == ERROR_FLASH_OPERATION_FAILED)
+		LOG_ERROR("flash write block failed at address 0x%" PRIx32,
+				buf_get_u32(reg_params[2].value, 0, 32));
+
+	target_free_working_area(target, source);
+	target_free_working_area(target, write_algorithm);
+
+	for (unsigned i = 0; i < ARRAY_SIZE(reg_params); i++)
+		destroy_reg_param(&reg_params[i]);
+
+	return retval;
+}
+
 static int cfi_spansion_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	uint32_t address, uint32_t count)
 {
@@ -1810,6 +1929,11 @@ static int cfi_spansion_write_block(struct flash_bank *bank, const uint8_t *buff
 	if (strncmp(target_type_name(target), "mips_m4k", 8) == 0)
 		return cfi_spansion_write_block_mips(bank, buffer, address, count);
 
+	retval = cfi_spansion_write_block_async(bank, buffer, address, count);
+	if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		return retval;
+	retval = ERROR_OK;
+
 	if (is_armv7m(target_to_armv7m(target))) {	/* armv7m target */
 		armv7m_algo.common_magic = ARMV7M_COMMON_MAGIC;
 		armv7m_algo.core_mode = ARM_MODE_THREAD;
@@ -26,6 +26,9 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <server/server.h>
+#include <helper/time_support.h>
+#include <helper/tracelog.h>
 
 /**
  * @file
@@ -36,13 +39,109 @@
 
 static struct flash_bank *flash_banks;
 
+static struct flash_phase_stats flash_stats[FLASH_PHASE_NUM];
+static struct flash_progress flash_progress_state;
+static int64_t flash_progress_reported;
+
+static const char * const flash_phase_names[FLASH_PHASE_NUM] = {
+	[FLASH_PHASE_PROBE] = "probe",
+	[FLASH_PHASE_ISP_INIT] = "isp_init",
+	[FLASH_PHASE_LOADER] = "loader",
+	[FLASH_PHASE_ERASE] = "erase",
+	[FLASH_PHASE_PROGRAM] = "program",
+	[FLASH_PHASE_VERIFY] = "verify",
+};
+
+const char *flash_phase_name(enum flash_phase phase)
+{
+	return flash_phase_names[phase];
+}
+
+void flash_stats_add(enum flash_phase phase, uint32_t bytes, int64_t start_ms)
+{
+	flash_stats[phase].calls++;
+	flash_stats[phase].bytes += bytes;
+	flash_stats[phase].ms += timeval_ms() - start_ms;
+
+	tracelog_complete(TRACELOG_FLASH, flash_phase_name(phase), start_ms * 1000, bytes, 0);
+}
+
+const struct flash_phase_stats *flash_stats_get(enum flash_phase phase)
+{
+	return &flash_stats[phase];
+}
+
+void flash_stats_reset(void)
+{
+	memset(flash_stats, 0, sizeof(flash_stats));
+}
+
+void flash_progress(struct target *target, enum flash_phase phase,
+	uint32_t done, uint32_t total)
+{
+	int64_t now = timeval_ms();
+
+	if (phase != flash_progress_state.phase || done == 0) {
+		flash_progress_state.phase = phase;
+		flash_progress_state.start_ms = now;
+	}
+	flash_progress_state.done = done;
+	flash_progress_state.total = total;
+
+	/* don't flood event handlers, but always report start and end */
+	if (done != 0 && done < total && now - flash_progress_reported < FLASH_PROGRESS_INTERVAL_MS)
+		return;
+	flash_progress_reported = now;
+
+	target_call_event_callbacks(target, TARGET_EVENT_FLASH_PROGRESS);
+}
+
+const struct flash_progress *flash_progress_get(void)
+{
+	return &flash_progress_state;
+}
+
+int flash_driver_auto_probe(struct flash_bank *bank)
+{
+	/* only count probes that find out about the bank */
+	bool unprobed = bank->num_sectors == 0;
+	int64_t start = timeval_ms();
+	int retval;
+
+	retval = bank->driver->auto_probe(bank);
+	if (retval == ERROR_OK && unprobed && bank->num_sectors != 0)
+		flash_stats_add(FLASH_PHASE_PROBE, 0, start);
+
+	return retval;
+}
+
+/* set is_erased of the sectors overlapping [offset, offset + count) */
+static void flash_mark_sectors(struct flash_bank *bank, uint32_t offset,
+	uint32_t count, int is_erased)
+{
+	for (int i = 0; i < bank->num_sectors; i++) {
+		struct flash_sector *sector = &bank->sectors[i];
+		if (offset < sector->offset + sector->size && sector->offset < offset + count)
+			sector->is_erased = is_erased;
+	}
+}
+
 int flash_driver_erase(struct flash_bank *bank, int first, int last)
 {
+	int64_t start = timeval_ms();
+	uint32_t bytes = 0;
 	int retval;
 
 	retval = bank->driver->erase(bank, first, last);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %d to %d", first, last);
+	else {
+		for (int i = first; i <= last; i++) {
+			bank->sectors[i].is_erased = 1;
+			bytes += bank->sectors[i].size;
+		}
+		flash_stats_add(FLASH_PHASE_ERASE, bytes, start);
+	}
 
 	return retval;
 }
@@ -81,6 +180,7 @@ int flash_driver_protect(struct flash_bank *bank, int set, int first, int last)
 int flash_driver_write(struct flash_bank *bank,
 	uint8_t *buffer, uint32_t offset, uint32_t count)
 {
+	int64_t start = timeval_ms();
 	int retval;
 
 	retval = bank->driver->write(bank, buffer, offset, count);
@@ -89,6 +189,33 @@ int flash_driver_write(struct flash_bank *bank,
 			"error writing to flash at address 0x%08" PRIx32 " at offset 0x%8.8" PRIx32,
 			bank->base,
 			offset);
+		/* a failed write may have programmed part of the range */
+		flash_mark_sectors(bank, offset, count, -1);
+	} else {
+		flash_mark_sectors(bank, offset, count, 0);
+		flash_stats_add(FLASH_PHASE_PROGRAM, count, start);
+	}
+
+	return retval;
+}
+
+int flash_driver_erase_write(struct flash_bank *bank,
+	uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	int64_t start = timeval_ms();
+	int retval;
+
+	retval = bank->driver->erase_write(bank, buffer, offset, count);
+	if (retval != ERROR_OK) {
+		LOG_ERROR(
+			"error erasing and writing flash at address 0x%08" PRIx32 " at offset 0x%8.8" PRIx32,
+			bank->base,
+			offset);
+		flash_mark_sectors(bank, offset, count, -1);
+	} else {
+		flash_mark_sectors(bank, offset, count, 0);
+		/* erase time is not known separately, count it as programming */
+		flash_stats_add(FLASH_PHASE_PROGRAM, count, start);
 	}
 
 	return retval;
@@ -118,10 +245,36 @@ int default_flash_read(struct flash_bank *bank,
 	return target_read_buffer(bank->target, offset + bank->base, count, buffer);
 }
 
+/* Code running on the target, or a reset, may change flash behind our back;
+ * forget what is known about the erase state of its sectors. */
+static int flash_target_event(struct target *target, enum target_event event, void *priv)
+{
+	switch (event) {
+		case TARGET_EVENT_RESUMED:
+		case TARGET_EVENT_RESET_START:
+		case TARGET_EVENT_RESET_ASSERT:
+			for (struct flash_bank *c = flash_banks; c; c = c->next) {
+				if (c->target != target)
+					continue;
+				for (int i = 0; i < c->num_sectors; i++)
+					c->sectors[i].is_erased = -1;
+			}
+			break;
+		default:
+			break;
+	}
+
+	return ERROR_OK;
+}
+
 void flash_bank_add(struct flash_bank *bank)
 {
 	/* put flash bank in linked list */
 	unsigned bank_num = 0;
+
+	if (flash_banks == NULL)
+		target_register_event_callback(flash_target_event, NULL);
+
 	if (flash_banks) {
 		/* find last flash bank */
 		struct flash_bank *p = flash_banks;
@@ -189,7 +342,7 @@ int get_flash_bank_by_name(const char *name, struct flash_bank **bank_result)
 
 	bank = get_flash_bank_by_name_noprobe(name);
 	if (bank != NULL) {
-		retval = bank->driver->auto_probe(bank);
+		retval = flash_driver_auto_probe(bank);
 
 		if (retval != ERROR_OK) {
 			LOG_ERROR("auto_probe failed");
@@ -209,7 +362,7 @@ int get_flash_bank_by_num(int num, struct flash_bank **bank)
 	if (p == NULL)
 		return ERROR_FAIL;
 
-	retval = p->driver->auto_probe(p);
+	retval = flash_driver_auto_probe(p);
 
 	if (retval != ERROR_OK) {
 		LOG_ERROR("auto_probe failed");
@@ -234,7 +387,7 @@ int get_flash_bank_by_addr(struct target *target,
 			continue;
 
 		int retval;
-		retval = c->driver->auto_probe(c);
+		retval = flash_driver_auto_probe(c);
 
 		if (retval != ERROR_OK) {
 			LOG_ERROR("auto_probe failed");
@@ -305,33 +458,36 @@ done:
 int default_flash_blank_check(struct flash_bank *bank)
 {
 	struct target *target = bank->target;
+	struct target_memory_check_block *blocks;
 	int i;
 	int retval;
-	int fast_check = 0;
-	uint32_t blank;
 
 	if (bank->target->state != TARGET_HALTED) {
 		LOG_ERROR("Target not halted");
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
+	if (bank->num_sectors == 0)
+		return ERROR_OK;
+
+	/* all sectors in one go, where the target can */
+	blocks = malloc(bank->num_sectors * sizeof(*blocks));
+	if (blocks == NULL)
+		return ERROR_FAIL;
+
 	for (i = 0; i < bank->num_sectors; i++) {
-		uint32_t address = bank->base + bank->sectors[i].offset;
-		uint32_t size = bank->sectors[i].size;
+		blocks[i].address = bank->base + bank->sectors[i].offset;
+		blocks[i].size = bank->sectors[i].size;
+	}
 
-		retval = target_blank_check_memory(target, address, size, &blank);
-		if (retval != ERROR_OK) {
-			fast_check = 0;
-			break;
-		}
-		if (blank == 0xFF)
-			bank->sectors[i].is_erased = 1;
-		else
-			bank->sectors[i].is_erased = 0;
-		fast_check = 1;
+	retval = target_blank_check_memory_blocks(target, blocks, bank->num_sectors);
+	if (retval == ERROR_OK) {
+		for (i = 0; i < bank->num_sectors; i++)
+			bank->sectors[i].is_erased = (blocks[i].result == 0xFF) ? 1 : 0;
 	}
+	free(blocks);
 
-	if (!fast_check) {
+	if (retval != ERROR_OK) {
 		LOG_USER("Running slow fallback erase check - add working memory");
 		return default_flash_mem_blank_check(bank);
 	}
@@ -538,6 +694,47 @@ int flash_unlock_address_range(struct target *target, uint32_t addr, uint32_t le
 		addr, length, true, &flash_driver_unprotect);
 }
 
+/* erase the sectors in first..last not known to be erased, in runs */
+static int flash_driver_erase_dirty(struct flash_bank *bank, int first, int last)
+{
+	int retval = ERROR_OK;
+
+	for (int i = first; i <= last && retval == ERROR_OK; ) {
+		if (bank->sectors[i].is_erased == 1) {
+			i++;
+			continue;
+		}
+
+		int j = i + 1;
+		while (j <= last && bank->sectors[j].is_erased != 1)
+			j++;
+
+		retval = flash_driver_erase(bank, i, j - 1);
+		i = j;
+	}
+
+	return retval;
+}
+
+int flash_erase_dirty_address_range(struct target *target,
+	bool pad, uint32_t addr, uint32_t length)
+{
+	return flash_iterate_address_range(target, pad ? "erase" : NULL,
+		addr, length, false, &flash_driver_erase_dirty);
+}
+
+/* index of the sector holding bank offset 'offset', -1 if unknown */
+static int flash_sector_index(struct flash_bank *bank, uint32_t offset)
+{
+	for (int i = 0; i < bank->num_sectors; i++) {
+		if (offset >= bank->sectors[i].offset &&
+				offset - bank->sectors[i].offset < bank->sectors[i].size)
+			return i;
+	}
+
+	return -1;
+}
+
 static int compare_section(const void *a, const void *b)
 {
 	struct imagesection *b1, *b2;
@@ -552,11 +749,151 @@ static int compare_section(const void *a, const void *b)
 		return -1;
 }
 
-int flash_write_unlock(struct target *target, struct image *image,
-	uint32_t *written, int erase, bool unlock)
+int flash_write_start(struct target *target)
 {
 	int retval = ERROR_OK;
 
+	for (struct flash_bank *c = flash_bank_list(); c; c = c->next) {
+		if (c->target == target && c->driver->write_start) {
+			int retval2 = c->driver->write_start(c);
+			if (retval == ERROR_OK)
+				retval = retval2;
+		}
+	}
+
+	return retval;
+}
+
+int flash_write_done(struct target *target)
+{
+	int retval = ERROR_OK;
+
+	for (struct flash_bank *c = flash_bank_list(); c; c = c->next) {
+		if (c->target == target && c->driver->write_done) {
+			int retval2 = c->driver->write_done(c);
+			if (retval == ERROR_OK)
+				retval = retval2;
+		}
+	}
+
+	return retval;
+}
+
+/* Program only the sectors of a run whose flash contents differ from
+ * 'buffer', comparing the host CRC of each sector piece with the one the
+ * target computes.  'changed' receives the number of bytes programmed. */
+static int flash_write_delta(struct flash_bank *c, uint8_t *buffer,
+	uint32_t address, uint32_t count, int erase, uint32_t *changed)
+{
+	struct target *target = c->target;
+	uint32_t offset = address - c->base;
+	int first = flash_sector_index(c, offset);
+	int last = flash_sector_index(c, offset + count - 1);
+	uint32_t *crc, *piece;
+	bool uniform;
+	int n, i, retval;
+
+	*changed = 0;
+	if (first < 0 || last < 0)
+		goto write_all;
+
+	n = last - first + 1;
+	crc = malloc(n * sizeof(uint32_t));
+	piece = malloc(n * sizeof(uint32_t));
+	if (crc == NULL || piece == NULL) {
+		free(crc);
+		free(piece);
+		goto write_all;
+	}
+
+	/* bank offset where each piece ends */
+	uniform = (offset == c->sectors[first].offset);
+	for (i = 0; i < n; i++) {
+		struct flash_sector *s = &c->sectors[first + i];
+		piece[i] = MIN(s->offset + s->size, offset + count);
+		if (s->size != c->sectors[first].size)
+			uniform = false;
+	}
+
+	/* one algorithm run for equal sectors, else one per sector */
+	if (uniform)
+		retval = target_checksum_memory_chunks(target, address, count,
+				c->sectors[first].size, crc);
+	else {
+		retval = ERROR_OK;
+		for (i = 0; i < n && retval == ERROR_OK; i++) {
+			uint32_t start = i ? piece[i - 1] : offset;
+			retval = target_checksum_memory(target, c->base + start,
+					piece[i] - start, &crc[i]);
+		}
+	}
+	if (retval != ERROR_OK) {
+		LOG_WARNING("no target checksum, writing all of 0x%8.8" PRIx32, address);
+		free(crc);
+		free(piece);
+		goto write_all;
+	}
+
+	for (i = 0; i < n; i++) {
+		uint32_t start = i ? piece[i - 1] : offset;
+		uint32_t host;
+
+		image_calculate_checksum(buffer + start - offset, piece[i] - start, &host);
+		crc[i] = (crc[i] != host);
+	}
+
+	/* one erase and write for every run of changed sectors */
+	retval = ERROR_OK;
+	for (i = 0; i < n && retval == ERROR_OK; ) {
+		if (!crc[i]) {
+			i++;
+			continue;
+		}
+
+		int end = i + 1;
+		while (end < n && crc[end])
+			end++;
+
+		uint32_t start = i ? piece[i - 1] : offset;
+		uint32_t length = piece[end - 1] - start;
+		uint8_t *data = buffer + start - offset;
+
+		LOG_DEBUG("delta: sectors %d..%d changed", first + i, first + end - 1);
+		if (erase && c->driver->erase_write)
+			retval = flash_driver_erase_write(c, data, start, length);
+		else {
+			if (erase)
+				retval = flash_erase_dirty_address_range(target, true,
+						c->base + start, length);
+			if (retval == ERROR_OK)
+				retval = flash_driver_write(c, data, start, length);
+		}
+		*changed += length;
+		i = end;
+	}
+
+	free(crc);
+	free(piece);
+	return retval;
+
+write_all:
+	*changed = count;
+	if (erase && c->driver->erase_write)
+		return flash_driver_erase_write(c, buffer, offset, count);
+	if (erase) {
+		retval = flash_erase_dirty_address_range(target, true, address, count);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	return flash_driver_write(c, buffer, offset, count);
+}
+
+int flash_write_unlock(struct target *target, struct image *image,
+	uint32_t *written, int erase, bool unlock, bool delta_mode)
+{
+	int retval = ERROR_OK, retval2;
+	uint32_t changed = 0;
+
 	int section;
 	uint32_t section_offset;
 	struct flash_bank *c;
@@ -568,16 +905,12 @@ int flash_write_unlock(struct target *target, struct image *image,
 	if (written)
 		*written = 0;
 
-	if (erase) {
-		/* assume all sectors need erasing - stops any problems
-		 * when flash_write is called multiple times */
-
-		flash_set_dirty();
-	}
-
 	/* allocate padding array */
 	padding = calloc(image->num_sections, sizeof(*padding));
 
+	/* one session for every bank the image may touch */
+	retval = flash_write_start(target);
+
 	/* This fn requires all sections to be in ascending order of addresses,
 	 * whereas an image can have sections out of order. */
 	struct imagesection **sections = malloc(sizeof(struct imagesection *) *
@@ -589,14 +922,25 @@ int flash_write_unlock(struct target *target, struct image *image,
 	qsort(sections, image->num_sections, sizeof(struct imagesection *),
 		compare_section);
 
+	uint32_t image_total = 0;
+	for (i = 0; i < image->num_sections; i++)
+		image_total += sections[i]->size;
+	flash_progress(target, FLASH_PHASE_PROGRAM, 0, image_total);
+
 	/* loop until we reach end of the image */
-	while (section < image->num_sections) {
+	while (retval == ERROR_OK && section < image->num_sections) {
 		uint32_t buffer_size;
 		uint8_t *buffer;
+		bool mapped;
 		int section_last;
 		uint32_t run_address = sections[section]->base_address + section_offset;
 		uint32_t run_size = sections[section]->size - section_offset;
-		//int pad_bytes = 0;
+
+		if (server_interrupt_requested()) {
+			LOG_ERROR("flash write interrupted");
+			retval = ERROR_FAIL;
+			break;
+		}
 
 		if (sections[section]->size ==  0) {
 			LOG_WARNING("empty section %d", section);
@@ -616,47 +960,47 @@ int flash_write_unlock(struct target *target, struct image *image,
 			continue;
 		}
 
-		/* collect consecutive sections which fall into the same bank */
+		/* collect consecutive sections which fall into the same bank.
+		 *
+		 * Adjacent sections are always merged.  A gap is padded only
+		 * with auto erase, and only when it ends in the sector the run
+		 * already touches: filling untouched sectors would needlessly
+		 * erase or write them, which can invalidate ECC (Stellaris
+		 * Tempest) or wear the flash.  Small sections such as
+		 * .isr_vector, .text, .rodata and .ARM.exidx then go to the
+		 * driver in a single write.
+		 */
 		section_last = section;
 		padding[section] = 0;
-		//if (erase) {
-		//	while ((run_address + run_size - 1 < c->base + c->size - 1) &&
-		//		(section_last + 1 < image->num_sections)) {
-		//		/* sections are sorted */
-		//		assert(sections[section_last + 1]->base_address >= c->base);
-		//		if (sections[section_last + 1]->base_address >= (c->base + c->size)) {
-		//			/* Done with this bank */
-		//			break;
-		//		}
-
-		//		/* FIXME This needlessly touches sectors BETWEEN the
-		//		 * sections it's writing.  Without auto erase, it just
-		//		 * writes ones.  That WILL INVALIDATE data in cases
-		//		 * like Stellaris Tempest chips, corrupting internal
-		//		 * ECC codes; and at least FreeScale suggests issues
-		//		 * with that approach (in HC11 documentation).
-		//		 *
-		//		 * With auto erase enabled, data in those sectors will
-		//		 * be needlessly destroyed; and some of the limited
-		//		 * number of flash erase cycles will be wasted...
-		//		 *
-		//		 * In both cases, the extra writes slow things down.
-		//		 */
-
-		//		/* if we have multiple sections within our image,
-		//		 * flash programming could fail due to alignment issues
-		//		 * attempt to rebuild a consecutive buffer for the flash loader */
-		//		pad_bytes = (sections[section_last + 1]->base_address) - (run_address + run_size);
-		//		padding[section_last] = pad_bytes;
-		//		run_size += sections[++section_last]->size;
-		//		run_size += pad_bytes;
-
-		//		if (pad_bytes > 0)
-		//			LOG_INFO("Padding image section %d with %d bytes",
-		//			section_last - 1,
-		//			pad_bytes);
-		//	}
-		//}
+		while ((run_address + run_size - 1 < c->base + c->size - 1) &&
+				(section_last + 1 < image->num_sections)) {
+			struct imagesection *next = sections[section_last + 1];
+			uint32_t run_end = run_address + run_size;
+			uint32_t pad_bytes;
+
+			/* sections are sorted */
+			if (next->size == 0 || next->base_address < run_end ||
+					next->base_address >= c->base + c->size)
+				break;
+
+			pad_bytes = next->base_address - run_end;
+			if (pad_bytes) {
+				/* without erase the gap may hold data to keep */
+				if (!erase)
+					break;
+				int sector = flash_sector_index(c, run_end - 1 - c->base);
+				if (sector < 0 || sector != flash_sector_index(c, next->base_address - c->base))
+					break;
+			}
+
+			padding[section_last] = pad_bytes;
+			run_size += pad_bytes + next->size;
+			section_last++;
+
+			if (pad_bytes > 0)
+				LOG_DEBUG("Padding image section %d with %d bytes",
+					section_last - 1, (int)pad_bytes);
+		}
 
 		if (run_address + run_size - 1 > c->base + c->size - 1) {
 			/* If we have more than one flash chip back to back, then we limit
@@ -675,7 +1019,7 @@ int flash_write_unlock(struct target *target, struct image *image,
 			int sector;
 			uint32_t offset_start = run_address - c->base;
 			uint32_t offset_end = offset_start + run_size;
-			uint32_t end = offset_end, delta;
+			uint32_t end = offset_end, pad;
 
 			for (sector = 0; sector < c->num_sectors; sector++) {
 				end = c->sectors[sector].offset
@@ -684,19 +1028,39 @@ int flash_write_unlock(struct target *target, struct image *image,
 					break;
 			}
 
-			delta = end - offset_end;
-			padding[section_last] += delta;
-			run_size += delta;
+			pad = end - offset_end;
+			padding[section_last] += pad;
+			run_size += pad;
+		}
+
+		/* a run inside a single unpadded section is written straight
+		 * from the image, without a copy */
+		mapped = false;
+		if (padding[section] == 0 && sections[section]->size - section_offset >= run_size) {
+			intptr_t diff = (intptr_t)sections[section] - (intptr_t)image->sections;
+			int t_section_num = diff / sizeof(struct imagesection);
+
+			if (image_map_section(image, t_section_num, section_offset,
+					run_size, &buffer) == ERROR_OK) {
+				mapped = true;
+				section_offset += run_size;
+				if (section_offset >= sections[section]->size) {
+					section++;
+					section_offset = 0;
+				}
+			}
 		}
 
 		/* allocate buffer */
-		buffer = malloc(run_size);
-		if (buffer == NULL) {
-			LOG_ERROR("Out of memory for flash bank buffer");
-			retval = ERROR_FAIL;
-			goto done;
+		if (!mapped) {
+			buffer = malloc(run_size);
+			if (buffer == NULL) {
+				LOG_ERROR("Out of memory for flash bank buffer");
+				retval = ERROR_FAIL;
+				goto done;
+			}
 		}
-		buffer_size = 0;
+		buffer_size = mapped ? run_size : 0;
 
 		/* read sections to the buffer */
 		while (buffer_size < run_size) {
@@ -742,20 +1106,30 @@ int flash_write_unlock(struct target *target, struct image *image,
 
 		if (unlock)
 			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
+		if (retval == ERROR_OK && delta_mode) {
+			uint32_t run_changed;
+			retval = flash_write_delta(c, buffer, run_address, run_size, erase, &run_changed);
+			changed += run_changed;
+		} else if (retval == ERROR_OK && erase && c->driver->erase_write) {
+			/* erase and write flash sectors in one pass */
+			retval = flash_driver_erase_write(c, buffer, run_address - c->base, run_size);
+		} else {
+			if (retval == ERROR_OK) {
+				if (erase) {
+					/* calculate and erase sectors */
+					retval = flash_erase_dirty_address_range(target,
+							true, run_address, run_size);
+				}
 			}
-		}
 
-		if (retval == ERROR_OK) {
-			/* write flash sectors */
-			retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+			if (retval == ERROR_OK) {
+				/* write flash sectors */
+				retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+			}
 		}
 
-		free(buffer);
+		if (!mapped)
+			free(buffer);
 
 		if (retval != ERROR_OK) {
 			/* abort operation */
@@ -764,9 +1138,21 @@ int flash_write_unlock(struct target *target, struct image *image,
 
 		if (written != NULL)
 			*written += run_size;	/* add run size to total written counter */
+
+		uint32_t image_done = section_offset;
+		for (i = 0; i < section; i++)
+			image_done += sections[i]->size;
+		flash_progress(target, FLASH_PHASE_PROGRAM, image_done, image_total);
 	}
 
 done:
+	retval2 = flash_write_done(target);
+	if (retval == ERROR_OK)
+		retval = retval2;
+
+	if (retval == ERROR_OK && delta_mode)
+		LOG_INFO("delta: programmed %" PRIu32 " of %" PRIu32 " bytes", changed, image_total);
+
 	free(sections);
 	free(padding);
 
@@ -776,7 +1162,7 @@ done:
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, int erase)
 {
-	return flash_write_unlock(target, image, written, erase, false);
+	return flash_write_unlock(target, image, written, erase, false, false);
 }
 
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size, int num_blocks)
@@ -45,7 +45,9 @@ struct flash_sector {
 	uint32_t size;
 	/**
 	 * Indication of erasure status: 0 = not erased, 1 = erased,
-	 * other = unknown.  Set by @c flash_driver_s::erase_check.
+	 * other = unknown.  Set by @c flash_driver_s::erase_check, and
+	 * kept up to date by flash_driver_erase() and flash_driver_write().
+	 * Reset to unknown when the target resumes or is reset.
 	 *
 	 * Flag is not used in protection block
 	 */
@@ -128,6 +130,13 @@ int flash_register_commands(struct command_context *cmd_ctx);
  */
 int flash_erase_address_range(struct target *target,
 		bool pad, uint32_t addr, uint32_t length);
+/**
+ * Like flash_erase_address_range(), but skips sectors known to be
+ * erased.  Erase state is tracked per sector by erase, write and blank
+ * check, and forgotten when the target resumes or is reset.
+ */
+int flash_erase_dirty_address_range(struct target *target,
+		bool pad, uint32_t addr, uint32_t length);
 
 int flash_unlock_address_range(struct target *target, uint32_t addr,
 		uint32_t length);
@@ -145,6 +154,65 @@ int flash_unlock_address_range(struct target *target, uint32_t addr,
 int flash_write(struct target *target,
 		struct image *image, uint32_t *written, int erase);
 
+/**
+ * Open a write session on every bank of @a target, so that drivers can
+ * keep their setup over several flash_write() calls.  Every call must be
+ * paired with flash_write_done(), see write_start in struct flash_driver.
+ * @param target The target with the flash to be programmed.
+ * @returns ERROR_OK if successful; otherwise, an error code.
+ */
+int flash_write_start(struct target *target);
+/** Close a session opened by flash_write_start(). */
+int flash_write_done(struct target *target);
+
+/** Phases of flash operations timed by flash_stats_add(). */
+enum flash_phase {
+	FLASH_PHASE_PROBE,
+	FLASH_PHASE_ISP_INIT,	/* driver specific controller setup */
+	FLASH_PHASE_LOADER,		/* uploading flash algorithms */
+	FLASH_PHASE_ERASE,
+	FLASH_PHASE_PROGRAM,
+	FLASH_PHASE_VERIFY,
+	FLASH_PHASE_NUM,
+};
+
+struct flash_phase_stats {
+	unsigned int calls;
+	uint64_t bytes;
+	int64_t ms;
+};
+
+/** State of the running operation, as of the last flash_progress() call. */
+struct flash_progress {
+	enum flash_phase phase;
+	uint32_t done;
+	uint32_t total;
+	int64_t start_ms;
+};
+
+/* minimum time between two flash-progress events */
+#define FLASH_PROGRESS_INTERVAL_MS 250
+
+const char *flash_phase_name(enum flash_phase phase);
+/**
+ * Account one operation of @a phase on @a bytes, started at @a start_ms
+ * (a timeval_ms() value), in the statistics shown by 'flash stats'.
+ */
+void flash_stats_add(enum flash_phase phase, uint32_t bytes, int64_t start_ms);
+const struct flash_phase_stats *flash_stats_get(enum flash_phase phase);
+void flash_stats_reset(void);
+/**
+ * Report progress of a long operation; fires the flash-progress target
+ * event, at most every FLASH_PROGRESS_INTERVAL_MS except at start
+ * (@a done 0) and end (@a done == @a total).
+ */
+void flash_progress(struct target *target, enum flash_phase phase,
+		uint32_t done, uint32_t total);
+const struct flash_progress *flash_progress_get(void);
+
+/** auto_probe a bank, timing the first actual probe. */
+int flash_driver_auto_probe(struct flash_bank *bank);
+
 /**
  * Forces targets to re-examine their erase/protection state.
  * This routine must be called when the system may modify the status.
@@ -137,6 +137,35 @@ struct flash_driver {
 	int (*write)(struct flash_bank *bank,
 			const uint8_t *buffer, uint32_t offset, uint32_t count);
 
+	/**
+	 * Erase and program a range in one pass, so that erasing can
+	 * overlap with the transfer of the data.  Optional; when set,
+	 * flash_write_unlock() calls it instead of erasing the range
+	 * before writing it.  The range is aligned to sectors.
+	 *
+	 * @param bank The bank to program
+	 * @param buffer The data bytes to write.
+	 * @param offset The offset into the chip to program.
+	 * @param count The number of bytes to write.
+	 * @returns ERROR_OK if successful; otherwise, an error code.
+	 */
+	int (*erase_write)(struct flash_bank *bank,
+			const uint8_t *buffer, uint32_t offset, uint32_t count);
+
+	/**
+	 * Bracket the writes of one image.  Optional; flash_write_unlock()
+	 * calls write_start on every bank of the target before it writes
+	 * the first section, and write_done on the same banks after the
+	 * last one, also when writing failed.  Drivers can keep loaders and
+	 * controller setup across the banks and sections of the image, and
+	 * undo it in write_done.
+	 *
+	 * @param bank A bank of the target about to be written.
+	 * @returns ERROR_OK if successful; otherwise, an error code.
+	 */
+	int (*write_start)(struct flash_bank *bank);
+	int (*write_done)(struct flash_bank *bank);
+
 	/**
 	 * Read data from the flash. Note CPU address will be
 	 * "bank->base + offset", while the physical address is
@@ -21,6 +21,7 @@
 #endif
 
 #include "imp.h"
+#include <jtag/jtag.h>
 #include <target/image.h>
 #include "hello.h"
 
@@ -28,6 +29,10 @@ struct faux_flash_bank {
 	struct target *target;
 	uint8_t *memory;
 	uint32_t start_address;
+	/* time the operations take, to benchmark the flash code without a chip */
+	uint32_t erase_us;		/* per sector */
+	uint32_t program_us;	/* per page */
+	uint32_t page_size;
 };
 
 static const int sectorSize = 0x10000;
@@ -53,6 +58,10 @@ FLASH_BANK_COMMAND_HANDLER(faux_flash_bank_command)
 		LOG_ERROR("no memory for flash bank info");
 		return ERROR_FAIL;
 	}
+	memset(info->memory, 0xff, bank->size);
+	info->erase_us = 0;
+	info->program_us = 0;
+	info->page_size = 256;
 	bank->driver_priv = info;
 
 	/* Use 0x10000 as a fixed sector size. */
@@ -82,6 +91,11 @@ static int faux_erase(struct flash_bank *bank, int first, int last)
 {
 	struct faux_flash_bank *info = bank->driver_priv;
 	memset(info->memory + first*sectorSize, 0xff, sectorSize*(last-first + 1));
+	for (int i = first; i <= last; i++)
+		bank->sectors[i].is_erased = 1;
+
+	if (info->erase_us)
+		jtag_sleep(info->erase_us * (last - first + 1));
 	return ERROR_OK;
 }
 
@@ -95,6 +109,35 @@ static int faux_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t o
 {
 	struct faux_flash_bank *info = bank->driver_priv;
 	memcpy(info->memory + offset, buffer, count);
+
+	if (info->program_us && count) {
+		uint32_t pages = (offset + count - 1) / info->page_size
+				- offset / info->page_size + 1;
+		jtag_sleep(info->program_us * pages);
+	}
+	return ERROR_OK;
+}
+
+static int faux_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	struct faux_flash_bank *info = bank->driver_priv;
+	memcpy(buffer, info->memory + offset, count);
+	return ERROR_OK;
+}
+
+static int faux_erase_check(struct flash_bank *bank)
+{
+	struct faux_flash_bank *info = bank->driver_priv;
+
+	for (int i = 0; i < bank->num_sectors; i++) {
+		const uint8_t *p = info->memory + bank->sectors[i].offset;
+		uint32_t j;
+
+		for (j = 0; j < bank->sectors[i].size; j++)
+			if (p[j] != 0xff)
+				break;
+		bank->sectors[i].is_erased = (j == bank->sectors[i].size);
+	}
 	return ERROR_OK;
 }
 
@@ -114,12 +157,59 @@ static int faux_probe(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(faux_handle_timing_command)
+{
+	struct flash_bank *bank;
+	struct faux_flash_bank *info;
+	int retval;
+
+	if (CMD_ARGC < 1 || CMD_ARGC == 2 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	retval = CALL_COMMAND_HANDLER(flash_command_get_bank, 0, &bank);
+	if (retval != ERROR_OK)
+		return retval;
+	info = bank->driver_priv;
+
+	if (CMD_ARGC > 1) {
+		uint32_t page_size = info->page_size;
+
+		if (CMD_ARGC > 3) {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], page_size);
+			if (page_size == 0)
+				return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], info->erase_us);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], info->program_us);
+		info->page_size = page_size;
+	}
+
+	command_print(CMD_CTX, "erase %" PRIu32 " us per sector, program %" PRIu32
+			" us per %" PRIu32 " byte page",
+			info->erase_us, info->program_us, info->page_size);
+	return ERROR_OK;
+}
+
+static const struct command_registration faux_exec_command_handlers[] = {
+	{
+		.name = "timing",
+		.handler = faux_handle_timing_command,
+		.mode = COMMAND_ANY,
+		.help = "set the time erase and program operations take",
+		.usage = "bank_id [erase_us program_us [page_size]]",
+	},
+	{
+		.chain = hello_command_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration faux_command_handlers[] = {
 	{
 		.name = "faux",
 		.mode = COMMAND_ANY,
 		.help = "faux flash command group",
-		.chain = hello_command_handlers,
+		.chain = faux_exec_command_handlers,
 	},
 	COMMAND_REGISTRATION_DONE
 };
@@ -131,10 +221,10 @@ struct flash_driver faux_flash = {
 	.erase = faux_erase,
 	.protect = faux_protect,
 	.write = faux_write,
-	.read = default_flash_read,
+	.read = faux_read,
 	.probe = faux_probe,
 	.auto_probe = faux_probe,
-	.erase_check = default_flash_blank_check,
+	.erase_check = faux_erase_check,
 	.protect_check = faux_protect_check,
 	.info = faux_info
 };
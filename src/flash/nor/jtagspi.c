@@ -26,10 +26,16 @@
 
 #define JTAGSPI_MAX_TIMEOUT 3000
 
+/* reads are split into scans of this size, a group of them queued
+ * before each jtag_execute_queue() */
+#define JTAGSPI_READ_CHUNK (64 * 1024)
+#define JTAGSPI_READ_GROUP 16
+
 
 struct jtagspi_flash_bank {
 	struct jtag_tap *tap;
 	const struct flash_device *dev;
+	struct flash_device sfdp_dev;
 	int probed;
 	uint32_t ir;
 	uint32_t dr_len;
@@ -76,8 +82,9 @@ static void jtagspi_set_ir(struct flash_bank *bank)
 
 static void flip_u8(uint8_t *in, uint8_t *out, int len)
 {
-	for (int i = 0; i < len; i++)
-		out[i] = flip_u32(in[i], 8);
+	if (in != out)
+		memcpy(out, in, len);
+	buf_flip_u8(out, len);
 }
 
 static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
@@ -139,6 +146,24 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 	return ERROR_OK;
 }
 
+static int jtagspi_read_sfdp(struct flash_bank *bank, uint32_t addr,
+		uint32_t len, uint8_t *buffer)
+{
+	/* one dummy byte follows the address */
+	uint8_t *buf = malloc(len + 1);
+	if (buf == NULL) {
+		LOG_ERROR("no memory for spi buffer");
+		return ERROR_FAIL;
+	}
+
+	int retval = jtagspi_cmd(bank, SPIFLASH_READ_SFDP, &addr, buf, -(len + 1) * 8);
+	if (retval == ERROR_OK)
+		memcpy(buffer, buf + 1, len);
+	free(buf);
+
+	return retval;
+}
+
 static int jtagspi_probe(struct flash_bank *bank)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
@@ -167,6 +192,10 @@ static int jtagspi_probe(struct flash_bank *bank)
 			break;
 		}
 
+	if (!(info->dev) &&
+			spi_sfdp_probe(bank, id, jtagspi_read_sfdp, &info->sfdp_dev) == ERROR_OK)
+		info->dev = &info->sfdp_dev;
+
 	if (!(info->dev)) {
 		LOG_ERROR("Unknown flash device (ID 0x%08" PRIx32 ")", id);
 		return ERROR_FAIL;
@@ -344,7 +373,46 @@ static int jtagspi_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offse
 		return ERROR_FLASH_BANK_NOT_PROBED;
 	}
 
-	jtagspi_cmd(bank, SPIFLASH_READ, &offset, buffer, -count*8);
+	/* each chunk is its own read command with the data scanned straight
+	 * into the caller's buffer, bit reversed in place afterwards */
+	while (count > 0) {
+		uint8_t cmd_buf[JTAGSPI_READ_GROUP][4];
+		struct scan_field fields[3];
+		uint8_t *group = buffer;
+		uint32_t group_len = 0;
+		int retval;
+
+		jtagspi_set_ir(bank);
+		for (int i = 0; i < JTAGSPI_READ_GROUP && count > 0; i++) {
+			uint32_t chunk = MIN(count, JTAGSPI_READ_CHUNK);
+
+			cmd_buf[i][0] = SPIFLASH_READ;
+			h_u24_to_be(cmd_buf[i] + 1, offset);
+			buf_flip_u8(cmd_buf[i], 4);
+
+			fields[0].num_bits = 32;
+			fields[0].out_value = cmd_buf[i];
+			fields[0].in_value = NULL;
+			fields[1].num_bits = info->dr_len;
+			fields[1].out_value = NULL;
+			fields[1].in_value = NULL;
+			fields[2].num_bits = chunk * 8;
+			fields[2].out_value = NULL;
+			fields[2].in_value = buffer;
+			jtag_add_dr_scan(info->tap, 3, fields, TAP_IDLE);
+
+			buffer += chunk;
+			offset += chunk;
+			count -= chunk;
+			group_len += chunk;
+		}
+
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			return retval;
+		buf_flip_u8(group, group_len);
+	}
+
 	return ERROR_OK;
 }
 
@@ -370,14 +438,18 @@ static int jtagspi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_
 		return ERROR_FLASH_BANK_NOT_PROBED;
 	}
 
-	for (n = 0; n < count; n += info->dev->pagesize) {
-		retval = jtagspi_page_write(bank, buffer + n, offset + n,
-				MIN(count - n, info->dev->pagesize));
+	/* a program wraps within its page, so stop at every page boundary */
+	for (n = 0; n < count; ) {
+		uint32_t page_left = info->dev->pagesize - (offset + n) % info->dev->pagesize;
+		uint32_t chunk = MIN(count - n, page_left);
+
+		retval = jtagspi_page_write(bank, buffer + n, offset + n, chunk);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("page write error");
 			return retval;
 		}
 		LOG_DEBUG("wrote page at 0x%08" PRIx32, offset + n);
+		n += chunk;
 	}
 	return ERROR_OK;
 }
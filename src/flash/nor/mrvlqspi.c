@@ -77,6 +77,7 @@ struct mrvlqspi_flash_bank {
 	uint32_t reg_base;
 	uint32_t bank_num;
 	const struct flash_device *dev;
+	struct flash_device sfdp_dev;
 };
 
 static inline uint32_t mrvlqspi_get_reg(struct flash_bank *bank, uint32_t reg)
@@ -754,24 +755,12 @@ static int mrvlqspi_flash_write(struct flash_bank *bank, const uint8_t *buffer,
 	return retval;
 }
 
-int mrvlqspi_flash_read(struct flash_bank *bank, uint8_t *buffer,
-				uint32_t offset, uint32_t count)
+static int mrvlqspi_read_cmd(struct flash_bank *bank, uint8_t instr,
+		uint32_t offset, uint32_t count, unsigned int dummy, uint8_t *buffer)
 {
-	struct target *target = bank->target;
-	struct mrvlqspi_flash_bank *mrvlqspi_info = bank->driver_priv;
 	int retval;
 	uint32_t i;
 
-	if (target->state != TARGET_HALTED) {
-		LOG_ERROR("Target not halted");
-		return ERROR_TARGET_NOT_HALTED;
-	}
-
-	if (!(mrvlqspi_info->probed)) {
-		LOG_ERROR("Flash bank not probed");
-		return ERROR_FLASH_BANK_NOT_PROBED;
-	}
-
 	/* Flush read/write fifo's */
 	retval = mrvlqspi_fifo_flush(bank, FIFO_FLUSH_TIMEOUT);
 	if (retval != ERROR_OK)
@@ -783,7 +772,7 @@ int mrvlqspi_flash_read(struct flash_bank *bank, uint8_t *buffer,
 		return retval;
 
 	/* Set count for number of bytes to read */
-	retval = mrvlqspi_set_din_cnt(bank, count);
+	retval = mrvlqspi_set_din_cnt(bank, count + dummy);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -793,7 +782,7 @@ int mrvlqspi_flash_read(struct flash_bank *bank, uint8_t *buffer,
 		return retval;
 
 	/* Set instruction */
-	retval = mrvlqspi_set_instr(bank, SPIFLASH_READ);
+	retval = mrvlqspi_set_instr(bank, instr);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -806,10 +795,14 @@ int mrvlqspi_flash_read(struct flash_bank *bank, uint8_t *buffer,
 	if (retval != ERROR_OK)
 		return retval;
 
-	for (i = 0; i < count; i++) {
-		retval = mrvlqspi_read_byte(bank, &buffer[i]);
+	/* dummy cycles are clocked in as data and dropped */
+	for (i = 0; i < count + dummy; i++) {
+		uint8_t data;
+		retval = mrvlqspi_read_byte(bank, &data);
 		if (retval != ERROR_OK)
 			return retval;
+		if (i >= dummy)
+			buffer[i - dummy] = data;
 	}
 
 	retval = mrvlqspi_set_ss_state(bank, QSPI_SS_DISABLE, QSPI_TIMEOUT);
@@ -819,6 +812,31 @@ int mrvlqspi_flash_read(struct flash_bank *bank, uint8_t *buffer,
 	return ERROR_OK;
 }
 
+static int mrvlqspi_read_sfdp(struct flash_bank *bank, uint32_t addr,
+		uint32_t len, uint8_t *buffer)
+{
+	return mrvlqspi_read_cmd(bank, SPIFLASH_READ_SFDP, addr, len, 1, buffer);
+}
+
+int mrvlqspi_flash_read(struct flash_bank *bank, uint8_t *buffer,
+				uint32_t offset, uint32_t count)
+{
+	struct target *target = bank->target;
+	struct mrvlqspi_flash_bank *mrvlqspi_info = bank->driver_priv;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	if (!(mrvlqspi_info->probed)) {
+		LOG_ERROR("Flash bank not probed");
+		return ERROR_FLASH_BANK_NOT_PROBED;
+	}
+
+	return mrvlqspi_read_cmd(bank, SPIFLASH_READ, offset, count, 0, buffer);
+}
+
 static int mrvlqspi_probe(struct flash_bank *bank)
 {
 	struct target *target = bank->target;
@@ -851,6 +869,10 @@ static int mrvlqspi_probe(struct flash_bank *bank)
 			break;
 		}
 
+	if (!mrvlqspi_info->dev &&
+			spi_sfdp_probe(bank, id, mrvlqspi_read_sfdp, &mrvlqspi_info->sfdp_dev) == ERROR_OK)
+		mrvlqspi_info->dev = &mrvlqspi_info->sfdp_dev;
+
 	if (!mrvlqspi_info->dev) {
 		LOG_ERROR("Unknown flash device ID 0x%08" PRIx32, id);
 		return ERROR_FAIL;
@@ -34,9 +34,11 @@
 
 #include "imp.h"
 #include <helper/binarybuffer.h>
+#include <helper/time_support.h>
 #include <target/algorithm.h>
 #include <target/armv7m.h>
 #include <target/cortex_m.h>
+#include <target/image.h>
 
 /* Nuvoton NuMicro register locations */
 #define NUMICRO_SYS_BASE        0x50000000UL
@@ -97,6 +99,8 @@
 #define ISPCON_ISPFF          (1 << 6)
 
 #define CONFIG0_LOCK_MASK     (1 << 1)
+#define CONFIG0_CBS_AP        (1 << 7)
+#define NUMICRO_CONFIG_WORDS  4     /* CONFIG0..CONFIG3, as many as the part has */
 
 #define DHCSR_S_SDE           (1 << 20)
 
@@ -108,6 +112,8 @@
 #define ISPCMD_READ_CID       0x0BU
 #define ISPCMD_READ_UID       0x04U
 #define ISPCMD_VECMAP         0x2EU
+#define ISPCMD_READ_CKS       0x0DU   /* M480/M460/M2351/M031 FMC checksum */
+#define ISPCMD_RUN_CKS        0x2DU
 #define ISPTRG_ISPGO          (1 << 0)
 
 /* access unlock keys */
@@ -119,6 +125,19 @@
 /* flash page size */
 #define NUMICRO_PAGESIZE        512
 #define NUMICRO_DFMC_PAGESIZE   256
+
+/* room kept free at the top of the working area for the loader stack */
+#define NUMICRO_ALGORITHM_STACK_SIZE 512
+#define NUMICRO_FLASH_ERASE_ENTRY    0x40   /* erase routine in numicro_flash_write_code */
+#define NUMICRO_FLASH_WRITE_MULTI_ENTRY 0x62 /* multi-word program routine */
+#define NUMICRO_FLASH_ISP_ENTRY      0xF8   /* ISP command list routine */
+#define NUMICRO_ISP_BATCH_MIN        3      /* shorter lists are cheaper from the host */
+#define NUMICRO_FLASH_BLANK_CHECK_ENTRY 0x120 /* blank check routine */
+#define NUMICRO_PAGE_ERASE_MS        20     /* typical page erase time */
+#define NUMICRO_FLASH_WRITE_ERASE_ENTRY 0x138 /* program routine erasing pages ahead */
+#define NUMICRO_FLM_BLOCK_SIZE       256    /* bytes per ProgramPage call when streaming */
+#define NUMICRO_FLM_WORDS_ENTRY      0x3E   /* flm_write_words in numicro_flm_stream_code */
+
 /* flash MAX banks */
 #define NUMICRO_MAX_FLASH_BANKS 4
 /* flash mask */
@@ -126,6 +145,7 @@
 #define NUMICRO_SPROM_MASK        0x00000001UL
 #define NUMICRO_SPROM_MINI57_MASK 0x00000002UL
 #define NUMICRO_FLASH_OFFSET_MASK 0x00000004UL
+#define NUMICRO_MULTI_WORD_MASK   0x00000008UL   /* FMC has multi-word program */
 #define NUMICRO_SPROM_ISPDAT      0x55AA03UL
 /* SPIM flash start address */
 #define NUMICRO_SPIM_FLASH_START_ADDRESS  0x8000000UL
@@ -1083,11 +1103,132 @@ static const struct numicro_cpu_type NuMicroParts[] = {
 	{"UNKNOWN", 0x00000000, NUMICRO_BANKS_GENERAL(0x10080000, 0*1024, 4*1024, 16)},
 };
 
+/* Parts added by "numicro part", preferred over NuMicroParts. */
+static struct numicro_cpu_type **numicro_extra_parts;
+static unsigned int numicro_extra_parts_count;
+
+/* All parts by part ID, rebuilt on the first lookup after a change. */
+struct numicro_part_index {
+	uint32_t partid;
+	unsigned int order; /* among equal IDs the lowest order wins */
+	const struct numicro_cpu_type *cpu;
+};
+
+static struct numicro_part_index *numicro_parts_index;
+static size_t numicro_parts_index_size;
+
+static int numicro_part_cmp(const void *a, const void *b)
+{
+	const struct numicro_part_index *pa = a, *pb = b;
+
+	if (pa->partid != pb->partid)
+		return (pa->partid < pb->partid) ? -1 : 1;
+	return (pa->order < pb->order) ? -1 : (pa->order > pb->order);
+}
+
+static int numicro_build_parts_index(void)
+{
+	size_t n_parts = sizeof(NuMicroParts) / sizeof(NuMicroParts[0]);
+	size_t size = numicro_extra_parts_count + n_parts;
+	struct numicro_part_index *index;
+	size_t n = 0;
+
+	index = malloc(size * sizeof(*index));
+	if (index == NULL) {
+		LOG_ERROR("no memory for the NuMicro part index");
+		return ERROR_FAIL;
+	}
+
+	/* the latest "numicro part" first */
+	for (unsigned int i = numicro_extra_parts_count; i-- > 0; n++) {
+		index[n].partid = numicro_extra_parts[i]->partid;
+		index[n].order = n;
+		index[n].cpu = numicro_extra_parts[i];
+	}
+	for (size_t i = 0; i < n_parts; i++, n++) {
+		index[n].partid = NuMicroParts[i].partid;
+		index[n].order = n;
+		index[n].cpu = &NuMicroParts[i];
+	}
+
+	qsort(index, size, sizeof(*index), numicro_part_cmp);
+
+	free(numicro_parts_index);
+	numicro_parts_index = index;
+	numicro_parts_index_size = size;
+
+	return ERROR_OK;
+}
+
+static const struct numicro_cpu_type *numicro_find_part(uint32_t part_id)
+{
+	size_t lo = 0, hi;
+
+	if (numicro_parts_index == NULL && numicro_build_parts_index() != ERROR_OK)
+		return NULL;
+
+	/* first entry not below part_id */
+	hi = numicro_parts_index_size;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (numicro_parts_index[mid].partid < part_id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < numicro_parts_index_size && numicro_parts_index[lo].partid == part_id)
+		return numicro_parts_index[lo].cpu;
+
+	return NULL;
+}
+
+/* Flash loader selection. Each entry ties a part (or any part, name NULL)
+ * and a flash region to the loader that programs it. Entry points are the
+ * Thumb addresses of the CMSIS flash algorithm functions relative to the
+ * start of the loader, 0 where the function is not used. The first entry
+ * that matches wins, so the catch-all entries come last. */
+#define NUMICRO_MATCH_SPIM      0x00000001UL   /* bank in the SPIM window */
+#define NUMICRO_MATCH_DFMC      0x00000002UL   /* bank in the DFMC data flash */
+#define NUMICRO_MATCH_NS        0x00000004UL   /* only when debugging non-secure, never otherwise */
+
+#define NUMICRO_CAP_ASYNC       0x00000001UL   /* streams through numicro_flash_write_code */
+#define NUMICRO_CAP_MULTI_WORD  0x00000002UL   /* FMC multi-word program, if NUMICRO_MULTI_WORD_MASK */
+#define NUMICRO_CAP_CRC         0x00000004UL   /* FMC runs ISPCMD_RUN_CKS */
+#define NUMICRO_CAP_SPIM        0x00000008UL   /* chip erased by a write unless sectors were erased */
+#define NUMICRO_CAP_ISP_INIT    0x00000010UL   /* init runs in numicro_init_isp, not per operation */
+#define NUMICRO_CAP_RESET       0x00000020UL   /* chip reset after programming */
+#define NUMICRO_CAP_WORD_ARGS   0x00000040UL   /* program takes (buffer, address, words) */
+
+struct numicro_family {
+	const char *name;
+	uint32_t match;
+	uint32_t caps;
+	const void *code;
+	uint32_t code_size;
+	const void *erase_code;         /* separate erase loader, NULL: in code */
+	uint32_t erase_code_size;
+	uint32_t init;
+	uint32_t uninit;
+	uint32_t erase_sector;
+	uint32_t chip_erase;
+	uint32_t program_page;
+	uint32_t static_base;           /* r9 of the loader */
+	uint32_t lr;                    /* return address, 0: the bkpt ending code */
+	uint32_t stack;                 /* stack top from the loader, 0: end of working area */
+	uint32_t addr_offset;           /* subtracted from flash addresses */
+	uint32_t buffer_size;           /* write buffer, 0: sized from the working area */
+	uint32_t block_size;            /* bytes per streamed ProgramPage call, 0: NUMICRO_FLM_BLOCK_SIZE */
+};
+
 /* Private bank information for NuMicro. */
 struct  numicro_flash_bank {
 	struct working_area *write_algorithm;
 	int probed;
 	const struct numicro_cpu_type *cpu;
+	uint32_t max_buffer_size; /* upper bound of a write buffer, 0: no limit */
+	bool erase_ahead; /* writeblock erases each page before programming it */
+	const struct numicro_family *family; /* loader for this bank, set by probe */
 };
 
 enum numicro_m23_secure_debug_state {
@@ -1096,96 +1237,203 @@ enum numicro_m23_secure_debug_state {
 	NUMICRO_M23_SECURE_DEBUG_NS, /* M23 Secure Debug Disabled */
 };
 
+/* Chip state, shared by all NuMicro banks of a target. The architecture
+ * part is worked out once and dropped on reset and examine, the rest is
+ * set when a bank is probed. */
+struct numicro_chip {
+	struct numicro_chip *next;
+	struct target *target;
+	bool arch_valid;
+	uint32_t page_size;
+	uint32_t address_minus_offset;
+	uint32_t m23_secure_debug_state;
+	uint32_t flash_info; /* bit 0:SPROM exists; */
+	char *target_name;
+	NUC_CHIP_TYPE_E chip_type;
+	bool spim_sector_erased;
+	bool isp_ready; /* numicro_init_isp done, until resume or reset */
+	unsigned int write_session; /* numicro_write_start calls not yet done */
+	const struct numicro_family *flm_open; /* loader initialised for the session */
+	bool flm_reset; /* chip reset due when flm_open is closed */
+	const struct numicro_family *family; /* loader numicro_init_isp runs */
+	const struct numicro_cpu_type *cpu; /* part found for PDID cpu_part_id */
+	uint32_t cpu_part_id;
+	bool identified; /* chip wide probe results valid, until examine */
+	bool skip_unchanged; /* numicro skip_unchanged */
+
+	/* CONFIG words, read once and written back by "numicro config write" */
+	uint32_t config[NUMICRO_CONFIG_WORDS];
+	uint32_t config_base;
+	unsigned int config_count;
+	bool config_valid;
+	bool config_dirty;
+
+	/* Only one loader is kept resident: several of them are linked for the
+	 * start of SRAM, so they must land at the start of the working area. */
+	struct working_area *loader; /* cleared when working areas are freed */
+	struct working_area *stack; /* for loaders not linked with a stack of their own */
+	uint32_t loader_size;
+	uint32_t loader_checksum;
+	bool loader_valid;
+};
+
 /* Private variables */
-uint32_t m_pageSize = NUMICRO_PAGESIZE;
-uint32_t m_addressMinusOffset = 0;
-uint32_t m_addressFlashOffset = 0;
-uint32_t m_M23SecureDebugState = NUMICRO_M23_SECURE_DEBUG_NORMAL;
-uint32_t m_flashInfo = 0; /* bit 0:SPROM exists; */
-char *m_target_name = "";
-NUC_CHIP_TYPE_E m_eChipType = NUC_CHIP_TYPE_GENERAL_V7M;
-bool m_bSPIMFlashSectorErased = 0;
+static struct numicro_chip *m_chips;
+
+static int numicro_chip_event(struct target *target, enum target_event event, void *priv)
+{
+	struct numicro_chip *chip = priv;
+
+	if (target != chip->target)
+		return ERROR_OK;
+
+	switch (event) {
+	case TARGET_EVENT_RESUMED:
+		/* the application may have reused the loader area and
+		 * locked the registers or turned ISP off again */
+		chip->loader_valid = false;
+		chip->isp_ready = false;
+		chip->flm_open = NULL;
+		chip->flm_reset = false;
+		break;
+	case TARGET_EVENT_EXAMINE_END:
+		/* possibly another chip */
+		chip->identified = false;
+		/* fall through */
+	case TARGET_EVENT_RESET_ASSERT:
+		/* the security state may have changed */
+		chip->arch_valid = false;
+		chip->loader_valid = false;
+		chip->isp_ready = false;
+		chip->family = NULL;
+		chip->flm_open = NULL;
+		chip->flm_reset = false;
+		if (chip->config_dirty)
+			LOG_WARNING("NuMicro CONFIG changes were not written");
+		chip->config_valid = false;
+		chip->config_dirty = false;
+		break;
+	default:
+		break;
+	}
+
+	return ERROR_OK;
+}
+
+/* The chip state of a target, made on first use; NULL when out of memory.
+ * The flash bank command and the numicro commands make it and fail when it
+ * cannot be had, so code running for a bank or command always finds it. */
+static struct numicro_chip *numicro_get_chip(struct target *target)
+{
+	struct numicro_chip *chip;
+
+	for (chip = m_chips; chip; chip = chip->next) {
+		if (chip->target == target)
+			return chip;
+	}
+
+	chip = calloc(1, sizeof(*chip));
+	if (chip == NULL) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+	chip->target = target;
+	chip->page_size = NUMICRO_PAGESIZE;
+	chip->m23_secure_debug_state = NUMICRO_M23_SECURE_DEBUG_NORMAL;
+	chip->target_name = "";
+	chip->chip_type = NUC_CHIP_TYPE_GENERAL_V7M;
+	chip->next = m_chips;
+	m_chips = chip;
+
+	target_register_event_callback(numicro_chip_event, chip);
+
+	return chip;
+}
 
 /* Private methods */
 static int numicro_get_arm_arch(struct target *target)
 {
+	struct numicro_chip *chip = numicro_get_chip(target);
 	struct armv7m_common *armv7m = target_to_armv7m(target);
 
-	if (strcmp(m_target_name, "M460") == 0) {
-		m_addressFlashOffset = NUMICRO_SPECIAL_FLASH_OFFSET;
-	}
+	if (chip->arch_valid)
+		return ERROR_OK;
 
 	if (armv7m->arm.is_armv6m) {
 		LOG_DEBUG("NuMicro arm architecture: armv6m");
 
 		if (armv7m->arm.is_NUC_M0_FMC_MSB4) {
-			m_addressMinusOffset = 0x10000000;
+			chip->address_minus_offset = 0x10000000;
 		}
 		else {
-			m_addressMinusOffset = 0;
+			chip->address_minus_offset = 0;
 		}
 
-		m_M23SecureDebugState = NUMICRO_M23_SECURE_DEBUG_NORMAL;
+		chip->m23_secure_debug_state = NUMICRO_M23_SECURE_DEBUG_NORMAL;
 	}
 	else if (armv7m->arm.is_armv8m) {
 		LOG_DEBUG("NuMicro arm architecture: armv8m");
 
 		if (armv7m->arm.is_NUC_M23_FMC_MSB5) {
-			m_addressMinusOffset = 0;
+			chip->address_minus_offset = 0;
 		}
 		else {
-		m_addressMinusOffset = 0x10000000;
+		chip->address_minus_offset = 0x10000000;
 		}
 
 		if (armv7m->arm.is_armv8mSecureExtend) {
 			// M2351/M2354
 			if (armv7m->arm.is_armv8mSecureInvasiveDebugAllowed) {
-				m_M23SecureDebugState = NUMICRO_M23_SECURE_DEBUG_S;
+				chip->m23_secure_debug_state = NUMICRO_M23_SECURE_DEBUG_S;
 			}
 			else {
-				m_M23SecureDebugState = NUMICRO_M23_SECURE_DEBUG_NS;
+				chip->m23_secure_debug_state = NUMICRO_M23_SECURE_DEBUG_NS;
 			}
 		}
 		else {
 			// M251 and NUC1262, NUC1263
-			m_M23SecureDebugState = NUMICRO_M23_SECURE_DEBUG_NORMAL;
+			chip->m23_secure_debug_state = NUMICRO_M23_SECURE_DEBUG_NORMAL;
 		}
 
 	}
 	else {
 		LOG_DEBUG("NuMicro arm architecture: armv7m");
-		m_addressMinusOffset = 0x10000000;
-		m_M23SecureDebugState = NUMICRO_M23_SECURE_DEBUG_NORMAL;
+		chip->address_minus_offset = 0x10000000;
+		chip->m23_secure_debug_state = NUMICRO_M23_SECURE_DEBUG_NORMAL;
 	}
 
+	chip->arch_valid = true;
+
 	return ERROR_OK;
 }
 
+/* Set and clear bits of a peripheral register. Adapters that can do the
+ * read-modify-write on the probe (Nu-Link) save the read round trip. */
+static int numicro_reg_update(struct target *target, uint32_t addr, uint32_t set, uint32_t clear)
+{
+	return target_update_u32(target, addr, set, clear);
+}
+
 static int numicro_reg_unlock(struct target *target)
 {
+	struct numicro_chip *chip = numicro_get_chip(target);
 	uint32_t is_protected;
 	int retval = ERROR_OK;
 
-	/* Check to see if NUC is register unlocked or not */
-	retval = target_read_u32(target, NUMICRO_SYS_WRPROT - m_addressMinusOffset, &is_protected);
+	/* The key sequence is harmless when the registers are already
+	 * unlocked, so send it unconditionally and only read back once. */
+	retval = target_write_u32(target, NUMICRO_SYS_WRPROT - chip->address_minus_offset, REG_KEY1);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = target_write_u32(target, NUMICRO_SYS_WRPROT - chip->address_minus_offset, REG_KEY2);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = target_write_u32(target, NUMICRO_SYS_WRPROT - chip->address_minus_offset, REG_KEY3);
 	if (retval != ERROR_OK)
 		return retval;
 
-	LOG_DEBUG("protected = 0x%08" PRIx32 "", is_protected);
-	if (is_protected == 0) {	/* means protected - so unlock it */
-		/* unlock flash registers */
-		retval = target_write_u32(target, NUMICRO_SYS_WRPROT - m_addressMinusOffset, REG_KEY1);
-		if (retval != ERROR_OK)
-			return retval;
-		retval = target_write_u32(target, NUMICRO_SYS_WRPROT - m_addressMinusOffset, REG_KEY2);
-		if (retval != ERROR_OK)
-			return retval;
-		retval = target_write_u32(target, NUMICRO_SYS_WRPROT - m_addressMinusOffset, REG_KEY3);
-		if (retval != ERROR_OK)
-			return retval;
-	}
 	/* Check that unlock worked */
-	retval = target_read_u32(target, NUMICRO_SYS_WRPROT - m_addressMinusOffset, &is_protected);
+	retval = target_read_u32(target, NUMICRO_SYS_WRPROT - chip->address_minus_offset, &is_protected);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -1199,31 +1447,59 @@ static int numicro_reg_unlock(struct target *target)
 	return ERROR_OK;
 }
 
+/* Flash written or erased behind the flash layer, by ISP commands or the
+ * adapter: the sectors at address are no longer known to be blank, or with
+ * size 0 none of the sectors of the target are. */
+static void numicro_sectors_unknown(struct target *target, uint32_t address, uint32_t size)
+{
+	address &= ~NUMICRO_SPECIAL_FLASH_OFFSET;
+
+	for (struct flash_bank *bank = flash_bank_list(); bank; bank = bank->next) {
+		uint32_t base = bank->base & ~NUMICRO_SPECIAL_FLASH_OFFSET;
+
+		if (bank->target != target)
+			continue;
+
+		for (int i = 0; i < bank->num_sectors; i++) {
+			uint32_t start = base + bank->sectors[i].offset;
+
+			if (size == 0 || (start < address + size && start + bank->sectors[i].size > address))
+				bank->sectors[i].is_erased = -1;
+		}
+	}
+}
+
 static uint32_t numicro_fmc_cmd(struct target *target, uint32_t cmd, uint32_t addr, uint32_t wdata, uint32_t* rdata)
 {
+	struct numicro_chip *chip = numicro_get_chip(target);
 	uint32_t timeout, status;
 	int retval = ERROR_OK;
 
-	retval = target_write_u32(target, NUMICRO_FLASH_ISPCMD - m_addressMinusOffset, cmd);
+	if (cmd == ISPCMD_WRITE || cmd == ISPCMD_ERASE)
+		numicro_sectors_unknown(target, addr, 4);
+	else if (cmd == ISPCMD_CHIPERASE)
+		numicro_sectors_unknown(target, 0, 0);
+
+	retval = target_write_u32(target, NUMICRO_FLASH_ISPCMD - chip->address_minus_offset, cmd);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - m_addressMinusOffset, wdata);
+	retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - chip->address_minus_offset, wdata);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - m_addressMinusOffset, addr);
+	retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - chip->address_minus_offset, addr);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = target_write_u32(target, NUMICRO_FLASH_ISPTRG - m_addressMinusOffset, ISPTRG_ISPGO);
+	retval = target_write_u32(target, NUMICRO_FLASH_ISPTRG - chip->address_minus_offset, ISPTRG_ISPGO);
 	if (retval != ERROR_OK)
 		return retval;
 
 	/* Wait for busy to clear - check the GO flag */
 	timeout = 100;
 	for (;;) {
-		retval = target_read_u32(target, NUMICRO_FLASH_ISPTRG - m_addressMinusOffset, &status);
+		retval = target_read_u32(target, NUMICRO_FLASH_ISPTRG - chip->address_minus_offset, &status);
 		if (retval != ERROR_OK){
 			return retval;
 		}
@@ -1237,142 +1513,547 @@ static uint32_t numicro_fmc_cmd(struct target *target, uint32_t cmd, uint32_t ad
 		busy_sleep(1);	/* can use busy sleep for short times. */
 	}
 
-	retval = target_read_u32(target, NUMICRO_FLASH_ISPDAT - m_addressMinusOffset, rdata);
+	retval = target_read_u32(target, NUMICRO_FLASH_ISPDAT - chip->address_minus_offset, rdata);
 	if (retval != ERROR_OK)
 		return retval;
 
 	return ERROR_OK;
 }
 
-/* NuMicro Program-LongWord Microcodes */
-static const uint8_t numicro_M0_flash_write_code[] = {
-	/* Params:
-	 * r0 - workarea buffer / result
-	 * r1 - target address
-	 * r2 - wordcount
-	 * Clobbered:
-	 * r4 - tmp
-	 * r5 - tmp
-	 * r6 - tmp
-	 * r7 - tmp
-	 */
-
-	/* .L1: */
-	/* for(register uint32_t i=0;i<wcount;i++){ */
-	0x04, 0x1C,				/* mov    r4, r0          */
-	0x00, 0x23,				/* mov    r3, #0          */
-	/* .L2: */
-	0x0D, 0x1A,				/* sub    r5, r1, r0      */
-	0x67, 0x19,				/* add    r7, r4, r7      */
-	0x93, 0x42,				/* cmp	  r3, r2		  */
-	0x0C, 0xD0,				/* beq    .L7             */
-	/* .L4: */
-	/* NUMICRO_FLASH_ISPADR = faddr; */
-	0x08, 0x4E,				/* ldr	r6, .L8           */
-	0x37, 0x60,				/* str	r7, [r6]          */
-	/* NUMICRO_FLASH_ISPDAT = *pLW; */
-	0x80, 0xCC,				/* ldmia	r4!, {r7}     */
-	0x08, 0x4D,				/* ldr	r5, .L8+4         */
-	0x2F, 0x60,				/* str	r7, [r5]		  */
-	/* faddr += 4; */
-	/* pLW++; */
-	/*  Trigger write action  */
-	/* NUMICRO_FLASH_ISPTRG = ISPTRG_ISPGO; */
-	0x08, 0x4D,				/* ldr	r5, .L8+8         */
-	0x01, 0x26,				/* mov	r6, #1            */
-	0x2E, 0x60,				/* str	r6, [r5]          */
-	/* .L3: */
-	/* while((NUMICRO_FLASH_ISPTRG & ISPTRG_ISPGO) == ISPTRG_ISPGO){}; */
-	0x2F, 0x68,				/* ldr	r7, [r5]          */
-	0xFF, 0x07,				/* lsl	r7, r7, #31       */
-	0xFC, 0xD4,				/* bmi	.L3               */
-
-	0x01, 0x33,				/* add	r3, r3, #1        */
-	0xEE, 0xE7,				/* b	.L2               */
-	/* .L7: */
-	/* return (NUMICRO_FLASH_ISPCON & ISPCON_ISPFF); */
-	0x05, 0x4B,				/* ldr	r3, .L8+12        */
-	0x18, 0x68,				/* ldr	r0, [r3]          */
-	0x40, 0x21,				/* mov	r1, #64           */
-	0x08, 0x40,				/* and	r0, r1            */
-	/* .L9: */
-	0x00, 0xBE,				/* bkpt    #0             */
-	/* .L8: */
-	0x04, 0xC0, 0x00, 0x50,/* .word	1342226436    */
-	0x08, 0xC0, 0x00, 0x50,/* .word	1342226440    */
-	0x10, 0xC0, 0x00, 0x50,/* .word	1342226448    */
-	0x00, 0xC0, 0x00, 0x50 /* .word	1342226432    */
+/* Let the FMC compute the checksum of count bytes at addr. Both must be
+ * aligned to the page size; parts without the command set ISPFF. */
+static int numicro_fmc_checksum(struct target *target, uint32_t addr, uint32_t count, uint32_t *checksum)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	uint32_t status;
+	int retval;
+
+	if ((addr | count) & (chip->page_size - 1)) {
+		LOG_ERROR("checksum range must be aligned to the 0x%" PRIx32 " page size", chip->page_size);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	retval = numicro_fmc_cmd(target, ISPCMD_RUN_CKS, addr, count, &status);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = numicro_fmc_cmd(target, ISPCMD_READ_CKS, addr, 0, checksum);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_read_u32(target, NUMICRO_FLASH_ISPCON - chip->address_minus_offset, &status);
+	if (retval != ERROR_OK)
+		return retval;
+	if ((status & ISPCON_ISPFF) != 0) {
+		LOG_DEBUG("failure: 0x%" PRIx32 "", status);
+		/* if bit is set, then must write to it to clear it. */
+		target_write_u32(target, NUMICRO_FLASH_ISPCON - chip->address_minus_offset, (status | ISPCON_ISPFF));
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	return ERROR_OK;
+}
+
+/* Upload a flash loader, or reuse it when it is still resident */
+static int numicro_flm_close(struct target *target);
+static uint32_t numicro_loader_slot_size(void);
+
+static int numicro_load_algorithm(struct target *target, const uint8_t *code, uint32_t size,
+		struct working_area **algorithm)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	uint32_t checksum;
+	int retval;
+
+	retval = image_calculate_checksum((uint8_t *)code, size, &checksum);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (chip->loader && chip->stack && chip->loader_valid &&
+		chip->loader_size == size && chip->loader_checksum == checksum) {
+		LOG_DEBUG("NuMicro loader resident at 0x%08" PRIx32, chip->loader->address);
+		*algorithm = chip->loader;
+		return ERROR_OK;
+	}
+
+	/* the loader kept initialised for the session is about to go */
+	if (chip->flm_open && chip->flm_open->code != (const void *)code) {
+		retval = numicro_flm_close(target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* a loader of its own could still outgrow the slot: the stack goes
+	 * too, or the new loader would be placed above it */
+	if (chip->loader && chip->loader->size < size) {
+		if (chip->stack)
+			target_free_working_area(target, chip->stack);
+		target_free_working_area(target, chip->loader);
+	}
+
+	/* the slot takes any of the loaders, so it stays where the first
+	 * one went, at the start of the working area */
+	if (!chip->loader) {
+		if (target_alloc_working_area(target, MAX(size, numicro_loader_slot_size()),
+				&chip->loader) != ERROR_OK) {
+			LOG_WARNING("no working area available, can't do block memory writes");
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+	}
+
+	/* a real area, so that nothing else is handed out where it grows */
+	if (!chip->stack) {
+		if (target_alloc_working_area(target, NUMICRO_ALGORITHM_STACK_SIZE, &chip->stack) != ERROR_OK) {
+			LOG_WARNING("no working area available for the loader stack");
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+	}
+
+	chip->loader_size = size;
+	chip->loader_checksum = checksum;
+	chip->loader_valid = false;
+
+	/* an init loader keeps its state in its own data */
+	if (chip->family && (chip->family->caps & NUMICRO_CAP_ISP_INIT))
+		chip->isp_ready = false;
+
+	/* a loader corrupted on the way in would misprogram the flash,
+	 * it is small enough to always be checked */
+	int64_t start = timeval_ms();
+	retval = target_write_buffer_verify(target, chip->loader->address, size, code, true);
+	if (retval != ERROR_OK)
+		return retval;
+	flash_stats_add(FLASH_PHASE_LOADER, size, start);
+
+	chip->loader_valid = true;
+	*algorithm = chip->loader;
+
+	return ERROR_OK;
+}
+
+/* NuMicro Program-LongWord Microcodes, contrib/loaders/flash/numicro.S
+ * Streams words out of a target_run_flash_async_algorithm() FIFO.
+ * The page erase routine follows at NUMICRO_FLASH_ERASE_ENTRY, the
+ * multi-word program routine at NUMICRO_FLASH_WRITE_MULTI_ENTRY, the
+ * ISP command list routine at NUMICRO_FLASH_ISP_ENTRY, the blank check
+ * at NUMICRO_FLASH_BLANK_CHECK_ENTRY and the erasing program routine at
+ * NUMICRO_FLASH_WRITE_ERASE_ENTRY. */
+static const uint8_t numicro_flash_write_code[] = {
+	/* #define NUMICRO_ISPCON_OFFSET 0x00 */
+	/* #define NUMICRO_ISPADR_OFFSET 0x04 */
+	/* #define NUMICRO_ISPDAT_OFFSET 0x08 */
+	/* #define NUMICRO_ISPTRG_OFFSET 0x10 */
+	/* #define NUMICRO_ISPCON_ISPFF  0x40 */
+	/* wait_fifo: */
+	0x16, 0x68,				/* ldr   r6, [r2, #0]                       */
+	0x00, 0x2e,				/* cmp   r6, #0                             */
+	0x1a, 0xd0,				/* beq   exit                               */
+	0x55, 0x68,				/* ldr   r5, [r2, #4]                       */
+	0xb5, 0x42,				/* cmp   r5, r6                             */
+	0xf9, 0xd0,				/* beq   wait_fifo                          */
+	0x44, 0x60,				/* str   r4, [r0, #NUMICRO_ISPADR_OFFSET]   */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0x86, 0x60,				/* str   r6, [r0, #NUMICRO_ISPDAT_OFFSET]   */
+	0x01, 0x26,				/* movs  r6, #1                             */
+	0x06, 0x61,				/* str   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	/* busy: */
+	0x06, 0x69,				/* ldr   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	0xf6, 0x07,				/* lsls  r6, r6, #31                        */
+	0xfc, 0xd4,				/* bmi   busy                               */
+	0x06, 0x68,				/* ldr   r6, [r0, #NUMICRO_ISPCON_OFFSET]   */
+	0x40, 0x27,				/* movs  r7, #NUMICRO_ISPCON_ISPFF          */
+	0x3e, 0x42,				/* tst   r6, r7                             */
+	0x09, 0xd1,				/* bne   error                              */
+	0x04, 0x34,				/* adds  r4, #4                             */
+	0x9d, 0x42,				/* cmp   r5, r3                             */
+	0x01, 0xd3,				/* bcc   no_wrap                            */
+	0x15, 0x46,				/* mov   r5, r2                             */
+	0x08, 0x35,				/* adds  r5, #8                             */
+	/* no_wrap: */
+	0x55, 0x60,				/* str   r5, [r2, #4]                       */
+	0x49, 0x1e,				/* subs  r1, r1, #1                         */
+	0x00, 0x29,				/* cmp   r1, #0                             */
+	0x02, 0xd0,				/* beq   exit                               */
+	0xe3, 0xe7,				/* b     wait_fifo                          */
+	/* error: */
+	0x00, 0x20,				/* movs  r0, #0                             */
+	0x50, 0x60,				/* str   r0, [r2, #4]                       */
+	/* exit: */
+	0x30, 0x46,				/* mov   r0, r6                             */
+	0x00, 0xbe,				/* bkpt  #0                                 */
+	/* #define NUMICRO_ISPCMD_OFFSET 0x0C */
+	/* #define NUMICRO_ISPCMD_ERASE  0x22 */
+	/* erase: */
+	0x22, 0x26,				/* movs  r6, #NUMICRO_ISPCMD_ERASE          */
+	0xc6, 0x60,				/* str   r6, [r0, #NUMICRO_ISPCMD_OFFSET]   */
+	/* erase_page: */
+	0x41, 0x60,				/* str   r1, [r0, #NUMICRO_ISPADR_OFFSET]   */
+	0x01, 0x26,				/* movs  r6, #1                             */
+	0x06, 0x61,				/* str   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	/* erase_busy: */
+	0x06, 0x69,				/* ldr   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	0xf6, 0x07,				/* lsls  r6, r6, #31                        */
+	0xfc, 0xd4,				/* bmi   erase_busy                         */
+	0x06, 0x68,				/* ldr   r6, [r0, #NUMICRO_ISPCON_OFFSET]   */
+	0x40, 0x27,				/* movs  r7, #NUMICRO_ISPCON_ISPFF          */
+	0x3e, 0x42,				/* tst   r6, r7                             */
+	0x02, 0xd1,				/* bne   erase_exit                         */
+	0xc9, 0x18,				/* adds  r1, r1, r3                         */
+	0x52, 0x1e,				/* subs  r2, r2, #1                         */
+	0xf2, 0xd1,				/* bne   erase_page                         */
+	/* erase_exit: */
+	0x30, 0x46,				/* mov   r0, r6                             */
+	0x00, 0xbe,				/* bkpt  #0                                 */
+	/* #define NUMICRO_ISPCMD_MULTI  0x27 */
+	/* #define NUMICRO_MPDAT0_OFFSET 0x80 */
+	/* #define NUMICRO_MPSTS_OFFSET  0x40 */
+	/* write_multi: */
+	0x80, 0x27,				/* movs  r7, #NUMICRO_MPDAT0_OFFSET         */
+	0x3f, 0x18,				/* adds  r7, r7, r0                         */
+	/* mp_start: */
+	0x16, 0x68,				/* ldr   r6, [r2, #0]                       */
+	0x00, 0x2e,				/* cmp   r6, #0                             */
+	0x43, 0xd0,				/* beq   mp_exit                            */
+	0x55, 0x68,				/* ldr   r5, [r2, #4]                       */
+	0xb5, 0x42,				/* cmp   r5, r6                             */
+	0xf9, 0xd0,				/* beq   mp_start                           */
+	0x27, 0x26,				/* movs  r6, #NUMICRO_ISPCMD_MULTI          */
+	0xc6, 0x60,				/* str   r6, [r0, #NUMICRO_ISPCMD_OFFSET]   */
+	0x44, 0x60,				/* str   r4, [r0, #NUMICRO_ISPADR_OFFSET]   */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0x3e, 0x60,				/* str   r6, [r7, #0]                       */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0x7e, 0x60,				/* str   r6, [r7, #4]                       */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0xbe, 0x60,				/* str   r6, [r7, #8]                       */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0xfe, 0x60,				/* str   r6, [r7, #12]                      */
+	0x01, 0x26,				/* movs  r6, #1                             */
+	0x06, 0x61,				/* str   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	0x1b, 0xe0,				/* b     mp_advance                         */
+	/* mp_next: */
+	0x16, 0x68,				/* ldr   r6, [r2, #0]                       */
+	0x00, 0x2e,				/* cmp   r6, #0                             */
+	0x20, 0xd0,				/* beq   mp_restart                         */
+	0x55, 0x68,				/* ldr   r5, [r2, #4]                       */
+	0xb5, 0x42,				/* cmp   r5, r6                             */
+	0x1d, 0xd0,				/* beq   mp_restart                         */
+	0xe6, 0x05,				/* lsls  r6, r4, #23                        */
+	0x1b, 0xd0,				/* beq   mp_restart                         */
+	/* mp_wait01: */
+	0x3e, 0x6c,				/* ldr   r6, [r7, #NUMICRO_MPSTS_OFFSET]    */
+	0x76, 0x08,				/* lsrs  r6, r6, #1                         */
+	0x18, 0xd3,				/* bcc   mp_restart                         */
+	0xf6, 0x08,				/* lsrs  r6, r6, #3                         */
+	0xb6, 0x07,				/* lsls  r6, r6, #30                        */
+	0xf9, 0xd1,				/* bne   mp_wait01                          */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0x3e, 0x60,				/* str   r6, [r7, #0]                       */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0x7e, 0x60,				/* str   r6, [r7, #4]                       */
+	/* mp_wait23: */
+	0x3e, 0x6c,				/* ldr   r6, [r7, #NUMICRO_MPSTS_OFFSET]    */
+	0x76, 0x08,				/* lsrs  r6, r6, #1                         */
+	0x1b, 0xd3,				/* bcc   mp_error                           */
+	0x76, 0x09,				/* lsrs  r6, r6, #5                         */
+	0xb6, 0x07,				/* lsls  r6, r6, #30                        */
+	0xf9, 0xd1,				/* bne   mp_wait23                          */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0xbe, 0x60,				/* str   r6, [r7, #8]                       */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0xfe, 0x60,				/* str   r6, [r7, #12]                      */
+	/* mp_advance: */
+	0x10, 0x34,				/* adds  r4, #16                            */
+	0x9d, 0x42,				/* cmp   r5, r3                             */
+	0x01, 0xd3,				/* bcc   mp_no_wrap                         */
+	0x15, 0x46,				/* mov   r5, r2                             */
+	0x08, 0x35,				/* adds  r5, #8                             */
+	/* mp_no_wrap: */
+	0x55, 0x60,				/* str   r5, [r2, #4]                       */
+	0x49, 0x1e,				/* subs  r1, r1, #1                         */
+	0xdb, 0xd1,				/* bne   mp_next                            */
+	/* mp_restart: */
+	0x3e, 0x6c,				/* ldr   r6, [r7, #NUMICRO_MPSTS_OFFSET]    */
+	0x76, 0x08,				/* lsrs  r6, r6, #1                         */
+	0xfc, 0xd2,				/* bcs   mp_restart                         */
+	0x06, 0x68,				/* ldr   r6, [r0, #NUMICRO_ISPCON_OFFSET]   */
+	0x40, 0x25,				/* movs  r5, #NUMICRO_ISPCON_ISPFF          */
+	0x2e, 0x42,				/* tst   r6, r5                             */
+	0x05, 0xd1,				/* bne   mp_error                           */
+	0x00, 0x29,				/* cmp   r1, #0                             */
+	0x05, 0xd0,				/* beq   mp_exit                            */
+	0x15, 0x68,				/* ldr   r5, [r2, #0]                       */
+	0x00, 0x2d,				/* cmp   r5, #0                             */
+	0x02, 0xd0,				/* beq   mp_exit                            */
+	0xba, 0xe7,				/* b     mp_start                           */
+	/* mp_error: */
+	0x00, 0x20,				/* movs  r0, #0                             */
+	0x50, 0x60,				/* str   r0, [r2, #4]                       */
+	/* mp_exit: */
+	0x30, 0x46,				/* mov   r0, r6                             */
+	0x00, 0xbe,				/* bkpt  #0                                 */
+	/* isp: */
+	/* isp_next: */
+	0xe0, 0xc9,				/* ldmia r1!, {r5, r6, r7}                  */
+	0xc5, 0x60,				/* str   r5, [r0, #NUMICRO_ISPCMD_OFFSET]   */
+	0x46, 0x60,				/* str   r6, [r0, #NUMICRO_ISPADR_OFFSET]   */
+	0x87, 0x60,				/* str   r7, [r0, #NUMICRO_ISPDAT_OFFSET]   */
+	0x01, 0x26,				/* movs  r6, #1                             */
+	0x06, 0x61,				/* str   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	/* isp_busy: */
+	0x06, 0x69,				/* ldr   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	0xf6, 0x07,				/* lsls  r6, r6, #31                        */
+	0xfc, 0xd4,				/* bmi   isp_busy                           */
+	0x86, 0x68,				/* ldr   r6, [r0, #NUMICRO_ISPDAT_OFFSET]   */
+	0x04, 0x39,				/* subs  r1, #4                             */
+	0x40, 0xc1,				/* stmia r1!, {r6}                          */
+	0x06, 0x68,				/* ldr   r6, [r0, #NUMICRO_ISPCON_OFFSET]   */
+	0x40, 0x27,				/* movs  r7, #NUMICRO_ISPCON_ISPFF          */
+	0x3e, 0x42,				/* tst   r6, r7                             */
+	0x01, 0xd1,				/* bne   isp_exit                           */
+	0x52, 0x1e,				/* subs  r2, r2, #1                         */
+	0xed, 0xd1,				/* bne   isp_next                           */
+	/* isp_exit: */
+	0x30, 0x46,				/* mov   r0, r6                             */
+	0x00, 0xbe,				/* bkpt  #0                                 */
+	/* blank_check: */
+	/* bc_sector: */
+	0x00, 0x24,				/* movs  r4, #0                             */
+	0xe4, 0x43,				/* mvns  r4, r4                             */
+	0x45, 0x18,				/* adds  r5, r0, r1                         */
+	/* bc_word: */
+	0xc0, 0xc8,				/* ldmia r0!, {r6, r7}                      */
+	0x34, 0x40,				/* ands  r4, r6                             */
+	0x3c, 0x40,				/* ands  r4, r7                             */
+	0xa8, 0x42,				/* cmp   r0, r5                             */
+	0xfa, 0xd3,				/* blo   bc_word                            */
+	0x10, 0xc3,				/* stmia r3!, {r4}                          */
+	0x52, 0x1e,				/* subs  r2, r2, #1                         */
+	0xf4, 0xd1,				/* bne   bc_sector                          */
+	0x00, 0xbe,				/* bkpt  #0                                 */
+	/* #define NUMICRO_ISPCMD_WRITE  0x21 */
+	/* write_erase: */
+	/* we_wait_fifo: */
+	0x16, 0x68,				/* ldr   r6, [r2, #0]                       */
+	0x00, 0x2e,				/* cmp   r6, #0                             */
+	0x2a, 0xd0,				/* beq   we_exit                            */
+	0x55, 0x68,				/* ldr   r5, [r2, #4]                       */
+	0xb5, 0x42,				/* cmp   r5, r6                             */
+	0xf9, 0xd0,				/* beq   we_wait_fifo                       */
+	0x47, 0x46,				/* mov   r7, r8                             */
+	0x3c, 0x42,				/* tst   r4, r7                             */
+	0x0b, 0xd1,				/* bne   we_write                           */
+	0x22, 0x26,				/* movs  r6, #NUMICRO_ISPCMD_ERASE          */
+	0xc6, 0x60,				/* str   r6, [r0, #NUMICRO_ISPCMD_OFFSET]   */
+	0x44, 0x60,				/* str   r4, [r0, #NUMICRO_ISPADR_OFFSET]   */
+	0x01, 0x26,				/* movs  r6, #1                             */
+	0x06, 0x61,				/* str   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	/* we_erase_busy: */
+	0x06, 0x69,				/* ldr   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	0xf6, 0x07,				/* lsls  r6, r6, #31                        */
+	0xfc, 0xd4,				/* bmi   we_erase_busy                      */
+	0x06, 0x68,				/* ldr   r6, [r0, #NUMICRO_ISPCON_OFFSET]   */
+	0x40, 0x27,				/* movs  r7, #NUMICRO_ISPCON_ISPFF          */
+	0x3e, 0x42,				/* tst   r6, r7                             */
+	0x16, 0xd1,				/* bne   we_error                           */
+	/* we_write: */
+	0x21, 0x26,				/* movs  r6, #NUMICRO_ISPCMD_WRITE          */
+	0xc6, 0x60,				/* str   r6, [r0, #NUMICRO_ISPCMD_OFFSET]   */
+	0x44, 0x60,				/* str   r4, [r0, #NUMICRO_ISPADR_OFFSET]   */
+	0x40, 0xcd,				/* ldmia r5!, {r6}                          */
+	0x86, 0x60,				/* str   r6, [r0, #NUMICRO_ISPDAT_OFFSET]   */
+	0x01, 0x26,				/* movs  r6, #1                             */
+	0x06, 0x61,				/* str   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	/* we_busy: */
+	0x06, 0x69,				/* ldr   r6, [r0, #NUMICRO_ISPTRG_OFFSET]   */
+	0xf6, 0x07,				/* lsls  r6, r6, #31                        */
+	0xfc, 0xd4,				/* bmi   we_busy                            */
+	0x06, 0x68,				/* ldr   r6, [r0, #NUMICRO_ISPCON_OFFSET]   */
+	0x40, 0x27,				/* movs  r7, #NUMICRO_ISPCON_ISPFF          */
+	0x3e, 0x42,				/* tst   r6, r7                             */
+	0x08, 0xd1,				/* bne   we_error                           */
+	0x04, 0x34,				/* adds  r4, #4                             */
+	0x9d, 0x42,				/* cmp   r5, r3                             */
+	0x01, 0xd3,				/* bcc   we_no_wrap                         */
+	0x15, 0x46,				/* mov   r5, r2                             */
+	0x08, 0x35,				/* adds  r5, #8                             */
+	/* we_no_wrap: */
+	0x55, 0x60,				/* str   r5, [r2, #4]                       */
+	0x49, 0x1e,				/* subs  r1, r1, #1                         */
+	0xd4, 0xd1,				/* bne   we_wait_fifo                       */
+	0x01, 0xe0,				/* b     we_exit                            */
+	/* we_error: */
+	0x00, 0x20,				/* movs  r0, #0                             */
+	0x50, 0x60,				/* str   r0, [r2, #4]                       */
+	/* we_exit: */
+	0x30, 0x46,				/* mov   r0, r6                             */
+	0x00, 0xbe,				/* bkpt  #0                                 */
 };
 
-static const uint8_t numicro_M4_M23_flash_write_code[] = {
-	/* Params:
-	* r0 - workarea buffer / result
-	* r1 - target address
-	* r2 - wordcount
-	* Clobbered:
-	* r4 - tmp
-	* r5 - tmp
-	* r6 - tmp
-	* r7 - tmp
-	*/
+/* Streams a target_run_flash_async_algorithm() FIFO into the ProgramPage
+ * function of a CMSIS flash algorithm, contrib/loaders/flash/numicro_flm.S */
+static const uint8_t numicro_flm_stream_code[] = {
+	/* flm_write: */
+	/* fw_wait_fifo: */
+	0x28, 0x68,				/* ldr   r0, [r5, #0]                       */
+	0x00, 0x28,				/* cmp   r0, #0                             */
+	0x1a, 0xd0,				/* beq   fw_exit                            */
+	0x6a, 0x68,				/* ldr   r2, [r5, #4]                       */
+	0x82, 0x42,				/* cmp   r2, r0                             */
+	0xf9, 0xd0,				/* beq   fw_wait_fifo                       */
+	0x41, 0x46,				/* mov   r1, r8                             */
+	0x8c, 0x42,				/* cmp   r4, r1                             */
+	0x00, 0xd2,				/* bhs   fw_program                         */
+	0x21, 0x46,				/* mov   r1, r4                             */
+	/* fw_program: */
+	0x8b, 0x46,				/* mov   r11, r1                            */
+	0x38, 0x46,				/* mov   r0, r7                             */
+	0xd0, 0x47,				/* blx   r10                                */
+	0x00, 0x28,				/* cmp   r0, #0                             */
+	0x0c, 0xd1,				/* bne   fw_error                           */
+	0x59, 0x46,				/* mov   r1, r11                            */
+	0x0f, 0x44,				/* add   r7, r1                             */
+	0x64, 0x1a,				/* subs  r4, r4, r1                         */
+	0x6a, 0x68,				/* ldr   r2, [r5, #4]                       */
+	0x42, 0x44,				/* add   r2, r8                             */
+	0xb2, 0x42,				/* cmp   r2, r6                             */
+	0x01, 0xd3,				/* bcc   fw_no_wrap                         */
+	0x2a, 0x46,				/* mov   r2, r5                             */
+	0x08, 0x32,				/* adds  r2, #8                             */
+	/* fw_no_wrap: */
+	0x6a, 0x60,				/* str   r2, [r5, #4]                       */
+	0x00, 0x2c,				/* cmp   r4, #0                             */
+	0xe4, 0xd1,				/* bne   fw_wait_fifo                       */
+	0x01, 0xe0,				/* b     fw_exit                            */
+	/* fw_error: */
+	0x00, 0x20,				/* movs  r0, #0                             */
+	0x68, 0x60,				/* str   r0, [r5, #4]                       */
+	/* fw_exit: */
+	0x00, 0xbe,				/* bkpt  #0                                 */
+	/* flm_write_words: */
+	0x50, 0x46,				/* mov   r0, r10                            */
+	0x01, 0xb4,				/* push  {r0}                               */
+	0x02, 0xa0,				/* adr   r0, fw_words                       */
+	0x01, 0x30,				/* adds  r0, #1                             */
+	0x82, 0x46,				/* mov   r10, r0                            */
+	0xda, 0xe7,				/* b     fw_wait_fifo                       */
+	0xc0, 0x46,				/* nop, align fw_words                      */
+	/* fw_words: */
+	0x03, 0x46,				/* mov   r3, r0                             */
+	0x10, 0x46,				/* mov   r0, r2                             */
+	0x8a, 0x08,				/* lsrs  r2, r1, #2                         */
+	0x19, 0x46,				/* mov   r1, r3                             */
+	0x00, 0x9b,				/* ldr   r3, [sp, #0]                       */
+	0x18, 0x47,				/* bx    r3                                 */
+};
 
-	/* .L1: */
-	/* for(register uint32_t i=0;i<wcount;i++){ */
-	0x04, 0x1C,				/* mov    r4, r0          */
-	0x00, 0x23,				/* mov    r3, #0          */
-	/* .L2: */
-	0x0D, 0x1A,				/* sub    r5, r1, r0      */
-	0x67, 0x19,				/* add    r7, r4, r7      */
-	0x93, 0x42,				/* cmp	  r3, r2		  */
-	0x0C, 0xD0,				/* beq    .L7             */
-	/* .L4: */
-	/* NUMICRO_FLASH_ISPADR = faddr; */
-	0x08, 0x4E,				/* ldr	r6, .L8           */
-	0x37, 0x60,				/* str	r7, [r6]          */
-	/* NUMICRO_FLASH_ISPDAT = *pLW; */
-	0x80, 0xCC,				/* ldmia	r4!, {r7}     */
-	0x08, 0x4D,				/* ldr	r5, .L8+4         */
-	0x2F, 0x60,				/* str	r7, [r5]		  */
-	/* faddr += 4; */
-	/* pLW++; */
-	/*  Trigger write action  */
-	/* NUMICRO_FLASH_ISPTRG = ISPTRG_ISPGO; */
-	0x08, 0x4D,				/* ldr	r5, .L8+8         */
-	0x01, 0x26,				/* mov	r6, #1            */
-	0x2E, 0x60,				/* str	r6, [r5]          */
-	/* .L3: */
-	/* while((NUMICRO_FLASH_ISPTRG & ISPTRG_ISPGO) == ISPTRG_ISPGO){}; */
-	0x2F, 0x68,				/* ldr	r7, [r5]          */
-	0xFF, 0x07,				/* lsl	r7, r7, #31       */
-	0xFC, 0xD4,				/* bmi	.L3               */
-
-	0x01, 0x33,				/* add	r3, r3, #1        */
-	0xEE, 0xE7,				/* b	.L2               */
-	/* .L7: */
-	/* return (NUMICRO_FLASH_ISPCON & ISPCON_ISPFF); */
-	0x05, 0x4B,				/* ldr	r3, .L8+12        */
-	0x18, 0x68,				/* ldr	r0, [r3]          */
-	0x40, 0x21,				/* mov	r1, #64           */
-	0x08, 0x40,				/* and	r0, r1            */
-	/* .L9: */
-	0x00, 0xBE,				/* bkpt    #0             */
-	/* .L8: */
-	0x04, 0xC0, 0x00, 0x40,/* .word	0x4000C004    */
-	0x08, 0xC0, 0x00, 0x40,/* .word	0x4000C008    */
-	0x10, 0xC0, 0x00, 0x40,/* .word	0x4000C010    */
-	0x00, 0xC0, 0x00, 0x40 /* .word	0x4000C000    */
+/* One ISP command; data is ISPDAT going in, and the ISPDAT read back. */
+struct numicro_isp_cmd {
+	uint32_t cmd;
+	uint32_t addr;
+	uint32_t data;
 };
 
+/* Run a list of ISP commands. Up from NUMICRO_ISP_BATCH_MIN entries the
+ * list is run by numicro_flash_write_code on the target, which costs one
+ * algorithm run instead of six or more probe round trips per command. */
+static int numicro_fmc_cmd_batch(struct target *target, struct numicro_isp_cmd *cmds, unsigned int count)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	struct working_area *isp_algorithm, *list;
+	struct reg_param reg_params[3];
+	struct armv7m_algorithm armv7m_info;
+	uint32_t fmc_base = NUMICRO_FLASH_ISPCON - chip->address_minus_offset;
+	uint8_t *buf;
+	unsigned int i;
+	int retval;
+
+	for (i = 0; i < count; i++) {
+		if (cmds[i].cmd == ISPCMD_WRITE || cmds[i].cmd == ISPCMD_ERASE)
+			numicro_sectors_unknown(target, cmds[i].addr, 4);
+		else if (cmds[i].cmd == ISPCMD_CHIPERASE)
+			numicro_sectors_unknown(target, 0, 0);
+	}
+
+	if (count >= NUMICRO_ISP_BATCH_MIN &&
+		numicro_load_algorithm(target, numicro_flash_write_code,
+			sizeof(numicro_flash_write_code), &isp_algorithm) == ERROR_OK &&
+		target_alloc_working_area(target, count * 12, &list) == ERROR_OK) {
+		buf = malloc(count * 12);
+		if (buf == NULL) {
+			target_free_working_area(target, list);
+			return ERROR_FAIL;
+		}
+		for (i = 0; i < count; i++) {
+			target_buffer_set_u32(target, buf + i * 12, cmds[i].cmd);
+			target_buffer_set_u32(target, buf + i * 12 + 4, cmds[i].addr);
+			target_buffer_set_u32(target, buf + i * 12 + 8, cmds[i].data);
+		}
+
+		retval = target_write_buffer(target, list->address, count * 12, buf);
+		if (retval == ERROR_OK) {
+			armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+			armv7m_info.core_mode = ARM_MODE_THREAD;
+
+			init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);	/* FMC base (in), ISPCON (out) */
+			init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* command list */
+			init_reg_param(&reg_params[2], "r2", 32, PARAM_IN_OUT);	/* count (entries) */
+
+			buf_set_u32(reg_params[0].value, 0, 32, fmc_base);
+			buf_set_u32(reg_params[1].value, 0, 32, list->address);
+			buf_set_u32(reg_params[2].value, 0, 32, count);
+
+			retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
+				isp_algorithm->address + NUMICRO_FLASH_ISP_ENTRY, 0, 10000, &armv7m_info);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("Error executing NuMicro ISP algorithm");
+				retval = ERROR_FLASH_OPERATION_FAILED;
+			}
+			else {
+				uint32_t ispcon = buf_get_u32(reg_params[0].value, 0, 32);
+				if (ispcon & ISPCON_ISPFF) {
+					LOG_DEBUG("failure: 0x%" PRIx32 " at entry %" PRIu32 "", ispcon,
+						count - buf_get_u32(reg_params[2].value, 0, 32));
+					/* if bit is set, then must write to it to clear it. */
+					target_write_u32(target, fmc_base, ispcon | ISPCON_ISPFF);
+					retval = ERROR_FLASH_OPERATION_FAILED;
+				}
+			}
+
+			destroy_reg_param(&reg_params[0]);
+			destroy_reg_param(&reg_params[1]);
+			destroy_reg_param(&reg_params[2]);
+		}
+
+		if (retval == ERROR_OK)
+			retval = target_read_buffer(target, list->address, count * 12, buf);
+		if (retval == ERROR_OK) {
+			for (i = 0; i < count; i++)
+				cmds[i].data = target_buffer_get_u32(target, buf + i * 12 + 8);
+		}
+
+		free(buf);
+		target_free_working_area(target, list);
+		return retval;
+	}
+
+	for (i = 0; i < count; i++) {
+		retval = numicro_fmc_cmd(target, cmds[i].cmd, cmds[i].addr, cmds[i].data, &cmds[i].data);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 static const uint8_t numicro_M2351_NS_flash_write_code[] = {
 	/* Params:
 	* r0 - workarea buffer / result
 	* r1 - target address
 	* r2 - wordcount
-	* Clobbered:
-	* r4 - tmp
-	* r5 - tmp
-	* r6 - tmp
-	* r7 - tmp
+	* Returns to lr, pop {r4, r5, r7, pc} in place of the vendor bkpt;
+	* the bkpt appended at the end serves as lr for a plain run.
+	* r4-r11 are preserved.
 	*/
 	0xb0, 0xb5, 0x92, 0xb0, 0x13, 0x46, 0x0c, 0x46, 0x05, 0x46, 0x10, 0x90, 0x0f,
 	0x91, 0x0e, 0x92, 0x00, 0x20, 0x0d, 0x90, 0x06, 0x93, 0x05, 0x94, 0x04, 0x95,
@@ -1403,14 +2084,14 @@ static const uint8_t numicro_M2351_NS_flash_write_code[] = {
 	0x01, 0x20, 0x11, 0x90, 0x12, 0xe0, 0x0c, 0xe0, 0x0f, 0x98, 0x40, 0xf6, 0x00,
 	0x01, 0xc0, 0xf2, 0x21, 0x01, 0x88, 0x42, 0x04, 0xd1, 0xff, 0xe7, 0x00, 0xf0,
 	0x2f, 0xf8, 0x00, 0x90, 0xff, 0xe7, 0xff, 0xe7, 0xff, 0xe7, 0xff, 0xe7, 0x00,
-	0x20, 0x11, 0x90, 0xff, 0xe7, 0x11, 0x98, 0x12, 0xb0, 0x00, 0xbe, 0x03, 0xb4,
+	0x20, 0x11, 0x90, 0xff, 0xe7, 0x11, 0x98, 0x12, 0xb0, 0xb0, 0xbd, 0x03, 0xb4,
 	0x01, 0x48, 0x01, 0x90, 0x01, 0xbd, 0x19, 0x7e, 0x80, 0x00, 0x03, 0xb4, 0x01,
 	0x48, 0x01, 0x90, 0x01, 0xbd, 0x39, 0x7e, 0x80, 0x00, 0x03, 0xb4, 0x01, 0x48,
 	0x01, 0x90, 0x01, 0xbd, 0x29, 0x7f, 0x80, 0x00, 0x03, 0xb4, 0x01, 0x48, 0x01,
 	0x90, 0x01, 0xbd, 0x31, 0x7f, 0x80, 0x00, 0x03, 0xb4, 0x01, 0x48, 0x01, 0x90,
 	0x01, 0xbd, 0x79, 0x7e, 0x80, 0x00, 0x03, 0xb4, 0x01, 0x48, 0x01, 0x90, 0x01,
 	0xbd, 0x69, 0x7e, 0x80, 0x00, 0x03, 0xb4, 0x01, 0x48, 0x01, 0x90, 0x01, 0xbd,
-	0x19, 0x7f, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x19, 0x7f, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xbe,
 };
 
 static const uint8_t numicro_M2351_NS_flash_erase_code[] = {
@@ -1753,1034 +2434,846 @@ static const uint32_t numicro_NUC505_flash_algorithm_code[] = {
 	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000
 };
 
-static int numicro_init_isp(struct target *target)
+/* Loaders by family, see struct numicro_family. */
+static const struct numicro_family numicro_families[] = {
+	{
+		.name = "M480", .match = NUMICRO_MATCH_SPIM, .caps = NUMICRO_CAP_SPIM,
+		.code = numicro_M480_spim_flash_algorithm_code,
+		.code_size = sizeof(numicro_M480_spim_flash_algorithm_code),
+		.init = 0x315, .uninit = 0xC75, .erase_sector = 0x1E9, .chip_erase = 0x12D,
+		.program_page = 0x535, .static_base = 0x20000EE0, .lr = 0x20000001,
+		.addr_offset = NUMICRO_SPIM_FLASH_START_ADDRESS,
+	},
+	{
+		.name = "M480", .caps = NUMICRO_CAP_MULTI_WORD | NUMICRO_CAP_CRC,
+		.code = numicro_M480_flash_algorithm_code,
+		.code_size = sizeof(numicro_M480_flash_algorithm_code),
+		.program_page = 0x339, .lr = 0x20000001,
+	},
+	{
+		.name = "M460", .caps = NUMICRO_CAP_MULTI_WORD | NUMICRO_CAP_CRC,
+		.code = numicro_M460_flash_algorithm_code,
+		.code_size = sizeof(numicro_M460_flash_algorithm_code),
+		.erase_sector = 0xE5, .program_page = 0x12F, .static_base = 0x20000228, .lr = 0x20000001,
+	},
+	{
+		.name = "M471", .match = NUMICRO_MATCH_DFMC,
+		.code = numicro_M471_dataflash_flash_algorithm_code,
+		.code_size = sizeof(numicro_M471_dataflash_flash_algorithm_code),
+		.init = 0x5, .uninit = 0x99, .erase_sector = 0x105, .program_page = 0x151,
+		.static_base = 0x20000244, .lr = 0x20000001,
+	},
+	{
+		.name = "NUC505", .caps = NUMICRO_CAP_ISP_INIT | NUMICRO_CAP_RESET,
+		.code = numicro_NUC505_flash_algorithm_code,
+		.code_size = sizeof(numicro_NUC505_flash_algorithm_code),
+		.init = 0x1DD, .uninit = 0x261, .erase_sector = 0x283, .program_page = 0x295,
+		.static_base = 0x2000032C, .lr = 0x20000001, .stack = 126 * 1024, .block_size = 0x1000,
+	},
+	{
+		.name = "M2354", .match = NUMICRO_MATCH_NS, .caps = NUMICRO_CAP_ISP_INIT,
+		.code = numicro_M2354_NS_flash_algorithm_code,
+		.code_size = sizeof(numicro_M2354_NS_flash_algorithm_code),
+		.init = 0xC9, .erase_sector = 0x151, .program_page = 0x1E9, .lr = 0x30010001,
+	},
+	{
+		/* non-secure code calling the secure flash API of the M2351 */
+		.name = NULL, .match = NUMICRO_MATCH_NS, .caps = NUMICRO_CAP_WORD_ARGS,
+		.code = numicro_M2351_NS_flash_write_code,
+		.code_size = sizeof(numicro_M2351_NS_flash_write_code),
+		.erase_code = numicro_M2351_NS_flash_erase_code,
+		.erase_code_size = sizeof(numicro_M2351_NS_flash_erase_code),
+		.erase_sector = 0x1, .program_page = 0x1, .block_size = 0x800,
+	},
+	{
+		/* everything else programs through the FMC ISP registers */
+		.name = NULL, .caps = NUMICRO_CAP_ASYNC | NUMICRO_CAP_CRC,
+		.code = numicro_flash_write_code,
+		.code_size = sizeof(numicro_flash_write_code),
+	},
+};
+
+static uint32_t numicro_loader_slot_size(void)
 {
-	struct working_area *init_algorithm;
-	struct reg_param reg_params[6];
-	struct armv7m_common *armv7m = target_to_armv7m(target);
-	struct armv7m_algorithm armv7m_info;
-	uint32_t algorithm_init_entry_offset = 0;
-	uint32_t algorithm_lr = 0;
-	int retval = ERROR_OK;
-	uint32_t reg_stat;
+	uint32_t size = sizeof(numicro_M2351_NS_init_info_code);
 
-	if (target->state != TARGET_HALTED) {
-		LOG_ERROR("Target not halted");
-		return ERROR_TARGET_NOT_HALTED;
-	}
+	for (unsigned int i = 0; i < ARRAY_SIZE(numicro_families); i++)
+		size = MAX(size, MAX(numicro_families[i].code_size, numicro_families[i].erase_code_size));
 
-	if (m_M23SecureDebugState == NUMICRO_M23_SECURE_DEBUG_NS) {
-		if (strcmp(m_target_name, "M2354") == 0) {
-			algorithm_init_entry_offset = 0xC9;
-			algorithm_lr = 0x30010001;
+	return size;
+}
 
-			/* allocate working area with init info code */
-			if (target_alloc_working_area(target, sizeof(numicro_M2354_NS_flash_algorithm_code),
-				&init_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory erase");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
+static const struct numicro_family *numicro_find_family(struct target *target, uint32_t address)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	const struct numicro_family *family;
+	bool ns;
 
-			retval = target_write_buffer(target, init_algorithm->address,
-				sizeof(numicro_M2354_NS_flash_algorithm_code), (const uint8_t *)numicro_M2354_NS_flash_algorithm_code);
-			if (retval != ERROR_OK)
-				return retval;
+	numicro_get_arm_arch(target);
+	ns = chip->m23_secure_debug_state == NUMICRO_M23_SECURE_DEBUG_NS;
+
+	for (family = numicro_families; family < numicro_families + ARRAY_SIZE(numicro_families); family++) {
+		if (family->name && strcmp(family->name, chip->target_name) != 0)
+			continue;
+		if ((family->match & NUMICRO_MATCH_SPIM) && address < NUMICRO_SPIM_FLASH_START_ADDRESS)
+			continue;
+		if ((family->match & NUMICRO_MATCH_DFMC) && address < NUMICRO_DATA_DFMC_BASE)
+			continue;
+		if (!(family->match & NUMICRO_MATCH_NS) != !ns)
+			continue;
+		break;
+	}
 
-			armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-			armv7m_info.core_mode = ARM_MODE_THREAD;
-			if (armv7m == NULL) {
-				/* something is very wrong if armv7m is NULL */
-				LOG_ERROR("unable to get armv7m target");
-				return retval;
-			}
+	LOG_DEBUG("NuMicro loader for %s at 0x%08" PRIx32 ": %s%s", chip->target_name, address,
+		family->name ? family->name : "common", ns ? " (non-secure)" : "");
 
-			init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-			init_reg_param(&reg_params[1], "sp", 32, PARAM_OUT);    /* update SP */
-			init_reg_param(&reg_params[2], "lr", 32, PARAM_OUT);
+	return family;
+}
 
-			buf_set_u32(reg_params[0].value, 0, 32, 0);
-			buf_set_u32(reg_params[1].value, 0, 32, init_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[2].value, 0, 32, algorithm_lr);
+/* The family picked at probe, or found now for banks not probed yet. */
+static const struct numicro_family *numicro_bank_family(struct flash_bank *bank)
+{
+	struct numicro_flash_bank *numicro_info = bank->driver_priv;
 
-			retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
-				init_algorithm->address + algorithm_init_entry_offset, 0, 100000, &armv7m_info);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error executing NuMicro Flash erase algorithm");
-				retval = ERROR_FLASH_OPERATION_FAILED;
-			}
+	if (numicro_info->family == NULL)
+		numicro_info->family = numicro_find_family(bank->target, bank->base);
 
-			target_free_working_area(target, init_algorithm);
-			destroy_reg_param(&reg_params[0]);
-			destroy_reg_param(&reg_params[1]);
-			destroy_reg_param(&reg_params[2]);
-		}
-		else {
-			LOG_DEBUG("numicro_init_isp skips since Secure invasive debug is prohibited.");
-		}
-		return ERROR_OK;
-	}
+	return numicro_info->family;
+}
 
-	if (strcmp(m_target_name, "NUC505") == 0) {
-		algorithm_init_entry_offset = 0x1DD;
-		algorithm_lr = 0x20000001;
+/* CMSIS flash algorithm calling convention: r0-r2 arguments, r9 static
+ * base, sp and the return address where the loader stops on a breakpoint. */
+static void numicro_flm_init_params(struct reg_param *reg_params)
+{
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
+	init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);
+	init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);
+}
 
-		/* allocate working area with init info code */
-		if (target_alloc_working_area(target, sizeof(numicro_NUC505_flash_algorithm_code),
-			&init_algorithm) != ERROR_OK) {
-			LOG_WARNING("no working area available, can't do block memory erase");
-			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-		}
+static void numicro_flm_destroy_params(struct reg_param *reg_params)
+{
+	for (int i = 0; i < 6; i++)
+		destroy_reg_param(&reg_params[i]);
+}
 
-		retval = target_write_buffer(target, init_algorithm->address,
-			sizeof(numicro_NUC505_flash_algorithm_code), (const uint8_t *)numicro_NUC505_flash_algorithm_code);
-		if (retval != ERROR_OK)
-			return retval;
+/* Stack top of the family loader: where it is linked for, or the end of
+ * the stack area numicro_load_algorithm() keeps along with the loader. */
+static uint32_t numicro_flm_stack(struct target *target, const struct numicro_family *family,
+		struct working_area *loader)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
 
-		armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-		armv7m_info.core_mode = ARM_MODE_THREAD;
-		if (armv7m == NULL) {
-			/* something is very wrong if armv7m is NULL */
-			LOG_ERROR("unable to get armv7m target");
-			return retval;
-		}
+	if (family->stack)
+		return loader->address + family->stack;
 
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
-		init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);    /* update LR */
-
-		/* use init info code within NuMicro */
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0);
-		buf_set_u32(reg_params[2].value, 0, 32, 0);
-		buf_set_u32(reg_params[3].value, 0, 32, 0x2000032C);
-		buf_set_u32(reg_params[4].value, 0, 32, init_algorithm->address + 126 * 1024);
-		buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
-
-		retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-			init_algorithm->address + algorithm_init_entry_offset, 0, 100000, &armv7m_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro init algorithm");
-			retval = ERROR_FLASH_OPERATION_FAILED;
-		}
+	return chip->stack->address + chip->stack->size;
+}
 
-		target_free_working_area(target, init_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-		destroy_reg_param(&reg_params[4]);
-		destroy_reg_param(&reg_params[5]);
-	}
-	else {
-		retval = numicro_reg_unlock(target);
-		if (retval != ERROR_OK)
-			return retval;
+static void numicro_flm_set_params(struct target *target, const struct numicro_family *family,
+		struct working_area *loader, struct reg_param *reg_params, uint32_t r0, uint32_t r1, uint32_t r2)
+{
+	buf_set_u32(reg_params[0].value, 0, 32, r0);
+	buf_set_u32(reg_params[1].value, 0, 32, r1);
+	buf_set_u32(reg_params[2].value, 0, 32, r2);
+	buf_set_u32(reg_params[3].value, 0, 32, family->static_base);
+	buf_set_u32(reg_params[4].value, 0, 32, numicro_flm_stack(target, family, loader));
+	buf_set_u32(reg_params[5].value, 0, 32, family->lr ? family->lr :
+		(loader->address + family->code_size - 2) | 1);
+}
 
-		/* Enable ISP/SRAM/TICK Clock */
-		retval = target_read_u32(target, NUMICRO_SYSCLK_AHBCLK - m_addressMinusOffset, &reg_stat);
-		if (retval != ERROR_OK)
-			return retval;
-
-		reg_stat |= AHBCLK_ISP_EN | AHBCLK_SRAM_EN | AHBCLK_TICK_EN;
-		retval = target_write_u32(target, NUMICRO_SYSCLK_AHBCLK - m_addressMinusOffset, reg_stat);
-		if (retval != ERROR_OK)
-			return retval;
-
-		/* Enable ISP */
-		retval = target_read_u32(target, NUMICRO_FLASH_ISPCON - m_addressMinusOffset, &reg_stat);
-		if (retval != ERROR_OK)
-			return retval;
-
-		reg_stat |= ISPCON_ISPFF | ISPCON_LDUEN | ISPCON_APUEN | ISPCON_CFGUEN | ISPCON_ISPEN;
-		retval = target_write_u32(target, NUMICRO_FLASH_ISPCON - m_addressMinusOffset, reg_stat);
-		if (retval != ERROR_OK)
-			return retval;
-
-		/* Write one to undocumented flash control register */
-	//	retval = target_write_u32(target, NUMICRO_FLASH_CHEAT - m_addressMinusOffset, 1);
-	//	if (retval != ERROR_OK)
-	//		return retval;
+/* Loaders returning to a fixed lr are linked for the address just below
+ * it, the start of the working area, and run from nowhere else. */
+static int numicro_flm_check_placement(struct target *target, const struct numicro_family *family,
+		struct working_area *loader)
+{
+	uint32_t base = family->lr & ~1u;
 
-		if (armv7m == NULL) {
-			/* something is very wrong if armv7m is NULL */
-			LOG_ERROR("unable to get armv7m target");
-			return retval;
-		}
-		if (armv7m->arm.is_armv6m) {
-			retval = target_write_u32(target, NUMICRO_FLASH_CHEAT - m_addressMinusOffset, 1);
-			if (retval != ERROR_OK)
-				return retval;
-		}
+	if (family->lr && loader->address != base) {
+		LOG_ERROR("NuMicro %s loader is at 0x%08" PRIx32 ", it only runs from 0x%08" PRIx32
+				" (working area at 0x%08" PRIx32 ")", family->name, loader->address,
+				base, target->working_area);
+		return ERROR_FAIL;
 	}
 
-	LOG_DEBUG("numicro_init_isp is done.");
 	return ERROR_OK;
 }
 
-/* Program LongWord Block Write */
-static int numicro_writeblock(struct flash_bank *bank, const uint8_t *buffer,
-		uint32_t offset, uint32_t count)
+/* Run one loader function to completion. */
+static int numicro_flm_call(struct target *target, const struct numicro_family *family,
+		struct working_area *loader, uint32_t entry, uint32_t r0, uint32_t r1, uint32_t r2,
+		const char *what)
 {
-	struct target *target = bank->target;
-	uint32_t buffer_size = 1024; /* Default minimum value */
-	uint32_t totalCount = count;
-	uint32_t thisrun_count = 0;
-	struct working_area *write_algorithm;
-	struct working_area *source;
-	struct working_area *source2;
-	uint32_t address = bank->base + offset;
 	struct reg_param reg_params[6];
-	struct armv7m_common *armv7m = target_to_armv7m(target);
 	struct armv7m_algorithm armv7m_info;
-	uint32_t algorithm_programPage_entry_offset = 0;
-	uint32_t algorithm_lr = 0;
-	bool bSPIMFlashWrite = (bank->base + offset < NUMICRO_SPIM_FLASH_START_ADDRESS)? 0 : 1;
-	bool bDFMCFlashWrite = (bank->base + offset < NUMICRO_DATA_DFMC_BASE)? 0 : 1;
-	int retval = ERROR_OK;
+	int retval;
 
-	/* Params:
-	 * r0 - workarea buffer / result
-	 * r1 - target address
-	 * r2 - wordcount
-	 * Clobbered:
-	 * r4 - tmp
-	 * r5 - tmp
-	 * r6 - tmp
-	 * r7 - tmp
-	 */
+	retval = numicro_flm_check_placement(target, family, loader);
+	if (retval != ERROR_OK)
+		return retval;
 
-	/* check code alignment */
-	if (offset & 0x1) {
-		LOG_WARNING("offset 0x%" PRIx32 " breaks required 2-byte alignment", offset);
-		return ERROR_FLASH_DST_BREAKS_ALIGNMENT;
-	}
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
 
-	/* Difference between M0 and M4(M23) */
-	if (armv7m->arm.is_armv6m) {
-		/* allocate working area with flash programming code */
-		if (armv7m->arm.is_NUC_M0_FMC_MSB4) {
-			if (target_alloc_working_area(target, sizeof(numicro_M4_M23_flash_write_code),
-				&write_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory writes");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
+	numicro_flm_init_params(reg_params);
+	numicro_flm_set_params(target, family, loader, reg_params, r0, r1, r2);
 
-			retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(numicro_M4_M23_flash_write_code), numicro_M4_M23_flash_write_code);
-			if (retval != ERROR_OK)
-				return retval;
-		}
-		else {
-			if (target_alloc_working_area(target, sizeof(numicro_M0_flash_write_code),
-				&write_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory writes");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
-
-			retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(numicro_M0_flash_write_code), numicro_M0_flash_write_code);
-			if (retval != ERROR_OK)
-				return retval;
-		}
+	retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
+		loader->address + entry, 0, 100000, &armv7m_info);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error executing NuMicro %s algorithm", what);
+		retval = ERROR_FLASH_OPERATION_FAILED;
 	}
-	else { /* for M4 and M23 */
-		if (strcmp(m_target_name, "M480") == 0) {
-			if (bSPIMFlashWrite) {
-				/* allocate working area with flash programming code */
-				if (target_alloc_working_area(target, sizeof(numicro_M480_spim_flash_algorithm_code),
-					&write_algorithm) != ERROR_OK) {
-					LOG_WARNING("no working area available, can't do block memory writes");
-					return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-				}
-
-				retval = target_write_buffer(target, write_algorithm->address,
-					sizeof(numicro_M480_spim_flash_algorithm_code), (const uint8_t *)numicro_M480_spim_flash_algorithm_code);
-				if (retval != ERROR_OK)
-					return retval;
-			}
-			else {
-				algorithm_programPage_entry_offset = 0x339;
-				algorithm_lr = 0x20000001;
-
-				/* allocate working area with flash programming code */
-				if (target_alloc_working_area(target, sizeof(numicro_M480_flash_algorithm_code),
-					&write_algorithm) != ERROR_OK) {
-					LOG_WARNING("no working area available, can't do block memory writes");
-					return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-				}
-
-				retval = target_write_buffer(target, write_algorithm->address,
-					sizeof(numicro_M480_flash_algorithm_code), (const uint8_t *)numicro_M480_flash_algorithm_code);
-				if (retval != ERROR_OK)
-					return retval;
-			}
-		}
-		else if (strcmp(m_target_name, "NUC505") == 0) {
-			buffer_size = 0x1000;
-			algorithm_programPage_entry_offset = 0x295;
-			algorithm_lr = 0x20000001;
-
-			/* allocate working area with flash programming code */
-			if (target_alloc_working_area(target, sizeof(numicro_NUC505_flash_algorithm_code),
-				&write_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory writes");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
 
-			retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(numicro_NUC505_flash_algorithm_code), (const uint8_t *)numicro_NUC505_flash_algorithm_code);
-			if (retval != ERROR_OK)
-				return retval;
-		}
-		else if ((strcmp(m_target_name, "NUC1262") == 0) ||
-				(strcmp(m_target_name, "NUC1263") == 0)) {
-			if (target_alloc_working_area(target, sizeof(numicro_M0_flash_write_code),
-				&write_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory writes");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
-
-			retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(numicro_M0_flash_write_code), numicro_M0_flash_write_code);
-			if (retval != ERROR_OK)
-				return retval;
-		}
-		else if (strcmp(m_target_name, "M460") == 0) {
-			buffer_size = 0x1000;
+	numicro_flm_destroy_params(reg_params);
 
-			if (target_alloc_working_area(target, sizeof(numicro_M460_flash_algorithm_code),
-				&write_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory writes");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
+	return retval;
+}
 
-			retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(numicro_M460_flash_algorithm_code), (const uint8_t *)numicro_M460_flash_algorithm_code);
-			if (retval != ERROR_OK)
-				return retval;
-		}		
-		else if(strcmp(m_target_name, "M471") == 0 && bDFMCFlashWrite) {
-			if (target_alloc_working_area(target, sizeof(numicro_M471_dataflash_flash_algorithm_code),
-				&write_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory writes");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
+/* Run the init function of the family loader, unless a write session
+ * keeps it initialised already. */
+static int numicro_flm_begin(struct target *target, const struct numicro_family *family,
+		struct working_area *loader)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	int retval = ERROR_OK;
 
-			retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(numicro_M471_dataflash_flash_algorithm_code), (const uint8_t *)numicro_M471_dataflash_flash_algorithm_code);
-			if (retval != ERROR_OK)
-				return retval;
-		}
-		else if (m_M23SecureDebugState != NUMICRO_M23_SECURE_DEBUG_NS) {
-			/* allocate working area with flash programming code */
-			if (target_alloc_working_area(target, sizeof(numicro_M4_M23_flash_write_code),
-				&write_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory writes");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
+	if (chip->flm_open == family)
+		return ERROR_OK;
 
-			retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(numicro_M4_M23_flash_write_code), numicro_M4_M23_flash_write_code);
-			if (retval != ERROR_OK)
-				return retval;
-		}
-		else {
-			if (strcmp(m_target_name, "M2354") == 0) {
-				algorithm_programPage_entry_offset = 0x1E9;
-				algorithm_lr = 0x30010001;
-
-				/* allocate working area with flash programming code */
-				if (target_alloc_working_area(target, sizeof(numicro_M2354_NS_flash_algorithm_code),
-					&write_algorithm) != ERROR_OK) {
-					LOG_WARNING("no working area available, can't do block memory writes");
-					return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-				}
+	if (family->init && !(family->caps & NUMICRO_CAP_ISP_INIT))
+		retval = numicro_flm_call(target, family, loader, family->init, 0, 0, 0, "init");
 
-				retval = target_write_buffer(target, write_algorithm->address,
-					sizeof(numicro_M2354_NS_flash_algorithm_code), (const uint8_t *)numicro_M2354_NS_flash_algorithm_code);
-				if (retval != ERROR_OK)
-					return retval;
-			}
-			else {
-				/* allocate working area with flash programming code */
-				if (target_alloc_working_area(target, sizeof(numicro_M2351_NS_flash_write_code),
-					&write_algorithm) != ERROR_OK) {
-					LOG_WARNING("no working area available, can't do block memory writes");
-					return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-				}
+	/* only loaders with something to undo stay open */
+	if (retval == ERROR_OK && chip->write_session &&
+		(family->uninit || (family->caps & NUMICRO_CAP_RESET)))
+		chip->flm_open = family;
 
-				retval = target_write_buffer(target, write_algorithm->address,
-					sizeof(numicro_M2351_NS_flash_write_code), numicro_M2351_NS_flash_write_code);
-				if (retval != ERROR_OK)
-					return retval;
-			}
-		}
-		/*buffer_size = m_pageSize; <- it doesn't matter because the flash algorithm uses the word programming. */
-	}
+	return retval;
+}
 
-	/* Increase buffer_size if needed */
-	if (buffer_size == 1024 /*&& buffer_size < ((target->working_area_size - write_algorithm->size)/2)*/) {
-		buffer_size = (target->working_area_size - write_algorithm->size - 512) / 2; /* 512 bytes for stack */
+static void numicro_flm_reset(struct target *target)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
 
-		if (buffer_size & 0x1)
-			buffer_size = buffer_size - 1;
+	/* chip reset */
+	chip->isp_ready = false;
+	target_write_u32(target, 0x40000008, 0x2);
+	/* wait for NUC505 IBR operations */
+	busy_sleep(50);
+}
 
-		/* buffer for alignment */
-		if (buffer_size >= 128) {
-			buffer_size = buffer_size / 128 * 128;
-		}
-		else {
-			buffer_size = buffer_size - 10;
-		}
-	}
+/* Undo numicro_flm_begin, or leave it to numicro_flm_close at the end of
+ * the write session. reset asks for the chip reset of the family. */
+static int numicro_flm_end(struct target *target, const struct numicro_family *family,
+		struct working_area *loader, bool reset)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	int retval = ERROR_OK;
 
-	/* memory buffer */
-	if ((target_alloc_working_area(target, buffer_size, &source) != ERROR_OK) ||
-		(target_alloc_working_area(target, buffer_size, &source2) != ERROR_OK)) {
-		/* free working area, write algorithm already allocated */
-		target_free_working_area(target, write_algorithm);
+	reset = reset && (family->caps & NUMICRO_CAP_RESET);
 
-		LOG_WARNING("No large enough working area available, can't do block memory writes");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-	armv7m_info.core_mode = ARM_MODE_THREAD;
-	if (armv7m == NULL) {
-		/* something is very wrong if armv7m is NULL */
-		LOG_ERROR("unable to get armv7m target");
-		return retval;
+	if (chip->flm_open == family) {
+		chip->flm_reset |= reset;
+		return ERROR_OK;
 	}
 
-	if ((strcmp(m_target_name, "M2354") == 0 && m_M23SecureDebugState == NUMICRO_M23_SECURE_DEBUG_NS) ||
-		(strcmp(m_target_name, "M480")  == 0 && !bSPIMFlashWrite)) {
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);    /* number of words to program */
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_IN_OUT); /* *pLW (*buffer) */
-		init_reg_param(&reg_params[3], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[4], "lr", 32, PARAM_OUT);    /* update LR */
-
-		/* write code buffer and use flash programming code within numicro */
-		/* set breakpoint to 0 with time-out of 10000 ms                  */
-		while (count > 0) {
-			if (count == totalCount) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
-
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
-
-			buf_set_u32(reg_params[0].value, 0, 32, address/* & NUMICRO_TZ_MASK*/);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source->address);
-			buf_set_u32(reg_params[3].value, 0, 32, write_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[4].value, 0, 32, algorithm_lr);
-
-			retval = target_start_algorithm(target, 0, NULL, 5, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	if (family->uninit)
+		retval = numicro_flm_call(target, family, loader, family->uninit, 0, 0, 0, "Flash uninit");
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+	if (reset)
+		numicro_flm_reset(target);
 
-			thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	return retval;
+}
 
-			if (thisrun_count > 0) {
-				retval = target_write_buffer(target, source2->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+/* Uninit the loader a write session kept initialised. */
+static int numicro_flm_close(struct target *target)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	const struct numicro_family *family = chip->flm_open;
+	struct working_area *loader;
+	bool reset = chip->flm_reset;
+	int retval = ERROR_OK;
 
-			retval = target_wait_algorithm(target, 0, NULL, 5, reg_params,
-				0, 10000, &armv7m_info);
+	if (family == NULL)
+		return ERROR_OK;
 
-			if (thisrun_count == 0)
-				break;
+	chip->flm_open = NULL;
+	chip->flm_reset = false;
 
-			buf_set_u32(reg_params[0].value, 0, 32, address/* & NUMICRO_TZ_MASK*/);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source2->address);
-			buf_set_u32(reg_params[3].value, 0, 32, write_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[4].value, 0, 32, algorithm_lr);
+	if (family->uninit) {
+		retval = numicro_load_algorithm(target, family->code, family->code_size, &loader);
+		if (retval == ERROR_OK)
+			retval = numicro_flm_end(target, family, loader, false);
+	}
 
-			retval = target_start_algorithm(target, 0, NULL, 5, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	if (reset)
+		numicro_flm_reset(target);
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+	return retval;
+}
 
-			if (count != 0) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+/* Erase sectors first..last with the family loader. A whole bank goes in
+ * one chip erase where the loader has one. */
+static int numicro_flm_erase(struct flash_bank *bank, const struct numicro_family *family,
+		int first, int last)
+{
+	struct target *target = bank->target;
+	struct numicro_chip *chip = numicro_get_chip(target);
+	struct working_area *loader;
+	uint32_t address;
+	int i, retval;
 
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	if (family->erase_code)
+		retval = numicro_load_algorithm(target, family->erase_code, family->erase_code_size, &loader);
+	else
+		retval = numicro_load_algorithm(target, family->code, family->code_size, &loader);
+	if (retval != ERROR_OK)
+		return retval;
 
-			retval = target_wait_algorithm(target, 0, NULL, 5, reg_params,
-				0, 10000, &armv7m_info);
-		}
+	retval = numicro_flm_begin(target, family, loader);
+	if (retval != ERROR_OK)
+		return retval;
 
-		target_free_working_area(target, source);
-		target_free_working_area(target, source2);
-		target_free_working_area(target, write_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-		destroy_reg_param(&reg_params[4]);
-	}
-	else if (strcmp(m_target_name, "M480") == 0 && bSPIMFlashWrite) {
-		// init
-		algorithm_programPage_entry_offset = 0x315;
-		algorithm_lr = 0x20000001;
-
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
-		init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);    /* update LR */
-
-		/* use init info code within NuMicro */
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0);
-		buf_set_u32(reg_params[2].value, 0, 32, 0);
-		buf_set_u32(reg_params[3].value, 0, 32, 0x20000EE0);
-		buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-		buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
-
-		retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-			write_algorithm->address + algorithm_programPage_entry_offset, 0, 100000, &armv7m_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro init algorithm");
-			retval = ERROR_FLASH_OPERATION_FAILED;
+	if (family->chip_erase && first == 0 && last == bank->num_sectors - 1) {
+		retval = numicro_flm_call(target, family, loader, family->chip_erase, 0, 0, 0, "chip erase");
+		if (retval == ERROR_OK) {
+			for (i = first; i <= last; i++)
+				bank->sectors[i].is_erased = 1;
 		}
+	}
 
-		// ChipErase
-		if (!m_bSPIMFlashSectorErased) {
-			algorithm_programPage_entry_offset = 0x12D;
-			retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, 100000, &armv7m_info);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error executing NuMicro chip erase algorithm");
-				retval = ERROR_FLASH_OPERATION_FAILED;
-			}
+	for (i = first; i <= last && retval == ERROR_OK; i++) {
+		if (bank->sectors[i].is_erased == 1) {
+			LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
+			continue;
 		}
-		m_bSPIMFlashSectorErased = 0;
 
-		// ProgramPage
-		algorithm_programPage_entry_offset = 0x535;
-		algorithm_lr = 0x20000001;
+		address = bank->base + bank->sectors[i].offset - family->addr_offset;
+		retval = numicro_flm_call(target, family, loader, family->erase_sector, address, 0, 0, "Flash erase");
+		if (retval == ERROR_OK)
+			bank->sectors[i].is_erased = 1;
+	}
 
-		/* write code buffer and use flash programming code within numicro */
-		/* set breakpoint to 0 with time-out of 10000 ms                  */
-		while (count > 0) {
-			if (count == totalCount) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	int retval2 = numicro_flm_end(target, family, loader, false);
+	if (retval == ERROR_OK)
+		retval = retval2;
 
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	if (retval == ERROR_OK && (family->caps & NUMICRO_CAP_SPIM))
+		chip->spim_sector_erased = 1;
 
-			buf_set_u32(reg_params[0].value, 0, 32, address - NUMICRO_SPIM_FLASH_START_ADDRESS);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source->address);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x20000EE0);
-			buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+	return retval;
+}
 
-			retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+/* Whether an area overlaps the stack a family loader is linked with. */
+static bool numicro_flm_on_stack(const struct numicro_family *family,
+		struct working_area *loader, struct working_area *area)
+{
+	uint32_t top = loader->address + family->stack;
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+	return family->stack && area->address < top &&
+		area->address + area->size > top - NUMICRO_ALGORITHM_STACK_SIZE;
+}
 
-			thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+/* Allocate a loader buffer of size bytes, or of at least min_size bytes
+ * when the full size would reach into the loader stack of the family. */
+static int numicro_flm_alloc(struct target *target, const struct numicro_family *family,
+		struct working_area *loader, uint32_t size, uint32_t min_size, struct working_area **area)
+{
+	uint32_t limit = loader->address + family->stack - NUMICRO_ALGORITHM_STACK_SIZE;
 
-			if (thisrun_count > 0) {
-				retval = target_write_buffer(target, source2->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	if (target_alloc_working_area(target, size, area) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-			retval = target_wait_algorithm(target, 0, NULL, 6, reg_params,
-				0, 10000, &armv7m_info);
+	if (!numicro_flm_on_stack(family, loader, *area))
+		return ERROR_OK;
 
-			if (thisrun_count == 0)
-				break;
+	/* Try what fits below the stack. Working areas are best fit, so the
+	 * smaller one need not start at the same place: check it again. */
+	size = ((*area)->address < limit) ? (limit - (*area)->address) & ~3UL : 0;
+	target_free_working_area(target, *area);
+	*area = NULL;
 
-			buf_set_u32(reg_params[0].value, 0, 32, address - NUMICRO_SPIM_FLASH_START_ADDRESS);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source2->address);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x20000EE0);
-			buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+	if (size < min_size || target_alloc_working_area(target, size, area) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-			retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	if (numicro_flm_on_stack(family, loader, *area)) {
+		target_free_working_area(target, *area);
+		*area = NULL;
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+	return ERROR_OK;
+}
 
-			if (count != 0) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+/* Stream count bytes to ProgramPage of the family loader through
+ * numicro_flm_stream_code, which calls it once per FIFO block while the
+ * host keeps the FIFO filled. NUMICRO_CAP_WORD_ARGS loaders are entered
+ * through flm_write_words. */
+static int numicro_flm_stream(struct target *target, const struct numicro_family *family,
+		struct working_area *loader, const uint8_t *buffer, uint32_t address, uint32_t count,
+		uint32_t buffer_size)
+{
+	struct working_area *stream_algorithm;
+	struct working_area *source;
+	struct reg_param reg_params[8];
+	struct armv7m_algorithm armv7m_info;
+	uint32_t block_size = NUMICRO_FLM_BLOCK_SIZE;
+	uint32_t num_blocks;
+	uint8_t *new_buffer = NULL;
+	uint32_t avail, fifo_size;
+	int retval;
 
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	/* multi-page runs need not be split by the loader on page boundaries */
+	if (family->block_size && (address - family->addr_offset) % family->block_size == 0)
+		block_size = family->block_size;
+	num_blocks = (count + block_size - 1) / block_size;
 
-			retval = target_wait_algorithm(target, 0, NULL, 6, reg_params,
-				0, 10000, &armv7m_info);
-		}
+	retval = numicro_flm_check_placement(target, family, loader);
+	if (retval != ERROR_OK)
+		return retval;
 
-		// uninit
-		algorithm_programPage_entry_offset = 0xC75;
-		algorithm_lr = 0x20000001;
+	if (target_alloc_working_area(target, sizeof(numicro_flm_stream_code), &stream_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0);
-		buf_set_u32(reg_params[2].value, 0, 32, 0);
-		buf_set_u32(reg_params[3].value, 0, 32, 0x20000EE0);
-		buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-		buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+	retval = target_write_buffer_verify(target, stream_algorithm->address,
+			sizeof(numicro_flm_stream_code), numicro_flm_stream_code, true);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, stream_algorithm);
+		return retval;
+	}
 
-		retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-					write_algorithm->address + algorithm_programPage_entry_offset, 0, 100000, &armv7m_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro Flash uninit algorithm");
-			retval = ERROR_FLASH_OPERATION_FAILED;
-		}
+	avail = target_get_working_area_avail(target);
+	if (buffer_size > avail)
+		buffer_size = avail;
+	buffer_size &= ~3UL;
 
-		target_free_working_area(target, source);
-		target_free_working_area(target, source2);
-		target_free_working_area(target, write_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-		destroy_reg_param(&reg_params[4]);
-		destroy_reg_param(&reg_params[5]);
-	}
-	else if (strcmp(m_target_name, "NUC505") == 0) {
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);    /* number of words to program */
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_IN_OUT); /* *pLW (*buffer) */
-		init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);    /* update LR */
-
-		/* write code buffer and use flash programming code within numicro */
-		/* set breakpoint to 0 with time-out of 10000 ms                  */
-		while (count > 0) {
-			if (count == totalCount) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
-
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	if (buffer_size < 8 + 2 * block_size ||
+		numicro_flm_alloc(target, family, loader, buffer_size, 8 + 2 * block_size, &source) != ERROR_OK) {
+		target_free_working_area(target, stream_algorithm);
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
 
-			buf_set_u32(reg_params[0].value, 0, 32, address & NUMICRO_TZ_MASK);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source->address);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x2000032C);
-			buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + 126 * 1024);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+	/* the FIFO is read in whole blocks */
+	if (count % block_size) {
+		new_buffer = malloc(num_blocks * block_size);
+		if (new_buffer == NULL) {
+			target_free_working_area(target, source);
+			target_free_working_area(target, stream_algorithm);
+			LOG_ERROR("no memory for padding buffer");
+			return ERROR_FAIL;
+		}
+		memset(new_buffer, 0xff, num_blocks * block_size);
+		buffer = memcpy(new_buffer, buffer, count);
+	}
 
-			retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	/* wp/rp, then a whole number of blocks */
+	fifo_size = 8 + ((source->size - 8) & ~(block_size - 1));
+
+	init_reg_param(&reg_params[0], "r4", 32, PARAM_OUT);	/* count (bytes) */
+	init_reg_param(&reg_params[1], "r5", 32, PARAM_OUT);	/* buffer start */
+	init_reg_param(&reg_params[2], "r6", 32, PARAM_OUT);	/* buffer end */
+	init_reg_param(&reg_params[3], "r7", 32, PARAM_IN_OUT);	/* target address */
+	init_reg_param(&reg_params[4], "r8", 32, PARAM_OUT);	/* block size */
+	init_reg_param(&reg_params[5], "r9", 32, PARAM_OUT);	/* static base */
+	init_reg_param(&reg_params[6], "r10", 32, PARAM_OUT);	/* ProgramPage */
+	init_reg_param(&reg_params[7], "sp", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, count);
+	buf_set_u32(reg_params[1].value, 0, 32, source->address);
+	buf_set_u32(reg_params[2].value, 0, 32, source->address + fifo_size);
+	if (family->caps & NUMICRO_CAP_WORD_ARGS)
+		buf_set_u32(reg_params[3].value, 0, 32, address & NUMICRO_TZ_MASK);
+	else
+		buf_set_u32(reg_params[3].value, 0, 32, address - family->addr_offset);
+	buf_set_u32(reg_params[4].value, 0, 32, block_size);
+	buf_set_u32(reg_params[5].value, 0, 32, family->static_base);
+	buf_set_u32(reg_params[6].value, 0, 32, loader->address + family->program_page);
+	buf_set_u32(reg_params[7].value, 0, 32, numicro_flm_stack(target, family, loader));
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
 
-			thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	retval = target_run_flash_async_algorithm(target, buffer, num_blocks, block_size,
+			0, NULL,
+			8, reg_params,
+			source->address, fifo_size,
+			stream_algorithm->address +
+			((family->caps & NUMICRO_CAP_WORD_ARGS) ? NUMICRO_FLM_WORDS_ENTRY : 0), 0,
+			&armv7m_info);
 
-			if (thisrun_count > 0) {
-				retval = target_write_buffer(target, source2->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	if (retval == ERROR_FLASH_OPERATION_FAILED)
+		LOG_ERROR("flash write failed at address 0x%" PRIx32,
+				buf_get_u32(reg_params[3].value, 0, 32) + family->addr_offset);
 
-			retval = target_wait_algorithm(target, 0, NULL, 6, reg_params,
-				0, 10000, &armv7m_info);
+	for (int i = 0; i < 8; i++)
+		destroy_reg_param(&reg_params[i]);
 
-			if (thisrun_count == 0)
-				break;
+	target_free_working_area(target, source);
+	target_free_working_area(target, stream_algorithm);
+	free(new_buffer);
 
-			buf_set_u32(reg_params[0].value, 0, 32, address & NUMICRO_TZ_MASK);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source2->address);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x2000032C);
-			buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + 126 * 1024);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+	return retval;
+}
 
-			retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+/* Program count words with the family loader, streamed where the working
+ * area allows it. Otherwise two buffers take turns, so the
+ * next chunk is downloaded while the loader programs the last one. */
+static int numicro_flm_program(struct target *target, const struct numicro_family *family,
+		struct working_area *loader, const uint8_t *buffer, uint32_t address, uint32_t count,
+		uint32_t buffer_size)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	struct working_area *source[2];
+	struct reg_param reg_params[6];
+	struct armv7m_algorithm armv7m_info;
+	uint32_t total_count = count;
+	uint32_t thisrun_count, next_count;
+	int index = 0;
+	int retval = ERROR_OK, retval2;
+
+	retval = numicro_flm_begin(target, family, loader);
+
+	if (retval == ERROR_OK && (family->caps & NUMICRO_CAP_SPIM)) {
+		if (!chip->spim_sector_erased)
+			retval = numicro_flm_call(target, family, loader, family->chip_erase, 0, 0, 0, "chip erase");
+		/* later writes of the session must not erase this one */
+		chip->spim_sector_erased = (chip->write_session != 0);
+	}
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+	if (retval != ERROR_OK)
+		goto uninit;
 
-			if (count != 0) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	retval = numicro_flm_stream(target, family, loader, buffer, address, count * 4, 2 * buffer_size);
+	if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		goto uninit;
+	LOG_DEBUG("NuMicro loader can't be streamed, using two buffers");
+	retval = ERROR_OK;
 
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	/* memory buffer */
+	if (numicro_flm_alloc(target, family, loader, buffer_size, buffer_size, &source[0]) != ERROR_OK) {
+		LOG_WARNING("No large enough working area available, can't do block memory writes");
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto uninit;
+	}
+	if (numicro_flm_alloc(target, family, loader, buffer_size, buffer_size, &source[1]) != ERROR_OK) {
+		target_free_working_area(target, source[0]);
 
-			retval = target_wait_algorithm(target, 0, NULL, 6, reg_params,
-				0, 10000, &armv7m_info);
-		}
+		LOG_WARNING("No large enough working area available, can't do block memory writes");
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto uninit;
+	}
 
-		// uninit
-		algorithm_programPage_entry_offset = 0x261;
-		algorithm_lr = 0x20000001;
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+	numicro_flm_init_params(reg_params);
+
+	/* the data is checked as it is written where the adapter can, a
+	 * separate read back would cost as much as the programming */
+	thisrun_count = MIN(count, buffer_size / 4);
+	retval = target_write_buffer_verify(target, source[0]->address, thisrun_count * 4, buffer, false);
+
+	while (retval == ERROR_OK && thisrun_count > 0) {
+		if (family->caps & NUMICRO_CAP_WORD_ARGS)
+			numicro_flm_set_params(target, family, loader, reg_params,
+				source[index]->address, address & NUMICRO_TZ_MASK, thisrun_count);
+		else
+			numicro_flm_set_params(target, family, loader, reg_params,
+				address - family->addr_offset, thisrun_count * 4, source[index]->address);
+
+		retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
+			loader->address + family->program_page, 0, &armv7m_info);
+		if (retval != ERROR_OK)
+			break;
 
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0);
-		buf_set_u32(reg_params[2].value, 0, 32, 0);
-		buf_set_u32(reg_params[3].value, 0, 32, 0x2000032C);
-		buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + 126 * 1024);
-		buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+		buffer  += thisrun_count * 4;
+		address += thisrun_count * 4;
+		count   -= thisrun_count;
 
-		retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-					write_algorithm->address + algorithm_programPage_entry_offset, 0, 100000, &armv7m_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro Flash uninit algorithm");
-			retval = ERROR_FLASH_OPERATION_FAILED;
-		}
+		/* fill the other buffer while this one is programmed */
+		next_count = MIN(count, buffer_size / 4);
+		if (next_count > 0)
+			retval = target_write_buffer_verify(target, source[index ^ 1]->address,
+					next_count * 4, buffer, false);
 
-		target_free_working_area(target, source);
-		target_free_working_area(target, source2);
-		target_free_working_area(target, write_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-		destroy_reg_param(&reg_params[4]);
-		destroy_reg_param(&reg_params[5]);
-
-		/* chip reset */
-		target_write_u32(target, 0x40000008, 0x2);
-		/* wait for NUC505 IBR operations */
-		busy_sleep(50);
-	}
-	else if (strcmp(m_target_name, "M471") == 0 && bDFMCFlashWrite) {
-		// init
-		algorithm_programPage_entry_offset = 0x5;
-		algorithm_lr = 0x20000001;
-
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
-		init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);    /* update LR */
-
-		/* use init info code within NuMicro */
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0);
-		buf_set_u32(reg_params[2].value, 0, 32, 0);
-		buf_set_u32(reg_params[3].value, 0, 32, 0x20000244);
-		buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-		buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
-
-		retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-			write_algorithm->address + algorithm_programPage_entry_offset, 0, 100000, &armv7m_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro init algorithm");
+		retval2 = target_wait_algorithm(target, 0, NULL, 6, reg_params, 0, 10000, &armv7m_info);
+		if (retval2 != ERROR_OK) {
+			LOG_ERROR("Error executing NuMicro Flash programming algorithm");
 			retval = ERROR_FLASH_OPERATION_FAILED;
+			break;
 		}
+		LOG_INFO("Have written %d%%", (total_count - count) * 100 / total_count);
 
-		// ProgramPage
-		algorithm_programPage_entry_offset = 0x151;
-		algorithm_lr = 0x20000001;
+		thisrun_count = next_count;
+		index ^= 1;
+	}
 
-		/* write code buffer and use flash programming code within numicro */
-		/* set breakpoint to 0 with time-out of 10000 ms                  */
-		while (count > 0) {
-			if (count == totalCount) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	numicro_flm_destroy_params(reg_params);
 
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	target_free_working_area(target, source[0]);
+	target_free_working_area(target, source[1]);
 
-			buf_set_u32(reg_params[0].value, 0, 32, address);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source->address);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x20000244);
-			buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+uninit:
+	retval2 = numicro_flm_end(target, family, loader, true);
+	if (retval == ERROR_OK)
+		retval = retval2;
 
-			retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	return retval;
+}
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+static int numicro_init_isp(struct target *target)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	const struct numicro_family *family;
+	struct working_area *init_algorithm;
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	int retval = ERROR_OK;
 
-			thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
 
-			if (thisrun_count > 0) {
-				retval = target_write_buffer(target, source2->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	if (chip->isp_ready) {
+		LOG_DEBUG("numicro_init_isp skips since ISP is enabled already.");
+		return ERROR_OK;
+	}
 
-			retval = target_wait_algorithm(target, 0, NULL, 6, reg_params,
-				0, 10000, &armv7m_info);
+	int64_t start = timeval_ms();
 
-			if (thisrun_count == 0)
-				break;
+	if (chip->family == NULL)
+		chip->family = numicro_find_family(target, 0);
+	family = chip->family;
 
-			buf_set_u32(reg_params[0].value, 0, 32, address);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source2->address);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x20000244);
-			buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+	if (family->caps & NUMICRO_CAP_ISP_INIT) {
+		/* allocate working area with init info code */
+		retval = numicro_load_algorithm(target, family->code, family->code_size, &init_algorithm);
+		if (retval != ERROR_OK)
+			return retval;
 
-			retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+		retval = numicro_flm_call(target, family, init_algorithm, family->init, 0, 0, 0, "init");
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	else if (chip->m23_secure_debug_state == NUMICRO_M23_SECURE_DEBUG_NS) {
+		LOG_DEBUG("numicro_init_isp skips since Secure invasive debug is prohibited.");
+		return ERROR_OK;
+	}
+	else {
+		retval = numicro_reg_unlock(target);
+		if (retval != ERROR_OK)
+			return retval;
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+		/* Enable ISP/SRAM/TICK Clock */
+		retval = numicro_reg_update(target, NUMICRO_SYSCLK_AHBCLK - chip->address_minus_offset,
+			AHBCLK_ISP_EN | AHBCLK_SRAM_EN | AHBCLK_TICK_EN, 0);
+		if (retval != ERROR_OK)
+			return retval;
 
-			if (count != 0) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+		/* Enable ISP */
+		retval = numicro_reg_update(target, NUMICRO_FLASH_ISPCON - chip->address_minus_offset,
+			ISPCON_ISPFF | ISPCON_LDUEN | ISPCON_APUEN | ISPCON_CFGUEN | ISPCON_ISPEN, 0);
+		if (retval != ERROR_OK)
+			return retval;
 
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+		/* Write one to undocumented flash control register */
+	//	retval = target_write_u32(target, NUMICRO_FLASH_CHEAT - chip->address_minus_offset, 1);
+	//	if (retval != ERROR_OK)
+	//		return retval;
 
-			retval = target_wait_algorithm(target, 0, NULL, 6, reg_params,
-				0, 10000, &armv7m_info);
+		if (armv7m == NULL) {
+			/* something is very wrong if armv7m is NULL */
+			LOG_ERROR("unable to get armv7m target");
+			return retval;
 		}
-
-		// uninit
-		algorithm_programPage_entry_offset = 0x99;
-		algorithm_lr = 0x20000001;
-
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0);
-		buf_set_u32(reg_params[2].value, 0, 32, 0);
-		buf_set_u32(reg_params[3].value, 0, 32, 0x20000244);
-		buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-		buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
-
-		retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-					write_algorithm->address + algorithm_programPage_entry_offset, 0, 100000, &armv7m_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro Flash uninit algorithm");
-			retval = ERROR_FLASH_OPERATION_FAILED;
+		if (armv7m->arm.is_armv6m) {
+			retval = target_write_u32(target, NUMICRO_FLASH_CHEAT - chip->address_minus_offset, 1);
+			if (retval != ERROR_OK)
+				return retval;
 		}
+	}
 
-		target_free_working_area(target, source);
-		target_free_working_area(target, source2);
-		target_free_working_area(target, write_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-		destroy_reg_param(&reg_params[4]);
-		destroy_reg_param(&reg_params[5]);
-	}
-	else if (strcmp(m_target_name, "M460") == 0) {
-		// ProgramPage
-		algorithm_programPage_entry_offset = 0x12F;
-		algorithm_lr = 0x20000001;
-
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
-		init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);    /* update LR */
-
-		/* write code buffer and use flash programming code within numicro */
-		/* set breakpoint to 0 with time-out of 10000 ms                  */
-		while (count > 0) {
-			if (count == totalCount) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
-
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
-
-			buf_set_u32(reg_params[0].value, 0, 32, address);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source->address);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x20000228);
-			buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+	chip->isp_ready = true;
+	flash_stats_add(FLASH_PHASE_ISP_INIT, 0, start);
 
-			retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	LOG_DEBUG("numicro_init_isp is done.");
+	return ERROR_OK;
+}
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+/* Program LongWord Block Write */
+/* Program through numicro_flash_write_code: the host keeps the FIFO filled
+ * while the loader programs, so USB and FMC time overlap. block_size is 4
+ * for the word loaders and 16 for the multi-word one at entry; page_mask
+ * is only used by the page erasing one. count is in words. */
+static int numicro_writeblock_fifo(struct target *target, struct working_area *write_algorithm,
+		uint32_t fmc_base, uint32_t entry, uint32_t block_size, uint32_t page_mask,
+		const uint8_t *buffer, uint32_t address, uint32_t count, uint32_t buffer_size)
+{
+	struct working_area *source;
+	struct reg_param reg_params[6];
+	struct armv7m_algorithm armv7m_info;
+	uint32_t fifo_size;
+	uint32_t tail = count % (block_size / 4);
+	int retval;
+
+	/* Padding the last block would program past the end of the range:
+	 * the words left over go through the word routine at entry 0. */
+	if (tail) {
+		if (count > tail) {
+			retval = numicro_writeblock_fifo(target, write_algorithm, fmc_base, entry,
+					block_size, page_mask, buffer, address, count - tail, buffer_size);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		return numicro_writeblock_fifo(target, write_algorithm, fmc_base, 0, 4, page_mask,
+				buffer + (count - tail) * 4, address + (count - tail) * 4, tail, buffer_size);
+	}
+	count = count * 4 / block_size;
 
-			thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	/* the word routine leaves ISPCMD alone, the other routines don't */
+	if (entry == 0) {
+		retval = target_write_u32(target, fmc_base + (NUMICRO_FLASH_ISPCMD - NUMICRO_FLASH_ISPCON),
+				ISPCMD_WRITE);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 
-			if (thisrun_count > 0) {
-				retval = target_write_buffer(target, source2->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	/* memory buffer */
+	while (target_alloc_working_area_try(target, buffer_size, &source) != ERROR_OK) {
+		buffer_size /= 2;
+		buffer_size &= ~3UL;
+		if (buffer_size <= 256) {
+			LOG_WARNING("No large enough working area available, can't do block memory writes");
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+	}
 
-			retval = target_wait_algorithm(target, 0, NULL, 6, reg_params,
-				0, 10000, &armv7m_info);
+	/* wp/rp, then a whole number of blocks */
+	fifo_size = 8 + ((source->size - 8) & ~(block_size - 1));
 
-			if (thisrun_count == 0)
-				break;
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);	/* FMC base (in), ISPCON (out) */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* count (blocks) */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);	/* buffer start */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* buffer end */
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_IN_OUT);	/* target address */
+	init_reg_param(&reg_params[5], "r8", 32, PARAM_OUT);	/* page size - 1 */
 
-			buf_set_u32(reg_params[0].value, 0, 32, address);
-			buf_set_u32(reg_params[1].value, 0, 32, thisrun_count * 4);
-			buf_set_u32(reg_params[2].value, 0, 32, source2->address);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x20000228);
-			buf_set_u32(reg_params[4].value, 0, 32, write_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
+	buf_set_u32(reg_params[0].value, 0, 32, fmc_base);
+	buf_set_u32(reg_params[1].value, 0, 32, count);
+	buf_set_u32(reg_params[2].value, 0, 32, source->address);
+	buf_set_u32(reg_params[3].value, 0, 32, source->address + fifo_size);
+	buf_set_u32(reg_params[4].value, 0, 32, address & NUMICRO_TZ_MASK);
+	buf_set_u32(reg_params[5].value, 0, 32, page_mask);
 
-			retval = target_start_algorithm(target, 0, NULL, 6, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+	retval = target_run_flash_async_algorithm(target, buffer, count, block_size,
+			0, NULL,
+			6, reg_params,
+			source->address, fifo_size,
+			write_algorithm->address + entry, 0,
+			&armv7m_info);
 
-			if (count != 0) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	if (retval == ERROR_FLASH_OPERATION_FAILED) {
+		uint32_t ispcon = buf_get_u32(reg_params[0].value, 0, 32);
 
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+		LOG_ERROR("flash write failed at address 0x%" PRIx32,
+				buf_get_u32(reg_params[4].value, 0, 32));
 
-			retval = target_wait_algorithm(target, 0, NULL, 6, reg_params,
-				0, 10000, &armv7m_info);
+		if (ispcon & ISPCON_ISPFF) {
+			/* if bit is set, then must write to it to clear it. */
+			target_write_u32(target, fmc_base, ispcon | ISPCON_ISPFF);
 		}
-
-		target_free_working_area(target, source);
-		target_free_working_area(target, source2);
-		target_free_working_area(target, write_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-		destroy_reg_param(&reg_params[4]);
-		destroy_reg_param(&reg_params[5]);
 	}
-	else {
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT); /* *pLW (*buffer) */
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);    /* faddr */
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);    /* number of words to program */
-		init_reg_param(&reg_params[3], "sp", 32, PARAM_OUT);    /* update SP */
-
-		/* write code buffer and use Flash programming code within NuMicro */
-		/* set breakpoint to 0 with time-out of 10000 ms                  */
-		while (count > 0) {
-			if (count == totalCount) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
-
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
-
-			buf_set_u32(reg_params[0].value, 0, 32, source->address);
-			buf_set_u32(reg_params[1].value, 0, 32, address & NUMICRO_TZ_MASK);
-			buf_set_u32(reg_params[2].value, 0, 32, thisrun_count);
-			buf_set_u32(reg_params[3].value, 0, 32, write_algorithm->address + target->working_area_size);
 
-			retval = target_start_algorithm(target, 0, NULL, 4, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	target_free_working_area(target, source);
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
-
-			thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+	destroy_reg_param(&reg_params[3]);
+	destroy_reg_param(&reg_params[4]);
+	destroy_reg_param(&reg_params[5]);
 
-			if (thisrun_count > 0) {
-				retval = target_write_buffer(target, source2->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	return retval;
+}
 
-			retval = target_wait_algorithm(target, 0, NULL, 4, reg_params,
-				0, 10000, &armv7m_info);
+static int numicro_writeblock(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count)
+{
+	struct numicro_flash_bank *numicro_info = bank->driver_priv;
+	const struct numicro_family *family = numicro_bank_family(bank);
+	struct target *target = bank->target;
+	struct numicro_chip *chip = numicro_get_chip(target);
+	uint32_t buffer_size = family->buffer_size;
+	struct working_area *write_algorithm;
+	uint32_t address = bank->base + offset;
+	uint32_t fifo_entry = 0, fifo_block_size = 0;
+	int retval;
 
-			if (thisrun_count == 0)
-				break;
+	/* check code alignment */
+	if (offset & 0x1) {
+		LOG_WARNING("offset 0x%" PRIx32 " breaks required 2-byte alignment", offset);
+		return ERROR_FLASH_DST_BREAKS_ALIGNMENT;
+	}
 
-			buf_set_u32(reg_params[0].value, 0, 32, source2->address);
-			buf_set_u32(reg_params[1].value, 0, 32, address & NUMICRO_TZ_MASK);
-			buf_set_u32(reg_params[2].value, 0, 32, thisrun_count);
-			buf_set_u32(reg_params[3].value, 0, 32, write_algorithm->address + target->working_area_size);
+	if (numicro_info->erase_ahead) {
+		/* numicro_erase_write made sure the word loader can do it */
+		fifo_entry = NUMICRO_FLASH_WRITE_ERASE_ENTRY;
+		fifo_block_size = 4;
+	}
+	else if ((family->caps & NUMICRO_CAP_MULTI_WORD) &&
+		(chip->flash_info & NUMICRO_MULTI_WORD_MASK) && !(address & 0xF)) {
+		fifo_entry = NUMICRO_FLASH_WRITE_MULTI_ENTRY;
+		fifo_block_size = 16;
+	}
+	else if (family->caps & NUMICRO_CAP_ASYNC) {
+		fifo_entry = 0;
+		fifo_block_size = 4;
+	}
 
-			retval = target_start_algorithm(target, 0, NULL, 4, reg_params,
-				write_algorithm->address + algorithm_programPage_entry_offset, 0, &armv7m_info);
+	/* allocate working area with flash programming code */
+	if (fifo_block_size)
+		retval = numicro_load_algorithm(target, numicro_flash_write_code,
+			sizeof(numicro_flash_write_code), &write_algorithm);
+	else
+		retval = numicro_load_algorithm(target, family->code, family->code_size, &write_algorithm);
+	if (retval != ERROR_OK)
+		return retval;
 
-			buffer  += thisrun_count * 4;
-			address += thisrun_count * 4;
-			count   -= thisrun_count;
-			LOG_INFO("Have written %d%%", (totalCount - count) * 100 / totalCount);
+	/* Increase buffer_size if needed: split what is left of the working
+	 * area between the two buffers, the loader stack has its own */
+	if (buffer_size == 0) {
+		buffer_size = target_get_working_area_avail(target) / 2;
 
-			if (count != 0) {
-				thisrun_count = (count > (buffer_size / 4)) ? (buffer_size / 4) : count;
+		/* buffer for alignment */
+		if (buffer_size >= 128)
+			buffer_size = buffer_size / 128 * 128;
+		else
+			buffer_size &= ~3UL;
+	}
 
-				retval = target_write_buffer(target, source->address, thisrun_count * 4, buffer);
-				if (retval != ERROR_OK)
-					break;
-			}
+	if (numicro_info->max_buffer_size && buffer_size > numicro_info->max_buffer_size)
+		buffer_size = numicro_info->max_buffer_size & ~3UL;
 
-			retval = target_wait_algorithm(target, 0, NULL, 4, reg_params,
-				0, 10000, &armv7m_info);
-		}
+	LOG_DEBUG("NuMicro write buffer size %" PRIu32, buffer_size);
 
-		target_free_working_area(target, source);
-		target_free_working_area(target, source2);
-		target_free_working_area(target, write_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-	}
+	if (fifo_block_size)
+		return numicro_writeblock_fifo(target, write_algorithm,
+				NUMICRO_FLASH_ISPCON - chip->address_minus_offset,
+				fifo_entry, fifo_block_size, bank->sectors[0].size - 1,
+				buffer, address, count, 2 * buffer_size);
 
-	return retval;
+	return numicro_flm_program(target, family, write_algorithm, buffer, address, count, buffer_size);
 }
 
 static int numicro_M2351_getinitinfo_ns(struct target *target, uint32_t *part_id)
 {
+	struct numicro_chip *chip = numicro_get_chip(target);
 	struct working_area *init_algorithm;
 	uint32_t address;
 	struct reg_param reg_params[2];
@@ -2793,7 +3286,7 @@ static int numicro_M2351_getinitinfo_ns(struct target *target, uint32_t *part_id
 	* r0 - address to place info (In fact, the actual location will be the address plus one word)
 	*/
 
-	if (m_M23SecureDebugState != NUMICRO_M23_SECURE_DEBUG_NS) {
+	if (chip->m23_secure_debug_state != NUMICRO_M23_SECURE_DEBUG_NS) {
 		LOG_DEBUG("Error executing NuMicro init-info algorithm because it is only used for M23 NS.");
 		retval = ERROR_FLASH_OPERATION_FAILED;
 
@@ -2801,14 +3294,8 @@ static int numicro_M2351_getinitinfo_ns(struct target *target, uint32_t *part_id
 	}
 
 	/* allocate working area with init info code */
-	if (target_alloc_working_area(target, sizeof(numicro_M2351_NS_init_info_code),
-		&init_algorithm) != ERROR_OK) {
-		LOG_WARNING("no working area available, can't do block memory erase");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, init_algorithm->address,
-		sizeof(numicro_M2351_NS_init_info_code), numicro_M2351_NS_init_info_code);
+	retval = numicro_load_algorithm(target, (const uint8_t *)numicro_M2351_NS_init_info_code,
+		sizeof(numicro_M2351_NS_init_info_code), &init_algorithm);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -2825,7 +3312,8 @@ static int numicro_M2351_getinitinfo_ns(struct target *target, uint32_t *part_id
 
 	/* use init info code within NuMicro              */
 	/* set breakpoint to 0 with time-out of 100000 ms */
-	address = init_algorithm->address + target->working_area_size/* - 4 * (numberOfInfo + 1) */;
+	/* the info goes just above the stack, at the top of the stack area */
+	address = chip->stack->address + chip->stack->size - 16;
 	buf_set_u32(reg_params[0].value, 0, 32, address + 4);
 	buf_set_u32(reg_params[1].value, 0, 32, address);
 
@@ -2836,7 +3324,6 @@ static int numicro_M2351_getinitinfo_ns(struct target *target, uint32_t *part_id
 		retval = ERROR_FLASH_OPERATION_FAILED;
 	}
 
-	target_free_working_area(target, init_algorithm);
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
 
@@ -2852,10 +3339,87 @@ static int numicro_M2351_getinitinfo_ns(struct target *target, uint32_t *part_id
 	return retval;
 }
 
+/* Read the CONFIG words of the part in one ISP list, unless the shadow
+ * holds them already. */
+static int numicro_config_read(struct target *target)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	struct numicro_isp_cmd cmds[NUMICRO_CONFIG_WORDS];
+	uint32_t base = NUMICRO_CONFIG_BASE, size = 8;
+	unsigned int count;
+	int retval;
+
+	if (chip->config_valid)
+		return ERROR_OK;
+
+	for (unsigned int i = 0; chip->cpu && i < chip->cpu->n_banks; i++) {
+		if ((chip->cpu->bank[i].base & ~NUMICRO_SPECIAL_FLASH_OFFSET) == NUMICRO_CONFIG_BASE &&
+			chip->cpu->bank[i].size) {
+			base = chip->cpu->bank[i].base;
+			size = chip->cpu->bank[i].size;
+		}
+	}
+	count = MIN(MAX(size / 4, 2), NUMICRO_CONFIG_WORDS);
+
+	for (unsigned int i = 0; i < count; i++) {
+		cmds[i].cmd = ISPCMD_READ;
+		cmds[i].addr = base + i * 4;
+		cmds[i].data = 0;
+	}
+
+	retval = numicro_fmc_cmd_batch(target, cmds, count);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("NuMicro flash driver: failed to read CONFIG");
+		return retval;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		chip->config[i] = cmds[i].data;
+	chip->config_base = base;
+	chip->config_count = count;
+	chip->config_valid = true;
+	chip->config_dirty = false;
+
+	return ERROR_OK;
+}
+
+/* Write changed CONFIG words back: the page erase and the programming
+ * of every word go in one ISP list. */
+static int numicro_config_flush(struct target *target)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	struct numicro_isp_cmd cmds[1 + NUMICRO_CONFIG_WORDS];
+	int retval;
+
+	if (!chip->config_valid || !chip->config_dirty)
+		return ERROR_OK;
+
+	cmds[0].cmd = ISPCMD_ERASE;
+	cmds[0].addr = chip->config_base;
+	cmds[0].data = 0;
+	for (unsigned int i = 0; i < chip->config_count; i++) {
+		cmds[1 + i].cmd = ISPCMD_WRITE;
+		cmds[1 + i].addr = chip->config_base + i * 4;
+		cmds[1 + i].data = chip->config[i];
+	}
+
+	/* on failure the shadow stays dirty, so the write can be retried */
+	retval = numicro_fmc_cmd_batch(target, cmds, 1 + chip->config_count);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("NuMicro flash driver: failed to write CONFIG");
+		return retval;
+	}
+
+	chip->config_dirty = false;
+
+	return ERROR_OK;
+}
+
 /* Flash Lock checking - examines the lock bit. */
 static int numicro_protect_check(struct flash_bank *bank)
 {
 	struct target *target = bank->target;
+	struct numicro_chip *chip = numicro_get_chip(target);
 	uint32_t set, config[2];
 	int i, retval = ERROR_OK;
 
@@ -2873,8 +3437,11 @@ static int numicro_protect_check(struct flash_bank *bank)
 
 	/* TODO: how about M23 NS? */
 	/* Read CONFIG0,CONFIG1 */
-	numicro_fmc_cmd(target, ISPCMD_READ, NUMICRO_CONFIG0 - m_addressMinusOffset, 0, &config[0]);
-	numicro_fmc_cmd(target, ISPCMD_READ, NUMICRO_CONFIG1 - m_addressMinusOffset, 0, &config[1]);
+	retval = numicro_config_read(target);
+	if (retval != ERROR_OK)
+		return retval;
+	config[0] = chip->config[0];
+	config[1] = chip->config[1];
 
 	LOG_DEBUG("CONFIG0: 0x%" PRIx32 ",CONFIG1: 0x%" PRIx32 "", config[0], config[1]);
 
@@ -2900,659 +3467,355 @@ static int numicro_protect_check(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
-static int numicro_erase(struct flash_bank *bank, int first, int last)
+/* Erase sectors first..last with the page erase routine of
+ * numicro_flash_write_code: one algorithm run per run of consecutive
+ * sectors still to be erased, instead of an ISP round trip per page. */
+static int numicro_erase_block(struct flash_bank *bank, int first, int last)
 {
 	struct target *target = bank->target;
+	struct numicro_chip *chip = numicro_get_chip(target);
 	struct working_area *erase_algorithm;
-	uint32_t address = 0;
-	struct reg_param reg_params[6];
-	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_param reg_params[4];
 	struct armv7m_algorithm armv7m_info;
-	uint32_t algorithm_eraseSector_entry_offset = 0;
-	uint32_t algorithm_lr = 0;
-	int i, retval = ERROR_OK;
-	uint32_t timeout, status;
-	bool bSPIMFlashWrite = (bank->base + bank->sectors[first].offset < NUMICRO_SPIM_FLASH_START_ADDRESS)? 0 : 1;
-	bool bDFMCFlashWrite = (bank->base + bank->sectors[first].offset < NUMICRO_DATA_DFMC_BASE)? 0 : 1;
+	uint32_t fmc_base = NUMICRO_FLASH_ISPCON - chip->address_minus_offset;
+	int i, j, retval;
 
-	if (target->state != TARGET_HALTED) {
-		LOG_ERROR("Target not halted");
-		return ERROR_TARGET_NOT_HALTED;
+	/* SPROM pages need the ISPDAT key, leave them to the ISP path */
+	if (bank->base >= NUMICRO_SPROM_BASE && bank->base < NUMICRO_CONFIG_BASE)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	retval = numicro_load_algorithm(target, numicro_flash_write_code,
+		sizeof(numicro_flash_write_code), &erase_algorithm);
+	if (retval != ERROR_OK) {
+		LOG_WARNING("no working area available, can't do block erase");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	LOG_INFO("Nuvoton NuMicro: Sector Erase ... (%d to %d)", first, last);
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
 
-	numicro_get_arm_arch(target);
-	if (!bSPIMFlashWrite || m_M23SecureDebugState == NUMICRO_M23_SECURE_DEBUG_NS) {
-		retval = numicro_init_isp(target);
-	}
+	/* save and restore the context once for all the runs */
+	retval = armv7m_begin_algorithm_session(target, &armv7m_info);
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (strcmp(m_target_name, "M480") == 0 && bSPIMFlashWrite) {
-		m_bSPIMFlashSectorErased = 1;
-		// init
-		algorithm_eraseSector_entry_offset = 0x315;
-		algorithm_lr = 0x20000001;
-
-		/* allocate working area with flash erase code */
-		if (target_alloc_working_area(target, sizeof(numicro_M480_spim_flash_algorithm_code),
-			&erase_algorithm) != ERROR_OK) {
-			LOG_WARNING("no working area available, can't do block memory erase");
-			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-		}
-
-		retval = target_write_buffer(target, erase_algorithm->address,
-			sizeof(numicro_M480_spim_flash_algorithm_code), (const uint8_t *)numicro_M480_spim_flash_algorithm_code);
-		if (retval != ERROR_OK)
-			return retval;
-
-		armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-		armv7m_info.core_mode = ARM_MODE_THREAD;
-		if (armv7m == NULL) {
-			/* something is very wrong if armv7m is NULL */
-			LOG_ERROR("unable to get armv7m target");
-			return retval;
-		}
-
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
-		init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);    /* update LR */
-
-		/* use init info code within NuMicro */
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0);
-		buf_set_u32(reg_params[2].value, 0, 32, 0);
-		buf_set_u32(reg_params[3].value, 0, 32, 0x20000EE0);
-		buf_set_u32(reg_params[4].value, 0, 32, erase_algorithm->address + target->working_area_size);
-		buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
-
-		retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-			erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro init algorithm");
-			retval = ERROR_FLASH_OPERATION_FAILED;
-		}
-
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-		destroy_reg_param(&reg_params[4]);
-		destroy_reg_param(&reg_params[5]);
-
-		// EraseSector
-		algorithm_eraseSector_entry_offset = 0x1E9;
-		algorithm_lr = 0x20000001;
-
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-		init_reg_param(&reg_params[1], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[2], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[3], "lr", 32, PARAM_OUT);
-
-		/* use Flash erase code within NuMicro            */
-		/* set breakpoint to 0 with time-out of 100000 ms */
-		for (i = first; i <= last; i++) {
-			if (bank->sectors[i].is_erased == 1) {
-				LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
-				continue;
-			}
-
-			address = bank->base + bank->sectors[i].offset;
-			buf_set_u32(reg_params[0].value, 0, 32, address - NUMICRO_SPIM_FLASH_START_ADDRESS);
-			buf_set_u32(reg_params[1].value, 0, 32, 0x20000EE0);
-			buf_set_u32(reg_params[2].value, 0, 32, erase_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[3].value, 0, 32, algorithm_lr);
-
-			retval = target_run_algorithm(target, 0, NULL, 4, reg_params,
-				erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error executing NuMicro Flash erase algorithm");
-				retval = ERROR_FLASH_OPERATION_FAILED;
-				break;
-			}
-			else {
-				bank->sectors[i].is_erased = 1;
-			}
-		}
-
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-
-		// uninit
-		algorithm_eraseSector_entry_offset = 0xC75;
-		algorithm_lr = 0x20000001;
-
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
-		init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
-		init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
-		init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);    /* update LR */
-
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0);
-		buf_set_u32(reg_params[2].value, 0, 32, 0);
-		buf_set_u32(reg_params[3].value, 0, 32, 0x20000EE0);
-		buf_set_u32(reg_params[4].value, 0, 32, erase_algorithm->address + target->working_area_size);
-		buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
-
-		retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-					erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro Flash uninit algorithm");
-			retval = ERROR_FLASH_OPERATION_FAILED;
-		}
-
-		target_free_working_area(target, erase_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-		destroy_reg_param(&reg_params[4]);
-		destroy_reg_param(&reg_params[5]);
-	}
-	else if (strcmp(m_target_name, "NUC505") == 0) {
-		algorithm_eraseSector_entry_offset = 0x283;
-		algorithm_lr = 0x20000001;
-
-		/* allocate working area with flash erase code */
-		if (target_alloc_working_area(target, sizeof(numicro_NUC505_flash_algorithm_code),
-			&erase_algorithm) != ERROR_OK) {
-			LOG_WARNING("no working area available, can't do block memory erase");
-			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-		}
-
-		retval = target_write_buffer(target, erase_algorithm->address,
-			sizeof(numicro_NUC505_flash_algorithm_code), (const uint8_t *)numicro_NUC505_flash_algorithm_code);
-		if (retval != ERROR_OK)
-			return retval;
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);	/* FMC base (in), ISPCON (out) */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_IN_OUT);	/* start address */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_IN_OUT);	/* count (pages) */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* page size */
 
-		armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-		armv7m_info.core_mode = ARM_MODE_THREAD;
-		if (armv7m == NULL) {
-			/* something is very wrong if armv7m is NULL */
-			LOG_ERROR("unable to get armv7m target");
-			return retval;
+	for (i = first; i <= last; i = j) {
+		if (bank->sectors[i].is_erased == 1) {
+			LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
+			j = i + 1;
+			continue;
 		}
 
-		init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-		init_reg_param(&reg_params[1], "r9", 32, PARAM_OUT);
-		init_reg_param(&reg_params[2], "sp", 32, PARAM_OUT);    /* update SP */
-		init_reg_param(&reg_params[3], "lr", 32, PARAM_OUT);
-
-		/* use Flash erase code within NuMicro            */
-		/* set breakpoint to 0 with time-out of 100000 ms */
-		for (i = first; i <= last; i++) {
-			if (bank->sectors[i].is_erased == 1) {
-				LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
-				continue;
-			}
-
-			address = (bank->base + bank->sectors[i].offset) /* & NUMICRO_TZ_MASK */;
-			buf_set_u32(reg_params[0].value, 0, 32, address);
-			buf_set_u32(reg_params[1].value, 0, 32, 0x2000032C);
-			buf_set_u32(reg_params[2].value, 0, 32, erase_algorithm->address + 126 * 1024);
-			buf_set_u32(reg_params[3].value, 0, 32, algorithm_lr);
-
-			retval = target_run_algorithm(target, 0, NULL, 4, reg_params,
-				erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error executing NuMicro Flash erase algorithm");
-				retval = ERROR_FLASH_OPERATION_FAILED;
+		/* extend the run while the sectors are adjacent and equally sized */
+		for (j = i + 1; j <= last; j++) {
+			if (bank->sectors[j].is_erased == 1 ||
+				bank->sectors[j].size != bank->sectors[i].size ||
+				bank->sectors[j].offset != bank->sectors[j - 1].offset + bank->sectors[j - 1].size)
 				break;
-			}
-			else {
-				bank->sectors[i].is_erased = 1;
-			}
 		}
 
-		// uninit
-		algorithm_eraseSector_entry_offset = 0x261;
-		algorithm_lr = 0x20000001;
-
-		buf_set_u32(reg_params[0].value, 0, 32, 0);
-		buf_set_u32(reg_params[1].value, 0, 32, 0x2000032C);
-		buf_set_u32(reg_params[2].value, 0, 32, erase_algorithm->address + 126 * 1024);
-		buf_set_u32(reg_params[3].value, 0, 32, algorithm_lr);
+		LOG_DEBUG("erasing sectors %d to %d at address 0x%" PRIx32 "",
+			i, j - 1, bank->base + bank->sectors[i].offset);
+		buf_set_u32(reg_params[0].value, 0, 32, fmc_base);
+		buf_set_u32(reg_params[1].value, 0, 32, (bank->base + bank->sectors[i].offset) & NUMICRO_TZ_MASK);
+		buf_set_u32(reg_params[2].value, 0, 32, j - i);
+		buf_set_u32(reg_params[3].value, 0, 32, bank->sectors[i].size);
 
+		target->algorithm_expected_ms = (j - i) * NUMICRO_PAGE_ERASE_MS;
 		retval = target_run_algorithm(target, 0, NULL, 4, reg_params,
-					erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
+			erase_algorithm->address + NUMICRO_FLASH_ERASE_ENTRY, 0, 100000, &armv7m_info);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("Error executing NuMicro Flash programming algorithm");
+			LOG_ERROR("Error executing NuMicro Flash erase algorithm");
 			retval = ERROR_FLASH_OPERATION_FAILED;
+			break;
 		}
 
-		target_free_working_area(target, erase_algorithm);
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		destroy_reg_param(&reg_params[2]);
-		destroy_reg_param(&reg_params[3]);
-	}
-	else if (m_M23SecureDebugState != NUMICRO_M23_SECURE_DEBUG_NS) {
-		if (strcmp(m_target_name, "M471") == 0 && bDFMCFlashWrite) {	// M471 data flash DFMC erase
-			// init
-			algorithm_eraseSector_entry_offset = 0x5;
-			algorithm_lr = 0x20000001;
-
-			/* allocate working area with flash erase code */
-			if (target_alloc_working_area(target, sizeof(numicro_M471_dataflash_flash_algorithm_code),
-				&erase_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory erase");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
-
-			retval = target_write_buffer(target, erase_algorithm->address,
-				sizeof(numicro_M471_dataflash_flash_algorithm_code), (const uint8_t *)numicro_M471_dataflash_flash_algorithm_code);
-			if (retval != ERROR_OK)
-				return retval;
-
-			armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-			armv7m_info.core_mode = ARM_MODE_THREAD;
-			if (armv7m == NULL) {
-				/* something is very wrong if armv7m is NULL */
-				LOG_ERROR("unable to get armv7m target");
-				return retval;
-			}
+		/* pages before the one left in r2 are done */
+		uint32_t ispcon = buf_get_u32(reg_params[0].value, 0, 32);
+		int done = (j - i) - buf_get_u32(reg_params[2].value, 0, 32);
+		for (int k = i; k < i + done; k++)
+			bank->sectors[k].is_erased = 1;
 
-			init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
-			init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
-			init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
-			init_reg_param(&reg_params[3], "r9", 32, PARAM_OUT);
-			init_reg_param(&reg_params[4], "sp", 32, PARAM_OUT);    /* update SP */
-			init_reg_param(&reg_params[5], "lr", 32, PARAM_OUT);    /* update LR */
-
-			/* use init info code within NuMicro */
-			buf_set_u32(reg_params[0].value, 0, 32, 0);
-			buf_set_u32(reg_params[1].value, 0, 32, 0);
-			buf_set_u32(reg_params[2].value, 0, 32, 0);
-			buf_set_u32(reg_params[3].value, 0, 32, 0x20000244);
-			buf_set_u32(reg_params[4].value, 0, 32, erase_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[5].value, 0, 32, algorithm_lr);
-
-			retval = target_run_algorithm(target, 0, NULL, 6, reg_params,
-				erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error executing NuMicro init algorithm");
-				retval = ERROR_FLASH_OPERATION_FAILED;
-			}
+		if (ispcon & ISPCON_ISPFF) {
+			LOG_DEBUG("failure: 0x%" PRIx32 " at sector %d", ispcon, i + done);
+			/* if bit is set, then must write to it to clear it. */
+			target_write_u32(target, fmc_base, ispcon | ISPCON_ISPFF);
+			retval = ERROR_FLASH_OPERATION_FAILED;
+			break;
+		}
+	}
 
-			destroy_reg_param(&reg_params[0]);
-			destroy_reg_param(&reg_params[1]);
-			destroy_reg_param(&reg_params[2]);
-			destroy_reg_param(&reg_params[3]);
-			destroy_reg_param(&reg_params[4]);
-			destroy_reg_param(&reg_params[5]);
-
-			algorithm_eraseSector_entry_offset = 0x105;
-			algorithm_lr = 0x20000001;
-
-			/* allocate working area with flash erase code */
-			if (target_alloc_working_area(target, sizeof(numicro_M471_dataflash_flash_algorithm_code),
-				&erase_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory erase");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
+	int end_retval = armv7m_end_algorithm_session(target, &armv7m_info);
+	if (retval == ERROR_OK)
+		retval = end_retval;
 
-			retval = target_write_buffer(target, erase_algorithm->address,
-				sizeof(numicro_M471_dataflash_flash_algorithm_code), (const uint8_t *)numicro_M471_dataflash_flash_algorithm_code);
-			if (retval != ERROR_OK)
-				return retval;
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+	destroy_reg_param(&reg_params[3]);
 
-			armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-			armv7m_info.core_mode = ARM_MODE_THREAD;
-			if (armv7m == NULL) {
-				/* something is very wrong if armv7m is NULL */
-				LOG_ERROR("unable to get armv7m target");
-				return retval;
-			}
+	return retval;
+}
 
-			init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-			init_reg_param(&reg_params[1], "r9", 32, PARAM_OUT);
-			init_reg_param(&reg_params[2], "sp", 32, PARAM_OUT);    /* update SP */
-			init_reg_param(&reg_params[3], "lr", 32, PARAM_OUT);
-
-			/* use Flash erase code within NuMicro            */
-			/* set breakpoint to 0 with time-out of 100000 ms */
-			for (i = first; i <= last; i++) {
-				if (bank->sectors[i].is_erased == 1) {
-					LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
-					continue;
-				}
+static int numicro_erase(struct flash_bank *bank, int first, int last)
+{
+	const struct numicro_family *family = numicro_bank_family(bank);
+	struct target *target = bank->target;
+	struct numicro_chip *chip = numicro_get_chip(target);
+	uint32_t address = 0;
+	int i, retval = ERROR_OK;
+	uint32_t timeout, status;
+	bool bSPIMFlashWrite = (bank->base + bank->sectors[first].offset < NUMICRO_SPIM_FLASH_START_ADDRESS)? 0 : 1;
 
-				LOG_DEBUG("address: 0x%x, bank->base: 0x%x, bank->sectors[i].offset: 0x%x,  %d", address, bank->base, bank->sectors[i].offset, i);
-				address = (bank->base + bank->sectors[i].offset);
-				buf_set_u32(reg_params[0].value, 0, 32, address);
-				buf_set_u32(reg_params[1].value, 0, 32, 0x20000244);
-				buf_set_u32(reg_params[2].value, 0, 32, erase_algorithm->address + target->working_area_size);
-				buf_set_u32(reg_params[3].value, 0, 32, algorithm_lr);
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
 
-				retval = target_run_algorithm(target, 0, NULL, 4, reg_params,
-					erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
+	LOG_INFO("Nuvoton NuMicro: Sector Erase ... (%d to %d)", first, last);
 
-				if (retval != ERROR_OK) {
-					LOG_ERROR("Error executing NuMicro Flash erase algorithm");
-					retval = ERROR_FLASH_OPERATION_FAILED;
-					break;
-				}
-				else {
-					bank->sectors[i].is_erased = 1;
-				}
-			}
+	if ((bank->base & ~NUMICRO_SPECIAL_FLASH_OFFSET) == NUMICRO_CONFIG_BASE)
+		chip->config_valid = false;
 
-			// uninit
-			algorithm_eraseSector_entry_offset = 0x99;
-			algorithm_lr = 0x20000001;
+	numicro_get_arm_arch(target);
+	if (!bSPIMFlashWrite || chip->m23_secure_debug_state == NUMICRO_M23_SECURE_DEBUG_NS) {
+		retval = numicro_init_isp(target);
+	}
+	if (retval != ERROR_OK)
+		return retval;
 
-			buf_set_u32(reg_params[0].value, 0, 32, 0);
-			buf_set_u32(reg_params[1].value, 0, 32, 0x20000244);
-			buf_set_u32(reg_params[2].value, 0, 32, erase_algorithm->address + target->working_area_size);
-			buf_set_u32(reg_params[3].value, 0, 32, algorithm_lr);
+	if (family->erase_sector) {
+		retval = numicro_flm_erase(bank, family, first, last);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	else {
+		/* try the on-target page erase first */
+		retval = numicro_erase_block(bank, first, last);
+		if (retval == ERROR_OK)
+			goto done;
+		if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+			return retval;
 
-			retval = target_run_algorithm(target, 0, NULL, 4, reg_params,
-						erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error executing NuMicro Flash programming algorithm");
-				retval = ERROR_FLASH_OPERATION_FAILED;
-			}
+		retval = target_write_u32(target, NUMICRO_FLASH_ISPCMD - chip->address_minus_offset, ISPCMD_ERASE);
+		if (retval != ERROR_OK)
+			return retval;
 
-			target_free_working_area(target, erase_algorithm);
-			destroy_reg_param(&reg_params[0]);
-			destroy_reg_param(&reg_params[1]);
-			destroy_reg_param(&reg_params[2]);
-			destroy_reg_param(&reg_params[3]);
-		}
-		else if (strcmp(m_target_name, "M460") == 0) {
-			/* allocate working area with flash erase code */
-			if (target_alloc_working_area(target, sizeof(numicro_M460_flash_algorithm_code),
-				&erase_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory erase");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		for (i = first; i <= last; i++) {
+			if (bank->sectors[i].is_erased == 1) {
+				LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
+				continue;
 			}
 
-			retval = target_write_buffer(target, erase_algorithm->address,
-				sizeof(numicro_M460_flash_algorithm_code), (const uint8_t *)numicro_M460_flash_algorithm_code);
-			if (retval != ERROR_OK)
-				return retval;
+			address = bank->base + bank->sectors[i].offset;
+			LOG_DEBUG("erasing sector %d at address 0x%" PRIx32 "", i, address);
+			if ((chip->flash_info & NUMICRO_SPROM_MASK) != 0 &&
+				(address >= NUMICRO_SPROM_BASE) && (address < (NUMICRO_SPROM_BASE + chip->page_size))) {
+				LOG_DEBUG("SPROM is erasing");
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - chip->address_minus_offset, NUMICRO_SPROM_ISPDAT);
+				if (retval != ERROR_OK)
+					return retval;
 
-			armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-			armv7m_info.core_mode = ARM_MODE_THREAD;
-			if (armv7m == NULL) {
-				/* something is very wrong if armv7m is NULL */
-				LOG_ERROR("unable to get armv7m target");
-				return retval;
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - chip->address_minus_offset, NUMICRO_SPROM_BASE);
+				if (retval != ERROR_OK)
+					return retval;
 			}
+			else if ((chip->flash_info & NUMICRO_SPROM_MINI57_MASK) != 0 &&
+				(address >= NUMICRO_SPROM_BASE) && (address < (NUMICRO_SPROM_BASE + chip->page_size))) {
+				LOG_DEBUG("SPROM is erasing");
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - chip->address_minus_offset, NUMICRO_SPROM_ISPDAT);
+				if (retval != ERROR_OK)
+					return retval;
 
-			algorithm_eraseSector_entry_offset = 0xE5;
-			algorithm_lr = 0x20000001;
-
-			init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-			init_reg_param(&reg_params[1], "r9", 32, PARAM_OUT);
-			init_reg_param(&reg_params[2], "sp", 32, PARAM_OUT);    /* update SP */
-			init_reg_param(&reg_params[3], "lr", 32, PARAM_OUT);
-
-			/* set breakpoint to 0 with time-out of 100000 ms */
-			for (i = first; i <= last; i++) {
-				if (bank->sectors[i].is_erased == 1) {
-					LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
-					continue;
-				}
-
-				LOG_DEBUG("address: 0x%x, bank->base: 0x%x, bank->sectors[i].offset: 0x%x,  %d", address, bank->base, bank->sectors[i].offset, i);
-				address = (bank->base + bank->sectors[i].offset);
-				buf_set_u32(reg_params[0].value, 0, 32, address);
-				buf_set_u32(reg_params[1].value, 0, 32, 0x20000228);
-				buf_set_u32(reg_params[2].value, 0, 32, erase_algorithm->address + target->working_area_size);
-				buf_set_u32(reg_params[3].value, 0, 32, algorithm_lr);
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - chip->address_minus_offset, NUMICRO_SPROM_BASE);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			else if ((chip->flash_info & NUMICRO_SPROM_MINI57_MASK) != 0 &&
+				(address >= NUMICRO_SPROM_BASE2) && (address < (NUMICRO_SPROM_BASE2 + chip->page_size))) {
+				LOG_DEBUG("SPROM is erasing");
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - chip->address_minus_offset, NUMICRO_SPROM_ISPDAT);
+				if (retval != ERROR_OK)
+					return retval;
 
-				retval = target_run_algorithm(target, 0, NULL, 4, reg_params,
-					erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - chip->address_minus_offset, NUMICRO_SPROM_BASE2);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			else if ((chip->flash_info & NUMICRO_SPROM_MINI57_MASK) != 0 &&
+				(address >= NUMICRO_SPROM_BASE3) && (address < (NUMICRO_SPROM_BASE3 + chip->page_size))) {
+				LOG_DEBUG("SPROM is erasing");
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - chip->address_minus_offset, NUMICRO_SPROM_ISPDAT);
+				if (retval != ERROR_OK)
+					return retval;
 
-				if (retval != ERROR_OK) {
-					LOG_ERROR("Error executing NuMicro Flash erase algorithm");
-					retval = ERROR_FLASH_OPERATION_FAILED;
-					break;
-				}
-				else {
-					bank->sectors[i].is_erased = 1;
-				}
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - chip->address_minus_offset, NUMICRO_SPROM_BASE3);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			else {
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - chip->address_minus_offset, address & NUMICRO_TZ_MASK);
+				if (retval != ERROR_OK)
+					return retval;
 			}
 
-			target_free_working_area(target, erase_algorithm);
-			destroy_reg_param(&reg_params[0]);
-			destroy_reg_param(&reg_params[1]);
-			destroy_reg_param(&reg_params[2]);
-			destroy_reg_param(&reg_params[3]);		
-		}
-		else {
-			retval = target_write_u32(target, NUMICRO_FLASH_ISPCMD - m_addressMinusOffset, ISPCMD_ERASE);
+			retval = target_write_u32(target, NUMICRO_FLASH_ISPTRG - chip->address_minus_offset, ISPTRG_ISPGO); /* This is the only bit available */
 			if (retval != ERROR_OK)
 				return retval;
 
-			for (i = first; i <= last; i++) {
-				if (bank->sectors[i].is_erased == 1) {
-					LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
-					continue;
-				}
-
-				address = bank->base + bank->sectors[i].offset;
-				LOG_DEBUG("erasing sector %d at address 0x%" PRIx32 "", i, address);
-				if ((m_flashInfo & NUMICRO_SPROM_MASK) != 0 &&
-					(address >= NUMICRO_SPROM_BASE) && (address < (NUMICRO_SPROM_BASE + m_pageSize))) {
-					LOG_DEBUG("SPROM is erasing");
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - m_addressMinusOffset, NUMICRO_SPROM_ISPDAT);
-					if (retval != ERROR_OK)
-						return retval;
-
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - m_addressMinusOffset, NUMICRO_SPROM_BASE);
-					if (retval != ERROR_OK)
-						return retval;
-				}
-				else if ((m_flashInfo & NUMICRO_SPROM_MINI57_MASK) != 0 &&
-					(address >= NUMICRO_SPROM_BASE) && (address < (NUMICRO_SPROM_BASE + m_pageSize))) {
-					LOG_DEBUG("SPROM is erasing");
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - m_addressMinusOffset, NUMICRO_SPROM_ISPDAT);
-					if (retval != ERROR_OK)
-						return retval;
-
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - m_addressMinusOffset, NUMICRO_SPROM_BASE);
-					if (retval != ERROR_OK)
-						return retval;
-				}
-				else if ((m_flashInfo & NUMICRO_SPROM_MINI57_MASK) != 0 &&
-					(address >= NUMICRO_SPROM_BASE2) && (address < (NUMICRO_SPROM_BASE2 + m_pageSize))) {
-					LOG_DEBUG("SPROM is erasing");
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - m_addressMinusOffset, NUMICRO_SPROM_ISPDAT);
-					if (retval != ERROR_OK)
-						return retval;
-
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - m_addressMinusOffset, NUMICRO_SPROM_BASE2);
-					if (retval != ERROR_OK)
-						return retval;
-				}
-				else if ((m_flashInfo & NUMICRO_SPROM_MINI57_MASK) != 0 &&
-					(address >= NUMICRO_SPROM_BASE3) && (address < (NUMICRO_SPROM_BASE3 + m_pageSize))) {
-					LOG_DEBUG("SPROM is erasing");
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPDAT - m_addressMinusOffset, NUMICRO_SPROM_ISPDAT);
-					if (retval != ERROR_OK)
-						return retval;
-
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - m_addressMinusOffset, NUMICRO_SPROM_BASE3);
-					if (retval != ERROR_OK)
-						return retval;
-				}
-				else {
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - m_addressMinusOffset, address & NUMICRO_TZ_MASK);
-					if (retval != ERROR_OK)
-						return retval;
-				}
-
-				retval = target_write_u32(target, NUMICRO_FLASH_ISPTRG - m_addressMinusOffset, ISPTRG_ISPGO); /* This is the only bit available */
+			/* wait for busy to clear - check the GO flag */
+			timeout = 100;
+			for (;;) {
+				retval = target_read_u32(target, NUMICRO_FLASH_ISPTRG - chip->address_minus_offset, &status);
 				if (retval != ERROR_OK)
 					return retval;
-
-				/* wait for busy to clear - check the GO flag */
-				timeout = 100;
-				for (;;) {
-					retval = target_read_u32(target, NUMICRO_FLASH_ISPTRG - m_addressMinusOffset, &status);
-					if (retval != ERROR_OK)
-						return retval;
-					LOG_DEBUG("status: 0x%" PRIx32 "", status);
-					if (status == 0)
-						break;
-					if (timeout-- <= 0) {
-						LOG_DEBUG("timed out waiting for flash");
-						return ERROR_FAIL;
-					}
-					busy_sleep(1);	/* can use busy sleep for short times. */
+				LOG_DEBUG("status: 0x%" PRIx32 "", status);
+				if (status == 0)
+					break;
+				if (timeout-- <= 0) {
+					LOG_DEBUG("timed out waiting for flash");
+					return ERROR_FAIL;
 				}
+				busy_sleep(1);	/* can use busy sleep for short times. */
+			}
 
-				/* check for failure */
-				retval = target_read_u32(target, NUMICRO_FLASH_ISPCON - m_addressMinusOffset, &status);
+			/* check for failure */
+			retval = target_read_u32(target, NUMICRO_FLASH_ISPCON - chip->address_minus_offset, &status);
+			if (retval != ERROR_OK)
+				return retval;
+			if ((status & ISPCON_ISPFF) != 0) {
+				LOG_DEBUG("failure: 0x%" PRIx32 "", status);
+				/* if bit is set, then must write to it to clear it. */
+				retval = target_write_u32(target, NUMICRO_FLASH_ISPCON - chip->address_minus_offset, (status | ISPCON_ISPFF));
 				if (retval != ERROR_OK)
 					return retval;
-				if ((status & ISPCON_ISPFF) != 0) {
-					LOG_DEBUG("failure: 0x%" PRIx32 "", status);
-					/* if bit is set, then must write to it to clear it. */
-					retval = target_write_u32(target, NUMICRO_FLASH_ISPCON - m_addressMinusOffset, (status | ISPCON_ISPFF));
-					if (retval != ERROR_OK)
-						return retval;
-				}
-				else {
-					bank->sectors[i].is_erased = 1;
-				}
+			}
+			else {
+				bank->sectors[i].is_erased = 1;
 			}
 		}
 	}
-	else { // m_M23SecureDebugState == NUMICRO_M23_SECURE_DEBUG_NS
-		if (strcmp(m_target_name, "M2354") == 0) {
-			algorithm_eraseSector_entry_offset = 0x151;
-			algorithm_lr = 0x30010001;
 
-			/* allocate working area with flash erase code */
-			if (target_alloc_working_area(target, sizeof(numicro_M2354_NS_flash_algorithm_code),
-				&erase_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory erase");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
-
-			retval = target_write_buffer(target, erase_algorithm->address,
-				sizeof(numicro_M2354_NS_flash_algorithm_code), (const uint8_t *)numicro_M2354_NS_flash_algorithm_code);
-			if (retval != ERROR_OK)
-				return retval;
+done:
+	LOG_DEBUG("Erase done.");
 
-			armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-			armv7m_info.core_mode = ARM_MODE_THREAD;
-			if (armv7m == NULL) {
-				/* something is very wrong if armv7m is NULL */
-				LOG_ERROR("unable to get armv7m target");
-				return retval;
-			}
+	return ERROR_OK;
+}
 
-			init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-			init_reg_param(&reg_params[1], "sp", 32, PARAM_OUT);    /* update SP */
-			init_reg_param(&reg_params[2], "lr", 32, PARAM_OUT);
+/* Blank check every sector in one run of numicro_flash_write_code per run
+ * of equal sectors; default_flash_blank_check uploads its loader and runs
+ * it once per sector. */
+static int numicro_erase_check(struct flash_bank *bank)
+{
+	struct target *target = bank->target;
+	struct working_area *check_algorithm;
+	struct working_area *result;
+	struct reg_param reg_params[4];
+	struct armv7m_algorithm armv7m_info;
+	uint8_t *buffer;
+	int i, j, retval;
 
-			/* use Flash erase code within NuMicro            */
-			/* set breakpoint to 0 with time-out of 100000 ms */
-			for (i = first; i <= last; i++) {
-				if (bank->sectors[i].is_erased == 1) {
-					LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
-					continue;
-				}
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
 
-				address = (bank->base + bank->sectors[i].offset) /* & NUMICRO_TZ_MASK */;
-				buf_set_u32(reg_params[0].value, 0, 32, address);
-				buf_set_u32(reg_params[1].value, 0, 32, erase_algorithm->address + target->working_area_size);
-				buf_set_u32(reg_params[2].value, 0, 32, algorithm_lr);
+	for (i = 0; i < bank->num_sectors; i++) {
+		if (bank->sectors[i].size & 0x7)
+			return default_flash_blank_check(bank);
+	}
 
-				retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
-					erase_algorithm->address + algorithm_eraseSector_entry_offset, 0, 100000, &armv7m_info);
-				if (retval != ERROR_OK) {
-					LOG_ERROR("Error executing NuMicro Flash erase algorithm");
-					retval = ERROR_FLASH_OPERATION_FAILED;
-					break;
-				}
-				else {
-					bank->sectors[i].is_erased = 1;
-				}
-			}
+	retval = numicro_load_algorithm(target, numicro_flash_write_code,
+		sizeof(numicro_flash_write_code), &check_algorithm);
+	if (retval != ERROR_OK)
+		return default_flash_blank_check(bank);
 
-			target_free_working_area(target, erase_algorithm);
-			destroy_reg_param(&reg_params[0]);
-			destroy_reg_param(&reg_params[1]);
-			destroy_reg_param(&reg_params[2]);
-		}
-		else {
-			/* allocate working area with flash erase code */
-			if (target_alloc_working_area(target, sizeof(numicro_M2351_NS_flash_erase_code),
-				&erase_algorithm) != ERROR_OK) {
-				LOG_WARNING("no working area available, can't do block memory erase");
-				return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-			}
+	if (target_alloc_working_area(target, bank->num_sectors * 4, &result) != ERROR_OK) {
+		LOG_WARNING("no working area available, can't do on-target blank check");
+		return default_flash_blank_check(bank);
+	}
 
-			retval = target_write_buffer(target, erase_algorithm->address,
-				sizeof(numicro_M2351_NS_flash_erase_code), numicro_M2351_NS_flash_erase_code);
-			if (retval != ERROR_OK)
-				return retval;
+	buffer = malloc(bank->num_sectors * 4);
+	if (buffer == NULL) {
+		target_free_working_area(target, result);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 
-			armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
-			armv7m_info.core_mode = ARM_MODE_THREAD;
-			if (armv7m == NULL) {
-				/* something is very wrong if armv7m is NULL */
-				LOG_ERROR("unable to get armv7m target");
-				return retval;
-			}
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
 
-			init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);    /* faddr */
-			init_reg_param(&reg_params[1], "sp", 32, PARAM_OUT);    /* update SP */
+	retval = armv7m_begin_algorithm_session(target, &armv7m_info);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, result);
+		free(buffer);
+		return retval;
+	}
 
-			/* use Flash erase code within NuMicro            */
-			/* set breakpoint to 0 with time-out of 100000 ms */
-			for (i = first; i <= last; i++) {
-				if (bank->sectors[i].is_erased == 1) {
-					LOG_DEBUG("sector %d has been erased recently. Skip to the next sector.", i);
-					continue;
-				}
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);	/* start address */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* sector size */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);	/* count (sectors) */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* result buffer */
 
-				address = (bank->base + bank->sectors[i].offset) /* & NUMICRO_TZ_MASK */;
-				buf_set_u32(reg_params[0].value, 0, 32, address);
-				buf_set_u32(reg_params[1].value, 0, 32, erase_algorithm->address + target->working_area_size);
+	for (i = 0; i < bank->num_sectors; i = j) {
+		/* adjacent sectors of one size go in one run */
+		for (j = i + 1; j < bank->num_sectors; j++) {
+			if (bank->sectors[j].size != bank->sectors[i].size ||
+				bank->sectors[j].offset != bank->sectors[j - 1].offset + bank->sectors[j - 1].size)
+				break;
+		}
 
-				retval = target_run_algorithm(target, 0, NULL, 2, reg_params,
-					erase_algorithm->address, 0, 100000, &armv7m_info);
-				if (retval != ERROR_OK) {
-					LOG_ERROR("Error executing NuMicro Flash erase algorithm");
-					retval = ERROR_FLASH_OPERATION_FAILED;
-					break;
-				}
-				else {
-					bank->sectors[i].is_erased = 1;
-				}
-			}
+		buf_set_u32(reg_params[0].value, 0, 32, bank->base + bank->sectors[i].offset);
+		buf_set_u32(reg_params[1].value, 0, 32, bank->sectors[i].size);
+		buf_set_u32(reg_params[2].value, 0, 32, j - i);
+		buf_set_u32(reg_params[3].value, 0, 32, result->address + i * 4);
 
-			target_free_working_area(target, erase_algorithm);
-			destroy_reg_param(&reg_params[0]);
-			destroy_reg_param(&reg_params[1]);
+		retval = target_run_algorithm(target, 0, NULL, 4, reg_params,
+			check_algorithm->address + NUMICRO_FLASH_BLANK_CHECK_ENTRY, 0, 10000, &armv7m_info);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Error executing NuMicro blank check algorithm");
+			break;
 		}
 	}
 
-	/* done */
-	LOG_DEBUG("Erase done.");
+	int end_retval = armv7m_end_algorithm_session(target, &armv7m_info);
+	if (retval == ERROR_OK)
+		retval = end_retval;
+
+	if (retval == ERROR_OK)
+		retval = target_read_buffer(target, result->address, bank->num_sectors * 4, buffer);
+
+	if (retval == ERROR_OK) {
+		for (i = 0; i < bank->num_sectors; i++)
+			bank->sectors[i].is_erased = (target_buffer_get_u32(target, buffer + i * 4) == 0xFFFFFFFF);
+	}
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+	destroy_reg_param(&reg_params[3]);
+
+	target_free_working_area(target, result);
+	free(buffer);
+
+	if (retval != ERROR_OK)
+		return default_flash_blank_check(bank);
 
 	return ERROR_OK;
 }
 
-/* The write routine stub. */
-static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
+/* Program count bytes at offset, the sectors must have been erased. */
+static int numicro_program(struct flash_bank *bank, const uint8_t *buffer,
 		uint32_t offset, uint32_t count)
 {
+	struct numicro_flash_bank *numicro_info = bank->driver_priv;
 	struct target *target = bank->target;
+	struct numicro_chip *chip = numicro_get_chip(target);
 	uint32_t timeout, status, rdat;
 	uint8_t *new_buffer = NULL;
 	int retval = ERROR_OK;
@@ -3566,14 +3829,14 @@ static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
 
 	numicro_get_arm_arch(target);
 	if ((bank->base + offset < NUMICRO_SPIM_FLASH_START_ADDRESS) ||
-		m_M23SecureDebugState == NUMICRO_M23_SECURE_DEBUG_NS) {
+		chip->m23_secure_debug_state == NUMICRO_M23_SECURE_DEBUG_NS) {
 		retval = numicro_init_isp(target);
 	}
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (m_M23SecureDebugState != NUMICRO_M23_SECURE_DEBUG_NS) {
-		retval = target_write_u32(target, NUMICRO_FLASH_ISPCMD - m_addressMinusOffset, ISPCMD_WRITE);
+	if (chip->m23_secure_debug_state != NUMICRO_M23_SECURE_DEBUG_NS) {
+		retval = target_write_u32(target, NUMICRO_FLASH_ISPCMD - chip->address_minus_offset, ISPCMD_WRITE);
 		if (retval != ERROR_OK)
 			return retval;
 	}
@@ -3598,7 +3861,8 @@ static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
 	/* try using a block write */
 	retval = numicro_writeblock(bank, buffer, offset, words_remaining);
 
-	if ((retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) && (m_M23SecureDebugState != NUMICRO_M23_SECURE_DEBUG_NS)) {
+	if ((retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) && (chip->m23_secure_debug_state != NUMICRO_M23_SECURE_DEBUG_NS) &&
+		!numicro_info->erase_ahead) {
 		/* if block write failed (no sufficient working area),
 		 * we use normal (slow) single word accesses */
 		LOG_WARNING("couldn't use block writes, falling back to single "
@@ -3612,20 +3876,20 @@ static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
 			uint8_t padding[4] = {0xff, 0xff, 0xff, 0xff};
 			memcpy(padding, buffer + i, MIN(4, count-i));
 
-			retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - m_addressMinusOffset, (bank->base + offset + i) & NUMICRO_TZ_MASK);
+			retval = target_write_u32(target, NUMICRO_FLASH_ISPADR - chip->address_minus_offset, (bank->base + offset + i) & NUMICRO_TZ_MASK);
 			if (retval != ERROR_OK)
 				return retval;
-			retval = target_write_memory(target, NUMICRO_FLASH_ISPDAT - m_addressMinusOffset, 4, 1, padding);
+			retval = target_write_memory(target, NUMICRO_FLASH_ISPDAT - chip->address_minus_offset, 4, 1, padding);
 			if (retval != ERROR_OK)
 				return retval;
-			retval = target_write_u32(target, NUMICRO_FLASH_ISPTRG - m_addressMinusOffset, ISPTRG_ISPGO);
+			retval = target_write_u32(target, NUMICRO_FLASH_ISPTRG - chip->address_minus_offset, ISPTRG_ISPGO);
 			if (retval != ERROR_OK)
 				return retval;
 
 			/* wait for busy to clear - check the GO flag */
 			timeout = 100;
 			for (;;) {
-				retval = target_read_u32(target, NUMICRO_FLASH_ISPTRG - m_addressMinusOffset, &status);
+				retval = target_read_u32(target, NUMICRO_FLASH_ISPTRG - chip->address_minus_offset, &status);
 				if (retval != ERROR_OK){
 					return retval;
 				}
@@ -3641,13 +3905,13 @@ static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
 		}
 
 		/* check for failure */
-		retval = target_read_u32(target, NUMICRO_FLASH_ISPCON - m_addressMinusOffset, &status);
+		retval = target_read_u32(target, NUMICRO_FLASH_ISPCON - chip->address_minus_offset, &status);
 		if (retval != ERROR_OK)
 			return retval;
 		if ((status & ISPCON_ISPFF) != 0) {
 			LOG_DEBUG("failure: 0x%" PRIx32 "", status);
 			/* if bit is set, then must write to it to clear it. */
-			retval = target_write_u32(target, NUMICRO_FLASH_ISPCON - m_addressMinusOffset, (status | ISPCON_ISPFF));
+			retval = target_write_u32(target, NUMICRO_FLASH_ISPCON - chip->address_minus_offset, (status | ISPCON_ISPFF));
 			if (retval != ERROR_OK)
 				return retval;
 		}
@@ -3660,7 +3924,7 @@ static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
 	LOG_DEBUG("Write done.");
 
 	/* check VectorRemap */
-	if (m_M23SecureDebugState == NUMICRO_M23_SECURE_DEBUG_S) {
+	if (chip->m23_secure_debug_state == NUMICRO_M23_SECURE_DEBUG_S) {
 		// M2351/M2354
 		retval = target_read_u32(target, NUMICRO_M23_FMC_ISPSTS, &status);
 		if (retval != ERROR_OK)
@@ -3690,7 +3954,7 @@ static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
 			}
 		}
 	}
-	else if (strcmp(m_target_name, "M460") == 0) {
+	else if (strcmp(chip->target_name, "M460") == 0) {
 		// M460
 		retval = target_read_u32(target, NUMICRO_M23_FMC_ISPSTS, &status);
 		if (retval != ERROR_OK)
@@ -3724,19 +3988,212 @@ static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
 		}
 	}
 
-	return ERROR_OK;
+	return ERROR_OK;
+}
+
+/* Compare the sectors to be written with the new data through an on-target
+ * CRC, then erase and program only the runs of sectors that differ. */
+static int numicro_program_changed(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count)
+{
+	struct target *target = bank->target;
+	uint32_t run_start = 0, run_end = 0;
+	int run_first = -1, unchanged = 0, total = 0;
+	int retval = ERROR_OK;
+
+	for (int i = 0; i <= bank->num_sectors; i++) {
+		bool changed = false;
+		uint32_t start = 0, end = 0;
+
+		if (i < bank->num_sectors) {
+			struct flash_sector *sector = &bank->sectors[i];
+			start = MAX(offset, sector->offset);
+			end = MIN(offset + count, sector->offset + sector->size);
+			if (start >= end)
+				continue;
+
+			uint32_t checksum, mem_checksum;
+			total++;
+			changed = true;
+			if (image_calculate_checksum((uint8_t *)buffer + (start - offset), end - start, &checksum) == ERROR_OK &&
+				target_checksum_memory(target, bank->base + start, end - start, &mem_checksum) == ERROR_OK &&
+				checksum == mem_checksum) {
+				LOG_DEBUG("sector %d is unchanged", i);
+				unchanged++;
+				changed = false;
+			}
+		}
+
+		if (changed) {
+			if (run_first < 0) {
+				run_first = i;
+				run_start = start;
+			}
+			run_end = end;
+			continue;
+		}
+
+		if (run_first < 0)
+			continue;
+
+		/* partly covered sectors keep the rest of their contents: read
+		 * it back, then erase and program the sectors in full */
+		uint32_t sector_start = bank->sectors[run_first].offset;
+		uint32_t sector_end = bank->sectors[i - 1].offset + bank->sectors[i - 1].size;
+		uint8_t *data = malloc(sector_end - sector_start);
+		if (data == NULL) {
+			LOG_ERROR("no memory for sector buffer");
+			return ERROR_FAIL;
+		}
+
+		retval = target_read_buffer(target, bank->base + sector_start, run_start - sector_start, data);
+		if (retval == ERROR_OK)
+			retval = target_read_buffer(target, bank->base + run_end, sector_end - run_end,
+					data + (run_end - sector_start));
+		if (retval == ERROR_OK) {
+			memcpy(data + (run_start - sector_start), buffer + (run_start - offset), run_end - run_start);
+			retval = numicro_erase(bank, run_first, i - 1);
+		}
+		if (retval == ERROR_OK)
+			retval = numicro_program(bank, data, sector_start, sector_end - sector_start);
+		free(data);
+		if (retval != ERROR_OK)
+			return retval;
+
+		run_first = -1;
+	}
+
+	LOG_INFO("Nuvoton NuMicro: %d of %d sectors unchanged", unchanged, total);
+
+	return retval;
+}
+
+/* The sectors written to are no longer blank. */
+static void numicro_set_written(struct flash_bank *bank, uint32_t offset, uint32_t count)
+{
+	for (int i = 0; i < bank->num_sectors; i++) {
+		if (bank->sectors[i].offset < offset + count &&
+			bank->sectors[i].offset + bank->sectors[i].size > offset)
+			bank->sectors[i].is_erased = 0;
+	}
+}
+
+/* The write routine stub. */
+static int numicro_write(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count)
+{
+	int retval;
+
+	/* the CONFIG shadow is read again after a write to the bank */
+	if ((bank->base & ~NUMICRO_SPECIAL_FLASH_OFFSET) == NUMICRO_CONFIG_BASE)
+		numicro_get_chip(bank->target)->config_valid = false;
+
+	if (numicro_get_chip(bank->target)->skip_unchanged)
+		retval = numicro_program_changed(bank, buffer, offset, count);
+	else
+		retval = numicro_program(bank, buffer, offset, count);
+	if (retval != ERROR_OK)
+		return retval;
+
+	numicro_set_written(bank, offset, count);
+
+	return ERROR_OK;
+}
+
+/* flash_write_unlock() brackets an image with these: loaders needing an
+ * uninit or a chip reset stay initialised over all its sections and
+ * banks, and are closed once at the end. */
+static int numicro_write_start(struct flash_bank *bank)
+{
+	numicro_get_chip(bank->target)->write_session++;
+
+	return ERROR_OK;
+}
+
+static int numicro_write_done(struct flash_bank *bank)
+{
+	struct numicro_chip *chip = numicro_get_chip(bank->target);
+
+	if (chip->write_session == 0 || --chip->write_session != 0)
+		return ERROR_OK;
+
+	chip->spim_sector_erased = 0;
+
+	if (bank->target->state != TARGET_HALTED) {
+		chip->flm_open = NULL;
+		chip->flm_reset = false;
+		return ERROR_OK;
+	}
+
+	return numicro_flm_close(bank->target);
+}
+
+/* Erase and program a sector aligned range in one pass. The word loader
+ * erases each page just before programming it while the host streams the
+ * data in, other loaders get the range erased first. */
+static int numicro_erase_write(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count)
+{
+	struct numicro_flash_bank *numicro_info = bank->driver_priv;
+	const struct numicro_family *family = numicro_bank_family(bank);
+	uint32_t page_size = bank->sectors[0].size;
+	int first = -1, last = -1;
+	int retval;
+
+	/* SPROM pages need the ISPDAT key, leave them to numicro_erase */
+	bool erase_ahead = (family->caps & NUMICRO_CAP_ASYNC) &&
+		!numicro_get_chip(bank->target)->skip_unchanged &&
+		!(bank->base >= NUMICRO_SPROM_BASE && bank->base < NUMICRO_CONFIG_BASE) &&
+		!(page_size & (page_size - 1));
+
+	for (int i = 0; i < bank->num_sectors; i++) {
+		if (bank->sectors[i].size != page_size)
+			erase_ahead = false;
+		if (bank->sectors[i].offset < offset + count &&
+			bank->sectors[i].offset + bank->sectors[i].size > offset) {
+			if (first < 0)
+				first = i;
+			last = i;
+		}
+	}
+
+	if (first < 0)
+		return ERROR_OK;
+
+	if (bank->sectors[first].offset != offset ||
+		bank->sectors[last].offset + bank->sectors[last].size != offset + count)
+		erase_ahead = false;
+
+	if (erase_ahead) {
+		numicro_info->erase_ahead = true;
+		retval = numicro_program(bank, buffer, offset, count);
+		numicro_info->erase_ahead = false;
+		if (retval == ERROR_OK)
+			numicro_set_written(bank, offset, count);
+		if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+			return retval;
+
+		LOG_WARNING("couldn't erase while programming, erasing first");
+	}
+
+	retval = numicro_erase(bank, first, last);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return numicro_write(bank, buffer, offset, count);
 }
 
 static int numicro_get_cpu_type(struct target *target, const struct numicro_cpu_type** cpu)
 {
-	uint32_t part_id = 0xABCDEF12;
+	struct numicro_chip *chip = numicro_get_chip(target);
+	uint32_t pdid, part_id = 0xABCDEF12;
 	int retval = ERROR_OK;
 
 	numicro_get_arm_arch(target);
 
 	/* Read NuMicro PartID */
-	if (m_M23SecureDebugState != NUMICRO_M23_SECURE_DEBUG_NS) {
-		retval = target_read_u32(target, NUMICRO_SYS_BASE - m_addressMinusOffset, &part_id);
+	if (chip->m23_secure_debug_state != NUMICRO_M23_SECURE_DEBUG_NS) {
+		retval = target_read_u32(target, NUMICRO_SYS_BASE - chip->address_minus_offset, &part_id);
 		if (retval != ERROR_OK) {
 			LOG_WARNING("NuMicro flash driver: Failed to Get PartID");
 			return ERROR_FLASH_OPERATION_FAILED;
@@ -3749,20 +4206,20 @@ static int numicro_get_cpu_type(struct target *target, const struct numicro_cpu_
 			return ERROR_FLASH_OPERATION_FAILED;
 		}
 	}
+	pdid = part_id;
 
-	LOG_INFO("Device ID: 0x%08" PRIx32 "", part_id);
-	/* search part numbers */
-	for (size_t i = 0; i < sizeof(NuMicroParts) / sizeof(NuMicroParts[0]); i++) {
-		if (part_id == NuMicroParts[i].partid) {
-			*cpu = &NuMicroParts[i];
-			LOG_INFO("Device Name: %s", (*cpu)->partname);
-			return ERROR_OK;
-		}
+	/* the other banks of the chip take the part found for the first */
+	if (chip->cpu && chip->cpu_part_id == pdid) {
+		*cpu = chip->cpu;
+		return ERROR_OK;
 	}
 
+	LOG_DEBUG("Device ID: 0x%08" PRIx32 "", part_id);
+	*cpu = numicro_find_part(part_id);
+
 	/* try again for M23 series */
-	if (m_M23SecureDebugState == NUMICRO_M23_SECURE_DEBUG_NS) {
-		if (strcmp(m_target_name, "M2351") == 0) {
+	if (*cpu == NULL && chip->m23_secure_debug_state == NUMICRO_M23_SECURE_DEBUG_NS) {
+		if (strcmp(chip->target_name, "M2351") == 0) {
 			numicro_M2351_getinitinfo_ns(target, &part_id);
 		}
 		else {
@@ -3773,19 +4230,19 @@ static int numicro_get_cpu_type(struct target *target, const struct numicro_cpu_
 			}
 		}
 
-		LOG_INFO("Device ID: 0x%08" PRIx32 "", part_id);
-		/* search part numbers */
-		for (size_t i = 0; i < sizeof(NuMicroParts) / sizeof(NuMicroParts[0]); i++) {
-			if (part_id == NuMicroParts[i].partid) {
-				*cpu = &NuMicroParts[i];
-				LOG_INFO("Device Name: %s", (*cpu)->partname);
-				return ERROR_OK;
-			}
-		}
+		LOG_DEBUG("Device ID: 0x%08" PRIx32 "", part_id);
+		*cpu = numicro_find_part(part_id);
 	}
-	LOG_WARNING("NuMicro flash driver: Failed to search PartID. Use 'UNKNOWN' instead.");
+
+	if (*cpu) {
+		LOG_INFO("Device Name: %s", (*cpu)->partname);
+		chip->cpu = *cpu;
+		chip->cpu_part_id = pdid;
+		return ERROR_OK;
+	}
+
+	LOG_WARNING("NuMicro flash driver: Failed to search PartID 0x%08" PRIx32 ". Use 'UNKNOWN' instead.", part_id);
 	*cpu = &NuMicroParts[sizeof(NuMicroParts) / sizeof(NuMicroParts[0]) - 1];
-	LOG_INFO("Device Name: %s", (*cpu)->partname);
 
 	return ERROR_FAIL;
 }
@@ -3807,34 +4264,35 @@ static int numicro_get_flash_size(struct flash_bank *bank, const struct numicro_
 }
 
 int nulink_usb_reconnect(int chip_type);
-static int numicro_probe(struct flash_bank *bank)
+
+/* Work out the part and what follows from it for the whole chip.  All
+ * banks of a chip share the result, so only the first one to be probed
+ * reads the PDID; another examine starts over. */
+static int numicro_identify(struct target *target, const struct numicro_cpu_type **part)
 {
-	uint32_t flash_size = 0, offset = 0, page_size;
-	int num_pages;
 	const struct numicro_cpu_type *cpu;
-	struct target *target = bank->target;
+	struct numicro_chip *chip = numicro_get_chip(target);
 	struct armv7m_common *armv7m = target_to_armv7m(target);
 	int retval = ERROR_OK;
 
-	retval = numicro_get_cpu_type(target, &cpu);
-	if (retval != ERROR_OK) {
-		LOG_WARNING("NuMicro flash driver: Failed to detect a known part");
-		/* return ERROR_FLASH_OPERATION_FAILED; */
+	if (chip->identified) {
+		*part = chip->cpu ? chip->cpu : &NuMicroParts[sizeof(NuMicroParts) / sizeof(NuMicroParts[0]) - 1];
+		return ERROR_OK;
 	}
 
-	retval = numicro_get_flash_size(bank, cpu, &flash_size);
+	retval = numicro_get_cpu_type(target, &cpu);
 	if (retval != ERROR_OK) {
-		LOG_WARNING("NuMicro flash driver: Failed to detect flash size");
+		LOG_WARNING("NuMicro flash driver: Failed to detect a known part");
 		/* return ERROR_FLASH_OPERATION_FAILED; */
 	}
 
 	/* decide the page size */
 	if (armv7m->arm.is_armv6m) { /* M0 */
 		if (armv7m->arm.is_NUC_M0_FMC_MSB4) {
-			m_eChipType = NUC_CHIP_TYPE_M031;
+			chip->chip_type = NUC_CHIP_TYPE_M031;
 		}
 		else {
-			m_eChipType = NUC_CHIP_TYPE_GENERAL_V6M;
+			chip->chip_type = NUC_CHIP_TYPE_GENERAL_V6M;
 		}
 
 		if ((cpu->partid == 0x00295C50/* NUC029LGE */) ||
@@ -3852,41 +4310,41 @@ static int numicro_probe(struct flash_bank *bank)
 			((cpu->partid & 0xFFFFFF00) == 0x01132600/* M031G  */) ||
 			((cpu->partid & 0xFFFFFF00) == 0x01131100/* M031I  */) ||
 			((cpu->partid & 0xFFFFFF00) == 0x01132100/* M031I  */)) {
-			m_pageSize = NUMICRO_PAGESIZE * 4;
+			chip->page_size = NUMICRO_PAGESIZE * 4;
 		}
 		else {
-			m_pageSize = NUMICRO_PAGESIZE;
+			chip->page_size = NUMICRO_PAGESIZE;
 		}
 	}
 	else if (armv7m->arm.is_armv8m) { /* M23 */
-		m_eChipType = NUC_CHIP_TYPE_M2351;
+		chip->chip_type = NUC_CHIP_TYPE_M2351;
 		if (((cpu->partid & 0xFFFFFF00) == 0x01812600)/* NUC1262 */ ||
 			((cpu->partid & 0xFFFFFF00) == 0x01D12600)/* NUC1263 */ ||
 			 armv7m->arm.is_armv8mSecureExtend) {
-			m_pageSize = NUMICRO_PAGESIZE * 4;
+			chip->page_size = NUMICRO_PAGESIZE * 4;
 		}
 		else {
-			m_pageSize = NUMICRO_PAGESIZE;     /* for M251 */
+			chip->page_size = NUMICRO_PAGESIZE;     /* for M251 */
 		}
 	}
 	else { /* armv7m (M4) */
-		m_eChipType = NUC_CHIP_TYPE_GENERAL_V7M;
+		chip->chip_type = NUC_CHIP_TYPE_GENERAL_V7M;
 		if (((cpu->partid & 0xFFFFFF00) == 0x01347900/* M479   */) ||
 			((cpu->partid & 0xFFFFF000) == 0x00D48000/* M480   */) ||
 			((cpu->partid & 0xFFFFF000) == 0x01348000/* M480LD */) ||
 			((cpu->partid & 0xFFFFF000) == 0x01B46000/* M460HD */) ||
 			((cpu->partid & 0xFFFFF000) == 0x01C46000/* M460LD */) ||
 			((cpu->partid & 0xFF00FF00) == 0x1D000500/* I94100 */)) {
-			m_pageSize = NUMICRO_PAGESIZE * 8;
+			chip->page_size = NUMICRO_PAGESIZE * 8;
 		}
 		else if (cpu->partid == 0x00550505) {
-			m_pageSize = 0x1000; /* for NUC505 */
+			chip->page_size = 0x1000; /* for NUC505 */
 		}
 		else {
-			m_pageSize = NUMICRO_PAGESIZE * 4;
+			chip->page_size = NUMICRO_PAGESIZE * 4;
 		}
 	}
-	LOG_DEBUG("Nuvoton pageSize: 0x%" PRIx32 "", m_pageSize);
+	LOG_DEBUG("Nuvoton pageSize: 0x%" PRIx32 "", chip->page_size);
 
 	/* decide the flash information */
 	if ((cpu->partid == 0x00295C50/* NUC029LGE */) ||
@@ -3908,78 +4366,108 @@ static int numicro_probe(struct flash_bank *bank)
 		((cpu->partid & 0xFFFFFF00) == 0x00110200/* Nano102 */) ||
 		((cpu->partid & 0xFFFFFF00) == 0x00111200/* Nano112 */) ||
 		((cpu->partid & 0xFFFFFF00) == 0x00A05800/* Mini58  */)) {
-		m_flashInfo = NUMICRO_SPROM_MASK;
+		chip->flash_info = NUMICRO_SPROM_MASK;
 	}
 	else if ((cpu->partid & 0xFFFFFF00) == 0x00B05700/* Mini57 */) {
-		m_flashInfo = NUMICRO_SPROM_MINI57_MASK;
+		chip->flash_info = NUMICRO_SPROM_MINI57_MASK;
 	}
 	else {
-		m_flashInfo = 0;
+		chip->flash_info = 0;
 	}
 
 	/* decide the target name */
 	if (((cpu->partid & 0xFFFFF000) == 0x01B46000/* M460HD */) ||
 		((cpu->partid & 0xFFFFF000) == 0x01C46000/* M460LD */)) {
-		m_flashInfo = NUMICRO_FLASH_OFFSET_MASK;
-		m_target_name = "M460";
-		m_eChipType = NUC_CHIP_TYPE_M460;
+		chip->flash_info = NUMICRO_FLASH_OFFSET_MASK | NUMICRO_MULTI_WORD_MASK;
+		chip->target_name = "M460";
+		chip->chip_type = NUC_CHIP_TYPE_M460;
 	}
 	else if (((cpu->partid & 0xFFFFFF00) == 0x01347900/* M479   */) ||
 		((cpu->partid & 0xFFFFF000) == 0x00D48000/* M480   */) ||
 		((cpu->partid & 0xFFFFF000) == 0x01348000/* M480LD */) ||
 		((cpu->partid & 0xFF00FF00) == 0x1D000500/* I94100 */)) {
-		m_target_name = "M480";
-		m_eChipType = NUC_CHIP_TYPE_M480;
+		if ((cpu->partid & 0xFF00FF00) != 0x1D000500/* I94100 */)
+			chip->flash_info |= NUMICRO_MULTI_WORD_MASK;
+		chip->target_name = "M480";
+		chip->chip_type = NUC_CHIP_TYPE_M480;
 	}
 	else if (((cpu->partid & 0xFFFFFFF0) == 0x01647140) ||
 		((cpu->partid & 0xFFFFFFF0) == 0x01647130) ||
 		((cpu->partid & 0xFFFFFFF0) == 0x01647170)) {
-		m_target_name = "M471";
-		m_eChipType = NUC_CHIP_TYPE_M471;
+		chip->target_name = "M471";
+		chip->chip_type = NUC_CHIP_TYPE_M471;
 	}
 	else if (cpu->partid == 0x00550505) {
-		m_target_name = "NUC505";
-		m_eChipType = NUC_CHIP_TYPE_NUC505;
+		chip->target_name = "NUC505";
+		chip->chip_type = NUC_CHIP_TYPE_NUC505;
 	}
 	else if ((cpu->partid & 0xFFFFFF00) == 0x01812600/* NUC1262 */) {
-		m_target_name = "NUC1262";
+		chip->target_name = "NUC1262";
 	}
 	else if ((cpu->partid & 0xFFFFFF00) == 0x01D12600/* NUC1263 */) {
-		m_target_name = "NUC1263";
+		chip->target_name = "NUC1263";
 	}
 	else if (((cpu->partid & 0xFFFFFF00) == 0x00235100) ||
 			 ((cpu->partid & 0xFFFFFF00) == 0x00235300)) {
-		m_target_name = "M2351";
+		chip->target_name = "M2351";
 	}
 	else if (((cpu->partid & 0xFFFFFF00) == 0x00235500) ||
 			 ((cpu->partid & 0xFFFFFF00) == 0x00235400) ||
 			 ((cpu->partid & 0xFFFFFF00) == 0xA1735400)) {
-		m_target_name = "M2354";
+		chip->target_name = "M2354";
 	}
 	else if (((cpu->partid & 0xFFFFFF00) == 0x01129600) ||
 			 ((cpu->partid & 0xFFFFFF00) == 0x01130600) ||
 			 ((cpu->partid & 0xFFFFFF00) == 0x01131600)) {
-		m_target_name = "M030G";
-		m_eChipType = NUC_CHIP_TYPE_M030G;
-		if (nulink_usb_reconnect(m_eChipType) != ERROR_OK) {
+		chip->target_name = "M030G";
+		chip->chip_type = NUC_CHIP_TYPE_M030G;
+		if (nulink_usb_reconnect(chip->chip_type) != ERROR_OK) {
 			return ERROR_FAIL;
 		}
 	}
 	else {
-		m_target_name = "common";
+		chip->target_name = "common";
+	}
+	LOG_DEBUG("target name: %s", chip->target_name);
+	chip->identified = true;
+	*part = cpu;
+
+	return ERROR_OK;
+}
+
+static int numicro_probe(struct flash_bank *bank)
+{
+	uint32_t flash_size = 0, offset = 0, page_size;
+	int num_pages;
+	const struct numicro_cpu_type *cpu;
+	struct target *target = bank->target;
+	struct numicro_chip *chip = numicro_get_chip(target);
+	int retval = ERROR_OK;
+
+	retval = numicro_identify(target, &cpu);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = numicro_get_flash_size(bank, cpu, &flash_size);
+	if (retval != ERROR_OK) {
+		LOG_WARNING("NuMicro flash driver: Failed to detect flash size");
+		/* return ERROR_FLASH_OPERATION_FAILED; */
 	}
-	LOG_DEBUG("target name: %s", m_target_name);
 
 	if ((bank->base & (~NUMICRO_SPECIAL_FLASH_OFFSET)) >= NUMICRO_DATA_DFMC_BASE) {
 		page_size =  NUMICRO_DFMC_PAGESIZE;
 	}
 	else {
-		page_size = m_pageSize;
+		page_size = chip->page_size;
 	}
 
 	num_pages = flash_size / page_size;
+	/* a probe again keeps the table, virtual banks point at it */
+	if (bank->sectors == NULL || bank->num_sectors != num_pages) {
+		free(bank->sectors);
+		bank->sectors = malloc(sizeof(struct flash_sector) * num_pages);
+	}
 	bank->num_sectors = num_pages;
-	bank->sectors = malloc(sizeof(struct flash_sector) * num_pages);
 	bank->size = flash_size;
 
 	for (int i = 0; i < num_pages; i++) {
@@ -3993,6 +4481,8 @@ static int numicro_probe(struct flash_bank *bank)
 	struct numicro_flash_bank *numicro_info = bank->driver_priv;
 	numicro_info->probed = true;
 	numicro_info->cpu = cpu;
+	numicro_info->family = numicro_find_family(target, bank->base);
+	chip->family = numicro_find_family(target, 0);
 	LOG_DEBUG("Nuvoton NuMicro: Probed ...");
 
 	return ERROR_OK;
@@ -4017,75 +4507,117 @@ FLASH_BANK_COMMAND_HANDLER(numicro_flash_bank_command)
 
 	LOG_DEBUG("add flash_bank numicro %s", bank->name);
 
+	if (numicro_get_chip(bank->target) == NULL)
+		return ERROR_FAIL;
+
 	bank_info = malloc(sizeof(struct numicro_flash_bank));
 
 	memset(bank_info, 0, sizeof(struct numicro_flash_bank));
 
 	bank->driver_priv = bank_info;
 
+	/* optional: flash bank ... numicro <base> <size> 0 0 <target> [max_buffer_size] */
+	if (CMD_ARGC > 6)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[6], bank_info->max_buffer_size);
+
 	return ERROR_OK;
 }
 
 COMMAND_HANDLER(numicro_handle_read_isp_command)
 {
-	uint32_t address;
-	uint32_t ispdat;
+	uint32_t address, count = 1;
+	struct numicro_isp_cmd *cmds;
 	int retval = ERROR_OK;
 
-	if (CMD_ARGC != 1)
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], count);
+	if (count == 0 || count > 1024)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
 
 	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	if (chip == NULL)
+		return ERROR_FAIL;
 
 	numicro_get_arm_arch(target);
 	retval = numicro_init_isp(target);
 	if (retval != ERROR_OK)
 		return retval;
 
-	if ((m_flashInfo & NUMICRO_FLASH_OFFSET_MASK) != 0) {
+	if ((chip->flash_info & NUMICRO_FLASH_OFFSET_MASK) != 0) {
 		address = address | NUMICRO_SPECIAL_FLASH_OFFSET;
 	}
 
-	retval = numicro_fmc_cmd(target, ISPCMD_READ, address, 0, &ispdat);
-	if (retval != ERROR_OK)
-		return retval;
+	cmds = calloc(count, sizeof(*cmds));
+	if (cmds == NULL)
+		return ERROR_FAIL;
+	for (uint32_t i = 0; i < count; i++) {
+		cmds[i].cmd = ISPCMD_READ;
+		cmds[i].addr = address + i * 4;
+	}
 
-	LOG_INFO("numicro read_isp 0x%08" PRIx32 " 0x%08" PRIx32, address, ispdat);
+	retval = numicro_fmc_cmd_batch(target, cmds, count);
+	if (retval == ERROR_OK) {
+		for (uint32_t i = 0; i < count; i++)
+			LOG_INFO("numicro read_isp 0x%08" PRIx32 " 0x%08" PRIx32, cmds[i].addr, cmds[i].data);
+	}
 
-	return ERROR_OK;
+	free(cmds);
+	return retval;
 }
 
 COMMAND_HANDLER(numicro_handle_write_isp_command)
 {
 	uint32_t address;
-	uint32_t ispdat, rdat;
+	struct numicro_isp_cmd *cmds;
+	unsigned int count;
 	int retval = ERROR_OK;
 
-	if (CMD_ARGC != 2)
+	if (CMD_ARGC < 2)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
-	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], ispdat);
+
+	/* the values go to consecutive words */
+	count = CMD_ARGC - 1;
+	cmds = calloc(count, sizeof(*cmds));
+	if (cmds == NULL)
+		return ERROR_FAIL;
+	for (unsigned int i = 0; i < count; i++) {
+		cmds[i].cmd = ISPCMD_WRITE;
+		if (parse_u32(CMD_ARGV[i + 1], &cmds[i].data) != ERROR_OK) {
+			free(cmds);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+	}
 
 	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	if (chip == NULL)
+		return ERROR_FAIL;
 
 	numicro_get_arm_arch(target);
 	retval = numicro_init_isp(target);
 	if (retval != ERROR_OK)
 		return retval;
 
-	if ((m_flashInfo & NUMICRO_FLASH_OFFSET_MASK) != 0) {
+	if ((chip->flash_info & NUMICRO_FLASH_OFFSET_MASK) != 0) {
 		address = address | NUMICRO_SPECIAL_FLASH_OFFSET;
 	}
 
-	retval = numicro_fmc_cmd(target, ISPCMD_WRITE, address, ispdat, &rdat);
-	if (retval != ERROR_OK)
-		return retval;
+	for (unsigned int i = 0; i < count; i++) {
+		cmds[i].addr = address + i * 4;
+		LOG_INFO("numicro write_isp 0x%08" PRIx32 " 0x%08" PRIx32, cmds[i].addr, cmds[i].data);
+	}
 
-	LOG_INFO("numicro write_isp 0x%08" PRIx32 " 0x%08" PRIx32, address, ispdat);
-	return ERROR_OK;
+	retval = numicro_fmc_cmd_batch(target, cmds, count);
+
+	free(cmds);
+	return retval;
 }
 
 COMMAND_HANDLER(numicro_handle_erase_isp_command)
@@ -4100,13 +4632,16 @@ COMMAND_HANDLER(numicro_handle_erase_isp_command)
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
 
 	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	if (chip == NULL)
+		return ERROR_FAIL;
 
 	numicro_get_arm_arch(target);
 	retval = numicro_init_isp(target);
 	if (retval != ERROR_OK)
 		return retval;
 
-	if ((m_flashInfo & NUMICRO_FLASH_OFFSET_MASK) != 0) {
+	if ((chip->flash_info & NUMICRO_FLASH_OFFSET_MASK) != 0) {
 		address = address | NUMICRO_SPECIAL_FLASH_OFFSET;
 	}
 
@@ -4119,44 +4654,230 @@ COMMAND_HANDLER(numicro_handle_erase_isp_command)
 	return ERROR_OK;
 }
 
-int nulink_usb_M2351_erase(int);
-COMMAND_HANDLER(numicro_handle_chip_erase_command)
+COMMAND_HANDLER(numicro_handle_skip_unchanged_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct numicro_chip *chip = numicro_get_chip(get_current_target(CMD_CTX));
+	if (chip == NULL)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], chip->skip_unchanged);
+
+	command_print(CMD_CTX, "numicro skip_unchanged %s", chip->skip_unchanged ? "enabled" : "disabled");
+
+	return ERROR_OK;
+}
+
+/* numicro config [set field value | write]: changes go to the CONFIG
+ * shadow, "write" programs them in one go. Fields are cbs (aprom|ldrom),
+ * lock (on|off) and config0..config3 for whole words. */
+COMMAND_HANDLER(numicro_handle_config_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	int retval;
+
+	if (CMD_ARGC != 0 && !(CMD_ARGC == 1 && strcmp(CMD_ARGV[0], "write") == 0) &&
+		!(CMD_ARGC == 3 && strcmp(CMD_ARGV[0], "set") == 0))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	numicro_get_arm_arch(target);
+	if (chip->m23_secure_debug_state == NUMICRO_M23_SECURE_DEBUG_NS) {
+		command_print(CMD_CTX, "numicro config needs the secure state");
+		return ERROR_FAIL;
+	}
+
+	retval = numicro_init_isp(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = numicro_config_read(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (CMD_ARGC == 1) {
+		retval = numicro_config_flush(target);
+		if (retval != ERROR_OK) {
+			command_print(CMD_CTX, "numicro config write failed");
+			return retval;
+		}
+	}
+	else if (CMD_ARGC == 3) {
+		uint32_t config0 = chip->config[0];
+		bool on;
+
+		if (strcmp(CMD_ARGV[1], "cbs") == 0) {
+			if (strcmp(CMD_ARGV[2], "aprom") == 0)
+				config0 |= CONFIG0_CBS_AP;
+			else if (strcmp(CMD_ARGV[2], "ldrom") == 0)
+				config0 &= ~CONFIG0_CBS_AP;
+			else
+				return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		else if (strcmp(CMD_ARGV[1], "lock") == 0) {
+			COMMAND_PARSE_ON_OFF(CMD_ARGV[2], on);
+			/* LOCK is active low */
+			if (on)
+				config0 &= ~CONFIG0_LOCK_MASK;
+			else
+				config0 |= CONFIG0_LOCK_MASK;
+		}
+		else if (strncmp(CMD_ARGV[1], "config", 6) == 0 && strlen(CMD_ARGV[1]) == 7 &&
+			CMD_ARGV[1][6] >= '0' && CMD_ARGV[1][6] < '0' + (int)chip->config_count) {
+			unsigned int word = CMD_ARGV[1][6] - '0';
+			uint32_t value;
+
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], value);
+			if (word == 0)
+				config0 = value;
+			else {
+				chip->config_dirty |= chip->config[word] != value;
+				chip->config[word] = value;
+			}
+		}
+		else {
+			command_print(CMD_CTX, "unknown CONFIG field %s", CMD_ARGV[1]);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		chip->config_dirty |= chip->config[0] != config0;
+		chip->config[0] = config0;
+	}
+
+	for (unsigned int i = 0; i < chip->config_count; i++)
+		command_print(CMD_CTX, "CONFIG%u: 0x%08" PRIx32 "", i, chip->config[i]);
+	if (chip->config_dirty)
+		command_print(CMD_CTX, "not written yet, use 'numicro config write'");
+
+	return ERROR_OK;
+}
+
+/* numicro part name partid [base size] ...: describe a part missing
+ * from NuMicroParts, or override one; a file of these can be sourced
+ * from the configuration */
+COMMAND_HANDLER(numicro_handle_part_command)
+{
+	struct numicro_cpu_type part = { 0 };
+	struct numicro_cpu_type *cpu, **parts;
+
+	if (CMD_ARGC < 2 || CMD_ARGC % 2 || CMD_ARGC > 2 + 2 * NUMICRO_MAX_FLASH_BANKS)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], part.partid);
+	part.n_banks = (CMD_ARGC - 2) / 2;
+	for (unsigned int i = 0; i < part.n_banks; i++) {
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2 + 2 * i], part.bank[i].base);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3 + 2 * i], part.bank[i].size);
+	}
+
+	parts = realloc(numicro_extra_parts, (numicro_extra_parts_count + 1) * sizeof(*parts));
+	if (parts)
+		numicro_extra_parts = parts;
+	cpu = malloc(sizeof(*cpu));
+	part.partname = strdup(CMD_ARGV[0]);
+	if (parts == NULL || cpu == NULL || part.partname == NULL) {
+		free(part.partname);
+		free(cpu);
+		LOG_ERROR("no memory for the part");
+		return ERROR_FAIL;
+	}
+	*cpu = part;
+
+	numicro_extra_parts = parts;
+	numicro_extra_parts[numicro_extra_parts_count++] = cpu;
+
+	/* reindex on the next lookup */
+	free(numicro_parts_index);
+	numicro_parts_index = NULL;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(numicro_handle_checksum_command)
 {
+	uint32_t address, count;
+	uint32_t checksum;
 	int retval = ERROR_OK;
-	uint32_t rdat;
 
-	if (CMD_ARGC != 0)
+	if (CMD_ARGC != 2)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], count);
+
 	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	if (chip == NULL)
+		return ERROR_FAIL;
 
 	numicro_get_arm_arch(target);
 	retval = numicro_init_isp(target);
 	if (retval != ERROR_OK)
 		return retval;
 
-	LOG_DEBUG("m_eChipType %x\n", m_eChipType);
-	retval = nulink_usb_M2351_erase(m_eChipType);
+	if (!(chip->family->caps & NUMICRO_CAP_CRC)) {
+		command_print(CMD_CTX, "numicro checksum is not supported on %s", chip->target_name);
+		return ERROR_FAIL;
+	}
+
+	retval = numicro_fmc_checksum(target, address, count, &checksum);
 	if (retval != ERROR_OK) {
-		command_print(CMD_CTX, "numicro chip_erase failed");
+		command_print(CMD_CTX, "numicro checksum failed");
 		return retval;
 	}
 
-	if ((m_flashInfo & NUMICRO_SPROM_MASK) != 0) {
+	command_print(CMD_CTX, "numicro checksum 0x%08" PRIx32 " 0x%08" PRIx32 ": 0x%08" PRIx32,
+		address, count, checksum);
+
+	return ERROR_OK;
+}
+
+int nulink_usb_M2351_erase(int);
+/* Erase the whole chip through the adapter, then SPROM where it exists. */
+static int numicro_chip_erase(struct target *target)
+{
+	struct numicro_chip *chip = numicro_get_chip(target);
+	int retval = ERROR_OK;
+	uint32_t rdat;
+
+	if (chip == NULL)
+		return ERROR_FAIL;
+
+	numicro_get_arm_arch(target);
+	retval = numicro_init_isp(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	LOG_DEBUG("chip->chip_type %x\n", chip->chip_type);
+	retval = nulink_usb_M2351_erase(chip->chip_type);
+	chip->config_valid = false;
+	numicro_sectors_unknown(target, 0, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if ((chip->flash_info & NUMICRO_SPROM_MASK) != 0) {
 		LOG_DEBUG("SPROM is erasing");
 		retval = numicro_fmc_cmd(target, ISPCMD_ERASE, NUMICRO_SPROM_BASE, NUMICRO_SPROM_ISPDAT, &rdat);
 		if (retval != ERROR_OK)
 			return retval;
 	}
-	else if ((m_flashInfo & NUMICRO_SPROM_MINI57_MASK) != 0) {
+	else if ((chip->flash_info & NUMICRO_SPROM_MINI57_MASK) != 0) {
+		struct numicro_isp_cmd cmds[] = {
+			{ ISPCMD_ERASE, NUMICRO_SPROM_BASE, NUMICRO_SPROM_ISPDAT },
+			{ ISPCMD_ERASE, NUMICRO_SPROM_BASE2, NUMICRO_SPROM_ISPDAT },
+			{ ISPCMD_ERASE, NUMICRO_SPROM_BASE3, NUMICRO_SPROM_ISPDAT },
+		};
+
 		LOG_DEBUG("SPROM is erasing");
-		retval = numicro_fmc_cmd(target, ISPCMD_ERASE, NUMICRO_SPROM_BASE, NUMICRO_SPROM_ISPDAT, &rdat);
-		if (retval != ERROR_OK)
-			return retval;
-		retval = numicro_fmc_cmd(target, ISPCMD_ERASE, NUMICRO_SPROM_BASE2, NUMICRO_SPROM_ISPDAT, &rdat);
-		if (retval != ERROR_OK)
-			return retval;
-		retval = numicro_fmc_cmd(target, ISPCMD_ERASE, NUMICRO_SPROM_BASE3, NUMICRO_SPROM_ISPDAT, &rdat);
+		retval = numicro_fmc_cmd_batch(target, cmds, ARRAY_SIZE(cmds));
 		if (retval != ERROR_OK)
 			return retval;
 	}
@@ -4164,11 +4885,202 @@ COMMAND_HANDLER(numicro_handle_chip_erase_command)
 		LOG_DEBUG("SPROM do not exist");
 	}
 
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(numicro_handle_chip_erase_command)
+{
+	int retval;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	retval = numicro_chip_erase(get_current_target(CMD_CTX));
+	if (retval != ERROR_OK) {
+		command_print(CMD_CTX, "numicro chip_erase failed");
+		return retval;
+	}
+
 	command_print(CMD_CTX, "numicro chip_erase complete");
 
 	return ERROR_OK;
 }
 
+/* Compare the image with the target, by an on-target CRC of each
+ * section where the target supports it, else by reading it back. */
+static int numicro_verify_image(struct target *target, struct image *image)
+{
+	uint8_t *buffer, *data;
+	size_t size;
+	uint32_t checksum, mem_checksum;
+	int retval = ERROR_OK;
+
+	uint32_t total = 0, done = 0;
+	for (int i = 0; i < image->num_sections; i++)
+		total += image->sections[i].size;
+	flash_progress(target, FLASH_PHASE_VERIFY, 0, total);
+
+	for (int i = 0; retval == ERROR_OK && i < image->num_sections; i++) {
+		uint32_t address = image->sections[i].base_address;
+		int64_t start = timeval_ms();
+
+		buffer = malloc(image->sections[i].size);
+		if (buffer == NULL) {
+			LOG_ERROR("no memory for the image section");
+			return ERROR_FAIL;
+		}
+
+		retval = image_read_section(image, i, 0, image->sections[i].size, buffer, &size);
+		if (retval == ERROR_OK)
+			retval = image_calculate_section_checksum(image, i, buffer, size, &checksum);
+		if (retval == ERROR_OK && target_checksum_memory(target, address, size, &mem_checksum) == ERROR_OK) {
+			if (checksum != mem_checksum) {
+				LOG_ERROR("checksum mismatch in section at 0x%08" PRIx32, address);
+				retval = ERROR_FAIL;
+			}
+		}
+		else if (retval == ERROR_OK) {
+			data = malloc(size);
+			if (data == NULL)
+				retval = ERROR_FAIL;
+			else
+				retval = target_read_buffer(target, address, size, data);
+			if (retval == ERROR_OK && memcmp(data, buffer, size) != 0) {
+				LOG_ERROR("verify failed in section at 0x%08" PRIx32, address);
+				retval = ERROR_FAIL;
+			}
+			free(data);
+		}
+
+		free(buffer);
+		if (retval == ERROR_OK) {
+			flash_stats_add(FLASH_PHASE_VERIFY, image->sections[i].size, start);
+			done += image->sections[i].size;
+			flash_progress(target, FLASH_PHASE_VERIFY, done, total);
+		}
+	}
+
+	return retval;
+}
+
+/* numicro production image [offset] ['erase'] ['cbs' (aprom|ldrom)] ['lock']:
+ * erase, program, verify and write CONFIG in one command, so the ISP
+ * setup and the resident loader carry over from one phase to the next. */
+COMMAND_HANDLER(numicro_handle_production_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	struct duration bench, total;
+	struct image image;
+	uint32_t written;
+	bool erase = false, lock = false, set_cbs = false, cbs_aprom = false;
+	int retval;
+
+	if (CMD_ARGC < 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (chip == NULL)
+		return ERROR_FAIL;
+
+	image.base_address_set = 0;
+	image.base_address = 0x0;
+	image.start_address_set = 0;
+
+	for (unsigned int i = 1; i < CMD_ARGC; i++) {
+		if (strcmp(CMD_ARGV[i], "erase") == 0)
+			erase = true;
+		else if (strcmp(CMD_ARGV[i], "lock") == 0)
+			lock = true;
+		else if (strcmp(CMD_ARGV[i], "cbs") == 0 && i + 1 < CMD_ARGC) {
+			set_cbs = true;
+			if (strcmp(CMD_ARGV[++i], "aprom") == 0)
+				cbs_aprom = true;
+			else if (strcmp(CMD_ARGV[i], "ldrom") != 0)
+				return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		else if (i == 1) {
+			image.base_address_set = 1;
+			COMMAND_PARSE_NUMBER(llong, CMD_ARGV[i], image.base_address);
+		}
+		else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	retval = image_open(&image, CMD_ARGV[0], NULL);
+	if (retval != ERROR_OK)
+		return retval;
+
+	duration_start(&total);
+
+	if (erase) {
+		duration_start(&bench);
+		retval = numicro_chip_erase(target);
+		if (retval != ERROR_OK) {
+			command_print(CMD_CTX, "numicro production: erase failed");
+			goto done;
+		}
+		if (duration_measure(&bench) == ERROR_OK)
+			command_print(CMD_CTX, "erase: %fs", duration_elapsed(&bench));
+	}
+
+	duration_start(&bench);
+	retval = flash_write(target, &image, &written, 0);
+	if (retval != ERROR_OK) {
+		command_print(CMD_CTX, "numicro production: program failed");
+		goto done;
+	}
+	if (duration_measure(&bench) == ERROR_OK)
+		command_print(CMD_CTX, "program: %" PRIu32 " bytes in %fs (%0.3f KiB/s)",
+			written, duration_elapsed(&bench), duration_kbps(&bench, written));
+
+	duration_start(&bench);
+	retval = numicro_verify_image(target, &image);
+	if (retval != ERROR_OK) {
+		command_print(CMD_CTX, "numicro production: verify failed");
+		goto done;
+	}
+	if (duration_measure(&bench) == ERROR_OK)
+		command_print(CMD_CTX, "verify: %fs", duration_elapsed(&bench));
+
+	if (set_cbs || lock) {
+		duration_start(&bench);
+		retval = numicro_config_read(target);
+		if (retval == ERROR_OK) {
+			uint32_t config0 = chip->config[0];
+
+			if (set_cbs)
+				config0 = cbs_aprom ? (config0 | CONFIG0_CBS_AP) : (config0 & ~CONFIG0_CBS_AP);
+			/* LOCK is active low */
+			if (lock)
+				config0 &= ~CONFIG0_LOCK_MASK;
+			chip->config_dirty |= chip->config[0] != config0;
+			chip->config[0] = config0;
+
+			retval = numicro_config_flush(target);
+		}
+		if (retval != ERROR_OK) {
+			command_print(CMD_CTX, "numicro production: CONFIG write failed");
+			goto done;
+		}
+		if (duration_measure(&bench) == ERROR_OK)
+			command_print(CMD_CTX, "config: 0x%08" PRIx32 " in %fs", chip->config[0],
+				duration_elapsed(&bench));
+	}
+
+	if (duration_measure(&total) == ERROR_OK)
+		command_print(CMD_CTX, "numicro production complete in %fs", duration_elapsed(&total));
+
+done:
+	image_close(&image);
+
+	return retval;
+}
+
 COMMAND_HANDLER(numicro_handle_M2351_erase_command)
 {
 	int retval = ERROR_OK;
@@ -4177,6 +5089,9 @@ COMMAND_HANDLER(numicro_handle_M2351_erase_command)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	if (chip == NULL)
+		return ERROR_FAIL;
 
 	numicro_get_arm_arch(target);
 	retval = numicro_init_isp(target);
@@ -4184,6 +5099,9 @@ COMMAND_HANDLER(numicro_handle_M2351_erase_command)
 		return retval;
 
 	retval = nulink_usb_M2351_erase(NUC_CHIP_TYPE_M2351);
+	chip->isp_ready = false;
+	chip->config_valid = false;
+	numicro_sectors_unknown(target, 0, 0);
 	if (retval != ERROR_OK) {
 		command_print(CMD_CTX, "numicro M2351_erase failed");
 		return retval;
@@ -4202,6 +5120,9 @@ COMMAND_HANDLER(numicro_handle_NUC505_sram_ini_command)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	if (chip == NULL)
+		return ERROR_FAIL;
 
 	COMMAND_PARSE_NUMBER(ulong, CMD_ARGV[0], address);
 	COMMAND_PARSE_NUMBER(ulong, CMD_ARGV[1], length);
@@ -4210,6 +5131,7 @@ COMMAND_HANDLER(numicro_handle_NUC505_sram_ini_command)
 	target_write_u32(target, 0x40000054, length);
 	target_write_u32(target, 0x4000005C, 0x00000001);
 	/* cpu reset */
+	chip->isp_ready = false;
 	target_write_u32(target, 0x40000008, 0x00000001);
 	/* wait for NUC505 IBR operations */
 	busy_sleep(50);
@@ -4225,8 +5147,12 @@ COMMAND_HANDLER(numicro_handle_NUC505_chip_reset_command)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	struct target *target = get_current_target(CMD_CTX);
+	struct numicro_chip *chip = numicro_get_chip(target);
+	if (chip == NULL)
+		return ERROR_FAIL;
 
 	/* cpu reset */
+	chip->isp_ready = false;
 	target_write_u32(target, 0x40000008, 0x00000002);
 	/* wait for NUC505 IBR operations */
 	busy_sleep(50);
@@ -4240,14 +5166,14 @@ static const struct command_registration numicro_exec_command_handlers[] = {
 	{
 		.name = "read_isp",
 		.handler = numicro_handle_read_isp_command,
-		.usage = "address",
+		.usage = "address [count]",
 		.mode = COMMAND_EXEC,
 		.help = "read flash through ISP.",
 	},
 	{
 		.name = "write_isp",
 		.handler = numicro_handle_write_isp_command,
-		.usage = "address value",
+		.usage = "address value [value ...]",
 		.mode = COMMAND_EXEC,
 		.help = "write flash through ISP.",
 	},
@@ -4258,12 +5184,47 @@ static const struct command_registration numicro_exec_command_handlers[] = {
 		.mode = COMMAND_EXEC,
 		.help = "erase flash through ISP.",
 	},
+	{
+		.name = "checksum",
+		.handler = numicro_handle_checksum_command,
+		.usage = "address length",
+		.mode = COMMAND_EXEC,
+		.help = "compute flash checksum in the FMC.",
+	},
+	{
+		.name = "skip_unchanged",
+		.handler = numicro_handle_skip_unchanged_command,
+		.usage = "['enable'|'disable']",
+		.mode = COMMAND_ANY,
+		.help = "only erase and program sectors whose contents change.",
+	},
+	{
+		.name = "config",
+		.handler = numicro_handle_config_command,
+		.usage = "['set' field value | 'write']",
+		.mode = COMMAND_EXEC,
+		.help = "show or change the CONFIG words, written back by 'write'.",
+	},
+	{
+		.name = "part",
+		.handler = numicro_handle_part_command,
+		.usage = "name partid [base size] ...",
+		.mode = COMMAND_ANY,
+		.help = "describe a part by its PDID and flash banks.",
+	},
 	{
 		.name = "chip_erase",
 		.handler = numicro_handle_chip_erase_command,
 		.mode = COMMAND_EXEC,
 		.help = "chip erase through ISP.",
 	},
+	{
+		.name = "production",
+		.handler = numicro_handle_production_command,
+		.usage = "filename [offset] ['erase'] ['cbs' ('aprom'|'ldrom')] ['lock']",
+		.mode = COMMAND_EXEC,
+		.help = "erase, program, verify and write CONFIG in one run.",
+	},
 	{
 		.name = "M2351_erase",
 		.handler = numicro_handle_M2351_erase_command,
@@ -4302,9 +5263,12 @@ struct flash_driver numicro_flash = {
 	.flash_bank_command = numicro_flash_bank_command,
 	.erase = numicro_erase,
 	.write = numicro_write,
+	.erase_write = numicro_erase_write,
+	.write_start = numicro_write_start,
+	.write_done = numicro_write_done,
 	.read = default_flash_read,
 	.probe = numicro_probe,
 	.auto_probe = numicro_auto_probe,
-	.erase_check = default_flash_blank_check,
+	.erase_check = numicro_erase_check,
 	.protect_check = numicro_protect_check,
 };
@@ -80,3 +80,101 @@ const struct flash_device flash_devices[] = {
 	FLASH_ID("gd gd25q128c",   0xd8, 0xc7, 0x001840c8, 0x100, 0x10000, 0x1000000),
 	FLASH_ID(NULL,             0,    0,	   0,          0,     0,       0)
 };
+
+/* SFDP, JESD216: header, parameter headers and the basic flash
+ * parameter table, all little endian */
+#define SFDP_SIGNATURE		0x50444653	/* "SFDP" */
+#define SFDP_BFPT_ID		0xff00
+#define SFDP_MAX_BFPT_DWORDS	16
+
+/* Read the SFDP of a device that isn't in flash_devices[] and fill *dev
+ * from its basic flash parameter table.  The sector is the largest
+ * erase type the device lists, matching the 64 KiB sectors the table
+ * above uses for most parts. */
+int spi_sfdp_probe(struct flash_bank *bank, uint32_t id,
+		spi_sfdp_read_fn read_sfdp, struct flash_device *dev)
+{
+	uint8_t buf[SFDP_MAX_BFPT_DWORDS * 4];
+	uint32_t bfpt[SFDP_MAX_BFPT_DWORDS] = { 0 };
+	uint32_t bfpt_addr = 0;
+	unsigned int bfpt_len = 0;
+	int retval;
+
+	retval = read_sfdp(bank, 0, 8, buf);
+	if (retval != ERROR_OK)
+		return retval;
+	if (le_to_h_u32(buf) != SFDP_SIGNATURE) {
+		LOG_DEBUG("no SFDP signature");
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	unsigned int num_headers = buf[6] + 1;
+	for (unsigned int i = 0; i < num_headers; i++) {
+		retval = read_sfdp(bank, 8 + 8 * i, 8, buf);
+		if (retval != ERROR_OK)
+			return retval;
+
+		/* the basic table comes first, later major revisions of it
+		 * are not compatible */
+		if ((buf[0] | (buf[7] << 8)) == SFDP_BFPT_ID && buf[2] == 1) {
+			bfpt_len = MIN(buf[3], SFDP_MAX_BFPT_DWORDS);
+			bfpt_addr = le_to_h_u24(buf + 4);
+			break;
+		}
+	}
+	if (bfpt_len < 9) {
+		LOG_DEBUG("no usable SFDP basic flash parameter table");
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	retval = read_sfdp(bank, bfpt_addr, bfpt_len * 4, buf);
+	if (retval != ERROR_OK)
+		return retval;
+	for (unsigned int i = 0; i < bfpt_len; i++)
+		bfpt[i] = le_to_h_u32(buf + 4 * i);
+
+	/* density in bits, either N + 1 or 2^N */
+	uint64_t bits;
+	if (bfpt[1] & 0x80000000)
+		bits = (bfpt[1] & 0x7fffffff) < 64 ? 1ull << (bfpt[1] & 0x7fffffff) : 0;
+	else
+		bits = (uint64_t)bfpt[1] + 1;
+	/* no 4 byte addressing in the drivers */
+	if (bits == 0 || bits / 8 > 0x1000000) {
+		LOG_ERROR("SFDP density of %" PRIu64 " bits not supported", bits);
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	/* erase types 1..4 in dwords 8 and 9: size 2^N, opcode */
+	unsigned int erase_shift = 0;
+	uint8_t erase_cmd = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		uint32_t type = bfpt[7 + i / 2] >> (16 * (i % 2));
+		unsigned int shift = type & 0xff;
+		if (shift != 0 && shift < 32 && shift > erase_shift) {
+			erase_shift = shift;
+			erase_cmd = (type >> 8) & 0xff;
+		}
+	}
+	if (erase_shift == 0) {
+		LOG_ERROR("SFDP lists no erase type");
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	/* page size arrived with JESD216A, 256 before that */
+	dev->pagesize = 256;
+	if (bfpt_len >= 11 && (bfpt[10] >> 4) & 0x0f)
+		dev->pagesize = 1 << ((bfpt[10] >> 4) & 0x0f);
+
+	dev->name = "SFDP";
+	dev->device_id = id;
+	dev->erase_cmd = erase_cmd;
+	dev->chip_erase_cmd = 0xc7;
+	dev->sectorsize = 1ul << erase_shift;
+	dev->size_in_bytes = bits / 8;
+
+	LOG_INFO("SFDP: %lu bytes, %lu byte sectors (erase 0x%02x), %" PRIu32 " byte pages",
+			dev->size_in_bytes, dev->sectorsize, dev->erase_cmd, dev->pagesize);
+
+	return ERROR_OK;
+}
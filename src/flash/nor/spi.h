@@ -46,6 +46,15 @@ struct flash_device {
 
 extern const struct flash_device flash_devices[];
 
+struct flash_bank;
+
+/* reads len bytes of SFDP space at addr, with the dummy byte stripped */
+typedef int (*spi_sfdp_read_fn)(struct flash_bank *bank, uint32_t addr,
+		uint32_t len, uint8_t *buffer);
+
+int spi_sfdp_probe(struct flash_bank *bank, uint32_t id,
+		spi_sfdp_read_fn read_sfdp, struct flash_device *dev);
+
 /* fields in SPI flash status register */
 #define SPIFLASH_BSY_BIT		0x00000001 /* WIP Bit of SPI SR on SMI SR */
 #define SPIFLASH_WE_BIT			0x00000002 /* WEL Bit of SPI SR on SMI SR */
@@ -57,5 +66,6 @@ extern const struct flash_device flash_devices[];
 #define SPIFLASH_PAGE_PROGRAM	0x02 /* Page Program */
 #define SPIFLASH_FAST_READ		0x0B /* Fast Read */
 #define SPIFLASH_READ			0x03 /* Normal Read */
+#define SPIFLASH_READ_SFDP		0x5A /* Read Serial Flash Discoverable Parameters */
 
 #endif /* OPENOCD_FLASH_NOR_SPI_H */
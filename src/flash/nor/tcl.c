@@ -22,6 +22,7 @@
 #endif
 #include "imp.h"
 #include <helper/time_support.h>
+#include <helper/metrics.h>
 #include <target/image.h>
 
 /**
@@ -93,7 +94,7 @@ COMMAND_HANDLER(handle_flash_info_command)
 		struct flash_sector *block_array;
 
 		/* attempt auto probe */
-		retval = p->driver->auto_probe(p);
+		retval = flash_driver_auto_probe(p);
 		if (retval != ERROR_OK)
 			return retval;
 
@@ -165,7 +166,10 @@ COMMAND_HANDLER(handle_flash_probe_command)
 		return retval;
 
 	if (p) {
+		int64_t start = timeval_ms();
 		retval = p->driver->probe(p);
+		if (retval == ERROR_OK)
+			flash_stats_add(FLASH_PHASE_PROBE, 0, start);
 		if (retval == ERROR_OK)
 			command_print(CMD_CTX,
 				"flash '%s' found at 0x%8.8" PRIx32,
@@ -265,8 +269,7 @@ COMMAND_HANDLER(handle_flash_erase_address_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	/* We can't know if we did a resume + halt, in which case we no longer know the erased state
-	 **/
+	/* an explicit erase must not skip sectors believed to be erased */
 	flash_set_dirty();
 
 	struct duration bench;
@@ -401,6 +404,7 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool delta = false;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -413,6 +417,11 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD_CTX, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "delta") == 0) {
+			delta = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD_CTX, "delta programming enabled");
 		} else
 			break;
 	}
@@ -442,7 +451,7 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock(target, &image, &written, auto_erase, auto_unlock);
+	retval = flash_write_unlock(target, &image, &written, auto_erase, auto_unlock, delta);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -754,6 +763,24 @@ COMMAND_HANDLER(handle_flash_verify_bank_command)
 		return ERROR_FAIL;
 	}
 
+	/* the target computes a CRC much faster than the contents can be read
+	 * back, so only do the binary compare when the checksums differ */
+	int64_t start = timeval_ms();
+	uint32_t checksum, mem_checksum;
+	if (image_calculate_checksum(buffer_file, read_cnt, &checksum) == ERROR_OK &&
+		target_checksum_memory(p->target, p->base + offset, read_cnt, &mem_checksum) == ERROR_OK &&
+		checksum == mem_checksum) {
+		flash_stats_add(FLASH_PHASE_VERIFY, read_cnt, start);
+		if (duration_measure(&bench) == ERROR_OK)
+			command_print(CMD_CTX, "verified %ld bytes from file %s and flash bank %u"
+				" at offset 0x%8.8" PRIx32 " in %fs (%0.3f KiB/s)",
+				(long)read_cnt, CMD_ARGV[1], p->bank_number, offset,
+				duration_elapsed(&bench), duration_kbps(&bench, read_cnt));
+		command_print(CMD_CTX, "contents match");
+		free(buffer_file);
+		return ERROR_OK;
+	}
+
 	buffer_flash = malloc(filesize);
 	if (buffer_flash == NULL) {
 		LOG_ERROR("Out of memory");
@@ -776,6 +803,7 @@ COMMAND_HANDLER(handle_flash_verify_bank_command)
 			duration_elapsed(&bench), duration_kbps(&bench, read_cnt));
 
 	differ = memcmp(buffer_file, buffer_flash, read_cnt);
+	flash_stats_add(FLASH_PHASE_VERIFY, read_cnt, start);
 	command_print(CMD_CTX, "contents %s", differ ? "differ" : "match");
 	if (differ) {
 		uint32_t t;
@@ -810,6 +838,68 @@ void flash_set_dirty(void)
 	}
 }
 
+COMMAND_HANDLER(handle_flash_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		flash_stats_reset();
+		return ERROR_OK;
+	}
+
+	for (int i = 0; i < FLASH_PHASE_NUM; i++) {
+		const struct flash_phase_stats *stats = flash_stats_get(i);
+
+		if (stats->calls == 0)
+			continue;
+		command_print(CMD_CTX, "%-8s %6u calls %10" PRIu64 " bytes %8" PRId64 " ms %10.3f KiB/s",
+				flash_phase_name(i), stats->calls, stats->bytes, stats->ms,
+				stats->ms ? (stats->bytes / 1024.0) / (stats->ms / 1000.0) : 0.0);
+	}
+
+	return ERROR_OK;
+}
+
+/* the 'flash stats' table, for the metrics server */
+static void flash_stats_collect(struct metrics_writer *writer, void *priv)
+{
+	char labels[32];
+
+	for (int i = 0; i < FLASH_PHASE_NUM; i++) {
+		snprintf(labels, sizeof(labels), "phase=\"%s\"", flash_phase_name(i));
+		metrics_write(writer, "openocd_flash_calls_total", METRIC_COUNTER,
+				"flash operations per phase", labels, flash_stats_get(i)->calls);
+	}
+	for (int i = 0; i < FLASH_PHASE_NUM; i++) {
+		snprintf(labels, sizeof(labels), "phase=\"%s\"", flash_phase_name(i));
+		metrics_write(writer, "openocd_flash_bytes_total", METRIC_COUNTER,
+				"bytes handled per flash phase", labels, flash_stats_get(i)->bytes);
+	}
+	for (int i = 0; i < FLASH_PHASE_NUM; i++) {
+		snprintf(labels, sizeof(labels), "phase=\"%s\"", flash_phase_name(i));
+		metrics_write(writer, "openocd_flash_seconds_total", METRIC_COUNTER,
+				"time spent per flash phase", labels, flash_stats_get(i)->ms / 1e3);
+	}
+}
+
+COMMAND_HANDLER(handle_flash_progress_command)
+{
+	const struct flash_progress *progress = flash_progress_get();
+	int64_t elapsed = timeval_ms() - progress->start_ms;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	/* phase, bytes done, bytes total, bytes per second */
+	command_print(CMD_CTX, "%s %" PRIu32 " %" PRIu32 " %" PRIu64,
+			flash_phase_name(progress->phase), progress->done, progress->total,
+			elapsed > 0 ? (uint64_t)progress->done * 1000 / elapsed : 0);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_flash_padded_value_command)
 {
 	if (CMD_ARGC != 2)
@@ -909,7 +999,7 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [delta] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
 			"and/or erase the region to be used.  Allow optional "
 			"offset from beginning of bank (defaults to zero)",
@@ -948,6 +1038,21 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.usage = "bank_id value",
 		.help = "Set default flash padded value",
 	},
+	{
+		.name = "stats",
+		.handler = handle_flash_stats_command,
+		.mode = COMMAND_EXEC,
+		.usage = "['reset']",
+		.help = "Show time and throughput per flash operation phase",
+	},
+	{
+		.name = "progress",
+		.handler = handle_flash_progress_command,
+		.mode = COMMAND_EXEC,
+		.usage = "",
+		.help = "Report phase, bytes done, bytes total and bytes/s "
+			"of the running flash operation",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -1142,5 +1247,6 @@ static const struct command_registration flash_command_handlers[] = {
 
 int flash_register_commands(struct command_context *cmd_ctx)
 {
+	metrics_add_collector(flash_stats_collect, NULL);
 	return register_commands(cmd_ctx, NULL, flash_command_handlers);
 }
@@ -142,8 +142,8 @@ static int virtual_probe(struct flash_bank *bank)
 	if (master_bank == NULL)
 		return ERROR_FLASH_OPERATION_FAILED;
 
-	/* call master handler */
-	retval = master_bank->driver->probe(master_bank);
+	/* share the master's probe results rather than probing it again */
+	retval = master_bank->driver->auto_probe(master_bank);
 	if (retval != ERROR_OK)
 		return retval;
 
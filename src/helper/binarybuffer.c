@@ -97,7 +97,18 @@ bool buf_cmp_mask(const void *_buf1, const void *_buf2,
 
 	const uint8_t *buf1 = _buf1, *buf2 = _buf2, *mask = _mask;
 	unsigned last = size / 8;
-	for (unsigned i = 0; i < last; i++) {
+	unsigned i = 0;
+
+	/* eight bytes at a time for long scans, e.g. SVF */
+	for (; i + 8 <= last; i += 8) {
+		uint64_t a, b, m;
+		memcpy(&a, buf1 + i, 8);
+		memcpy(&b, buf2 + i, 8);
+		memcpy(&m, mask + i, 8);
+		if ((a ^ b) & m)
+			return true;
+	}
+	for (; i < last; i++) {
 		if (buf_cmp_masked(buf1[i], buf2[i], mask[i]))
 			return true;
 	}
@@ -128,42 +139,28 @@ void *buf_set_buf(const void *_src, unsigned src_start,
 {
 	const uint8_t *src = _src;
 	uint8_t *dst = _dst;
-	unsigned i, sb, db, sq, dq, lb, lq;
+	unsigned i, sq, dq, lb, lq;
 
-	sb = src_start / 8;
-	db = dst_start / 8;
 	sq = src_start % 8;
 	dq = dst_start % 8;
 	lb = len / 8;
 	lq = len % 8;
 
-	src += sb;
-	dst += db;
-
-	/* check if both buffers are on byte boundary and
-	 * len is a multiple of 8bit so we can simple copy
-	 * the buffer */
-	if ((sq == 0) && (dq == 0) &&  (lq == 0)) {
-		for (i = 0; i < lb; i++)
-			*dst++ = *src++;
+	/* both buffers on a byte boundary: copy the whole bytes and
+	 * merge the trailing bits */
+	if ((sq == 0) && (dq == 0)) {
+		memcpy(dst + dst_start / 8, src + src_start / 8, lb);
+		if (lq)
+			buf_set_u32(dst, dst_start + 8 * lb, lq,
+					buf_get_u32(src, src_start + 8 * lb, lq));
 		return _dst;
 	}
 
-	/* fallback to slow bit copy */
-	for (i = 0; i < len; i++) {
-		if (((*src >> (sq&7)) & 1) == 1)
-			*dst |= 1 << (dq&7);
-		else
-			*dst &= ~(1 << (dq&7));
-		if (sq++ == 7) {
-			sq = 0;
-			src++;
-		}
-		if (dq++ == 7) {
-			dq = 0;
-			dst++;
-		}
-	}
+	/* otherwise shift through 32-bit words */
+	for (i = 0; i + 32 <= len; i += 32)
+		buf_set_u32(dst, dst_start + i, 32, buf_get_u32(src, src_start + i, 32));
+	if (i < len)
+		buf_set_u32(dst, dst_start + i, len - i, buf_get_u32(src, src_start + i, len - i));
 
 	return _dst;
 }
@@ -181,6 +178,12 @@ uint32_t flip_u32(uint32_t value, unsigned int num)
 	return c;
 }
 
+void buf_flip_u8(uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = bit_reverse_table256[buf[i]];
+}
+
 static int ceil_f_to_u32(float x)
 {
 	if (x < 0)	/* return zero for negative numbers */
@@ -47,12 +47,18 @@ static inline void buf_set_u32(uint8_t *_buffer,
 		buffer[2] = (value >> 16) & 0xff;
 		buffer[1] = (value >> 8) & 0xff;
 		buffer[0] = (value >> 0) & 0xff;
-	} else {
-		for (unsigned i = first; i < first + num; i++) {
-			if (((value >> (i - first)) & 1) == 1)
-				buffer[i / 8] |= 1 << (i % 8);
+	} else if (num > 0) {
+		/* a byte at a time, masking the partial bytes at either end */
+		unsigned shift = first % 8;
+		uint64_t mask = (((uint64_t)1 << num) - 1) << shift;
+		uint64_t bits = ((uint64_t)value << shift) & mask;
+
+		buffer += first / 8;
+		for (; mask; mask >>= 8, bits >>= 8, buffer++) {
+			if ((mask & 0xff) == 0xff)
+				*buffer = bits;
 			else
-				buffer[i / 8] &= ~(1 << (i % 8));
+				*buffer = (*buffer & ~mask) | bits;
 		}
 	}
 }
@@ -85,14 +91,11 @@ static inline void buf_set_u64(uint8_t *_buffer,
 		buffer[2] = (value >> 16) & 0xff;
 		buffer[1] = (value >> 8) & 0xff;
 		buffer[0] = (value >> 0) & 0xff;
-	} else {
-		for (unsigned i = first; i < first + num; i++) {
-			if (((value >> (i - first)) & 1) == 1)
-				buffer[i / 8] |= 1 << (i % 8);
-			else
-				buffer[i / 8] &= ~(1 << (i % 8));
-		}
-	}
+	} else if (num > 32) {
+		buf_set_u32(buffer, first, 32, value);
+		buf_set_u32(buffer, first + 32, num - 32, value >> 32);
+	} else
+		buf_set_u32(buffer, first, num, value);
 }
 
 /**
@@ -114,14 +117,18 @@ static inline uint32_t buf_get_u32(const uint8_t *_buffer,
 				(((uint32_t)buffer[2]) << 16) |
 				(((uint32_t)buffer[1]) << 8) |
 				(((uint32_t)buffer[0]) << 0);
-	} else {
-		uint32_t result = 0;
-		for (unsigned i = first; i < first + num; i++) {
-			if (((buffer[i / 8] >> (i % 8)) & 1) == 1)
-				result |= 1 << (i - first);
-		}
-		return result;
-	}
+	} else if (num > 0) {
+		/* gather the bytes holding the field, then shift it down */
+		unsigned shift = first % 8;
+		unsigned bytes = (shift + num + 7) / 8;
+		uint64_t bits = 0;
+
+		buffer += first / 8;
+		for (unsigned i = 0; i < bytes; i++)
+			bits |= (uint64_t)buffer[i] << (8 * i);
+		return (bits >> shift) & ((((uint64_t)1) << num) - 1);
+	} else
+		return 0;
 }
 
 /**
@@ -152,12 +159,11 @@ static inline uint64_t buf_get_u64(const uint8_t *_buffer,
 				(((uint64_t)buffer[2]) << 16) |
 				(((uint64_t)buffer[1]) << 8)  |
 				(((uint64_t)buffer[0]) << 0));
+	} else if (num > 32) {
+		return buf_get_u32(buffer, first, 32) |
+			((uint64_t)buf_get_u32(buffer, first + 32, num - 32) << 32);
 	} else {
-		uint64_t result = 0;
-		for (unsigned i = first; i < first + num; i++) {
-			if (((buffer[i / 8] >> (i % 8)) & 1) == 1)
-				result = result | ((uint64_t)1 << (uint64_t)(i - first));
-		}
+		uint64_t result = buf_get_u32(buffer, first, num);
 		return result;
 	}
 }
@@ -173,6 +179,14 @@ static inline uint64_t buf_get_u64(const uint8_t *_buffer,
  */
 uint32_t flip_u32(uint32_t value, unsigned width);
 
+/**
+ * Inverts the ordering of bits inside each byte of a buffer, in place.
+ * Equivalent to calling flip_u32(b, 8) on every byte.
+ * @param buf The buffer to flip.
+ * @param len The number of bytes.
+ */
+void buf_flip_u8(uint8_t *buf, size_t len);
+
 bool buf_cmp(const void *buf1, const void *buf2, unsigned size);
 bool buf_cmp_mask(const void *buf1, const void *buf2,
 		const void *mask, unsigned size);
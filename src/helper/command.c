@@ -39,6 +39,7 @@
 #include "configuration.h"
 #include "log.h"
 #include "time_support.h"
+#include "tracelog.h"
 #include "jim-eventloop.h"
 
 /* nice short description of source file */
@@ -230,6 +231,47 @@ static struct command *command_root(struct command *c)
 	return c;
 }
 
+/* All commands, hashed by scope and name.  The top level has a few
+ * hundred entries once each driver and target type has registered its
+ * own, too many to search the sibling list on every dispatch.  The scope
+ * of a subcommand is its parent; top level commands have none, so theirs
+ * is the interpreter, which copies of a context share along with their
+ * command list.  The lists stay, sorted, for help and usage output. */
+#define COMMAND_HASH_SIZE 2048
+
+static struct command *command_hash[COMMAND_HASH_SIZE];
+
+static unsigned command_hash_index(const void *scope, const char *name)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261u ^ (uint32_t)(uintptr_t)scope;
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h & (COMMAND_HASH_SIZE - 1);
+}
+
+static void command_hash_add(struct command *c)
+{
+	unsigned i = command_hash_index(c->hash_scope, c->name);
+
+	c->hash_next = command_hash[i];
+	command_hash[i] = c;
+}
+
+static void command_hash_remove(struct command *c)
+{
+	struct command **p = &command_hash[command_hash_index(c->hash_scope, c->name)];
+
+	for (; *p; p = &(*p)->hash_next) {
+		if (*p == c) {
+			*p = c->hash_next;
+			return;
+		}
+	}
+}
+
 /**
  * Find a command by name from a list of commands.
  * @returns Returns the named command if it exists in the list.
@@ -237,8 +279,14 @@ static struct command *command_root(struct command *c)
  */
 static struct command *command_find(struct command *head, const char *name)
 {
-	for (struct command *cc = head; cc; cc = cc->next) {
-		if (strcmp(cc->name, name) == 0)
+	if (head == NULL)
+		return NULL;
+
+	/* siblings share the scope */
+	const void *scope = head->hash_scope;
+	for (struct command *cc = command_hash[command_hash_index(scope, name)];
+			cc; cc = cc->hash_next) {
+		if (cc->hash_scope == scope && strcmp(cc->name, name) == 0)
 			return cc;
 	}
 	return NULL;
@@ -291,6 +339,9 @@ static void command_free(struct command *c)
 {
 	/** @todo if command has a handler, unregister its jim command! */
 
+	if (c->name)
+		command_hash_remove(c);
+
 	while (NULL != c->children) {
 		struct command *tmp = c->children;
 		c->children = tmp->next;
@@ -337,12 +388,14 @@ static struct command *command_new(struct command_context *cmd_ctx,
 		goto command_new_error;
 
 	c->parent = parent;
+	c->hash_scope = parent ? (const void *)parent : (const void *)cmd_ctx->interp;
 	c->handler = cr->handler;
 	c->jim_handler = cr->jim_handler;
 	c->jim_handler_data = cr->jim_handler_data;
 	c->mode = cr->mode;
 
 	command_add_child(command_list_for_parent(cmd_ctx, parent), c);
+	command_hash_add(c);
 
 	return c;
 
@@ -608,7 +661,9 @@ static int run_command(struct command_context *context,
 		.argc = num_words - 1,
 		.argv = words + 1,
 	};
+	tracelog_begin(TRACELOG_COMMAND, c->name, cmd.argc, 0);
 	int retval = c->handler(&cmd);
+	tracelog_end(TRACELOG_COMMAND, c->name, retval);
 	if (retval == ERROR_COMMAND_SYNTAX_ERROR) {
 		/* Print help for command */
 		char *full_name = command_name(c, ' ');
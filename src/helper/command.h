@@ -170,6 +170,8 @@ struct command {
 	void *jim_handler_data;
 	enum command_mode mode;
 	struct command *next;
+	struct command *hash_next;	/* same bucket of the lookup table */
+	const void *hash_scope;		/* parent, or the interpreter at the top level */
 };
 
 /**
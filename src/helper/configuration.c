@@ -31,8 +31,59 @@ static char **config_file_names;
 static size_t num_script_dirs;
 static char **script_search_dirs;
 
+/* Where find_file() found a name in the search path.  The same target and
+ * interface scripts are looked up again and again, each time costing one
+ * fopen() per search directory.  Cleared when the search path changes. */
+struct found_file {
+	char *file;
+	char *full_path;
+	struct found_file *next;
+};
+
+static struct found_file *found_files;
+
+static void found_files_clear(void)
+{
+	while (found_files) {
+		struct found_file *f = found_files;
+		found_files = f->next;
+		free(f->file);
+		free(f->full_path);
+		free(f);
+	}
+}
+
+static void found_files_add(const char *file, const char *full_path)
+{
+	struct found_file *f = malloc(sizeof(*f));
+	if (f == NULL)
+		return;
+
+	f->file = strdup(file);
+	f->full_path = strdup(full_path);
+	if (f->file == NULL || f->full_path == NULL) {
+		free(f->file);
+		free(f->full_path);
+		free(f);
+		return;
+	}
+	f->next = found_files;
+	found_files = f;
+}
+
+static struct found_file *found_files_lookup(const char *file)
+{
+	for (struct found_file *f = found_files; f; f = f->next) {
+		if (strcmp(f->file, file) == 0)
+			return f;
+	}
+	return NULL;
+}
+
 void add_script_search_dir(const char *dir)
 {
+	found_files_clear();
+
 	num_script_dirs++;
 	script_search_dirs = realloc(script_search_dirs, (num_script_dirs + 1) * sizeof(char *));
 
@@ -51,13 +102,13 @@ void add_config_command(const char *cfg)
 	config_file_names[num_config_files] = NULL;
 }
 
-/* return full path or NULL according to search rules */
-char *find_file(const char *file)
+/* Open 'file' according to the search rules; the full path is returned
+ * in 'path' and must be freed by the caller.  NULL if not found. */
+static FILE *find_file_open(const char *file, const char *mode, char **path)
 {
 	FILE *fp = NULL;
 	char **search_dirs = script_search_dirs;
 	char *dir;
-	char const *mode = "r";
 	char *full_path;
 
 	/* Check absolute and relative to current working dir first.
@@ -65,6 +116,17 @@ char *find_file(const char *file)
 	full_path = alloc_printf("%s", file);
 	fp = fopen(full_path, mode);
 
+	if (!fp) {
+		struct found_file *f = found_files_lookup(file);
+		if (f) {
+			fp = fopen(f->full_path, mode);
+			if (fp) {
+				free(full_path);
+				full_path = alloc_printf("%s", f->full_path);
+			}
+		}
+	}
+
 	while (!fp) {
 		free(full_path);
 		full_path = NULL;
@@ -75,12 +137,14 @@ char *find_file(const char *file)
 
 		full_path = alloc_printf("%s/%s", dir, file);
 		fp = fopen(full_path, mode);
+		if (fp)
+			found_files_add(file, full_path);
 	}
 
 	if (fp) {
-		fclose(fp);
 		LOG_DEBUG("found %s", full_path);
-		return full_path;
+		*path = full_path;
+		return fp;
 	}
 
 	free(full_path);
@@ -88,17 +152,28 @@ char *find_file(const char *file)
 	return NULL;
 }
 
+/* return full path or NULL according to search rules */
+char *find_file(const char *file)
+{
+	char *full_path;
+	FILE *fp = find_file_open(file, "r", &full_path);
+
+	if (fp == NULL)
+		return NULL;
+
+	fclose(fp);
+	return full_path;
+}
+
 FILE *open_file_from_path(const char *file, const char *mode)
 {
 	if (mode[0] != 'r')
 		return fopen(file, mode);
 	else {
-		char *full_path = find_file(file);
-		if (full_path == NULL)
-			return NULL;
-		FILE *fp = NULL;
-		fp = fopen(full_path, mode);
-		free(full_path);
+		char *full_path;
+		FILE *fp = find_file_open(file, mode, &full_path);
+		if (fp)
+			free(full_path);
 		return fp;
 	}
 }
@@ -30,14 +30,454 @@
 #include "configuration.h"
 #include "fileio.h"
 
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* stdio buffer size for files opened for reading */
+#define FILEIO_READ_AHEAD (64 * 1024)
+
+enum fileio_codec {
+	FILEIO_CODEC_GZIP,
+	FILEIO_CODEC_XZ,
+	FILEIO_CODEC_ZSTD,
+};
+
+/* A compressed file opened for reading is decompressed while it is read:
+ * its data never goes to disk, and the parsers see the plain image.
+ * Seeking back restarts the decoder, the size is found by decoding the
+ * whole stream once. */
+struct fileio_stream {
+	enum fileio_codec codec;
+	uint8_t *in;
+	size_t in_len, in_pos;
+	bool in_eof;
+	uint8_t *out;
+	size_t out_len, out_pos;
+	size_t pos;		/* of out[0] in the decompressed data */
+	bool boundary;	/* decoder at the end of a stream or frame */
+	bool eof;
+	bool size_known;
+#ifdef HAVE_ZLIB
+	z_stream gzip;
+#endif
+#ifdef HAVE_LZMA
+	lzma_stream xz;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zstd;
+#endif
+};
+
 struct fileio {
 	char *url;
 	size_t size;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	uint8_t *map;	/* private mapping of the whole file, see fileio_map() */
+#ifdef _WIN32
+	HANDLE map_handle;
+#endif
+	struct fileio_stream *stream;	/* NULL unless compressed */
+};
+
+static const struct {
+	enum fileio_codec codec;
+	const char *name;
+	uint8_t magic[6];
+	size_t magic_len;
+	bool supported;
+} fileio_codecs[] = {
+	{ FILEIO_CODEC_GZIP, "gzip", { 0x1f, 0x8b }, 2,
+#ifdef HAVE_ZLIB
+		true },
+#else
+		false },
+#endif
+	{ FILEIO_CODEC_XZ, "xz", { 0xfd, '7', 'z', 'X', 'Z', 0x00 }, 6,
+#ifdef HAVE_LZMA
+		true },
+#else
+		false },
+#endif
+	{ FILEIO_CODEC_ZSTD, "zstd", { 0x28, 0xb5, 0x2f, 0xfd }, 4,
+#ifdef HAVE_ZSTD
+		true },
+#else
+		false },
+#endif
 };
 
+static void fileio_stream_end(struct fileio_stream *stream)
+{
+	switch (stream->codec) {
+#ifdef HAVE_ZLIB
+	case FILEIO_CODEC_GZIP:
+		inflateEnd(&stream->gzip);
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case FILEIO_CODEC_XZ:
+		lzma_end(&stream->xz);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case FILEIO_CODEC_ZSTD:
+		ZSTD_freeDStream(stream->zstd);
+		stream->zstd = NULL;
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+/* (re)start decoding at the beginning of the file */
+static int fileio_stream_start(struct fileio *fileio)
+{
+	struct fileio_stream *stream = fileio->stream;
+	bool ok = false;
+
+	if (fseek(fileio->file, 0, SEEK_SET) != 0)
+		return ERROR_FILEIO_OPERATION_FAILED;
+
+	stream->in_len = stream->in_pos = 0;
+	stream->in_eof = false;
+	stream->out_len = stream->out_pos = 0;
+	stream->pos = 0;
+	stream->boundary = false;
+	stream->eof = false;
+
+	switch (stream->codec) {
+#ifdef HAVE_ZLIB
+	case FILEIO_CODEC_GZIP:
+		memset(&stream->gzip, 0, sizeof(stream->gzip));
+		/* 16: gzip header and trailer */
+		ok = inflateInit2(&stream->gzip, 16 + MAX_WBITS) == Z_OK;
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case FILEIO_CODEC_XZ:
+		memset(&stream->xz, 0, sizeof(stream->xz));
+		ok = lzma_stream_decoder(&stream->xz, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK;
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case FILEIO_CODEC_ZSTD:
+		stream->zstd = ZSTD_createDStream();
+		ok = stream->zstd && !ZSTD_isError(ZSTD_initDStream(stream->zstd));
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (!ok) {
+		LOG_ERROR("couldn't start decompressing %s", fileio->url);
+		return ERROR_FILEIO_OPERATION_FAILED;
+	}
+	return ERROR_OK;
+}
+
+/* run the decoder on what is in stream->in, appending to stream->out */
+static int fileio_stream_decode(struct fileio_stream *stream)
+{
+	switch (stream->codec) {
+#ifdef HAVE_ZLIB
+	case FILEIO_CODEC_GZIP:
+	{
+		z_stream *z = &stream->gzip;
+		int ret;
+
+		z->next_in = stream->in + stream->in_pos;
+		z->avail_in = stream->in_len - stream->in_pos;
+		z->next_out = stream->out + stream->out_len;
+		z->avail_out = FILEIO_READ_AHEAD - stream->out_len;
+		ret = inflate(z, Z_NO_FLUSH);
+		stream->in_pos = stream->in_len - z->avail_in;
+		stream->out_len = FILEIO_READ_AHEAD - z->avail_out;
+
+		if (ret == Z_STREAM_END) {
+			/* another member may follow */
+			stream->boundary = true;
+			inflateReset(z);
+		} else if (ret == Z_OK)
+			stream->boundary = false;
+		else if (ret != Z_BUF_ERROR)
+			return ERROR_FILEIO_OPERATION_FAILED;
+		return ERROR_OK;
+	}
+#endif
+#ifdef HAVE_LZMA
+	case FILEIO_CODEC_XZ:
+	{
+		lzma_stream *xz = &stream->xz;
+		lzma_ret ret;
+
+		xz->next_in = stream->in + stream->in_pos;
+		xz->avail_in = stream->in_len - stream->in_pos;
+		xz->next_out = stream->out + stream->out_len;
+		xz->avail_out = FILEIO_READ_AHEAD - stream->out_len;
+		ret = lzma_code(xz, stream->in_eof ? LZMA_FINISH : LZMA_RUN);
+		stream->in_pos = stream->in_len - xz->avail_in;
+		stream->out_len = FILEIO_READ_AHEAD - xz->avail_out;
+
+		if (ret == LZMA_STREAM_END) {
+			stream->boundary = true;
+			stream->eof = true;
+		} else if (ret != LZMA_OK && ret != LZMA_BUF_ERROR)
+			return ERROR_FILEIO_OPERATION_FAILED;
+		return ERROR_OK;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case FILEIO_CODEC_ZSTD:
+	{
+		ZSTD_inBuffer in = { stream->in, stream->in_len, stream->in_pos };
+		ZSTD_outBuffer out = { stream->out, FILEIO_READ_AHEAD, stream->out_len };
+		size_t ret;
+
+		ret = ZSTD_decompressStream(stream->zstd, &out, &in);
+		if (ZSTD_isError(ret))
+			return ERROR_FILEIO_OPERATION_FAILED;
+		stream->in_pos = in.pos;
+		stream->out_len = out.pos;
+		/* 0 when a frame is complete */
+		stream->boundary = ret == 0;
+		return ERROR_OK;
+	}
+#endif
+	default:
+		return ERROR_FILEIO_OPERATION_FAILED;
+	}
+}
+
+/* refill stream->out with the next decompressed data, empty at the end */
+static int fileio_stream_fill(struct fileio *fileio)
+{
+	struct fileio_stream *stream = fileio->stream;
+
+	stream->pos += stream->out_len;
+	stream->out_len = stream->out_pos = 0;
+
+	while (stream->out_len == 0 && !stream->eof) {
+		size_t in_pos = stream->in_pos;
+
+		if (stream->in_pos == stream->in_len && !stream->in_eof) {
+			stream->in_len = fread(stream->in, 1, FILEIO_READ_AHEAD, fileio->file);
+			stream->in_pos = 0;
+			in_pos = 0;
+			if (stream->in_len == 0) {
+				if (ferror(fileio->file)) {
+					LOG_ERROR("couldn't read %s: %s", fileio->url, strerror(errno));
+					return ERROR_FILEIO_OPERATION_FAILED;
+				}
+				stream->in_eof = true;
+			}
+		}
+
+		if (fileio_stream_decode(stream) != ERROR_OK) {
+			LOG_ERROR("%s: corrupt compressed data", fileio->url);
+			return ERROR_FILEIO_OPERATION_FAILED;
+		}
+
+		/* all input used up and the decoder has nothing more to give */
+		if (stream->out_len == 0 && stream->in_pos == in_pos &&
+				stream->in_eof && stream->in_pos == stream->in_len) {
+			if (!stream->boundary) {
+				LOG_ERROR("%s: compressed data is truncated", fileio->url);
+				return ERROR_FILEIO_OPERATION_FAILED;
+			}
+			stream->eof = true;
+		}
+	}
+
+	if (stream->eof && stream->out_len == 0 && !stream->size_known) {
+		fileio->size = stream->pos;
+		stream->size_known = true;
+	}
+	return ERROR_OK;
+}
+
+static int fileio_stream_read(struct fileio *fileio, size_t size, void *buffer,
+		size_t *size_read)
+{
+	struct fileio_stream *stream = fileio->stream;
+	uint8_t *p = buffer;
+
+	*size_read = 0;
+	while (size) {
+		size_t n = stream->out_len - stream->out_pos;
+
+		if (n == 0) {
+			int retval = fileio_stream_fill(fileio);
+			if (retval != ERROR_OK)
+				return retval;
+			n = stream->out_len;
+			if (n == 0)
+				break;
+		}
+		if (n > size)
+			n = size;
+		if (p)
+			memcpy(p, stream->out + stream->out_pos, n);
+		stream->out_pos += n;
+		*size_read += n;
+		size -= n;
+		if (p)
+			p += n;
+	}
+	return ERROR_OK;
+}
+
+static int fileio_stream_seek(struct fileio *fileio, size_t position)
+{
+	struct fileio_stream *stream = fileio->stream;
+	size_t current = stream->pos + stream->out_pos;
+	size_t skipped;
+	int retval;
+
+	if (position < current) {
+		/* back into what is still in the buffer, or from the start */
+		if (position >= stream->pos) {
+			stream->out_pos = position - stream->pos;
+			return ERROR_OK;
+		}
+		fileio_stream_end(stream);
+		retval = fileio_stream_start(fileio);
+		if (retval != ERROR_OK)
+			return retval;
+		current = 0;
+	}
+
+	retval = fileio_stream_read(fileio, position - current, NULL, &skipped);
+	if (retval == ERROR_OK && skipped != position - current)
+		retval = ERROR_FILEIO_OPERATION_FAILED;
+	return retval;
+}
+
+static int fileio_stream_fgets(struct fileio *fileio, size_t size, void *buffer)
+{
+	struct fileio_stream *stream = fileio->stream;
+	char *p = buffer;
+	size_t len = 0;
+
+	while (len + 1 < size) {
+		if (stream->out_pos == stream->out_len) {
+			if (fileio_stream_fill(fileio) != ERROR_OK || stream->out_len == 0)
+				break;
+		}
+		p[len] = stream->out[stream->out_pos++];
+		if (p[len++] == '\n')
+			break;
+	}
+
+	if (len == 0)
+		return ERROR_FILEIO_OPERATION_FAILED;
+	p[len] = '\0';
+	return ERROR_OK;
+}
+
+/* the decompressed size, decoding the whole stream the first time */
+static int fileio_stream_size(struct fileio *fileio)
+{
+	struct fileio_stream *stream = fileio->stream;
+	size_t position = stream->pos + stream->out_pos;
+	size_t skipped;
+	int retval;
+
+	if (stream->size_known)
+		return ERROR_OK;
+
+	retval = fileio_stream_read(fileio, SIZE_MAX, NULL, &skipped);
+	if (retval == ERROR_OK)
+		retval = fileio_stream_seek(fileio, position);
+	return retval;
+}
+
+static void fileio_stream_close(struct fileio *fileio)
+{
+	if (fileio->stream == NULL)
+		return;
+	fileio_stream_end(fileio->stream);
+	free(fileio->stream->in);
+	free(fileio->stream->out);
+	free(fileio->stream);
+	fileio->stream = NULL;
+}
+
+/* decompress the file while reading it if it starts with a known magic */
+static int fileio_stream_open(struct fileio *fileio)
+{
+	uint8_t magic[6];
+	size_t len;
+	int retval;
+
+	len = fread(magic, 1, sizeof(magic), fileio->file);
+	if (fseek(fileio->file, 0, SEEK_SET) != 0)
+		return ERROR_FILEIO_OPERATION_FAILED;
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(fileio_codecs); i++) {
+		if (len < fileio_codecs[i].magic_len ||
+				memcmp(magic, fileio_codecs[i].magic, fileio_codecs[i].magic_len))
+			continue;
+
+		if (!fileio_codecs[i].supported) {
+			LOG_DEBUG("%s looks %s compressed, but this build can't decompress it",
+				fileio->url, fileio_codecs[i].name);
+			return ERROR_OK;
+		}
+
+		LOG_DEBUG("decompressing %s (%s)", fileio->url, fileio_codecs[i].name);
+		fileio->stream = calloc(1, sizeof(*fileio->stream));
+		if (fileio->stream == NULL)
+			return ERROR_FAIL;
+		fileio->stream->codec = fileio_codecs[i].codec;
+		fileio->stream->in = malloc(FILEIO_READ_AHEAD);
+		fileio->stream->out = malloc(FILEIO_READ_AHEAD);
+		if (fileio->stream->in == NULL || fileio->stream->out == NULL) {
+			free(fileio->stream->in);
+			free(fileio->stream->out);
+			free(fileio->stream);
+			fileio->stream = NULL;
+			return ERROR_FAIL;
+		}
+
+		retval = fileio_stream_start(fileio);
+		if (retval != ERROR_OK)
+			fileio_stream_close(fileio);
+		return retval;
+	}
+	return ERROR_OK;
+}
+
+static void fileio_unmap(struct fileio *fileio)
+{
+	if (fileio->map == NULL)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(fileio->map);
+	CloseHandle(fileio->map_handle);
+#else
+	munmap(fileio->map, fileio->size);
+#endif
+	fileio->map = NULL;
+}
+
 static inline int fileio_close_local(struct fileio *fileio)
 {
 	int retval = fclose(fileio->file);
@@ -91,6 +531,11 @@ static inline int fileio_open_local(struct fileio *fileio)
 		return ERROR_FILEIO_OPERATION_FAILED;
 	}
 
+	/* image parsers read lines or a few bytes at a time; this keeps
+	 * the number of reads low, notably on network shares */
+	if (fileio->access == FILEIO_READ)
+		setvbuf(fileio->file, NULL, _IOFBF, FILEIO_READ_AHEAD);
+
 	file_size = 0;
 
 	if ((fileio->access != FILEIO_WRITE) || (fileio->access == FILEIO_READWRITE)) {
@@ -113,6 +558,14 @@ static inline int fileio_open_local(struct fileio *fileio)
 
 	fileio->size = file_size;
 
+	if (fileio->access == FILEIO_READ) {
+		int retval = fileio_stream_open(fileio);
+		if (retval != ERROR_OK) {
+			fileio_close_local(fileio);
+			return retval;
+		}
+	}
+
 	return ERROR_OK;
 }
 
@@ -127,6 +580,8 @@ int fileio_open(struct fileio **fileio, const char *url,
 	tmp->type = type;
 	tmp->access = access_type;
 	tmp->url = strdup(url);
+	tmp->map = NULL;
+	tmp->stream = NULL;
 
 	retval = fileio_open_local(tmp);
 
@@ -145,6 +600,8 @@ int fileio_close(struct fileio *fileio)
 {
 	int retval;
 
+	fileio_unmap(fileio);
+	fileio_stream_close(fileio);
 	retval = fileio_close_local(fileio);
 
 	free(fileio->url);
@@ -153,10 +610,59 @@ int fileio_close(struct fileio *fileio)
 	return retval;
 }
 
+/**
+ * Map the whole of a binary file opened for reading into memory.  The
+ * mapping is copy-on-write, so callers may modify the data in place
+ * without touching the file; it stays valid until fileio_close().
+ * Returns ERROR_FILEIO_OPERATION_NOT_SUPPORTED when the file can't be
+ * mapped, callers then fall back to fileio_read().
+ */
+int fileio_map(struct fileio *fileio, uint8_t **data)
+{
+	if (fileio->map) {
+		*data = fileio->map;
+		return ERROR_OK;
+	}
+
+	if (fileio->access != FILEIO_READ || fileio->type != FILEIO_BINARY ||
+			fileio->size == 0 || fileio->stream)
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+#ifdef _WIN32
+	HANDLE file = (HANDLE)_get_osfhandle(fileno(fileio->file));
+	if (file == INVALID_HANDLE_VALUE)
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+	fileio->map_handle = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (fileio->map_handle == NULL)
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+	fileio->map = MapViewOfFile(fileio->map_handle, FILE_MAP_COPY, 0, 0, fileio->size);
+	if (fileio->map == NULL) {
+		CloseHandle(fileio->map_handle);
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+	}
+#else
+	void *map = mmap(NULL, fileio->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			fileno(fileio->file), 0);
+	if (map == MAP_FAILED) {
+		LOG_DEBUG("couldn't map %s: %s", fileio->url, strerror(errno));
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+	}
+	fileio->map = map;
+#endif
+
+	*data = fileio->map;
+	return ERROR_OK;
+}
+
 int fileio_seek(struct fileio *fileio, size_t position)
 {
 	int retval;
 
+	if (fileio->stream)
+		return fileio_stream_seek(fileio, position);
+
 	retval = fseek(fileio->file, position, SEEK_SET);
 
 	if (retval != 0) {
@@ -172,6 +678,9 @@ static int fileio_local_read(struct fileio *fileio, size_t size, void *buffer,
 {
 	ssize_t retval;
 
+	if (fileio->stream)
+		return fileio_stream_read(fileio, size, buffer, size_read);
+
 	retval = fread(buffer, 1, size, fileio->file);
 	*size_read = (retval >= 0) ? retval : 0;
 
@@ -202,6 +711,9 @@ int fileio_read_u32(struct fileio *fileio, uint32_t *data)
 
 static int fileio_local_fgets(struct fileio *fileio, size_t size, void *buffer)
 {
+	if (fileio->stream)
+		return fileio_stream_fgets(fileio, size, buffer);
+
 	if (fgets(buffer, size, fileio->file) == NULL)
 		return ERROR_FILEIO_OPERATION_FAILED;
 
@@ -261,8 +773,26 @@ int fileio_write_u32(struct fileio *fileio, uint32_t data)
  * Avoiding the seek on startup opens up for using streams.
  *
  */
+/* modification time of the file, for callers caching its contents */
+int fileio_mtime(struct fileio *fileio, time_t *mtime)
+{
+	struct stat st;
+
+	if (fstat(fileno(fileio->file), &st) != 0)
+		return ERROR_FILEIO_OPERATION_FAILED;
+
+	*mtime = st.st_mtime;
+	return ERROR_OK;
+}
+
 int fileio_size(struct fileio *fileio, size_t *size)
 {
+	if (fileio->stream) {
+		int retval = fileio_stream_size(fileio);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
 	*size = fileio->size;
 
 	return ERROR_OK;
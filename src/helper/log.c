@@ -60,6 +60,58 @@ static const char * const log_strings[5] = {
 
 static int count;
 
+/* With "log_buffer on" messages are formatted into log_buf and written out
+ * in one go: when the buffer fills, before the server loop sleeps, for
+ * errors and warnings, and at exit.  Per message fflush() calls dominate
+ * the run time at debug level 3 and up. */
+#define LOG_BUFFER_SIZE (64 * 1024)
+
+static bool log_buffered;
+static char *log_buf;
+static size_t log_buf_used;
+
+void log_flush(void)
+{
+	if (log_output == NULL)
+		return;
+
+	if (log_buf_used) {
+		fwrite(log_buf, 1, log_buf_used, log_output);
+		log_buf_used = 0;
+	}
+	fflush(log_output);
+}
+
+static void log_write(const char *format, ...) __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 1, 2)));
+static void log_write(const char *format, ...)
+{
+	va_list ap, ap_copy;
+	int len;
+
+	va_start(ap, format);
+	if (log_buffered) {
+		for (int pass = 0; pass < 2; pass++) {
+			size_t room = LOG_BUFFER_SIZE - log_buf_used;
+
+			va_copy(ap_copy, ap);
+			len = vsnprintf(log_buf + log_buf_used, room, format, ap_copy);
+			va_end(ap_copy);
+			if (len >= 0 && (size_t)len < room) {
+				log_buf_used += len;
+				va_end(ap);
+				return;
+			}
+
+			/* does not fit, make room and try once more */
+			log_flush();
+		}
+	}
+
+	/* unbuffered, or longer than the whole buffer */
+	vfprintf(log_output, format, ap);
+	va_end(ap);
+}
+
 static struct store_log_forward *log_head;
 static int log_forward_count;
 
@@ -122,8 +174,8 @@ static void log_puts(enum log_levels level,
 	char *f;
 	if (level == LOG_LVL_OUTPUT) {
 		/* do not prepend any headers, just print out what we were given and return */
-		fputs(string, log_output);
-		fflush(log_output);
+		log_write("%s", string);
+		log_flush();
 		return;
 	}
 
@@ -139,7 +191,7 @@ static void log_puts(enum log_levels level,
 			struct mallinfo info;
 			info = mallinfo();
 #endif
-			fprintf(log_output, "%s%d %" PRId64 " %s:%d %s()"
+			log_write("%s%d %" PRId64 " %s:%d %s()"
 #ifdef _DEBUG_FREE_SPACE_
 				" %d"
 #endif
@@ -151,7 +203,7 @@ static void log_puts(enum log_levels level,
 		} else {
 			/* if we are using gdb through pipes then we do not want any output
 			 * to the pipe otherwise we get repeated strings */
-			fprintf(log_output, "%s%s",
+			log_write("%s%s",
 				(level > LOG_LVL_USER) ? log_strings[level + 1] : "", string);
 		}
 	} else {
@@ -159,7 +211,8 @@ static void log_puts(enum log_levels level,
 		 *nothing. */
 	}
 
-	fflush(log_output);
+	if (!log_buffered || level <= LOG_LVL_WARNING)
+		log_flush();
 
 	/* Never forward LOG_LVL_DEBUG, too verbose and they can be found in the log if need be */
 	if (level <= LOG_LVL_INFO)
@@ -238,6 +291,8 @@ COMMAND_HANDLER(handle_debug_level_command)
 			LOG_ERROR("level must be between %d and %d", LOG_LVL_SILENT, LOG_LVL_NULINK);
 			return ERROR_COMMAND_SYNTAX_ERROR;
 		}
+		if (new_level > LOG_MAX_LEVEL)
+			LOG_WARNING("messages above level %d are not in this build", LOG_MAX_LEVEL);
 		debug_level = new_level;
 	} else if (CMD_ARGC > 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
@@ -252,10 +307,39 @@ COMMAND_HANDLER(handle_log_output_command)
 	if (CMD_ARGC == 1) {
 		FILE *file = fopen(CMD_ARGV[0], "w");
 
-		if (file)
+		if (file) {
+			log_flush();
 			log_output = file;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_buffer_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+
+		if (enable && log_buf == NULL) {
+			log_buf = malloc(LOG_BUFFER_SIZE);
+			if (log_buf == NULL) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+			atexit(log_flush);
+		}
+		if (!enable)
+			log_flush();
+		log_buffered = enable;
 	}
 
+	command_print(CMD_CTX, "log_buffer: %s", log_buffered ? "on" : "off");
+
 	return ERROR_OK;
 }
 
@@ -267,6 +351,14 @@ static struct command_registration log_command_handlers[] = {
 		.help = "redirect logging to a file (default: stderr)",
 		.usage = "file_name",
 	},
+	{
+		.name = "log_buffer",
+		.handler = handle_log_buffer_command,
+		.mode = COMMAND_ANY,
+		.help = "buffer log messages and write them out in blocks; "
+			"errors and warnings are still written at once",
+		.usage = "['on'|'off']",
+	},
 	{
 		.name = "debug_level",
 		.handler = handle_debug_level_command,
@@ -309,6 +401,7 @@ void log_init(void)
 
 int set_log_output(struct command_context *cmd_ctx, FILE *output)
 {
+	log_flush();
 	log_output = output;
 	return ERROR_OK;
 }
@@ -442,6 +535,10 @@ void keep_alive()
 		 * These functions should be invoked at a well defined spot in server.c
 		 */
 
+		/* only peeks at the sockets, no handlers run */
+		extern void server_check_interrupt(void);
+		server_check_interrupt();
+
 		last_time = current_time;
 	}
 }
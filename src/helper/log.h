@@ -72,6 +72,8 @@ __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 5, 6)));
  */
 void log_init(void);
 int set_log_output(struct command_context *cmd_ctx, FILE *output);
+/* write out messages held back by "log_buffer on" */
+void log_flush(void);
 
 int log_register_commands(struct command_context *cmd_ctx);
 
@@ -101,24 +103,34 @@ extern int debug_level;
 /* Avoid fn call and building parameter list if we're not outputting the information.
  * Matters on feeble CPUs for DEBUG/INFO statements that are involved frequently */
 
-#define LOG_LEVEL_IS(FOO)  ((debug_level) >= (FOO))
+/* Messages above this level are compiled out (configure --with-log-max-level);
+ * errors and warnings are always kept. */
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_LVL_NULINK
+#endif
 
-#define LOG_DEBUG(expr ...) \
+#define LOG_LEVEL_IS(FOO)  (((FOO) <= LOG_LVL_WARNING || (FOO) <= LOG_MAX_LEVEL) && \
+		(debug_level) >= (FOO))
+
+#define LOG_LEVEL_PRINTF_LF(level, expr ...) \
 	do { \
-		if (debug_level >= LOG_LVL_DEBUG) \
-			log_printf_lf(LOG_LVL_DEBUG, \
+		if (LOG_LEVEL_IS(level)) \
+			log_printf_lf(level, \
 				__FILE__, __LINE__, __func__, \
 				expr); \
 	} while (0)
 
+#define LOG_DEBUG(expr ...) \
+	LOG_LEVEL_PRINTF_LF(LOG_LVL_DEBUG, expr)
+
 #define LOG_INFO(expr ...) \
-	log_printf_lf(LOG_LVL_INFO, __FILE__, __LINE__, __func__, expr)
+	LOG_LEVEL_PRINTF_LF(LOG_LVL_INFO, expr)
 
 #define LOG_WARNING(expr ...) \
-	log_printf_lf(LOG_LVL_WARNING, __FILE__, __LINE__, __func__, expr)
+	LOG_LEVEL_PRINTF_LF(LOG_LVL_WARNING, expr)
 
 #define LOG_ERROR(expr ...) \
-	log_printf_lf(LOG_LVL_ERROR, __FILE__, __LINE__, __func__, expr)
+	LOG_LEVEL_PRINTF_LF(LOG_LVL_ERROR, expr)
 
 #define LOG_USER(expr ...) \
 	log_printf_lf(LOG_LVL_USER, __FILE__, __LINE__, __func__, expr)
@@ -0,0 +1,373 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+
+#include "log.h"
+#include "command.h"
+#include "time_support.h"
+#include "metrics.h"
+
+struct metrics_collector {
+	metrics_collector_t collector;
+	void *priv;
+	struct metrics_collector *next;
+};
+
+struct metrics_writer {
+	bool json;
+	char *buf;
+	size_t len;
+	size_t size;
+	bool failed;	/* out of memory */
+	const char *family;	/* name of the last sample written */
+	unsigned int samples;
+};
+
+static struct metric *metrics;
+static struct metrics_collector *metrics_collectors;
+static int64_t metrics_start_ms;
+
+static const char * const metric_type_names[] = {
+	[METRIC_COUNTER] = "counter",
+	[METRIC_GAUGE] = "gauge",
+	[METRIC_HISTOGRAM] = "histogram",
+};
+
+static void metric_list(struct metric *metric)
+{
+	if (!metric->listed) {
+		metric->listed = true;
+		metric->next = metrics;
+		metrics = metric;
+	}
+}
+
+void metric_add(struct metric *metric, double value)
+{
+	metric_list(metric);
+	metric->value += value;
+}
+
+void metric_set(struct metric *metric, double value)
+{
+	metric_list(metric);
+	metric->value = value;
+}
+
+void metric_observe(struct metric *metric, double value)
+{
+	unsigned int i = 0;
+
+	metric_list(metric);
+	while (i < metric->num_bounds && value > metric->bounds[i])
+		i++;
+	metric->buckets[i]++;
+	metric->sum += value;
+	metric->count++;
+}
+
+void metrics_add_collector(metrics_collector_t collector, void *priv)
+{
+	struct metrics_collector **p;
+
+	for (p = &metrics_collectors; *p; p = &(*p)->next) {
+		if ((*p)->collector == collector && (*p)->priv == priv)
+			return;
+	}
+
+	*p = malloc(sizeof(**p));
+	if (!*p) {
+		LOG_ERROR("Out of memory");
+		return;
+	}
+	(*p)->collector = collector;
+	(*p)->priv = priv;
+	(*p)->next = NULL;
+}
+
+void metrics_remove_collector(metrics_collector_t collector, void *priv)
+{
+	for (struct metrics_collector **p = &metrics_collectors; *p; p = &(*p)->next) {
+		struct metrics_collector *c = *p;
+
+		if (c->collector == collector && c->priv == priv) {
+			*p = c->next;
+			free(c);
+			return;
+		}
+	}
+}
+
+static void metrics_printf(struct metrics_writer *w, const char *fmt, ...)
+	__attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 2, 3)));
+
+static void metrics_printf(struct metrics_writer *w, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (w->failed)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(w->buf + w->len, w->size - w->len, fmt, ap);
+	va_end(ap);
+
+	if (n >= 0 && (size_t)n >= w->size - w->len) {
+		size_t size = MAX(2 * w->size, w->len + n + 1);
+		char *buf = realloc(w->buf, size);
+
+		if (!buf) {
+			w->failed = true;
+			return;
+		}
+		w->buf = buf;
+		w->size = size;
+
+		va_start(ap, fmt);
+		n = vsnprintf(w->buf + w->len, w->size - w->len, fmt, ap);
+		va_end(ap);
+	}
+	if (n > 0)
+		w->len += n;
+}
+
+/* a JSON string, for the names and help texts we hand out ourselves */
+static void metrics_json_string(struct metrics_writer *w, const char *s)
+{
+	metrics_printf(w, "\"");
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			metrics_printf(w, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			metrics_printf(w, "\\u%04x", *s);
+		else
+			metrics_printf(w, "%c", *s);
+	}
+	metrics_printf(w, "\"");
+}
+
+/* labels 'a="x",b="y"' as a JSON object; the values are escaped the same
+ * way in both */
+static void metrics_json_labels(struct metrics_writer *w, const char *labels)
+{
+	const char *s = labels;
+
+	metrics_printf(w, "\"labels\": {");
+	while (s && *s) {
+		const char *eq = strchr(s, '=');
+		const char *end;
+
+		if (!eq || eq[1] != '"')
+			break;
+		for (end = eq + 2; *end && *end != '"'; end++) {
+			if (*end == '\\' && end[1])
+				end++;
+		}
+		metrics_printf(w, "%s\"%.*s\": \"%.*s\"", s == labels ? "" : ", ",
+				(int)(eq - s), s, (int)(end - eq - 2), eq + 2);
+		if (!*end)
+			break;
+		s = end + 1;
+		if (*s == ',')
+			s++;
+	}
+	metrics_printf(w, "}");
+}
+
+/* what comes before the value of a sample in either format */
+static void metrics_begin(struct metrics_writer *w, const char *name,
+		enum metric_type type, const char *help, const char *labels)
+{
+	bool new_family = !w->family || strcmp(w->family, name);
+
+	w->family = name;
+
+	if (w->json) {
+		metrics_printf(w, "%s\n    {\"name\": ", w->samples ? "," : "");
+		metrics_json_string(w, name);
+		metrics_printf(w, ", \"type\": \"%s\", \"help\": ", metric_type_names[type]);
+		metrics_json_string(w, help ? help : "");
+		metrics_printf(w, ", ");
+		metrics_json_labels(w, labels);
+		metrics_printf(w, ", ");
+	} else if (new_family) {
+		if (help)
+			metrics_printf(w, "# HELP %s %s\n", name, help);
+		metrics_printf(w, "# TYPE %s %s\n", name, metric_type_names[type]);
+	}
+	w->samples++;
+}
+
+/* Prometheus name and labels of a sample, with an extra label if any */
+static void metrics_text_sample(struct metrics_writer *w, const char *name,
+		const char *suffix, const char *labels, const char *extra)
+{
+	bool has_labels = labels && *labels;
+
+	metrics_printf(w, "%s%s", name, suffix);
+	if (has_labels || extra)
+		metrics_printf(w, "{%s%s%s}", has_labels ? labels : "",
+				has_labels && extra ? "," : "", extra ? extra : "");
+}
+
+void metrics_write(struct metrics_writer *w, const char *name,
+		enum metric_type type, const char *help, const char *labels,
+		double value)
+{
+	metrics_begin(w, name, type, help, labels);
+
+	if (w->json) {
+		metrics_printf(w, "\"value\": %.15g}", value);
+		return;
+	}
+	metrics_text_sample(w, name, "", labels, NULL);
+	metrics_printf(w, " %.15g\n", value);
+}
+
+void metrics_write_histogram(struct metrics_writer *w, const char *name,
+		const char *help, const char *labels, const double *bounds,
+		unsigned int num_bounds, const uint64_t *buckets, double sum)
+{
+	uint64_t count = 0;
+
+	metrics_begin(w, name, METRIC_HISTOGRAM, help, labels);
+
+	if (w->json)
+		metrics_printf(w, "\"buckets\": [");
+	for (unsigned int i = 0; i <= num_bounds; i++) {
+		char le[32];
+
+		count += buckets[i];
+		if (i < num_bounds)
+			snprintf(le, sizeof(le), "%.15g", bounds[i]);
+		else
+			strcpy(le, "+Inf");
+
+		if (w->json) {
+			metrics_printf(w, "%s{\"le\": \"%s\", \"count\": %" PRIu64 "}",
+					i ? ", " : "", le, count);
+			continue;
+		}
+		char extra[40];
+		snprintf(extra, sizeof(extra), "le=\"%s\"", le);
+		metrics_text_sample(w, name, "_bucket", labels, extra);
+		metrics_printf(w, " %" PRIu64 "\n", count);
+	}
+
+	if (w->json) {
+		metrics_printf(w, "], \"sum\": %.15g, \"count\": %" PRIu64 "}", sum, count);
+		return;
+	}
+	metrics_text_sample(w, name, "_sum", labels, NULL);
+	metrics_printf(w, " %.15g\n", sum);
+	metrics_text_sample(w, name, "_count", labels, NULL);
+	metrics_printf(w, " %" PRIu64 "\n", count);
+}
+
+char *metrics_output(bool json, size_t *len)
+{
+	struct metrics_writer w = { .json = json, .size = 4096 };
+
+	w.buf = malloc(w.size);
+	if (!w.buf)
+		return NULL;
+	w.buf[0] = '\0';
+
+	if (json)
+		metrics_printf(&w, "{\"metrics\": [");
+
+	metrics_write(&w, "openocd_uptime_seconds", METRIC_GAUGE,
+			"time since OpenOCD started", NULL,
+			(timeval_ms() - metrics_start_ms) / 1e3);
+
+	for (struct metric *m = metrics; m; m = m->next) {
+		if (m->type == METRIC_HISTOGRAM)
+			metrics_write_histogram(&w, m->name, m->help, NULL, m->bounds,
+					m->num_bounds, m->buckets, m->sum);
+		else
+			metrics_write(&w, m->name, m->type, m->help, NULL, m->value);
+	}
+
+	for (struct metrics_collector *c = metrics_collectors; c; c = c->next)
+		c->collector(&w, c->priv);
+
+	if (json)
+		metrics_printf(&w, "\n]}\n");
+
+	if (w.failed) {
+		free(w.buf);
+		return NULL;
+	}
+	if (len)
+		*len = w.len;
+	return w.buf;
+}
+
+COMMAND_HANDLER(handle_metrics_show_command)
+{
+	bool json = false;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "json"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		json = true;
+	}
+
+	char *out = metrics_output(json, NULL);
+	if (!out) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	command_print_sameline(CMD_CTX, "%s", out);
+	free(out);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration metrics_subcommand_handlers[] = {
+	{
+		.name = "show",
+		.handler = handle_metrics_show_command,
+		.mode = COMMAND_ANY,
+		.help = "print all metrics as Prometheus text, or as JSON",
+		.usage = "['json']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration metrics_command_handlers[] = {
+	{
+		.name = "metrics",
+		.mode = COMMAND_ANY,
+		.help = "monitoring counters, gauges and histograms",
+		.usage = "",
+		.chain = metrics_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int metrics_register_commands(struct command_context *cmd_ctx)
+{
+	metrics_start_ms = timeval_ms();
+	return register_commands(cmd_ctx, NULL, metrics_command_handlers);
+}
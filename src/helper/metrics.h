@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_HELPER_METRICS_H
+#define OPENOCD_HELPER_METRICS_H
+
+#include "types.h"
+
+struct command_context;
+
+/* Counters, gauges and histograms for monitoring, written out as
+ * Prometheus text or JSON by "metrics show" and the metrics server.
+ *
+ * Code counting something of its own declares a metric at file scope and
+ * updates it; the metric joins the list the first time it is updated:
+ *
+ *	METRIC_COUNTER(foo_errors, "openocd_foo_errors_total", "foo errors");
+ *	...
+ *	metric_add(&foo_errors, 1);
+ *
+ * Code already keeping statistics of its own registers a collector
+ * instead, which writes them with metrics_write() when asked for.
+ */
+enum metric_type {
+	METRIC_COUNTER,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM,
+};
+
+struct metric {
+	const char *name;
+	const char *help;
+	enum metric_type type;
+	double value;
+	/* histograms only: upper bounds, the last bucket is open */
+	const double *bounds;
+	unsigned int num_bounds;
+	uint64_t *buckets;
+	double sum;
+	uint64_t count;
+	bool listed;
+	struct metric *next;
+};
+
+#define METRIC_COUNTER(var, metric_name, metric_help) \
+	static struct metric var = { .name = metric_name, .help = metric_help, \
+		.type = METRIC_COUNTER }
+
+#define METRIC_GAUGE(var, metric_name, metric_help) \
+	static struct metric var = { .name = metric_name, .help = metric_help, \
+		.type = METRIC_GAUGE }
+
+/* the bounds, in ascending order, follow the help text */
+#define METRIC_HISTOGRAM(var, metric_name, metric_help, ...) \
+	static const double var##_bounds[] = { __VA_ARGS__ }; \
+	static uint64_t var##_buckets[ARRAY_SIZE(var##_bounds) + 1]; \
+	static struct metric var = { .name = metric_name, .help = metric_help, \
+		.type = METRIC_HISTOGRAM, .bounds = var##_bounds, \
+		.num_bounds = ARRAY_SIZE(var##_bounds), .buckets = var##_buckets }
+
+/** Add @a value to a counter or gauge. */
+void metric_add(struct metric *metric, double value);
+/** Set a gauge to @a value. */
+void metric_set(struct metric *metric, double value);
+/** Count @a value in the bucket of a histogram it falls in. */
+void metric_observe(struct metric *metric, double value);
+
+/* output being written, see metrics_write() */
+struct metrics_writer;
+
+typedef void (*metrics_collector_t)(struct metrics_writer *writer, void *priv);
+
+/** Have @a collector called with @a priv on every output; once only. */
+void metrics_add_collector(metrics_collector_t collector, void *priv);
+void metrics_remove_collector(metrics_collector_t collector, void *priv);
+
+/**
+ * Write one sample of a counter or gauge from a collector. @a labels is
+ * NULL or in Prometheus form, e.g. "op=\"0x11\""; samples of one name
+ * must be written one after the other.
+ */
+void metrics_write(struct metrics_writer *writer, const char *name,
+		enum metric_type type, const char *help, const char *labels,
+		double value);
+/**
+ * Write a histogram from a collector: @a buckets holds @a num_bounds + 1
+ * counts, not cumulated, the last one of values above all @a bounds.
+ */
+void metrics_write_histogram(struct metrics_writer *writer, const char *name,
+		const char *help, const char *labels, const double *bounds,
+		unsigned int num_bounds, const uint64_t *buckets, double sum);
+
+/**
+ * @returns all metrics as Prometheus text exposition, or as JSON if
+ * @a json, in a buffer to free(); NULL when out of memory.
+ */
+char *metrics_output(bool json, size_t *len);
+
+int metrics_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_HELPER_METRICS_H */
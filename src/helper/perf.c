@@ -0,0 +1,119 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "log.h"
+#include "command.h"
+#include "perf.h"
+#include "metrics.h"
+
+static struct perf_counter *perf_counters;
+
+void perf_stop(struct perf_counter *counter, int64_t start_ns)
+{
+	int64_t ns = timeval_ns() - start_ns;
+
+	if (!counter->listed) {
+		counter->listed = true;
+		counter->next = perf_counters;
+		perf_counters = counter;
+	}
+
+	if (counter->count == 0 || ns < counter->min_ns)
+		counter->min_ns = ns;
+	if (ns > counter->max_ns)
+		counter->max_ns = ns;
+	counter->total_ns += ns;
+	counter->count++;
+}
+
+/* the counters, for the metrics server */
+static void perf_collect(struct metrics_writer *writer, void *priv)
+{
+	char labels[64];
+
+	for (struct perf_counter *c = perf_counters; c; c = c->next) {
+		snprintf(labels, sizeof(labels), "counter=\"%s\"", c->name);
+		metrics_write(writer, "openocd_perf_calls_total", METRIC_COUNTER,
+				"calls of the timed operations", labels, c->count);
+	}
+	for (struct perf_counter *c = perf_counters; c; c = c->next) {
+		snprintf(labels, sizeof(labels), "counter=\"%s\"", c->name);
+		metrics_write(writer, "openocd_perf_seconds_total", METRIC_COUNTER,
+				"time spent in the timed operations", labels, c->total_ns / 1e9);
+	}
+}
+
+COMMAND_HANDLER(handle_perf_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		for (struct perf_counter *c = perf_counters; c; c = c->next) {
+			c->count = 0;
+			c->total_ns = 0;
+			c->min_ns = 0;
+			c->max_ns = 0;
+		}
+		return ERROR_OK;
+	}
+
+	command_print(CMD_CTX, "%-24s %10s %12s %10s %10s %10s", "counter", "count",
+			"total ms", "avg us", "min us", "max us");
+	for (struct perf_counter *c = perf_counters; c; c = c->next) {
+		if (c->count == 0)
+			continue;
+		command_print(CMD_CTX, "%-24s %10" PRIu64 " %12.3f %10.1f %10.1f %10.1f",
+				c->name, c->count, c->total_ns / 1e6,
+				c->total_ns / 1e3 / c->count, c->min_ns / 1e3, c->max_ns / 1e3);
+	}
+
+	return ERROR_OK;
+}
+
+static const struct command_registration perf_subcommand_handlers[] = {
+	{
+		.name = "stats",
+		.handler = handle_perf_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "show the call counts and times of the timed operations, "
+			"or reset them",
+		.usage = "['reset']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration perf_command_handlers[] = {
+	{
+		.name = "perf",
+		.mode = COMMAND_ANY,
+		.help = "timing counters",
+		.usage = "",
+		.chain = perf_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int perf_register_commands(struct command_context *cmd_ctx)
+{
+	metrics_add_collector(perf_collect, NULL);
+	return register_commands(cmd_ctx, NULL, perf_command_handlers);
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_HELPER_PERF_H
+#define OPENOCD_HELPER_PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "time_support.h"
+
+struct command_context;
+
+/* Named counters of how often, and for how long, something ran; listed
+ * by "perf stats".  Declare one with PERF_COUNTER at file scope, then
+ * bracket the code to time:
+ *
+ *	PERF_COUNTER(foo_perf, "foo");
+ *	...
+ *	int64_t start = perf_start();
+ *	retval = foo();
+ *	perf_stop(&foo_perf, start);
+ *
+ * A counter joins the list the first time it is stopped.
+ */
+struct perf_counter {
+	const char *name;
+	uint64_t count;
+	int64_t total_ns;
+	int64_t min_ns;
+	int64_t max_ns;
+	bool listed;
+	struct perf_counter *next;
+};
+
+#define PERF_COUNTER(var, counter_name) \
+	static struct perf_counter var = { .name = counter_name }
+
+static inline int64_t perf_start(void)
+{
+	return timeval_ns();
+}
+
+void perf_stop(struct perf_counter *counter, int64_t start_ns);
+
+int perf_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_HELPER_PERF_H */
@@ -132,6 +132,9 @@ char *strndup(const char *s, size_t n)
 #endif
 
 #ifdef _WIN32
+/* how often pipes with nothing in them are looked at again */
+#define WIN_SELECT_POLL_MS	10
+
 int win_select(int max_fd, fd_set *rfds, fd_set *wfds, fd_set *efds, struct timeval *tv)
 {
 	DWORD ms_total, limit;
@@ -142,6 +145,7 @@ int win_select(int max_fd, fd_set *rfds, fd_set *wfds, fd_set *efds, struct time
 	fd_set aread, awrite, aexcept;
 	int sock_max_fd = -1;
 	struct timeval tvslice;
+	WSAEVENT sock_event = WSA_INVALID_EVENT;
 	int retcode;
 
 #define SAFE_FD_ISSET(fd, set)  (set != NULL && FD_ISSET(fd, set))
@@ -185,84 +189,130 @@ int win_select(int max_fd, fd_set *rfds, fd_set *wfds, fd_set *efds, struct time
 		return select(max_fd, rfds, wfds, efds, tv);
 	}
 
-	/* mixture of handles and sockets; lets multiplex between
-	 * winsock and waiting on the handles */
-
-	FD_ZERO(&aread);
-	FD_ZERO(&awrite);
-	FD_ZERO(&aexcept);
+	/* mixture of handles and sockets: the sockets signal one event
+	 * through WSAEventSelect(), so a single MsgWaitForMultipleObjects()
+	 * sleeps until a socket, a handle or a window message is ready
+	 * instead of alternating 1ms select() and wait slices */
+	if (sock_max_fd >= 0 && n_handles < MAXIMUM_WAIT_OBJECTS) {
+		sock_event = WSACreateEvent();
+		if (sock_event != WSA_INVALID_EVENT) {
+			for (i = 0; i <= sock_max_fd; i++) {
+				long events = 0;
+				if (FD_ISSET(i, &sock_read))
+					events |= FD_READ | FD_ACCEPT | FD_CLOSE;
+				if (FD_ISSET(i, &sock_write))
+					events |= FD_WRITE | FD_CONNECT | FD_CLOSE;
+				if (FD_ISSET(i, &sock_except))
+					events |= FD_OOB;
+				if (events)
+					WSAEventSelect(i, sock_event, events);
+			}
+			handles[n_handles] = sock_event;
+		}
+	}
 
 	limit = GetTickCount() + ms_total;
-	do {
+	for (;;) {
+		DWORD wret, now, wait_ms;
+		int pipe_idle = 0;
+
+		FD_ZERO(&aread);
+		FD_ZERO(&awrite);
+		FD_ZERO(&aexcept);
 		retcode = 0;
 
 		if (sock_max_fd >= 0) {
-			/* overwrite the zero'd sets here; the select call
-			 * will clear those that are not active */
+			/* the event only tells something changed: ask select()
+			 * for the sockets ready now */
 			aread = sock_read;
 			awrite = sock_write;
 			aexcept = sock_except;
 
 			tvslice.tv_sec = 0;
-			tvslice.tv_usec = 1000;
+			tvslice.tv_usec = 0;
 
 			retcode = select(sock_max_fd + 1, &aread, &awrite, &aexcept, &tvslice);
+			if (retcode < 0)
+				break;
 		}
 
-		if (n_handles > 0) {
-			/* check handles */
-			DWORD wret;
-
-			wret = MsgWaitForMultipleObjects(n_handles,
-					handles,
-					FALSE,
-					retcode > 0 ? 0 : 1,
-					QS_ALLEVENTS);
-
-			if (wret == WAIT_TIMEOUT) {
-				/* set retcode to 0; this is the default.
-				 * select() may have set it to something else,
-				 * in which case we leave it alone, so this branch
-				 * does nothing */
-				;
-			} else if (wret == WAIT_FAILED) {
-				if (retcode == 0)
-					retcode = -1;
-			} else {
-				if (retcode < 0)
-					retcode = 0;
-				for (i = 0; i < n_handles; i++) {
-					if (WAIT_OBJECT_0 == WaitForSingleObject(handles[i], 0)) {
-						if (SAFE_FD_ISSET(handle_slot_to_fd[i], rfds)) {
-							DWORD dwBytes;
-							intptr_t handle = (intptr_t) _get_osfhandle(
-									handle_slot_to_fd[i]);
-
-							if (PeekNamedPipe((HANDLE)handle, NULL, 0,
-								    NULL, &dwBytes, NULL)) {
-								/* check to see if gdb pipe has data available */
-								if (dwBytes) {
-									FD_SET(handle_slot_to_fd[i], &aread);
-									retcode++;
-								}
-							} else {
-								FD_SET(handle_slot_to_fd[i], &aread);
-								retcode++;
-							}
-						}
-						if (SAFE_FD_ISSET(handle_slot_to_fd[i], wfds)) {
-							FD_SET(handle_slot_to_fd[i], &awrite);
-							retcode++;
-						}
-						if (SAFE_FD_ISSET(handle_slot_to_fd[i], efds)) {
-							FD_SET(handle_slot_to_fd[i], &aexcept);
-							retcode++;
-						}
+		/* check handles */
+		for (i = 0; i < n_handles; i++) {
+			if (WAIT_OBJECT_0 != WaitForSingleObject(handles[i], 0))
+				continue;
+			if (SAFE_FD_ISSET(handle_slot_to_fd[i], rfds)) {
+				DWORD dwBytes;
+				intptr_t handle = (intptr_t) _get_osfhandle(
+						handle_slot_to_fd[i]);
+
+				if (PeekNamedPipe((HANDLE)handle, NULL, 0,
+					    NULL, &dwBytes, NULL)) {
+					/* check to see if gdb pipe has data available */
+					if (dwBytes) {
+						FD_SET(handle_slot_to_fd[i], &aread);
+						retcode++;
+					} else {
+						/* a pipe is signalled with nothing in it */
+						pipe_idle = 1;
 					}
+				} else {
+					FD_SET(handle_slot_to_fd[i], &aread);
+					retcode++;
 				}
 			}
+			if (SAFE_FD_ISSET(handle_slot_to_fd[i], wfds)) {
+				FD_SET(handle_slot_to_fd[i], &awrite);
+				retcode++;
+			}
+			if (SAFE_FD_ISSET(handle_slot_to_fd[i], efds)) {
+				FD_SET(handle_slot_to_fd[i], &aexcept);
+				retcode++;
+			}
+		}
+
+		now = GetTickCount();
+		if (retcode != 0 || (ms_total != INFINITE && now >= limit))
+			break;
+
+		wait_ms = ms_total == INFINITE ? INFINITE : limit - now;
+		/* a signalled empty pipe would wake the wait at once, those are
+		 * polled; so are sockets when there is no slot for their event */
+		if (pipe_idle || (sock_max_fd >= 0 && sock_event == WSA_INVALID_EVENT))
+			wait_ms = wait_ms < WIN_SELECT_POLL_MS ? wait_ms : WIN_SELECT_POLL_MS;
+
+		if (pipe_idle) {
+			if (sock_event != WSA_INVALID_EVENT)
+				wret = MsgWaitForMultipleObjects(1, &sock_event, FALSE,
+						wait_ms, QS_ALLEVENTS);
+			else
+				wret = MsgWaitForMultipleObjects(0, NULL, FALSE,
+						wait_ms, QS_ALLEVENTS);
+		} else
+			wret = MsgWaitForMultipleObjects(
+					n_handles + (sock_event != WSA_INVALID_EVENT ? 1 : 0),
+					handles, FALSE, wait_ms, QS_ALLEVENTS);
+
+		if (wret == WAIT_FAILED) {
+			retcode = -1;
+			break;
 		}
-	} while (retcode == 0 && (ms_total == INFINITE || GetTickCount() < limit));
+		/* a window message is handled by server_loop() */
+		if (wret == WAIT_OBJECT_0 + n_handles + (sock_event != WSA_INVALID_EVENT ? 1 : 0))
+			break;
+		if (sock_event != WSA_INVALID_EVENT)
+			WSAResetEvent(sock_event);
+	}
+
+	if (sock_event != WSA_INVALID_EVENT) {
+		/* detach the sockets again; they stay non-blocking, which all
+		 * the server's sockets are anyway */
+		for (i = 0; i <= sock_max_fd; i++) {
+			if (FD_ISSET(i, &sock_read) || FD_ISSET(i, &sock_write) ||
+					FD_ISSET(i, &sock_except))
+				WSAEventSelect(i, NULL, 0);
+		}
+		WSACloseEvent(sock_event);
+	}
 
 	if (rfds)
 		*rfds = aread;
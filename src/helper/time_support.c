@@ -62,18 +62,27 @@ int timeval_add_time(struct timeval *result, long sec, long usec)
 	return 0;
 }
 
+static void timeval_from_ns(struct timeval *tv, int64_t ns)
+{
+	tv->tv_sec = ns / 1000000000;
+	tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
+/* durations use the monotonic clock, so setting the time cannot
+ * make them negative */
 int duration_start(struct duration *duration)
 {
-	return gettimeofday(&duration->start, NULL);
+	timeval_from_ns(&duration->start, timeval_ns());
+	return 0;
 }
 
 int duration_measure(struct duration *duration)
 {
 	struct timeval end;
-	int retval = gettimeofday(&end, NULL);
-	if (0 == retval)
-		timeval_subtract(&duration->elapsed, &end, &duration->start);
-	return retval;
+
+	timeval_from_ns(&end, timeval_ns());
+	timeval_subtract(&duration->elapsed, &end, &duration->start);
+	return 0;
 }
 
 float duration_elapsed(const struct duration *duration)
@@ -39,7 +39,9 @@
 int timeval_subtract(struct timeval *result, struct timeval *x, struct timeval *y);
 int timeval_add_time(struct timeval *result, long sec, long usec);
 
-/** @returns gettimeofday() timeval as 64-bit in ms */
+/** @returns monotonic clock in ns; only differences are meaningful */
+int64_t timeval_ns(void);
+/** @returns monotonic clock in ms; only differences are meaningful */
 int64_t timeval_ms(void);
 
 struct duration {
@@ -28,14 +28,40 @@
 
 #include "time_support.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/* Monotonic: unlike gettimeofday() it does not jump when the system
+ * clock is set or adjusted.  The origin is arbitrary. */
+int64_t timeval_ns(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (now.QuadPart / freq.QuadPart) * 1000000000 +
+		(now.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (int64_t)now.tv_sec * 1000000000 + (int64_t)now.tv_usec * 1000;
+#endif
+}
+
 /* simple and low overhead fetching of ms counter. Use only
  * the difference between ms counters returned from this fn.
  */
 int64_t timeval_ms(void)
 {
-	struct timeval now;
-	int retval = gettimeofday(&now, NULL);
-	if (retval < 0)
-		return retval;
-	return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+	return timeval_ns() / 1000000;
 }
@@ -0,0 +1,335 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "log.h"
+#include "command.h"
+#include "time_support.h"
+#include "tracelog.h"
+
+/* records go out through stdio in blocks of this size */
+#define TRACELOG_BUFFER_SIZE	(64 * 1024)
+#define TRACELOG_MAX_EVENTS		1024
+
+bool tracelog_enabled;
+
+static FILE *tracelog_file;
+static int64_t tracelog_base_us;
+
+/* Names seen so far, the index is the event id.  Callers pass string
+ * literals or command names, so comparing pointers finds nearly all. */
+static const char *tracelog_names[TRACELOG_MAX_EVENTS];
+static char *tracelog_name_copies[TRACELOG_MAX_EVENTS];
+static unsigned int tracelog_num_names;
+
+static const char * const tracelog_subsystem_names[TRACELOG_NUM_SUBSYSTEMS] = {
+	[TRACELOG_COMMAND] = "command",
+	[TRACELOG_FLASH] = "flash",
+	[TRACELOG_TARGET] = "target",
+	[TRACELOG_ADAPTER] = "adapter",
+};
+
+int64_t tracelog_time_us(void)
+{
+	return timeval_ns() / 1000;
+}
+
+static void tracelog_write(struct tracelog_record *rec)
+{
+	if (fwrite(rec, sizeof(*rec), 1, tracelog_file) != 1) {
+		LOG_ERROR("tracelog: write failed, trace stopped");
+		fclose(tracelog_file);
+		tracelog_file = NULL;
+		tracelog_enabled = false;
+	}
+}
+
+static uint16_t tracelog_event_id(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < tracelog_num_names; i++) {
+		if (tracelog_names[i] == name)
+			return i;
+	}
+	for (i = 0; i < tracelog_num_names; i++) {
+		if (strcmp(tracelog_name_copies[i], name) == 0) {
+			tracelog_names[i] = name;
+			return i;
+		}
+	}
+
+	/* table full, the last id stands for everything else */
+	if (tracelog_num_names == TRACELOG_MAX_EVENTS)
+		return TRACELOG_MAX_EVENTS - 1;
+
+	i = tracelog_num_names++;
+	tracelog_names[i] = name;
+	tracelog_name_copies[i] = strdup(name);
+	if (tracelog_name_copies[i] == NULL) {
+		tracelog_num_names--;
+		return TRACELOG_MAX_EVENTS - 1;
+	}
+
+	struct tracelog_record rec = {
+		.time_us = 0,
+		.type = TRACELOG_NAME,
+		.event = i,
+	};
+	strncpy(rec.name, name, TRACELOG_NAME_LEN);
+	tracelog_write(&rec);
+
+	return i;
+}
+
+static void tracelog_record(enum tracelog_type type, enum tracelog_subsystem subsystem,
+		const char *name, int64_t time_us, uint32_t duration_us,
+		uint32_t arg0, uint32_t arg1)
+{
+	uint16_t event = tracelog_event_id(name);
+
+	if (!tracelog_enabled)
+		return;
+
+	struct tracelog_record rec = {
+		.time_us = time_us - tracelog_base_us,
+		.duration_us = duration_us,
+		.type = type,
+		.subsystem = subsystem,
+		.event = event,
+		.arg = { arg0, arg1 },
+	};
+	tracelog_write(&rec);
+}
+
+void tracelog_begin(enum tracelog_subsystem subsystem, const char *name,
+		uint32_t arg0, uint32_t arg1)
+{
+	if (tracelog_enabled)
+		tracelog_record(TRACELOG_BEGIN, subsystem, name, tracelog_time_us(), 0, arg0, arg1);
+}
+
+void tracelog_end(enum tracelog_subsystem subsystem, const char *name,
+		uint32_t result)
+{
+	if (tracelog_enabled)
+		tracelog_record(TRACELOG_END, subsystem, name, tracelog_time_us(), 0, result, 0);
+}
+
+void tracelog_complete(enum tracelog_subsystem subsystem, const char *name,
+		int64_t start_us, uint32_t arg0, uint32_t arg1)
+{
+	if (!tracelog_enabled)
+		return;
+
+	int64_t now = tracelog_time_us();
+	if (start_us < tracelog_base_us)
+		start_us = tracelog_base_us;
+	tracelog_record(TRACELOG_COMPLETE, subsystem, name, start_us, now - start_us, arg0, arg1);
+}
+
+static void tracelog_stop(void)
+{
+	if (tracelog_file == NULL)
+		return;
+
+	tracelog_enabled = false;
+	fclose(tracelog_file);
+	tracelog_file = NULL;
+
+	for (unsigned int i = 0; i < tracelog_num_names; i++)
+		free(tracelog_name_copies[i]);
+	tracelog_num_names = 0;
+}
+
+static int tracelog_start(const char *filename)
+{
+	static bool at_exit;
+
+	tracelog_stop();
+
+	tracelog_file = fopen(filename, "wb");
+	if (tracelog_file == NULL) {
+		LOG_ERROR("tracelog: cannot create '%s'", filename);
+		return ERROR_FAIL;
+	}
+	setvbuf(tracelog_file, NULL, _IOFBF, TRACELOG_BUFFER_SIZE);
+
+	if (fwrite(TRACELOG_MAGIC, 1, 8, tracelog_file) != 8) {
+		fclose(tracelog_file);
+		tracelog_file = NULL;
+		return ERROR_FAIL;
+	}
+
+	if (!at_exit) {
+		atexit(tracelog_stop);
+		at_exit = true;
+	}
+
+	tracelog_base_us = tracelog_time_us();
+	tracelog_enabled = true;
+
+	return ERROR_OK;
+}
+
+/* Chrome trace event format: one array entry per record, a thread per
+ * subsystem so that begin and end pairs nest within their own row */
+static int tracelog_convert(const char *in_name, const char *out_name)
+{
+	char *names[TRACELOG_MAX_EVENTS] = { NULL };
+	struct tracelog_record rec;
+	char magic[8];
+	unsigned int n = 0;
+	int retval = ERROR_OK;
+
+	FILE *in = fopen(in_name, "rb");
+	if (in == NULL) {
+		LOG_ERROR("tracelog: cannot open '%s'", in_name);
+		return ERROR_FAIL;
+	}
+	if (fread(magic, 1, 8, in) != 8 || memcmp(magic, TRACELOG_MAGIC, 8)) {
+		LOG_ERROR("tracelog: '%s' is not a trace", in_name);
+		fclose(in);
+		return ERROR_FAIL;
+	}
+
+	FILE *out = fopen(out_name, "w");
+	if (out == NULL) {
+		LOG_ERROR("tracelog: cannot create '%s'", out_name);
+		fclose(in);
+		return ERROR_FAIL;
+	}
+
+	fprintf(out, "{\"traceEvents\":[\n");
+	for (int i = 0; i < TRACELOG_NUM_SUBSYSTEMS; i++)
+		fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+				"\"args\":{\"name\":\"%s\"}}", i ? ",\n" : "", i, tracelog_subsystem_names[i]);
+
+	while (fread(&rec, sizeof(rec), 1, in) == 1) {
+		if (rec.event >= TRACELOG_MAX_EVENTS || rec.subsystem >= TRACELOG_NUM_SUBSYSTEMS) {
+			LOG_ERROR("tracelog: bad record %u", n);
+			retval = ERROR_FAIL;
+			break;
+		}
+		n++;
+
+		if (rec.type == TRACELOG_NAME) {
+			free(names[rec.event]);
+			names[rec.event] = calloc(1, TRACELOG_NAME_LEN + 1);
+			if (names[rec.event])
+				memcpy(names[rec.event], rec.name, TRACELOG_NAME_LEN);
+			continue;
+		}
+
+		const char *name = names[rec.event] ? names[rec.event] : "?";
+		fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,"
+				"\"ts\":%" PRIu64, name, tracelog_subsystem_names[rec.subsystem],
+				rec.type, rec.subsystem, rec.time_us);
+		if (rec.type == TRACELOG_COMPLETE)
+			fprintf(out, ",\"dur\":%" PRIu32, rec.duration_us);
+		if (rec.type == TRACELOG_END)
+			fprintf(out, ",\"args\":{\"result\":%" PRId32 "}}", (int32_t)rec.arg[0]);
+		else
+			fprintf(out, ",\"args\":{\"arg0\":\"0x%" PRIx32 "\",\"arg1\":\"0x%" PRIx32 "\"}}",
+					rec.arg[0], rec.arg[1]);
+	}
+	fprintf(out, "\n]}\n");
+
+	for (unsigned int i = 0; i < TRACELOG_MAX_EVENTS; i++)
+		free(names[i]);
+	fclose(in);
+	if (fclose(out) != 0)
+		retval = ERROR_FAIL;
+
+	if (retval == ERROR_OK)
+		LOG_INFO("tracelog: %u records written to %s", n, out_name);
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_tracelog_start_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	return tracelog_start(CMD_ARGV[0]);
+}
+
+COMMAND_HANDLER(handle_tracelog_stop_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	tracelog_stop();
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_tracelog_convert_command)
+{
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	/* the trace being written is incomplete until flushed */
+	if (tracelog_file)
+		fflush(tracelog_file);
+
+	return tracelog_convert(CMD_ARGV[0], CMD_ARGV[1]);
+}
+
+static const struct command_registration tracelog_subcommand_handlers[] = {
+	{
+		.name = "start",
+		.handler = handle_tracelog_start_command,
+		.mode = COMMAND_ANY,
+		.help = "write a binary timeline of commands, flash phases, "
+			"target algorithms and adapter transactions to a file",
+		.usage = "filename",
+	},
+	{
+		.name = "stop",
+		.handler = handle_tracelog_stop_command,
+		.mode = COMMAND_ANY,
+		.help = "stop tracing and close the trace file",
+		.usage = "",
+	},
+	{
+		.name = "convert",
+		.handler = handle_tracelog_convert_command,
+		.mode = COMMAND_ANY,
+		.help = "convert a trace file to Chrome trace event JSON",
+		.usage = "trace_file json_file",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration tracelog_command_handlers[] = {
+	{
+		.name = "tracelog",
+		.mode = COMMAND_ANY,
+		.help = "timeline tracing",
+		.usage = "",
+		.chain = tracelog_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int tracelog_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, tracelog_command_handlers);
+}
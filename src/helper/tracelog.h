@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_HELPER_TRACELOG_H
+#define OPENOCD_HELPER_TRACELOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct command_context;
+
+/* A timeline of what OpenOCD spends its time on, written as fixed size
+ * binary records by "tracelog start" and turned into Chrome trace JSON
+ * (chrome://tracing, Perfetto) by "tracelog convert". */
+
+enum tracelog_subsystem {
+	TRACELOG_COMMAND,	/* Tcl commands */
+	TRACELOG_FLASH,		/* flash phases, see enum flash_phase */
+	TRACELOG_TARGET,	/* target algorithms */
+	TRACELOG_ADAPTER,	/* adapter transactions */
+	TRACELOG_NUM_SUBSYSTEMS
+};
+
+enum tracelog_type {
+	TRACELOG_NAME = 'N',	/* binds 'event' to the name in 'arg' */
+	TRACELOG_BEGIN = 'B',
+	TRACELOG_END = 'E',
+	TRACELOG_COMPLETE = 'X',	/* begin and 'duration_us' in one */
+};
+
+#define TRACELOG_NAME_LEN	16
+
+/* 32 bytes in host byte order; files start with TRACELOG_MAGIC */
+struct tracelog_record {
+	uint64_t time_us;	/* since "tracelog start" */
+	uint32_t duration_us;
+	uint8_t type;
+	uint8_t subsystem;
+	uint16_t event;
+	union {
+		uint32_t arg[4];
+		char name[TRACELOG_NAME_LEN];	/* TRACELOG_NAME, not terminated when full */
+	};
+};
+
+#define TRACELOG_MAGIC	"OCDTRAC1"
+
+extern bool tracelog_enabled;
+
+/* microseconds on the monotonic clock, timeval_ns() / 1000 */
+int64_t tracelog_time_us(void);
+
+/* 'name' should stay the same for a kind of event: it is looked up in a
+ * table to find the event id, and written just the first time */
+void tracelog_begin(enum tracelog_subsystem subsystem, const char *name,
+		uint32_t arg0, uint32_t arg1);
+void tracelog_end(enum tracelog_subsystem subsystem, const char *name,
+		uint32_t result);
+void tracelog_complete(enum tracelog_subsystem subsystem, const char *name,
+		int64_t start_us, uint32_t arg0, uint32_t arg1);
+
+int tracelog_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_HELPER_TRACELOG_H */
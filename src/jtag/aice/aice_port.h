@@ -148,6 +148,9 @@ struct aice_port_api_s {
 	int (*step)(uint32_t coreid);
 	/** */
 	int (*read_reg)(uint32_t coreid, uint32_t num, uint32_t *val);
+	/** several registers behind a single transfer, may be NULL */
+	int (*read_reg_list)(uint32_t coreid, const uint32_t *num, uint32_t *val,
+			uint32_t count);
 	/** */
 	int (*write_reg)(uint32_t coreid, uint32_t num, uint32_t val);
 	/** */
@@ -423,9 +423,49 @@ static uint32_t usb_out_packets_buffer_length;
 static uint32_t usb_in_packets_buffer_length;
 static enum aice_command_mode aice_command_mode;
 
+/* Commands queued in pack mode whose acknowledge, and for reads whose
+ * data, are picked out of the response stream when the packet is flushed */
+#define AICE_MAX_DEFERRED_RESULTS	128
+
+struct aice_deferred_result {
+	uint32_t offset;	/* of the response in usb_in_packets_buffer */
+	uint8_t cmd_code;
+	uint32_t *data;		/* word of a DTHMA response, NULL for none */
+};
+
+static struct aice_deferred_result aice_deferred_results[AICE_MAX_DEFERRED_RESULTS];
+static uint32_t aice_num_deferred_results;
+static int aice_deferred_retval = ERROR_OK;
+
 static int aice_batch_buffer_write(uint8_t buf_index, const uint8_t *word,
 		uint32_t num_of_words);
 
+static int aice_resolve_deferred_results(int32_t in_length)
+{
+	int retval = ERROR_OK;
+
+	for (uint32_t i = 0; i < aice_num_deferred_results; i++) {
+		struct aice_deferred_result *res = &aice_deferred_results[i];
+		uint8_t *in = usb_in_packets_buffer + res->offset;
+		int32_t length = res->data ? AICE_FORMAT_DTHMA : AICE_FORMAT_DTHMB;
+
+		if ((int32_t)res->offset + length > in_length || in[0] != res->cmd_code) {
+			LOG_DEBUG("deferred command 0x%" PRIx8 " not acknowledged", res->cmd_code);
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		if (res->data)
+			*res->data = (in[4] << 24) | (in[5] << 16) | (in[6] << 8) | in[7];
+	}
+	aice_num_deferred_results = 0;
+
+	if (retval != ERROR_OK)
+		aice_deferred_retval = retval;
+
+	return retval;
+}
+
 static int aice_usb_packet_flush(void)
 {
 	if (usb_out_packets_buffer_length == 0)
@@ -438,8 +478,12 @@ static int aice_usb_packet_flush(void)
 					usb_out_packets_buffer_length) < 0)
 			return ERROR_FAIL;
 
-		if (aice_usb_read(usb_in_packets_buffer,
-					usb_in_packets_buffer_length) < 0)
+		int32_t result = aice_usb_read(usb_in_packets_buffer,
+				usb_in_packets_buffer_length);
+		if (aice_num_deferred_results > 0 &&
+				aice_resolve_deferred_results(result) != ERROR_OK)
+			result = -1;
+		if (result < 0)
 			return ERROR_FAIL;
 
 		usb_out_packets_buffer_length = 0;
@@ -518,6 +562,24 @@ static int aice_usb_packet_append(uint8_t *out_buffer, int out_length, int in_le
 	return ERROR_OK;
 }
 
+/* Append the command packed in usb_out_buffer in pack mode and keep track
+ * of its response; *data receives the word a read returns at the flush. */
+static int aice_usb_packet_defer(int out_length, int in_length, uint32_t *data)
+{
+	if (usb_out_packets_buffer_length + out_length > AICE_OUT_PACK_COMMAND_SIZE ||
+			usb_in_packets_buffer_length + in_length > AICE_IN_PACK_COMMAND_SIZE ||
+			aice_num_deferred_results == AICE_MAX_DEFERRED_RESULTS)
+		if (aice_usb_packet_flush() != ERROR_OK)
+			return ERROR_FAIL;
+
+	struct aice_deferred_result *res = &aice_deferred_results[aice_num_deferred_results++];
+	res->offset = usb_in_packets_buffer_length;
+	res->cmd_code = usb_out_buffer[0];
+	res->data = data;
+
+	return aice_usb_packet_append(usb_out_buffer, out_length, in_length);
+}
+
 /***************************************************************************/
 /* AICE commands */
 static int aice_reset_box(void)
@@ -1900,12 +1962,9 @@ static int aice_execute_dim(uint32_t coreid, uint32_t *insts, uint8_t n_inst)
 	return ERROR_OK;
 }
 
-static int aice_read_reg(uint32_t coreid, uint32_t num, uint32_t *val)
+/* DIM sequence moving register num to $DTR */
+static void aice_read_reg_insts(uint32_t num, uint32_t *instructions)
 {
-	LOG_DEBUG("aice_read_reg, reg_no: 0x%08" PRIx32, num);
-
-	uint32_t instructions[4]; /** execute instructions in DIM */
-
 	if (NDS32_REG_TYPE_GPR == nds32_reg_type(num)) { /* general registers */
 		instructions[0] = MTSR_DTR(num);
 		instructions[1] = DSB;
@@ -1958,6 +2017,15 @@ static int aice_read_reg(uint32_t coreid, uint32_t num, uint32_t *val)
 		instructions[2] = DSB;
 		instructions[3] = BEQ_MINUS_12;
 	}
+}
+
+static int aice_read_reg(uint32_t coreid, uint32_t num, uint32_t *val)
+{
+	LOG_DEBUG("aice_read_reg, reg_no: 0x%08" PRIx32, num);
+
+	uint32_t instructions[4]; /** execute instructions in DIM */
+
+	aice_read_reg_insts(num, instructions);
 
 	aice_execute_dim(coreid, instructions, 4);
 
@@ -1974,10 +2042,10 @@ static int aice_read_reg(uint32_t coreid, uint32_t num, uint32_t *val)
 	return ERROR_OK;
 }
 
-static int aice_usb_read_reg(uint32_t coreid, uint32_t num, uint32_t *val)
+/* Registers OpenOCD keeps a backup of while the target is halted are
+ * served from it; returns false for every other register. */
+static bool aice_usb_read_backup_reg(uint32_t coreid, uint32_t num, uint32_t *val)
 {
-	LOG_DEBUG("aice_usb_read_reg");
-
 	if (num == R0) {
 		*val = core_info[coreid].r0_backup;
 	} else if (num == R1) {
@@ -1994,6 +2062,17 @@ static int aice_usb_read_reg(uint32_t coreid, uint32_t num, uint32_t *val)
 	} else if ((core_info[coreid].target_dtr_valid == true) && (num == DR43)) {
 		*val = core_info[coreid].target_dtr_backup;
 	} else {
+		return false;
+	}
+
+	return true;
+}
+
+static int aice_usb_read_reg(uint32_t coreid, uint32_t num, uint32_t *val)
+{
+	LOG_DEBUG("aice_usb_read_reg");
+
+	if (!aice_usb_read_backup_reg(coreid, num, val)) {
 		if (ERROR_OK != aice_read_reg(coreid, num, val))
 			*val = 0xBBADBEEF;
 	}
@@ -2001,6 +2080,109 @@ static int aice_usb_read_reg(uint32_t coreid, uint32_t num, uint32_t *val)
 	return ERROR_OK;
 }
 
+/* Queue what aice_execute_dim() does in pack mode.  $DBGER cannot be
+ * polled from inside a packet, it is read once into *dbger instead. */
+static int aice_queue_execute_dim(uint32_t coreid, uint32_t *insts, uint32_t *dbger)
+{
+	uint32_t big_endian_word[4];
+
+	/** instruction is big-endian */
+	memcpy(big_endian_word, insts, sizeof(big_endian_word));
+	aice_switch_to_big_endian(big_endian_word, 4);
+
+	aice_pack_htdmc_multiple_data(AICE_CMD_T_WRITE_DIM, coreid, 3, 0,
+			big_endian_word, 4, AICE_LITTLE_ENDIAN);
+	if (aice_usb_packet_defer(AICE_FORMAT_HTDMC + 3 * 4, AICE_FORMAT_DTHMB, NULL) != ERROR_OK)
+		return ERROR_FAIL;
+
+	aice_pack_htdmc(AICE_CMD_T_WRITE_MISC, coreid, 0, NDS_EDM_MISC_DBGER,
+			NDS_DBGER_DPED, AICE_LITTLE_ENDIAN);
+	if (aice_usb_packet_defer(AICE_FORMAT_HTDMC, AICE_FORMAT_DTHMB, NULL) != ERROR_OK)
+		return ERROR_FAIL;
+
+	aice_pack_htdmc(AICE_CMD_T_EXECUTE, coreid, 0, 0, 0, AICE_LITTLE_ENDIAN);
+	if (aice_usb_packet_defer(AICE_FORMAT_HTDMC, AICE_FORMAT_DTHMB, NULL) != ERROR_OK)
+		return ERROR_FAIL;
+
+	aice_pack_htdma(AICE_CMD_T_READ_MISC, coreid, 0, NDS_EDM_MISC_DBGER);
+	return aice_usb_packet_defer(AICE_FORMAT_HTDMA, AICE_FORMAT_DTHMA, dbger);
+}
+
+/* Read a list of registers with all commands queued behind one flush.
+ * Every register is checked afterwards the way aice_read_reg() does, and
+ * from the first one that did not complete on, the rest is read again
+ * one at a time. */
+static int aice_usb_read_reg_list(uint32_t coreid, const uint32_t *num,
+		uint32_t *val, uint32_t count)
+{
+	enum aice_command_mode saved_mode = aice_command_mode;
+	uint32_t *status = NULL;
+	uint32_t i, done = 0;
+
+	LOG_DEBUG("aice_usb_read_reg_list, count: %" PRIu32, count);
+
+	if (AICE_COMMAND_MODE_BATCH != aice_command_mode)
+		status = malloc(2 * count * sizeof(uint32_t));
+	if (status == NULL)
+		goto one_by_one;
+
+	aice_usb_packet_flush();
+	aice_command_mode = AICE_COMMAND_MODE_PACK;
+	aice_deferred_retval = ERROR_OK;
+
+	for (i = 0; i < count; i++) {
+		uint32_t instructions[4];
+		uint32_t *dbger = &status[2 * i];
+		uint32_t *edmsw = &status[2 * i + 1];
+
+		if (aice_usb_read_backup_reg(coreid, num[i], &val[i])) {
+			*dbger = NDS_DBGER_DPED;
+			*edmsw = NDS_EDMSW_WDV;
+			continue;
+		}
+		*dbger = 0;
+		*edmsw = 0;
+
+		aice_read_reg_insts(num[i], instructions);
+		if (aice_queue_execute_dim(coreid, instructions, dbger) != ERROR_OK)
+			break;
+
+		aice_pack_htdma(AICE_CMD_T_READ_EDMSR, coreid, 0, NDS_EDM_SR_EDMSW);
+		if (aice_usb_packet_defer(AICE_FORMAT_HTDMA, AICE_FORMAT_DTHMA, edmsw) != ERROR_OK)
+			break;
+
+		aice_pack_htdma(AICE_CMD_T_READ_DTR, coreid, 0, 0);
+		if (aice_usb_packet_defer(AICE_FORMAT_HTDMA, AICE_FORMAT_DTHMA, &val[i]) != ERROR_OK)
+			break;
+	}
+
+	if (aice_usb_packet_flush() != ERROR_OK || i != count)
+		aice_deferred_retval = ERROR_FAIL;
+	aice_command_mode = saved_mode;
+
+	if (aice_deferred_retval == ERROR_OK) {
+		for (done = 0; done < count; done++) {
+			uint32_t dbger = status[2 * done];
+			uint32_t edmsw = status[2 * done + 1];
+
+			if (!(dbger & NDS_DBGER_DPED) || (dbger & NDS_DBGER_ILL_SEC_ACC) ||
+					(dbger & NDS_DBGER_ALL_SUPRS_EX) == NDS_DBGER_ALL_SUPRS_EX ||
+					!(edmsw & NDS_EDMSW_WDV))
+				break;
+		}
+	}
+	free(status);
+
+	if (done < count)
+		LOG_DEBUG("queued register read stopped at %" PRIu32, done);
+
+one_by_one:
+	for (i = done; i < count; i++)
+		aice_usb_read_reg(coreid, num[i], &val[i]);
+
+	return ERROR_OK;
+}
+
 static int aice_write_reg(uint32_t coreid, uint32_t num, uint32_t val)
 {
 	LOG_DEBUG("aice_write_reg, reg_no: 0x%08" PRIx32 ", value: 0x%08" PRIx32, num, val);
@@ -4073,6 +4255,8 @@ struct aice_port_api_s aice_usb_api = {
 	/** */
 	.read_reg = aice_usb_read_reg,
 	/** */
+	.read_reg_list = aice_usb_read_reg_list,
+	/** */
 	.write_reg = aice_usb_write_reg,
 	/** */
 	.read_reg_64 = aice_usb_read_reg_64,
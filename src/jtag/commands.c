@@ -31,17 +31,25 @@
 #endif
 
 #include <jtag/jtag.h>
+#include <limits.h>
 #include "commands.h"
 
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
+	size_t size;
 	size_t used;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
+/* Pages are kept across flushes and only emptied by jtag_command_queue_reset;
+ * every CMD_QUEUE_TRIM_INTERVAL resets the pages beyond the most any of those
+ * queues needed are given back. */
+#define CMD_QUEUE_TRIM_INTERVAL 256
 static struct cmd_queue_page *cmd_queue_pages;
 static struct cmd_queue_page *cmd_queue_pages_tail;
+static unsigned int cmd_queue_pages_used, cmd_queue_pages_high_water;
+static unsigned int cmd_queue_resets;
 
 struct jtag_command *jtag_command_queue;
 static struct jtag_command **next_command_pointer = &jtag_command_queue;
@@ -98,20 +106,35 @@ void *cmd_queue_alloc(size_t size)
 	size = (size + ALIGN_SIZE - 1) & (~(ALIGN_SIZE - 1));
 	/* Done... */
 
+	/* the tail is the page being filled, the pages after it are retained
+	 * from earlier queues and still empty */
 	if (*p_page) {
 		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE - (*p_page)->used < size)
+		if ((*p_page)->size - (*p_page)->used < size) {
 			p_page = &((*p_page)->next);
+			while (*p_page && (*p_page)->size < size) {
+				/* too small for this request, drop it */
+				struct cmd_queue_page *page = *p_page;
+				*p_page = page->next;
+				free(page->address);
+				free(page);
+			}
+		}
 	}
 
 	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
-		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
+		struct cmd_queue_page *page = malloc(sizeof(struct cmd_queue_page));
+		page->used = 0;
+		page->size = (size < CMD_QUEUE_PAGE_SIZE) ?
 					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
-		(*p_page)->next = NULL;
+		page->address = malloc(page->size);
+		page->next = NULL;
+		*p_page = page;
+	}
+
+	if (*p_page != cmd_queue_pages_tail) {
 		cmd_queue_pages_tail = *p_page;
+		cmd_queue_pages_used++;
 	}
 
 	offset = (*p_page)->used;
@@ -121,19 +144,47 @@ void *cmd_queue_alloc(size_t size)
 	return t + offset;
 }
 
+bool cmd_queue_contains(const void *p)
+{
+	for (struct cmd_queue_page *page = cmd_queue_pages; page; page = page->next) {
+		const uint8_t *start = page->address;
+		if ((const uint8_t *)p >= start && (const uint8_t *)p < start + page->used)
+			return true;
+		if (page == cmd_queue_pages_tail)
+			break;
+	}
+
+	return false;
+}
+
+/* empty the pages for the next queue, keep them allocated */
 static void cmd_queue_free(void)
 {
-	struct cmd_queue_page *page = cmd_queue_pages;
+	if (cmd_queue_pages_used > cmd_queue_pages_high_water)
+		cmd_queue_pages_high_water = cmd_queue_pages_used;
+
+	unsigned int keep = UINT_MAX;
+	if (++cmd_queue_resets == CMD_QUEUE_TRIM_INTERVAL) {
+		keep = MAX(cmd_queue_pages_high_water, 1);
+		cmd_queue_resets = 0;
+		cmd_queue_pages_high_water = 0;
+	}
 
-	while (page) {
-		struct cmd_queue_page *last = page;
+	struct cmd_queue_page **p_page = &cmd_queue_pages;
+	for (unsigned int i = 0; *p_page; i++) {
+		struct cmd_queue_page *page = *p_page;
+		if (i < keep) {
+			page->used = 0;
+			p_page = &page->next;
+			continue;
+		}
+		*p_page = page->next;
 		free(page->address);
-		page = page->next;
-		free(last);
+		free(page);
 	}
 
-	cmd_queue_pages = NULL;
-	cmd_queue_pages_tail = NULL;
+	cmd_queue_pages_tail = cmd_queue_pages;
+	cmd_queue_pages_used = cmd_queue_pages ? 1 : 0;
 }
 
 void jtag_command_queue_reset(void)
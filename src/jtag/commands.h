@@ -164,6 +164,8 @@ struct jtag_command {
 extern struct jtag_command *jtag_command_queue;
 
 void *cmd_queue_alloc(size_t size);
+/** Whether p points into memory handed out by cmd_queue_alloc() for the current queue */
+bool cmd_queue_contains(const void *p);
 
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
@@ -35,6 +35,8 @@
 #include "interface.h"
 #include <transport/transport.h>
 #include <helper/jep106.h>
+#include <helper/tracelog.h>
+#include <helper/perf.h>
 
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
@@ -46,6 +48,7 @@
 
 /** The number of JTAG queue flushes (for profiling and debugging purposes). */
 static int jtag_flush_queue_count;
+PERF_COUNTER(execute_queue_perf, "jtag_execute_queue");
 
 /* Sleep this # of ms after flushing the queue */
 static int jtag_flush_queue_sleep;
@@ -94,6 +97,11 @@ static enum reset_types jtag_reset_config = RESET_NONE;
 tap_state_t cmd_queue_cur_state = TAP_RESET;
 
 static bool jtag_verify_capture_ir = true;
+static bool jtag_ir_cache = true;
+/* the cur_instr and bypass of every enabled TAP match the hardware, only
+ * after an IR scan through jtag_add_ir_scan() and until something else
+ * touches the IR: a plain or raw scan, a TAP reset, a chain change, an error */
+static bool jtag_ir_cache_valid;
 static int jtag_verify = 1;
 
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
@@ -141,6 +149,35 @@ void jtag_set_error(int error)
 	if ((error == ERROR_OK) || (jtag_error != ERROR_OK))
 		return;
 	jtag_error = error;
+	jtag_ir_cache_valid = false;
+}
+
+void jtag_invalidate_ir_cache(void)
+{
+	jtag_ir_cache_valid = false;
+}
+
+/* The scan would shift the instruction the TAP already has, with all
+ * other TAPs already in BYPASS: only the move to the end state is needed.
+ * An end state in the IR column needs the scan, leaving it would pass
+ * Update-IR with whatever Capture-IR loaded. */
+static bool jtag_ir_scan_redundant(struct jtag_tap *active,
+	const struct scan_field *field, tap_state_t state)
+{
+	if (!jtag_ir_cache || !jtag_ir_cache_valid)
+		return false;
+	if (state != TAP_IDLE && state != TAP_DRPAUSE)
+		return false;
+	if (field->in_value || !field->out_value || field->num_bits != active->ir_length)
+		return false;
+	if (active->bypass || buf_cmp(field->out_value, active->cur_instr, active->ir_length))
+		return false;
+
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap))
+		if (tap != active && !tap->bypass)
+			return false;
+
+	return true;
 }
 
 int jtag_error_clear(void)
@@ -355,10 +392,17 @@ static void jtag_prelude(tap_state_t state)
 void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field *in_fields,
 	tap_state_t state)
 {
+	if (jtag_ir_scan_redundant(active, in_fields, state)) {
+		jtag_set_error(jtag_add_statemove(state));
+		return;
+	}
+
 	jtag_prelude(state);
 
 	int retval = interface_jtag_add_ir_scan(active, in_fields, state);
 	jtag_set_error(retval);
+	if (retval == ERROR_OK)
+		jtag_ir_cache_valid = true;
 }
 
 static void jtag_add_ir_scan_noverify_callback(struct jtag_tap *active,
@@ -374,6 +418,11 @@ void jtag_add_ir_scan(struct jtag_tap *active, struct scan_field *in_fields, tap
 {
 	assert(state != TAP_RESET);
 
+	if (jtag_ir_scan_redundant(active, in_fields, state)) {
+		jtag_set_error(jtag_add_statemove(state));
+		return;
+	}
+
 	if (jtag_verify && jtag_verify_capture_ir) {
 		/* 8 x 32 bit id's is enough for all invocations */
 
@@ -395,6 +444,7 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 	assert(state != TAP_RESET);
 
 	jtag_prelude(state);
+	jtag_ir_cache_valid = false;
 
 	int retval = interface_jtag_add_plain_ir_scan(
 			num_bits, out_bits, in_bits, state);
@@ -508,6 +558,7 @@ int jtag_add_tms_seq(unsigned nbits, const uint8_t *seq, enum tap_state state)
 
 	jtag_checks();
 	cmd_queue_cur_state = state;
+	jtag_ir_cache_valid = false;
 
 	retval = interface_add_tms_seq(nbits, seq, state);
 	jtag_set_error(retval);
@@ -539,6 +590,9 @@ void jtag_add_pathmove(int num_states, const tap_state_t *path)
 			jtag_set_error(ERROR_JTAG_TRANSITION_INVALID);
 			return;
 		}
+		/* the IR now holds what was shifted or captured */
+		if (path[i] == TAP_IRUPDATE)
+			jtag_ir_cache_valid = false;
 		cur_state = path[i];
 	}
 
@@ -841,9 +895,15 @@ int default_interface_jtag_execute_queue(void)
 
 void jtag_execute_queue_noclear(void)
 {
+	int64_t start_us = tracelog_enabled ? tracelog_time_us() : 0;
+	int64_t start = perf_start();
+
 	jtag_flush_queue_count++;
 	jtag_set_error(interface_jtag_execute_queue());
 
+	perf_stop(&execute_queue_perf, start);
+	tracelog_complete(TRACELOG_ADAPTER, "execute_queue", start_us, jtag_flush_queue_count, 0);
+
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
 		 * or behavior when delaying after flushing the queue,
@@ -874,6 +934,7 @@ static int jtag_reset_callback(enum jtag_event event, void *priv)
 		/* current instruction is either BYPASS or IDCODE */
 		buf_set_ones(tap->cur_instr, tap->ir_length);
 		tap->bypass = 1;
+		jtag_ir_cache_valid = false;
 	}
 
 	return ERROR_OK;
@@ -1690,6 +1751,16 @@ bool jtag_will_verify_capture_ir()
 	return jtag_verify_capture_ir;
 }
 
+void jtag_set_ir_cache(bool enable)
+{
+	jtag_ir_cache = enable;
+}
+
+bool jtag_will_cache_ir(void)
+{
+	return jtag_ir_cache;
+}
+
 int jtag_power_dropout(int *dropout)
 {
 	if (jtag == NULL) {
@@ -106,10 +106,17 @@ static int bitbang_execute_tms(struct jtag_command *cmd)
 	DEBUG_JTAG_IO("TMS: %d bits", num_bits);
 
 	int tms = 0;
-	for (unsigned i = 0; i < num_bits; i++) {
-		tms = ((bits[i/8] >> (i % 8)) & 1);
-		bitbang_interface->write(0, tms, 0);
-		bitbang_interface->write(1, tms, 0);
+	if (bitbang_interface->scan && num_bits > 0) {
+		int retval = bitbang_interface->scan(bits, NULL, NULL, num_bits);
+		if (retval != ERROR_OK)
+			return retval;
+		tms = (bits[(num_bits - 1) / 8] >> ((num_bits - 1) % 8)) & 1;
+	} else {
+		for (unsigned i = 0; i < num_bits; i++) {
+			tms = ((bits[i/8] >> (i % 8)) & 1);
+			bitbang_interface->write(0, tms, 0);
+			bitbang_interface->write(1, tms, 0);
+		}
 	}
 	bitbang_interface->write(CLOCK_IDLE(), tms, 0);
 
@@ -185,7 +192,25 @@ static void bitbang_stableclocks(int num_cycles)
 	}
 }
 
-static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int scan_size)
+/* hand the whole shift to the driver, TMS only rises on the last bit */
+static int bitbang_scan_bulk(enum scan_type type, uint8_t *buffer, int scan_size)
+{
+	uint8_t *tms = calloc(DIV_ROUND_UP(scan_size, 8), 1);
+	if (tms == NULL)
+		return ERROR_FAIL;
+
+	tms[(scan_size - 1) / 8] |= 1 << ((scan_size - 1) % 8);
+
+	int retval = bitbang_interface->scan(tms,
+			type == SCAN_IN ? NULL : buffer,
+			type == SCAN_OUT ? NULL : buffer,
+			scan_size);
+
+	free(tms);
+	return retval;
+}
+
+static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int scan_size)
 {
 	tap_state_t saved_end_state = tap_get_end_state();
 	int bit_cnt;
@@ -202,6 +227,13 @@ static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 		bitbang_end_state(saved_end_state);
 	}
 
+	if (bitbang_interface->scan && scan_size > 0) {
+		int retval = bitbang_scan_bulk(type, buffer, scan_size);
+		if (retval != ERROR_OK)
+			return retval;
+		scan_size = 0;	/* nothing left for the loops below */
+	}
+
 	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
 		int val = 0;
 		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
@@ -219,12 +251,16 @@ static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 
 		bitbang_interface->write(0, tms, tdi);
 
-		if (type != SCAN_OUT)
-			val = bitbang_interface->read();
+		if (type != SCAN_OUT) {
+			if (bitbang_interface->sample)
+				bitbang_interface->sample();
+			else
+				val = bitbang_interface->read();
+		}
 
 		bitbang_interface->write(1, tms, tdi);
 
-		if (type != SCAN_OUT) {
+		if (type != SCAN_OUT && !bitbang_interface->sample) {
 			if (val)
 				buffer[bytec] |= bcval;
 			else
@@ -232,6 +268,19 @@ static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 		}
 	}
 
+	/* collect the samples queued above, the tdi bits have all gone out */
+	if (type != SCAN_OUT && bitbang_interface->sample) {
+		for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
+			int bytec = bit_cnt/8;
+			int bcval = 1 << (bit_cnt % 8);
+
+			if (bitbang_interface->read_sample())
+				buffer[bytec] |= bcval;
+			else
+				buffer[bytec] &= ~bcval;
+		}
+	}
+
 	if (tap_get_state() != tap_get_end_state()) {
 		/* we *KNOW* the above loop transitioned out of
 		 * the shift state, so we skip the first state
@@ -239,6 +288,8 @@ static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 		 */
 		bitbang_state_move(1);
 	}
+
+	return ERROR_OK;
 }
 
 int bitbang_execute_queue(void)
@@ -317,8 +368,9 @@ int bitbang_execute_queue(void)
 				bitbang_end_state(cmd->cmd.scan->end_state);
 				scan_size = jtag_build_buffer(cmd->cmd.scan, &buffer);
 				type = jtag_scan_type(cmd->cmd.scan);
-				bitbang_scan(cmd->cmd.scan->ir_scan, type, buffer, scan_size);
-				if (jtag_read_buffer(buffer, cmd->cmd.scan) != ERROR_OK)
+				if (bitbang_scan(cmd->cmd.scan->ir_scan, type, buffer, scan_size) != ERROR_OK)
+					retval = ERROR_JTAG_QUEUE_FAILED;
+				else if (jtag_read_buffer(buffer, cmd->cmd.scan) != ERROR_OK)
 					retval = ERROR_JTAG_QUEUE_FAILED;
 				if (buffer)
 					free(buffer);
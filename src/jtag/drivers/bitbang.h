@@ -31,6 +31,15 @@ struct bitbang_interface {
 	void (*write)(int tck, int tms, int tdi);
 	void (*reset)(int trst, int srst);
 	void (*blink)(int on);
+	/* optional: queue a tdo sample and fetch queued samples later, in order,
+	 * instead of waiting for each read */
+	void (*sample)(void);
+	int (*read_sample)(void);
+	/* optional: clock out a whole shift at once. tms and tdi are packed
+	 * lsb first, NULL meaning all zeroes; tdo receives the captured bits
+	 * unless NULL and may be the same buffer as tdi. Each bit is clocked
+	 * like write(0, ...), read(), write(1, ...), so TCK is left high. */
+	int (*scan)(const uint8_t *tms, const uint8_t *tdi, uint8_t *tdo, unsigned int bits);
 	int (*swdio_read)(void);
 	void (*swdio_drive)(bool on);
 };
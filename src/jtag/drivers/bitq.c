@@ -170,7 +170,17 @@ static void bitq_scan_field(struct scan_field *field, int do_pause)
 	else
 		tdo_req = 0;
 
-	if (field->out_value == NULL) {
+	if (bitq_interface->out_bits && field->num_bits > 1) {
+		/* all but the last bit in one go, TMS stays low for them */
+		int last = field->num_bits - 1;
+
+		bitq_interface->out_bits(NULL, field->out_value, last, tdo_req);
+		if (bitq_interface->in_rdy())
+			bitq_in_proc();
+
+		int tdi = field->out_value && (field->out_value[last / 8] & (1 << (last % 8)));
+		bitq_io(do_pause, tdi, tdo_req);
+	} else if (field->out_value == NULL) {
 		/* just send zeros and request data from TDO */
 		for (bit_cnt = field->num_bits; bit_cnt > 1; bit_cnt--)
 			bitq_io(0, 0, tdo_req);
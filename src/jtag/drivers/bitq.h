@@ -24,6 +24,10 @@
 struct bitq_interface {
 	/* function to enqueueing low level IO requests */
 	int (*out)(int tms, int tdi, int tdo_req);
+	/* optional: enqueue a run of bits at once, tms and tdi packed lsb
+	 * first with NULL meaning all zeroes; requested TDO still comes back
+	 * through in(), one bit per call */
+	int (*out_bits)(const uint8_t *tms, const uint8_t *tdi, unsigned int bits, int tdo_req);
 	int (*flush)(void);
 
 	int (*sleep)(unsigned long us);
@@ -39,6 +39,9 @@
 #include <jtag/tcl.h>
 
 #include <hidapi.h>
+#if HAVE_LIBUSB1
+#include "libusb1_common.h"
+#endif
 
 /*
  * See CMSIS-DAP documentation:
@@ -165,6 +168,13 @@ static const char * const info_caps_str[] = {
 
 struct cmsis_dap {
 	hid_device *dev_handle;
+#if HAVE_LIBUSB1
+	/* CMSIS-DAP v2 probes: bulk endpoints instead of HID reports */
+	struct jtag_libusb_device_handle *bulk_handle;
+	int bulk_interface;
+	unsigned int ep_out;
+	unsigned int ep_in;
+#endif
 	uint16_t packet_size;
 	uint16_t packet_count;
 	uint8_t *packet_buffer;
@@ -208,6 +218,127 @@ static int queued_retval;
 
 static struct cmsis_dap *cmsis_dap_handle;
 
+#if HAVE_LIBUSB1
+static struct libusb_context *cmsis_dap_libusb_context;
+
+/* A CMSIS-DAP v2 interface is vendor class, names itself "CMSIS-DAP" in
+ * its interface string and starts with a bulk OUT and a bulk IN endpoint. */
+static bool cmsis_dap_bulk_interface(libusb_device_handle *devh,
+		const struct libusb_interface_descriptor *intf)
+{
+	char name[256];
+
+	if (intf->bInterfaceClass != LIBUSB_CLASS_VENDOR_SPEC || intf->bNumEndpoints < 2)
+		return false;
+
+	const struct libusb_endpoint_descriptor *out = &intf->endpoint[0];
+	const struct libusb_endpoint_descriptor *in = &intf->endpoint[1];
+	if ((out->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_BULK ||
+	    (in->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_BULK ||
+	    (out->bEndpointAddress & LIBUSB_ENDPOINT_IN) ||
+	    !(in->bEndpointAddress & LIBUSB_ENDPOINT_IN))
+		return false;
+
+	if (intf->iInterface == 0 || libusb_get_string_descriptor_ascii(devh, intf->iInterface,
+			(unsigned char *)name, sizeof(name)) < 0)
+		return false;
+
+	return strstr(name, "CMSIS-DAP") != NULL;
+}
+
+static bool cmsis_dap_bulk_serial_matches(libusb_device_handle *devh, uint8_t index)
+{
+	char serial[256];
+	wchar_t wserial[256];
+
+	if (cmsis_dap_serial == NULL)
+		return true;
+
+	if (index == 0 || libusb_get_string_descriptor_ascii(devh, index,
+			(unsigned char *)serial, sizeof(serial)) < 0)
+		return false;
+
+	if (mbstowcs(wserial, serial, 256) == (size_t)-1)
+		return false;
+	wserial[255] = 0;
+
+	return wcscmp(wserial, cmsis_dap_serial) == 0;
+}
+
+/* Look for a CMSIS-DAP v2 probe and claim its bulk interface */
+static int cmsis_dap_usb_open_bulk(void)
+{
+	libusb_device **devs;
+	libusb_device_handle *devh = NULL;
+	const struct libusb_interface_descriptor *found = NULL;
+	uint16_t vid = 0;
+
+	if (libusb_init(&cmsis_dap_libusb_context) < 0)
+		return ERROR_FAIL;
+
+	ssize_t cnt = libusb_get_device_list(cmsis_dap_libusb_context, &devs);
+
+	for (ssize_t idx = 0; idx < cnt && found == NULL; idx++) {
+		struct libusb_device_descriptor desc;
+		struct libusb_config_descriptor *config;
+
+		if (libusb_get_device_descriptor(devs[idx], &desc) != 0)
+			continue;
+
+		if (cmsis_dap_vid[0] || cmsis_dap_pid[0]) {
+			int i;
+			for (i = 0; cmsis_dap_vid[i] || cmsis_dap_pid[i]; i++) {
+				if (cmsis_dap_vid[i] == desc.idVendor && cmsis_dap_pid[i] == desc.idProduct)
+					break;
+			}
+			if (!cmsis_dap_vid[i] && !cmsis_dap_pid[i])
+				continue;
+		}
+
+		if (libusb_get_config_descriptor(devs[idx], 0, &config) != 0)
+			continue;
+
+		if (libusb_open(devs[idx], &devh) != 0) {
+			libusb_free_config_descriptor(config);
+			continue;
+		}
+
+		if (cmsis_dap_bulk_serial_matches(devh, desc.iSerialNumber)) {
+			for (int i = 0; i < config->bNumInterfaces && found == NULL; i++) {
+				const struct libusb_interface_descriptor *intf = &config->interface[i].altsetting[0];
+				if (cmsis_dap_bulk_interface(devh, intf) &&
+				    libusb_claim_interface(devh, intf->bInterfaceNumber) == 0) {
+					found = intf;
+					vid = desc.idVendor;
+					cmsis_dap_handle->bulk_handle = devh;
+					cmsis_dap_handle->bulk_interface = intf->bInterfaceNumber;
+					cmsis_dap_handle->ep_out = intf->endpoint[0].bEndpointAddress;
+					cmsis_dap_handle->ep_in = intf->endpoint[1].bEndpointAddress;
+					cmsis_dap_handle->packet_size = intf->endpoint[1].wMaxPacketSize + 1;
+				}
+			}
+		}
+
+		libusb_free_config_descriptor(config);
+		if (found == NULL)
+			libusb_close(devh);
+	}
+
+	if (cnt >= 0)
+		libusb_free_device_list(devs, 1);
+
+	if (found == NULL) {
+		libusb_exit(cmsis_dap_libusb_context);
+		cmsis_dap_libusb_context = NULL;
+		return ERROR_FAIL;
+	}
+
+	LOG_INFO("CMSIS-DAP: using the v2 bulk interface of 0x%04x", vid);
+
+	return ERROR_OK;
+}
+#endif
+
 static int cmsis_dap_usb_open(void)
 {
 	hid_device *dev = NULL;
@@ -222,6 +353,27 @@ static int cmsis_dap_usb_open(void)
 	target_vid = 0;
 	target_pid = 0;
 
+#if HAVE_LIBUSB1
+	/* prefer the bulk interface, HID reports are a fallback */
+	cmsis_dap_handle = calloc(1, sizeof(struct cmsis_dap));
+	if (cmsis_dap_handle == NULL) {
+		LOG_ERROR("unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	if (cmsis_dap_usb_open_bulk() == ERROR_OK) {
+		cmsis_dap_handle->packet_buffer = malloc(cmsis_dap_handle->packet_size);
+		if (cmsis_dap_handle->packet_buffer == NULL) {
+			LOG_ERROR("unable to allocate memory");
+			return ERROR_FAIL;
+		}
+		return ERROR_OK;
+	}
+
+	free(cmsis_dap_handle);
+	cmsis_dap_handle = NULL;
+#endif
+
 	/*
 	 * The CMSIS-DAP specification stipulates:
 	 * "The Product String must contain "CMSIS-DAP" somewhere in the string. This is used by the
@@ -296,7 +448,7 @@ static int cmsis_dap_usb_open(void)
 		return ERROR_FAIL;
 	}
 
-	struct cmsis_dap *dap = malloc(sizeof(struct cmsis_dap));
+	struct cmsis_dap *dap = calloc(1, sizeof(struct cmsis_dap));
 	if (dap == NULL) {
 		LOG_ERROR("unable to allocate memory");
 		return ERROR_FAIL;
@@ -334,8 +486,18 @@ static int cmsis_dap_usb_open(void)
 
 static void cmsis_dap_usb_close(struct cmsis_dap *dap)
 {
-	hid_close(dap->dev_handle);
-	hid_exit();
+#if HAVE_LIBUSB1
+	if (dap->bulk_handle) {
+		libusb_release_interface(dap->bulk_handle, dap->bulk_interface);
+		libusb_close(dap->bulk_handle);
+		libusb_exit(cmsis_dap_libusb_context);
+		cmsis_dap_libusb_context = NULL;
+	} else
+#endif
+	{
+		hid_close(dap->dev_handle);
+		hid_exit();
+	}
 
 	free(cmsis_dap_handle->packet_buffer);
 	free(cmsis_dap_handle);
@@ -349,11 +511,24 @@ static void cmsis_dap_usb_close(struct cmsis_dap *dap)
 }
 
 /* Send a message and receive the reply */
-static int cmsis_dap_usb_xfer(struct cmsis_dap *dap, int txlen)
+static int cmsis_dap_usb_write(struct cmsis_dap *dap, int txlen)
 {
 #ifdef CMSIS_DAP_JTAG_DEBUG
 	LOG_DEBUG("cmsis-dap usb xfer cmd=%02X", dap->packet_buffer[1]);
 #endif
+#if HAVE_LIBUSB1
+	/* bulk transfers carry no report number and need no padding */
+	if (dap->bulk_handle) {
+		int sent = jtag_libusb_bulk_write(dap->bulk_handle, dap->ep_out,
+				(char *)dap->packet_buffer + 1, txlen - 1, USB_TIMEOUT);
+		if (sent != txlen - 1) {
+			LOG_ERROR("error writing data");
+			return ERROR_FAIL;
+		}
+		return ERROR_OK;
+	}
+#endif
+
 	/* Pad the rest of the TX buffer with 0's */
 	memset(dap->packet_buffer + txlen, 0, dap->packet_size - txlen);
 
@@ -364,8 +539,25 @@ static int cmsis_dap_usb_xfer(struct cmsis_dap *dap, int txlen)
 		return ERROR_FAIL;
 	}
 
-	/* get reply */
-	retval = hid_read_timeout(dap->dev_handle, dap->packet_buffer, dap->packet_size, USB_TIMEOUT);
+	return ERROR_OK;
+}
+
+/* replies come back in the order the commands were written */
+static int cmsis_dap_usb_read(struct cmsis_dap *dap)
+{
+#if HAVE_LIBUSB1
+	if (dap->bulk_handle) {
+		int got = jtag_libusb_bulk_read(dap->bulk_handle, dap->ep_in,
+				(char *)dap->packet_buffer, dap->packet_size - 1, USB_TIMEOUT);
+		if (got <= 0) {
+			LOG_DEBUG("error reading data");
+			return ERROR_FAIL;
+		}
+		return ERROR_OK;
+	}
+#endif
+
+	int retval = hid_read_timeout(dap->dev_handle, dap->packet_buffer, dap->packet_size, USB_TIMEOUT);
 	if (retval == -1 || retval == 0) {
 		LOG_DEBUG("error reading data: %ls", hid_error(dap->dev_handle));
 		return ERROR_FAIL;
@@ -374,6 +566,15 @@ static int cmsis_dap_usb_xfer(struct cmsis_dap *dap, int txlen)
 	return ERROR_OK;
 }
 
+static int cmsis_dap_usb_xfer(struct cmsis_dap *dap, int txlen)
+{
+	int retval = cmsis_dap_usb_write(dap, txlen);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return cmsis_dap_usb_read(dap);
+}
+
 static int cmsis_dap_cmd_DAP_SWJ_Pins(uint8_t pins, uint8_t mask, uint32_t delay, uint8_t *input)
 {
 	int retval;
@@ -590,27 +791,66 @@ static int cmsis_dap_cmd_DAP_Delay(uint16_t delay_us)
 }
 #endif
 
-static int cmsis_dap_swd_run_queue(void)
+/* a run of at least this many identical transfers, typically DRW
+ * accesses of a MEM-AP block transfer, goes out as DAP_TransferBlock */
+#define CMSIS_DAP_TFER_BLOCK_MIN	4
+
+static uint32_t cmsis_dap_swd_last_read;
+
+/* number of identical transfers starting at first, looking at most limit far */
+static int cmsis_dap_swd_run_length(int first, int limit)
 {
-	uint8_t *buffer = cmsis_dap_handle->packet_buffer;
+	int n = 1;
 
-	LOG_DEBUG("Executing %d queued transactions", pending_transfer_count);
+	while (n < limit && first + n < pending_transfer_count &&
+	       pending_transfers[first + n].cmd == pending_transfers[first].cmd)
+		n++;
 
-	if (queued_retval != ERROR_OK) {
-		LOG_DEBUG("Skipping due to previous errors: %d", queued_retval);
-		goto skip;
+	return n;
+}
+
+static int cmsis_dap_swd_check_ack(uint8_t response)
+{
+	uint8_t ack = response & 0x07;
+
+	if (ack != SWD_ACK_OK || (response & 0x08)) {
+		LOG_DEBUG("SWD ack not OK: %d %s", response,
+			  ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK");
+		return ack == SWD_ACK_WAIT ? ERROR_WAIT : ERROR_FAIL;
 	}
 
-	if (!pending_transfer_count)
-		goto skip;
+	return ERROR_OK;
+}
+
+static void cmsis_dap_swd_read_result(int i, uint32_t data)
+{
+	uint32_t tmp = data;
+
+	LOG_DEBUG("Read result: %"PRIx32, data);
+
+	/* Imitate posted AP reads */
+	if ((pending_transfers[i].cmd & SWD_CMD_APnDP) ||
+	    ((pending_transfers[i].cmd & SWD_CMD_A32) >> 1 == DP_RDBUFF)) {
+		tmp = cmsis_dap_swd_last_read;
+		cmsis_dap_swd_last_read = data;
+	}
+
+	if (pending_transfers[i].buffer)
+		*(uint32_t *)pending_transfers[i].buffer = tmp;
+}
+
+/* DAP_Transfer: a request byte per transfer, data for writes only */
+static int cmsis_dap_swd_tfer_send(int first, int count)
+{
+	uint8_t *buffer = cmsis_dap_handle->packet_buffer;
 
 	size_t idx = 0;
 	buffer[idx++] = 0;	/* report number */
 	buffer[idx++] = CMD_DAP_TFER;
 	buffer[idx++] = 0x00;	/* DAP Index */
-	buffer[idx++] = pending_transfer_count;
+	buffer[idx++] = count;
 
-	for (int i = 0; i < pending_transfer_count; i++) {
+	for (int i = first; i < first + count; i++) {
 		uint8_t cmd = pending_transfers[i].cmd;
 		uint32_t data = pending_transfers[i].data;
 
@@ -619,25 +859,6 @@ static int cmsis_dap_swd_run_queue(void)
 				cmd & SWD_CMD_RnW ? "read" : "write",
 			  (cmd & SWD_CMD_A32) >> 1, data);
 
-		/* When proper WAIT handling is implemented in the
-		 * common SWD framework, this kludge can be
-		 * removed. However, this might lead to minor
-		 * performance degradation as the adapter wouldn't be
-		 * able to automatically retry anything (because ARM
-		 * has forgotten to implement sticky error flags
-		 * clearing). See also comments regarding
-		 * cmsis_dap_cmd_DAP_TFER_Configure() and
-		 * cmsis_dap_cmd_DAP_SWD_Configure() in
-		 * cmsis_dap_init().
-		 */
-		if (!(cmd & SWD_CMD_RnW) &&
-		    !(cmd & SWD_CMD_APnDP) &&
-		    (cmd & SWD_CMD_A32) >> 1 == DP_CTRL_STAT &&
-		    (data & CORUNDETECT)) {
-			LOG_DEBUG("refusing to enable sticky overrun detection");
-			data &= ~CORUNDETECT;
-		}
-
 		buffer[idx++] = (cmd >> 1) & 0x0f;
 		if (!(cmd & SWD_CMD_RnW)) {
 			buffer[idx++] = (data) & 0xff;
@@ -647,42 +868,178 @@ static int cmsis_dap_swd_run_queue(void)
 		}
 	}
 
-	queued_retval = cmsis_dap_usb_xfer(cmsis_dap_handle, idx);
-	if (queued_retval != ERROR_OK)
-		goto skip;
+	return cmsis_dap_usb_write(cmsis_dap_handle, idx);
+}
 
-	idx = 2;
-	uint8_t ack = buffer[idx] & 0x07;
-	if (ack != SWD_ACK_OK || (buffer[idx] & 0x08)) {
-		LOG_DEBUG("SWD ack not OK: %d %s", buffer[idx-1],
-			  ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK");
-		queued_retval = ack == SWD_ACK_WAIT ? ERROR_WAIT : ERROR_FAIL;
-		goto skip;
-	}
-	idx++;
+static int cmsis_dap_swd_tfer_recv(int first, int count)
+{
+	uint8_t *buffer = cmsis_dap_handle->packet_buffer;
+
+	int retval = cmsis_dap_usb_read(cmsis_dap_handle);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = cmsis_dap_swd_check_ack(buffer[2]);
+	if (retval != ERROR_OK)
+		return retval;
 
-	if (pending_transfer_count != buffer[1])
+	if (count != buffer[1])
 		LOG_ERROR("CMSIS-DAP transfer count mismatch: expected %d, got %d",
-			  pending_transfer_count, buffer[1]);
+			  count, buffer[1]);
 
-	for (int i = 0; i < buffer[1]; i++) {
+	size_t idx = 3;
+	for (int i = first; i < first + buffer[1]; i++) {
 		if (pending_transfers[i].cmd & SWD_CMD_RnW) {
-			static uint32_t last_read;
-			uint32_t data = le_to_h_u32(&buffer[idx]);
-			uint32_t tmp = data;
+			cmsis_dap_swd_read_result(i, le_to_h_u32(&buffer[idx]));
+			idx += 4;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* DAP_TransferBlock: one request byte for count transfers to the same register */
+static int cmsis_dap_swd_tfer_block_send(int first, int count)
+{
+	uint8_t *buffer = cmsis_dap_handle->packet_buffer;
+	uint8_t cmd = pending_transfers[first].cmd;
+
+	LOG_DEBUG("%s %s reg %x, block of %d",
+			cmd & SWD_CMD_APnDP ? "AP" : "DP",
+			cmd & SWD_CMD_RnW ? "read" : "write",
+		  (cmd & SWD_CMD_A32) >> 1, count);
+
+	size_t idx = 0;
+	buffer[idx++] = 0;	/* report number */
+	buffer[idx++] = CMD_DAP_TFER_BLOCK;
+	buffer[idx++] = 0x00;	/* DAP Index */
+	buffer[idx++] = count & 0xff;
+	buffer[idx++] = (count >> 8) & 0xff;
+	buffer[idx++] = (cmd >> 1) & 0x0f;
+	if (!(cmd & SWD_CMD_RnW)) {
+		for (int i = first; i < first + count; i++) {
+			h_u32_to_le(&buffer[idx], pending_transfers[i].data);
 			idx += 4;
+		}
+	}
+
+	return cmsis_dap_usb_write(cmsis_dap_handle, idx);
+}
+
+static int cmsis_dap_swd_tfer_block_recv(int first, int count)
+{
+	uint8_t *buffer = cmsis_dap_handle->packet_buffer;
+	uint8_t cmd = pending_transfers[first].cmd;
+
+	int retval = cmsis_dap_usb_read(cmsis_dap_handle);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = cmsis_dap_swd_check_ack(buffer[3]);
+	if (retval != ERROR_OK)
+		return retval;
+
+	int done = le_to_h_u16(&buffer[1]);
+	if (count != done)
+		LOG_ERROR("CMSIS-DAP transfer count mismatch: expected %d, got %d",
+			  count, done);
+
+	if (cmd & SWD_CMD_RnW) {
+		size_t idx = 4;
+		for (int i = first; i < first + done; i++) {
+			cmsis_dap_swd_read_result(i, le_to_h_u32(&buffer[idx]));
+			idx += 4;
+		}
+	}
 
-			LOG_DEBUG("Read result: %"PRIx32, data);
+	return ERROR_OK;
+}
+
+/* packets written whose reply is still to be read, oldest first */
+#define CMSIS_DAP_MAX_PACKETS_IN_FLIGHT	8
+
+static struct {
+	int first;
+	int count;
+	bool block;
+} in_flight[CMSIS_DAP_MAX_PACKETS_IN_FLIGHT];
+
+/* Split the queue into packets and keep up to the probe's packet count
+ * of them outstanding, so that USB latency is paid once per queue rather
+ * than once per packet.  Once a reply reports an error nothing more is
+ * sent, but the replies to packets already written are still read. */
+static int cmsis_dap_swd_run_queue(void)
+{
+	/* payload room of one packet, both directions */
+	int room = cmsis_dap_handle->packet_size - 1;
+	int max_in_flight = MIN(MAX(cmsis_dap_handle->packet_count, 1),
+			CMSIS_DAP_MAX_PACKETS_IN_FLIGHT);
+	int head = 0, n_in_flight = 0;
+	int i = 0;
+
+	LOG_DEBUG("Executing %d queued transactions", pending_transfer_count);
 
-			/* Imitate posted AP reads */
-			if ((pending_transfers[i].cmd & SWD_CMD_APnDP) ||
-			    ((pending_transfers[i].cmd & SWD_CMD_A32) >> 1 == DP_RDBUFF)) {
-				tmp = last_read;
-				last_read = data;
+	if (queued_retval != ERROR_OK) {
+		LOG_DEBUG("Skipping due to previous errors: %d", queued_retval);
+		goto skip;
+	}
+
+	while (i < pending_transfer_count || n_in_flight) {
+		if (i < pending_transfer_count && n_in_flight < max_in_flight) {
+			/* block header is 5 bytes out, 4 bytes back */
+			int block_max = (room - 5) / 4;
+			int n = cmsis_dap_swd_run_length(i, block_max);
+			bool block = n >= CMSIS_DAP_TFER_BLOCK_MIN;
+
+			if (!block) {
+				/* everything up to the next long run goes out as DAP_Transfer,
+				 * with its 3 header bytes out and 3 back */
+				int out = 3, in = 3;
+				n = 0;
+				while (i + n < pending_transfer_count && n < 255) {
+					bool read = pending_transfers[i + n].cmd & SWD_CMD_RnW;
+					int out_n = read ? 1 : 5;
+					int in_n = read ? 4 : 0;
+
+					if (out + out_n > room || in + in_n > room)
+						break;
+					if (n && cmsis_dap_swd_run_length(i + n, CMSIS_DAP_TFER_BLOCK_MIN)
+							>= CMSIS_DAP_TFER_BLOCK_MIN)
+						break;
+
+					out += out_n;
+					in += in_n;
+					n++;
+				}
 			}
 
-			if (pending_transfers[i].buffer)
-				*(uint32_t *)pending_transfers[i].buffer = tmp;
+			int retval = block ? cmsis_dap_swd_tfer_block_send(i, n)
+					: cmsis_dap_swd_tfer_send(i, n);
+			if (retval != ERROR_OK) {
+				/* the probe is gone, do not wait for replies */
+				queued_retval = retval;
+				goto skip;
+			}
+
+			int slot = (head + n_in_flight) % CMSIS_DAP_MAX_PACKETS_IN_FLIGHT;
+			in_flight[slot].first = i;
+			in_flight[slot].count = n;
+			in_flight[slot].block = block;
+			n_in_flight++;
+			i += n;
+			continue;
+		}
+
+		int retval = in_flight[head].block
+				? cmsis_dap_swd_tfer_block_recv(in_flight[head].first, in_flight[head].count)
+				: cmsis_dap_swd_tfer_recv(in_flight[head].first, in_flight[head].count);
+		head = (head + 1) % CMSIS_DAP_MAX_PACKETS_IN_FLIGHT;
+		n_in_flight--;
+
+		if (retval != ERROR_OK && queued_retval == ERROR_OK) {
+			queued_retval = retval;
+			/* send nothing more after a failure */
+			i = pending_transfer_count;
 		}
 	}
 
@@ -704,6 +1061,25 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 	if (queued_retval != ERROR_OK)
 		return;
 
+	/* When proper WAIT handling is implemented in the
+	 * common SWD framework, this kludge can be
+	 * removed. However, this might lead to minor
+	 * performance degradation as the adapter wouldn't be
+	 * able to automatically retry anything (because ARM
+	 * has forgotten to implement sticky error flags
+	 * clearing). See also comments regarding
+	 * cmsis_dap_cmd_DAP_TFER_Configure() and
+	 * cmsis_dap_cmd_DAP_SWD_Configure() in
+	 * cmsis_dap_init().
+	 */
+	if (!(cmd & SWD_CMD_RnW) &&
+	    !(cmd & SWD_CMD_APnDP) &&
+	    (cmd & SWD_CMD_A32) >> 1 == DP_CTRL_STAT &&
+	    (data & CORUNDETECT)) {
+		LOG_DEBUG("refusing to enable sticky overrun detection");
+		data &= ~CORUNDETECT;
+	}
+
 	pending_transfers[pending_transfer_count].data = data;
 	pending_transfers[pending_transfer_count].cmd = cmd;
 	if (cmd & SWD_CMD_RnW) {
@@ -899,10 +1275,12 @@ static int cmsis_dap_init(void)
 	if (data[0] == 2) {  /* short */
 		uint16_t pkt_sz = data[1] + (data[2] << 8);
 
-		/* 4 bytes of command header + 5 bytes per register
-		 * write. For bulk read sequences just 4 bytes are
-		 * needed per transfer, so this is suboptimal. */
-		pending_queue_len = (pkt_sz - 4) / 5;
+		/* The queue is run in as many packets as it takes,
+		 * mixed transfers at 5 bytes per register write and
+		 * block transfers at 4 bytes per word; let it hold as
+		 * many packets' worth of block transfers as can be
+		 * in flight at once. */
+		pending_queue_len = CMSIS_DAP_MAX_PACKETS_IN_FLIGHT * ((pkt_sz - 5) / 4);
 		pending_transfers = malloc(pending_queue_len * sizeof(*pending_transfers));
 		if (!pending_transfers) {
 			LOG_ERROR("Unable to allocate memory for CMSIS-DAP queue");
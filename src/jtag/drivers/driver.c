@@ -58,12 +58,19 @@ static void jtag_callback_queue_reset(void)
 /**
  * Copy a struct scan_field for insertion into the queue.
  *
- * This allocates a new copy of out_value using cmd_queue_alloc.
+ * This allocates a new copy of out_value using cmd_queue_alloc, unless
+ * there is nothing to copy or the value already lives in the queue and
+ * has no trailing bits to mask.
  */
 static void cmd_queue_scan_field_clone(struct scan_field *dst, const struct scan_field *src)
 {
 	dst->num_bits	= src->num_bits;
-	dst->out_value	= buf_cpy(src->out_value, cmd_queue_alloc(DIV_ROUND_UP(src->num_bits, 8)), src->num_bits);
+	if (src->out_value == NULL)
+		dst->out_value = NULL;
+	else if (src->num_bits % 8 == 0 && cmd_queue_contains(src->out_value))
+		dst->out_value = src->out_value;
+	else
+		dst->out_value = buf_cpy(src->out_value, cmd_queue_alloc(DIV_ROUND_UP(src->num_bits, 8)), src->num_bits);
 	dst->in_value	= src->in_value;
 }
 
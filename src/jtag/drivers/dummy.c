@@ -21,9 +21,38 @@
 #endif
 
 #include <jtag/interface.h>
+#include <jtag/commands.h>
 #include "bitbang.h"
 #include "hello.h"
 
+/* bytes a queued command costs on the link besides its scan bits */
+#define DUMMY_CMD_OVERHEAD	4
+
+/* cost of the link to an imaginary adapter, charged per queue flush */
+struct dummy_link {
+	const char *name;
+	unsigned int latency_us;	/* per transaction */
+	unsigned int kbps;			/* kB/s, 0 for no limit */
+	unsigned int packet;		/* bytes per transaction, 0 for one per flush */
+};
+
+/* Nu-Link1: full speed HID, a 64 byte report out and one back each
+ * transaction; Nu-Link2: high speed, 1024 byte reports */
+static const struct dummy_link dummy_links[] = {
+	{ "none", 0, 0, 0 },
+	{ "nulink1", 2000, 0, 64 },
+	{ "nulink2", 250, 0, 1024 },
+};
+
+static struct dummy_link dummy_link = { "none", 0, 0, 0 };
+
+static struct {
+	uint64_t flushes;
+	uint64_t transactions;
+	uint64_t bytes;
+	uint64_t delay_us;
+} dummy_stats;
+
 /* my private tap controller state, which tracks state for calling code */
 static tap_state_t dummy_state = TAP_RESET;
 
@@ -116,6 +145,86 @@ static int dummy_speed(int speed)
 	return ERROR_OK;
 }
 
+static int dummy_execute_queue(void)
+{
+	uint64_t bytes = 0, transactions, delay;
+	int retval;
+
+	if (!jtag_command_queue)
+		return bitbang_execute_queue();
+
+	for (struct jtag_command *cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		bytes += DUMMY_CMD_OVERHEAD;
+		if (cmd->type == JTAG_SCAN)
+			bytes += DIV_ROUND_UP(jtag_scan_size(cmd->cmd.scan), 8);
+	}
+
+	transactions = dummy_link.packet ? DIV_ROUND_UP(bytes, dummy_link.packet) : 1;
+	delay = transactions * dummy_link.latency_us;
+	if (dummy_link.kbps)
+		delay += bytes * 1000 / dummy_link.kbps;
+
+	dummy_stats.flushes++;
+	dummy_stats.transactions += transactions;
+	dummy_stats.bytes += bytes;
+	dummy_stats.delay_us += delay;
+
+	retval = bitbang_execute_queue();
+
+	if (delay)
+		jtag_sleep(delay > UINT32_MAX ? UINT32_MAX : delay);
+
+	return retval;
+}
+
+COMMAND_HANDLER(dummy_handle_link_command)
+{
+	if (CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1 && !isdigit((unsigned char)CMD_ARGV[0][0])) {
+		unsigned int i;
+
+		for (i = 0; i < ARRAY_SIZE(dummy_links); i++)
+			if (strcmp(CMD_ARGV[0], dummy_links[i].name) == 0)
+				break;
+		if (i == ARRAY_SIZE(dummy_links))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		dummy_link = dummy_links[i];
+	} else if (CMD_ARGC > 0) {
+		struct dummy_link link = { "custom", 0, 0, 0 };
+
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], link.latency_us);
+		if (CMD_ARGC > 1)
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], link.kbps);
+		if (CMD_ARGC > 2)
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], link.packet);
+		dummy_link = link;
+	}
+
+	command_print(CMD_CTX, "link %s: %u us per transaction, %u kB/s, %u byte packets",
+			dummy_link.name, dummy_link.latency_us, dummy_link.kbps, dummy_link.packet);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dummy_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	command_print(CMD_CTX, "%" PRIu64 " flushes, %" PRIu64 " transactions, "
+			"%" PRIu64 " bytes, %" PRIu64 " us of link time",
+			dummy_stats.flushes, dummy_stats.transactions,
+			dummy_stats.bytes, dummy_stats.delay_us);
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&dummy_stats, 0, sizeof(dummy_stats));
+	}
+	return ERROR_OK;
+}
+
 static int dummy_init(void)
 {
 	bitbang_interface = &dummy_bitbang;
@@ -128,13 +237,34 @@ static int dummy_quit(void)
 	return ERROR_OK;
 }
 
+static const struct command_registration dummy_subcommand_handlers[] = {
+	{
+		.name = "link",
+		.handler = dummy_handle_link_command,
+		.mode = COMMAND_ANY,
+		.help = "model the latency and bandwidth of an adapter",
+		.usage = "['none'|'nulink1'|'nulink2'|latency_us [kBps [packet_bytes]]]",
+	},
+	{
+		.name = "stats",
+		.handler = dummy_handle_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "show the traffic the link model was charged for",
+		.usage = "['reset']",
+	},
+	{
+		.chain = hello_command_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration dummy_command_handlers[] = {
 	{
 		.name = "dummy",
 		.mode = COMMAND_ANY,
 		.help = "dummy interface driver commands",
 
-		.chain = hello_command_handlers,
+		.chain = dummy_subcommand_handlers,
 	},
 	COMMAND_REGISTRATION_DONE,
 };
@@ -149,7 +279,7 @@ struct jtag_interface dummy_interface = {
 		.commands = dummy_command_handlers,
 		.transports = jtag_only,
 
-		.execute_queue = &bitbang_execute_queue,
+		.execute_queue = &dummy_execute_queue,
 
 		.speed = &dummy_speed,
 		.khz = &dummy_khz,
@@ -56,9 +56,23 @@ static enum jaylink_target_interface iface = JAYLINK_TIF_JTAG;
 static bool trace_enabled;
 
 #define JLINK_MAX_SPEED			12000
-#define JLINK_TAP_BUFFER_SIZE	2048
-
-static unsigned int swd_buffer_size = JLINK_TAP_BUFFER_SIZE;
+/* Largest tap buffer, the one in use is sized from the device memory */
+#define JLINK_TAP_BUFFER_SIZE	8192
+/* Tap buffer size for devices that don't report their free memory */
+#define JLINK_TAP_BUFFER_DEFAULT	2048
+
+static unsigned int tap_buffer_size = JLINK_TAP_BUFFER_DEFAULT;
+
+/* Transfer statistics, see "jlink stats" */
+static struct {
+	/* jaylink_jtag_io() and jaylink_swd_io() calls */
+	unsigned int flushes;
+	/* SWD transactions or JTAG scans with input */
+	unsigned int transactions;
+	/* queue runs that had nothing to send */
+	unsigned int empty_runs;
+	uint64_t bits;
+} jlink_stats;
 
 /* 256 byte non-volatile memory */
 struct device_config {
@@ -470,7 +484,7 @@ static int jlink_register(void)
  * memory. This ensures that the SWD transactions sent to the device do not
  * exceed the internal memory of the device.
  */
-static bool adjust_swd_buffer_size(void)
+static bool adjust_tap_buffer_size(void)
 {
 	int ret;
 	uint32_t tmp;
@@ -493,10 +507,9 @@ static bool adjust_swd_buffer_size(void)
 
 	tmp = MIN(JLINK_TAP_BUFFER_SIZE, (tmp - 16) / 2);
 
-	if (tmp != swd_buffer_size) {
-		swd_buffer_size = tmp;
-		LOG_DEBUG("Adjusted SWD transaction buffer size to %u bytes.",
-			swd_buffer_size);
+	if (tmp != tap_buffer_size) {
+		tap_buffer_size = tmp;
+		LOG_DEBUG("Adjusted tap buffer size to %u bytes.", tap_buffer_size);
 	}
 
 	return true;
@@ -693,18 +706,16 @@ static int jlink_init(void)
 			jtag_command_version = JAYLINK_JTAG_V3;
 	}
 
-	if (iface == JAYLINK_TIF_SWD) {
-		/*
-		 * Adjust the SWD transaction buffer size in case there is already
-		 * allocated memory on the device. This happens for example if the
-		 * memory for SWO capturing is still allocated because the software
-		 * which used the device before has not been shut down properly.
-		 */
-		if (!adjust_swd_buffer_size()) {
-			jaylink_close(devh);
-			jaylink_exit(jayctx);
-			return ERROR_JTAG_INIT_FAILED;
-		}
+	/*
+	 * Size the tap buffer from the free device memory. This also accounts
+	 * for memory that is already allocated on the device, for example if
+	 * the memory for SWO capturing is still allocated because the software
+	 * which used the device before has not been shut down properly.
+	 */
+	if (!adjust_tap_buffer_size()) {
+		jaylink_close(devh);
+		jaylink_exit(jayctx);
+		return ERROR_JTAG_INIT_FAILED;
 	}
 
 	if (jaylink_has_cap(caps, JAYLINK_DEV_CAP_READ_CONFIG)) {
@@ -1001,6 +1012,31 @@ COMMAND_HANDLER(jlink_handle_free_memory_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jlink_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		memset(&jlink_stats, 0, sizeof(jlink_stats));
+		return ERROR_OK;
+	}
+
+	command_print(CMD_CTX, "Tap buffer size: %u bytes.", tap_buffer_size);
+	command_print(CMD_CTX, "%u flushes, %u transactions, %u empty queue runs, "
+		"%" PRIu64 " bits.", jlink_stats.flushes, jlink_stats.transactions,
+		jlink_stats.empty_runs, jlink_stats.bits);
+
+	if (jlink_stats.flushes)
+		command_print(CMD_CTX, "%.1f transactions per flush.",
+			(double)jlink_stats.transactions / jlink_stats.flushes);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(jlink_handle_jlink_jtag_command)
 {
 	int tmp;
@@ -1271,10 +1307,10 @@ static int config_trace(bool enabled, enum tpio_pin_protocol pin_protocol,
 
 	if (!enabled) {
 		/*
-		 * Adjust the SWD transaction buffer size as stopping SWO capturing
-		 * deallocates device internal memory.
+		 * Adjust the tap buffer size as stopping SWO capturing deallocates
+		 * device internal memory.
 		 */
-		if (!adjust_swd_buffer_size())
+		if (!adjust_tap_buffer_size())
 			return ERROR_FAIL;
 
 		return ERROR_OK;
@@ -1313,10 +1349,10 @@ static int config_trace(bool enabled, enum tpio_pin_protocol pin_protocol,
 	}
 
 	/*
-	 * Adjust the SWD transaction buffer size as starting SWO capturing
-	 * allocates device internal memory.
+	 * Adjust the tap buffer size as starting SWO capturing allocates device
+	 * internal memory.
 	 */
-	if (!adjust_swd_buffer_size())
+	if (!adjust_tap_buffer_size())
 		return ERROR_FAIL;
 
 	return ERROR_OK;
@@ -1668,6 +1704,14 @@ static const struct command_registration jlink_subcommand_handlers[] = {
 		.mode = COMMAND_EXEC,
 		.help = "show free device memory"
 	},
+	{
+		.name = "stats",
+		.handler = &jlink_handle_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show the number of flushes and transactions since the "
+			"last reset of the statistics",
+		.usage = "[reset]"
+	},
 	{
 		.name = "hwstatus",
 		.handler = &jlink_handle_hwstatus_command,
@@ -1756,7 +1800,8 @@ struct pending_scan_result {
 	unsigned buffer_offset;
 };
 
-#define MAX_PENDING_SCAN_RESULTS 256
+/* One per SWD transaction of at least 46 bits in a full tap buffer */
+#define MAX_PENDING_SCAN_RESULTS (JLINK_TAP_BUFFER_SIZE * 8 / 46)
 
 static int pending_scan_results_length;
 static struct pending_scan_result pending_scan_results_buffer[MAX_PENDING_SCAN_RESULTS];
@@ -1775,13 +1820,13 @@ static void jlink_clock_data(const uint8_t *out, unsigned out_offset,
 			     unsigned length)
 {
 	do {
-		unsigned available_length = JLINK_TAP_BUFFER_SIZE - tap_length / 8;
+		unsigned available_length = tap_buffer_size * 8 - tap_length;
 
 		if (!available_length ||
 		    (in && pending_scan_results_length == MAX_PENDING_SCAN_RESULTS)) {
 			if (jlink_flush() != ERROR_OK)
 				return;
-			available_length = JLINK_TAP_BUFFER_SIZE;
+			available_length = tap_buffer_size * 8;
 		}
 
 		struct pending_scan_result *pending_scan_result =
@@ -1825,6 +1870,10 @@ static int jlink_flush(void)
 	ret = jaylink_jtag_io(devh, tms_buffer, tdi_buffer, tdo_buffer,
 		tap_length, jtag_command_version);
 
+	jlink_stats.flushes++;
+	jlink_stats.transactions += pending_scan_results_length;
+	jlink_stats.bits += tap_length;
+
 	if (ret != JAYLINK_OK) {
 		LOG_ERROR("jaylink_jtag_io() failed: %s.", jaylink_strerror_name(ret));
 		jlink_tap_init();
@@ -1923,6 +1972,15 @@ static int jlink_swd_run_queue(void)
 		goto skip;
 	}
 
+	/*
+	 * The ADI layer runs the queue again after each batch of accesses, the
+	 * queue is often empty by then. Don't spend a USB round trip on it.
+	 */
+	if (!tap_length) {
+		jlink_stats.empty_runs++;
+		goto skip;
+	}
+
 	/*
 	 * A transaction must be followed by another transaction or at least 8 idle
 	 * cycles to ensure that data is clocked through the AP.
@@ -1931,6 +1989,10 @@ static int jlink_swd_run_queue(void)
 
 	ret = jaylink_swd_io(devh, tms_buffer, tdi_buffer, tdo_buffer, tap_length);
 
+	jlink_stats.flushes++;
+	jlink_stats.transactions += pending_scan_results_length;
+	jlink_stats.bits += tap_length;
+
 	if (ret != JAYLINK_OK) {
 		LOG_ERROR("jaylink_swd_io() failed: %s.", jaylink_strerror_name(ret));
 		goto skip;
@@ -1970,7 +2032,7 @@ skip:
 static void jlink_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data, uint32_t ap_delay_clk)
 {
 	uint8_t data_parity_trn[DIV_ROUND_UP(32 + 1, 8)];
-	if (tap_length + 46 + 8 + ap_delay_clk >= sizeof(tdi_buffer) * 8 ||
+	if (tap_length + 46 + 8 + ap_delay_clk >= tap_buffer_size * 8 ||
 	    pending_scan_results_length == MAX_PENDING_SCAN_RESULTS) {
 		/* Not enough room in the queue. Run the queue. */
 		queued_retval = jlink_swd_run_queue();
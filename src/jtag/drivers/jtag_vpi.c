@@ -75,6 +75,85 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 	return ERROR_OK;
 }
 
+/*
+ * Scan chain transfers are sent without waiting for their replies, which the
+ * server sends back in order; at most VPI_MAX_IN_FLIGHT are outstanding so
+ * that neither side can fill its socket buffers and stall the other.  Scans
+ * are finished, their tdo bits handed to jtag_read_buffer, once the reply to
+ * their last transfer is in.
+ */
+#define VPI_MAX_IN_FLIGHT	16
+
+static struct {
+	uint8_t *dest;
+	int nb_bytes;
+} vpi_in_flight[VPI_MAX_IN_FLIGHT];
+static unsigned int vpi_sent, vpi_received;
+
+struct vpi_pending_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+	unsigned int last_xfer;
+};
+static struct vpi_pending_scan *vpi_scans;
+static unsigned int vpi_scans_head, vpi_scans_count, vpi_scans_size;
+static int vpi_scans_retval = ERROR_OK;
+
+static void jtag_vpi_finish_scans(void)
+{
+	while (vpi_scans_head < vpi_scans_count &&
+	       (int)(vpi_scans[vpi_scans_head].last_xfer - vpi_received) <= 0) {
+		struct vpi_pending_scan *scan = &vpi_scans[vpi_scans_head++];
+		int retval = jtag_read_buffer(scan->buf, scan->cmd);
+		if (retval != ERROR_OK && vpi_scans_retval == ERROR_OK)
+			vpi_scans_retval = retval;
+		free(scan->buf);
+	}
+
+	if (vpi_scans_head == vpi_scans_count)
+		vpi_scans_head = vpi_scans_count = 0;
+}
+
+static int jtag_vpi_receive_one(void)
+{
+	struct vpi_cmd vpi;
+	unsigned int slot = vpi_received % VPI_MAX_IN_FLIGHT;
+
+	int retval = jtag_vpi_receive_cmd(&vpi);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (vpi_in_flight[slot].dest)
+		memcpy(vpi_in_flight[slot].dest, vpi.buffer_in, vpi_in_flight[slot].nb_bytes);
+	vpi_received++;
+
+	jtag_vpi_finish_scans();
+
+	return ERROR_OK;
+}
+
+/* wait for every outstanding reply and finish the scans waiting on them */
+static int jtag_vpi_flush(void)
+{
+	while (vpi_received != vpi_sent) {
+		int retval = jtag_vpi_receive_one();
+		if (retval != ERROR_OK) {
+			/* the connection is broken, drop what waits for it */
+			vpi_received = vpi_sent;
+			while (vpi_scans_head < vpi_scans_count)
+				free(vpi_scans[vpi_scans_head++].buf);
+			vpi_scans_head = vpi_scans_count = 0;
+			vpi_scans_retval = ERROR_OK;
+			return retval;
+		}
+	}
+
+	int retval = vpi_scans_retval;
+	vpi_scans_retval = ERROR_OK;
+
+	return retval;
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @trst: 1 if TRST is to be asserted
@@ -182,16 +261,20 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
 	vpi.length = nb_bytes;
 	vpi.nb_bits = nb_bits;
 
-	int retval = jtag_vpi_send_cmd(&vpi);
-	if (retval != ERROR_OK)
-		return retval;
+	if (vpi_sent - vpi_received == VPI_MAX_IN_FLIGHT) {
+		int retval = jtag_vpi_receive_one();
+		if (retval != ERROR_OK)
+			return retval;
+	}
 
-	retval = jtag_vpi_receive_cmd(&vpi);
+	int retval = jtag_vpi_send_cmd(&vpi);
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (bits)
-		memcpy(bits, vpi.buffer_in, nb_bytes);
+	unsigned int slot = vpi_sent % VPI_MAX_IN_FLIGHT;
+	vpi_in_flight[slot].dest = bits;
+	vpi_in_flight[slot].nb_bytes = nb_bytes;
+	vpi_sent++;
 
 	return ERROR_OK;
 }
@@ -294,12 +377,22 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
-
-	if (buf)
-		free(buf);
+	/* the tdo bits arrive later, see jtag_vpi_finish_scans() */
+	if (vpi_scans_count == vpi_scans_size) {
+		unsigned int size = vpi_scans_size ? 2 * vpi_scans_size : 64;
+		struct vpi_pending_scan *scans = realloc(vpi_scans, size * sizeof(*scans));
+		if (scans == NULL) {
+			free(buf);
+			return ERROR_FAIL;
+		}
+		vpi_scans = scans;
+		vpi_scans_size = size;
+	}
+	vpi_scans[vpi_scans_count].cmd = cmd;
+	vpi_scans[vpi_scans_count].buf = buf;
+	vpi_scans[vpi_scans_count].last_xfer = vpi_sent;
+	vpi_scans_count++;
+	jtag_vpi_finish_scans();
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
@@ -358,6 +451,7 @@ static int jtag_vpi_execute_queue(void)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
+			retval = jtag_vpi_flush();
 			jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
@@ -366,7 +460,9 @@ static int jtag_vpi_execute_queue(void)
 		}
 	}
 
-	return retval;
+	int flush_retval = jtag_vpi_flush();
+
+	return (retval != ERROR_OK) ? retval : flush_retval;
 }
 
 static int jtag_vpi_init(void)
@@ -405,6 +501,7 @@ static int jtag_vpi_init(void)
 
 static int jtag_vpi_quit(void)
 {
+	free(vpi_scans);
 	free(server_address);
 	return close(sockfd);
 }
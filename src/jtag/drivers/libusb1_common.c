@@ -179,6 +179,69 @@ int jtag_libusb_bulk_read(jtag_libusb_device_handle *dev, int ep, char *bytes,
 	return transferred;
 }
 
+static void LIBUSB_CALL jtag_libusb_xfer_done(struct libusb_transfer *transfer)
+{
+	int *completed = transfer->user_data;
+
+	*completed = 1;
+}
+
+int jtag_libusb_bulk_transfer_n(jtag_libusb_device_handle *dev,
+		struct jtag_xfer *xfers, unsigned int n, int timeout)
+{
+	int retval = ERROR_OK;
+	unsigned int submitted;
+
+	for (submitted = 0; submitted < n; submitted++) {
+		struct jtag_xfer *x = &xfers[submitted];
+
+		x->transferred = 0;
+		x->completed = 0;
+		x->transfer = libusb_alloc_transfer(0);
+		if (!x->transfer) {
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		libusb_fill_bulk_transfer(x->transfer, dev, x->ep, x->buf, x->size,
+				jtag_libusb_xfer_done, &x->completed, timeout);
+		if (libusb_submit_transfer(x->transfer) != 0) {
+			libusb_free_transfer(x->transfer);
+			retval = ERROR_FAIL;
+			break;
+		}
+	}
+
+	/* after a failed submission, take back what is already queued */
+	for (unsigned int i = 0; i < submitted; i++) {
+		struct jtag_xfer *x = &xfers[i];
+
+		if (retval != ERROR_OK && !x->completed)
+			libusb_cancel_transfer(x->transfer);
+
+		while (!x->completed) {
+			if (libusb_handle_events_completed(jtag_libusb_context, &x->completed) != 0) {
+				libusb_cancel_transfer(x->transfer);
+				retval = ERROR_FAIL;
+			}
+		}
+
+		x->transferred = x->transfer->actual_length;
+		if (x->transfer->status != LIBUSB_TRANSFER_COMPLETED || x->transferred != x->size) {
+			/* the rest would only see the device out of step */
+			if (retval == ERROR_OK) {
+				for (unsigned int j = i + 1; j < submitted; j++)
+					libusb_cancel_transfer(xfers[j].transfer);
+			}
+			retval = ERROR_FAIL;
+		}
+
+		libusb_free_transfer(x->transfer);
+	}
+
+	return retval;
+}
+
 int jtag_libusb_set_configuration(jtag_libusb_device_handle *devh,
 		int configuration)
 {
@@ -68,6 +68,27 @@ int jtag_libusb_bulk_read(struct jtag_libusb_device_handle *dev, int ep,
 		char *bytes, int size, int timeout);
 int jtag_libusb_set_configuration(jtag_libusb_device_handle *devh,
 		int configuration);
+
+/** One bulk transfer of a jtag_libusb_bulk_transfer_n() batch */
+struct jtag_xfer {
+	int ep;
+	uint8_t *buf;
+	int size;
+	/** bytes transferred */
+	int transferred;
+	/* internal */
+	int completed;
+	struct libusb_transfer *transfer;
+};
+
+/**
+ * Submit @a n bulk transfers at once and wait for all of them, so that
+ * e.g. a command, its data and its status reply need no host round trip
+ * in between.  The device sees them in order, per endpoint.
+ * @returns ERROR_OK when every transfer moved all of its bytes.
+ */
+int jtag_libusb_bulk_transfer_n(jtag_libusb_device_handle *dev,
+		struct jtag_xfer *xfers, unsigned int n, int timeout);
 /**
  * Find the first interface optionally matching class, subclass and
  * protocol and claim it.
@@ -55,6 +55,9 @@
 
 #define BITMODE_MPSSE 0x02
 
+/* read transfers kept submitted during a flush */
+#define MPSSE_READ_TRANSFERS 4
+
 #define SIO_RESET_REQUEST             0x00
 #define SIO_SET_LATENCY_TIMER_REQUEST 0x09
 #define SIO_GET_LATENCY_TIMER_REQUEST 0x0A
@@ -330,10 +333,10 @@ struct mpsse_ctx *mpsse_open(const uint16_t *vid, const uint16_t *pid, const cha
 		return 0;
 
 	bit_copy_queue_init(&ctx->read_queue);
-	ctx->read_chunk_size = 16384;
+	ctx->read_chunk_size = 4096;
 	ctx->read_size = 16384;
 	ctx->write_size = 16384;
-	ctx->read_chunk = malloc(ctx->read_chunk_size);
+	ctx->read_chunk = malloc(ctx->read_chunk_size * MPSSE_READ_TRANSFERS);
 	ctx->read_buffer = malloc(ctx->read_size);
 	ctx->write_buffer = malloc(ctx->write_size);
 	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer)
@@ -779,6 +782,8 @@ struct transfer_result {
 	struct mpsse_ctx *ctx;
 	bool done;
 	unsigned transferred;
+	/* read transfers submitted and not completed yet */
+	unsigned pending;
 };
 
 static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
@@ -788,10 +793,18 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 
 	unsigned packet_size = ctx->max_packet_size;
 
+	res->pending--;
+
+	/* the read ring is cancelled once everything has arrived */
+	if (res->done)
+		return;
+
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
 	/* Strip the two status bytes sent at the beginning of each USB packet
-	 * while copying the chunk buffer to the read buffer */
+	 * while copying the chunk buffer to the read buffer.  Transfers on
+	 * one endpoint complete in submission order, so the chunks of the
+	 * ring arrive here one after the other. */
 	unsigned num_packets = DIV_ROUND_UP(transfer->actual_length, packet_size);
 	unsigned chunk_remains = transfer->actual_length;
 	for (unsigned i = 0; i < num_packets && chunk_remains > 2; i++) {
@@ -801,7 +814,7 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 		if (this_size > ctx->read_count - res->transferred)
 			this_size = ctx->read_count - res->transferred;
 		memcpy(ctx->read_buffer + res->transferred,
-			ctx->read_chunk + packet_size * i + 2,
+			transfer->buffer + packet_size * i + 2,
 			this_size);
 		res->transferred += this_size;
 		chunk_remains -= this_size + 2;
@@ -814,9 +827,14 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 	DEBUG_IO("raw chunk %d, transferred %d of %d", transfer->actual_length, res->transferred,
 		ctx->read_count);
 
-	if (!res->done)
-		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
+	if (!res->done) {
+		/* back to the tail of the ring */
+		if (transfer->status == LIBUSB_TRANSFER_CANCELLED ||
+				libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
 			res->done = true;
+		else
+			res->pending++;
+	}
 }
 
 static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
@@ -840,6 +858,18 @@ static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 	}
 }
 
+static void mpsse_cancel_reads(struct libusb_transfer **read_transfers)
+{
+	for (int i = 0; i < MPSSE_READ_TRANSFERS; i++) {
+		if (read_transfers[i])
+			libusb_cancel_transfer(read_transfers[i]);
+	}
+}
+
+/* The write goes out as one transfer while a ring of MPSSE_READ_TRANSFERS
+ * read transfers stays submitted, so the chip always has somewhere to put
+ * its results and never stalls the command stream while the host handles
+ * a completed chunk. */
 int mpsse_flush(struct mpsse_ctx *ctx)
 {
 	int retval = ctx->retval;
@@ -858,7 +888,7 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 	if (ctx->write_count == 0)
 		return retval;
 
-	struct libusb_transfer *read_transfer = 0;
+	struct libusb_transfer *read_transfers[MPSSE_READ_TRANSFERS] = { NULL };
 	struct transfer_result read_result = { .ctx = ctx, .done = true };
 	if (ctx->read_count) {
 		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
@@ -872,41 +902,57 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 	libusb_fill_bulk_transfer(write_transfer, ctx->usb_dev, ctx->out_ep, ctx->write_buffer,
 		ctx->write_count, write_cb, &write_result, ctx->usb_write_timeout);
 	retval = libusb_submit_transfer(write_transfer);
-	if (retval != LIBUSB_SUCCESS)
+	if (retval != LIBUSB_SUCCESS) {
+		write_result.done = true;
 		goto error_check;
+	}
 
-	if (ctx->read_count) {
-		read_transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
-			ctx->read_chunk_size, read_cb, &read_result,
-			ctx->usb_read_timeout);
-		retval = libusb_submit_transfer(read_transfer);
+	/* Only as many chunks as the read can fill, plus one for the
+	 * status-only packets the chip sends when its latency timer expires */
+	unsigned chunk_payload = ctx->read_chunk_size / ctx->max_packet_size
+		* (ctx->max_packet_size - 2);
+	unsigned chunks = ctx->read_count ?
+		MIN(DIV_ROUND_UP(ctx->read_count, chunk_payload) + 1,
+				(unsigned)MPSSE_READ_TRANSFERS) : 0;
+	for (unsigned i = 0; i < chunks; i++) {
+		read_transfers[i] = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(read_transfers[i], ctx->usb_dev, ctx->in_ep,
+			ctx->read_chunk + i * ctx->read_chunk_size, ctx->read_chunk_size,
+			read_cb, &read_result, ctx->usb_read_timeout);
+		retval = libusb_submit_transfer(read_transfers[i]);
 		if (retval != LIBUSB_SUCCESS)
-			goto error_check;
+			break;
+		read_result.pending++;
 	}
 
 	/* Polling loop, more or less taken from libftdi */
-	while (!write_result.done || !read_result.done) {
+	while (retval == LIBUSB_SUCCESS &&
+			(!write_result.done || !read_result.done || read_result.pending)) {
 		struct timeval timeout_usb;
 
 		timeout_usb.tv_sec = 1;
 		timeout_usb.tv_usec = 0;
 
+		/* the reads still submitted have nothing left to receive */
+		if (read_result.done && read_result.pending)
+			mpsse_cancel_reads(read_transfers);
+
 		retval = libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL);
 		keep_alive();
 		if (retval == LIBUSB_ERROR_NO_DEVICE || retval == LIBUSB_ERROR_INTERRUPTED)
 			break;
+	}
 
-		if (retval != LIBUSB_SUCCESS) {
-			libusb_cancel_transfer(write_transfer);
-			if (read_transfer)
-				libusb_cancel_transfer(read_transfer);
-			while (!write_result.done || !read_result.done) {
-				retval = libusb_handle_events_timeout_completed(ctx->usb_ctx,
-								&timeout_usb, NULL);
-				if (retval != LIBUSB_SUCCESS)
-					break;
-			}
+	if (retval != LIBUSB_SUCCESS) {
+		struct timeval timeout_usb = { .tv_sec = 1, .tv_usec = 0 };
+
+		libusb_cancel_transfer(write_transfer);
+		read_result.done = true;
+		mpsse_cancel_reads(read_transfers);
+		while (!write_result.done || read_result.pending) {
+			if (libusb_handle_events_timeout_completed(ctx->usb_ctx,
+							&timeout_usb, NULL) != LIBUSB_SUCCESS)
+				break;
 		}
 	}
 
@@ -936,8 +982,10 @@ error_check:
 	}
 
 	libusb_free_transfer(write_transfer);
-	if (read_transfer)
-		libusb_free_transfer(read_transfer);
+	for (int i = 0; i < MPSSE_READ_TRANSFERS; i++) {
+		if (read_transfers[i])
+			libusb_free_transfer(read_transfers[i]);
+	}
 
 	if (retval != ERROR_OK)
 		mpsse_purge(ctx);
@@ -0,0 +1,519 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Report transport of the Nu-Link driver.
+ *
+ * hidapi costs latency on every report: its libusb flavour reads through
+ * a thread and a report queue, and on Windows each call waits on a
+ * fresh overlapped operation. The native backends talk to the OS
+ * directly instead: hidraw and poll() on Linux, ReadFile/WriteFile
+ * with persistent OVERLAPPED structures on Windows. The libusb backend
+ * uses interrupt transfers with the IN transfer always submitted.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/time_support.h>
+#include <hidapi.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LIBUSB1
+#include <libusb.h>
+#endif
+
+#include "nulink_hid.h"
+
+struct nulink_hid {
+    enum hl_hid_backend backend;
+    hid_device *hidapi;
+#ifdef __linux__
+    int fd;
+#endif
+#ifdef _WIN32
+    HANDLE file;
+    OVERLAPPED ov_write;
+    OVERLAPPED ov_read;
+    bool read_pending;
+    uint8_t read_buf[NULINK_HID_REPORT_MAX + 1];
+#endif
+#ifdef HAVE_LIBUSB1
+    libusb_context *ctx;
+    libusb_device_handle *usb;
+    int interface;
+    uint8_t ep_in, ep_out;
+    uint16_t in_size;
+    struct libusb_transfer *in;
+    int in_done;
+    bool in_submitted;
+    uint8_t in_buf[NULINK_HID_REPORT_MAX];
+#endif
+};
+
+#ifdef __linux__
+/* the hidraw node of the probe, found through sysfs so that it doesn't
+ * matter which flavour of hidapi is installed */
+static int nulink_hid_hidraw_open(uint16_t vid, uint16_t pid, const char *serial)
+{
+    DIR *dir = opendir("/sys/class/hidraw");
+    struct dirent *entry;
+    int fd = -1;
+
+    if (!dir)
+        return -1;
+
+    while (fd < 0 && (entry = readdir(dir))) {
+        char path[PATH_MAX], line[256];
+        unsigned int bus, dev_vid, dev_pid;
+        bool match = false, serial_ok = !serial;
+
+        if (strncmp(entry->d_name, "hidraw", 6))
+            continue;
+
+        snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device/uevent", entry->d_name);
+        FILE *uevent = fopen(path, "r");
+        if (!uevent)
+            continue;
+
+        while (fgets(line, sizeof(line), uevent)) {
+            line[strcspn(line, "\n")] = 0;
+            if (sscanf(line, "HID_ID=%x:%x:%x", &bus, &dev_vid, &dev_pid) == 3)
+                match = dev_vid == vid && dev_pid == pid;
+            else if (serial && !strncmp(line, "HID_UNIQ=", 9))
+                serial_ok = !strcmp(line + 9, serial);
+        }
+        fclose(uevent);
+
+        if (!match || !serial_ok)
+            continue;
+
+        snprintf(path, sizeof(path), "/dev/%s", entry->d_name);
+        fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd < 0)
+            LOG_ERROR("unable to open %s: %s", path, strerror(errno));
+    }
+
+    closedir(dir);
+    return fd;
+}
+#endif
+
+#ifdef _WIN32
+/* the device path is what hidapi enumerates on Windows */
+static HANDLE nulink_hid_win32_open(uint16_t vid, uint16_t pid, const char *serial)
+{
+    struct hid_device_info *devs = hid_enumerate(vid, pid);
+    HANDLE file = INVALID_HANDLE_VALUE;
+
+    for (struct hid_device_info *cur = devs; cur; cur = cur->next) {
+        if (serial) {
+            char dev_serial[256];
+
+            if (!cur->serial_number ||
+                    wcstombs(dev_serial, cur->serial_number, sizeof(dev_serial)) == (size_t)-1 ||
+                    strcmp(dev_serial, serial))
+                continue;
+        }
+
+        file = CreateFileA(cur->path, GENERIC_READ | GENERIC_WRITE,
+                FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                FILE_FLAG_OVERLAPPED, NULL);
+        break;
+    }
+
+    hid_free_enumeration(devs);
+    return file;
+}
+#endif
+
+#ifdef HAVE_LIBUSB1
+static void LIBUSB_CALL nulink_hid_libusb_in_done(struct libusb_transfer *transfer)
+{
+    struct nulink_hid *dev = transfer->user_data;
+
+    dev->in_done = 1;
+}
+
+static int nulink_hid_libusb_submit(struct nulink_hid *dev)
+{
+    dev->in_done = 0;
+    libusb_fill_interrupt_transfer(dev->in, dev->usb, dev->ep_in, dev->in_buf,
+            dev->in_size, nulink_hid_libusb_in_done, dev, 0);
+
+    int ret = libusb_submit_transfer(dev->in);
+    if (ret) {
+        LOG_ERROR("libusb_submit_transfer: %s", libusb_error_name(ret));
+        return -1;
+    }
+
+    dev->in_submitted = true;
+    return 0;
+}
+
+/* the HID interface with an interrupt endpoint in each direction */
+static int nulink_hid_libusb_claim(struct nulink_hid *dev)
+{
+    struct libusb_config_descriptor *config;
+
+    if (libusb_get_active_config_descriptor(libusb_get_device(dev->usb), &config))
+        return -1;
+
+    int ret = -1;
+    for (unsigned int i = 0; i < config->bNumInterfaces && ret; i++) {
+        const struct libusb_interface_descriptor *intf = &config->interface[i].altsetting[0];
+
+        if (intf->bInterfaceClass != LIBUSB_CLASS_HID)
+            continue;
+
+        dev->ep_in = dev->ep_out = 0;
+        for (unsigned int e = 0; e < intf->bNumEndpoints; e++) {
+            const struct libusb_endpoint_descriptor *ep = &intf->endpoint[e];
+
+            if ((ep->bmAttributes & 0x03) != LIBUSB_TRANSFER_TYPE_INTERRUPT)
+                continue;
+            if (ep->bEndpointAddress & LIBUSB_ENDPOINT_IN) {
+                dev->ep_in = ep->bEndpointAddress;
+                /* a full sized packet is a whole report */
+                dev->in_size = MIN(ep->wMaxPacketSize & 0x7FF, NULINK_HID_REPORT_MAX);
+            } else {
+                dev->ep_out = ep->bEndpointAddress;
+            }
+        }
+        if (!dev->ep_in || !dev->ep_out)
+            continue;
+
+        dev->interface = intf->bInterfaceNumber;
+        libusb_set_auto_detach_kernel_driver(dev->usb, 1);
+        ret = libusb_claim_interface(dev->usb, dev->interface);
+        if (ret)
+            LOG_ERROR("libusb_claim_interface: %s", libusb_error_name(ret));
+    }
+
+    libusb_free_config_descriptor(config);
+    return ret ? -1 : 0;
+}
+
+static int nulink_hid_libusb_open(struct nulink_hid *dev, uint16_t vid, uint16_t pid,
+        const char *serial)
+{
+    libusb_device **list;
+
+    if (libusb_init(&dev->ctx))
+        return -1;
+
+    ssize_t cnt = libusb_get_device_list(dev->ctx, &list);
+    for (ssize_t i = 0; i < cnt && !dev->usb; i++) {
+        struct libusb_device_descriptor desc;
+        libusb_device_handle *usb;
+        char dev_serial[256];
+
+        if (libusb_get_device_descriptor(list[i], &desc) ||
+                desc.idVendor != vid || desc.idProduct != pid)
+            continue;
+        if (libusb_open(list[i], &usb))
+            continue;
+
+        if (serial && (libusb_get_string_descriptor_ascii(usb, desc.iSerialNumber,
+                        (unsigned char *)dev_serial, sizeof(dev_serial)) < 0 ||
+                    strcmp(dev_serial, serial))) {
+            libusb_close(usb);
+            continue;
+        }
+
+        dev->usb = usb;
+    }
+    if (cnt >= 0)
+        libusb_free_device_list(list, 1);
+
+    if (!dev->usb || nulink_hid_libusb_claim(dev))
+        return -1;
+
+    dev->in = libusb_alloc_transfer(0);
+    if (!dev->in)
+        return -1;
+
+    /* from here on, each response is picked up as soon as it arrives */
+    return nulink_hid_libusb_submit(dev);
+}
+
+static void nulink_hid_libusb_close(struct nulink_hid *dev)
+{
+    if (dev->in) {
+        if (dev->in_submitted && !libusb_cancel_transfer(dev->in)) {
+            while (!dev->in_done)
+                libusb_handle_events_completed(dev->ctx, &dev->in_done);
+        }
+        libusb_free_transfer(dev->in);
+    }
+    if (dev->usb) {
+        libusb_release_interface(dev->usb, dev->interface);
+        libusb_close(dev->usb);
+    }
+    if (dev->ctx)
+        libusb_exit(dev->ctx);
+}
+#endif
+
+struct nulink_hid *nulink_hid_open(enum hl_hid_backend backend,
+        uint16_t vid, uint16_t pid, const char *serial)
+{
+    struct nulink_hid *dev = calloc(1, sizeof(*dev));
+
+    if (!dev)
+        return NULL;
+
+    dev->backend = backend;
+#ifdef __linux__
+    dev->fd = -1;
+#endif
+#ifdef _WIN32
+    dev->file = INVALID_HANDLE_VALUE;
+#endif
+
+    switch (backend) {
+    case HL_HID_HIDAPI: {
+        wchar_t *wserial = NULL;
+
+        if (serial) {
+            size_t len = mbstowcs(NULL, serial, 0);
+
+            if (len == (size_t)-1)
+                break;
+            wserial = calloc(len + 1, sizeof(wchar_t));
+            if (!wserial)
+                break;
+            mbstowcs(wserial, serial, len + 1);
+        }
+        dev->hidapi = hid_open(vid, pid, wserial);
+        free(wserial);
+        if (dev->hidapi)
+            return dev;
+        break;
+    }
+    case HL_HID_NATIVE:
+#if defined(__linux__)
+        dev->fd = nulink_hid_hidraw_open(vid, pid, serial);
+        if (dev->fd >= 0)
+            return dev;
+#elif defined(_WIN32)
+        dev->file = nulink_hid_win32_open(vid, pid, serial);
+        if (dev->file != INVALID_HANDLE_VALUE) {
+            dev->ov_write.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+            dev->ov_read.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+            if (dev->ov_write.hEvent && dev->ov_read.hEvent)
+                return dev;
+        }
+#else
+        LOG_ERROR("no native HID backend on this platform");
+#endif
+        break;
+    case HL_HID_LIBUSB:
+#ifdef HAVE_LIBUSB1
+        if (nulink_hid_libusb_open(dev, vid, pid, serial) == 0)
+            return dev;
+#else
+        LOG_ERROR("built without libusb-1.0");
+#endif
+        break;
+    }
+
+    nulink_hid_close(dev);
+    return NULL;
+}
+
+struct nulink_hid *nulink_hid_open_path(enum hl_hid_backend backend,
+        const char *path, const char *serial)
+{
+    struct nulink_hid *dev;
+    wchar_t dev_serial[256];
+    char serial_mb[256];
+
+    if (backend != HL_HID_HIDAPI)
+        return NULL;
+
+    dev = calloc(1, sizeof(*dev));
+    if (!dev)
+        return NULL;
+
+    dev->backend = backend;
+#ifdef __linux__
+    dev->fd = -1;
+#endif
+#ifdef _WIN32
+    dev->file = INVALID_HANDLE_VALUE;
+#endif
+
+    dev->hidapi = hid_open_path(path);
+    if (!dev->hidapi) {
+        free(dev);
+        return NULL;
+    }
+
+    /* the path may belong to another device by now */
+    if (hid_get_serial_number_string(dev->hidapi, dev_serial, ARRAY_SIZE(dev_serial)) != 0 ||
+            wcstombs(serial_mb, dev_serial, sizeof(serial_mb)) == (size_t)-1 ||
+            strcmp(serial_mb, serial)) {
+        nulink_hid_close(dev);
+        return NULL;
+    }
+
+    return dev;
+}
+
+void nulink_hid_close(struct nulink_hid *dev)
+{
+    if (!dev)
+        return;
+
+    if (dev->hidapi)
+        hid_close(dev->hidapi);
+#ifdef __linux__
+    if (dev->fd >= 0)
+        close(dev->fd);
+#endif
+#ifdef _WIN32
+    if (dev->file != INVALID_HANDLE_VALUE) {
+        CancelIo(dev->file);
+        CloseHandle(dev->file);
+    }
+    if (dev->ov_write.hEvent)
+        CloseHandle(dev->ov_write.hEvent);
+    if (dev->ov_read.hEvent)
+        CloseHandle(dev->ov_read.hEvent);
+#endif
+#ifdef HAVE_LIBUSB1
+    if (dev->backend == HL_HID_LIBUSB)
+        nulink_hid_libusb_close(dev);
+#endif
+
+    free(dev);
+}
+
+int nulink_hid_write(struct nulink_hid *dev, const uint8_t *buf, size_t len)
+{
+    switch (dev->backend) {
+    case HL_HID_HIDAPI:
+        return hid_write(dev->hidapi, buf, len);
+    case HL_HID_NATIVE: {
+#if defined(__linux__)
+        /* hidraw takes the report number first, as hidapi does */
+        ssize_t ret = write(dev->fd, buf, len);
+        return (ret < 0) ? -1 : (int)ret;
+#elif defined(_WIN32)
+        DWORD written;
+
+        if (!WriteFile(dev->file, buf, len, NULL, &dev->ov_write) &&
+                GetLastError() != ERROR_IO_PENDING)
+            return -1;
+        if (!GetOverlappedResult(dev->file, &dev->ov_write, &written, TRUE))
+            return -1;
+        return written;
+#else
+        return -1;
+#endif
+    }
+    case HL_HID_LIBUSB: {
+#ifdef HAVE_LIBUSB1
+        int transferred;
+
+        /* report number 0 is not sent on the wire */
+        if (libusb_interrupt_transfer(dev->usb, dev->ep_out, (uint8_t *)buf + 1, len - 1,
+                    &transferred, 1000))
+            return -1;
+        return transferred + 1;
+#else
+        return -1;
+#endif
+    }
+    }
+
+    return -1;
+}
+
+int nulink_hid_read_timeout(struct nulink_hid *dev, uint8_t *buf, size_t len,
+        int timeout_ms)
+{
+    switch (dev->backend) {
+    case HL_HID_HIDAPI:
+        return hid_read_timeout(dev->hidapi, buf, len, timeout_ms);
+    case HL_HID_NATIVE: {
+#if defined(__linux__)
+        struct pollfd pfd = { .fd = dev->fd, .events = POLLIN };
+
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret <= 0)
+            return ret;
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+            return -1;
+
+        ssize_t n = read(dev->fd, buf, len);
+        return (n < 0) ? -1 : (int)n;
+#elif defined(_WIN32)
+        DWORD n;
+
+        /* a read that timed out stays pending for the next call */
+        if (!dev->read_pending) {
+            ResetEvent(dev->ov_read.hEvent);
+            if (!ReadFile(dev->file, dev->read_buf, sizeof(dev->read_buf), NULL, &dev->ov_read) &&
+                    GetLastError() != ERROR_IO_PENDING)
+                return -1;
+            dev->read_pending = true;
+        }
+
+        if (WaitForSingleObject(dev->ov_read.hEvent, timeout_ms) == WAIT_TIMEOUT)
+            return 0;
+
+        dev->read_pending = false;
+        if (!GetOverlappedResult(dev->file, &dev->ov_read, &n, FALSE) || n < 1)
+            return -1;
+
+        /* strip the report number */
+        n = MIN(n - 1, len);
+        memcpy(buf, dev->read_buf + 1, n);
+        return n;
+#else
+        return -1;
+#endif
+    }
+    case HL_HID_LIBUSB: {
+#ifdef HAVE_LIBUSB1
+        int64_t deadline = timeval_ms() + timeout_ms;
+
+        while (!dev->in_done) {
+            int64_t left = deadline - timeval_ms();
+            if (left <= 0)
+                return 0;
+
+            struct timeval tv = { .tv_sec = left / 1000, .tv_usec = (left % 1000) * 1000 };
+            if (libusb_handle_events_timeout_completed(dev->ctx, &tv, &dev->in_done))
+                return -1;
+        }
+
+        dev->in_submitted = false;
+        if (dev->in->status != LIBUSB_TRANSFER_COMPLETED)
+            return -1;
+
+        int n = MIN((size_t)dev->in->actual_length, len);
+        memcpy(buf, dev->in_buf, n);
+
+        if (nulink_hid_libusb_submit(dev))
+            return -1;
+        return n;
+#else
+        return -1;
+#endif
+    }
+    }
+
+    return -1;
+}
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef OPENOCD_JTAG_DRIVERS_NULINK_HID_H
+#define OPENOCD_JTAG_DRIVERS_NULINK_HID_H
+
+#include <jtag/hla/hla_transport.h>
+#include <jtag/hla/hla_interface.h>
+
+/* largest report of any Nu-Link, without the report number */
+#define NULINK_HID_REPORT_MAX   (1024)
+
+struct nulink_hid;
+
+/* Open the probe vid:pid, the one with this serial number if not NULL,
+ * through the backend asked for. NULL if it can't be opened that way. */
+struct nulink_hid *nulink_hid_open(enum hl_hid_backend backend,
+        uint16_t vid, uint16_t pid, const char *serial);
+/* Open the device at this hidapi path, if its serial number is serial.
+ * Only for the hidapi backend, the others return NULL. */
+struct nulink_hid *nulink_hid_open_path(enum hl_hid_backend backend,
+        const char *path, const char *serial);
+void nulink_hid_close(struct nulink_hid *dev);
+
+/* The calls of hidapi: buf of the write starts with the report number,
+ * the read returns the report without it. Both return the number of
+ * bytes moved or -1; the read returns 0 on timeout. */
+int nulink_hid_write(struct nulink_hid *dev, const uint8_t *buf, size_t len);
+int nulink_hid_read_timeout(struct nulink_hid *dev, uint8_t *buf, size_t len,
+        int timeout_ms);
+
+#endif /* OPENOCD_JTAG_DRIVERS_NULINK_HID_H */
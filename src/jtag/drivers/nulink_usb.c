@@ -9,6 +9,8 @@
 #include "config.h"
 #endif
 
+#include <limits.h>
+
 /* project specific includes */
 #include <helper/binarybuffer.h>
 // #include <jtag/adapter.h>
@@ -20,31 +22,148 @@
 
 #include <target/cortex_m.h>
 
+#include <helper/time_support.h>
+#include <helper/tracelog.h>
+#include <helper/metrics.h>
 #include <hidapi.h>
 #include "libusb_common.h"
+#include "nulink_hid.h"
 // #include "libusb_helper.h"
 
 #define NULINK_READ_TIMEOUT  100000
+/* how often polling looks for an unplugged probe to come back */
+#define NULINK_REATTACH_INTERVAL_MS  500
 
 #define NULINK_HID_MAX_SIZE   (64)
 #define NULINK2_HID_MAX_SIZE   (1024)
 #define V6M_MAX_COMMAND_LENGTH (NULINK_HID_MAX_SIZE - 2)
 #define V7M_MAX_COMMAND_LENGTH (NULINK_HID_MAX_SIZE - 3)
-
+#define NULINK2_MAX_COMMAND_LENGTH (NULINK2_HID_MAX_SIZE - 3)
+
+/* CMD_WRITE_RAM/CMD_WRITE_REG: 8 header bytes, then u32Addr/u32Data/u32Mask
+ * per entry on the way out and u32Addr/u32Data per entry on the way back */
+#define NULINK_RAM_CMD_HEADER_SIZE  (8)
+#define NULINK_RAM_CMD_ENTRY_SIZE   (12)
+#define NULINK_RAM_RSP_ENTRY_SIZE   (8)
+#define NULINK_RAM_CMD_MAX_ENTRIES  (255)
+
+/* independent writes that can be merged into one Nu-Link2 CMD_WRITE_RAM report */
+#define NULINK_MAX_QUEUED_WRITES \
+    ((NULINK2_MAX_COMMAND_LENGTH - NULINK_RAM_CMD_HEADER_SIZE) / NULINK_RAM_CMD_ENTRY_SIZE)
+
+/* reports sent ahead of their response while streaming memory writes */
+#define NULINK_MAX_REPORTS_IN_FLIGHT  (2)
+
+#define NULINK_USB_VID    (0x0416)
+#define NULINK_USB_PID1   (0x511B)
+#define NULINK_USB_PID2   (0x511C)
+#define NULINK_USB_PID3   (0x511D)
 #define NULINK2_USB_PID1  (0x5200)
 #define NULINK2_USB_PID2  (0x5201)
 
+/* While the core keeps running CMD_CHECK_MCU_STOP is sent less and less
+ * often, doubling the gap from the first to the last value (ms). */
+#define NULINK_POLL_BACKOFF_MIN_MS    (50)
+#define NULINK_POLL_BACKOFF_MAX_MS    (500)
+
+/* latency buckets: below 64 us, below 128 us, ... the last one is open */
+#define NULINK_STATS_BUCKETS      (12)
+#define NULINK_STATS_BUCKET0_US   (64U)
+
+struct nulink_usb_cmd_stats {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t hist[NULINK_STATS_BUCKETS];
+};
+
+struct nulink_usb_stats {
+    uint32_t commands;
+    uint32_t errors;
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+    /* indexed by the low byte of the CMD_* opcode */
+    struct nulink_usb_cmd_stats cmd[256];
+};
+
+/* probes matched when the configuration does not list any */
+static const uint16_t nulink_usb_pids[] = {
+    NULINK_USB_PID1, NULINK_USB_PID2, NULINK_USB_PID3,
+    NULINK2_USB_PID1, NULINK2_USB_PID2,
+};
+
+enum nulink_reset {
+    RESET_AUTO = 0,
+    RESET_HW = 1,
+    RESET_SYSRESETREQ = 2,
+    RESET_VECTRESET = 3,
+    RESET_FAST_RESCUE = 4, /* Rescue and erase the chip, need very fast speed */
+};
+
+enum nulink_connect {
+    CONNECT_NORMAL = 0,      /* Support all reset method */
+    CONNECT_PRE_RESET = 1,   /* Support all reset method */
+    CONNECT_UNDER_RESET = 2, /* Support all reset method */
+    CONNECT_NONE = 3,        /* Support RESET_HW, (RESET_AUTO = RESET_HW) */
+    CONNECT_DISCONNECT = 4,  /* Support RESET_NONE, (RESET_AUTO = RESET_NONE) */
+    CONNECT_ICP_MODE = 5     /* Support NUC505 ICP mode*/
+};
+
 struct nulink_usb_handle_s {
-    hid_device *dev_handle;
+    struct nulink_hid *dev_handle; /* NULL while the probe is unplugged */
+    uint16_t vid, pid; /* the probe opened, reopened when plugged in again */
+    char *serial;
+    enum hl_hid_backend hid_backend;
+    int64_t reattach_next_ms;
+    unsigned long speed_khz; /* last SWD clock set */
+    enum nulink_connect connect;
     uint16_t max_packet_size;
     uint8_t usbcmdidx;
-    uint8_t cmdidx;
+    uint16_t cmdidx; /* up to a full Nu-Link2 report */
     uint8_t cmdsize;
     uint8_t cmdbuf[NULINK2_HID_MAX_SIZE + 1];
     uint8_t tempbuf[NULINK2_HID_MAX_SIZE];
     uint8_t databuf[NULINK2_HID_MAX_SIZE];
     uint32_t max_mem_packet;
+    uint16_t max_mem_words; /* words per CMD_WRITE_RAM report */
     uint16_t hardware_config; /* bit 0: 1:Nu-Link-Pro, 0:Nu-Link */
+    bool auto_speed; /* SWD clock picked by nulink_usb_speed_autotune */
+    bool speed_tune_pending; /* auto-tune again once the target halts */
+    unsigned int speed_index; /* into nulink_speed_khz when auto_speed */
+
+    /* deferred CMD_WRITE_RAM entries, sent as one report on the next
+     * command that depends on them or on an explicit flush */
+    uint16_t queued_writes;
+    uint32_t queued_addr[NULINK_MAX_QUEUED_WRITES];
+    uint32_t queued_data[NULINK_MAX_QUEUED_WRITES];
+    uint32_t queued_mask[NULINK_MAX_QUEUED_WRITES]; /* bits kept by the probe */
+    int queued_retval;
+    /* reports written whose response has not been read yet */
+    uint8_t reports_in_flight;
+    uint8_t in_flight_head;
+    uint8_t in_flight_opcode[NULINK_MAX_REPORTS_IN_FLIGHT];
+    int64_t in_flight_start_us[NULINK_MAX_REPORTS_IN_FLIGHT];
+    /* CMD_WRITE_RAM reports sent with u8Verify: the words the probe must
+     * read back, checked when the response arrives */
+    const uint8_t *in_flight_verify_buf[NULINK_MAX_REPORTS_IN_FLIGHT];
+    uint32_t in_flight_verify_addr[NULINK_MAX_REPORTS_IN_FLIGHT];
+    unsigned int in_flight_verify_count[NULINK_MAX_REPORTS_IN_FLIGHT];
+    /* set up by the sender for the next report only */
+    const uint8_t *verify_buf;
+    uint32_t verify_addr;
+    unsigned int verify_count;
+    bool verify_writes; /* nulink_usb_write_bytes asks the probe to verify */
+
+    struct nulink_usb_stats stats;
+
+    /* adaptive CMD_CHECK_MCU_STOP polling */
+    bool poll_running;
+    unsigned int poll_interval_ms;
+    int64_t poll_next_ms;
+
+    /* states seen in other traffic go to the target through this */
+    void (*state_callback)(void *priv, enum target_state state);
+    void *state_priv;
 
     int (*xfer)(void *handle, uint8_t *buf, int size);
     void (*init_buffer)(void *handle, uint32_t size);
@@ -65,46 +184,174 @@ struct nulink_usb_handle_s {
 
 #define ARM_SRAM_BASE                0x20000000UL
 
+/* SWD clock steps tried by the auto-tune mode ("adapter_khz 0") */
+static const int nulink_speed_khz[] = {
+    1000, 2000, 3000, 4000, 6000, 8000, 12000,
+};
+
+/* words of SRAM overwritten (and restored) by the clock test */
+#define NULINK_SPEED_TEST_WORDS      16
+
 #define HARDWARE_CONFIG_NULINKPRO    1
 #define HARDWARE_CONFIG_NULINK2        2
 
-enum nulink_reset {
-    RESET_AUTO = 0,
-    RESET_HW = 1,
-    RESET_SYSRESETREQ = 2,
-    RESET_VECTRESET = 3,
-    RESET_FAST_RESCUE = 4, /* Rescue and erase the chip, need very fast speed */
-};
+/* the open probe, for the flash driver which has no handle of its own */
+static struct nulink_usb_handle_s *nulink_usb_active;
 
-enum nulink_connect {
-    CONNECT_NORMAL = 0,      /* Support all reset method */
-    CONNECT_PRE_RESET = 1,   /* Support all reset method */
-    CONNECT_UNDER_RESET = 2, /* Support all reset method */
-    CONNECT_NONE = 3,        /* Support RESET_HW, (RESET_AUTO = RESET_HW) */
-    CONNECT_DISCONNECT = 4,  /* Support RESET_NONE, (RESET_AUTO = RESET_NONE) */
-    CONNECT_ICP_MODE = 5     /* Support NUC505 ICP mode*/
-};
+static int64_t nulink_usb_time_us(void)
+{
+    return timeval_ns() / 1000;
+}
 
-static int nulink_usb_xfer_rw(void *handle, uint8_t *buf)
+static void nulink_usb_stats_account(struct nulink_usb_handle_s *h, uint8_t opcode,
+        int64_t start_us, int bytes_in)
+{
+    struct nulink_usb_cmd_stats *cmd = &h->stats.cmd[opcode];
+    uint32_t elapsed = nulink_usb_time_us() - start_us;
+    unsigned int bucket = 0;
+
+    while (bucket < NULINK_STATS_BUCKETS - 1 &&
+           elapsed >= (NULINK_STATS_BUCKET0_US << bucket))
+        bucket++;
+
+    if (tracelog_enabled)
+        tracelog_complete(TRACELOG_ADAPTER, "nulink", start_us, opcode, bytes_in);
+
+    if (bytes_in > 0)
+        h->stats.bytes_in += bytes_in;
+    cmd->count++;
+    cmd->total_us += elapsed;
+    if (elapsed > cmd->max_us)
+        cmd->max_us = elapsed;
+    cmd->hist[bucket]++;
+}
+
+/* the probe went away: forget whatever it had in flight */
+static void nulink_usb_detach(struct nulink_usb_handle_s *h)
+{
+    LOG_WARNING("Nu-Link disconnected, waiting for it to be plugged in again");
+    nulink_hid_close(h->dev_handle);
+    h->dev_handle = NULL;
+    h->reports_in_flight = 0;
+    h->in_flight_head = 0;
+    h->queued_writes = 0;
+    h->poll_running = false;
+    h->reattach_next_ms = 0;
+}
+
+static int nulink_usb_xfer_send(void *handle)
 {
     struct nulink_usb_handle_s *h = handle;
 
     assert(handle);
 
-    int ret = hid_write(h->dev_handle, h->cmdbuf, h->max_packet_size + 1);
+    if (!h->dev_handle)
+        return ERROR_FAIL;
+
+    /* the opcode follows the report header: 3 bytes on Nu-Link1, 4 on Nu-Link2 */
+    unsigned int slot = (h->in_flight_head + h->reports_in_flight) % NULINK_MAX_REPORTS_IN_FLIGHT;
+    h->in_flight_opcode[slot] = h->cmdbuf[(h->hardware_config & HARDWARE_CONFIG_NULINK2) ? 4 : 3];
+    h->in_flight_start_us[slot] = nulink_usb_time_us();
+    h->in_flight_verify_buf[slot] = h->verify_buf;
+    h->in_flight_verify_addr[slot] = h->verify_addr;
+    h->in_flight_verify_count[slot] = h->verify_count;
+    h->verify_count = 0;
+
+    /* anything that may change the run state ends the polling backoff */
+    switch (h->in_flight_opcode[slot]) {
+    case CMD_MCU_RESET:
+    case CMD_MCU_STEP_RUN:
+    case CMD_MCU_STOP_RUN:
+    case CMD_MCU_FREE_RUN:
+        h->poll_running = false;
+        h->poll_interval_ms = 0;
+        break;
+    default:
+        break;
+    }
+
+    int ret = nulink_hid_write(h->dev_handle, h->cmdbuf, h->max_packet_size + 1);
     if (ret < 0) {
         LOG_ERROR("hid_write");
+        h->stats.errors++;
+        nulink_usb_detach(h);
         return ERROR_FAIL;
     }
 
-    ret = hid_read_timeout(h->dev_handle, buf, h->max_packet_size, NULINK_READ_TIMEOUT);
+    h->stats.commands++;
+    h->stats.bytes_out += ret;
+    h->reports_in_flight++;
+    return ERROR_OK;
+}
+
+static int nulink_usb_xfer_recv(void *handle, uint8_t *buf)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    assert(handle);
+
+    if (!h->dev_handle)
+        return ERROR_FAIL;
+
+    unsigned int slot = h->in_flight_head;
+    h->in_flight_head = (h->in_flight_head + 1) % NULINK_MAX_REPORTS_IN_FLIGHT;
+    h->reports_in_flight--;
+
+    int ret = nulink_hid_read_timeout(h->dev_handle, buf, h->max_packet_size, NULINK_READ_TIMEOUT);
+    nulink_usb_stats_account(h, h->in_flight_opcode[slot], h->in_flight_start_us[slot], ret);
     if (ret < 0) {
         LOG_ERROR("hid_read_timeout");
+        h->stats.errors++;
+        nulink_usb_detach(h);
         return ERROR_FAIL;
     }
+
+    /* the probe returns the word it read back after each verified write */
+    const uint8_t *rsp = buf + ((h->hardware_config & HARDWARE_CONFIG_NULINK2) ? 3 : 2);
+    for (unsigned int i = 0; i < h->in_flight_verify_count[slot]; i++) {
+        uint32_t expected = buf_get_u32(h->in_flight_verify_buf[slot] + 4 * i, 0, 32);
+        uint32_t actual = le_to_h_u32(rsp + 4 * (2 * i + 1));
+        if (actual != expected) {
+            LOG_ERROR("verify failed at 0x%08" PRIx32 ": wrote 0x%08" PRIx32 ", read 0x%08" PRIx32,
+                      h->in_flight_verify_addr[slot] + 4 * i, expected, actual);
+            return ERROR_FAIL;
+        }
+    }
     return ERROR_OK;
 }
 
+/* collect the responses of reports sent ahead, the probe answers in order */
+static int nulink_usb_xfer_drain(void *handle)
+{
+    struct nulink_usb_handle_s *h = handle;
+    int res = ERROR_OK;
+
+    while (h->reports_in_flight) {
+        int err = nulink_usb_xfer_recv(h, h->tempbuf);
+        if (res == ERROR_OK)
+            res = err;
+    }
+
+    return res;
+}
+
+static int nulink_usb_xfer_rw(void *handle, uint8_t *buf)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    assert(handle);
+
+    int res = nulink_usb_xfer_drain(h);
+    if (res != ERROR_OK)
+        return res;
+
+    res = nulink_usb_xfer_send(h);
+    if (res != ERROR_OK)
+        return res;
+
+    return nulink_usb_xfer_recv(h, buf);
+}
+
 static int nulink1_usb_xfer(void *handle, uint8_t *buf, int size)
 {
     struct nulink_usb_handle_s *h = handle;
@@ -126,7 +373,7 @@ static int nulink2_usb_xfer(void *handle, uint8_t *buf, int size)
 
     int err = nulink_usb_xfer_rw(h, h->tempbuf);
 
-    memcpy(buf, h->tempbuf + 3, V7M_MAX_COMMAND_LENGTH);
+    memcpy(buf, h->tempbuf + 3, NULINK2_MAX_COMMAND_LENGTH);
 
     return err;
 }
@@ -163,13 +410,100 @@ static void nulink2_usb_init_buffer(void *handle, uint32_t size)
     h->cmdidx += 4;
 }
 
+static int nulink_usb_flush(void *handle)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    assert(handle);
+
+    int res = h->queued_retval;
+    h->queued_retval = ERROR_OK;
+
+    if (!h->queued_writes)
+        return res;
+
+    unsigned int count = h->queued_writes;
+    h->queued_writes = 0;
+
+    LOG_DEBUG("nulink_usb_flush: %u queued writes", count);
+
+    h->init_buffer(handle, NULINK_RAM_CMD_HEADER_SIZE + NULINK_RAM_CMD_ENTRY_SIZE * count);
+    /* set command ID */
+    h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_RAM);
+    h->cmdidx += 4;
+    /* Count of registers */
+    h->cmdbuf[h->cmdidx] = count;
+    h->cmdidx += 1;
+    /* Array of bool value (u8ReadOld) */
+    h->cmdbuf[h->cmdidx] = 0x00;
+    h->cmdidx += 1;
+    /* Array of bool value (u8Verify) */
+    h->cmdbuf[h->cmdidx] = 0x00;
+    h->cmdidx += 1;
+    /* ignore */
+    h->cmdbuf[h->cmdidx] = 0;
+    h->cmdidx += 1;
+
+    for (unsigned int i = 0; i < count; i++) {
+        /* u32Addr */
+        h_u32_to_le(h->cmdbuf + h->cmdidx, h->queued_addr[i]);
+        h->cmdidx += 4;
+        /* u32Data */
+        h_u32_to_le(h->cmdbuf + h->cmdidx, h->queued_data[i]);
+        h->cmdidx += 4;
+        /* u32Mask */
+        h_u32_to_le(h->cmdbuf + h->cmdidx, h->queued_mask[i]);
+        h->cmdidx += 4;
+    }
+    assert(h->cmdidx <= h->max_packet_size + 1);
+
+    int err = h->xfer(handle, h->databuf, NULINK_RAM_RSP_ENTRY_SIZE * count);
+
+    return (res != ERROR_OK) ? res : err;
+}
+
+/* defer a single word write; it is merged with its neighbours into one report.
+ * Bits set in mask keep their current value, the probe does the read-modify-write. */
+static int nulink_usb_queue_write(void *handle, uint32_t addr, uint32_t val, uint32_t mask)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    assert(handle);
+
+    if (h->queued_writes >= h->max_mem_words) {
+        int res = nulink_usb_flush(handle);
+        if (res != ERROR_OK)
+            return res;
+    }
+
+    h->queued_addr[h->queued_writes] = addr;
+    h->queued_data[h->queued_writes] = val;
+    h->queued_mask[h->queued_writes] = mask;
+    h->queued_writes++;
+
+    return ERROR_OK;
+}
+
+static void nulink_usb_speed_fallback(struct nulink_usb_handle_s *h);
+
 static inline int nulink_usb_xfer(void *handle, uint8_t *buf, int size)
 {
     struct nulink_usb_handle_s *h = handle;
 
     assert(handle);
 
-    return h->xfer(handle, buf, size);
+    /* report a failure of the queued writes sent ahead of this command */
+    if (h->queued_retval != ERROR_OK) {
+        int res = h->queued_retval;
+        h->queued_retval = ERROR_OK;
+        return res;
+    }
+
+    int res = h->xfer(handle, buf, size);
+    if (res != ERROR_OK && h->auto_speed)
+        nulink_usb_speed_fallback(h);
+
+    return res;
 }
 
 static inline void nulink_usb_init_buffer(void *handle, uint32_t size)
@@ -178,6 +512,10 @@ static inline void nulink_usb_init_buffer(void *handle, uint32_t size)
 
     assert(handle);
 
+    /* every other command may depend on the queued writes */
+    if (h->queued_writes)
+        h->queued_retval = nulink_usb_flush(handle);
+
     h->init_buffer(handle, size);
 }
 
@@ -247,41 +585,47 @@ static int nulink_usb_write_debug_reg(void *handle, uint32_t addr, uint32_t val)
 
     LOG_DEBUG("nulink_usb_write_debug_reg 0x%08" PRIX32 " 0x%08" PRIX32, addr, val);
 
-    nulink_usb_init_buffer(handle, 8 + 12 * 1);
-    /* set command ID */
-    h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_RAM);
-    h->cmdidx += 4;
-    /* Count of registers */
-    h->cmdbuf[h->cmdidx] = 1;
-    h->cmdidx += 1;
-    /* Array of bool value (u8ReadOld) */
-    h->cmdbuf[h->cmdidx] = 0x00;
-    h->cmdidx += 1;
-    /* Array of bool value (u8Verify) */
-    h->cmdbuf[h->cmdidx] = 0x00;
-    h->cmdidx += 1;
-    /* ignore */
-    h->cmdbuf[h->cmdidx] = 0;
-    h->cmdidx += 1;
-    /* u32Addr */
-    h_u32_to_le(h->cmdbuf + h->cmdidx, addr);
-    h->cmdidx += 4;
-    /* u32Data */
-    h_u32_to_le(h->cmdbuf + h->cmdidx, val);
-    h->cmdidx += 4;
-    /* u32Mask */
-    h_u32_to_le(h->cmdbuf + h->cmdidx, 0x00000000UL);
-    h->cmdidx += 4;
+    assert(handle);
 
-    return nulink_usb_xfer(handle, h->databuf, 4 * 2);
+    return nulink_usb_queue_write(h, addr, val, 0x00000000UL);
 }
 
+static int nulink_usb_write_mem_masked(void *handle, uint32_t addr, uint32_t val, uint32_t mask)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    LOG_DEBUG("nulink_usb_write_mem_masked 0x%08" PRIX32 " 0x%08" PRIX32 " mask 0x%08" PRIX32,
+              addr, val, mask);
+
+    assert(handle);
+
+    if (addr % 4)
+        return ERROR_TARGET_UNALIGNED_ACCESS;
+
+    /* u32Mask selects the bits the probe preserves */
+    return nulink_usb_queue_write(h, addr, val & mask, ~mask);
+}
+
+static int nulink_usb_reattach(struct nulink_usb_handle_s *h);
+
+static int nulink_usb_speed_autotune(struct nulink_usb_handle_s *h);
+
 static enum target_state nulink_usb_state(void *handle)
 {
     struct nulink_usb_handle_s *h = handle;
 
     assert(handle);
 
+    /* target polling is where an unplugged probe gets picked up again;
+     * a failed poll then makes the target be examined anew */
+    if (!h->dev_handle && nulink_usb_reattach(h) != ERROR_OK)
+        return TARGET_UNKNOWN;
+
+    /* the probe cannot signal a halt, so back off while the core runs */
+    int64_t now = timeval_ms();
+    if (h->poll_running && now < h->poll_next_ms)
+        return TARGET_RUNNING;
+
     nulink_usb_init_buffer(handle, 4 * 1);
     /* set command ID */
     h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_CHECK_MCU_STOP);
@@ -291,10 +635,40 @@ static enum target_state nulink_usb_state(void *handle)
     if (res != ERROR_OK)
         return TARGET_UNKNOWN;
 
-    if (!le_to_h_u32(h->databuf + 4 * 2))
+    if (!le_to_h_u32(h->databuf + 4 * 2)) {
+        h->poll_running = false;
+        h->poll_interval_ms = 0;
+        /* "adapter_khz 0" came before the target could be halted */
+        if (h->speed_tune_pending) {
+            h->speed_tune_pending = false;
+            nulink_usb_speed_autotune(h);
+        }
         return TARGET_HALTED;
-    else
-        return TARGET_RUNNING;
+    }
+
+    if (!h->poll_running)
+        h->poll_interval_ms = 0;
+    else if (!h->poll_interval_ms)
+        h->poll_interval_ms = NULINK_POLL_BACKOFF_MIN_MS;
+    else if (h->poll_interval_ms < NULINK_POLL_BACKOFF_MAX_MS)
+        h->poll_interval_ms = MIN(2 * h->poll_interval_ms, NULINK_POLL_BACKOFF_MAX_MS);
+    h->poll_running = true;
+    h->poll_next_ms = now + h->poll_interval_ms;
+
+    return TARGET_RUNNING;
+}
+
+static int nulink_usb_subscribe_state(void *handle,
+        void (*callback)(void *priv, enum target_state state), void *priv)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    assert(handle);
+
+    h->state_callback = callback;
+    h->state_priv = priv;
+
+    return ERROR_OK;
 }
 
 static int nulink_usb_assert_srst(void *handle, int srst)
@@ -322,29 +696,51 @@ static int nulink_usb_assert_srst(void *handle, int srst)
     return nulink_usb_xfer(handle, h->databuf, 4 * 4);
 }
 
-static int nulink_usb_reset(void *handle)
+static int nulink_usb_mcu_reset(struct nulink_usb_handle_s *h,
+        enum nulink_reset reset, enum nulink_connect connect)
 {
-    struct nulink_usb_handle_s *h = handle;
-
-    LOG_DEBUG("nulink_usb_reset");
-
-    assert(handle);
-
-    nulink_usb_init_buffer(handle, 4 * 4);
+    nulink_usb_init_buffer(h, 4 * 4);
     /* set command ID */
     h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_MCU_RESET);
     h->cmdidx += 4;
     /* set reset type */
-    h_u32_to_le(h->cmdbuf + h->cmdidx, RESET_HW);
+    h_u32_to_le(h->cmdbuf + h->cmdidx, reset);
     h->cmdidx += 4;
     /* set connect type */
-    h_u32_to_le(h->cmdbuf + h->cmdidx, CONNECT_NORMAL);
+    h_u32_to_le(h->cmdbuf + h->cmdidx, connect);
     h->cmdidx += 4;
     /* set extMode */
     h_u32_to_le(h->cmdbuf + h->cmdidx, 0);
     h->cmdidx += 4;
 
-    return nulink_usb_xfer(handle, h->databuf, 4 * 4);
+    return nulink_usb_xfer(h, h->databuf, 4 * 4);
+}
+
+static int nulink_usb_reset(void *handle)
+{
+    LOG_DEBUG("nulink_usb_reset");
+
+    assert(handle);
+
+    return nulink_usb_mcu_reset(handle, RESET_HW, CONNECT_NORMAL);
+}
+
+/* attach to the target the way hla_connect_mode asked for */
+static int nulink_usb_connect(struct nulink_usb_handle_s *h)
+{
+    switch (h->connect) {
+    case CONNECT_NONE:
+        /* the probe attaches on the first debug access */
+        LOG_DEBUG("nulink_usb_connect: attaching without reset");
+        return ERROR_OK;
+    case CONNECT_DISCONNECT:
+        /* RESET_AUTO stands for no reset in this mode */
+        LOG_DEBUG("nulink_usb_connect: connecting without reset");
+        return nulink_usb_mcu_reset(h, RESET_AUTO, CONNECT_DISCONNECT);
+    default:
+        LOG_DEBUG("nulink_usb_connect: we manually perform nulink_usb_reset");
+        return nulink_usb_reset(h);
+    }
 }
 
 static int nulink_usb_run(void *handle)
@@ -403,38 +799,93 @@ static int nulink_usb_step(void *handle)
     return res;
 }
 
-static int nulink_usb_read_regs(void *handle)
-{
-    /* not supported*/
-    LOG_DEBUG("nulink_usb_read_regs");
-
-    return ERROR_OK;
-}
-
-static int nulink_usb_read_reg(void *handle, unsigned int regsel, uint32_t *val)
+static int nulink_usb_read_regs(void *handle, const uint32_t *regsel,
+        unsigned int count, uint32_t *val)
 {
+    int res = ERROR_OK;
     struct nulink_usb_handle_s *h = handle;
 
+    LOG_DEBUG("nulink_usb_read_regs: %u registers", count);
+
     assert(handle);
 
-    nulink_usb_init_buffer(handle, 8 + 12 * 1);
-    /* set command ID */
-    h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_REG);
-    h->cmdidx += 4;
-    /* Count of registers */
-    h->cmdbuf[h->cmdidx] = 1;
-    h->cmdidx += 1;
-    /* Array of bool value (u8ReadOld) */
-    h->cmdbuf[h->cmdidx] = 0xFF;
-    h->cmdidx += 1;
-    /* Array of bool value (u8Verify) */
-    h->cmdbuf[h->cmdidx] = 0x00;
-    h->cmdidx += 1;
-    /* ignore */
-    h->cmdbuf[h->cmdidx] = 0;
-    h->cmdidx += 1;
-    /* u32Addr */
-    h_u32_to_le(h->cmdbuf + h->cmdidx, regsel);
+    /* one report per max_mem_words registers: the core and FPU registers
+     * of an M4F (53) take one Nu-Link2 report, or many Nu-Link1 ones */
+    while (count) {
+        unsigned int thisrun_count = count;
+
+        if (thisrun_count > h->max_mem_words)
+            thisrun_count = h->max_mem_words;
+
+        nulink_usb_init_buffer(handle, 8 + 12 * thisrun_count);
+        /* set command ID */
+        h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_REG);
+        h->cmdidx += 4;
+        /* Count of registers */
+        h->cmdbuf[h->cmdidx] = thisrun_count;
+        h->cmdidx += 1;
+        /* Array of bool value (u8ReadOld) */
+        h->cmdbuf[h->cmdidx] = 0xFF;
+        h->cmdidx += 1;
+        /* Array of bool value (u8Verify) */
+        h->cmdbuf[h->cmdidx] = 0x00;
+        h->cmdidx += 1;
+        /* ignore */
+        h->cmdbuf[h->cmdidx] = 0;
+        h->cmdidx += 1;
+
+        for (unsigned int i = 0; i < thisrun_count; i++) {
+            /* u32Addr */
+            h_u32_to_le(h->cmdbuf + h->cmdidx, regsel[i]);
+            h->cmdidx += 4;
+            /* u32Data */
+            h_u32_to_le(h->cmdbuf + h->cmdidx, 0);
+            h->cmdidx += 4;
+            /* u32Mask */
+            h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFFFFFFFFUL);
+            h->cmdidx += 4;
+        }
+        assert(h->cmdidx <= h->max_packet_size + 1);
+
+        res = nulink_usb_xfer(handle, h->databuf, 4 * thisrun_count * 2);
+        if (res != ERROR_OK)
+            break;
+
+        for (unsigned int i = 0; i < thisrun_count; i++)
+            val[i] = le_to_h_u32(h->databuf + 4 * (2 * i + 1));
+
+        regsel += thisrun_count;
+        val += thisrun_count;
+        count -= thisrun_count;
+    }
+
+    return res;
+}
+
+static int nulink_usb_read_reg(void *handle, unsigned int regsel, uint32_t *val)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    assert(handle);
+
+    nulink_usb_init_buffer(handle, 8 + 12 * 1);
+    /* set command ID */
+    h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_REG);
+    h->cmdidx += 4;
+    /* Count of registers */
+    h->cmdbuf[h->cmdidx] = 1;
+    h->cmdidx += 1;
+    /* Array of bool value (u8ReadOld) */
+    h->cmdbuf[h->cmdidx] = 0xFF;
+    h->cmdidx += 1;
+    /* Array of bool value (u8Verify) */
+    h->cmdbuf[h->cmdidx] = 0x00;
+    h->cmdidx += 1;
+    /* ignore */
+    h->cmdbuf[h->cmdidx] = 0;
+    h->cmdidx += 1;
+    /* u32Addr */
+    h_u32_to_le(h->cmdbuf + h->cmdidx, regsel);
     h->cmdidx += 4;
     /* u32Data */
     h_u32_to_le(h->cmdbuf + h->cmdidx, 0);
@@ -485,50 +936,31 @@ static int nulink_usb_write_reg(void *handle, unsigned int regsel, uint32_t val)
     return nulink_usb_xfer(handle, h->databuf, 4 * 2);
 }
 
-static int nulink_usb_read_mem8(void *handle, uint32_t addr, uint16_t len,
-        uint8_t *buffer)
+static int nulink_usb_write_regs(void *handle, const uint32_t *regsel,
+        unsigned int count, const uint32_t *val)
 {
     int res = ERROR_OK;
-    uint32_t offset = 0;
-    uint32_t bytes_remaining = 12;
     struct nulink_usb_handle_s *h = handle;
 
-    LOG_DEBUG("nulink_usb_read_mem8: addr 0x%08" PRIx32 ", len %" PRId16, addr, len);
+    LOG_DEBUG("nulink_usb_write_regs: %u registers", count);
 
     assert(handle);
 
-    /* check whether data is word aligned */
-    if (addr % 4) {
-        uint32_t aligned_addr = addr / 4;
-        aligned_addr = aligned_addr * 4;
-        offset = addr - aligned_addr;
-        LOG_DEBUG("nulink_usb_read_mem8: unaligned address addr 0x%08" PRIx32
-                "/aligned addr 0x%08" PRIx32 " offset %" PRIu32,
-                addr, aligned_addr, offset);
-
-        addr = aligned_addr;
-    }
-
-    while (len) {
-        unsigned int count;
-
-        if (len < bytes_remaining)
-            bytes_remaining = len;
+    while (count) {
+        unsigned int thisrun_count = count;
 
-        if (len < 4)
-            count = 1;
-        else
-            count = 2;
+        if (thisrun_count > h->max_mem_words)
+            thisrun_count = h->max_mem_words;
 
-        nulink_usb_init_buffer(handle, 8 + 12 * count);
+        nulink_usb_init_buffer(handle, 8 + 12 * thisrun_count);
         /* set command ID */
-        h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_RAM);
+        h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_REG);
         h->cmdidx += 4;
         /* Count of registers */
-        h->cmdbuf[h->cmdidx] = count;
+        h->cmdbuf[h->cmdidx] = thisrun_count;
         h->cmdidx += 1;
         /* Array of bool value (u8ReadOld) */
-        h->cmdbuf[h->cmdidx] = 0xFF;
+        h->cmdbuf[h->cmdidx] = 0x00;
         h->cmdidx += 1;
         /* Array of bool value (u8Verify) */
         h->cmdbuf[h->cmdidx] = 0x00;
@@ -537,83 +969,58 @@ static int nulink_usb_read_mem8(void *handle, uint32_t addr, uint16_t len,
         h->cmdbuf[h->cmdidx] = 0;
         h->cmdidx += 1;
 
-        for (unsigned int i = 0; i < count; i++) {
+        for (unsigned int i = 0; i < thisrun_count; i++) {
             /* u32Addr */
-            h_u32_to_le(h->cmdbuf + h->cmdidx, addr);
+            h_u32_to_le(h->cmdbuf + h->cmdidx, regsel[i]);
             h->cmdidx += 4;
             /* u32Data */
-            h_u32_to_le(h->cmdbuf + h->cmdidx, 0);
+            h_u32_to_le(h->cmdbuf + h->cmdidx, val[i]);
             h->cmdidx += 4;
             /* u32Mask */
-            h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFFFFFFFFUL);
+            h_u32_to_le(h->cmdbuf + h->cmdidx, 0x00000000UL);
             h->cmdidx += 4;
-            /* proceed to the next one  */
-            addr += 4;
         }
 
-        res = nulink_usb_xfer(handle, h->databuf, 4 * count * 2);
+        res = nulink_usb_xfer(handle, h->databuf, 4 * thisrun_count * 2);
         if (res != ERROR_OK)
             break;
 
-        /* fill in the output buffer */
-        for (unsigned int i = 0; i < count; i++) {
-            if (i == 0)
-                memcpy(buffer, h->databuf + 4 + offset, len);
-            else
-                memcpy(buffer + 2 * i, h->databuf + 4 * (2 * i + 1), len - 2);
-        }
-
-        if (len >= bytes_remaining)
-            len -= bytes_remaining;
+        regsel += thisrun_count;
+        val += thisrun_count;
+        count -= thisrun_count;
     }
 
     return res;
 }
 
-static int nulink_usb_write_mem8(void *handle, uint32_t addr, uint16_t len,
-        const uint8_t *buffer)
+static int nulink_usb_read_mem_fixed(void *handle, uint32_t addr, uint32_t count,
+        uint32_t *val)
 {
     int res = ERROR_OK;
-    uint32_t offset = 0;
-    uint32_t bytes_remaining = 12;
     struct nulink_usb_handle_s *h = handle;
 
-    LOG_DEBUG("nulink_usb_write_mem8: addr 0x%08" PRIx32 ", len %" PRIu16, addr, len);
-
     assert(handle);
 
-    /* check whether data is word aligned */
     if (addr % 4) {
-        uint32_t aligned_addr = addr / 4;
-        aligned_addr = aligned_addr * 4;
-        offset = addr - aligned_addr;
-        LOG_DEBUG("nulink_usb_write_mem8: address not aligned. addr(0x%08" PRIx32
-                ")/aligned_addr(0x%08" PRIx32 ")/offset(%" PRIu32 ")",
-                addr, aligned_addr, offset);
-
-        addr = aligned_addr;
+        LOG_ERROR("Invalid data alignment");
+        return ERROR_TARGET_UNALIGNED_ACCESS;
     }
 
-    while (len) {
-        unsigned int count;
-
-        if (len < bytes_remaining)
-            bytes_remaining = len;
+    while (count) {
+        unsigned int thisrun_count = count;
 
-        if (len < 4)
-            count = 1;
-        else
-            count = 2;
+        if (thisrun_count > h->max_mem_words)
+            thisrun_count = h->max_mem_words;
 
-        nulink_usb_init_buffer(handle, 8 + 12 * count);
+        nulink_usb_init_buffer(handle, 8 + 12 * thisrun_count);
         /* set command ID */
         h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_RAM);
         h->cmdidx += 4;
         /* Count of registers */
-        h->cmdbuf[h->cmdidx] = count;
+        h->cmdbuf[h->cmdidx] = thisrun_count;
         h->cmdidx += 1;
         /* Array of bool value (u8ReadOld) */
-        h->cmdbuf[h->cmdidx] = 0x00;
+        h->cmdbuf[h->cmdidx] = 0xFF;
         h->cmdidx += 1;
         /* Array of bool value (u8Verify) */
         h->cmdbuf[h->cmdidx] = 0x00;
@@ -622,82 +1029,65 @@ static int nulink_usb_write_mem8(void *handle, uint32_t addr, uint16_t len,
         h->cmdbuf[h->cmdidx] = 0;
         h->cmdidx += 1;
 
-        for (unsigned int i = 0; i < count; i++) {
+        /* same address in every entry, the probe reads it back to back */
+        for (unsigned int i = 0; i < thisrun_count; i++) {
             /* u32Addr */
             h_u32_to_le(h->cmdbuf + h->cmdidx, addr);
             h->cmdidx += 4;
             /* u32Data */
-            uint32_t u32buffer = buf_get_u32(buffer, 0, len * 8);
-            u32buffer = (u32buffer << offset * 8);
-            h_u32_to_le(h->cmdbuf + h->cmdidx, u32buffer);
+            h_u32_to_le(h->cmdbuf + h->cmdidx, 0);
             h->cmdidx += 4;
             /* u32Mask */
-            if (i == 0) {
-                if (offset == 0) {
-                    if (len == 1) {
-                        h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFFFFFF00UL);
-                        LOG_DEBUG("nulink_usb_write_mem8: count(%u), mask: 0xFFFFFF00", i);
-                    } else {
-                        h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFFFF0000UL);
-                        LOG_DEBUG("nulink_usb_write_mem8: count(%u), mask: 0xFFFF0000", i);
-                    }
-                } else {
-                    if (len == 1) {
-                        h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFF00FFFFUL);
-                        LOG_DEBUG("nulink_usb_write_mem8: count(%u), mask: 0xFF00FFFF", i);
-
-                    } else {
-                        h_u32_to_le(h->cmdbuf + h->cmdidx, 0x0000FFFFUL);
-                        LOG_DEBUG("nulink_usb_write_mem8: count(%u), mask: 0x0000FFFF", i);
-                    }
-                }
-            } else {
-                if (len == 4) {
-                    h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFFFF0000UL);
-                    LOG_DEBUG("nulink_usb_write_mem8: count(%u), mask: 0xFFFF0000", i);
-                } else {
-                    h_u32_to_le(h->cmdbuf + h->cmdidx, 0x00000000UL);
-                    LOG_DEBUG("nulink_usb_write_mem8: count(%u), mask: 0x00000000", i);
-                }
-            }
+            h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFFFFFFFFUL);
             h->cmdidx += 4;
-
-            /* proceed to the next one */
-            addr += 4;
-            buffer += 4;
         }
 
-        res = nulink_usb_xfer(handle, h->databuf, 4 * count * 2);
+        res = nulink_usb_xfer(handle, h->databuf, 4 * thisrun_count * 2);
         if (res != ERROR_OK)
             break;
 
-        if (len >= bytes_remaining)
-            len -= bytes_remaining;
+        for (unsigned int i = 0; i < thisrun_count; i++)
+            val[i] = le_to_h_u32(h->databuf + 4 * (2 * i + 1));
+
+        val += thisrun_count;
+        count -= thisrun_count;
     }
 
     return res;
 }
 
-static int nulink_usb_read_mem32(void *handle, uint32_t addr, uint16_t len,
-        uint8_t *buffer)
+/* the bytes outside [addr, addr + len) of the word at addr & ~3 as a
+ * CMD_WRITE_RAM mask, whose set bits keep their value */
+static uint32_t nulink_usb_keep_mask(uint32_t addr, uint32_t len)
+{
+    uint32_t offset = addr % 4;
+    uint32_t mask = 0;
+
+    for (uint32_t b = 0; b < 4; b++)
+        if (b < offset || b >= offset + len)
+            mask |= 0xFFUL << (8 * b);
+
+    return mask;
+}
+
+/* Any alignment: the words covering the range are written with the bytes
+ * outside it masked, so unaligned heads and tails share the report of
+ * the aligned body. */
+static int nulink_usb_write_bytes(void *handle, uint32_t addr, uint32_t len,
+        const uint8_t *buffer)
 {
     int res = ERROR_OK;
-    uint32_t bytes_remaining = 12;
     struct nulink_usb_handle_s *h = handle;
 
     assert(handle);
 
-    /* data must be a multiple of 4 and word aligned */
-    if (len % 4 || addr % 4) {
-        LOG_ERROR("Invalid data alignment");
-        return ERROR_TARGET_UNALIGNED_ACCESS;
-    }
-
+    /* The write responses carry nothing we need but the verified words,
+     * which are checked as they come back, so the next report is built
+     * and sent while the probe still works on the previous one. */
     while (len) {
-        if (len < bytes_remaining)
-            bytes_remaining = len;
-
-        unsigned int count = bytes_remaining / 4;
+        uint32_t offset = addr % 4;
+        unsigned int count = MIN(DIV_ROUND_UP(offset + len, 4), h->max_mem_words);
+        uint32_t bytes = MIN(len, 4 * count - offset);
 
         nulink_usb_init_buffer(handle, 8 + 12 * count);
         /* set command ID */
@@ -707,245 +1097,275 @@ static int nulink_usb_read_mem32(void *handle, uint32_t addr, uint16_t len,
         h->cmdbuf[h->cmdidx] = count;
         h->cmdidx += 1;
         /* Array of bool value (u8ReadOld) */
-        h->cmdbuf[h->cmdidx] = 0xFF;
+        h->cmdbuf[h->cmdidx] = 0x00;
         h->cmdidx += 1;
         /* Array of bool value (u8Verify) */
-        h->cmdbuf[h->cmdidx] = 0x00;
+        h->cmdbuf[h->cmdidx] = h->verify_writes ? 0xFF : 0x00;
         h->cmdidx += 1;
         /* ignore */
         h->cmdbuf[h->cmdidx] = 0;
         h->cmdidx += 1;
 
         for (unsigned int i = 0; i < count; i++) {
+            uint32_t first = (i == 0) ? addr : (addr & ~3UL) + 4 * i;
+            uint32_t done = first - addr;
+            uint32_t n = MIN(4 - first % 4, bytes - done);
+            uint8_t word[4] = { 0 };
+
+            memcpy(word + first % 4, buffer + done, n);
+
             /* u32Addr */
-            h_u32_to_le(h->cmdbuf + h->cmdidx, addr);
+            h_u32_to_le(h->cmdbuf + h->cmdidx, first & ~3UL);
             h->cmdidx += 4;
             /* u32Data */
-            h_u32_to_le(h->cmdbuf + h->cmdidx, 0);
+            h_u32_to_le(h->cmdbuf + h->cmdidx, buf_get_u32(word, 0, 32));
             h->cmdidx += 4;
             /* u32Mask */
-            h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFFFFFFFFUL);
+            h_u32_to_le(h->cmdbuf + h->cmdidx, nulink_usb_keep_mask(first, n));
             h->cmdidx += 4;
-            /* proceed to the next one  */
-            addr += 4;
         }
 
-        res = nulink_usb_xfer(handle, h->databuf, 4 * count * 2);
+        if (h->queued_retval != ERROR_OK) {
+            res = h->queued_retval;
+            h->queued_retval = ERROR_OK;
+            break;
+        }
 
-        /* fill in the output buffer */
-        for (unsigned int i = 0; i < count; i++) {
-            memcpy(buffer, h->databuf + 4 * (2 * i + 1), 4);
-            buffer += 4;
+        if (h->reports_in_flight >= NULINK_MAX_REPORTS_IN_FLIGHT) {
+            res = nulink_usb_xfer_recv(h, h->tempbuf);
+            if (res != ERROR_OK)
+                break;
         }
 
-        if (len >= bytes_remaining)
-            len -= bytes_remaining;
-        else
-            len = 0;
+        /* only whole aligned words are verified, see nulink_usb_write_mem_verify */
+        if (h->verify_writes) {
+            h->verify_buf = buffer;
+            h->verify_addr = addr;
+            h->verify_count = count;
+        }
+
+        res = nulink_usb_xfer_send(h);
+        if (res != ERROR_OK)
+            break;
+
+        addr += bytes;
+        buffer += bytes;
+        len -= bytes;
     }
 
-    return res;
+    int err = nulink_usb_xfer_drain(h);
+
+    return (res != ERROR_OK) ? res : err;
 }
 
-static int nulink_usb_write_mem32(void *handle, uint32_t addr, uint16_t len,
-        const uint8_t *buffer)
+/* number of words a single CMD_WRITE_RAM report can carry in both directions */
+static uint16_t nulink_usb_max_mem_words(struct nulink_usb_handle_s *h)
 {
-    int res = ERROR_OK;
-    uint32_t bytes_remaining = 12;
-    struct nulink_usb_handle_s *h = handle;
+    uint32_t max_command_length;
 
-    assert(handle);
-
-    /* data must be a multiple of 4 and word aligned */
-    if (len % 4 || addr % 4) {
-        LOG_ERROR("Invalid data alignment");
-        return ERROR_TARGET_UNALIGNED_ACCESS;
-    }
+    if (h->hardware_config & HARDWARE_CONFIG_NULINK2)
+        max_command_length = h->max_packet_size - 3;
+    else
+        max_command_length = h->max_packet_size - 2;
 
-    while (len) {
-        if (len < bytes_remaining)
-            bytes_remaining = len;
+    uint32_t words = (max_command_length - NULINK_RAM_CMD_HEADER_SIZE) / NULINK_RAM_CMD_ENTRY_SIZE;
 
-        unsigned int count = bytes_remaining / 4;
+    if (words > max_command_length / NULINK_RAM_RSP_ENTRY_SIZE)
+        words = max_command_length / NULINK_RAM_RSP_ENTRY_SIZE;
+    if (words > NULINK_RAM_CMD_MAX_ENTRIES)
+        words = NULINK_RAM_CMD_MAX_ENTRIES;
 
-        nulink_usb_init_buffer(handle, 8 + 12 * count);
-        /* set command ID */
-        h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_RAM);
-        h->cmdidx += 4;
-        /* Count of registers */
-        h->cmdbuf[h->cmdidx] = count;
-        h->cmdidx += 1;
-        /* Array of bool value (u8ReadOld) */
-        h->cmdbuf[h->cmdidx] = 0x00;
-        h->cmdidx += 1;
-        /* Array of bool value (u8Verify) */
-        h->cmdbuf[h->cmdidx] = 0x00;
-        h->cmdidx += 1;
-        /* ignore */
-        h->cmdbuf[h->cmdidx] = 0;
-        h->cmdidx += 1;
+    return words;
+}
 
-        for (unsigned int i = 0; i < count; i++) {
-            /* u32Addr */
-            h_u32_to_le(h->cmdbuf + h->cmdidx, addr);
-            h->cmdidx += 4;
-            /* u32Data */
-            uint32_t u32buffer = buf_get_u32(buffer, 0, 32);
-            h_u32_to_le(h->cmdbuf + h->cmdidx, u32buffer);
-            h->cmdidx += 4;
-            /* u32Mask */
-            h_u32_to_le(h->cmdbuf + h->cmdidx, 0x00000000);
-            h->cmdidx += 4;
+/* one CMD_WRITE_RAM report reading the words at addr[] into dest[] */
+static int nulink_usb_read_words(void *handle, const uint32_t *addr,
+        uint8_t * const *dest, unsigned int count)
+{
+    struct nulink_usb_handle_s *h = handle;
+    int res;
 
-            /* proceed to the next one */
-            addr += 4;
-            buffer += 4;
-        }
+    /* while the core runs, a spare entry samples DHCSR so that the
+     * target can skip its CMD_CHECK_MCU_STOP poll */
+    bool sample = h->state_callback && h->poll_running && count < h->max_mem_words;
+    unsigned int entries = count + (sample ? 1 : 0);
 
-        res = nulink_usb_xfer(handle, h->databuf, 4 * count * 2);
+    nulink_usb_init_buffer(handle, 8 + 12 * entries);
+    /* set command ID */
+    h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_WRITE_RAM);
+    h->cmdidx += 4;
+    /* Count of registers */
+    h->cmdbuf[h->cmdidx] = entries;
+    h->cmdidx += 1;
+    /* Array of bool value (u8ReadOld) */
+    h->cmdbuf[h->cmdidx] = 0xFF;
+    h->cmdidx += 1;
+    /* Array of bool value (u8Verify) */
+    h->cmdbuf[h->cmdidx] = 0x00;
+    h->cmdidx += 1;
+    /* ignore */
+    h->cmdbuf[h->cmdidx] = 0;
+    h->cmdidx += 1;
 
-        if (len >= bytes_remaining)
-            len -= bytes_remaining;
-        else
-            len = 0;
+    for (unsigned int i = 0; i < entries; i++) {
+        /* u32Addr */
+        h_u32_to_le(h->cmdbuf + h->cmdidx, i < count ? addr[i] : DCB_DHCSR);
+        h->cmdidx += 4;
+        /* u32Data */
+        h_u32_to_le(h->cmdbuf + h->cmdidx, 0);
+        h->cmdidx += 4;
+        /* u32Mask */
+        h_u32_to_le(h->cmdbuf + h->cmdidx, 0xFFFFFFFFUL);
+        h->cmdidx += 4;
     }
+    assert(h->cmdidx <= h->max_packet_size + 1);
 
-    return res;
-}
+    res = nulink_usb_xfer(handle, h->databuf, 4 * entries * 2);
+    if (res != ERROR_OK)
+        return res;
 
-static uint32_t nulink_max_block_size(uint32_t tar_autoincr_block, uint32_t address)
-{
-    uint32_t max_tar_block = (tar_autoincr_block - ((tar_autoincr_block - 1) & address));
+    for (unsigned int i = 0; i < count; i++)
+        memcpy(dest[i], h->databuf + 4 * (2 * i + 1), 4);
 
-    if (max_tar_block == 0)
-        max_tar_block = 4;
+    if (sample) {
+        if (le_to_h_u32(h->databuf + 4 * (2 * count + 1)) & S_HALT) {
+            /* have the next state call ask the probe at once */
+            h->poll_running = false;
+            h->poll_interval_ms = 0;
+            h->state_callback(h->state_priv, TARGET_HALTED);
+        } else {
+            h->state_callback(h->state_priv, TARGET_RUNNING);
+        }
+    }
 
-    return max_tar_block;
+    return ERROR_OK;
 }
 
+/* Any size and alignment: the words covering the range are read,
+ * max_mem_words per report, the partial ones at either end into bounce
+ * words of the same report. */
 static int nulink_usb_read_mem(void *handle, uint32_t addr, uint32_t size,
         uint32_t count, uint8_t *buffer)
 {
-    int retval = ERROR_OK;
     struct nulink_usb_handle_s *h = handle;
+    uint32_t words[NULINK_MAX_QUEUED_WRITES];
+    uint8_t *dest[NULINK_MAX_QUEUED_WRITES];
+    unsigned int max_words = MIN(h->max_mem_words, NULINK_MAX_QUEUED_WRITES);
+    uint8_t head[4], tail[4];
+    uint32_t len = size * count;
 
-    /* calculate byte count */
-    count *= size;
+    assert(handle);
 
-    while (count) {
-        uint32_t bytes_remaining = nulink_max_block_size(h->max_mem_packet, addr);
-
-        if (count < bytes_remaining)
-            bytes_remaining = count;
-
-        if (bytes_remaining >= 4)
-            size = 4;
-
-        /* the nulink only supports 8/32bit memory read/writes
-         * honour 32bit, all others will be handled as 8bit access */
-        if (size == 4) {
-            /* When in jtag mode the nulink uses the auto-increment functionality.
-             * However it expects us to pass the data correctly, this includes
-             * alignment and any page boundaries. We already do this as part of the
-             * adi_v5 implementation, but the nulink is a hla adapter and so this
-             * needs implementing manually.
-             * currently this only affects jtag mode, they do single
-             * access in SWD mode - but this may change and so we do it for both modes */
-
-            /* we first need to check for any unaligned bytes */
-            if (addr % 4) {
-                uint32_t head_bytes = 4 - (addr % 4);
-                retval = nulink_usb_read_mem8(handle, addr, head_bytes, buffer);
-                if (retval != ERROR_OK)
-                    return retval;
-                buffer += head_bytes;
-                addr += head_bytes;
-                count -= head_bytes;
-                bytes_remaining -= head_bytes;
-            }
+    while (len) {
+        uint32_t offset = addr % 4;
+        unsigned int n = MIN(DIV_ROUND_UP(offset + len, 4), max_words);
+        uint32_t bytes = MIN(len, 4 * n - offset);
 
-            if (bytes_remaining % 4)
-                retval = nulink_usb_read_mem(handle, addr, 1, bytes_remaining, buffer);
-            else
-                retval = nulink_usb_read_mem32(handle, addr, bytes_remaining, buffer);
-        } else {
-            retval = nulink_usb_read_mem8(handle, addr, bytes_remaining, buffer);
+        for (unsigned int i = 0; i < n; i++) {
+            words[i] = (addr & ~3UL) + 4 * i;
+            dest[i] = (i == 0 && offset) ? head : buffer + 4 * i - offset;
         }
+        if ((offset + bytes) % 4 && dest[n - 1] != head)
+            dest[n - 1] = tail;
+
+        int res = nulink_usb_read_words(handle, words, dest, n);
+        if (res != ERROR_OK)
+            return res;
 
-        if (retval != ERROR_OK)
-            return retval;
+        if (dest[0] == head)
+            memcpy(buffer, head + offset, MIN(bytes, 4 - offset));
+        if (dest[n - 1] == tail)
+            memcpy(buffer + 4 * (n - 1) - offset, tail, (offset + bytes) % 4);
 
-        buffer += bytes_remaining;
-        addr += bytes_remaining;
-        count -= bytes_remaining;
+        addr += bytes;
+        buffer += bytes;
+        len -= bytes;
     }
 
-    return retval;
+    return ERROR_OK;
 }
 
-static int nulink_usb_write_mem(void *handle, uint32_t addr, uint32_t size,
-        uint32_t count, const uint8_t *buffer)
+/* Every entry of a CMD_WRITE_RAM report has its own address, so aligned
+ * word reads from all over memory share reports.  Other regions go
+ * through nulink_usb_read_mem() in between, keeping the order. */
+static int nulink_usb_read_mem_multi(void *handle, const struct target_mem_xfer *xfers,
+        unsigned int num)
 {
-    int retval = ERROR_OK;
     struct nulink_usb_handle_s *h = handle;
+    /* max_mem_words is bound by the report size like the write queue */
+    uint32_t addr[NULINK_MAX_QUEUED_WRITES];
+    uint8_t *dest[NULINK_MAX_QUEUED_WRITES];
+    unsigned int max_words = MIN(h->max_mem_words, NULINK_MAX_QUEUED_WRITES);
+    unsigned int count = 0;
+    int res;
 
-    if (addr < ARM_SRAM_BASE) {
-        LOG_DEBUG("nulink_usb_write_mem: address below ARM_SRAM_BASE, not supported.\n");
-        return retval;
-    }
-
-    /* calculate byte count */
-    count *= size;
+    assert(handle);
 
-    while (count) {
-        uint32_t bytes_remaining = nulink_max_block_size(h->max_mem_packet, addr);
-
-        if (count < bytes_remaining)
-            bytes_remaining = count;
-
-        if (bytes_remaining >= 4)
-            size = 4;
-
-        /* the nulink only supports 8/32bit memory read/writes
-         * honour 32bit, all others will be handled as 8bit access */
-        if (size == 4) {
-            /* When in jtag mode the nulink uses the auto-increment functionality.
-             * However it expects us to pass the data correctly, this includes
-             * alignment and any page boundaries. We already do this as part of the
-             * adi_v5 implementation, but the nulink is a hla adapter and so this
-             * needs implementing manually.
-             * currently this only affects jtag mode, do single
-             * access in SWD mode - but this may change and so we do it for both modes */
-
-            /* we first need to check for any unaligned bytes */
-            if (addr % 4) {
-                uint32_t head_bytes = 4 - (addr % 4);
-                retval = nulink_usb_write_mem8(handle, addr, head_bytes, buffer);
-                if (retval != ERROR_OK)
-                    return retval;
-                buffer += head_bytes;
-                addr += head_bytes;
-                count -= head_bytes;
-                bytes_remaining -= head_bytes;
+    for (unsigned int x = 0; x < num; x++) {
+        if (xfers[x].size != 4 || xfers[x].address % 4) {
+            if (count) {
+                res = nulink_usb_read_words(handle, addr, dest, count);
+                if (res != ERROR_OK)
+                    return res;
+                count = 0;
             }
 
-            if (bytes_remaining % 4)
-                retval = nulink_usb_write_mem(handle, addr, 1, bytes_remaining, buffer);
-            else
-                retval = nulink_usb_write_mem32(handle, addr, bytes_remaining, buffer);
+            res = nulink_usb_read_mem(handle, xfers[x].address, xfers[x].size,
+                    xfers[x].count, xfers[x].buffer);
+            if (res != ERROR_OK)
+                return res;
+            continue;
+        }
 
-        } else {
-            retval = nulink_usb_write_mem8(handle, addr, bytes_remaining, buffer);
+        for (uint32_t i = 0; i < xfers[x].count; i++) {
+            addr[count] = xfers[x].address + 4 * i;
+            dest[count] = xfers[x].buffer + 4 * i;
+            if (++count == max_words) {
+                res = nulink_usb_read_words(handle, addr, dest, count);
+                if (res != ERROR_OK)
+                    return res;
+                count = 0;
+            }
         }
+    }
+
+    if (count)
+        return nulink_usb_read_words(handle, addr, dest, count);
 
-        if (retval != ERROR_OK)
-            return retval;
+    return ERROR_OK;
+}
 
-        buffer += bytes_remaining;
-        addr += bytes_remaining;
-        count -= bytes_remaining;
+static int nulink_usb_write_mem(void *handle, uint32_t addr, uint32_t size,
+        uint32_t count, const uint8_t *buffer)
+{
+    struct nulink_usb_handle_s *h = handle;
+    uint32_t len = size * count;
+
+    /* an access within one word (e.g. a peripheral register) can be deferred */
+    if (len && addr % 4 + len <= 4) {
+        uint8_t word[4] = { 0 };
+
+        memcpy(word + addr % 4, buffer, len);
+        return nulink_usb_queue_write(h, addr & ~3UL, buf_get_u32(word, 0, 32),
+                nulink_usb_keep_mask(addr, len));
     }
 
+    return nulink_usb_write_bytes(h, addr, len, buffer);
+}
+
+/* write words and have the probe read each one back in the same report */
+static int nulink_usb_write_mem_verify(void *handle, uint32_t addr, uint32_t count,
+        const uint8_t *buffer)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    if (addr % 4)
+        return ERROR_TARGET_UNALIGNED_ACCESS;
+
+    h->verify_writes = true;
+    int retval = nulink_usb_write_bytes(handle, addr, 4 * count, buffer);
+    h->verify_writes = false;
+
     return retval;
 }
 
@@ -956,6 +1376,20 @@ static int nulink_usb_override_target(const char *targetname)
     return !strcmp(targetname, "cortex_m");
 }
 
+static int nulink_usb_config_trace(void *handle, bool enabled,
+        enum tpio_pin_protocol pin_protocol, uint32_t port_size,
+        unsigned int *trace_freq)
+{
+    /* the probe firmware has no SWO capture endpoint */
+    if (enabled) {
+        LOG_ERROR("Nu-Link cannot capture SWO, use 'tpiu config external' "
+                  "with a UART on the SWO pin");
+        return ERROR_FAIL;
+    }
+
+    return ERROR_OK;
+}
+
 static int nulink_speed(void *handle, int khz, bool query)
 {
     struct nulink_usb_handle_s *h = handle;
@@ -963,6 +1397,19 @@ static int nulink_speed(void *handle, int khz, bool query)
 
     LOG_DEBUG("nulink_speed: query %s", query ? "yes" : "no");
 
+    /* 0 selects the fastest clock that passes a memory test */
+    if (khz == 0) {
+        if (query)
+            return 0;
+        return nulink_usb_speed_autotune(h);
+    }
+
+    /* an explicit clock ends the auto-tune mode */
+    if (!query) {
+        h->auto_speed = false;
+        h->speed_tune_pending = false;
+    }
+
     if (max_ice_clock > 12000)
         max_ice_clock = 12000;
     else if ((max_ice_clock == 3 * 512) || (max_ice_clock == 1500))
@@ -975,6 +1422,7 @@ static int nulink_speed(void *handle, int khz, bool query)
     LOG_DEBUG("Nu-Link nulink_speed: %lu", max_ice_clock);
 
     if (!query) {
+        h->speed_khz = max_ice_clock;
         nulink_usb_init_buffer(handle, 4 * 6);
         /* set command ID */
         h_u32_to_le(h->cmdbuf + h->cmdidx, CMD_SET_CONFIG);
@@ -1010,15 +1458,340 @@ static int nulink_speed(void *handle, int khz, bool query)
     return max_ice_clock;
 }
 
+/* write a pattern into SRAM and check that it reads back unchanged; on a
+ * failure the SRAM is restored at good_khz, the last clock that passed */
+static int nulink_usb_speed_test(struct nulink_usb_handle_s *h, int good_khz)
+{
+    uint8_t saved[4 * NULINK_SPEED_TEST_WORDS];
+    uint8_t pattern[4 * NULINK_SPEED_TEST_WORDS];
+    uint8_t readback[4 * NULINK_SPEED_TEST_WORDS];
+
+    for (unsigned int i = 0; i < NULINK_SPEED_TEST_WORDS; i++) {
+        uint32_t word = (i & 1) ? 0x55AA33CCUL : 0xAA55CC33UL;
+        h_u32_to_le(pattern + 4 * i, word ^ (i * 0x01010101UL));
+    }
+
+    /* the running core could use the SRAM written here */
+    if (nulink_usb_state(h) != TARGET_HALTED)
+        return ERROR_TARGET_NOT_HALTED;
+
+    int res = nulink_usb_read_mem(h, ARM_SRAM_BASE, 4, NULINK_SPEED_TEST_WORDS, saved);
+    if (res != ERROR_OK)
+        return res;
+
+    res = nulink_usb_write_bytes(h, ARM_SRAM_BASE, sizeof(pattern), pattern);
+    if (res == ERROR_OK)
+        res = nulink_usb_read_mem(h, ARM_SRAM_BASE, 4, NULINK_SPEED_TEST_WORDS, readback);
+    if (res == ERROR_OK && memcmp(pattern, readback, sizeof(pattern)) != 0)
+        res = ERROR_FAIL;
+
+    if (res != ERROR_OK)
+        nulink_speed(h, good_khz, false);
+
+    int err = nulink_usb_write_bytes(h, ARM_SRAM_BASE, sizeof(saved), saved);
+
+    return (res != ERROR_OK) ? res : err;
+}
+
+static int nulink_usb_speed_autotune(struct nulink_usb_handle_s *h)
+{
+    unsigned int good = 0;
+    bool found = false;
+    int res = ERROR_OK;
+
+    /* nulink_speed() leaves the auto-tune mode off while probing,
+     * so a failing step simply ends the search */
+    for (unsigned int i = 0; i < ARRAY_SIZE(nulink_speed_khz); i++) {
+        nulink_speed(h, nulink_speed_khz[i], false);
+        res = nulink_usb_speed_test(h, nulink_speed_khz[good]);
+        if (res != ERROR_OK) {
+            LOG_DEBUG("Nu-Link SWD clock %d kHz failed the memory test", nulink_speed_khz[i]);
+            break;
+        }
+        good = i;
+        found = true;
+    }
+
+    if (res == ERROR_TARGET_NOT_HALTED)
+        LOG_WARNING("Nu-Link memory test needs a halted target, using %d kHz until it halts",
+                    nulink_speed_khz[good]);
+    else if (!found)
+        LOG_WARNING("Nu-Link memory test failed at %d kHz, keeping it", nulink_speed_khz[0]);
+
+    LOG_INFO("Nu-Link SWD clock auto-tuned to %d kHz", nulink_speed_khz[good]);
+
+    int khz = nulink_speed(h, nulink_speed_khz[good], false);
+    h->auto_speed = true;
+    h->speed_index = good;
+    h->speed_tune_pending = (res == ERROR_TARGET_NOT_HALTED);
+
+    return khz;
+}
+
+/* after a failed transfer in auto-tune mode fall back one clock step */
+static void nulink_usb_speed_fallback(struct nulink_usb_handle_s *h)
+{
+    if (h->speed_index == 0)
+        return;
+
+    unsigned int index = h->speed_index - 1;
+
+    LOG_WARNING("Nu-Link transfer failed, lowering SWD clock to %d kHz",
+                nulink_speed_khz[index]);
+    nulink_speed(h, nulink_speed_khz[index], false);
+    h->auto_speed = true;
+    h->speed_index = index;
+}
+
+static void nulink_usb_stats_show(struct nulink_usb_handle_s *h)
+{
+    LOG_USER("Nu-Link: %" PRIu32 " commands, %" PRIu32 " errors, "
+             "%" PRIu64 " bytes out, %" PRIu64 " bytes in",
+             h->stats.commands, h->stats.errors, h->stats.bytes_out, h->stats.bytes_in);
+
+    for (unsigned int op = 0; op < ARRAY_SIZE(h->stats.cmd); op++) {
+        struct nulink_usb_cmd_stats *cmd = &h->stats.cmd[op];
+        char hist[NULINK_STATS_BUCKETS * 11 + 1];
+        int len = 0;
+
+        if (!cmd->count)
+            continue;
+
+        for (unsigned int i = 0; i < NULINK_STATS_BUCKETS; i++)
+            len += snprintf(hist + len, sizeof(hist) - len, " %" PRIu32, cmd->hist[i]);
+
+        LOG_USER("  0x%02X: %" PRIu32 " calls, avg %" PRIu64 " us, max %" PRIu32 " us,"
+                 " histogram (<%u us, x2 ...):%s",
+                 op, cmd->count, cmd->total_us / cmd->count, cmd->max_us,
+                 NULINK_STATS_BUCKET0_US, hist);
+    }
+}
+
+/* the "stats" counters, for the metrics server */
+static void nulink_usb_stats_collect(struct metrics_writer *writer, void *priv)
+{
+    struct nulink_usb_handle_s *h = priv;
+    double bounds[NULINK_STATS_BUCKETS - 1];
+    uint64_t buckets[NULINK_STATS_BUCKETS];
+    char labels[32];
+
+    metrics_write(writer, "openocd_nulink_commands_total", METRIC_COUNTER,
+                  "commands sent to the Nu-Link", NULL, h->stats.commands);
+    metrics_write(writer, "openocd_nulink_errors_total", METRIC_COUNTER,
+                  "Nu-Link transfers that failed", NULL, h->stats.errors);
+    metrics_write(writer, "openocd_nulink_bytes_total", METRIC_COUNTER,
+                  "bytes moved over USB", "dir=\"out\"", h->stats.bytes_out);
+    metrics_write(writer, "openocd_nulink_bytes_total", METRIC_COUNTER,
+                  "bytes moved over USB", "dir=\"in\"", h->stats.bytes_in);
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(bounds); i++)
+        bounds[i] = (NULINK_STATS_BUCKET0_US << i) / 1e6;
+
+    for (unsigned int op = 0; op < ARRAY_SIZE(h->stats.cmd); op++) {
+        struct nulink_usb_cmd_stats *cmd = &h->stats.cmd[op];
+
+        if (!cmd->count)
+            continue;
+
+        /* the buckets hold times below their bound, near enough */
+        for (unsigned int i = 0; i < NULINK_STATS_BUCKETS; i++)
+            buckets[i] = cmd->hist[i];
+        snprintf(labels, sizeof(labels), "op=\"0x%02X\"", op);
+        metrics_write_histogram(writer, "openocd_nulink_command_seconds",
+                                "round trip time per command opcode", labels,
+                                bounds, ARRAY_SIZE(bounds), buckets, cmd->total_us / 1e6);
+    }
+}
+
+#define NULINK_BENCH_ITERATIONS   (100)
+#define NULINK_BENCH_MAX_BYTES    (64 * 1024)
+#define NULINK_BENCH_SIZES        (8)
+
+/* 8-bit accesses in pieces of max_mem_packet bytes */
+static int nulink_usb_bench_mem8(struct nulink_usb_handle_s *h, bool write,
+        uint32_t addr, uint32_t len, uint8_t *buffer)
+{
+    while (len) {
+        uint32_t chunk = MIN(len, h->max_mem_packet);
+        int res = write ? nulink_usb_write_mem(h, addr, 1, chunk, buffer)
+                        : nulink_usb_read_mem(h, addr, 1, chunk, buffer);
+        if (res != ERROR_OK)
+            return res;
+        addr += chunk;
+        buffer += chunk;
+        len -= chunk;
+    }
+
+    return ERROR_OK;
+}
+
+/* KiB/s, or 0 on failure */
+static unsigned int nulink_usb_bench_rate(uint32_t bytes, int64_t elapsed_us)
+{
+    if (elapsed_us <= 0)
+        elapsed_us = 1;
+    return bytes * 1000000ULL / 1024 / elapsed_us;
+}
+
+/* hla_command "bench [max_bytes]": overwrites (then restores) SRAM */
+static int nulink_usb_bench(struct nulink_usb_handle_s *h, uint32_t max_bytes)
+{
+    static const uint32_t sizes[NULINK_BENCH_SIZES] = {
+        4, 16, 64, 256, 1024, 4096, 16384, 65536,
+    };
+    unsigned int rate[NULINK_BENCH_SIZES][4];
+    unsigned int nsizes = 0;
+    uint32_t idcode, val;
+    int64_t start;
+    int res = ERROR_OK;
+
+    if (max_bytes < 4 || max_bytes > NULINK_BENCH_MAX_BYTES) {
+        LOG_ERROR("Nu-Link bench size must be between 4 and %d bytes", NULINK_BENCH_MAX_BYTES);
+        return ERROR_COMMAND_ARGUMENT_INVALID;
+    }
+
+    /* the SRAM test below would overwrite memory a running core uses */
+    if (nulink_usb_state(h) != TARGET_HALTED) {
+        LOG_ERROR("Nu-Link bench: the target is not halted");
+        return ERROR_TARGET_NOT_HALTED;
+    }
+
+    /* raw report round trip */
+    start = nulink_usb_time_us();
+    for (unsigned int i = 0; i < NULINK_BENCH_ITERATIONS && res == ERROR_OK; i++)
+        res = nulink_usb_idcode(h, &idcode);
+    int64_t rtt_us = (nulink_usb_time_us() - start) / NULINK_BENCH_ITERATIONS;
+
+    /* core register access */
+    start = nulink_usb_time_us();
+    for (unsigned int i = 0; i < NULINK_BENCH_ITERATIONS && res == ERROR_OK; i++)
+        res = nulink_usb_read_reg(h, 0, &val);
+    int64_t reg_us = (nulink_usb_time_us() - start) / NULINK_BENCH_ITERATIONS;
+
+    if (res != ERROR_OK) {
+        LOG_ERROR("Nu-Link bench: probe command failed");
+        return res;
+    }
+
+    uint8_t *saved = malloc(max_bytes);
+    uint8_t *buffer = malloc(max_bytes);
+    if (!saved || !buffer) {
+        free(saved);
+        free(buffer);
+        LOG_ERROR("Out of memory");
+        return ERROR_FAIL;
+    }
+
+    res = nulink_usb_read_mem(h, ARM_SRAM_BASE, 4, max_bytes / 4, saved);
+
+    for (nsizes = 0; nsizes < NULINK_BENCH_SIZES && res == ERROR_OK; nsizes++) {
+        uint32_t bytes = sizes[nsizes];
+        if (bytes > max_bytes)
+            break;
+
+        for (uint32_t i = 0; i < bytes; i++)
+            buffer[i] = i * 7 + 1;
+
+        start = nulink_usb_time_us();
+        res = nulink_usb_write_mem(h, ARM_SRAM_BASE, 4, bytes / 4, buffer);
+        if (res == ERROR_OK)
+            res = nulink_usb_flush(h);
+        rate[nsizes][0] = nulink_usb_bench_rate(bytes, nulink_usb_time_us() - start);
+
+        start = nulink_usb_time_us();
+        if (res == ERROR_OK)
+            res = nulink_usb_read_mem(h, ARM_SRAM_BASE, 4, bytes / 4, buffer);
+        rate[nsizes][1] = nulink_usb_bench_rate(bytes, nulink_usb_time_us() - start);
+
+        start = nulink_usb_time_us();
+        if (res == ERROR_OK)
+            res = nulink_usb_bench_mem8(h, true, ARM_SRAM_BASE, bytes, buffer);
+        rate[nsizes][2] = nulink_usb_bench_rate(bytes, nulink_usb_time_us() - start);
+
+        start = nulink_usb_time_us();
+        if (res == ERROR_OK)
+            res = nulink_usb_bench_mem8(h, false, ARM_SRAM_BASE, bytes, buffer);
+        rate[nsizes][3] = nulink_usb_bench_rate(bytes, nulink_usb_time_us() - start);
+    }
+
+    int err = nulink_usb_write_mem(h, ARM_SRAM_BASE, 4, max_bytes / 4, saved);
+    if (res == ERROR_OK)
+        res = err;
+
+    free(saved);
+    free(buffer);
+
+    if (res != ERROR_OK) {
+        LOG_ERROR("Nu-Link bench: SRAM access at 0x%08" PRIx32 " failed", (uint32_t)ARM_SRAM_BASE);
+        return res;
+    }
+
+    LOG_USER("Nu-Link round trip %" PRId64 " us, register read %" PRId64 " us",
+             rtt_us, reg_us);
+    LOG_USER("%8s %10s %10s %10s %10s (KiB/s)", "bytes", "write32", "read32", "write8", "read8");
+    for (unsigned int i = 0; i < nsizes; i++)
+        LOG_USER("%8" PRIu32 " %10u %10u %10u %10u", sizes[i],
+                 rate[i][0], rate[i][1], rate[i][2], rate[i][3]);
+
+    char json[128 + NULINK_BENCH_SIZES * 96];
+    int len = snprintf(json, sizeof(json),
+                       "{\"rtt_us\":%" PRId64 ",\"reg_read_us\":%" PRId64 ",\"mem\":[",
+                       rtt_us, reg_us);
+    for (unsigned int i = 0; i < nsizes; i++)
+        len += snprintf(json + len, sizeof(json) - len,
+                        "%s{\"bytes\":%" PRIu32 ",\"write32\":%u,\"read32\":%u"
+                        ",\"write8\":%u,\"read8\":%u}",
+                        i ? "," : "", sizes[i], rate[i][0], rate[i][1], rate[i][2], rate[i][3]);
+    snprintf(json + len, sizeof(json) - len, "]}");
+    LOG_USER("%s", json);
+
+    return ERROR_OK;
+}
+
+/* hla_command "stats" / "stats reset" / "bench [max_bytes]" */
+static int nulink_usb_custom_command(void *handle, const char *command)
+{
+    struct nulink_usb_handle_s *h = handle;
+
+    assert(handle);
+
+    if (strncmp(command, "bench", 5) == 0 && (command[5] == '\0' || command[5] == ' ')) {
+        unsigned long max_bytes = 4096;
+        if (command[5] == ' ')
+            max_bytes = strtoul(command + 6, NULL, 0);
+        return nulink_usb_bench(h, max_bytes);
+    }
+
+    if (strcmp(command, "stats") == 0) {
+        nulink_usb_stats_show(h);
+        return ERROR_OK;
+    }
+
+    if (strcmp(command, "stats reset") == 0) {
+        memset(&h->stats, 0, sizeof(h->stats));
+        return ERROR_OK;
+    }
+
+    LOG_ERROR("unknown Nu-Link command '%s', expected 'stats', 'stats reset' or 'bench'", command);
+    return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
 static int nulink_usb_close(void *handle)
 {
     struct nulink_usb_handle_s *h = handle;
 
     LOG_DEBUG("nulink_usb_close");
 
-    if (h && h->dev_handle)
-        hid_close(h->dev_handle);
+    if (h && h->dev_handle) {
+        nulink_usb_flush(h);
+        nulink_hid_close(h->dev_handle);
+    }
 
+    if (h)
+        free(h->serial);
+    metrics_remove_collector(nulink_usb_stats_collect, h);
+    if (h == nulink_usb_active)
+        nulink_usb_active = NULL;
     free(h);
 
     hid_exit();
@@ -1032,33 +1805,223 @@ int nulink_usb_M2351_erase(int chip_type)
     return ERROR_OK;
 }
 
-int nulink_usb_reconnect(int chip_type)
+/* bring a freshly opened probe up; the target is left alone */
+static void nulink_usb_setup(struct nulink_usb_handle_s *h)
 {
-    int res = ERROR_FAIL;
+    h->usbcmdidx = 0;
+
+    switch (h->pid) {
+    case NULINK2_USB_PID1:
+    case NULINK2_USB_PID2:
+        h->hardware_config = HARDWARE_CONFIG_NULINK2;
+        h->max_packet_size = NULINK2_HID_MAX_SIZE;
+        h->init_buffer = nulink2_usb_init_buffer;
+        h->xfer = nulink2_usb_xfer;
+        break;
+    default:
+        h->hardware_config = 0;
+        h->max_packet_size = NULINK_HID_MAX_SIZE;
+        h->init_buffer = nulink1_usb_init_buffer;
+        h->xfer = nulink1_usb_xfer;
+        break;
+    }
+
+    h->max_mem_words = nulink_usb_max_mem_words(h);
+    LOG_DEBUG("Nu-Link max_mem_words %" PRIu16, h->max_mem_words);
+
+    /* get the device version */
+    h->cmdsize = 4 * 5;
+    int err = nulink_usb_version(h);
+    if (err != ERROR_OK) {
+        LOG_DEBUG("nulink_usb_version failed with cmdSize(4 * 5)");
+        h->cmdsize = 4 * 6;
+        err = nulink_usb_version(h);
+        if (err != ERROR_OK)
+            LOG_DEBUG("nulink_usb_version failed with cmdSize(4 * 6)");
+    }
+
+    /* SWD clock rate : 1MHz, or what was set before a reattach */
+    nulink_speed(h, h->speed_khz ? h->speed_khz : 1000, false);
+}
+
+/* reopen the probe last used, if it is back; tried at most every
+ * NULINK_REATTACH_INTERVAL_MS */
+static int nulink_usb_reattach(struct nulink_usb_handle_s *h)
+{
+    int64_t now = timeval_ms();
+
+    if (now < h->reattach_next_ms)
+        return ERROR_FAIL;
+    h->reattach_next_ms = now + NULINK_REATTACH_INTERVAL_MS;
+
+    struct nulink_hid *dev = nulink_hid_open(h->hid_backend, h->vid, h->pid, h->serial);
+    if (!dev)
+        return ERROR_FAIL;
+
+    h->dev_handle = dev;
+    nulink_usb_setup(h);
+    LOG_INFO("Nu-Link 0x%04" PRIx16 ":0x%04" PRIx16 " connected again", h->vid, h->pid);
 
-    LOG_INFO("nulink_usb_reconnect");
     return ERROR_OK;
 }
 
+/* drop the session with the target and start a new one over the same
+ * HID handle, e.g. once the flash driver has told the chip type apart */
+int nulink_usb_reconnect(int chip_type)
+{
+    struct nulink_usb_handle_s *h = nulink_usb_active;
+
+    LOG_DEBUG("nulink_usb_reconnect: chip type %d", chip_type);
+
+    if (!h || !h->dev_handle) {
+        LOG_ERROR("Nu-Link is not connected");
+        return ERROR_FAIL;
+    }
+
+    int res = nulink_usb_flush(h);
+    if (res != ERROR_OK)
+        return res;
+
+    nulink_usb_setup(h);
+
+    return nulink_usb_connect(h);
+}
+
+static bool nulink_usb_match(struct hl_interface_param_s *param,
+        uint16_t vid, uint16_t pid)
+{
+    bool listed = false;
+
+    if (param->vid || param->pid) {
+        listed = true;
+        if (vid == param->vid && pid == param->pid)
+            return true;
+    }
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(param->vids); i++) {
+        if (!param->vids[i] && !param->pids[i])
+            continue;
+        listed = true;
+        if (vid == param->vids[i] && pid == param->pids[i])
+            return true;
+    }
+
+    if (listed)
+        return false;
+
+    if (vid != NULINK_USB_VID)
+        return false;
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(nulink_usb_pids); i++) {
+        if (pid == nulink_usb_pids[i])
+            return true;
+    }
+
+    return false;
+}
+
+/* the probe opened last: vid, pid, serial number and hidapi path, kept
+ * for a reopen and, with hla_device_cache, in a file for the next start */
+struct nulink_usb_cache {
+    bool valid;
+    uint16_t vid, pid;
+    char serial[128];
+    char path[PATH_MAX];
+};
+
+static struct nulink_usb_cache nulink_usb_cached;
+
+static void nulink_usb_cache_load(const char *file)
+{
+    struct nulink_usb_cache c = { .valid = true };
+    char line[sizeof(c.serial) + sizeof(c.path) + 32];
+    int path_pos = 0;
+    FILE *f;
+
+    if (nulink_usb_cached.valid || !file)
+        return;
+
+    f = fopen(file, "r");
+    if (!f)
+        return;
+    /* vid pid serial path, the path is the rest of the line */
+    if (fgets(line, sizeof(line), f) &&
+            sscanf(line, "%" SCNx16 " %" SCNx16 " %127s %n", &c.vid, &c.pid, c.serial, &path_pos) == 3 &&
+            path_pos) {
+        line[strcspn(line, "\n")] = 0;
+        snprintf(c.path, sizeof(c.path), "%s", line + path_pos);
+        nulink_usb_cached = c;
+    }
+    fclose(f);
+}
+
+static void nulink_usb_cache_store(const char *file, uint16_t vid, uint16_t pid,
+        const char *serial, const char *path)
+{
+    struct nulink_usb_cache *c = &nulink_usb_cached;
+    FILE *f;
+
+    if (c->valid && c->vid == vid && c->pid == pid &&
+            !strcmp(c->serial, serial) && !strcmp(c->path, path))
+        return;
+
+    c->valid = true;
+    c->vid = vid;
+    c->pid = pid;
+    snprintf(c->serial, sizeof(c->serial), "%s", serial);
+    snprintf(c->path, sizeof(c->path), "%s", path);
+
+    if (!file)
+        return;
+    f = fopen(file, "w");
+    if (!f) {
+        LOG_WARNING("unable to write %s: %s", file, strerror(errno));
+        return;
+    }
+    fprintf(f, "%04" PRIx16 " %04" PRIx16 " %s %s\n", vid, pid, serial, path);
+    fclose(f);
+}
+
+/* open the probe of the cache without scanning, if it is still there */
+static struct nulink_hid *nulink_usb_cache_open(struct hl_interface_param_s *param)
+{
+    struct nulink_usb_cache *c = &nulink_usb_cached;
+    struct nulink_hid *dev;
+
+    nulink_usb_cache_load(param->device_cache);
+
+    /* probes without a serial number can't be told apart */
+    if (!c->valid || !strcmp(c->serial, "-"))
+        return NULL;
+    if (param->serial && strcmp(param->serial, c->serial))
+        return NULL;
+    if (!nulink_usb_match(param, c->vid, c->pid))
+        return NULL;
+
+    dev = nulink_hid_open_path(param->hid_backend, c->path, c->serial);
+    if (!dev)
+        dev = nulink_hid_open(param->hid_backend, c->vid, c->pid, c->serial);
+    if (dev)
+        LOG_INFO("Nu-Link 0x%04" PRIx16 ":0x%04" PRIx16 " serial %s (cached)",
+                 c->vid, c->pid, c->serial);
+    return dev;
+}
+
 static int nulink_usb_open(struct hl_interface_param_s *param, void **fd)
 {
     struct hid_device_info *devs, *cur_dev;
     uint16_t target_vid = 0;
     uint16_t target_pid = 0;
     wchar_t *target_serial = NULL;
+    char found_serial[128] = "-";
+    char found_path[PATH_MAX] = "";
+    struct nulink_hid *dev;
 
     LOG_DEBUG("nulink_usb_open");
 
     if (param->transport != HL_TRANSPORT_SWD)
         return TARGET_UNKNOWN;
 
-    /*
-    if (!param->vid[0] && !param->pid[0]) {
-        LOG_ERROR("Missing vid/pid");
-        return ERROR_FAIL;
-    }
-    */
-
     if (hid_init() != 0) {
         LOG_ERROR("unable to open HIDAPI");
         return ERROR_FAIL;
@@ -1069,8 +2032,8 @@ static int nulink_usb_open(struct hl_interface_param_s *param, void **fd)
         LOG_ERROR("Out of memory");
         goto error_open;
     }
-    /*
-    const char *serial = adapter_get_required_serial();
+
+    const char *serial = param->serial;
     if (serial) {
         size_t len = mbstowcs(NULL, serial, 0);
 
@@ -1086,87 +2049,85 @@ static int nulink_usb_open(struct hl_interface_param_s *param, void **fd)
             target_serial = NULL;
         }
     }
-    */
+
+    dev = nulink_usb_cache_open(param);
+    if (dev) {
+        target_vid = nulink_usb_cached.vid;
+        target_pid = nulink_usb_cached.pid;
+        goto opened;
+    }
 
     devs = hid_enumerate(0, 0);
-    cur_dev = devs;
-    while (cur_dev) {
-        bool found = false;
+    for (cur_dev = devs; cur_dev; cur_dev = cur_dev->next) {
+        if (!nulink_usb_match(param, cur_dev->vendor_id, cur_dev->product_id))
+            continue;
 
-    
-        if (0x0416 == cur_dev->vendor_id && 0x5200 == cur_dev->product_id) {
-            found = true;
-            break;
-        }
-        
+        /* list every probe so a fixture can be mapped to its serial number */
+        LOG_INFO("Nu-Link 0x%04" PRIx16 ":0x%04" PRIx16 " serial %ls",
+                 cur_dev->vendor_id, cur_dev->product_id,
+                 cur_dev->serial_number ? cur_dev->serial_number : L"(none)");
 
-        if (found) {
-            if (!target_serial)
-                break;
-            if (cur_dev->serial_number && wcscmp(target_serial, cur_dev->serial_number) == 0)
-                break;
-        }
+        if (target_vid || target_pid)
+            continue;
+        if (target_serial && (!cur_dev->serial_number ||
+                              wcscmp(target_serial, cur_dev->serial_number) != 0))
+            continue;
 
-        cur_dev = cur_dev->next;
-    }
-    if (cur_dev) {
         target_vid = cur_dev->vendor_id;
         target_pid = cur_dev->product_id;
+        if (cur_dev->serial_number &&
+                wcstombs(found_serial, cur_dev->serial_number, sizeof(found_serial)) == (size_t)-1)
+            strcpy(found_serial, "-");
+        if (strchr(found_serial, ' '))
+            strcpy(found_serial, "-");
+        if (cur_dev->path)
+            snprintf(found_path, sizeof(found_path), "%s", cur_dev->path);
     }
 
     hid_free_enumeration(devs);
 
     if (target_vid == 0 && target_pid == 0) {
-        LOG_ERROR("unable to find Nu-Link");
+        if (serial)
+            LOG_ERROR("unable to find Nu-Link with serial %s", serial);
+        else
+            LOG_ERROR("unable to find Nu-Link");
         goto error_open;
     }
 
-    hid_device *dev = hid_open(target_vid, target_pid, target_serial);
+    dev = nulink_hid_open(param->hid_backend, target_vid, target_pid, serial);
     if (!dev) {
         LOG_ERROR("unable to open Nu-Link device 0x%" PRIx16 ":0x%" PRIx16, target_vid, target_pid);
         goto error_open;
     }
+    nulink_usb_cache_store(param->device_cache, target_vid, target_pid, found_serial, found_path);
 
+opened:
     h->dev_handle = dev;
-    h->usbcmdidx = 0;
-
-    switch (target_pid) {
-    case NULINK2_USB_PID1:
-    case NULINK2_USB_PID2:
-        h->hardware_config = HARDWARE_CONFIG_NULINK2;
-        h->max_packet_size = NULINK2_HID_MAX_SIZE;
-        h->init_buffer = nulink2_usb_init_buffer;
-        h->xfer = nulink2_usb_xfer;
-        break;
-    default:
-        h->hardware_config = 0;
-        h->max_packet_size = NULINK_HID_MAX_SIZE;
-        h->init_buffer = nulink1_usb_init_buffer;
-        h->xfer = nulink1_usb_xfer;
-        break;
-    }
-
-    /* get the device version */
-    h->cmdsize = 4 * 5;
-    int err = nulink_usb_version(h);
-    if (err != ERROR_OK) {
-        LOG_DEBUG("nulink_usb_version failed with cmdSize(4 * 5)");
-        h->cmdsize = 4 * 6;
-        err = nulink_usb_version(h);
-        if (err != ERROR_OK)
-            LOG_DEBUG("nulink_usb_version failed with cmdSize(4 * 6)");
-    }
-
-    /* SWD clock rate : 1MHz */
-    nulink_speed(h, 1000, false);
+    h->hid_backend = param->hid_backend;
+    h->vid = target_vid;
+    h->pid = target_pid;
+    h->serial = serial ? strdup(serial) : NULL;
+    nulink_usb_setup(h);
 
     /* get cpuid, so we can determine the max page size
      * start with a safe default */
     h->max_mem_packet = (1 << 10);
 
-    LOG_DEBUG("nulink_usb_open: we manually perform nulink_usb_reset");
-    nulink_usb_reset(h);
+    switch (param->connect_mode) {
+    case HL_CONNECT_NONE:
+        h->connect = CONNECT_NONE;
+        break;
+    case HL_CONNECT_DISCONNECT:
+        h->connect = CONNECT_DISCONNECT;
+        break;
+    default:
+        h->connect = CONNECT_NORMAL;
+        break;
+    }
+    nulink_usb_connect(h);
 
+    nulink_usb_active = h;
+    metrics_add_collector(nulink_usb_stats_collect, h);
     *fd = h;
 
     free(target_serial);
@@ -1184,17 +2145,26 @@ struct hl_layout_api_s nulink_usb_layout_api = {
     .close = nulink_usb_close,
     .idcode = nulink_usb_idcode,
     .state = nulink_usb_state,
+    .subscribe_state = nulink_usb_subscribe_state,
     .reset = nulink_usb_reset,
     .assert_srst = nulink_usb_assert_srst,
     .run = nulink_usb_run,
     .halt = nulink_usb_halt,
     .step = nulink_usb_step,
     .read_reg = nulink_usb_read_reg,
-    .read_regs = nulink_usb_read_regs,
+    .read_reg_list = nulink_usb_read_regs,
     .write_reg = nulink_usb_write_reg,
+    .write_reg_list = nulink_usb_write_regs,
     .read_mem = nulink_usb_read_mem,
+    .read_mem_fixed = nulink_usb_read_mem_fixed,
+    .read_mem_multi = nulink_usb_read_mem_multi,
     .write_mem = nulink_usb_write_mem,
+    .write_mem_verify = nulink_usb_write_mem_verify,
     .write_debug_reg = nulink_usb_write_debug_reg,
+    .write_mem_masked = nulink_usb_write_mem_masked,
+    .flush = nulink_usb_flush,
     .override_target = nulink_usb_override_target,
     .speed = nulink_speed,
+    .config_trace = nulink_usb_config_trace,
+    .custom_command = nulink_usb_custom_command,
 };
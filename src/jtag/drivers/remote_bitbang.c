@@ -39,18 +39,66 @@
 
 static char *remote_bitbang_host;
 static char *remote_bitbang_port;
+static bool remote_bitbang_try_batch = true;
 
 FILE *remote_bitbang_in;
 FILE *remote_bitbang_out;
 
+/* Batched protocol, used when the server answers 'V' with "V1": writes and
+ * samples are packed two 4-bit codes to a byte and sent as
+ * 'P' <count 16 bit LE> <codes>; 'C' asks for the tdo bits sampled since the
+ * last 'C', returned as <count 16 bit LE> <bits, LSB first>. */
+#define REMOTE_BITBANG_BATCH_CODES	4096
+#define REMOTE_BITBANG_CODE_SAMPLE	8
+
+static bool remote_bitbang_batch;
+static uint8_t remote_bitbang_codes[REMOTE_BITBANG_BATCH_CODES / 2];
+static unsigned int remote_bitbang_code_count;
+static unsigned int remote_bitbang_samples_queued;
+static uint8_t *remote_bitbang_capture;
+static unsigned int remote_bitbang_capture_size;
+static unsigned int remote_bitbang_capture_count;
+static unsigned int remote_bitbang_capture_pos;
+
+static void remote_bitbang_flush_codes(void)
+{
+	if (!remote_bitbang_code_count)
+		return;
+
+	uint8_t header[3] = { 'P', remote_bitbang_code_count & 0xff,
+			remote_bitbang_code_count >> 8 };
+	size_t len = DIV_ROUND_UP(remote_bitbang_code_count, 2);
+
+	if (fwrite(header, 1, 3, remote_bitbang_out) != 3 ||
+	    fwrite(remote_bitbang_codes, 1, len, remote_bitbang_out) != len)
+		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang_flush_codes: %s", strerror(errno));
+
+	memset(remote_bitbang_codes, 0, len);
+	remote_bitbang_code_count = 0;
+}
+
+static void remote_bitbang_add_code(uint8_t code)
+{
+	unsigned int i = remote_bitbang_code_count++;
+
+	remote_bitbang_codes[i / 2] |= code << (4 * (i % 2));
+	if (remote_bitbang_code_count == REMOTE_BITBANG_BATCH_CODES)
+		remote_bitbang_flush_codes();
+}
+
 static void remote_bitbang_putc(int c)
 {
+	/* a plain command must not overtake the codes before it */
+	remote_bitbang_flush_codes();
+
 	if (EOF == fputc(c, remote_bitbang_out))
 		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang_putc: %s", strerror(errno));
 }
 
 static int remote_bitbang_quit(void)
 {
+	remote_bitbang_flush_codes();
+
 	if (EOF == fputc('Q', remote_bitbang_out)) {
 		LOG_ERROR("fputs: %s", strerror(errno));
 		return ERROR_FAIL;
@@ -102,10 +150,72 @@ static int remote_bitbang_read(void)
 	return remote_bitbang_rread();
 }
 
+static void remote_bitbang_sample(void)
+{
+	if (remote_bitbang_batch) {
+		remote_bitbang_add_code(REMOTE_BITBANG_CODE_SAMPLE);
+		remote_bitbang_samples_queued++;
+	} else {
+		/* read responses come back in order, fetch them later */
+		remote_bitbang_putc('R');
+	}
+}
+
+/* fetch the capture buffer for every sample queued so far */
+static void remote_bitbang_collect(void)
+{
+	uint8_t count[2];
+
+	remote_bitbang_putc('C');
+	if (EOF == fflush(remote_bitbang_out))
+		REMOTE_BITBANG_RAISE_ERROR("fflush: %s", strerror(errno));
+
+	if (fread(count, 1, 2, remote_bitbang_in) != 2)
+		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: no capture reply");
+
+	unsigned int n = le_to_h_u16(count);
+	if (n != remote_bitbang_samples_queued)
+		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: %u samples returned, %u expected",
+				n, remote_bitbang_samples_queued);
+
+	size_t len = DIV_ROUND_UP(n, 8);
+	if (len > remote_bitbang_capture_size) {
+		free(remote_bitbang_capture);
+		remote_bitbang_capture = malloc(len);
+		if (remote_bitbang_capture == NULL)
+			REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: out of memory");
+		remote_bitbang_capture_size = len;
+	}
+	if (len && fread(remote_bitbang_capture, 1, len, remote_bitbang_in) != len)
+		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: short capture reply");
+
+	remote_bitbang_capture_count = n;
+	remote_bitbang_capture_pos = 0;
+	remote_bitbang_samples_queued = 0;
+}
+
+static int remote_bitbang_read_sample(void)
+{
+	if (!remote_bitbang_batch)
+		return remote_bitbang_rread();
+
+	if (remote_bitbang_capture_pos == remote_bitbang_capture_count)
+		remote_bitbang_collect();
+	if (remote_bitbang_capture_pos == remote_bitbang_capture_count)
+		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: no sample queued");
+
+	unsigned int i = remote_bitbang_capture_pos++;
+	return (remote_bitbang_capture[i / 8] >> (i % 8)) & 1;
+}
+
 static void remote_bitbang_write(int tck, int tms, int tdi)
 {
-	char c = '0' + ((tck ? 0x4 : 0x0) | (tms ? 0x2 : 0x0) | (tdi ? 0x1 : 0x0));
-	remote_bitbang_putc(c);
+	int code = (tck ? 0x4 : 0x0) | (tms ? 0x2 : 0x0) | (tdi ? 0x1 : 0x0);
+
+	if (remote_bitbang_batch)
+		remote_bitbang_add_code(code);
+	else
+		remote_bitbang_putc('0' + code);
 }
 
 static void remote_bitbang_reset(int trst, int srst)
@@ -122,6 +232,8 @@ static void remote_bitbang_blink(int on)
 
 static struct bitbang_interface remote_bitbang_bitbang = {
 	.read = &remote_bitbang_read,
+	.sample = &remote_bitbang_sample,
+	.read_sample = &remote_bitbang_read_sample,
 	.write = &remote_bitbang_write,
 	.reset = &remote_bitbang_reset,
 	.blink = &remote_bitbang_blink,
@@ -197,6 +309,38 @@ static int remote_bitbang_init_unix(void)
 	return fd;
 }
 
+/* Ask for the batched protocol.  A server that only speaks ASCII does not
+ * answer 'V', so give up on it after a short wait. */
+static void remote_bitbang_negotiate(int fd)
+{
+	char reply[2];
+
+	remote_bitbang_batch = false;
+	if (!remote_bitbang_try_batch)
+		return;
+
+	remote_bitbang_putc('V');
+	if (EOF == fflush(remote_bitbang_out))
+		return;
+
+	fd_set rfds;
+	FD_ZERO(&rfds);
+	FD_SET(fd, &rfds);
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+	if (socket_select(fd + 1, &rfds, NULL, NULL, &tv) <= 0)
+		goto ascii;
+
+	if (fread(reply, 1, 2, remote_bitbang_in) != 2 || reply[0] != 'V' || reply[1] != '1')
+		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: unexpected reply to version query");
+
+	remote_bitbang_batch = true;
+	LOG_INFO("remote_bitbang: using the batched protocol");
+	return;
+
+ascii:
+	LOG_INFO("remote_bitbang: no reply to version query, using the ASCII protocol");
+}
+
 static int remote_bitbang_init(void)
 {
 	int fd;
@@ -225,6 +369,8 @@ static int remote_bitbang_init(void)
 		return ERROR_FAIL;
 	}
 
+	remote_bitbang_negotiate(fd);
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -251,7 +397,24 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_host_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_batch_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], remote_bitbang_try_batch);
+	return ERROR_OK;
+}
+
 static const struct command_registration remote_bitbang_command_handlers[] = {
+	{
+		.name = "remote_bitbang_batch",
+		.handler = remote_bitbang_handle_remote_bitbang_batch_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Offer the batched binary protocol to the remote jtag (default on).\n"
+			"  Turn off for servers that cannot ignore the 'V' query.",
+		.usage = "(on|off)",
+	},
 	{
 		.name = "remote_bitbang_port",
 		.handler = remote_bitbang_handle_remote_bitbang_port_command,
@@ -59,10 +59,14 @@
 #define STLINK_V1_PID         (0x3744)
 #define STLINK_V2_PID         (0x3748)
 #define STLINK_V2_1_PID       (0x374B)
+#define STLINK_V3_PID         (0x374E)
+#define STLINK_V3_S_PID       (0x374F)
+#define STLINK_V3_2VCP_PID    (0x3753)
 
-/* the current implementation of the stlink limits
- * 8bit read/writes to max 64 bytes. */
+/* the full speed stlinks limit 8bit read/writes to max 64 bytes,
+ * the high speed STLINK-V3 to 512 bytes from firmware J6 on */
 #define STLINK_MAX_RW8		(64)
+#define STLINKV3_MAX_RW8	(512)
 
 /* "WAIT" responses will be retried (with exponential backoff) at
  * most this many times before failing to caller.
@@ -84,8 +88,15 @@ struct stlink_usb_version {
 	int swim;
 	/** highest supported jtag api version */
 	enum stlink_jtag_api_version jtag_api_max;
+	/** STLINK_F_* features of this firmware */
+	uint32_t flags;
 };
 
+#define STLINK_F_HAS_TRACE              (1UL << 0)
+#define STLINK_F_HAS_SWD_SET_FREQ       (1UL << 1)
+#define STLINK_F_HAS_TARGET_VOLT        (1UL << 2)
+#define STLINK_F_HAS_RW8_512BYTES       (1UL << 3)
+
 /** */
 struct stlink_usb_handle_s {
 	/** */
@@ -106,6 +117,11 @@ struct stlink_usb_handle_s {
 	uint8_t direction;
 	/** */
 	uint8_t databuf[STLINK_DATA_SIZE];
+	/** GETLASTRWSTATUS command and reply, sent along with a memory access */
+	uint8_t rw_status_cmd[STLINK_CMD_SIZE_V2];
+	uint8_t rw_status[2];
+	/** rw_status holds the reply for the last memory access */
+	bool rw_status_valid;
 	/** */
 	uint32_t max_mem_packet;
 	/** */
@@ -152,6 +168,7 @@ struct stlink_usb_handle_s {
 #define STLINK_CORE_STAT_UNKNOWN       -1
 
 #define STLINK_GET_VERSION             0xF1
+#define STLINK_APIV3_GET_VERSION_EX    0xFB
 #define STLINK_DEBUG_COMMAND           0xF2
 #define STLINK_DFU_COMMAND             0xF3
 #define STLINK_SWIM_COMMAND            0xF4
@@ -290,26 +307,26 @@ static int stlink_usb_xfer_v1_get_status(void *handle)
 static int stlink_usb_xfer_rw(void *handle, int cmdsize, const uint8_t *buf, int size)
 {
 	struct stlink_usb_handle_s *h = handle;
+	struct jtag_xfer xfers[2];
+	unsigned int n = 0;
 
 	assert(handle != NULL);
 
-	if (jtag_libusb_bulk_write(h->fd, h->tx_ep, (char *)h->cmdbuf, cmdsize,
-			STLINK_WRITE_TIMEOUT) != cmdsize) {
-		return ERROR_FAIL;
+	/* the command and its data go out together, without waiting for
+	 * the command to be taken before the data is queued */
+	xfers[n].ep = h->tx_ep;
+	xfers[n].buf = h->cmdbuf;
+	xfers[n++].size = cmdsize;
+
+	if (size && (h->direction == h->tx_ep || h->direction == h->rx_ep)) {
+		xfers[n].ep = h->direction;
+		xfers[n].buf = (uint8_t *)buf;
+		xfers[n++].size = size;
 	}
 
-	if (h->direction == h->tx_ep && size) {
-		if (jtag_libusb_bulk_write(h->fd, h->tx_ep, (char *)buf,
-				size, STLINK_WRITE_TIMEOUT) != size) {
-			LOG_DEBUG("bulk write failed");
-			return ERROR_FAIL;
-		}
-	} else if (h->direction == h->rx_ep && size) {
-		if (jtag_libusb_bulk_read(h->fd, h->rx_ep, (char *)buf,
-				size, STLINK_READ_TIMEOUT) != size) {
-			LOG_DEBUG("bulk read failed");
-			return ERROR_FAIL;
-		}
+	if (jtag_libusb_bulk_transfer_n(h->fd, xfers, n, STLINK_WRITE_TIMEOUT) != ERROR_OK) {
+		LOG_DEBUG("bulk transfer failed");
+		return ERROR_FAIL;
 	}
 
 	return ERROR_OK;
@@ -546,14 +563,47 @@ static int stlink_usb_version(void *handle)
 	h->vid = buf_get_u32(h->databuf, 16, 16);
 	h->pid = buf_get_u32(h->databuf, 32, 16);
 
+	/* STLINK-V3 reports its versions only through the extended command */
+	if (h->version.stlink == 3) {
+		stlink_usb_init_buffer(handle, h->rx_ep, 12);
+
+		h->cmdbuf[h->cmdidx++] = STLINK_APIV3_GET_VERSION_EX;
+
+		res = stlink_usb_xfer(handle, h->databuf, 12);
+
+		if (res != ERROR_OK)
+			return res;
+
+		h->version.stlink = h->databuf[0];
+		h->version.swim = h->databuf[1];
+		h->version.jtag = h->databuf[2];
+		h->vid = le_to_h_u16(h->databuf + 8);
+		h->pid = le_to_h_u16(h->databuf + 10);
+	}
+
 	/* set the supported jtag api version
-	 * API V2 is supported since JTAG V11
+	 * API V2 is supported since JTAG V11 of stlink/v2, and by any stlink/v3
 	 */
-	if (h->version.jtag >= 11)
+	if (h->version.stlink >= 3 || h->version.jtag >= 11)
 		h->version.jtag_api_max = STLINK_JTAG_API_V2;
 	else
 		h->version.jtag_api_max = STLINK_JTAG_API_V1;
 
+	h->version.flags = 0;
+	if (h->version.stlink == 2) {
+		/* trace and target voltage since JTAG V13 */
+		if (h->version.jtag >= 13)
+			h->version.flags |= STLINK_F_HAS_TRACE | STLINK_F_HAS_TARGET_VOLT;
+		/* SWD clock setting since JTAG V22 */
+		if (h->version.jtag >= 22)
+			h->version.flags |= STLINK_F_HAS_SWD_SET_FREQ;
+	} else if (h->version.stlink >= 3) {
+		h->version.flags |= STLINK_F_HAS_TRACE | STLINK_F_HAS_TARGET_VOLT;
+		/* 512 byte 8bit read/write since JTAG V6 */
+		if (h->version.jtag >= 6)
+			h->version.flags |= STLINK_F_HAS_RW8_512BYTES;
+	}
+
 	LOG_INFO("STLINK v%d JTAG v%d API v%d SWIM v%d VID 0x%04X PID 0x%04X",
 		h->version.stlink,
 		h->version.jtag,
@@ -570,8 +620,8 @@ static int stlink_usb_check_voltage(void *handle, float *target_voltage)
 	struct stlink_usb_handle_s *h = handle;
 	uint32_t adc_results[2];
 
-	/* only supported by stlink/v2 and for firmware >= 13 */
-	if (h->version.stlink == 1 || h->version.jtag < 13)
+	/* only supported by stlink/v2 for firmware >= 13, and stlink/v3 */
+	if (!(h->version.flags & STLINK_F_HAS_TARGET_VOLT))
 		return ERROR_COMMAND_NOTFOUND;
 
 	stlink_usb_init_buffer(handle, h->rx_ep, 8);
@@ -604,7 +654,7 @@ static int stlink_usb_set_swdclk(void *handle, uint16_t clk_divisor)
 	assert(handle != NULL);
 
 	/* only supported by stlink/v2 and for firmware >= 22 */
-	if (h->version.stlink == 1 || h->version.jtag < 22)
+	if (!(h->version.flags & STLINK_F_HAS_SWD_SET_FREQ))
 		return ERROR_COMMAND_NOTFOUND;
 
 	stlink_usb_init_buffer(handle, h->rx_ep, 2);
@@ -920,7 +970,7 @@ static int stlink_usb_trace_read(void *handle, uint8_t *buf, size_t *size)
 
 	assert(handle != NULL);
 
-	if (h->trace.enabled && h->version.jtag >= STLINK_TRACE_MIN_VERSION) {
+	if (h->trace.enabled && (h->version.flags & STLINK_F_HAS_TRACE)) {
 		int res;
 
 		stlink_usb_init_buffer(handle, h->rx_ep, 10);
@@ -1034,7 +1084,7 @@ static void stlink_usb_trace_disable(void *handle)
 
 	assert(handle != NULL);
 
-	assert(h->version.jtag >= STLINK_TRACE_MIN_VERSION);
+	assert(h->version.flags & STLINK_F_HAS_TRACE);
 
 	LOG_DEBUG("Tracing: disable");
 
@@ -1056,7 +1106,7 @@ static int stlink_usb_trace_enable(void *handle)
 
 	assert(handle != NULL);
 
-	if (h->version.jtag >= STLINK_TRACE_MIN_VERSION) {
+	if (h->version.flags & STLINK_F_HAS_TRACE) {
 		stlink_usb_init_buffer(handle, h->rx_ep, 10);
 
 		h->cmdbuf[h->cmdidx++] = STLINK_DEBUG_COMMAND;
@@ -1276,6 +1326,71 @@ static int stlink_usb_get_rw_status(void *handle)
 	return stlink_usb_error_check(h);
 }
 
+/* the largest 8bit read/write */
+static uint32_t stlink_usb_block(struct stlink_usb_handle_s *h)
+{
+	if (h->version.flags & STLINK_F_HAS_RW8_512BYTES)
+		return STLINKV3_MAX_RW8;
+	return STLINK_MAX_RW8;
+}
+
+/* A memory access with its data and the GETLASTRWSTATUS that reports
+ * on it, all submitted as one batch of transfers. The status is checked
+ * by stlink_usb_mem_status(). */
+static int stlink_usb_mem_xfer(void *handle, const uint8_t *buf, int size)
+{
+	struct stlink_usb_handle_s *h = handle;
+	struct jtag_xfer xfers[4];
+	unsigned int n = 0;
+
+	assert(handle != NULL);
+
+	h->rw_status_valid = false;
+
+	if (h->version.stlink == 1 || h->jtag_api == STLINK_JTAG_API_V1)
+		return stlink_usb_xfer(handle, buf, size);
+
+	xfers[n].ep = h->tx_ep;
+	xfers[n].buf = h->cmdbuf;
+	xfers[n++].size = STLINK_CMD_SIZE_V2;
+
+	if (size) {
+		xfers[n].ep = h->direction;
+		xfers[n].buf = (uint8_t *)buf;
+		xfers[n++].size = size;
+	}
+
+	memset(h->rw_status_cmd, 0, sizeof(h->rw_status_cmd));
+	h->rw_status_cmd[0] = STLINK_DEBUG_COMMAND;
+	h->rw_status_cmd[1] = STLINK_DEBUG_APIV2_GETLASTRWSTATUS;
+
+	xfers[n].ep = h->tx_ep;
+	xfers[n].buf = h->rw_status_cmd;
+	xfers[n++].size = sizeof(h->rw_status_cmd);
+	xfers[n].ep = h->rx_ep;
+	xfers[n].buf = h->rw_status;
+	xfers[n++].size = sizeof(h->rw_status);
+
+	if (jtag_libusb_bulk_transfer_n(h->fd, xfers, n, STLINK_READ_TIMEOUT) != ERROR_OK) {
+		LOG_DEBUG("bulk transfer failed");
+		return ERROR_FAIL;
+	}
+
+	h->rw_status_valid = true;
+	return ERROR_OK;
+}
+
+static int stlink_usb_mem_status(void *handle)
+{
+	struct stlink_usb_handle_s *h = handle;
+
+	if (!h->rw_status_valid)
+		return stlink_usb_get_rw_status(handle);
+
+	h->databuf[0] = h->rw_status[0];
+	return stlink_usb_error_check(h);
+}
+
 /** */
 static int stlink_usb_read_mem8(void *handle, uint32_t addr, uint16_t len,
 			  uint8_t *buffer)
@@ -1286,8 +1401,8 @@ static int stlink_usb_read_mem8(void *handle, uint32_t addr, uint16_t len,
 
 	assert(handle != NULL);
 
-	/* max 8bit read/write is 64bytes */
-	if (len > STLINK_MAX_RW8) {
+	/* max 8bit read/write is 64 or 512 bytes */
+	if (len > stlink_usb_block(h)) {
 		LOG_DEBUG("max buffer length exceeded");
 		return ERROR_FAIL;
 	}
@@ -1305,14 +1420,14 @@ static int stlink_usb_read_mem8(void *handle, uint32_t addr, uint16_t len,
 	if (read_len == 1)
 		read_len++;
 
-	res = stlink_usb_xfer(handle, h->databuf, read_len);
+	res = stlink_usb_mem_xfer(handle, h->databuf, read_len);
 
 	if (res != ERROR_OK)
 		return res;
 
 	memcpy(buffer, h->databuf, len);
 
-	return stlink_usb_get_rw_status(handle);
+	return stlink_usb_mem_status(handle);
 }
 
 /** */
@@ -1324,8 +1439,8 @@ static int stlink_usb_write_mem8(void *handle, uint32_t addr, uint16_t len,
 
 	assert(handle != NULL);
 
-	/* max 8bit read/write is 64bytes */
-	if (len > STLINK_MAX_RW8) {
+	/* max 8bit read/write is 64 or 512 bytes */
+	if (len > stlink_usb_block(h)) {
 		LOG_DEBUG("max buffer length exceeded");
 		return ERROR_FAIL;
 	}
@@ -1339,12 +1454,12 @@ static int stlink_usb_write_mem8(void *handle, uint32_t addr, uint16_t len,
 	h_u16_to_le(h->cmdbuf+h->cmdidx, len);
 	h->cmdidx += 2;
 
-	res = stlink_usb_xfer(handle, buffer, len);
+	res = stlink_usb_mem_xfer(handle, buffer, len);
 
 	if (res != ERROR_OK)
 		return res;
 
-	return stlink_usb_get_rw_status(handle);
+	return stlink_usb_mem_status(handle);
 }
 
 /** */
@@ -1371,14 +1486,14 @@ static int stlink_usb_read_mem32(void *handle, uint32_t addr, uint16_t len,
 	h_u16_to_le(h->cmdbuf+h->cmdidx, len);
 	h->cmdidx += 2;
 
-	res = stlink_usb_xfer(handle, h->databuf, len);
+	res = stlink_usb_mem_xfer(handle, h->databuf, len);
 
 	if (res != ERROR_OK)
 		return res;
 
 	memcpy(buffer, h->databuf, len);
 
-	return stlink_usb_get_rw_status(handle);
+	return stlink_usb_mem_status(handle);
 }
 
 /** */
@@ -1405,12 +1520,12 @@ static int stlink_usb_write_mem32(void *handle, uint32_t addr, uint16_t len,
 	h_u16_to_le(h->cmdbuf+h->cmdidx, len);
 	h->cmdidx += 2;
 
-	res = stlink_usb_xfer(handle, buffer, len);
+	res = stlink_usb_mem_xfer(handle, buffer, len);
 
 	if (res != ERROR_OK)
 		return res;
 
-	return stlink_usb_get_rw_status(handle);
+	return stlink_usb_mem_status(handle);
 }
 
 static uint32_t stlink_max_block_size(uint32_t tar_autoincr_block, uint32_t address)
@@ -1435,7 +1550,7 @@ static int stlink_usb_read_mem(void *handle, uint32_t addr, uint32_t size,
 	while (count) {
 
 		bytes_remaining = (size == 4) ? \
-				stlink_max_block_size(h->max_mem_packet, addr) : STLINK_MAX_RW8;
+				stlink_max_block_size(h->max_mem_packet, addr) : stlink_usb_block(h);
 
 		if (count < bytes_remaining)
 			bytes_remaining = count;
@@ -1505,7 +1620,7 @@ static int stlink_usb_write_mem(void *handle, uint32_t addr, uint32_t size,
 	while (count) {
 
 		bytes_remaining = (size == 4) ? \
-				stlink_max_block_size(h->max_mem_packet, addr) : STLINK_MAX_RW8;
+				stlink_max_block_size(h->max_mem_packet, addr) : stlink_usb_block(h);
 
 		if (count < bytes_remaining)
 			bytes_remaining = count;
@@ -1575,7 +1690,7 @@ static int stlink_speed(void *handle, int khz, bool query)
 	struct stlink_usb_handle_s *h = handle;
 
 	/* only supported by stlink/v2 and for firmware >= 22 */
-	if (h && (h->version.stlink == 1 || h->version.jtag < 22))
+	if (h && !(h->version.flags & STLINK_F_HAS_SWD_SET_FREQ))
 		return khz;
 
 	for (i = 0; i < ARRAY_SIZE(stlink_khz_to_speed_map); i++) {
@@ -1695,6 +1810,13 @@ static int stlink_usb_open(struct hl_interface_param_s *param, void **fd)
 				h->tx_ep = STLINK_V2_1_TX_EP;
 				h->trace_ep = STLINK_V2_1_TRACE_EP;
 				break;
+			case STLINK_V3_PID:
+			case STLINK_V3_S_PID:
+			case STLINK_V3_2VCP_PID:
+				h->version.stlink = 3;
+				h->tx_ep = STLINK_V2_1_TX_EP;
+				h->trace_ep = STLINK_V2_1_TRACE_EP;
+				break;
 			default:
 			/* fall through - we assume V2 to be the default version*/
 			case STLINK_V2_PID:
@@ -1781,7 +1903,7 @@ static int stlink_usb_open(struct hl_interface_param_s *param, void **fd)
 	}
 
 	/* clock speed only supported by stlink/v2 and for firmware >= 22 */
-	if (h->version.stlink >= 2 && h->version.jtag >= 22) {
+	if (h->version.flags & STLINK_F_HAS_SWD_SET_FREQ) {
 		LOG_DEBUG("Supported clock speeds are:");
 
 		for (unsigned i = 0; i < ARRAY_SIZE(stlink_khz_to_speed_map); i++)
@@ -44,6 +44,11 @@
  * For speed the sysfs "value" entry is opened at init and held open.
  * This results in considerable gains over open-write-close (45s vs 900s)
  *
+ * Where the kernel provides the GPIO character device (/dev/gpiochipN) and
+ * sysfsgpio_chip names it, the gpio numbers are taken as line offsets on
+ * that chip instead. TCK, TMS and TDI are then requested as one line handle
+ * so a bitbang write costs a single ioctl rather than up to three writes.
+ *
  * Further work could address:
  *  -srst and trst open drain/ push pull
  *  -configurable active high/low for srst & trst
@@ -55,6 +60,11 @@
 #include <jtag/interface.h>
 #include "bitbang.h"
 
+#if HAVE_LINUX_GPIO_H
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#endif
+
 /*
  * Helper func to determine if gpio number valid
  *
@@ -179,6 +189,9 @@ static int last_swdio;
 static bool last_stored;
 static bool swdio_input;
 
+/* GPIO character device to use instead of sysfs, NULL when not set */
+static char *sysfsgpio_chip;
+
 static void sysfsgpio_swdio_drive(bool is_output)
 {
 	char buf[40];
@@ -447,6 +460,20 @@ COMMAND_HANDLER(sysfsgpio_handle_swd_gpionum_swdio)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(sysfsgpio_handle_chip)
+{
+	if (CMD_ARGC == 1) {
+		free(sysfsgpio_chip);
+		sysfsgpio_chip = strdup(CMD_ARGV[0]);
+	} else if (CMD_ARGC != 0) {
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	command_print(CMD_CTX, "SysfsGPIO chip: %s",
+			sysfsgpio_chip ? sysfsgpio_chip : "none (sysfs)");
+	return ERROR_OK;
+}
+
 static const struct command_registration sysfsgpio_command_handlers[] = {
 	{
 		.name = "sysfsgpio_jtag_nums",
@@ -510,6 +537,14 @@ static const struct command_registration sysfsgpio_command_handlers[] = {
 		.mode = COMMAND_CONFIG,
 		.help = "gpio number for swdio.",
 	},
+	{
+		.name = "sysfsgpio_chip",
+		.handler = &sysfsgpio_handle_chip,
+		.mode = COMMAND_CONFIG,
+		.help = "GPIO character device to use instead of sysfs; "
+			"the gpio numbers become line offsets on it.",
+		.usage = "[/dev/gpiochipN]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -581,6 +616,308 @@ static bool sysfsgpio_swd_mode_possible(void)
 	return 1;
 }
 
+#if HAVE_LINUX_GPIO_H
+
+/*
+ * GPIO character device backend.
+ *
+ * Each handle covers the lines that always change together: tck, tms and
+ * tdi as one output handle, tdo as an input, swclk as an output, swdio on
+ * its own so that its direction can change, and trst/srst as one output.
+ */
+#define JTAG_OUT_TCK	0
+#define JTAG_OUT_TMS	1
+#define JTAG_OUT_TDI	2
+
+static int chip_fd = -1;
+static int jtag_out_fd = -1;
+static int tdo_in_fd = -1;
+static int swclk_out_fd = -1;
+static int swdio_line_fd = -1;
+static int reset_out_fd = -1;
+
+static int reset_trst_idx = -1;
+static int reset_srst_idx = -1;
+static unsigned int reset_lines;
+
+static uint8_t jtag_out_last[3];
+static bool jtag_out_stored;
+
+/* Returns the line handle fd, negative on failure */
+static int chip_request_lines(const int *lines, const uint8_t *values,
+		unsigned int n, bool is_output, const char *what)
+{
+	struct gpiohandle_request req;
+
+	memset(&req, 0, sizeof(req));
+	for (unsigned int i = 0; i < n; i++) {
+		req.lineoffsets[i] = lines[i];
+		if (values)
+			req.default_values[i] = values[i];
+	}
+	req.lines = n;
+	req.flags = is_output ? GPIOHANDLE_REQUEST_OUTPUT : GPIOHANDLE_REQUEST_INPUT;
+	strncpy(req.consumer_label, "openocd", sizeof(req.consumer_label) - 1);
+
+	if (ioctl(chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &req) < 0) {
+		LOG_ERROR("Couldn't request %s lines from %s", what, sysfsgpio_chip);
+		perror("sysfsgpio: ");
+		return -1;
+	}
+
+	return req.fd;
+}
+
+static void chip_set_values(int fd, const uint8_t *values, unsigned int n, const char *what)
+{
+	struct gpiohandle_data data;
+
+	memset(&data, 0, sizeof(data));
+	memcpy(data.values, values, n);
+	if (ioctl(fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0)
+		LOG_WARNING("writing %s failed", what);
+}
+
+static int chip_get_value(int fd, const char *what)
+{
+	struct gpiohandle_data data;
+
+	if (ioctl(fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) {
+		LOG_WARNING("reading %s failed", what);
+		return 0;
+	}
+
+	return data.values[0] != 0;
+}
+
+static void chip_swdio_drive(bool is_output)
+{
+	const uint8_t high = 1;
+
+#ifdef GPIOHANDLE_SET_CONFIG_IOCTL
+	struct gpiohandle_config config;
+
+	memset(&config, 0, sizeof(config));
+	config.flags = is_output ? GPIOHANDLE_REQUEST_OUTPUT : GPIOHANDLE_REQUEST_INPUT;
+	config.default_values[0] = high;
+	if (ioctl(swdio_line_fd, GPIOHANDLE_SET_CONFIG_IOCTL, &config) == 0)
+		goto done;
+#endif
+
+	/* older kernels can only change direction by requesting the line again */
+	if (swdio_line_fd >= 0)
+		close(swdio_line_fd);
+	swdio_line_fd = chip_request_lines(&swdio_gpio, &high, 1, is_output, "swdio");
+
+#ifdef GPIOHANDLE_SET_CONFIG_IOCTL
+done:
+#endif
+	last_stored = false;
+	swdio_input = !is_output;
+}
+
+static int chip_swdio_read(void)
+{
+	return chip_get_value(swdio_line_fd, "swdio");
+}
+
+static void chip_swd_write(int swclk, int swdio)
+{
+	uint8_t value;
+
+	if (!swdio_input && (!last_stored || swdio != last_swdio)) {
+		value = swdio;
+		chip_set_values(swdio_line_fd, &value, 1, "swdio");
+	}
+
+	/* write swclk last */
+	if (!last_stored || swclk != last_swclk) {
+		value = swclk;
+		chip_set_values(swclk_out_fd, &value, 1, "swclk");
+	}
+
+	last_swdio = swdio;
+	last_swclk = swclk;
+	last_stored = true;
+}
+
+static int chip_read(void)
+{
+	return chip_get_value(tdo_in_fd, "tdo");
+}
+
+/*
+ * All three lines change in the same ioctl. TMS and TDI only move on the
+ * falling edge of TCK, so updating them together with it is safe.
+ */
+static void chip_write(int tck, int tms, int tdi)
+{
+	if (swd_mode) {
+		chip_swd_write(tck, tdi);
+		return;
+	}
+
+	uint8_t values[3];
+
+	values[JTAG_OUT_TCK] = tck;
+	values[JTAG_OUT_TMS] = tms;
+	values[JTAG_OUT_TDI] = tdi;
+
+	if (jtag_out_stored && !memcmp(values, jtag_out_last, sizeof(values)))
+		return;
+
+	chip_set_values(jtag_out_fd, values, sizeof(values), "tck/tms/tdi");
+	memcpy(jtag_out_last, values, sizeof(values));
+	jtag_out_stored = true;
+}
+
+static void chip_reset(int trst, int srst)
+{
+	uint8_t values[2];
+
+	LOG_DEBUG("sysfsgpio_reset");
+
+	if (reset_out_fd < 0)
+		return;
+
+	/* assume active low */
+	if (reset_trst_idx >= 0)
+		values[reset_trst_idx] = !trst;
+	if (reset_srst_idx >= 0)
+		values[reset_srst_idx] = !srst;
+
+	chip_set_values(reset_out_fd, values, reset_lines, "trst/srst");
+}
+
+static struct bitbang_interface sysfsgpio_chip_bitbang = {
+	.read = chip_read,
+	.write = chip_write,
+	.reset = chip_reset,
+	.swdio_read = chip_swdio_read,
+	.swdio_drive = chip_swdio_drive,
+	.blink = 0
+};
+
+static void chip_close_fd(int *fd)
+{
+	if (*fd >= 0)
+		close(*fd);
+	*fd = -1;
+}
+
+static void chip_cleanup(void)
+{
+	chip_close_fd(&jtag_out_fd);
+	chip_close_fd(&tdo_in_fd);
+	chip_close_fd(&swclk_out_fd);
+	chip_close_fd(&swdio_line_fd);
+	chip_close_fd(&reset_out_fd);
+	chip_close_fd(&chip_fd);
+}
+
+/*
+ * Drive TDI and TCK low, and TMS/TRST/SRST high. SWCLK starts low and
+ * SWDIO as output high.
+ */
+static int chip_init(void)
+{
+	bitbang_interface = &sysfsgpio_chip_bitbang;
+	jtag_out_stored = false;
+	last_stored = false;
+	swdio_input = false;
+
+	chip_fd = open(sysfsgpio_chip, O_RDWR);
+	if (chip_fd < 0) {
+		LOG_ERROR("Couldn't open %s", sysfsgpio_chip);
+		perror("sysfsgpio: ");
+		return ERROR_FAIL;
+	}
+
+	if (sysfsgpio_jtag_mode_possible()) {
+		const int lines[3] = {
+			[JTAG_OUT_TCK] = tck_gpio,
+			[JTAG_OUT_TMS] = tms_gpio,
+			[JTAG_OUT_TDI] = tdi_gpio,
+		};
+		const uint8_t values[3] = {
+			[JTAG_OUT_TCK] = 0,
+			[JTAG_OUT_TMS] = 1,
+			[JTAG_OUT_TDI] = 0,
+		};
+
+		jtag_out_fd = chip_request_lines(lines, values, 3, true, "tck/tms/tdi");
+		if (jtag_out_fd < 0)
+			goto out_error;
+
+		tdo_in_fd = chip_request_lines(&tdo_gpio, NULL, 1, false, "tdo");
+		if (tdo_in_fd < 0)
+			goto out_error;
+	}
+
+	if (sysfsgpio_swd_mode_possible()) {
+		const uint8_t low = 0, high = 1;
+
+		swclk_out_fd = chip_request_lines(&swclk_gpio, &low, 1, true, "swclk");
+		if (swclk_out_fd < 0)
+			goto out_error;
+
+		swdio_line_fd = chip_request_lines(&swdio_gpio, &high, 1, true, "swdio");
+		if (swdio_line_fd < 0)
+			goto out_error;
+	}
+
+	int lines[2];
+	const uint8_t values[2] = { 1, 1 };
+
+	reset_lines = 0;
+	reset_trst_idx = -1;
+	reset_srst_idx = -1;
+	if (is_gpio_valid(trst_gpio)) {
+		reset_trst_idx = reset_lines;
+		lines[reset_lines++] = trst_gpio;
+	}
+	if (is_gpio_valid(srst_gpio)) {
+		reset_srst_idx = reset_lines;
+		lines[reset_lines++] = srst_gpio;
+	}
+	if (reset_lines) {
+		reset_out_fd = chip_request_lines(lines, values, reset_lines, true, "trst/srst");
+		if (reset_out_fd < 0)
+			goto out_error;
+	}
+
+	return ERROR_OK;
+
+out_error:
+	chip_cleanup();
+	return ERROR_FAIL;
+}
+
+#else
+
+static int chip_init(void)
+{
+	LOG_ERROR("sysfsgpio_chip needs the GPIO character device, "
+			"which this build does not support");
+	return ERROR_FAIL;
+}
+
+static void chip_cleanup(void)
+{
+}
+
+#endif /* HAVE_LINUX_GPIO_H */
+
+static void sysfsgpio_select_swd_jtag(void)
+{
+	if (sysfsgpio_swd_mode_possible()) {
+		if (swd_mode)
+			bitbang_swd_switch_seq(JTAG_TO_SWD);
+		else
+			bitbang_swd_switch_seq(SWD_TO_JTAG);
+	}
+}
+
 static int sysfsgpio_init(void)
 {
 	bitbang_interface = &sysfsgpio_bitbang;
@@ -603,6 +940,12 @@ static int sysfsgpio_init(void)
 		return ERROR_JTAG_INIT_FAILED;
 	}
 
+	if (sysfsgpio_chip) {
+		if (chip_init() != ERROR_OK)
+			return ERROR_JTAG_INIT_FAILED;
+		sysfsgpio_select_swd_jtag();
+		return ERROR_OK;
+	}
 
 	/*
 	 * Configure TDO as an input, and TDI, TCK, TMS, TRST, SRST
@@ -659,12 +1002,7 @@ static int sysfsgpio_init(void)
 			goto out_error;
 	}
 
-	if (sysfsgpio_swd_mode_possible()) {
-		if (swd_mode)
-			bitbang_swd_switch_seq(JTAG_TO_SWD);
-		else
-			bitbang_swd_switch_seq(SWD_TO_JTAG);
-	}
+	sysfsgpio_select_swd_jtag();
 
 	return ERROR_OK;
 
@@ -675,7 +1013,10 @@ out_error:
 
 static int sysfsgpio_quit(void)
 {
-	cleanup_all_fds();
+	if (sysfsgpio_chip)
+		chip_cleanup();
+	else
+		cleanup_all_fds();
 	return ERROR_OK;
 }
 
@@ -52,6 +52,7 @@ struct icdi_usb_handle_s {
 	int max_packet;
 	int read_count;
 	uint32_t max_rw_packet; /* max X packet (read/write memory) transfers */
+	bool noack; /* QStartNoAckMode in use, packets are not acked */
 };
 
 static int icdi_usb_read_mem(void *handle, uint32_t addr, uint32_t size,
@@ -158,6 +159,12 @@ static int icdi_send_packet(void *handle, int len)
 			return ERROR_FAIL;
 		}
 
+		/* no ack to wait for, the reply is all that comes back */
+		if (h->noack) {
+			transferred = 0;
+			break;
+		}
+
 		/* check that the client got the message ok, or shall we resend */
 		result = libusb_bulk_transfer(h->usb_dev, ICDI_READ_ENDPOINT, (unsigned char *)h->read_buffer, h->max_packet,
 					&transferred, ICDI_READ_TIMEOUT);
@@ -189,6 +196,10 @@ static int icdi_send_packet(void *handle, int len)
 
 	while (1) {
 
+		/* the reply may have come in with the ack */
+		if (h->read_count > 5 && h->read_buffer[h->read_count - 3] == '#')
+			return ERROR_OK;
+
 		/* read reply from icdi */
 		result = libusb_bulk_transfer(h->usb_dev, ICDI_READ_ENDPOINT, (unsigned char *)h->read_buffer + h->read_count,
 				h->max_packet - h->read_count, &transferred, ICDI_READ_TIMEOUT);
@@ -210,15 +221,11 @@ static int icdi_send_packet(void *handle, int len)
 
 		h->read_count += transferred;
 
-		/* we need to make sure we have a full packet, including checksum */
-		if (h->read_count > 5) {
-
-			/* check that we have received an packet delimiter
-			 * we do not validate the checksum
-			 * reply should contain $...#AA - so we check for # */
-			if (h->read_buffer[h->read_count - 3] == '#')
-				return ERROR_OK;
-		}
+		/* we need to make sure we have a full packet, including checksum
+		 * reply should contain $...#AA - so we check for #
+		 * we do not validate the checksum */
+		if (h->read_count > 5 && h->read_buffer[h->read_count - 3] == '#')
+			return ERROR_OK;
 
 		if (retry++ == 3) {
 			LOG_DEBUG("maximum data retries attempted");
@@ -247,20 +254,32 @@ static int icdi_send_remote_cmd(void *handle, const char *data)
 	return icdi_send_packet(handle, cmd_len);
 }
 
-static int icdi_get_cmd_result(void *handle)
+/* offset of the reply data after the '$', -1 if there is none */
+static int icdi_reply_offset(struct icdi_usb_handle_s *h)
 {
-	struct icdi_usb_handle_s *h = handle;
 	int offset = 0;
 	char ch;
 
-	assert(handle != NULL);
-
 	do {
 		ch = h->read_buffer[offset++];
 		if (offset > h->read_count)
-			return ERROR_FAIL;
+			return -1;
 	} while (ch != '$');
 
+	return offset;
+}
+
+static int icdi_get_cmd_result(void *handle)
+{
+	struct icdi_usb_handle_s *h = handle;
+	int offset;
+
+	assert(handle != NULL);
+
+	offset = icdi_reply_offset(h);
+	if (offset < 0)
+		return ERROR_FAIL;
+
 	if (memcmp("OK", h->read_buffer + offset, 2) == 0)
 		return ERROR_OK;
 
@@ -375,6 +394,8 @@ static int icdi_usb_query(void *handle)
 	}
 
 
+	bool noack = strstr(h->read_buffer, "QStartNoAckMode+") != NULL;
+
 	/* if required re allocate packet buffer */
 	if (h->max_packet != ICDI_PACKET_SIZE) {
 		h->read_buffer = realloc(h->read_buffer, h->max_packet);
@@ -397,6 +418,15 @@ static int icdi_usb_query(void *handle)
 		return ERROR_FAIL;
 	}
 
+	/* without acks every packet is one write and one read */
+	if (noack) {
+		result = icdi_send_cmd(handle, "QStartNoAckMode");
+		if (result == ERROR_OK && icdi_get_cmd_result(handle) == ERROR_OK) {
+			h->noack = true;
+			LOG_DEBUG("no ack mode enabled");
+		}
+	}
+
 	return ERROR_OK;
 }
 
@@ -546,8 +576,10 @@ static int icdi_usb_read_mem_int(void *handle, uint32_t addr, uint32_t len, uint
 		return ERROR_FAIL;
 	}
 
-	/* unescape input */
-	int read_len = remote_unescape_input(h->read_buffer + 5, h->read_count - 8, (char *)buffer, len);
+	/* unescape input, the data follows "$OK:" and is followed by "#AA" */
+	int offset = icdi_reply_offset(h) + 3;
+	int read_len = remote_unescape_input(h->read_buffer + offset, h->read_count - offset - 3,
+			(char *)buffer, len);
 	if (read_len != (int)len) {
 		LOG_ERROR("read more bytes than expected: actual 0x%x expected 0x%" PRIx32, read_len, len);
 		return ERROR_FAIL;
@@ -556,23 +588,43 @@ static int icdi_usb_read_mem_int(void *handle, uint32_t addr, uint32_t len, uint
 	return ERROR_OK;
 }
 
-static int icdi_usb_write_mem_int(void *handle, uint32_t addr, uint32_t len, const uint8_t *buffer)
+/* Write as much of len as fits in one packet once escaped, at least all
+ * of it up to max_rw_packet; *written is the number of bytes sent. */
+static int icdi_usb_write_mem_int(void *handle, uint32_t addr, uint32_t len, const uint8_t *buffer,
+		uint32_t *written)
 {
 	int result;
 	struct icdi_usb_handle_s *h = handle;
+	char header[32];
 
-	size_t cmd_len = snprintf(h->write_buffer, h->max_packet, PACKET_START "X%" PRIx32 ",%" PRIx32 ":", addr, len);
+	/* the length in the header is known only after escaping, keep the
+	 * room for it and for the "#AA" checksum */
+	int header_len = snprintf(header, sizeof(header), PACKET_START "X%" PRIx32 ",%" PRIx32 ":", addr, len);
 
 	int out_len;
-	cmd_len += remote_escape_output((const char *)buffer, len, h->write_buffer + cmd_len,
-			&out_len, h->max_packet - cmd_len);
+	int data_len = remote_escape_output((const char *)buffer, len, h->write_buffer + header_len,
+			&out_len, h->max_packet - header_len - 3);
 
 	if (out_len < (int)len) {
-		/* for now issue a error as we have no way of allocating a larger buffer */
-		LOG_ERROR("memory buffer too small: requires 0x%x actual 0x%" PRIx32, out_len, len);
-		return ERROR_FAIL;
+		/* keep whole words for the next packet */
+		if (out_len >= 4)
+			out_len &= ~3;
+		if ((uint32_t)out_len < MIN(len, h->max_rw_packet)) {
+			LOG_ERROR("memory buffer too small: requires 0x%" PRIx32 " actual 0x%x", len, out_len);
+			return ERROR_FAIL;
+		}
+		data_len = remote_escape_output((const char *)buffer, out_len, h->write_buffer + header_len,
+				&out_len, h->max_packet - header_len - 3);
 	}
 
+	/* the header with the final length is never longer than the one
+	 * room was kept for, move the data up to it if it is shorter */
+	int cmd_len = snprintf(header, sizeof(header), PACKET_START "X%" PRIx32 ",%x:", addr, out_len);
+	if (cmd_len != header_len)
+		memmove(h->write_buffer + cmd_len, h->write_buffer + header_len, data_len);
+	memcpy(h->write_buffer, header, cmd_len);
+	cmd_len += data_len;
+
 	result = icdi_send_packet(handle, cmd_len);
 	if (result != ERROR_OK)
 		return result;
@@ -584,6 +636,7 @@ static int icdi_usb_write_mem_int(void *handle, uint32_t addr, uint32_t len, con
 		return ERROR_FAIL;
 	}
 
+	*written = out_len;
 	return ERROR_OK;
 }
 
@@ -619,25 +672,21 @@ static int icdi_usb_write_mem(void *handle, uint32_t addr, uint32_t size,
 		uint32_t count, const uint8_t *buffer)
 {
 	int retval = ERROR_OK;
-	struct icdi_usb_handle_s *h = handle;
-	uint32_t bytes_remaining;
+	uint32_t written;
 
 	/* calculate byte count */
 	count *= size;
 
 	while (count) {
 
-		bytes_remaining = h->max_rw_packet;
-		if (count < bytes_remaining)
-			bytes_remaining = count;
-
-		retval = icdi_usb_write_mem_int(handle, addr, bytes_remaining, buffer);
+		/* as much as fits, most data needs few escapes */
+		retval = icdi_usb_write_mem_int(handle, addr, count, buffer, &written);
 		if (retval != ERROR_OK)
 			return retval;
 
-		buffer += bytes_remaining;
-		addr += bytes_remaining;
-		count -= bytes_remaining;
+		buffer += written;
+		addr += written;
+		count -= written;
 	}
 
 	return retval;
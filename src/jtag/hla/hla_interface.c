@@ -35,7 +35,23 @@
 
 #include <target/target.h>
 
-static struct hl_interface_s hl_if = { { 0, 0, 0, 0, { 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0 }, 0, HL_TRANSPORT_UNKNOWN, false, -1 }, 0, 0 };
+static struct hl_interface_s hl_if = {
+	.param = {
+		.device_desc = NULL,
+		.serial = NULL,
+		.vid = 0,
+		.pid = 0,
+		.api = 0,
+		.transport = HL_TRANSPORT_UNKNOWN,
+		.connect_under_reset = false,
+		.connect_mode = HL_CONNECT_NORMAL,
+		.hid_backend = HL_HID_HIDAPI,
+		.initial_interface_speed = -1,
+		.device_cache = NULL,
+	},
+	.layout = NULL,
+	.handle = NULL,
+};
 
 int hl_interface_open(enum hl_transports tr)
 {
@@ -124,6 +140,9 @@ static int hl_interface_quit(void)
 
 static int hl_interface_execute_queue(void)
 {
+	if (hl_if.layout->api->flush && hl_if.handle)
+		return hl_if.layout->api->flush(hl_if.handle);
+
 	LOG_DEBUG("hl_interface_execute_queue: ignored");
 
 	return ERROR_OK;
@@ -234,6 +253,57 @@ COMMAND_HANDLER(hl_interface_handle_serial_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(hl_interface_handle_connect_mode_command)
+{
+	LOG_DEBUG("hl_interface_handle_connect_mode_command");
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(CMD_ARGV[0], "normal") == 0)
+		hl_if.param.connect_mode = HL_CONNECT_NORMAL;
+	else if (strcmp(CMD_ARGV[0], "none") == 0)
+		hl_if.param.connect_mode = HL_CONNECT_NONE;
+	else if (strcmp(CMD_ARGV[0], "disconnect") == 0)
+		hl_if.param.connect_mode = HL_CONNECT_DISCONNECT;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(hl_interface_handle_hid_backend_command)
+{
+	LOG_DEBUG("hl_interface_handle_hid_backend_command");
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(CMD_ARGV[0], "hidapi") == 0)
+		hl_if.param.hid_backend = HL_HID_HIDAPI;
+	else if (strcmp(CMD_ARGV[0], "native") == 0)
+		hl_if.param.hid_backend = HL_HID_NATIVE;
+	else if (strcmp(CMD_ARGV[0], "libusb") == 0)
+		hl_if.param.hid_backend = HL_HID_LIBUSB;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(hl_interface_handle_device_cache_command)
+{
+	LOG_DEBUG("hl_interface_handle_device_cache_command");
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free((void *)hl_if.param.device_cache);
+	hl_if.param.device_cache = strdup(CMD_ARGV[0]);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(hl_interface_handle_layout_command)
 {
 	LOG_DEBUG("hl_interface_handle_layout_command");
@@ -374,6 +444,28 @@ static const struct command_registration hl_interface_command_handlers[] = {
 	 .help = "set the serial number of the adapter",
 	 .usage = "serial_string",
 	 },
+	{
+	 .name = "hla_connect_mode",
+	 .handler = &hl_interface_handle_connect_mode_command,
+	 .mode = COMMAND_CONFIG,
+	 .help = "select whether the target is reset when the adapter attaches",
+	 .usage = "(normal|none|disconnect)",
+	 },
+	{
+	 .name = "hla_hid_backend",
+	 .handler = &hl_interface_handle_hid_backend_command,
+	 .mode = COMMAND_CONFIG,
+	 .help = "select how the reports of a HID adapter are exchanged",
+	 .usage = "(hidapi|native|libusb)",
+	 },
+	{
+	 .name = "hla_device_cache",
+	 .handler = &hl_interface_handle_device_cache_command,
+	 .mode = COMMAND_CONFIG,
+	 .help = "remember the adapter opened last in a file, to open it "
+		 "again without scanning all USB devices",
+	 .usage = "filename",
+	 },
 	{
 	 .name = "hla_layout",
 	 .handler = &hl_interface_handle_layout_command,
@@ -29,6 +29,26 @@ enum e_hl_transports;
 /** */
 extern const char *hl_transports[];
 
+/** How the adapter attaches to the target when it is opened */
+enum hl_connect_mode {
+	/** reset the target while connecting */
+	HL_CONNECT_NORMAL = 0,
+	/** attach to the running target, leave it alone */
+	HL_CONNECT_NONE,
+	/** connect without reset, and only allow resets by the reset pin */
+	HL_CONNECT_DISCONNECT,
+};
+
+/** How a HID adapter exchanges its reports with the host */
+enum hl_hid_backend {
+	/** through hidapi */
+	HL_HID_HIDAPI = 0,
+	/** directly through the OS: hidraw on Linux, overlapped I/O on Windows */
+	HL_HID_NATIVE,
+	/** libusb interrupt transfers, the kernel HID driver detached */
+	HL_HID_LIBUSB,
+};
+
 struct hl_interface_param_s {
 	/** */
 	const char *device_desc;
@@ -48,8 +68,14 @@ struct hl_interface_param_s {
 	enum hl_transports transport;
 	/** */
 	bool connect_under_reset;
+	/** */
+	enum hl_connect_mode connect_mode;
+	/** */
+	enum hl_hid_backend hid_backend;
 	/** Initial interface clock clock speed */
 	int initial_interface_speed;
+	/** File remembering the adapter opened last, NULL for none */
+	const char *device_cache;
 };
 
 struct hl_interface_s {
@@ -27,6 +27,7 @@
 /** */
 struct hl_interface_s;
 struct hl_interface_param_s;
+struct target_mem_xfer;
 
 /** */
 extern struct hl_layout_api_s stlink_usb_layout_api;
@@ -53,16 +54,97 @@ struct hl_layout_api_s {
 	int (*read_regs) (void *handle);
 	/** */
 	int (*read_reg) (void *handle, int num, uint32_t *val);
+	/**
+	 * Read several core registers in as few transfers as possible
+	 *
+	 * @param handle A pointer to the device-specific handle
+	 * @param regsel Debug Core Register Selector values (DCRSR REGSEL)
+	 * @param count Number of entries in regsel and val
+	 * @param val Storage for the register values
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*read_reg_list) (void *handle, const uint32_t *regsel,
+			unsigned int count, uint32_t *val);
 	/** */
 	int (*write_reg) (void *handle, int num, uint32_t val);
+	/**
+	 * Write several core registers in as few transfers as possible
+	 *
+	 * @param handle A pointer to the device-specific handle
+	 * @param regsel Debug Core Register Selector values (DCRSR REGSEL)
+	 * @param count Number of entries in regsel and val
+	 * @param val The register values
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*write_reg_list) (void *handle, const uint32_t *regsel,
+			unsigned int count, const uint32_t *val);
 	/** */
 	int (*read_mem) (void *handle, uint32_t addr, uint32_t size,
 			uint32_t count, uint8_t *buffer);
+	/**
+	 * Read the same 32-bit word count times in one transfer, e.g. to
+	 * sample a free running register. Optional.
+	 *
+	 * @param handle A pointer to the device-specific handle
+	 * @param addr The word aligned address to read
+	 * @param count Number of reads
+	 * @param val Storage for the values read
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*read_mem_fixed) (void *handle, uint32_t addr, uint32_t count,
+			uint32_t *val);
+	/**
+	 * Read several memory regions in as few transfers as possible,
+	 * in the order given. Optional.
+	 *
+	 * @param handle A pointer to the device-specific handle
+	 * @param xfers The regions to read, see target_read_memory_multi()
+	 * @param num Number of entries in xfers
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*read_mem_multi) (void *handle, const struct target_mem_xfer *xfers,
+			unsigned int num);
 	/** */
 	int (*write_mem) (void *handle, uint32_t addr, uint32_t size,
 			uint32_t count, const uint8_t *buffer);
+	/**
+	 * Write 32-bit words and have the adapter read each one back,
+	 * failing on the first mismatch. Optional.
+	 *
+	 * @param handle A pointer to the device-specific handle
+	 * @param addr Word aligned target address
+	 * @param count Number of words
+	 * @param buffer Data to write, target byte order
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*write_mem_verify) (void *handle, uint32_t addr, uint32_t count,
+			const uint8_t *buffer);
 	/** */
 	int (*write_debug_reg) (void *handle, uint32_t addr, uint32_t val);
+	/**
+	 * Update some bits of a memory mapped 32-bit register
+	 *
+	 * The read-modify-write is done by the adapter, so no host round
+	 * trip is needed to fetch the old value.
+	 *
+	 * @param handle A pointer to the device-specific handle
+	 * @param addr Word aligned target address
+	 * @param val New value of the selected bits
+	 * @param mask Bits to modify; all others keep their current value
+	 * @returns ERROR_OK on success, or an error code on failure.
+	 */
+	int (*write_mem_masked) (void *handle, uint32_t addr, uint32_t val, uint32_t mask);
+	/**
+	 * Send any commands the adapter has deferred
+	 *
+	 * Adapters that batch independent writes into a single USB transfer
+	 * implement this; everything that reads back from the target flushes
+	 * implicitly.
+	 *
+	 * @param handle A pointer to the device-specific handle
+	 * @returns ERROR_OK on success, or the error of a deferred command.
+	 */
+	int (*flush) (void *handle);
 	/**
 	 * Read the idcode of the target connected to the adapter
 	 *
@@ -107,6 +189,21 @@ struct hl_layout_api_s {
 	int (*poll_trace)(void *handle, uint8_t *buf, size_t *size);
 	/** */
 	enum target_state (*state) (void *fd);
+	/**
+	 * Have the adapter report core states it learns without being asked
+	 * (optional)
+	 *
+	 * Adapters that see the core state as a side effect of other traffic
+	 * call @a callback from within those calls, so the target does not
+	 * need to be polled as long as the reports keep coming.
+	 *
+	 * @param handle A handle to adapter
+	 * @param callback Called with each state seen
+	 * @param priv Passed back to @a callback
+	 * @returns ERROR_OK on success, an error code on failure.
+	 */
+	int (*subscribe_state) (void *handle,
+			void (*callback)(void *priv, enum target_state state), void *priv);
 };
 
 /** */
@@ -297,6 +297,16 @@ void jtag_set_verify_capture_ir(bool enable);
 /** @returns True if IR scan verification will be performed. */
 bool jtag_will_verify_capture_ir(void);
 
+/**
+ * Enable or disable leaving out IR scans that would load the instruction
+ * the TAP already has, with all other TAPs already in BYPASS.
+ */
+void jtag_set_ir_cache(bool enable);
+/** @returns True if redundant IR scans are left out. */
+bool jtag_will_cache_ir(void);
+/** Forget the IR contents, the next IR scan is queued in any case. */
+void jtag_invalidate_ir_cache(void);
+
 /** Initialize debug adapter upon startup.  */
 int adapter_init(struct command_context *cmd_ctx);
 
@@ -645,6 +645,7 @@ static void jtag_tap_handle_event(struct jtag_tap *tap, enum jtag_event e)
 				 * really be verifying the scan chains ...
 				 */
 			    tap->enabled = (e == JTAG_TAP_EVENT_ENABLE);
+			    jtag_invalidate_ir_cache();
 			    LOG_INFO("JTAG tap: %s %s", tap->dotted_name,
 				tap->enabled ? "enabled" : "disabled");
 			    break;
@@ -1148,6 +1149,8 @@ COMMAND_HANDLER(handle_irscan_command)
 	}
 
 	/* did we have an endstate? */
+	/* an explicit scan is always done */
+	jtag_invalidate_ir_cache();
 	jtag_add_ir_scan(tap, fields, endstate);
 
 	retval = jtag_execute_queue();
@@ -1180,6 +1183,23 @@ COMMAND_HANDLER(handle_verify_ircapture_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_jtag_ir_cache_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_set_ir_cache(enable);
+	}
+
+	const char *status = jtag_will_cache_ir() ? "enabled" : "disabled";
+	command_print(CMD_CTX, "skipping redundant IR scans is %s", status);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_verify_jtag_command)
 {
 	if (CMD_ARGC > 1)
@@ -1340,6 +1360,15 @@ static const struct command_registration jtag_command_handlers[] = {
 			"verify values captured during Capture-IR.",
 		.usage = "['enable'|'disable']",
 	},
+	{
+		.name = "jtag_ir_cache",
+		.handler = handle_jtag_ir_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or assign flag controlling whether IR scans "
+			"that would load the instruction a TAP already has "
+			"are left out.",
+		.usage = "['enable'|'disable']",
+	},
 	{
 		.name = "verify_jtag",
 		.handler = handle_verify_jtag_command,
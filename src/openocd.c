@@ -33,10 +33,14 @@
 #include <helper/ioutil.h>
 #include <helper/util.h>
 #include <helper/configuration.h>
+#include <helper/tracelog.h>
+#include <helper/perf.h>
+#include <helper/metrics.h>
 #include <flash/nor/core.h>
 #include <flash/nand/core.h>
 #include <pld/pld.h>
 #include <flash/mflash.h>
+#include <target/rtt.h>
 
 #include <server/server.h>
 #include <server/gdb_server.h>
@@ -242,9 +246,13 @@ struct command_context *setup_command_handler(Jim_Interp *interp)
 		&server_register_commands,
 		&gdb_register_commands,
 		&log_register_commands,
+		&tracelog_register_commands,
+		&perf_register_commands,
+		&metrics_register_commands,
 		&transport_register_commands,
 		&interface_register_commands,
 		&target_register_commands,
+		&rtt_register_commands,
 		&flash_register_commands,
 		&nand_register_commands,
 		&pld_register_commands,
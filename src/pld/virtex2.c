@@ -24,6 +24,9 @@
 #include "xilinx_bit.h"
 #include "pld.h"
 
+/* bytes of bitstream per DR scan while loading */
+#define VIRTEX2_LOAD_CHUNK	(64 * 1024)
+
 static int virtex2_set_instr(struct jtag_tap *tap, uint32_t new_instr)
 {
 	if (tap == NULL)
@@ -146,14 +149,22 @@ static int virtex2_load(struct pld_device *pld_device, const char *filename)
 	virtex2_set_instr(virtex2_info->tap, 0x5);	/* CFG_IN */
 	jtag_execute_queue();
 
-	for (i = 0; i < bit_file.length; i++)
-		bit_file.data[i] = flip_u32(bit_file.data[i], 8);
-
-	field.num_bits = bit_file.length * 8;
-	field.out_value = bit_file.data;
-
-	jtag_add_dr_scan(virtex2_info->tap, 1, &field, TAP_DRPAUSE);
-	jtag_execute_queue();
+	buf_flip_u8(bit_file.data, bit_file.length);
+
+	/* Passing through DRPAUSE between the scans does not disturb the
+	 * shift, so the bitstream goes out in pieces the queue can hold
+	 * without copying all of it at once. */
+	for (i = 0; i < bit_file.length; i += VIRTEX2_LOAD_CHUNK) {
+		field.num_bits = MIN(bit_file.length - i, VIRTEX2_LOAD_CHUNK) * 8;
+		field.out_value = bit_file.data + i;
+
+		jtag_add_dr_scan(virtex2_info->tap, 1, &field, TAP_DRPAUSE);
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK) {
+			LOG_ERROR("bitstream load failed at byte %u", i);
+			return retval;
+		}
+	}
 
 	jtag_add_tlr();
 
@@ -34,6 +34,8 @@
 
 
 #define FREERTOS_MAX_PRIORITIES	63
+#define FREERTOS_MAX_LIST_SIZE	64
+#define FREERTOS_THREAD_NAME_STR_SIZE (200)
 
 #define FreeRTOS_STRUCT(int_type, ptr_type, list_prev_offset)
 
@@ -104,6 +106,7 @@ static int FreeRTOS_create(struct target *target);
 static int FreeRTOS_update_threads(struct rtos *rtos);
 static int FreeRTOS_get_thread_reg_list(struct rtos *rtos, int64_t thread_id, char **hex_reg_list);
 static int FreeRTOS_get_symbol_list_to_lookup(symbol_table_elem_t *symbol_list[]);
+static int FreeRTOS_get_thread_name(struct rtos *rtos, struct thread_detail *thread);
 
 struct rtos_type FreeRTOS_rtos = {
 	.name = "FreeRTOS",
@@ -113,6 +116,7 @@ struct rtos_type FreeRTOS_rtos = {
 	.update_threads = FreeRTOS_update_threads,
 	.get_thread_reg_list = FreeRTOS_get_thread_reg_list,
 	.get_symbol_list_to_lookup = FreeRTOS_get_symbol_list_to_lookup,
+	.get_thread_name = FreeRTOS_get_thread_name,
 };
 
 enum FreeRTOS_symbol_values {
@@ -154,6 +158,71 @@ static const struct symbols FreeRTOS_symbol_list[] = {
 /* may be problems reading if sizes are not 32 bit long integers. */
 /* test mallocs for failure */
 
+static uint64_t FreeRTOS_get_field(const uint8_t *buf, int width)
+{
+	uint64_t value = 0;
+
+	memcpy(&value, buf, width);
+	return value;
+}
+
+/* Add the tasks of one list, whose header has been read into list, to
+ * thread_details. Each list item costs one read, covering both its next
+ * pointer and its owner, and is normally served from the snapshot
+ * rtos_read_buffer() keeps of the TCBs; names are only read on demand by
+ * FreeRTOS_get_thread_name(). */
+static int FreeRTOS_read_list(struct rtos *rtos, const uint8_t *list,
+		int *tasks_found, int thread_list_size)
+{
+	const struct FreeRTOS_params *param = rtos->rtos_specific_params;
+	int item_start = MIN(param->list_elem_next_offset, param->list_elem_content_offset);
+	int item_size = MAX(param->list_elem_next_offset, param->list_elem_content_offset)
+		+ param->pointer_width - item_start;
+	uint8_t item[FREERTOS_MAX_LIST_SIZE];
+	int retval;
+
+	int64_t list_thread_count = FreeRTOS_get_field(list, param->thread_count_width);
+	uint64_t prev_list_elem_ptr = -1;
+	uint64_t list_elem_ptr = FreeRTOS_get_field(list + param->list_next_offset,
+			param->pointer_width);
+
+	while ((list_thread_count > 0) && (list_elem_ptr != 0) &&
+			(list_elem_ptr != prev_list_elem_ptr) &&
+			(*tasks_found < thread_list_size)) {
+		struct thread_detail *thread = &rtos->thread_details[*tasks_found];
+
+		retval = rtos_read_buffer(rtos, list_elem_ptr + item_start,
+				item_size, item);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Error reading thread list item in FreeRTOS thread list");
+			return retval;
+		}
+
+		thread->threadid = FreeRTOS_get_field(
+				item + param->list_elem_content_offset - item_start, param->pointer_width);
+		LOG_DEBUG("FreeRTOS: Read Thread ID at 0x%" PRIx64 ", value 0x%" PRIx64 "\r\n",
+									list_elem_ptr + param->list_elem_content_offset,
+									thread->threadid);
+
+		thread->thread_name_str = NULL;
+		thread->exists = true;
+
+		if (thread->threadid == rtos->current_thread)
+			thread->extra_info_str = strdup("Running");
+		else
+			thread->extra_info_str = NULL;
+
+		(*tasks_found)++;
+		list_thread_count--;
+
+		prev_list_elem_ptr = list_elem_ptr;
+		list_elem_ptr = FreeRTOS_get_field(
+				item + param->list_elem_next_offset - item_start, param->pointer_width);
+	}
+
+	return ERROR_OK;
+}
+
 static int FreeRTOS_update_threads(struct rtos *rtos)
 {
 	int i = 0;
@@ -260,139 +329,86 @@ static int FreeRTOS_update_threads(struct rtos *rtos)
 		return ERROR_FAIL;
 	}
 
-	symbol_address_t *list_of_lists =
-		malloc(sizeof(symbol_address_t) *
-			(max_used_priority+1 + 5));
-	if (!list_of_lists) {
+	/* all ready lists are next to each other, fetch them in one go */
+	int ready_size = (max_used_priority + 1) * param->list_width;
+	uint8_t *ready_lists = malloc(ready_size);
+	if (!ready_lists) {
 		LOG_ERROR("Error allocating memory for %" PRId64 " priorities", max_used_priority);
 		return ERROR_FAIL;
 	}
+	retval = target_read_buffer(rtos->target,
+			rtos->symbols[FreeRTOS_VAL_pxReadyTasksLists].address,
+			ready_size, ready_lists);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading FreeRTOS ready task lists");
+		free(ready_lists);
+		return retval;
+	}
 
-	int num_lists;
-	for (num_lists = 0; num_lists <= max_used_priority; num_lists++)
-		list_of_lists[num_lists] = rtos->symbols[FreeRTOS_VAL_pxReadyTasksLists].address +
-			num_lists * param->list_width;
-
-	list_of_lists[num_lists++] = rtos->symbols[FreeRTOS_VAL_xDelayedTaskList1].address;
-	list_of_lists[num_lists++] = rtos->symbols[FreeRTOS_VAL_xDelayedTaskList2].address;
-	list_of_lists[num_lists++] = rtos->symbols[FreeRTOS_VAL_xPendingReadyList].address;
-	list_of_lists[num_lists++] = rtos->symbols[FreeRTOS_VAL_xSuspendedTaskList].address;
-	list_of_lists[num_lists++] = rtos->symbols[FreeRTOS_VAL_xTasksWaitingTermination].address;
-
-	for (i = 0; i < num_lists; i++) {
-		if (list_of_lists[i] == 0)
-			continue;
-
-		/* Read the number of threads in this list */
-		int64_t list_thread_count = 0;
-		retval = target_read_buffer(rtos->target,
-				list_of_lists[i],
-				param->thread_count_width,
-				(uint8_t *)&list_thread_count);
+	for (i = 0; i <= max_used_priority; i++) {
+		retval = FreeRTOS_read_list(rtos, ready_lists + i * param->list_width,
+				&tasks_found, thread_list_size);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading number of threads in FreeRTOS thread list");
-			free(list_of_lists);
+			free(ready_lists);
 			return retval;
 		}
-		LOG_DEBUG("FreeRTOS: Read thread count for list %d at 0x%" PRIx64 ", value %" PRId64 "\r\n",
-										i, list_of_lists[i], list_thread_count);
+	}
+	free(ready_lists);
 
-		if (list_thread_count == 0)
+	static const int other_lists[] = {
+		FreeRTOS_VAL_xDelayedTaskList1,
+		FreeRTOS_VAL_xDelayedTaskList2,
+		FreeRTOS_VAL_xPendingReadyList,
+		FreeRTOS_VAL_xSuspendedTaskList,
+		FreeRTOS_VAL_xTasksWaitingTermination,
+	};
+
+	for (i = 0; i < (int)ARRAY_SIZE(other_lists); i++) {
+		uint8_t list[FREERTOS_MAX_LIST_SIZE];
+		symbol_address_t address = rtos->symbols[other_lists[i]].address;
+
+		if (address == 0)
 			continue;
 
-		/* Read the location of first list item */
-		uint64_t prev_list_elem_ptr = -1;
-		uint64_t list_elem_ptr = 0;
-		retval = target_read_buffer(rtos->target,
-				list_of_lists[i] + param->list_next_offset,
-				param->pointer_width,
-				(uint8_t *)&list_elem_ptr);
+		retval = target_read_buffer(rtos->target, address, param->list_width, list);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-			free(list_of_lists);
+			LOG_ERROR("Error reading FreeRTOS thread list at 0x%" PRIx64, address);
 			return retval;
 		}
-		LOG_DEBUG("FreeRTOS: Read first item for list %d at 0x%" PRIx64 ", value 0x%" PRIx64 "\r\n",
-										i, list_of_lists[i] + param->list_next_offset, list_elem_ptr);
-
-		while ((list_thread_count > 0) && (list_elem_ptr != 0) &&
-				(list_elem_ptr != prev_list_elem_ptr) &&
-				(tasks_found < thread_list_size)) {
-			/* Get the location of the thread structure. */
-			rtos->thread_details[tasks_found].threadid = 0;
-			retval = target_read_buffer(rtos->target,
-					list_elem_ptr + param->list_elem_content_offset,
-					param->pointer_width,
-					(uint8_t *)&(rtos->thread_details[tasks_found].threadid));
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading thread list item object in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			LOG_DEBUG("FreeRTOS: Read Thread ID at 0x%" PRIx64 ", value 0x%" PRIx64 "\r\n",
-										list_elem_ptr + param->list_elem_content_offset,
-										rtos->thread_details[tasks_found].threadid);
 
-			/* get thread name */
+		retval = FreeRTOS_read_list(rtos, list, &tasks_found, thread_list_size);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 
-			#define FREERTOS_THREAD_NAME_STR_SIZE (200)
-			char tmp_str[FREERTOS_THREAD_NAME_STR_SIZE];
+	rtos->thread_count = tasks_found;
+	return 0;
+}
 
-			/* Read the thread name */
-			retval = target_read_buffer(rtos->target,
-					rtos->thread_details[tasks_found].threadid + param->thread_name_offset,
-					FREERTOS_THREAD_NAME_STR_SIZE,
-					(uint8_t *)&tmp_str);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			tmp_str[FREERTOS_THREAD_NAME_STR_SIZE-1] = '\x00';
-			LOG_DEBUG("FreeRTOS: Read Thread Name at 0x%" PRIx64 ", value \"%s\"\r\n",
-										rtos->thread_details[tasks_found].threadid + param->thread_name_offset,
-										tmp_str);
+static int FreeRTOS_get_thread_name(struct rtos *rtos, struct thread_detail *thread)
+{
+	const struct FreeRTOS_params *param = rtos->rtos_specific_params;
+	char tmp_str[FREERTOS_THREAD_NAME_STR_SIZE];
+	int retval;
 
-			if (tmp_str[0] == '\x00')
-				strcpy(tmp_str, "No Name");
-
-			rtos->thread_details[tasks_found].thread_name_str =
-				malloc(strlen(tmp_str)+1);
-			strcpy(rtos->thread_details[tasks_found].thread_name_str, tmp_str);
-			rtos->thread_details[tasks_found].exists = true;
-
-			if (rtos->thread_details[tasks_found].threadid == rtos->current_thread) {
-				char running_str[] = "Running";
-				rtos->thread_details[tasks_found].extra_info_str = malloc(
-						sizeof(running_str));
-				strcpy(rtos->thread_details[tasks_found].extra_info_str,
-					running_str);
-			} else
-				rtos->thread_details[tasks_found].extra_info_str = NULL;
-
-			tasks_found++;
-			list_thread_count--;
-
-			prev_list_elem_ptr = list_elem_ptr;
-			list_elem_ptr = 0;
-			retval = target_read_buffer(rtos->target,
-					prev_list_elem_ptr + param->list_elem_next_offset,
-					param->pointer_width,
-					(uint8_t *)&list_elem_ptr);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading next thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			LOG_DEBUG("FreeRTOS: Read next thread location at 0x%" PRIx64 ", value 0x%" PRIx64 "\r\n",
-										prev_list_elem_ptr + param->list_elem_next_offset,
-										list_elem_ptr);
-		}
+	retval = rtos_read_buffer(rtos,
+			thread->threadid + param->thread_name_offset,
+			FREERTOS_THREAD_NAME_STR_SIZE,
+			(uint8_t *)&tmp_str);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading FreeRTOS thread name");
+		return retval;
 	}
+	tmp_str[FREERTOS_THREAD_NAME_STR_SIZE-1] = '\x00';
+	LOG_DEBUG("FreeRTOS: Read Thread Name at 0x%" PRIx64 ", value \"%s\"\r\n",
+										thread->threadid + param->thread_name_offset,
+										tmp_str);
 
-	free(list_of_lists);
-	rtos->thread_count = tasks_found;
-	return 0;
+	if (tmp_str[0] == '\x00')
+		strcpy(tmp_str, "No Name");
+
+	thread->thread_name_str = strdup(tmp_str);
+	return ERROR_OK;
 }
 
 static int FreeRTOS_get_thread_reg_list(struct rtos *rtos, int64_t thread_id, char **hex_reg_list)
@@ -414,7 +430,7 @@ static int FreeRTOS_get_thread_reg_list(struct rtos *rtos, int64_t thread_id, ch
 	param = (const struct FreeRTOS_params *) rtos->rtos_specific_params;
 
 	/* Read the stack pointer */
-	retval = target_read_buffer(rtos->target,
+	retval = rtos_read_buffer(rtos,
 			thread_id + param->thread_stack_offset,
 			param->pointer_width,
 			(uint8_t *)&stack_ptr);
@@ -451,7 +467,7 @@ static int FreeRTOS_get_thread_reg_list(struct rtos *rtos, int64_t thread_id, ch
 	if (cm4_fpu_enabled == 1) {
 		/* Read the LR to decide between stacking with or without FPU */
 		uint32_t LR_svc = 0;
-		retval = target_read_buffer(rtos->target,
+		retval = rtos_read_buffer(rtos,
 				stack_ptr + 0x20,
 				param->pointer_width,
 				(uint8_t *)&LR_svc);
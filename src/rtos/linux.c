@@ -36,6 +36,8 @@
 #include "linux_header.h"
 #define PHYS
 #define MAX_THREADS 200
+/*  every task_struct field read here lies in its first bytes, comm last */
+#define TASK_PREFETCH_SIZE (COMM + 16)
 /*  specific task  */
 struct linux_os {
 	const char *name;
@@ -51,6 +53,14 @@ struct linux_os {
 	/*  virt2phys parameter */
 	uint32_t phys_mask;
 	uint32_t phys_base;
+	/*  task_struct read in one go, see linux_prefetch_task() */
+	bool prefetch_valid;
+	uint32_t prefetch_addr;
+	uint32_t prefetch_generation;
+	uint8_t prefetch[TASK_PREFETCH_SIZE];
+	/*  init_task.tasks pointers seen by the last walk of the task list */
+	bool tasks_head_valid;
+	uint32_t tasks_head[2];
 };
 
 struct current_thread {
@@ -137,6 +147,15 @@ static int linux_read_memory(struct target *target,
 		LOG_ERROR("linux awareness : address in user space");
 		return ERROR_FAIL;
 	}
+	/*  served from the task_struct prefetched by linux_prefetch_task()  */
+	if (linux_os->prefetch_valid &&
+		linux_os->prefetch_generation == target->memory_generation &&
+		address >= linux_os->prefetch_addr &&
+		address + size * count <= linux_os->prefetch_addr + TASK_PREFETCH_SIZE) {
+		memcpy(buffer, linux_os->prefetch + (address - linux_os->prefetch_addr),
+			size * count);
+		return ERROR_OK;
+	}
 #ifdef PHYS
 	target_read_phys_memory(target, pa, size, count, buffer);
 #endif
@@ -353,6 +372,51 @@ static int linux_thread_packet(struct connection *connection, char const *packet
 		int packet_size);
 static void linux_identify_current_threads(struct target *target);
 
+/*  Read the fields of a task_struct used by fill_task(), get_name() and
+ *  next_task() with a single transfer instead of one per field.  */
+static void linux_prefetch_task(struct target *target, uint32_t base_addr)
+{
+	struct linux_os *linux_os = (struct linux_os *)
+		target->rtos->rtos_specific_params;
+
+	linux_os->prefetch_valid = false;
+	if (linux_read_memory(target, base_addr, 4, TASK_PREFETCH_SIZE / 4,
+			linux_os->prefetch) != ERROR_OK)
+		return;
+
+	linux_os->prefetch_addr = base_addr;
+	linux_os->prefetch_generation = target->memory_generation;
+	linux_os->prefetch_valid = true;
+}
+
+/*  Read the init_task.tasks list head; returns 1 when it still holds the
+ *  pointers of the last walk, that is the task list looks unchanged.  */
+static int linux_tasks_head_unchanged(struct target *target)
+{
+	struct linux_os *linux_os = (struct linux_os *)
+		target->rtos->rtos_specific_params;
+	uint8_t buffer[8];
+	uint32_t head[2];
+
+	if (linux_read_memory(target, linux_os->init_task_addr + NEXT, 4, 2,
+			buffer) != ERROR_OK) {
+		linux_os->tasks_head_valid = false;
+		return 0;
+	}
+
+	head[0] = get_buffer(target, buffer);
+	head[1] = get_buffer(target, buffer + 4);
+
+	if (linux_os->tasks_head_valid && head[0] == linux_os->tasks_head[0] &&
+		head[1] == linux_os->tasks_head[1])
+		return 1;
+
+	linux_os->tasks_head[0] = head[0];
+	linux_os->tasks_head[1] = head[1];
+	linux_os->tasks_head_valid = true;
+	return 0;
+}
+
 #ifdef PID_CHECK
 int fill_task_pid(struct target *target, struct threads *t)
 {
@@ -783,9 +847,13 @@ int linux_get_tasks(struct target *target, int context)
 	/* retrieve the thread id , currently running in the different smp core */
 	get_current(target, 1);
 
+	/*  remember the list head for linux_task_update()  */
+	linux_tasks_head_unchanged(target);
+
 	while (((t->base_addr != linux_os->init_task_addr) &&
 		(t->base_addr != 0)) || (loop == 0)) {
 		loop++;
+		linux_prefetch_task(target, t->base_addr);
 		fill_task(target, t);
 		retval = get_name(target, t);
 
@@ -879,6 +947,8 @@ static int linux_os_clean(struct target *target)
 	os_linux->threads_lookup = 0;
 	os_linux->threads_needs_update = 0;
 	os_linux->threadid_count = 1;
+	os_linux->prefetch_valid = false;
+	os_linux->tasks_head_valid = false;
 	return ERROR_OK;
 }
 
@@ -948,6 +1018,7 @@ error_handling:
 
 			if (!found) {
 				/*  it is a new thread */
+				linux_prefetch_task(target, t->base_addr);
 				if (fill_task(target, t) != ERROR_OK)
 					goto error_handling;
 
@@ -1028,6 +1099,25 @@ static int linux_task_update(struct target *target, int context)
 	/*check that all current threads have been identified  */
 	linux_identify_current_threads(target);
 
+	/*  no task added or removed at either end of the list since the last
+	 *  walk: keep the list, contexts are read again when asked for  */
+	if (linux_tasks_head_unchanged(target)) {
+		thread_list = linux_os->thread_list;
+
+		while (thread_list != NULL) {
+			if (thread_list->status == 0)
+				thread_list->status = 1;
+			linux_os->thread_count++;
+			thread_list = thread_list->next;
+		}
+
+		LOG_DEBUG("task list head unchanged, %d threads kept",
+			linux_os->thread_count);
+		free(t);
+		linux_os->threads_needs_update = 0;
+		return ERROR_OK;
+	}
+
 	while (((t->base_addr != linux_os->init_task_addr) &&
 		(t->base_addr != previous)) || (loop == 0)) {
 		/*  for avoiding any permanent loop for any reason possibly due to
@@ -1089,6 +1179,7 @@ static int linux_task_update(struct target *target, int context)
 
 		if (found == 0) {
 			uint32_t base_addr;
+			linux_prefetch_task(target, t->base_addr);
 			fill_task(target, t);
 			get_name(target, t);
 			retval = insert_into_threadlist(target, t);
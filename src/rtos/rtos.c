@@ -24,7 +24,25 @@
 #include "target/target.h"
 #include "helper/log.h"
 #include "helper/binarybuffer.h"
+#include "helper/fileio.h"
 #include "server/gdb_server.h"
+#include "target/image.h"
+
+#define RTOS_CACHE_KEY_MAX	32
+
+struct rtos_symbol_cache {
+	/* the image file, as last seen */
+	size_t file_size;
+	time_t file_mtime;
+	/* its build-id, or 'c' and its CRC if it has none */
+	uint8_t key[RTOS_CACHE_KEY_MAX];
+	size_t key_len;
+	/* what GDB resolved for it, if valid */
+	bool valid;
+	const struct rtos_type *type;
+	symbol_address_t *addresses;
+	int count;
+};
 
 /* RTOSs */
 extern struct rtos_type FreeRTOS_rtos;
@@ -74,14 +92,38 @@ static int os_alloc(struct target *target, struct rtos_type *ostype)
 	return JIM_OK;
 }
 
+static void rtos_reg_cache_clear(struct rtos *rtos)
+{
+	for (int i = 0; i < rtos->reg_cache_count; i++)
+		free(rtos->reg_cache[i].hex_reg_list);
+	free(rtos->reg_cache);
+	rtos->reg_cache = NULL;
+	rtos->reg_cache_count = 0;
+}
+
+static void rtos_snapshot_clear(struct rtos *rtos)
+{
+	free(rtos->snapshot);
+	rtos->snapshot = NULL;
+	rtos->snapshot_size = 0;
+}
+
 static void os_free(struct target *target)
 {
 	if (!target->rtos)
 		return;
 
+	rtos_reg_cache_clear(target->rtos);
+	rtos_snapshot_clear(target->rtos);
+
 	if (target->rtos->symbols)
 		free(target->rtos->symbols);
 
+	if (target->rtos->symbol_cache) {
+		free(target->rtos->symbol_cache->addresses);
+		free(target->rtos->symbol_cache);
+	}
+
 	free(target->rtos);
 	target->rtos = NULL;
 }
@@ -178,6 +220,191 @@ static bool is_symbol_mandatory(const struct rtos *os, const char *symbol)
 	return false;
 }
 
+/* the GNU build-id note of a 32-bit ELF file, 0 if it has none */
+static size_t rtos_elf_build_id(const uint8_t *elf, size_t size, const uint8_t **id)
+{
+	bool be;
+	uint32_t shoff, shentsize, shnum;
+
+#define ELF_U16(p) (be ? be_to_h_u16(p) : le_to_h_u16(p))
+#define ELF_U32(p) (be ? be_to_h_u32(p) : le_to_h_u32(p))
+
+	/* ELFCLASS32 */
+	if (size < 52 || memcmp(elf, "\177ELF", 4) || elf[4] != 1)
+		return 0;
+	be = elf[5] == 2;
+
+	shoff = ELF_U32(elf + 32);
+	shentsize = ELF_U16(elf + 46);
+	shnum = ELF_U16(elf + 48);
+	if (shentsize < 40)
+		return 0;
+
+	for (uint32_t i = 0; i < shnum; i++) {
+		const uint8_t *sh = elf + shoff + i * shentsize;
+		uint32_t offset, end;
+
+		if ((uint64_t)shoff + (uint64_t)(i + 1) * shentsize > size)
+			return 0;
+		/* SHT_NOTE */
+		if (ELF_U32(sh + 4) != 7)
+			continue;
+		offset = ELF_U32(sh + 16);
+		end = offset + ELF_U32(sh + 20);
+		if (end < offset || end > size)
+			continue;
+
+		while (offset + 12 <= end) {
+			const uint8_t *note = elf + offset;
+			uint32_t namesz = ELF_U32(note), descsz = ELF_U32(note + 4);
+			uint32_t desc = offset + 12 + ((namesz + 3) & ~3);
+
+			if (desc < offset || desc + descsz < desc || desc + descsz > end)
+				break;
+			/* NT_GNU_BUILD_ID */
+			if (ELF_U32(note + 8) == 3 && namesz == 4 && !memcmp(note + 12, "GNU", 4)) {
+				*id = elf + desc;
+				return descsz;
+			}
+			offset = desc + ((descsz + 3) & ~3);
+		}
+	}
+	return 0;
+
+#undef ELF_U16
+#undef ELF_U32
+}
+
+/* Find the key of the -rtos-cache image: its build-id, else its CRC. The
+ * file is only read again when its size or time changed. */
+static int rtos_cache_key(struct target *target, struct rtos_symbol_cache *cache)
+{
+	struct fileio *fileio;
+	size_t size, size_read;
+	time_t mtime;
+	uint8_t *buffer;
+	const uint8_t *id;
+	size_t id_len;
+	int retval;
+
+	retval = fileio_open(&fileio, target->rtos_cache_file, FILEIO_READ, FILEIO_BINARY);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = fileio_size(fileio, &size);
+	if (retval == ERROR_OK)
+		retval = fileio_mtime(fileio, &mtime);
+	if (retval != ERROR_OK || (cache->key_len && size == cache->file_size &&
+				mtime == cache->file_mtime)) {
+		fileio_close(fileio);
+		return retval;
+	}
+
+	buffer = malloc(size);
+	if (buffer == NULL) {
+		fileio_close(fileio);
+		return ERROR_FAIL;
+	}
+	retval = fileio_read(fileio, size, buffer, &size_read);
+	fileio_close(fileio);
+	if (retval == ERROR_OK && size_read != size)
+		retval = ERROR_FILEIO_OPERATION_FAILED;
+
+	if (retval == ERROR_OK) {
+		uint8_t key[RTOS_CACHE_KEY_MAX];
+		size_t key_len;
+
+		id_len = rtos_elf_build_id(buffer, size, &id);
+		if (id_len && id_len <= sizeof(key)) {
+			memcpy(key, id, id_len);
+			key_len = id_len;
+		} else {
+			uint32_t crc;
+			image_calculate_checksum(buffer, size, &crc);
+			key[0] = 'c';
+			h_u32_to_le(key + 1, crc);
+			key_len = 5;
+		}
+
+		if (key_len != cache->key_len || memcmp(key, cache->key, key_len)) {
+			memcpy(cache->key, key, key_len);
+			cache->key_len = key_len;
+			cache->valid = false;
+		}
+		cache->file_size = size;
+		cache->file_mtime = mtime;
+	}
+	free(buffer);
+	return retval;
+}
+
+/* On GDB's first qSymbol, take the symbols from the cache if GDB debugs
+ * the image they were resolved for; true if the lookup can be skipped */
+static bool rtos_symbol_cache_get(struct target *target)
+{
+	struct rtos *os = target->rtos;
+	struct rtos_symbol_cache *cache;
+	int count = 0;
+
+	if (!target->rtos_cache_file)
+		return false;
+
+	if (!os->symbol_cache) {
+		os->symbol_cache = calloc(1, sizeof(*os->symbol_cache));
+		if (!os->symbol_cache)
+			return false;
+	}
+	cache = os->symbol_cache;
+
+	if (rtos_cache_key(target, cache) != ERROR_OK) {
+		LOG_WARNING("can't read %s, looking up RTOS symbols", target->rtos_cache_file);
+		cache->key_len = 0;
+		cache->valid = false;
+		return false;
+	}
+	if (!cache->valid || (!target->rtos_auto_detect && cache->type != os->type))
+		return false;
+
+	os->type = cache->type;
+	free(os->symbols);
+	os->symbols = NULL;
+	os->type->get_symbol_list_to_lookup(&os->symbols);
+	for (symbol_table_elem_t *s = os->symbols; s->symbol_name; s++)
+		count++;
+	if (count != cache->count)
+		return false;
+	for (int i = 0; i < count; i++)
+		os->symbols[i].address = cache->addresses[i];
+
+	LOG_INFO("RTOS %s symbols of %s taken from the cache", os->type->name,
+		target->rtos_cache_file);
+	return true;
+}
+
+/* keep what GDB resolved for the image of the current key */
+static void rtos_symbol_cache_put(struct rtos *os)
+{
+	struct rtos_symbol_cache *cache = os->symbol_cache;
+	symbol_address_t *addresses;
+	int count = 0;
+
+	if (!cache || !cache->key_len)
+		return;
+
+	for (symbol_table_elem_t *s = os->symbols; s->symbol_name; s++)
+		count++;
+	addresses = realloc(cache->addresses, (count + 1) * sizeof(*addresses));
+	if (!addresses)
+		return;
+	for (int i = 0; i < count; i++)
+		addresses[i] = os->symbols[i].address;
+
+	cache->addresses = addresses;
+	cache->count = count;
+	cache->type = os->type;
+	cache->valid = true;
+}
+
 /* rtos_qsymbol() processes and replies to all qSymbol packets from GDB.
  *
  * GDB sends a qSymbol:: packet (empty address, empty name) to notify
@@ -195,6 +422,10 @@ static bool is_symbol_mandatory(const struct rtos *os, const char *symbol)
  * specified explicitly, then no further symbol lookup is done. When
  * auto-detecting, the RTOS driver _detect() function must return success.
  *
+ * With -rtos-cache, the symbols and RTOS type found for an image are
+ * kept; when GDB offers symbol lookup again for the same image, the
+ * reply is "OK" right away and no lookup or detection is done.
+ *
  * rtos_qsymbol() returns 1 if an RTOS has been detected, or 0 otherwise.
  */
 int rtos_qsymbol(struct connection *connection, char const *packet, int packet_size)
@@ -212,6 +443,11 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 	if (!os)
 		goto done;
 
+	if (strcmp(packet, "qSymbol::") == 0 && rtos_symbol_cache_get(target)) {
+		rtos_detected = 1;
+		goto done;
+	}
+
 	/* Decode any symbol name in the packet*/
 	size_t len = unhexify((uint8_t *)cur_sym, strchr(packet + 8, ':') + 1, strlen(strchr(packet + 8, ':') + 1));
 	cur_sym[len] = 0;
@@ -241,12 +477,14 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 		/* No more symbols need looking up */
 
 		if (!target->rtos_auto_detect) {
+			rtos_symbol_cache_put(os);
 			rtos_detected = 1;
 			goto done;
 		}
 
 		if (os->type->detect_rtos(target)) {
 			LOG_INFO("Auto-detected RTOS: %s", os->type->name);
+			rtos_symbol_cache_put(os);
 			rtos_detected = 1;
 			goto done;
 		} else {
@@ -295,6 +533,9 @@ int rtos_thread_packet(struct connection *connection, char const *packet, int pa
 
 			struct thread_detail *detail = &target->rtos->thread_details[found];
 
+			if (detail->thread_name_str == NULL && target->rtos->type->get_thread_name)
+				target->rtos->type->get_thread_name(target->rtos, detail);
+
 			int str_size = 0;
 			if (detail->thread_name_str != NULL)
 				str_size += strlen(detail->thread_name_str);
@@ -416,20 +657,46 @@ int rtos_get_gdb_reg_list(struct connection *connection)
 			(current_threadid != 0) &&
 			((current_threadid != target->rtos->current_thread) ||
 			(target->smp))) {	/* in smp several current thread are possible */
+		struct rtos *rtos = target->rtos;
 		char *hex_reg_list;
 
+		/* the stacked frames hold until the target runs or is written */
+		if (rtos->reg_cache_generation != target->memory_generation) {
+			rtos_reg_cache_clear(rtos);
+			rtos->reg_cache_generation = target->memory_generation;
+		}
+
+		for (int i = 0; i < rtos->reg_cache_count; i++) {
+			if (rtos->reg_cache[i].threadid == (threadid_t)current_threadid) {
+				hex_reg_list = rtos->reg_cache[i].hex_reg_list;
+				gdb_put_packet(connection, hex_reg_list, strlen(hex_reg_list));
+				return ERROR_OK;
+			}
+		}
+
 		LOG_DEBUG("RTOS: getting register list for thread 0x%" PRIx64
 				  ", target->rtos->current_thread=0x%" PRIx64 "\r\n",
 										current_threadid,
 										target->rtos->current_thread);
 
-		target->rtos->type->get_thread_reg_list(target->rtos,
+		rtos->type->get_thread_reg_list(rtos,
 			current_threadid,
 			&hex_reg_list);
 
 		if (hex_reg_list != NULL) {
 			gdb_put_packet(connection, hex_reg_list, strlen(hex_reg_list));
-			free(hex_reg_list);
+
+			struct rtos_reg_cache *cache = NULL;
+			if (target->state == TARGET_HALTED)
+				cache = realloc(rtos->reg_cache,
+						(rtos->reg_cache_count + 1) * sizeof(*cache));
+			if (cache != NULL) {
+				rtos->reg_cache = cache;
+				cache[rtos->reg_cache_count].threadid = current_threadid;
+				cache[rtos->reg_cache_count].hex_reg_list = hex_reg_list;
+				rtos->reg_cache_count++;
+			} else
+				free(hex_reg_list);
 			return ERROR_OK;
 		}
 	}
@@ -457,7 +724,10 @@ int rtos_generic_stack_read(struct target *target,
 
 	if (stacking->stack_growth_direction == 1)
 		address -= stacking->stack_registers_size;
-	retval = target_read_buffer(target, address, stacking->stack_registers_size, stack_data);
+	if (target->rtos)
+		retval = rtos_read_buffer(target->rtos, address, stacking->stack_registers_size, stack_data);
+	else
+		retval = target_read_buffer(target, address, stacking->stack_registers_size, stack_data);
 	if (retval != ERROR_OK) {
 		free(stack_data);
 		LOG_ERROR("Error reading stack frame from thread");
@@ -525,8 +795,86 @@ int rtos_try_next(struct target *target)
 
 int rtos_update_threads(struct target *target)
 {
-	if ((target->rtos != NULL) && (target->rtos->type != NULL))
-		target->rtos->type->update_threads(target->rtos);
+	if ((target->rtos != NULL) && (target->rtos->type != NULL)) {
+		struct rtos *rtos = target->rtos;
+
+		/* nothing the list is built from can have changed */
+		if (rtos->thread_details != NULL && target->state == TARGET_HALTED
+				&& rtos->threads_generation == target->memory_generation)
+			return ERROR_OK;
+
+		rtos->type->update_threads(rtos);
+		rtos->threads_generation = target->memory_generation;
+	}
+	return ERROR_OK;
+}
+
+/* Largest span of RTOS data read in one go.  Task control blocks are
+ * usually allocated next to their stacks, so a few tasks fill this. */
+#define RTOS_SNAPSHOT_MAX_SIZE	(8 * 1024)
+
+/**
+ * Read RTOS data structures, such as task control blocks, list items and
+ * stack frames, through a snapshot of the target memory.  The memory
+ * spanned by the reads of one halt is fetched with a single read at the
+ * start of the next, and the walk of the thread lists is then served
+ * from host memory.  Reads outside the snapshot go to the target and
+ * widen the span, as long as it stays within RTOS_SNAPSHOT_MAX_SIZE.
+ */
+int rtos_read_buffer(struct rtos *rtos, symbol_address_t address,
+		uint32_t size, uint8_t *buffer)
+{
+	struct target *target = rtos->target;
+	int retval;
+
+	if (rtos->snapshot && rtos->snapshot_generation != target->memory_generation)
+		rtos_snapshot_clear(rtos);
+
+	if (!rtos->snapshot && rtos->span_end > rtos->span_start) {
+		uint32_t span_size = rtos->span_end - rtos->span_start;
+
+		rtos->snapshot = malloc(span_size);
+		if (rtos->snapshot) {
+			retval = target_read_buffer(target, rtos->span_start, span_size, rtos->snapshot);
+			if (retval != ERROR_OK) {
+				/* the span may have come from stale pointers, start over */
+				LOG_DEBUG("rtos: no snapshot of 0x%" PRIx64 "+0x%" PRIx32,
+					rtos->span_start, span_size);
+				rtos_snapshot_clear(rtos);
+				rtos->span_start = rtos->span_end = 0;
+			} else {
+				rtos->snapshot_base = rtos->span_start;
+				rtos->snapshot_size = span_size;
+				rtos->snapshot_generation = target->memory_generation;
+			}
+		}
+	}
+
+	if (rtos->snapshot && address >= rtos->snapshot_base &&
+			address + size <= rtos->snapshot_base + rtos->snapshot_size) {
+		memcpy(buffer, rtos->snapshot + (address - rtos->snapshot_base), size);
+		return ERROR_OK;
+	}
+
+	retval = target_read_buffer(target, address, size, buffer);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (rtos->span_end <= rtos->span_start) {
+		if (size <= RTOS_SNAPSHOT_MAX_SIZE) {
+			rtos->span_start = address;
+			rtos->span_end = address + size;
+		}
+	} else {
+		symbol_address_t start = MIN(rtos->span_start, address);
+		symbol_address_t end = MAX(rtos->span_end, address + size);
+
+		if (end - start <= RTOS_SNAPSHOT_MAX_SIZE) {
+			rtos->span_start = start;
+			rtos->span_end = end;
+		}
+	}
+
 	return ERROR_OK;
 }
 
@@ -43,6 +43,12 @@ struct thread_detail {
 	char *extra_info_str;
 };
 
+/* register list of one non-current thread, as sent to GDB */
+struct rtos_reg_cache {
+	threadid_t threadid;
+	char *hex_reg_list;
+};
+
 struct rtos {
 	const struct rtos_type *type;
 
@@ -53,6 +59,25 @@ struct rtos {
 	threadid_t current_thread;
 	struct thread_detail *thread_details;
 	int thread_count;
+	/* target memory_generation the thread list was read at */
+	uint32_t threads_generation;
+	/* thread register lists already read from the stacks, valid while
+	 * the target's memory_generation equals reg_cache_generation */
+	struct rtos_reg_cache *reg_cache;
+	int reg_cache_count;
+	uint32_t reg_cache_generation;
+	/* copy of the target memory around the thread control blocks, valid
+	 * while memory_generation equals snapshot_generation, and the span
+	 * of the reads the next copy should cover; see rtos_read_buffer() */
+	uint8_t *snapshot;
+	symbol_address_t snapshot_base;
+	uint32_t snapshot_size;
+	uint32_t snapshot_generation;
+	symbol_address_t span_start;
+	symbol_address_t span_end;
+	/* symbols GDB resolved for the image named by -rtos-cache, reused
+	 * while the image stays the same; see rtos_qsymbol() */
+	struct rtos_symbol_cache *symbol_cache;
 	int (*gdb_thread_packet)(struct connection *connection, char const *packet, int packet_size);
 	void *rtos_specific_params;
 };
@@ -67,6 +92,9 @@ struct rtos_type {
 	int (*get_symbol_list_to_lookup)(symbol_table_elem_t *symbol_list[]);
 	int (*clean)(struct target *target);
 	char * (*ps_command)(struct target *target);
+	/* optional: fill in thread_name_str of a thread that update_threads
+	 * left without one, when GDB asks for it */
+	int (*get_thread_name)(struct rtos *rtos, struct thread_detail *thread);
 };
 
 struct stack_register_offset {
@@ -104,6 +132,8 @@ int gdb_thread_packet(struct connection *connection, char const *packet, int pac
 int rtos_get_gdb_reg_list(struct connection *connection);
 int rtos_update_threads(struct target *target);
 void rtos_free_threadlist(struct rtos *rtos);
+int rtos_read_buffer(struct rtos *rtos, symbol_address_t address,
+		uint32_t size, uint8_t *buffer);
 int rtos_smp_init(struct target *target);
 /*  function for handling symbol access */
 int rtos_qsymbol(struct connection *connection, char const *packet, int packet_size);
@@ -46,6 +46,8 @@
 #include "gdb_server.h"
 #include <target/image.h>
 #include <jtag/jtag.h>
+#include <helper/time_support.h>
+#include <helper/metrics.h>
 #include "rtos/rtos.h"
 #include "target/smp.h"
 
@@ -63,14 +65,72 @@ struct target_desc_format {
 	uint32_t tdesc_length;
 };
 
+/* one gdb_memory_cache page, read in a single target_read_buffer() */
+struct gdb_memory_page {
+	uint32_t address;
+	bool valid;
+	uint8_t *data;
+};
+
+/* a z packet not applied yet, see gdb_breakpoint_watchpoint_packet() */
+struct gdb_pending_removal {
+	struct target *target;
+	int type;
+	uint32_t address;
+	uint32_t size;
+	struct gdb_pending_removal *next;
+};
+
+/* memory range gdb_memory_cache never serves, e.g. peripherals */
+struct gdb_uncached_region {
+	uint32_t address;
+	uint32_t size;
+	struct gdb_uncached_region *next;
+};
+
 /* private connection data for GDB */
 struct gdb_connection {
 	char buffer[GDB_BUFFER_SIZE];
 	char *buf_p;
+	/* replies not sent yet, flushed once per gdb_input() and before
+	 * waiting for GDB; out_defer is set while gdb_input() runs */
+	char out_buffer[GDB_BUFFER_SIZE];
+	int out_cnt;
+	int64_t out_since;
+	int out_defer;
+	/* log text for one merged 'O' packet, see gdb_log_merge */
+	char log_buffer[GDB_LOG_MERGE_SIZE + 1];
+	int log_cnt;
+	int64_t log_since;
+	/* one received packet, gdb_packet_size bytes at connection time */
+	char *packet_buffer;
+	int packet_buffer_size;
 	int buf_cnt;
 	int ctrl_c;
 	enum target_state frontend_state;
-	struct image *vflash_image;
+	/* vFlashWrite data not programmed yet, one contiguous run */
+	uint8_t *vflash_buffer;
+	uint32_t vflash_address;
+	uint32_t vflash_length;
+	uint32_t vflash_buffer_size;
+	bool vflash_session;
+	/* QNonStop:1 given: stops are sent as %Stop notifications */
+	bool non_stop;
+	/* vCont;t halted the target, report signal 0 */
+	bool stop_requested;
+	/* halted-state read cache, good while the target's
+	 * memory_generation still equals mem_cache_generation */
+	struct gdb_memory_page *mem_cache;
+	uint32_t mem_cache_page_size;
+	uint32_t mem_cache_generation;
+	struct target *mem_cache_target;
+	unsigned int mem_cache_next;
+	/* breakpoints and watchpoints GDB removed but are still set */
+	struct gdb_pending_removal *bp_pending;
+	/* qXfer:memory-map:read document, generated when GDB asks
+	 * for offset 0, the further chunks are served from it */
+	char *memory_map;
+	int memory_map_length;
 	int closed;
 	int busy;
 	int noack_mode;
@@ -102,6 +162,8 @@ static int gdb_breakpoint_override;
 static enum breakpoint_type gdb_breakpoint_override_type;
 
 static int gdb_error(struct connection *connection, int retval);
+static void gdb_memory_cache_free(struct gdb_connection *gdb_con);
+static void gdb_breakpoints_flush(struct connection *connection);
 static char *gdb_port;
 static char *gdb_port_next;
 
@@ -119,12 +181,34 @@ static int gdb_use_memory_map = 1;
 /* enabled by default*/
 static int gdb_flash_program = 1;
 
+/* largest packet GDB is told to send, including the terminating zero */
+static unsigned int gdb_packet_size = GDB_PACKET_SIZE_DEFAULT;
+
+METRIC_COUNTER(gdb_packets_metric, "openocd_gdb_packets_total",
+		"GDB packets received");
+METRIC_COUNTER(gdb_packet_bytes_metric, "openocd_gdb_packet_bytes_total",
+		"payload bytes of the GDB packets received");
+METRIC_COUNTER(gdb_checksum_errors_metric, "openocd_gdb_checksum_errors_total",
+		"GDB packets received with a bad checksum");
+
+/* page size of the halted-state read cache, 0: disabled */
+static uint32_t gdb_memory_cache_page;
+static struct gdb_uncached_region *gdb_uncached_regions;
+
+#define GDB_MEMORY_CACHE_PAGES 16
+
+/* vFlashWrite data is programmed once about this much has come in */
+#define GDB_VFLASH_RUN_SIZE (64 * 1024)
+
 /* if set, data aborts cause an error to be reported in memory read packets
  * see the code in gdb_read_memory_packet() for further explanations.
  * Disabled by default.
  */
 static int gdb_report_data_abort;
 
+/* merge console output into fewer 'O' packets, disabled by default */
+static int gdb_log_merge;
+
 /* set if we are sending target descriptions to gdb
  * via qXfer:features:read packet */
 /* enabled by default */
@@ -160,7 +244,7 @@ static int check_pending(struct connection *connection,
 	 * but return with as many bytes as are available immediately
 	 */
 	struct timeval tv;
-	fd_set read_fds;
+	fd_set read_fds, write_fds;
 	struct gdb_connection *gdb_con = connection->priv;
 	int t;
 	if (got_data == NULL)
@@ -172,24 +256,40 @@ static int check_pending(struct connection *connection,
 		return ERROR_OK;
 	}
 
-	FD_ZERO(&read_fds);
-	FD_SET(connection->fd, &read_fds);
-
 	tv.tv_sec = timeout_s;
 	tv.tv_usec = 0;
-	if (socket_select(connection->fd + 1, &read_fds, NULL, NULL, &tv) == 0) {
-		/* This can typically be because a "monitor" command took too long
-		 * before printing any progress messages
-		 */
-		if (timeout_s > 0)
-			return ERROR_GDB_TIMEOUT;
-		else
-			return ERROR_OK;
+	for (;; ) {
+		FD_ZERO(&read_fds);
+		FD_SET(connection->fd, &read_fds);
+		/* GDB can't answer what is still queued on our side */
+		FD_ZERO(&write_fds);
+		if (connection_output_pending(connection))
+			FD_SET(connection->fd, &write_fds);
+
+		if (socket_select(connection->fd + 1, &read_fds, &write_fds, NULL, &tv) == 0) {
+			/* This can typically be because a "monitor" command took too long
+			 * before printing any progress messages
+			 */
+			if (timeout_s > 0)
+				return ERROR_GDB_TIMEOUT;
+			else
+				return ERROR_OK;
+		}
+		if (!FD_ISSET(connection->fd, &write_fds))
+			break;
+		if (connection_flush(connection) != ERROR_OK) {
+			gdb_con->closed = 1;
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		if (FD_ISSET(connection->fd, &read_fds))
+			break;
 	}
 	*got_data = FD_ISSET(connection->fd, &read_fds) != 0;
 	return ERROR_OK;
 }
 
+static int gdb_flush(struct connection *connection);
+
 static int gdb_get_char_inner(struct connection *connection, int *next_char)
 {
 	struct gdb_connection *gdb_con = connection->priv;
@@ -198,6 +298,11 @@ static int gdb_get_char_inner(struct connection *connection, int *next_char)
 #ifdef _DEBUG_GDB_IO_
 	char *debug_buffer;
 #endif
+	/* GDB can't answer what it has not seen yet */
+	retval = gdb_flush(connection);
+	if (retval != ERROR_OK)
+		return retval;
+
 	for (;; ) {
 		if (connection->service->type != CONNECTION_TCP)
 			gdb_con->buf_cnt = read(connection->fd, gdb_con->buffer, GDB_BUFFER_SIZE);
@@ -331,11 +436,9 @@ static int gdb_putback_char(struct connection *connection, int last_char)
 /* The only way we can detect that the socket is closed is the first time
  * we write to it, we will fail. Subsequent write operations will
  * succeed. Shudder! */
-static int gdb_write(struct connection *connection, void *data, int len)
+static int gdb_write_direct(struct connection *connection, void *data, int len)
 {
 	struct gdb_connection *gdb_con = connection->priv;
-	if (gdb_con->closed)
-		return ERROR_SERVER_REMOTE_CLOSED;
 
 	if (connection_write(connection, data, len) == len)
 		return ERROR_OK;
@@ -343,6 +446,55 @@ static int gdb_write(struct connection *connection, void *data, int len)
 	return ERROR_SERVER_REMOTE_CLOSED;
 }
 
+static int gdb_flush(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	int cnt = gdb_con->out_cnt;
+
+	if (cnt == 0)
+		return ERROR_OK;
+	gdb_con->out_cnt = 0;
+	if (gdb_con->closed)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	return gdb_write_direct(connection, gdb_con->out_buffer, cnt);
+}
+
+/* While a gdb_input() cycle runs, output is collected in out_buffer so
+ * a packet and whatever follows it leave in one write. */
+static int gdb_write(struct connection *connection, void *data, int len)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	int retval;
+
+	if (gdb_con->closed)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	if (!gdb_con->out_defer || len >= (int)sizeof(gdb_con->out_buffer)) {
+		retval = gdb_flush(connection);
+		if (retval != ERROR_OK)
+			return retval;
+		return gdb_write_direct(connection, data, len);
+	}
+
+	if (gdb_con->out_cnt + len > (int)sizeof(gdb_con->out_buffer)) {
+		retval = gdb_flush(connection);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (gdb_con->out_cnt == 0)
+		gdb_con->out_since = timeval_ms();
+	memcpy(gdb_con->out_buffer + gdb_con->out_cnt, data, len);
+	gdb_con->out_cnt += len;
+
+	/* don't hold progress output of a long command back */
+	if (timeval_ms() - gdb_con->out_since >= GDB_OUTPUT_FLUSH_MS)
+		return gdb_flush(connection);
+
+	return ERROR_OK;
+}
+
 static int gdb_put_packet_inner(struct connection *connection,
 		char *buffer, int len)
 {
@@ -466,9 +618,16 @@ static int gdb_put_packet_inner(struct connection *connection,
 	return ERROR_OK;
 }
 
+static void gdb_log_flush(struct connection *connection);
+
 int gdb_put_packet(struct connection *connection, char *buffer, int len)
 {
 	struct gdb_connection *gdb_con = connection->priv;
+
+	/* merged log text goes out before the reply it belongs to */
+	if (gdb_con->log_cnt)
+		gdb_log_flush(connection);
+
 	gdb_con->busy = 1;
 	int retval = gdb_put_packet_inner(connection, buffer, len);
 	gdb_con->busy = 0;
@@ -479,6 +638,47 @@ int gdb_put_packet(struct connection *connection, char *buffer, int len)
 	return retval;
 }
 
+/* Asynchronous notification, non-stop mode only: "%name:data#xx",
+ * not acknowledged by GDB. */
+static int gdb_put_notification(struct connection *connection,
+		const char *name, char *buffer, int len)
+{
+	unsigned char my_checksum = ':';
+	char local_buffer[16];
+	int name_len = strlen(name);
+	int retval;
+
+	for (int i = 0; i < name_len; i++)
+		my_checksum += name[i];
+	for (int i = 0; i < len; i++)
+		my_checksum += buffer[i];
+
+	snprintf(local_buffer, sizeof(local_buffer), "%%%s:", name);
+	retval = gdb_write(connection, local_buffer, strlen(local_buffer));
+	if (retval == ERROR_OK)
+		retval = gdb_write(connection, buffer, len);
+	if (retval == ERROR_OK) {
+		snprintf(local_buffer, sizeof(local_buffer), "#%02x", my_checksum);
+		retval = gdb_write(connection, local_buffer, 3);
+	}
+	if (retval == ERROR_OK)
+		retval = gdb_flush(connection);
+
+	kept_alive();
+
+	return retval;
+}
+
+/* A stop reply, or in non-stop mode the %Stop notification with it. */
+static int gdb_put_stop_reply(struct connection *connection, char *buffer, int len)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
+	if (gdb_con->non_stop)
+		return gdb_put_notification(connection, "Stop", buffer, len);
+	return gdb_put_packet(connection, buffer, len);
+}
+
 static inline int fetch_packet(struct connection *connection,
 		int *checksum_ok, int noack, int *len, char *buffer)
 {
@@ -667,6 +867,7 @@ static int gdb_get_packet_inner(struct connection *connection,
 				return retval;
 			break;
 		}
+		metric_add(&gdb_checksum_errors_metric, 1);
 	}
 	if (gdb_con->closed)
 		return ERROR_SERVER_REMOTE_CLOSED;
@@ -723,7 +924,10 @@ static void gdb_signal_reply(struct target *target, struct connection *connectio
 	if (target->debug_reason == DBG_REASON_EXIT) {
 		sig_reply_len = snprintf(sig_reply, sizeof(sig_reply), "W00");
 	} else {
-		if (gdb_connection->ctrl_c) {
+		if (gdb_connection->stop_requested) {
+			signal_var = 0x0;
+			gdb_connection->stop_requested = false;
+		} else if (gdb_connection->ctrl_c) {
 			signal_var = 0x2;
 			gdb_connection->ctrl_c = 0;
 		} else
@@ -765,7 +969,7 @@ static void gdb_signal_reply(struct target *target, struct connection *connectio
 				signal_var, stop_reason, current_thread);
 	}
 
-	gdb_put_packet(connection, sig_reply, sig_reply_len);
+	gdb_put_stop_reply(connection, sig_reply, sig_reply_len);
 	gdb_connection->frontend_state = TARGET_HALTED;
 }
 
@@ -899,6 +1103,10 @@ static int gdb_target_callback_event_handler(struct target *target,
 		case TARGET_EVENT_HALTED:
 			target_call_event_callbacks(target, TARGET_EVENT_GDB_END);
 			break;
+		case TARGET_EVENT_RESUME_START:
+			/* resumed from elsewhere, GDB's removals must be in place */
+			gdb_breakpoints_flush(connection);
+			break;
 		case TARGET_EVENT_GDB_FLASH_ERASE_START:
 			retval = jtag_execute_queue();
 			if (retval != ERROR_OK)
@@ -918,14 +1126,42 @@ static int gdb_new_connection(struct connection *connection)
 	int retval;
 	int initial_ack;
 
+	if (gdb_connection == NULL)
+		return ERROR_FAIL;
+
+	gdb_connection->packet_buffer = malloc(gdb_packet_size);
+	if (gdb_connection->packet_buffer == NULL) {
+		LOG_ERROR("Out of memory for a %u byte GDB packet buffer", gdb_packet_size);
+		free(gdb_connection);
+		return ERROR_FAIL;
+	}
+	gdb_connection->packet_buffer_size = gdb_packet_size;
+
 	connection->priv = gdb_connection;
 
 	/* initialize gdb connection information */
 	gdb_connection->buf_p = gdb_connection->buffer;
 	gdb_connection->buf_cnt = 0;
+	gdb_connection->out_cnt = 0;
+	gdb_connection->out_since = 0;
+	gdb_connection->out_defer = 0;
+	gdb_connection->log_cnt = 0;
+	gdb_connection->log_since = 0;
 	gdb_connection->ctrl_c = 0;
 	gdb_connection->frontend_state = TARGET_HALTED;
-	gdb_connection->vflash_image = NULL;
+	gdb_connection->vflash_buffer = NULL;
+	gdb_connection->vflash_address = 0;
+	gdb_connection->vflash_length = 0;
+	gdb_connection->vflash_buffer_size = 0;
+	gdb_connection->vflash_session = false;
+	gdb_connection->non_stop = false;
+	gdb_connection->stop_requested = false;
+	gdb_connection->mem_cache = NULL;
+	gdb_connection->mem_cache_page_size = 0;
+	gdb_connection->mem_cache_generation = 0;
+	gdb_connection->mem_cache_target = NULL;
+	gdb_connection->mem_cache_next = 0;
+	gdb_connection->bp_pending = NULL;
 	gdb_connection->closed = 0;
 	gdb_connection->busy = 0;
 	gdb_connection->noack_mode = 0;
@@ -934,6 +1170,8 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->attached = true;
 	gdb_connection->target_desc.tdesc = NULL;
 	gdb_connection->target_desc.tdesc_length = 0;
+	gdb_connection->memory_map = NULL;
+	gdb_connection->memory_map_length = 0;
 
 	/* send ACK to GDB for debug request */
 	gdb_write(connection, "+", 1);
@@ -1017,12 +1255,23 @@ static int gdb_connection_closed(struct connection *connection)
 		target_state_name(gdb_service->target),
 		gdb_actual_connections);
 
-	/* see if an image built with vFlash commands is left */
-	if (gdb_connection->vflash_image) {
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
+	gdb_breakpoints_flush(connection);
+
+	/* see if vFlash data or a write session is left */
+	if (gdb_connection->vflash_session) {
+		flash_write_done(gdb_service->target);
+		gdb_connection->vflash_session = false;
+		target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_FLASH_WRITE_END);
 	}
+	free(gdb_connection->vflash_buffer);
+	gdb_connection->vflash_buffer = NULL;
+	free(gdb_connection->packet_buffer);
+	gdb_connection->packet_buffer = NULL;
+	gdb_memory_cache_free(gdb_connection);
+	free(gdb_connection->memory_map);
+	gdb_connection->memory_map = NULL;
+	free(gdb_connection->target_desc.tdesc);
+	gdb_connection->target_desc.tdesc = NULL;
 
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, gdb_service->target);
@@ -1064,6 +1313,12 @@ static int gdb_last_signal_packet(struct connection *connection,
 		return ERROR_OK;
 	}
 
+	/* non-stop: no stop to report while running, "OK" says so */
+	if (gdb_con->non_stop && target->state != TARGET_HALTED) {
+		gdb_put_packet(connection, "OK", 2);
+		return ERROR_OK;
+	}
+
 	signal_var = gdb_last_signal(target);
 
 	snprintf(sig_reply, 4, "S%2.2x", signal_var);
@@ -1346,10 +1601,123 @@ static int gdb_error(struct connection *connection, int retval)
  *
  * 8191 bytes by the looks of it. Why 8191 bytes instead of 8192?????
  */
+static void gdb_memory_cache_free(struct gdb_connection *gdb_con)
+{
+	if (gdb_con->mem_cache) {
+		free(gdb_con->mem_cache[0].data);
+		free(gdb_con->mem_cache);
+	}
+	gdb_con->mem_cache = NULL;
+	gdb_con->mem_cache_page_size = 0;
+}
+
+static bool gdb_memory_uncached(uint32_t address, uint32_t size)
+{
+	for (struct gdb_uncached_region *r = gdb_uncached_regions; r; r = r->next) {
+		if ((uint64_t)address < (uint64_t)r->address + r->size
+				&& (uint64_t)r->address < (uint64_t)address + size)
+			return true;
+	}
+	return false;
+}
+
+/* Make the cache match the configured page size and the target's
+ * current memory, dropping every page if anything has changed. */
+static int gdb_memory_cache_sync(struct gdb_connection *gdb_con, struct target *target)
+{
+	if (gdb_con->mem_cache_page_size != gdb_memory_cache_page) {
+		gdb_memory_cache_free(gdb_con);
+
+		gdb_con->mem_cache = calloc(GDB_MEMORY_CACHE_PAGES, sizeof(struct gdb_memory_page));
+		uint8_t *data = malloc(GDB_MEMORY_CACHE_PAGES * gdb_memory_cache_page);
+		if (gdb_con->mem_cache == NULL || data == NULL) {
+			free(data);
+			free(gdb_con->mem_cache);
+			gdb_con->mem_cache = NULL;
+			return ERROR_FAIL;
+		}
+		for (unsigned int i = 0; i < GDB_MEMORY_CACHE_PAGES; i++)
+			gdb_con->mem_cache[i].data = data + i * gdb_memory_cache_page;
+		gdb_con->mem_cache_page_size = gdb_memory_cache_page;
+		gdb_con->mem_cache_target = NULL;
+	}
+
+	if (gdb_con->mem_cache_target != target
+			|| gdb_con->mem_cache_generation != target->memory_generation) {
+		for (unsigned int i = 0; i < GDB_MEMORY_CACHE_PAGES; i++)
+			gdb_con->mem_cache[i].valid = false;
+		gdb_con->mem_cache_target = target;
+		gdb_con->mem_cache_generation = target->memory_generation;
+		gdb_con->mem_cache_next = 0;
+	}
+
+	return ERROR_OK;
+}
+
+/* Read target memory for an 'm' packet. While the target is halted,
+ * whole gdb_memory_cache pages are fetched and kept, so the stack
+ * frames and variables GDB rereads after every step cost no adapter
+ * traffic until the target runs or its memory is written. */
+static int gdb_read_memory_cached(struct connection *connection, struct target *target,
+		uint32_t address, uint32_t size, uint8_t *buffer)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	uint32_t page_size = gdb_memory_cache_page;
+
+	if (page_size == 0 || target->state != TARGET_HALTED
+			|| size >= page_size * (GDB_MEMORY_CACHE_PAGES / 2)
+			|| gdb_memory_cache_sync(gdb_con, target) != ERROR_OK)
+		return target_read_buffer(target, address, size, buffer);
+
+	while (size > 0) {
+		uint32_t page = address & ~(page_size - 1);
+		uint32_t offset = address - page;
+		uint32_t n = MIN(page_size - offset, size);
+		struct gdb_memory_page *p = NULL;
+
+		if (gdb_memory_uncached(page, page_size)
+				|| !target_memory_cacheable(target, page, page_size)) {
+			int retval = target_read_buffer(target, address, n, buffer);
+			if (retval != ERROR_OK)
+				return retval;
+		} else {
+			for (unsigned int i = 0; i < GDB_MEMORY_CACHE_PAGES; i++) {
+				if (gdb_con->mem_cache[i].valid && gdb_con->mem_cache[i].address == page) {
+					p = &gdb_con->mem_cache[i];
+					break;
+				}
+			}
+
+			if (p == NULL) {
+				p = &gdb_con->mem_cache[gdb_con->mem_cache_next];
+				p->valid = false;
+				if (target_read_buffer(target, page, page_size, p->data) != ERROR_OK) {
+					/* part of the page may not be readable, try just what was asked */
+					return target_read_buffer(target, address, size, buffer);
+				}
+				p->address = page;
+				p->valid = true;
+				gdb_con->mem_cache_next = (gdb_con->mem_cache_next + 1) % GDB_MEMORY_CACHE_PAGES;
+			}
+
+			memcpy(buffer, p->data + offset, n);
+		}
+
+		address += n;
+		size -= n;
+		buffer += n;
+	}
+
+	return ERROR_OK;
+}
+
+/* Answers both 'm' (hex reply) and 'x' (binary reply, announced by
+ * binary-upload+ in qSupported, half the bytes on the wire). */
 static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
 	struct target *target = get_target_from_connection(connection);
+	bool binary = packet[0] == 'x';
 	char *separator;
 	uint32_t addr = 0;
 	uint32_t len = 0;
@@ -1371,6 +1739,12 @@ static int gdb_read_memory_packet(struct connection *connection,
 
 	len = strtoul(separator + 1, NULL, 16);
 
+	if (!len && binary) {
+		/* GDB probes for 'x' support with a zero length read */
+		gdb_put_packet(connection, "b", 1);
+		return ERROR_OK;
+	}
+
 	if (!len) {
 		LOG_WARNING("invalid read memory packet received (len == 0)");
 		gdb_put_packet(connection, NULL, 0);
@@ -1381,7 +1755,7 @@ static int gdb_read_memory_packet(struct connection *connection,
 
 	LOG_DEBUG("addr: 0x%8.8" PRIx32 ", len: 0x%8.8" PRIx32 "", addr, len);
 
-	retval = target_read_buffer(target, addr, len, buffer);
+	retval = gdb_read_memory_cached(connection, target, addr, len, buffer);
 
 	if ((retval != ERROR_OK) && !gdb_report_data_abort) {
 		/* TODO : Here we have to lie and send back all zero's lest stack traces won't work.
@@ -1401,7 +1775,25 @@ static int gdb_read_memory_packet(struct connection *connection,
 		retval = ERROR_OK;
 	}
 
-	if (retval == ERROR_OK) {
+	if (retval == ERROR_OK && binary) {
+		/* worst case every byte needs a '}' escape */
+		hex_buffer = malloc(len * 2 + 1);
+
+		int pkt_len = 0;
+		hex_buffer[pkt_len++] = 'b';
+		for (uint32_t i = 0; i < len; i++) {
+			uint8_t c = buffer[i];
+			if (c == '#' || c == '$' || c == '}' || c == '*') {
+				hex_buffer[pkt_len++] = '}';
+				c ^= 0x20;
+			}
+			hex_buffer[pkt_len++] = c;
+		}
+
+		gdb_put_packet(connection, hex_buffer, pkt_len);
+
+		free(hex_buffer);
+	} else if (retval == ERROR_OK) {
 		hex_buffer = malloc(len * 2 + 1);
 
 		int pkt_len = hexify(hex_buffer, (char *)buffer, len, len * 2 + 1);
@@ -1549,9 +1941,67 @@ static int gdb_step_continue_packet(struct connection *connection,
 	return retval;
 }
 
+static void gdb_breakpoint_remove(struct target *target, int type, uint32_t address)
+{
+	if (type <= 1)
+		breakpoint_remove(target, address);
+	else
+		watchpoint_remove(target, address);
+}
+
+/* Apply every z packet that is still pending. */
+static void gdb_breakpoints_flush(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
+	while (gdb_con->bp_pending) {
+		struct gdb_pending_removal *p = gdb_con->bp_pending;
+
+		gdb_con->bp_pending = p->next;
+		gdb_breakpoint_remove(p->target, p->type, p->address);
+		free(p);
+	}
+}
+
+/* Packets that neither run the target nor look at memory a pending
+ * software breakpoint removal would show up in. */
+static bool gdb_breakpoints_keep_pending(struct gdb_connection *gdb_con,
+		char const *packet)
+{
+	switch (packet[0]) {
+		case 'Z':
+		case 'z':
+		case 'g':
+		case 'p':
+		case 'H':
+		case 'T':
+		case '?':
+			return true;
+		case 'q':
+			return strncmp(packet, "qRcmd,", 6) != 0;
+		case 'm':
+		case 'x':
+			for (struct gdb_pending_removal *p = gdb_con->bp_pending; p; p = p->next) {
+				if (p->type == 0)
+					return false;
+			}
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* GDB takes out every breakpoint when the target stops and puts them
+ * all back before the next step or continue. z packets are therefore
+ * only queued, and a Z for the same breakpoint just drops the queued
+ * removal, so breakpoints that survive a stop are never touched. The
+ * queue is applied before anything that runs the target or could see
+ * the difference (gdb_breakpoints_keep_pending()), and before any Z
+ * that really adds something, so resources are freed first. */
 static int gdb_breakpoint_watchpoint_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
+	struct gdb_connection *gdb_con = connection->priv;
 	struct target *target = get_target_from_connection(connection);
 	int type;
 	enum breakpoint_type bp_type = BKPT_SOFT /* dummy init to avoid warning */;
@@ -1597,38 +2047,74 @@ static int gdb_breakpoint_watchpoint_packet(struct connection *connection,
 
 	size = strtoul(separator + 1, &separator, 16);
 
+	if (packet[0] == 'z') {
+		struct gdb_pending_removal *p = malloc(sizeof(*p));
+		if (p == NULL) {
+			gdb_breakpoint_remove(target, type, address);
+		} else {
+			p->target = target;
+			p->type = type;
+			p->address = address;
+			p->size = size;
+			p->next = gdb_con->bp_pending;
+			gdb_con->bp_pending = p;
+		}
+		gdb_put_packet(connection, "OK", 2);
+		return ERROR_OK;
+	}
+
+	for (struct gdb_pending_removal **pp = &gdb_con->bp_pending; *pp; pp = &(*pp)->next) {
+		struct gdb_pending_removal *p = *pp;
+
+		if (p->target != target || p->type != type || p->address != address || p->size != size)
+			continue;
+
+		*pp = p->next;
+		free(p);
+
+		/* still set, unless something else removed it meanwhile */
+		bool set = false;
+		if (type <= 1)
+			set = breakpoint_find(target, address) != NULL;
+		else {
+			for (struct watchpoint *wp = target->watchpoints; wp; wp = wp->next) {
+				if (wp->address == address) {
+					set = true;
+					break;
+				}
+			}
+		}
+		if (set) {
+			gdb_put_packet(connection, "OK", 2);
+			return ERROR_OK;
+		}
+		break;
+	}
+
+	gdb_breakpoints_flush(connection);
+
 	switch (type) {
 		case 0:
 		case 1:
-			if (packet[0] == 'Z') {
-				retval = breakpoint_add(target, address, size, bp_type);
-				if (retval != ERROR_OK) {
-					retval = gdb_error(connection, retval);
-					if (retval != ERROR_OK)
-						return retval;
-				} else
-					gdb_put_packet(connection, "OK", 2);
-			} else {
-				breakpoint_remove(target, address);
+			retval = breakpoint_add(target, address, size, bp_type);
+			if (retval != ERROR_OK) {
+				retval = gdb_error(connection, retval);
+				if (retval != ERROR_OK)
+					return retval;
+			} else
 				gdb_put_packet(connection, "OK", 2);
-			}
 			break;
 		case 2:
 		case 3:
 		case 4:
 		{
-			if (packet[0] == 'Z') {
-				retval = watchpoint_add(target, address, size, wp_type, 0, 0xffffffffu);
-				if (retval != ERROR_OK) {
-					retval = gdb_error(connection, retval);
-					if (retval != ERROR_OK)
-						return retval;
-				} else
-					gdb_put_packet(connection, "OK", 2);
-			} else {
-				watchpoint_remove(target, address);
+			retval = watchpoint_add(target, address, size, wp_type, 0, 0xffffffffu);
+			if (retval != ERROR_OK) {
+				retval = gdb_error(connection, retval);
+				if (retval != ERROR_OK)
+					return retval;
+			} else
 				gdb_put_packet(connection, "OK", 2);
-			}
 			break;
 		}
 		default:
@@ -1719,36 +2205,25 @@ static int compare_bank(const void *a, const void *b)
 		return -1;
 }
 
-static int gdb_memory_map(struct connection *connection,
-		char const *packet, int packet_size)
+static int gdb_generate_memory_map(struct target *target, char **xml_out, int *length)
 {
 	/* We get away with only specifying flash here. Regions that are not
 	 * specified are treated as if we provided no memory map(if not we
 	 * could detect the holes and mark them as RAM).
-	 * Normally we only execute this code once, but no big deal if we
-	 * have to regenerate it a couple of times.
+	 * This runs once per read of the document by GDB, which probes
+	 * the flash banks.
 	 */
 
-	struct target *target = get_target_from_connection(connection);
 	struct flash_bank *p;
 	char *xml = NULL;
 	int size = 0;
 	int pos = 0;
 	int retval = ERROR_OK;
 	struct flash_bank **banks;
-	int offset;
-	int length;
-	char *separator;
 	uint32_t ram_start = 0;
 	int i;
 	int target_flash_banks = 0;
 
-	/* skip command character */
-	packet += 23;
-
-	offset = strtoul(packet, &separator, 16);
-	length = strtoul(separator + 1, &separator, 16);
-
 	xml_printf(&retval, &xml, &pos, &size, "<memory-map>\n");
 
 	/* Sort banks in ascending order.  We need to report non-flash
@@ -1767,7 +2242,7 @@ static int gdb_memory_map(struct connection *connection,
 		retval = get_flash_bank_by_num(i, &p);
 		if (retval != ERROR_OK) {
 			free(banks);
-			gdb_error(connection, retval);
+			free(xml);
 			return retval;
 		}
 		banks[target_flash_banks++] = p;
@@ -1848,20 +2323,52 @@ static int gdb_memory_map(struct connection *connection,
 	xml_printf(&retval, &xml, &pos, &size, "</memory-map>\n");
 
 	if (retval != ERROR_OK) {
-		gdb_error(connection, retval);
+		free(xml);
 		return retval;
 	}
 
-	if (offset + length > pos)
-		length = pos - offset;
+	*xml_out = xml;
+	*length = pos;
+	return ERROR_OK;
+}
+
+static int gdb_memory_map(struct connection *connection,
+		char const *packet, int packet_size)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	int offset;
+	int length;
+	char *separator;
+
+	/* skip command character */
+	packet += 23;
+
+	offset = strtoul(packet, &separator, 16);
+	length = strtoul(separator + 1, &separator, 16);
+
+	if (offset == 0 || gdb_connection->memory_map == NULL) {
+		free(gdb_connection->memory_map);
+		gdb_connection->memory_map = NULL;
+
+		int retval = gdb_generate_memory_map(get_target_from_connection(connection),
+				&gdb_connection->memory_map, &gdb_connection->memory_map_length);
+		if (retval != ERROR_OK) {
+			gdb_error(connection, retval);
+			return retval;
+		}
+	}
+
+	if (offset > gdb_connection->memory_map_length)
+		offset = gdb_connection->memory_map_length;
+	if (offset + length > gdb_connection->memory_map_length)
+		length = gdb_connection->memory_map_length - offset;
 
 	char *t = malloc(length + 1);
 	t[0] = 'l';
-	memcpy(t + 1, xml + offset, length);
+	memcpy(t + 1, gdb_connection->memory_map + offset, length);
 	gdb_put_packet(connection, t, length + 1);
 
 	free(t);
-	free(xml);
 	return ERROR_OK;
 }
 
@@ -2180,7 +2687,13 @@ static int gdb_get_target_description_chunk(struct target *target, struct target
 	char *tdesc = target_desc->tdesc;
 	uint32_t tdesc_length = target_desc->tdesc_length;
 
-	if (tdesc == NULL) {
+	/* generated when GDB starts reading, the chunks come from that copy */
+	if (offset == 0 || tdesc == NULL) {
+		free(tdesc);
+		tdesc = NULL;
+		target_desc->tdesc = NULL;
+		target_desc->tdesc_length = 0;
+
 		int retval = gdb_generate_target_description(target, &tdesc);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("Unable to Generate Target Description");
@@ -2210,11 +2723,6 @@ static int gdb_get_target_description_chunk(struct target *target, struct target
 	} else {
 		strncpy((*chunk) + 1, tdesc + offset, tdesc_length - offset);
 		(*chunk)[1 + (tdesc_length - offset)] = '\0';
-
-		/* After gdb-server sends out last chunk, invalidate tdesc. */
-		free(tdesc);
-		tdesc = NULL;
-		tdesc_length = 0;
 	}
 
 	target_desc->tdesc = tdesc;
@@ -2363,6 +2871,11 @@ static int gdb_query_packet(struct connection *connection,
 
 			return ERROR_OK;
 		}
+	} else if (strncmp(packet, "QNonStop:", 9) == 0) {
+		gdb_connection->non_stop = packet[9] == '1';
+		LOG_DEBUG("GDB %s non-stop mode", gdb_connection->non_stop ? "enters" : "leaves");
+		gdb_put_packet(connection, "OK", 2);
+		return ERROR_OK;
 	} else if (strncmp(packet, "qSupported", 10) == 0) {
 		/* we currently support packet size and qXfer:memory-map:read (if enabled)
 		 * qXfer:features:read is supported for some targets */
@@ -2390,8 +2903,8 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;QStartNoAckMode+",
-			(GDB_BUFFER_SIZE - 1),
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;QStartNoAckMode+;binary-upload+;QNonStop+",
+			(gdb_connection->packet_buffer_size - 1),
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
 			(gdb_target_desc_supported == 1) ? '+' : '-');
 
@@ -2448,6 +2961,147 @@ static int gdb_query_packet(struct connection *connection,
 	return ERROR_OK;
 }
 
+/* Append vFlashWrite data to the run still to be programmed. */
+static int gdb_vflash_add(struct connection *connection, uint32_t addr,
+		const uint8_t *data, uint32_t length)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	uint32_t needed = gdb_connection->vflash_length + length;
+
+	if (gdb_connection->vflash_length == 0)
+		gdb_connection->vflash_address = addr;
+
+	if (needed > gdb_connection->vflash_buffer_size) {
+		uint32_t size = MAX(needed, 2 * gdb_connection->vflash_buffer_size);
+		uint8_t *buffer = realloc(gdb_connection->vflash_buffer, size);
+		if (buffer == NULL) {
+			LOG_ERROR("Out of memory for vFlash data");
+			return ERROR_FAIL;
+		}
+		gdb_connection->vflash_buffer = buffer;
+		gdb_connection->vflash_buffer_size = size;
+	}
+
+	memcpy(gdb_connection->vflash_buffer + gdb_connection->vflash_length, data, length);
+	gdb_connection->vflash_length = needed;
+
+	return ERROR_OK;
+}
+
+/* Program the run collected from vFlashWrite packets. Unless all is set,
+ * the sector the run ends in waits for the packets still to come, so no
+ * flash word gets programmed twice. */
+static int gdb_vflash_program(struct connection *connection, bool all)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct gdb_service *gdb_service = connection->service->priv;
+	struct target *target = gdb_service->target;
+	uint32_t address = gdb_connection->vflash_address;
+	uint32_t length = gdb_connection->vflash_length;
+	struct flash_bank *bank;
+	struct image image;
+	uint32_t written;
+	int retval;
+
+	if (length == 0)
+		return ERROR_OK;
+
+	if (!all) {
+		uint32_t end = address + length;
+
+		retval = get_flash_bank_by_addr(target, end, false, &bank);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (int i = 0; bank && i < bank->num_sectors; i++) {
+			uint32_t start = bank->base + bank->sectors[i].offset;
+			if (end >= start && end - start < bank->sectors[i].size) {
+				if (start <= address)
+					return ERROR_OK;
+				length = start - address;
+				break;
+			}
+		}
+	}
+
+	retval = image_open(&image, "", "build");
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = image_add_section(&image, address, length, 0x0, gdb_connection->vflash_buffer);
+	if (retval == ERROR_OK)
+		retval = flash_write(target, &image, &written, 0);
+	image_close(&image);
+	if (retval != ERROR_OK)
+		return retval;
+
+	LOG_DEBUG("wrote %u bytes from vFlash data to flash", (unsigned)written);
+
+	gdb_connection->vflash_length -= length;
+	gdb_connection->vflash_address += length;
+	memmove(gdb_connection->vflash_buffer, gdb_connection->vflash_buffer + length,
+		gdb_connection->vflash_length);
+
+	return ERROR_OK;
+}
+
+static void gdb_resume_packet(struct connection *connection,
+		char const *packet, int packet_size);
+
+/* vCont? and vCont;action[:thread]... for the single core behind this
+ * connection. Any step action steps, t halts, c continues. */
+static int gdb_vcont_packet(struct connection *connection,
+		char const *packet, int packet_size)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct gdb_service *gdb_service = connection->service->priv;
+	struct target *target = gdb_service->target;
+	char action = 0;
+
+	if (strcmp(packet, "vCont?") == 0) {
+		gdb_put_packet(connection, "vCont;c;C;s;S;t", 15);
+		return ERROR_OK;
+	}
+
+	for (char const *p = strchr(packet, ';'); p; p = strchr(p + 1, ';')) {
+		char a = tolower(p[1]);
+		if (a == 's')
+			action = 's';
+		else if (a == 'c' && action != 's')
+			action = 'c';
+		else if (a == 't' && action == 0)
+			action = 't';
+	}
+
+	switch (action) {
+		case 'c':
+		case 's':
+		{
+			char resume[2] = { action, 0 };
+			gdb_resume_packet(connection, resume, 1);
+			break;
+		}
+		case 't':
+			gdb_put_packet(connection, "OK", 2);
+			if (target->state == TARGET_HALTED) {
+				/* GDB still wants a stop for the thread it asked about */
+				gdb_con->stop_requested = true;
+				gdb_signal_reply(target, connection);
+			} else {
+				/* the halt event sends the %Stop notification */
+				gdb_con->stop_requested = true;
+				gdb_con->frontend_state = TARGET_RUNNING;
+				target_halt(target);
+			}
+			break;
+		default:
+			gdb_put_packet(connection, "E01", 3);
+			break;
+	}
+
+	return ERROR_OK;
+}
+
 static int gdb_v_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -2455,6 +3109,15 @@ static int gdb_v_packet(struct connection *connection,
 	struct gdb_service *gdb_service = connection->service->priv;
 	int result;
 
+	if (strncmp(packet, "vCont", 5) == 0)
+		return gdb_vcont_packet(connection, packet, packet_size);
+
+	if (strcmp(packet, "vStopped") == 0) {
+		/* one core, so never a second stop queued behind the first */
+		gdb_put_packet(connection, "OK", 2);
+		return ERROR_OK;
+	}
+
 	/* if flash programming disabled - send a empty reply */
 
 	if (gdb_flash_program == 0) {
@@ -2485,14 +3148,6 @@ static int gdb_v_packet(struct connection *connection,
 			LOG_ERROR("incomplete vFlashErase packet received, dropping connection");
 			return ERROR_SERVER_REMOTE_CLOSED;
 		}
-#if (NUVOTON_CUSTOMIZED)
-		gdb_put_packet(connection, "OK", 2);
-		return ERROR_OK;
-#endif		
-		/* assume all sectors need erasing - stops any problems
-		 * when flash_write is called multiple times */
-		flash_set_dirty();
-
 		/* perform any target specific operations before the erase */
 		target_call_event_callbacks(gdb_service->target,
 			TARGET_EVENT_GDB_FLASH_ERASE_START);
@@ -2501,7 +3156,7 @@ static int gdb_v_packet(struct connection *connection,
 		 * end to be "block" aligned ... if padding is ever needed,
 		 * GDB will have become dangerously confused.
 		 */
-		result = flash_erase_address_range(gdb_service->target,
+		result = flash_erase_dirty_address_range(gdb_service->target,
 				false, addr, length);
 
 		/* perform any target specific operations after the erase */
@@ -2536,54 +3191,61 @@ static int gdb_v_packet(struct connection *connection,
 			LOG_ERROR("incomplete vFlashErase packet received, dropping connection");
 			return ERROR_SERVER_REMOTE_CLOSED;
 		}
-#if (NUVOTON_CUSTOMIZED)		
-		gdb_put_packet(connection, "OK", 2);
-		return ERROR_OK;
-#endif		
 		length = packet_size - (parse - packet);
 
-		/* create a new image if there isn't already one */
-		if (gdb_connection->vflash_image == NULL) {
-			gdb_connection->vflash_image = malloc(sizeof(struct image));
-			image_open(gdb_connection->vflash_image, "", "build");
+		/* the session lasts until vFlashDone */
+		if (!gdb_connection->vflash_session) {
+			target_call_event_callbacks(gdb_service->target,
+					TARGET_EVENT_GDB_FLASH_WRITE_START);
+			flash_write_start(gdb_service->target);
+			gdb_connection->vflash_session = true;
 		}
 
-		/* create new section with content from packet buffer */
-		retval = image_add_section(gdb_connection->vflash_image,
-				addr, length, 0x0, (uint8_t const *)parse);
-		if (retval != ERROR_OK)
-			return retval;
+		/* a run ends where the data stops being contiguous */
+		retval = ERROR_OK;
+		if (gdb_connection->vflash_length &&
+			addr != gdb_connection->vflash_address + gdb_connection->vflash_length)
+			retval = gdb_vflash_program(connection, true);
 
-		gdb_put_packet(connection, "OK", 2);
+		if (retval == ERROR_OK)
+			retval = gdb_vflash_add(connection, addr, (uint8_t const *)parse, length);
+
+		/* program what came in so far while GDB sends the rest */
+		if (retval == ERROR_OK && gdb_connection->vflash_length >= GDB_VFLASH_RUN_SIZE)
+			retval = gdb_vflash_program(connection, false);
+
+		if (retval != ERROR_OK) {
+			gdb_connection->vflash_length = 0;
+			if (retval == ERROR_FLASH_DST_OUT_OF_BANK)
+				gdb_put_packet(connection, "E.memtype", 9);
+			else
+				gdb_send_error(connection, EIO);
+		} else
+			gdb_put_packet(connection, "OK", 2);
 
 		return ERROR_OK;
 	}
 
 	if (strncmp(packet, "vFlashDone", 10) == 0) {
-		uint32_t written;
-#if (NUVOTON_CUSTOMIZED)
-		gdb_put_packet(connection, "OK", 2);
-		return ERROR_OK;
-#endif		
-		/* process the flashing buffer. No need to erase as GDB
+		/* program the rest. No need to erase as GDB
 		 * always issues a vFlashErase first. */
-		target_call_event_callbacks(gdb_service->target,
-				TARGET_EVENT_GDB_FLASH_WRITE_START);
-		result = flash_write(gdb_service->target, gdb_connection->vflash_image, &written, 0);
-		target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_FLASH_WRITE_END);
+		result = gdb_vflash_program(connection, true);
+		if (gdb_connection->vflash_session) {
+			int result2 = flash_write_done(gdb_service->target);
+			if (result == ERROR_OK)
+				result = result2;
+			gdb_connection->vflash_session = false;
+			target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_FLASH_WRITE_END);
+		}
+		gdb_connection->vflash_length = 0;
+
 		if (result != ERROR_OK) {
 			if (result == ERROR_FLASH_DST_OUT_OF_BANK)
 				gdb_put_packet(connection, "E.memtype", 9);
 			else
 				gdb_send_error(connection, EIO);
-		} else {
-			LOG_DEBUG("wrote %u bytes from vFlash image to flash", (unsigned)written);
+		} else
 			gdb_put_packet(connection, "OK", 2);
-		}
-
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
 
 		return ERROR_OK;
 	}
@@ -2649,38 +3311,145 @@ static int gdb_fileio_response_packet(struct connection *connection,
 	return ERROR_OK;
 }
 
+/* Send the log text collected for gdb_log_merge as one 'O' packet. */
+static void gdb_log_flush(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
+	if (gdb_con->log_cnt == 0)
+		return;
+
+	gdb_con->log_buffer[gdb_con->log_cnt] = '\0';
+	gdb_con->log_cnt = 0;
+	gdb_output_con(connection, gdb_con->log_buffer);
+}
+
 static void gdb_log_callback(void *priv, const char *file, unsigned line,
 		const char *function, const char *string)
 {
 	struct connection *connection = priv;
 	struct gdb_connection *gdb_con = connection->priv;
+	int len = strlen(string);
 
 	if (gdb_con->busy) {
 		/* do not reply this using the O packet */
 		return;
 	}
 
-	gdb_output_con(connection, string);
+	/* merge only inside gdb_input(), whose end sends what is left;
+	 * the empty keep-alive string must go out at once */
+	if (!gdb_log_merge || !gdb_con->out_defer || len == 0 || len > GDB_LOG_MERGE_SIZE) {
+		gdb_log_flush(connection);
+		gdb_output_con(connection, string);
+		return;
+	}
+
+	if (gdb_con->log_cnt + len > GDB_LOG_MERGE_SIZE)
+		gdb_log_flush(connection);
+
+	if (gdb_con->log_cnt == 0)
+		gdb_con->log_since = timeval_ms();
+	memcpy(gdb_con->log_buffer + gdb_con->log_cnt, string, len);
+	gdb_con->log_cnt += len;
+
+	if (timeval_ms() - gdb_con->log_since >= GDB_OUTPUT_FLUSH_MS)
+		gdb_log_flush(connection);
 }
 
 static void gdb_sig_halted(struct connection *connection)
 {
 	char sig_reply[4];
 	snprintf(sig_reply, 4, "T%2.2x", 2);
-	gdb_put_packet(connection, sig_reply, 3);
+	gdb_put_stop_reply(connection, sig_reply, 3);
 }
 
-static int gdb_input_inner(struct connection *connection)
+/* 'c' and 's', also used for vCont. In non-stop mode the packet is
+ * acknowledged at once and the stop comes later as a notification. */
+static void gdb_resume_packet(struct connection *connection,
+		char const *packet, int packet_size)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE];
+	struct gdb_service *gdb_service = connection->service->priv;
+	struct target *target = gdb_service->target;
+	struct gdb_connection *gdb_con = connection->priv;
+	int retval;
 
+	gdb_thread_packet(connection, packet, packet_size);
+	if (gdb_con->non_stop)
+		gdb_put_packet(connection, "OK", 2);
+	else
+		log_add_callback(gdb_log_callback, connection);
+
+	if (gdb_con->mem_write_error) {
+		LOG_ERROR("Memory write failure!");
+
+		/* now that we have reported the memory write error,
+		 * we can clear the condition */
+		gdb_con->mem_write_error = false;
+	}
+
+	bool nostep = false;
+	bool already_running = false;
+	if (target->state == TARGET_RUNNING) {
+		LOG_WARNING("WARNING! The target is already running. "
+				"All changes GDB did to registers will be discarded! "
+				"Waiting for target to halt.");
+		already_running = true;
+	} else if (target->state != TARGET_HALTED) {
+		LOG_WARNING("The target is not in the halted nor running stated, " \
+				"stepi/continue ignored.");
+		nostep = true;
+	} else if ((packet[0] == 's') && gdb_con->sync) {
+		/* Hmm..... when you issue a continue in GDB, then a "stepi" is
+		 * sent by GDB first to OpenOCD, thus defeating the check to
+		 * make only the single stepping have the sync feature...
+		 */
+		nostep = true;
+		LOG_WARNING("stepi ignored. GDB will now fetch the register state " \
+				"from the target.");
+	}
+	gdb_con->sync = false;
+
+	if (!already_running && nostep) {
+		/* Either the target isn't in the halted state, then we can't
+		 * step/continue. This might be early setup, etc.
+		 *
+		 * Or we want to allow GDB to pick up a fresh set of
+		 * register values without modifying the target state.
+		 *
+		 */
+		gdb_sig_halted(connection);
+
+		/* stop forwarding log packets! */
+		log_remove_callback(gdb_log_callback, connection);
+	} else {
+		/* We're running/stepping, in which case we can
+		 * forward log output until the target is halted
+		 */
+		gdb_con->frontend_state = TARGET_RUNNING;
+		target_call_event_callbacks(target, TARGET_EVENT_GDB_START);
+
+		if (!already_running) {
+			/* packet processing goes on even if this fails */
+			retval = gdb_step_continue_packet(connection, packet, packet_size);
+			if (retval != ERROR_OK) {
+				/* we'll never receive a halted
+				 * condition... issue a false one..
+				 */
+				gdb_frontend_halted(target, connection);
+			}
+		}
+	}
+}
+
+static int gdb_input_inner(struct connection *connection)
+{
 	struct gdb_service *gdb_service = connection->service->priv;
 	struct target *target = gdb_service->target;
+	struct gdb_connection *gdb_con = connection->priv;
+	char *gdb_packet_buffer = gdb_con->packet_buffer;
 	char const *packet = gdb_packet_buffer;
 	int packet_size;
 	int retval;
-	struct gdb_connection *gdb_con = connection->priv;
 	static int extended_protocol;
 
 	/* drain input buffer. If one of the packets fail, then an error
@@ -2695,10 +3464,12 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE-1;
+		packet_size = gdb_con->packet_buffer_size - 1;
 		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
+		metric_add(&gdb_packets_metric, 1);
+		metric_add(&gdb_packet_bytes_metric, packet_size);
 
 		/* terminate with zero */
 		gdb_packet_buffer[packet_size] = '\0';
@@ -2717,6 +3488,9 @@ static int gdb_input_inner(struct connection *connection)
 		}
 
 		if (packet_size > 0) {
+			if (gdb_con->bp_pending && !gdb_breakpoints_keep_pending(gdb_con, packet))
+				gdb_breakpoints_flush(connection);
+
 			retval = ERROR_OK;
 			switch (packet[0]) {
 				case 'T':	/* Is thread alive? */
@@ -2745,6 +3519,7 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_set_register_packet(connection, packet, packet_size);
 					break;
 				case 'm':
+				case 'x':
 					retval = gdb_read_memory_packet(connection, packet, packet_size);
 					break;
 				case 'M':
@@ -2759,72 +3534,7 @@ static int gdb_input_inner(struct connection *connection)
 					break;
 				case 'c':
 				case 's':
-				{
-					gdb_thread_packet(connection, packet, packet_size);
-					log_add_callback(gdb_log_callback, connection);
-
-					if (gdb_con->mem_write_error) {
-						LOG_ERROR("Memory write failure!");
-
-						/* now that we have reported the memory write error,
-						 * we can clear the condition */
-						gdb_con->mem_write_error = false;
-					}
-
-					bool nostep = false;
-					bool already_running = false;
-					if (target->state == TARGET_RUNNING) {
-						LOG_WARNING("WARNING! The target is already running. "
-								"All changes GDB did to registers will be discarded! "
-								"Waiting for target to halt.");
-						already_running = true;
-					} else if (target->state != TARGET_HALTED) {
-						LOG_WARNING("The target is not in the halted nor running stated, " \
-								"stepi/continue ignored.");
-						nostep = true;
-					} else if ((packet[0] == 's') && gdb_con->sync) {
-						/* Hmm..... when you issue a continue in GDB, then a "stepi" is
-						 * sent by GDB first to OpenOCD, thus defeating the check to
-						 * make only the single stepping have the sync feature...
-						 */
-						nostep = true;
-						LOG_WARNING("stepi ignored. GDB will now fetch the register state " \
-								"from the target.");
-					}
-					gdb_con->sync = false;
-
-					if (!already_running && nostep) {
-						/* Either the target isn't in the halted state, then we can't
-						 * step/continue. This might be early setup, etc.
-						 *
-						 * Or we want to allow GDB to pick up a fresh set of
-						 * register values without modifying the target state.
-						 *
-						 */
-						gdb_sig_halted(connection);
-
-						/* stop forwarding log packets! */
-						log_remove_callback(gdb_log_callback, connection);
-					} else {
-						/* We're running/stepping, in which case we can
-						 * forward log output until the target is halted
-						 */
-						gdb_con->frontend_state = TARGET_RUNNING;
-						target_call_event_callbacks(target, TARGET_EVENT_GDB_START);
-
-						if (!already_running) {
-							/* Here we don't want packet processing to stop even if this fails,
-							 * so we use a local variable instead of retval. */
-							retval = gdb_step_continue_packet(connection, packet, packet_size);
-							if (retval != ERROR_OK) {
-								/* we'll never receive a halted
-								 * condition... issue a false one..
-								 */
-								gdb_frontend_halted(target, connection);
-							}
-						}
-					}
-				}
+					gdb_resume_packet(connection, packet, packet_size);
 				break;
 				case 'v':
 					retval = gdb_v_packet(connection, packet, packet_size);
@@ -2919,8 +3629,18 @@ static int gdb_input_inner(struct connection *connection)
 
 static int gdb_input(struct connection *connection)
 {
-	int retval = gdb_input_inner(connection);
 	struct gdb_connection *gdb_con = connection->priv;
+
+	gdb_con->out_defer++;
+	int retval = gdb_input_inner(connection);
+	gdb_con->out_defer--;
+
+	/* a last reply, e.g. to 'k', must still go out before closing */
+	if (gdb_con->out_defer == 0) {
+		gdb_log_flush(connection);
+		gdb_flush(connection);
+	}
+
 	if (retval == ERROR_SERVER_REMOTE_CLOSED)
 		return retval;
 
@@ -3051,6 +3771,87 @@ COMMAND_HANDLER(handle_gdb_memory_map_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_packet_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int size;
+
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+		/* GDB needs room for a whole register set in one packet */
+		if (size < GDB_BUFFER_SIZE || size > 16 * 1024 * 1024) {
+			command_print(CMD_CTX, "gdb_packet_size must be between %u and %u",
+				GDB_BUFFER_SIZE, 16 * 1024 * 1024);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		gdb_packet_size = size;
+	}
+
+	command_print(CMD_CTX, "gdb_packet_size %u", gdb_packet_size);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_gdb_memory_cache_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		uint32_t page_size;
+
+		if (strcmp(CMD_ARGV[0], "disable") == 0)
+			page_size = 0;
+		else {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], page_size);
+			if (page_size < 4 || page_size > 64 * 1024
+					|| (page_size & (page_size - 1)) != 0) {
+				command_print(CMD_CTX, "page size must be a power of 2 from 4 to 65536");
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+		gdb_memory_cache_page = page_size;
+	}
+
+	if (gdb_memory_cache_page)
+		command_print(CMD_CTX, "gdb_memory_cache %" PRIu32, gdb_memory_cache_page);
+	else
+		command_print(CMD_CTX, "gdb_memory_cache disabled");
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_gdb_memory_uncached_command)
+{
+	if (CMD_ARGC != 0 && CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 2) {
+		uint32_t address, size;
+
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+		if (size == 0)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+
+		struct gdb_uncached_region *r = malloc(sizeof(*r));
+		if (r == NULL)
+			return ERROR_FAIL;
+		r->address = address;
+		r->size = size;
+		r->next = gdb_uncached_regions;
+		gdb_uncached_regions = r;
+		return ERROR_OK;
+	}
+
+	for (struct gdb_uncached_region *r = gdb_uncached_regions; r; r = r->next)
+		command_print(CMD_CTX, "0x%8.8" PRIx32 " 0x%8.8" PRIx32, r->address, r->size);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_flash_program_command)
 {
 	if (CMD_ARGC != 1)
@@ -3060,6 +3861,15 @@ COMMAND_HANDLER(handle_gdb_flash_program_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_log_merge_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ENABLE(CMD_ARGV[0], gdb_log_merge);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 {
 	if (CMD_ARGC != 1)
@@ -3176,6 +3986,29 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable memory map",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_packet_size",
+		.handler = handle_gdb_packet_size_command,
+		.mode = COMMAND_ANY,
+		.help = "set the largest packet GDB may send, "
+			"taking effect on the next GDB connection",
+		.usage = "[bytes]"
+	},
+	{
+		.name = "gdb_memory_cache",
+		.handler = handle_gdb_memory_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "cache GDB memory reads in pages of this size "
+			"while the target is halted",
+		.usage = "[page_size|'disable']"
+	},
+	{
+		.name = "gdb_memory_uncached",
+		.handler = handle_gdb_memory_uncached_command,
+		.mode = COMMAND_ANY,
+		.help = "never cache GDB reads of this range, or list the ranges",
+		.usage = "[address size]"
+	},
 	{
 		.name = "gdb_flash_program",
 		.handler = handle_gdb_flash_program_command,
@@ -3190,6 +4023,14 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable reporting data aborts",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_log_merge",
+		.handler = handle_gdb_log_merge_command,
+		.mode = COMMAND_ANY,
+		.help = "enable or disable sending console output to GDB "
+			"in fewer, larger packets",
+		.usage = "('enable'|'disable')"
+	},
 	{
 		.name = "gdb_breakpoint_override",
 		.handler = handle_gdb_breakpoint_override_command,
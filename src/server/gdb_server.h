@@ -33,6 +33,9 @@ struct reg;
 #include <target/target.h>
 
 #define GDB_BUFFER_SIZE 16384
+#define GDB_PACKET_SIZE_DEFAULT (64 * 1024) /* gdb_packet_size */
+#define GDB_LOG_MERGE_SIZE 1024 /* gdb_log_merge text per 'O' packet */
+#define GDB_OUTPUT_FLUSH_MS 100 /* oldest buffered output is sent after this */
 
 int gdb_target_add_all(struct target *target);
 int gdb_register_commands(struct command_context *command_context);
@@ -0,0 +1,169 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "metrics_server.h"
+#include <helper/metrics.h>
+
+/* longest request head read, the rest is ignored */
+#define METRICS_REQUEST_MAX		1024
+
+/* Answers an HTTP GET of /metrics with Prometheus text, and one of
+ * /metrics.json or /metrics?format=json with JSON, then closes. */
+struct metrics_connection {
+	char request[METRICS_REQUEST_MAX + 1];
+	size_t len;
+	bool answered;
+};
+
+static char *metrics_port;
+
+static int metrics_new_connection(struct connection *connection)
+{
+	connection->priv = calloc(1, sizeof(struct metrics_connection));
+	if (!connection->priv) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static void metrics_reply(struct connection *connection, const char *status,
+		const char *type, const char *body, size_t len)
+{
+	char *head = alloc_printf("HTTP/1.0 %s\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n\r\n", status, type, len);
+
+	if (!head)
+		return;
+	connection_write(connection, head, strlen(head));
+	connection_write(connection, body, len);
+	free(head);
+}
+
+static void metrics_answer(struct connection *connection, const char *request)
+{
+	char method[8], path[128];
+	bool json;
+
+	if (sscanf(request, "%7s %127s", method, path) != 2) {
+		metrics_reply(connection, "400 Bad Request", "text/plain", "", 0);
+		return;
+	}
+	if (strcmp(method, "GET")) {
+		metrics_reply(connection, "405 Method Not Allowed", "text/plain", "", 0);
+		return;
+	}
+
+	if (!strcmp(path, "/metrics") || !strcmp(path, "/"))
+		json = false;
+	else if (!strcmp(path, "/metrics.json") || !strcmp(path, "/metrics?format=json"))
+		json = true;
+	else {
+		metrics_reply(connection, "404 Not Found", "text/plain", "", 0);
+		return;
+	}
+
+	size_t len;
+	char *body = metrics_output(json, &len);
+	if (!body) {
+		metrics_reply(connection, "500 Internal Server Error", "text/plain", "", 0);
+		return;
+	}
+	metrics_reply(connection, "200 OK",
+			json ? "application/json" : "text/plain; version=0.0.4", body, len);
+	free(body);
+}
+
+static int metrics_input(struct connection *connection)
+{
+	struct metrics_connection *mc = connection->priv;
+	char buf[256];
+
+	int len = connection_read(connection, buf, sizeof(buf));
+	if (len <= 0) {
+		if (len < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	/* anything after the request is of no interest */
+	if (mc->answered)
+		return ERROR_OK;
+
+	len = MIN((size_t)len, METRICS_REQUEST_MAX - mc->len);
+	memcpy(mc->request + mc->len, buf, len);
+	mc->len += len;
+	mc->request[mc->len] = '\0';
+
+	if (!strstr(mc->request, "\r\n\r\n") && !strstr(mc->request, "\n\n") &&
+			mc->len < METRICS_REQUEST_MAX)
+		return ERROR_OK;
+
+	metrics_answer(connection, mc->request);
+	mc->answered = true;
+
+	/* close now unless the socket did not take it all; then the client
+	 * closes, having read Content-Length bytes */
+	if (connection_output_pending(connection))
+		return ERROR_OK;
+	return ERROR_SERVER_REMOTE_CLOSED;
+}
+
+static int metrics_closed(struct connection *connection)
+{
+	free(connection->priv);
+	connection->priv = NULL;
+	return ERROR_OK;
+}
+
+int metrics_server_init(void)
+{
+	if (strcmp(metrics_port, "disabled") == 0) {
+		LOG_DEBUG("metrics server disabled");
+		return ERROR_OK;
+	}
+
+	return add_service("metrics", metrics_port, CONNECTION_LIMIT_UNLIMITED,
+		&metrics_new_connection, &metrics_input, &metrics_closed, NULL);
+}
+
+COMMAND_HANDLER(handle_metrics_port_command)
+{
+	return CALL_COMMAND_HANDLER(server_pipe_command, &metrics_port);
+}
+
+static const struct command_registration metrics_server_command_handlers[] = {
+	{
+		.name = "metrics_port",
+		.handler = handle_metrics_port_command,
+		.mode = COMMAND_ANY,
+		.help = "Specify port on which to serve the metrics over HTTP, "
+			"disabled by default. Read help on 'gdb_port'.",
+		.usage = "[port_num]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int metrics_server_register_commands(struct command_context *cmd_ctx)
+{
+	metrics_port = strdup("disabled");
+	return register_commands(cmd_ctx, NULL, metrics_server_command_handlers);
+}
@@ -33,6 +33,9 @@
 #include "openocd.h"
 #include "tcl_server.h"
 #include "telnet_server.h"
+#include "metrics_server.h"
+#include <helper/metrics.h>
+#include <helper/time_support.h>
 
 #include <signal.h>
 
@@ -44,6 +47,105 @@
 #include <netinet/tcp.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+/* Where epoll is available, listeners, connections and websocket sockets
+ * are registered once, when they come and go, and each server_loop() pass
+ * only handles what the kernel reports ready, so idle connections cost
+ * nothing. Other hosts, or a descriptor epoll refuses (stdin redirected
+ * from a file), fall back to rebuilding the select() sets every pass. */
+enum server_fd_kind {
+	SERVER_FD_NONE,
+	SERVER_FD_SERVICE,	/* a listener, ptr is its service */
+	SERVER_FD_CONNECTION,	/* ptr is the connection */
+	SERVER_FD_LWS,		/* a libwebsockets socket */
+};
+
+struct server_fd {
+	enum server_fd_kind kind;
+	void *ptr;
+	/* bumped on every change, so events for a closed and reused fd
+	 * reported in the same pass are told apart */
+	uint32_t generation;
+};
+
+/* connections whose input handler left buffered data behind */
+static int server_input_pending;
+
+#ifdef HAVE_SYS_EPOLL_H
+#define SERVER_MAX_EVENTS 64
+
+static int server_epoll_fd = -1;
+static struct server_fd *server_fds;
+static int server_fds_size;
+
+static void server_epoll_disable(void)
+{
+	LOG_DEBUG("falling back to select()");
+	close(server_epoll_fd);
+	server_epoll_fd = -1;
+}
+
+static void server_watch(int fd, enum server_fd_kind kind, void *ptr, bool in, bool out)
+{
+	struct epoll_event event;
+	int op;
+
+	if (server_epoll_fd == -1 || fd < 0)
+		return;
+
+	if (fd >= server_fds_size) {
+		int size = MAX(fd + 1, 2 * server_fds_size);
+		struct server_fd *fds = realloc(server_fds, size * sizeof(*fds));
+		if (fds == NULL) {
+			server_epoll_disable();
+			return;
+		}
+		memset(fds + server_fds_size, 0, (size - server_fds_size) * sizeof(*fds));
+		server_fds = fds;
+		server_fds_size = size;
+	}
+
+	op = server_fds[fd].kind == SERVER_FD_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+	server_fds[fd].kind = kind;
+	server_fds[fd].ptr = ptr;
+	server_fds[fd].generation++;
+
+	memset(&event, 0, sizeof(event));
+	event.events = (in ? EPOLLIN : 0) | (out ? EPOLLOUT : 0);
+	event.data.u64 = (uint64_t)server_fds[fd].generation << 32 | (uint32_t)fd;
+	if (epoll_ctl(server_epoll_fd, op, fd, &event) == -1) {
+		LOG_DEBUG("epoll can't watch fd %d: %s", fd, strerror(errno));
+		server_epoll_disable();
+	}
+}
+
+static void server_unwatch(int fd)
+{
+	struct epoll_event event;
+
+	if (server_epoll_fd == -1 || fd < 0 || fd >= server_fds_size ||
+			server_fds[fd].kind == SERVER_FD_NONE)
+		return;
+
+	server_fds[fd].kind = SERVER_FD_NONE;
+	server_fds[fd].ptr = NULL;
+	server_fds[fd].generation++;
+	/* event is ignored, but kernels before 2.6.9 want one */
+	epoll_ctl(server_epoll_fd, EPOLL_CTL_DEL, fd, &event);
+}
+#else
+static inline void server_watch(int fd, enum server_fd_kind kind, void *ptr, bool in, bool out)
+{
+}
+
+static inline void server_unwatch(int fd)
+{
+}
+#endif
+
 #if (NUVOTON_CUSTOMIZED)
 #include "libwebsockets.h"
 #include <flash/nor/core.h>
@@ -51,9 +153,30 @@
 #include <flash/nor/numicro.c>
 
 static struct lws_context *context;
+/* target new sessions start on, "b<name>" binds a session to another */
 static struct target *lws_target;
+
+/* libwebsockets runs in external poll mode: it reports its sockets via
+ * LWS_CALLBACK_*_POLL_FD and server_loop() adds them to its select() */
+#define MAX_LWS_POLLFDS 16
+static struct lws_pollfd lws_pollfds[MAX_LWS_POLLFDS];
+static int lws_pollfd_count;
 extern struct flash_bank *flash_banks;
 #define MAX_NUC_PAYLOAD 1024
+/* replies are built in tx_buf and sent as MAX_NUC_PAYLOAD sized fragments */
+#define MAX_NUC_REPLY (64 * 1024)
+
+/* push subscriptions, see lws_subscribe_packet() */
+#define LWS_SUB_MAX_RANGES 16
+#define LWS_SUB_MAX_DATA 512
+#define LWS_SUB_TICK_MS 10
+#define LWS_SUB_RUN_HEADER 4
+
+struct lws_sub_range {
+	uint32_t addr;
+	uint32_t len;
+};
+
 struct per_session_data_nuvoton {
 	size_t rx, tx;
 	unsigned char buf[LWS_PRE + MAX_NUC_PAYLOAD];
@@ -62,63 +185,914 @@ struct per_session_data_nuvoton {
 	int final;
 	int continuation;
 	int binary;
+
+	struct target *target;
+	struct lws *wsi;
+	struct per_session_data_nuvoton *sub_next;
+	uint32_t sub_period;	/* ms, 0 when not subscribed */
+	int64_t sub_due;
+	uint32_t sub_count;
+	struct lws_sub_range sub[LWS_SUB_MAX_RANGES];
+	uint32_t sub_size;	/* bytes over all ranges */
+	uint8_t sub_shadow[LWS_SUB_MAX_DATA];	/* values last pushed */
+	int sub_primed;
+	uint32_t sub_seq;
+	unsigned char push[LWS_PRE + MAX_NUC_PAYLOAD];
+	unsigned int push_len;	/* 0 when no push frame is waiting */
+
+	uint8_t *tx_buf;	/* LWS_PRE bytes headroom, then the reply */
+	size_t tx_buf_size;
+	uint32_t tx_len;	/* reply size, 0 when no reply is in flight */
+	uint32_t tx_sent;
+	enum lws_write_protocol tx_protocol;
+};
+
+static struct per_session_data_nuvoton *lws_subscribers;
+
+#define MAX_LWS_READ_WORDS (MAX_NUC_PAYLOAD / (8 + 1))
+
+struct lws_read_word {
+	uint32_t addr;
+	uint32_t index;
+};
+
+/* Reads shared by all sessions. A line is good for the server_loop pass
+ * that read it and as long as its target's memory_generation holds, so
+ * sessions asking for the same memory in one poll window cost one
+ * adapter read. Across passes memory may change under a running target,
+ * so nothing is served from an older pass. */
+#define LWS_CACHE_LINES 8
+#define LWS_CACHE_MAX_LINE 4096
+
+struct lws_cache_line {
+	struct target *target;
+	uint32_t generation;
+	uint32_t pass;
+	uint32_t addr;
+	uint32_t len;
+	uint8_t data[LWS_CACHE_MAX_LINE];
 };
 
+static struct lws_cache_line *lws_cache;
+static unsigned int lws_cache_next;
+static uint32_t lws_poll_pass;
+
+static bool lws_cache_lookup(struct target *target, uint32_t addr, uint32_t len, uint8_t *buffer)
+{
+	struct lws_cache_line *line;
+
+	if (lws_cache == NULL)
+		lws_cache = calloc(LWS_CACHE_LINES, sizeof(*lws_cache));
+
+	for (unsigned int i = 0; lws_cache && i < LWS_CACHE_LINES; i++) {
+		line = &lws_cache[i];
+		if (line->target == target && line->pass == lws_poll_pass &&
+				line->generation == target->memory_generation &&
+				addr >= line->addr && addr - line->addr + len <= line->len) {
+			memcpy(buffer, line->data + (addr - line->addr), len);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void lws_cache_fill(struct target *target, uint32_t addr, uint32_t len, const uint8_t *buffer)
+{
+	struct lws_cache_line *line;
+
+	if (lws_cache == NULL || len > LWS_CACHE_MAX_LINE
+			|| !target_memory_cacheable(target, addr, len))
+		return;
+
+	line = &lws_cache[lws_cache_next];
+	lws_cache_next = (lws_cache_next + 1) % LWS_CACHE_LINES;
+	line->target = target;
+	line->generation = target->memory_generation;
+	line->pass = lws_poll_pass;
+	line->addr = addr;
+	line->len = len;
+	memcpy(line->data, buffer, len);
+}
+
+static int lws_target_read(struct target *target, uint32_t addr, uint32_t len, uint8_t *buffer)
+{
+	int retval;
+
+	if (lws_cache_lookup(target, addr, len, buffer))
+		return ERROR_OK;
+
+	retval = target_read_buffer(target, addr, len, buffer);
+	if (retval == ERROR_OK)
+		lws_cache_fill(target, addr, len, buffer);
+
+	return retval;
+}
+
+static int lws_read_word_compare(const void *a, const void *b)
+{
+	const struct lws_read_word *wa = a, *wb = b;
+
+	if (wa->addr != wb->addr)
+		return wa->addr < wb->addr ? -1 : 1;
+	return 0;
+}
+
+/* Read the words listed in words[] into out, 4 raw target bytes each at
+ * their index position. Addresses are sorted and words that touch or
+ * overlap form one span; the spans not in the cache are fetched by one
+ * target_read_memory_multi(). */
+static int lws_read_words(struct target *target, struct lws_read_word *words, uint32_t count,
+		uint8_t *out)
+{
+	struct target_mem_xfer *xfers;
+	uint32_t *first;
+	uint8_t *buffer;
+	uint32_t i, j, n = 0, offset = 0;
+	int retval;
+
+	qsort(words, count, sizeof(words[0]), lws_read_word_compare);
+
+	/* spans never hold more bytes than the words in them */
+	buffer = malloc(count * 4);
+	xfers = malloc(count * sizeof(*xfers));
+	first = malloc((count + 1) * sizeof(*first));
+	if (buffer == NULL || xfers == NULL || first == NULL) {
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
+	for (i = 0; i < count; i = j) {
+		uint32_t span_start = words[i].addr;
+		uint32_t span_end = span_start + 4;
+
+		/* grow the span while the next word touches or overlaps it */
+		for (j = i + 1; j < count && words[j].addr <= span_end; j++) {
+			if (words[j].addr + 4 > span_end)
+				span_end = words[j].addr + 4;
+		}
+
+		uint32_t len = span_end - span_start;
+		if (lws_cache_lookup(target, span_start, len, buffer + offset)) {
+			for (uint32_t k = i; k < j; k++)
+				memcpy(out + words[k].index * 4,
+						buffer + offset + (words[k].addr - span_start), 4);
+			continue;
+		}
+
+		bool aligned = !(span_start % 4) && !(len % 4);
+		xfers[n].address = span_start;
+		xfers[n].size = aligned ? 4 : 1;
+		xfers[n].count = aligned ? len / 4 : len;
+		xfers[n].buffer = buffer + offset;
+		first[n++] = i;
+		offset += len;
+	}
+	first[n] = count;
+
+	retval = target_read_memory_multi(target, xfers, n);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("lws failed to read %" PRIu32 " spans from a target", n);
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		uint32_t len = xfers[i].size * xfers[i].count;
+
+		for (uint32_t k = first[i]; k < first[i + 1]; k++)
+			memcpy(out + words[k].index * 4,
+					xfers[i].buffer + (words[k].addr - xfers[i].address), 4);
+		lws_cache_fill(target, xfers[i].address, len, xfers[i].buffer);
+	}
+
+out:
+	free(first);
+	free(xfers);
+	free(buffer);
+
+	return retval;
+}
+
+static int lws_reply_frame(struct lws *wsi, struct per_session_data_nuvoton *pss, int len,
+		enum lws_write_protocol protocol)
+{
+	int retval;
+
+	pss->tx += len;
+	retval = lws_write(wsi, &pss->buf[LWS_PRE], len, protocol);
+	if (retval < 0) {
+		LOG_ERROR("ERROR %d writing to socket, hanging up", retval);
+		return 1;
+	}
+	return 0;
+}
+
+/* Return room for a len byte reply in the session's tx buffer. */
+static uint8_t *lws_tx_alloc(struct per_session_data_nuvoton *pss, size_t len)
+{
+	if (len > pss->tx_buf_size) {
+		uint8_t *buf = realloc(pss->tx_buf, LWS_PRE + len);
+		if (buf == NULL) {
+			LOG_ERROR("lws out of memory for a %zu byte reply", len);
+			return NULL;
+		}
+		pss->tx_buf = buf;
+		pss->tx_buf_size = len;
+	}
+	return pss->tx_buf + LWS_PRE;
+}
+
+/* Send the next fragment of the reply in tx_buf. Each fragment follows
+ * the sent part of the buffer, so that part serves as its LWS_PRE room. */
+static int lws_tx_fragment(struct lws *wsi, struct per_session_data_nuvoton *pss)
+{
+	uint32_t n = MIN(pss->tx_len - pss->tx_sent, MAX_NUC_PAYLOAD);
+	int protocol = pss->tx_sent == 0 ? pss->tx_protocol : LWS_WRITE_CONTINUATION;
+	int retval;
+
+	if (pss->tx_sent + n < pss->tx_len)
+		protocol |= LWS_WRITE_NO_FIN;
+
+	retval = lws_write(wsi, pss->tx_buf + LWS_PRE + pss->tx_sent, n, (enum lws_write_protocol)protocol);
+	if (retval < 0) {
+		LOG_ERROR("ERROR %d writing to socket, hanging up", retval);
+		pss->tx_len = 0;
+		return 1;
+	}
+	pss->tx += n;
+	pss->tx_sent += n;
+
+	if (pss->tx_sent == pss->tx_len)
+		pss->tx_len = 0;
+	else
+		lws_callback_on_writable(wsi);
+	return 0;
+}
+
+/* Send the len byte reply built in tx_buf; what does not fit one
+ * fragment goes out from the following writeable callbacks. */
+static int lws_reply_tx(struct lws *wsi, struct per_session_data_nuvoton *pss, uint32_t len,
+		enum lws_write_protocol protocol)
+{
+	pss->tx_len = len;
+	pss->tx_sent = 0;
+	pss->tx_protocol = protocol;
+	return lws_tx_fragment(wsi, pss);
+}
+
+static int lws_reply(struct lws *wsi, struct per_session_data_nuvoton *pss, int len)
+{
+	return lws_reply_frame(wsi, pss, len, LWS_WRITE_TEXT);
+}
+
+/* failed request: reply "e" and hang up */
+static int lws_reply_error(struct lws *wsi, struct per_session_data_nuvoton *pss)
+{
+	sprintf((char *)&pss->buf[LWS_PRE], "e");
+	lws_reply(wsi, pss, 1);
+	return 1;
+}
+
+/* "m<addr>,<addr>,..." reads one 32-bit word per address and replies
+ * "m<value>,<value>,..." in the same order. The addresses are sorted and
+ * words that follow each other are fetched in one target_read_buffer()
+ * so a watch list costs one transfer per contiguous group. */
 static int lws_read_memory_packet(struct lws *wsi, struct per_session_data_nuvoton *pss, uint8_t const *packet, int packet_size)
 {
-	uint32_t addr = 0;
-	uint32_t len = 0;
-	uint32_t bufferLen = 0;
-	uint32_t i = 0;
-	int retval, result = 0;
+	struct lws_read_word words[MAX_LWS_READ_WORDS];
+	uint8_t values[MAX_LWS_READ_WORDS * 4];
+	char const *p = (char const *)packet + 1;
+	char const *end = (char const *)packet + packet_size;
 	char *separator;
-	uint8_t commandCode;
+	uint32_t count = 0;
+	uint32_t i;
+	int retval;
+	int len;
+	char *out;
+
+	while (p < end && count < MAX_LWS_READ_WORDS) {
+		words[count].addr = strtoul(p, &separator, 16);
+		words[count].index = count;
+		if (separator == p)
+			break;
+		count++;
+		if (separator >= end || *separator != ',')
+			break;
+		p = separator + 1;
+	}
+
+	if (count == 0) {
+		LOG_ERROR("lws received a read memory packet without addresses");
+		return lws_reply_error(wsi, pss);
+	}
+
+	retval = lws_read_words(pss->target, words, count, values);
+	if (retval != ERROR_OK)
+		return lws_reply_error(wsi, pss);
+
+	/* command, then 8 digits and a separator per word, and the NUL */
+	out = (char *)lws_tx_alloc(pss, 1 + count * 9 + 1);
+	if (out == NULL)
+		return lws_reply_error(wsi, pss);
+
+	len = sprintf(out, "%c", packet[0]);
+	for (i = 0; i < count; i++)
+		len += sprintf(out + len, i == 0 ? "%08" PRIx32 : ",%08" PRIx32,
+				le_to_h_u32(values + i * 4));
+	LOG_DEBUG("+++ openocd-nuvoton: TX %" PRIu32 " words, %d bytes", count, len);
+
+	return lws_reply_tx(wsi, pss, len, LWS_WRITE_TEXT);
+}
+
+/* "r<addr>,<len>" reads len bytes in one transfer and replies "r" and
+ * the bytes as hex, in memory order. */
+#define LWS_RANGE_MAX_DATA ((MAX_NUC_REPLY - 1) / 2)
+
+static int lws_read_range_packet(struct lws *wsi, struct per_session_data_nuvoton *pss, uint8_t const *packet, int packet_size)
+{
 	uint8_t *buffer;
-	uint8_t *bufferAddress;
+	char *separator;
+	uint32_t addr, len;
+	int retval;
+	char *out;
+	int out_len;
 
-	/* skip command character */
-	commandCode = *packet;
-	packet++;
-	bufferLen = 1;
-	
-	len = 4;
-	buffer = (uint8_t *)malloc(len);
-	bufferAddress = (uint8_t *)malloc(8 + 1);
-	do {
-		memcpy(bufferAddress, packet, 8 + 1);	
-		addr = strtoul(bufferAddress, &separator, 16);
-		retval = target_read_buffer(lws_target, addr, len, buffer);	  
+	addr = strtoul((char const *)packet + 1, &separator, 16);
+	if (*separator != ',') {
+		LOG_ERROR("lws received an incomplete read range packet");
+		return lws_reply_error(wsi, pss);
+	}
+	len = strtoul(separator + 1, NULL, 16);
+	if (len == 0 || len > LWS_RANGE_MAX_DATA) {
+		LOG_ERROR("lws read range of %" PRIu32 " bytes, at most %d fit a reply", len,
+			LWS_RANGE_MAX_DATA);
+		return lws_reply_error(wsi, pss);
+	}
+
+	/* the hex digits plus hexify()'s NUL */
+	out = (char *)lws_tx_alloc(pss, 1 + 2 * len + 1);
+	buffer = malloc(len);
+	if (out == NULL || buffer == NULL) {
+		free(buffer);
+		return lws_reply_error(wsi, pss);
+	}
+
+	retval = lws_target_read(pss->target, addr, len, buffer);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("lws failed to read buffer from a target at the addr(0x%8.8"PRIx32")!", addr);
+		free(buffer);
+		return lws_reply_error(wsi, pss);
+	}
+
+	out[0] = packet[0];
+	out_len = 1 + hexify(out + 1, (char *)buffer, len, 2 * len + 1);
+	free(buffer);
+
+	return lws_reply_tx(wsi, pss, out_len, LWS_WRITE_TEXT);
+}
+
+/* Binary frames carry a little endian header
+ *   u8 command, u8 status (replies: 0 ok, 1 failed), u16 reserved,
+ *   u32 address, u32 length
+ * followed by raw payload. 'r' reads length bytes at address and
+ * replies with them; 'm' carries length u32 addresses and replies with
+ * one raw word for each, in the same order. Target data is read straight
+ * into the tx buffer behind the reply header. */
+#define LWS_BIN_HEADER_SIZE 12
+#define LWS_BIN_MAX_DATA (MAX_NUC_PAYLOAD - LWS_BIN_HEADER_SIZE)
+#define LWS_BIN_MAX_REPLY (MAX_NUC_REPLY - LWS_BIN_HEADER_SIZE)
+
+/* Streamed flash upload, one at a time:
+ *   'B' begin: address = sector aligned start, length = image size
+ *   'C' chunk: address = image offset (chunks come in order),
+ *       length = data bytes following the header
+ *   'E' end: programs the last, padded sector and closes the session
+ * Every reply carries the bytes received in its address field and the
+ * bytes programmed in its length field, so chunk replies double as
+ * progress notifications. Data is staged one sector at a time and each
+ * sector is programmed as soon as it is complete, while the client is
+ * still uploading the rest. A failed command ends the upload. */
+struct lws_flash_upload {
+	struct per_session_data_nuvoton *owner;	/* NULL when idle */
+	struct target *target;
+	struct flash_bank *bank;
+	uint32_t size;
+	uint32_t received;
+	uint32_t programmed;
+	int sector;	/* sector being staged */
+	uint8_t *buf;
+	uint32_t fill;
+};
+
+static struct lws_flash_upload lws_upload;
+
+static void lws_flash_close(void)
+{
+	if (lws_upload.owner == NULL)
+		return;
+	flash_write_done(lws_upload.target);
+	free(lws_upload.buf);
+	lws_upload.buf = NULL;
+	lws_upload.owner = NULL;
+}
+
+/* erase and program the staged sector, padding what was not received */
+static int lws_flash_program(void)
+{
+	struct flash_bank *bank = lws_upload.bank;
+	struct flash_sector *sector = &bank->sectors[lws_upload.sector];
+	int retval;
+
+	memset(lws_upload.buf + lws_upload.fill, bank->default_padded_value,
+		sector->size - lws_upload.fill);
+
+	if (bank->driver->erase_write)
+		retval = flash_driver_erase_write(bank, lws_upload.buf, sector->offset, sector->size);
+	else {
+		retval = flash_driver_erase(bank, lws_upload.sector, lws_upload.sector);
+		if (retval == ERROR_OK)
+			retval = flash_driver_write(bank, lws_upload.buf, sector->offset, sector->size);
+	}
+	if (retval != ERROR_OK)
+		return retval;
+
+	lws_upload.programmed += lws_upload.fill;
+	lws_upload.fill = 0;
+	lws_upload.sector++;
+	return ERROR_OK;
+}
+
+static int lws_flash_begin(struct per_session_data_nuvoton *pss, uint32_t addr, uint32_t size)
+{
+	struct target *target = pss->target;
+	struct flash_bank *bank;
+	uint32_t buf_size = 0;
+	int sector = -1;
+	int retval;
+
+	if (lws_upload.owner) {
+		LOG_ERROR("lws flash upload already in progress");
+		return ERROR_FAIL;
+	}
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("lws flash upload needs a halted target");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	retval = get_flash_bank_by_addr(target, addr, true, &bank);
+	if (retval != ERROR_OK)
+		return retval;
+	if (size == 0 || size > bank->base + bank->size - addr) {
+		LOG_ERROR("lws flash upload of %" PRIu32 " bytes does not fit the bank", size);
+		return ERROR_FLASH_DST_OUT_OF_BANK;
+	}
+
+	for (int i = 0; i < bank->num_sectors; i++) {
+		if (bank->sectors[i].offset == addr - bank->base)
+			sector = i;
+		buf_size = MAX(buf_size, bank->sectors[i].size);
+	}
+	if (sector < 0) {
+		LOG_ERROR("lws flash upload at 0x%8.8" PRIx32 " is not sector aligned", addr);
+		return ERROR_FLASH_DST_BREAKS_ALIGNMENT;
+	}
+
+	lws_upload.buf = malloc(buf_size);
+	if (lws_upload.buf == NULL)
+		return ERROR_FAIL;
+
+	retval = flash_write_start(target);
+	if (retval != ERROR_OK) {
+		flash_write_done(target);
+		free(lws_upload.buf);
+		lws_upload.buf = NULL;
+		return retval;
+	}
+
+	lws_upload.owner = pss;
+	lws_upload.target = target;
+	lws_upload.bank = bank;
+	lws_upload.size = size;
+	lws_upload.received = 0;
+	lws_upload.programmed = 0;
+	lws_upload.sector = sector;
+	lws_upload.fill = 0;
+	LOG_INFO("lws flash upload of %" PRIu32 " bytes at 0x%8.8" PRIx32, size, addr);
+	return ERROR_OK;
+}
+
+static int lws_flash_chunk(uint32_t offset, uint8_t const *data, uint32_t len)
+{
+	int retval;
+
+	if (offset != lws_upload.received || len > lws_upload.size - lws_upload.received) {
+		LOG_ERROR("lws flash chunk at %" PRIu32 " of %" PRIu32 " bytes is out of order",
+			offset, len);
+		return ERROR_FAIL;
+	}
+
+	while (len) {
+		uint32_t room = lws_upload.bank->sectors[lws_upload.sector].size - lws_upload.fill;
+		uint32_t n = MIN(len, room);
+
+		memcpy(lws_upload.buf + lws_upload.fill, data, n);
+		lws_upload.fill += n;
+		lws_upload.received += n;
+		data += n;
+		len -= n;
+
+		if (n == room) {
+			retval = lws_flash_program();
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+	return ERROR_OK;
+}
+
+static int lws_flash_end(void)
+{
+	int retval;
+
+	if (lws_upload.received != lws_upload.size) {
+		LOG_ERROR("lws flash upload ended after %" PRIu32 " of %" PRIu32 " bytes",
+			lws_upload.received, lws_upload.size);
+		return ERROR_FAIL;
+	}
+	if (lws_upload.fill) {
+		retval = lws_flash_program();
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	LOG_INFO("lws flash upload programmed %" PRIu32 " bytes", lws_upload.programmed);
+	return ERROR_OK;
+}
+
+static int lws_flash_packet(struct lws *wsi, struct per_session_data_nuvoton *pss, uint8_t const *packet, int packet_size)
+{
+	uint8_t command = packet[0];
+	uint32_t addr = le_to_h_u32(packet + 4);
+	uint32_t len = le_to_h_u32(packet + 8);
+	uint8_t *reply;
+	int retval;
+
+	if (command == 'B')
+		retval = lws_flash_begin(pss, addr, len);
+	else if (lws_upload.owner != pss) {
+		LOG_ERROR("lws flash 0x%2.2x packet without an upload", command);
+		retval = ERROR_FAIL;
+	} else if (command == 'C') {
+		if ((uint32_t)packet_size < LWS_BIN_HEADER_SIZE + len) {
+			LOG_ERROR("lws flash chunk shorter than its %" PRIu32 " bytes", len);
+			retval = ERROR_FAIL;
+		} else
+			retval = lws_flash_chunk(addr, packet + LWS_BIN_HEADER_SIZE, len);
+	} else
+		retval = lws_flash_end();
+
+	reply = lws_tx_alloc(pss, LWS_BIN_HEADER_SIZE);
+	if (reply == NULL) {
+		lws_flash_close();
+		return 1;
+	}
+	reply[0] = command;
+	reply[1] = retval == ERROR_OK ? 0 : 1;
+	reply[2] = 0;
+	reply[3] = 0;
+	h_u32_to_le(reply + 4, lws_upload.received);
+	h_u32_to_le(reply + 8, lws_upload.programmed);
+
+	if (lws_upload.owner == pss && (retval != ERROR_OK || command == 'E'))
+		lws_flash_close();
+
+	return lws_reply_tx(wsi, pss, LWS_BIN_HEADER_SIZE, LWS_WRITE_BINARY);
+}
+
+static int lws_binary_packet(struct lws *wsi, struct per_session_data_nuvoton *pss, uint8_t const *packet, int packet_size)
+{
+	uint8_t *reply;
+	uint8_t command;
+	uint32_t addr, len;
+	int retval = ERROR_FAIL;
+
+	if (packet_size < LWS_BIN_HEADER_SIZE) {
+		LOG_ERROR("lws binary frame of %d bytes is shorter than its header", packet_size);
+		return 1;
+	}
+
+	command = packet[0];
+	addr = le_to_h_u32(packet + 4);
+	len = le_to_h_u32(packet + 8);
+
+	if (command == 'B' || command == 'C' || command == 'E')
+		return lws_flash_packet(wsi, pss, packet, packet_size);
+
+	switch (command) {
+		case 'r':
+			if (len == 0 || len > LWS_BIN_MAX_REPLY) {
+				LOG_ERROR("lws binary read of %" PRIu32 " bytes, at most %d fit a reply",
+					len, LWS_BIN_MAX_REPLY);
+				break;
+			}
+			reply = lws_tx_alloc(pss, LWS_BIN_HEADER_SIZE + len);
+			if (reply)
+				retval = lws_target_read(pss->target, addr, len, reply + LWS_BIN_HEADER_SIZE);
+			break;
+		case 'm':
+		{
+			struct lws_read_word words[LWS_BIN_MAX_DATA / 4];
+
+			if (len == 0 || len > ARRAY_SIZE(words)
+					|| (uint32_t)packet_size < LWS_BIN_HEADER_SIZE + len * 4) {
+				LOG_ERROR("lws binary word read with a bad count %" PRIu32, len);
+				break;
+			}
+			for (uint32_t i = 0; i < len; i++) {
+				words[i].addr = le_to_h_u32(packet + LWS_BIN_HEADER_SIZE + i * 4);
+				words[i].index = i;
+			}
+			len *= 4;
+			reply = lws_tx_alloc(pss, LWS_BIN_HEADER_SIZE + len);
+			if (reply)
+				retval = lws_read_words(pss->target, words, len / 4, reply + LWS_BIN_HEADER_SIZE);
+			break;
+		}
+		default:
+			LOG_DEBUG("ignoring binary 0x%2.2x packet", command);
+			break;
+	}
+
+	reply = lws_tx_alloc(pss, LWS_BIN_HEADER_SIZE);
+	if (reply == NULL)
+		return 1;
+
+	reply[0] = command;
+	reply[1] = retval == ERROR_OK ? 0 : 1;
+	reply[2] = 0;
+	reply[3] = 0;
+	h_u32_to_le(reply + 4, addr);
+	if (retval != ERROR_OK)
+		len = 0;
+	h_u32_to_le(reply + 8, len);
+
+	return lws_reply_tx(wsi, pss, LWS_BIN_HEADER_SIZE + len, LWS_WRITE_BINARY);
+}
+
+static int lws_sub_range_compare(const void *a, const void *b)
+{
+	const struct lws_sub_range *ra = a, *rb = b;
+
+	if (ra->addr != rb->addr)
+		return ra->addr < rb->addr ? -1 : 1;
+	return 0;
+}
+
+/* Build the push payload for the sampled values in cur: runs of
+ *   u16 offset, u16 length, length bytes
+ * where offset counts from the start of the subscription data. Changes
+ * closer together than a run header share a run. The first push, or a
+ * delta that would not be smaller, carries all the data in one run.
+ * Returns the payload size, 0 when nothing changed. */
+static unsigned int lws_sub_encode(struct per_session_data_nuvoton *pss, uint8_t const *cur)
+{
+	uint8_t *out = &pss->push[LWS_PRE + LWS_BIN_HEADER_SIZE];
+	uint32_t size = pss->sub_size;
+	unsigned int n = 0;
+	uint32_t i = 0, j, end;
+
+	if (pss->sub_primed) {
+		while (i < size) {
+			if (cur[i] == pss->sub_shadow[i]) {
+				i++;
+				continue;
+			}
+			end = i + 1;
+			for (j = end; j < size && j < end + LWS_SUB_RUN_HEADER; j++) {
+				if (cur[j] != pss->sub_shadow[j])
+					end = j + 1;
+			}
+			if (n + LWS_SUB_RUN_HEADER + (end - i) >= LWS_SUB_RUN_HEADER + size)
+				break;
+			h_u16_to_le(out + n, i);
+			h_u16_to_le(out + n + 2, end - i);
+			memcpy(out + n + LWS_SUB_RUN_HEADER, cur + i, end - i);
+			n += LWS_SUB_RUN_HEADER + (end - i);
+			i = end;
+		}
+		if (i >= size) {
+			memcpy(pss->sub_shadow, cur, size);
+			return n;
+		}
+	}
+
+	h_u16_to_le(out, 0);
+	h_u16_to_le(out + 2, size);
+	memcpy(out + LWS_SUB_RUN_HEADER, cur, size);
+	memcpy(pss->sub_shadow, cur, size);
+	pss->sub_primed = 1;
+	return LWS_SUB_RUN_HEADER + size;
+}
+
+#define LWS_SUB_DUE(pss, target, now) \
+	((pss)->target == (target) && (pss)->push_len == 0 && (now) >= (pss)->sub_due)
+
+/* Sample the ranges of every subscriber on target that is due. The
+ * ranges of all due subscribers are merged first, so the same target
+ * memory is read once however many clients watch it. */
+static int lws_sub_sample(struct target *target, int64_t now)
+{
+	struct per_session_data_nuvoton *pss;
+	struct lws_sub_range *spans;
+	uint32_t *offsets;
+	uint8_t *sample;
+	uint8_t cur[LWS_SUB_MAX_DATA];
+	uint32_t count = 0, i, j, total = 0;
+	int retval = ERROR_OK;
+
+	for (pss = lws_subscribers; pss; pss = pss->sub_next) {
+		if (LWS_SUB_DUE(pss, target, now))
+			count += pss->sub_count;
+	}
+	if (count == 0)
+		return ERROR_OK;
+
+	spans = malloc(count * sizeof(*spans));
+	offsets = malloc(count * sizeof(*offsets));
+	if (spans == NULL || offsets == NULL) {
+		free(spans);
+		free(offsets);
+		return ERROR_FAIL;
+	}
+
+	count = 0;
+	for (pss = lws_subscribers; pss; pss = pss->sub_next) {
+		if (LWS_SUB_DUE(pss, target, now)) {
+			memcpy(spans + count, pss->sub, pss->sub_count * sizeof(*spans));
+			count += pss->sub_count;
+		}
+	}
+
+	/* merge touching or overlapping ranges into spans */
+	qsort(spans, count, sizeof(*spans), lws_sub_range_compare);
+	for (i = 0, j = 0; i < count; i++) {
+		if (j > 0 && spans[i].addr <= spans[j - 1].addr + spans[j - 1].len) {
+			uint32_t end = spans[i].addr + spans[i].len;
+			if (end > spans[j - 1].addr + spans[j - 1].len)
+				spans[j - 1].len = end - spans[j - 1].addr;
+		} else
+			spans[j++] = spans[i];
+	}
+	count = j;
+	for (i = 0; i < count; i++) {
+		offsets[i] = total;
+		total += spans[i].len;
+	}
+
+	sample = malloc(total);
+	if (sample == NULL) {
+		retval = ERROR_FAIL;
+		goto out;
+	}
+	for (i = 0; i < count; i++) {
+		retval = lws_target_read(target, spans[i].addr, spans[i].len, sample + offsets[i]);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("lws failed to read buffer from a target at the addr(0x%8.8"PRIx32")!", addr);
-			result = 1;
-			LOG_DEBUG("+++ openocd-nuvoton: TX packet %s, bufferAddress %s",
-				packet, bufferAddress);	
+			LOG_DEBUG("lws subscription read at 0x%8.8" PRIx32 " failed", spans[i].addr);
+			goto out;
+		}
+	}
+
+	for (pss = lws_subscribers; pss; pss = pss->sub_next) {
+		uint32_t pos = 0;
+		unsigned int n;
+		uint8_t *reply;
+
+		if (!LWS_SUB_DUE(pss, target, now))
+			continue;
+		pss->sub_due = now + pss->sub_period;
+
+		for (i = 0; i < pss->sub_count; i++) {
+			uint32_t addr = pss->sub[i].addr;
+
+			for (j = 0; j + 1 < count && spans[j].addr + spans[j].len < addr + pss->sub[i].len; j++)
+				;
+			memcpy(cur + pos, sample + offsets[j] + (addr - spans[j].addr), pss->sub[i].len);
+			pos += pss->sub[i].len;
+		}
+
+		n = lws_sub_encode(pss, cur);
+		if (n == 0)
+			continue;
+
+		reply = &pss->push[LWS_PRE];
+		reply[0] = 'p';
+		reply[1] = 0;
+		reply[2] = 0;
+		reply[3] = 0;
+		h_u32_to_le(reply + 4, pss->sub_seq++);
+		h_u32_to_le(reply + 8, n);
+		pss->push_len = LWS_BIN_HEADER_SIZE + n;
+		lws_callback_on_writable(pss->wsi);
+	}
+
+out:
+	free(sample);
+	free(spans);
+	free(offsets);
+	return retval;
+}
+
+/* Timer callback: sample the due subscriptions of each target. */
+static int lws_sub_timer(void *priv)
+{
+	int64_t now = timeval_ms();
+
+	/* a new poll window, values cached before may be stale now */
+	lws_poll_pass++;
+	for (struct target *target = all_targets; target; target = target->next)
+		lws_sub_sample(target, now);
+
+	return ERROR_OK;
+}
+
+static void lws_sub_remove(struct per_session_data_nuvoton *pss)
+{
+	struct per_session_data_nuvoton **p;
+
+	for (p = &lws_subscribers; *p; p = &(*p)->sub_next) {
+		if (*p == pss) {
+			*p = pss->sub_next;
 			break;
 		}
-		if (i == 0) {
-			sprintf(&pss->buf[LWS_PRE], "%c%08x", commandCode, le_to_h_u32(buffer));		
+	}
+	pss->sub_period = 0;
+	pss->sub_count = 0;
+	pss->push_len = 0;
+
+	if (lws_subscribers == NULL)
+		target_unregister_timer_callback(lws_sub_timer, NULL);
+}
+
+/* "p<period>,<addr>,<len>,<addr>,<len>,..." (hex, period in ms) replaces
+ * the session's subscription and replies "p". "p" or "p0" cancels it.
+ * Subscribed ranges are sampled every period and pushed as binary 'p'
+ * frames, only when a value changed: the header's address field carries
+ * a sequence number and the payload holds the runs built by
+ * lws_sub_encode(). The first frame after subscribing has all the data. */
+static int lws_subscribe_packet(struct lws *wsi, struct per_session_data_nuvoton *pss, uint8_t const *packet, int packet_size)
+{
+	char const *p = (char const *)packet + 1;
+	char *separator;
+	uint32_t period;
+	uint32_t count = 0, size = 0;
+
+	lws_sub_remove(pss);
+
+	period = strtoul(p, &separator, 16);
+	if (period == 0) {
+		sprintf((char *)&pss->buf[LWS_PRE], "p");
+		return lws_reply(wsi, pss, 1);
+	}
+
+	while (*separator == ',') {
+		struct lws_sub_range *range = &pss->sub[count];
+
+		if (count == LWS_SUB_MAX_RANGES) {
+			LOG_ERROR("lws subscription has more than %d ranges", LWS_SUB_MAX_RANGES);
+			return lws_reply_error(wsi, pss);
+		}
+		range->addr = strtoul(separator + 1, &separator, 16);
+		if (*separator != ',') {
+			LOG_ERROR("lws subscription range without a length");
+			return lws_reply_error(wsi, pss);
 		}
-		else {
-			sprintf(&pss->buf[LWS_PRE + i * (8 + 1)], ",%08x", le_to_h_u32(buffer));	
-		}
-		LOG_DEBUG("+++ openocd-nuvoton: TX pss->buf[LWS_PRE] %s, pss->len %d, i %d, packet %s, bufferAddress %s, *buffer %08X, addr: 0x%8.8"PRIx32", len: 0x%8.8"PRIx32"",
-			&pss->buf[LWS_PRE], pss->len, i, packet, bufferAddress, le_to_h_u32(buffer), addr, len);	
-					
-		i = i + 1;		
-		packet = packet + 8 + 1;			
-		bufferLen = bufferLen + 8 + 1;		
-	} while (bufferLen < pss->len);
-	
-	pss->tx += pss->len;
-	retval = lws_write(wsi, &pss->buf[LWS_PRE], pss->len, LWS_WRITE_TEXT);
-	if (retval < 0) {
-		LOG_ERROR("ERROR %d writing to socket, hanging up", retval);
-		result = 1;
+		range->len = strtoul(separator + 1, &separator, 16);
+		if (range->len == 0 || range->len > LWS_SUB_MAX_DATA - size) {
+			LOG_ERROR("lws subscription exceeds %d bytes", LWS_SUB_MAX_DATA);
+			return lws_reply_error(wsi, pss);
+		}
+		size += range->len;
+		count++;
 	}
-		
-	free(buffer);
-	
-	return result;
+	if (count == 0) {
+		LOG_ERROR("lws subscription without ranges");
+		return lws_reply_error(wsi, pss);
+	}
+
+	if (lws_subscribers == NULL)
+		target_register_timer_callback(lws_sub_timer, LWS_SUB_TICK_MS, 1, NULL);
+
+	pss->sub_count = count;
+	pss->sub_size = size;
+	pss->sub_period = MAX(period, LWS_SUB_TICK_MS);
+	pss->sub_due = 0;
+	pss->sub_primed = 0;
+	pss->sub_next = lws_subscribers;
+	lws_subscribers = pss;
+	LOG_DEBUG("+++ openocd-nuvoton: subscribed %" PRIu32 " ranges, %" PRIu32 " bytes every %" PRIu32 " ms",
+		count, size, pss->sub_period);
+
+	sprintf((char *)&pss->buf[LWS_PRE], "p");
+	return lws_reply(wsi, pss, 1);
 }
 
 static int lws_step_continue_halt_packet(struct lws *wsi, struct per_session_data_nuvoton *pss, uint8_t const *packet, int packet_size)
@@ -137,15 +1111,15 @@ static int lws_step_continue_halt_packet(struct lws *wsi, struct per_session_dat
 	if (packet[0] == 'c') {
 		LOG_DEBUG("+++ openocd-nuvoton: TX continue");
 		/* resume at current address, don't handle breakpoints, not debugging */
-		retval = target_resume(lws_target, current, address, 0, 0);
+		retval = target_resume(pss->target, current, address, 0, 0);
 	} else if (packet[0] == 's') {
 		LOG_DEBUG("+++ openocd-nuvoton: TX step");
 		/* step at current or address, don't handle breakpoints */
-		retval = target_step(lws_target, current, address, 0);
+		retval = target_step(pss->target, current, address, 0);
 	}
 	else { 
 		LOG_DEBUG("+++ openocd-nuvoton: TX halt");
-		retval = target_halt(lws_target);
+		retval = target_halt(pss->target);
 	}	
 	
 	if (retval != ERROR_OK) {
@@ -190,6 +1164,27 @@ static int lws_query_packet(struct lws *wsi, struct per_session_data_nuvoton *ps
 	return result;
 }
 
+/* "b<name>" binds the session to the target called name, the reply
+ * is "b" and the name of the target the session now uses. */
+static int lws_bind_packet(struct lws *wsi, struct per_session_data_nuvoton *pss, uint8_t const *packet, int packet_size)
+{
+	struct target *target = get_target((char const *)packet + 1);
+	int len;
+
+	if (target == NULL) {
+		LOG_ERROR("lws: no target named '%s'", (char const *)packet + 1);
+		return lws_reply_error(wsi, pss);
+	}
+	if (lws_upload.owner == pss)
+		lws_flash_close();
+	if (pss->sub_period)
+		lws_sub_remove(pss);
+	pss->target = target;
+
+	len = snprintf((char *)&pss->buf[LWS_PRE], MAX_NUC_PAYLOAD, "b%s", target_name(target));
+	return lws_reply(wsi, pss, MIN(len, MAX_NUC_PAYLOAD - 1));
+}
+
 static int
 callback_nuvoton(struct lws *wsi, enum lws_callback_reasons reason, void *user,
 	      void *in, size_t len)
@@ -200,22 +1195,106 @@ callback_nuvoton(struct lws *wsi, enum lws_callback_reasons reason, void *user,
 	uint8_t *packet;
 	
 	switch (reason) {
+	case LWS_CALLBACK_ADD_POLL_FD:
+	{
+		struct lws_pollargs *pa = in;
+
+		if (lws_pollfd_count == MAX_LWS_POLLFDS) {
+			LOG_ERROR("lws: too many sockets");
+			return 1;
+		}
+		lws_pollfds[lws_pollfd_count].fd = pa->fd;
+		lws_pollfds[lws_pollfd_count].events = pa->events;
+		lws_pollfds[lws_pollfd_count].revents = 0;
+		lws_pollfd_count++;
+		server_watch(pa->fd, SERVER_FD_LWS, NULL,
+			pa->events & LWS_POLLIN, pa->events & LWS_POLLOUT);
+		break;
+	}
+	case LWS_CALLBACK_DEL_POLL_FD:
+	case LWS_CALLBACK_CHANGE_MODE_POLL_FD:
+	{
+		struct lws_pollargs *pa = in;
+
+		for (int i = 0; i < lws_pollfd_count; i++) {
+			if (lws_pollfds[i].fd != pa->fd)
+				continue;
+			if (reason == LWS_CALLBACK_CHANGE_MODE_POLL_FD) {
+				lws_pollfds[i].events = pa->events;
+				server_watch(pa->fd, SERVER_FD_LWS, NULL,
+					pa->events & LWS_POLLIN, pa->events & LWS_POLLOUT);
+			} else {
+				lws_pollfds[i] = lws_pollfds[--lws_pollfd_count];
+				server_unwatch(pa->fd);
+			}
+			break;
+		}
+		break;
+	}
+
 	case LWS_CALLBACK_ESTABLISHED:
 		pss->index = 0;
 		pss->len = -1;
+		pss->target = lws_target;
+		pss->wsi = wsi;
+		pss->sub_next = NULL;
+		pss->sub_period = 0;
+		pss->sub_count = 0;
+		pss->push_len = 0;
+		pss->tx_buf = NULL;
+		pss->tx_buf_size = 0;
+		pss->tx_len = 0;
+		break;
+
+	case LWS_CALLBACK_CLOSED:
+		if (pss->sub_period)
+			lws_sub_remove(pss);
+		if (lws_upload.owner == pss)
+			lws_flash_close();
+		free(pss->tx_buf);
+		pss->tx_buf = NULL;
 		break;
 
 	case LWS_CALLBACK_SERVER_WRITEABLE:
 do_tx:
-		if ((int)pss->len == -1)
+		if (pss->tx_len) {
+			/* continue the fragmented reply, new requests wait for it */
+			result = lws_tx_fragment(wsi, pss);
+			if (pss->tx_len == 0 && result == 0) {
+				lws_rx_flow_control(wsi, 1);
+				if (pss->push_len)
+					lws_callback_on_writable(wsi);
+			}
+			break;
+		}
+		if ((int)pss->len == -1) {
+			/* no request waiting, send a pending push frame */
+			if (pss->push_len) {
+				pss->tx += pss->push_len;
+				if (lws_write(wsi, &pss->push[LWS_PRE], pss->push_len, LWS_WRITE_BINARY) < 0) {
+					LOG_ERROR("ERROR writing to socket, hanging up");
+					result = 1;
+				}
+				pss->push_len = 0;
+			}
 			break;
+		}
 
-		packet = malloc(pss->len);
-		memcpy(packet, &pss->buf[LWS_PRE], pss->len);		
+		/* terminated, so the handlers can parse it with strtoul() */
+		packet = malloc(pss->len + 1);
+		memcpy(packet, &pss->buf[LWS_PRE], pss->len);
+		packet[pss->len] = 0;
+		if (pss->binary) {
+			result = lws_binary_packet(wsi, pss, packet, pss->len);
+			goto done_tx;
+		}
 		switch (packet[0]) {
 			case 'm':
 				result = lws_read_memory_packet(wsi, pss, packet, pss->len);
 				break;
+			case 'r':
+				result = lws_read_range_packet(wsi, pss, packet, pss->len);
+				break;
 			case 'c':
 			case 's':
 			case 't':
@@ -223,18 +1302,31 @@ do_tx:
 				break;				
 			case 'q':
 				result = lws_query_packet(wsi, pss, packet, pss->len);
-				break;					
+				break;
+			case 'p':
+				result = lws_subscribe_packet(wsi, pss, packet, pss->len);
+				break;
+			case 'b':
+				result = lws_bind_packet(wsi, pss, packet, pss->len);
+				break;
 			default:
 				/* ignore unknown packets */
 				LOG_DEBUG("ignoring 0x%2.2x packet", packet[0]);
 				break;				
 		}
-		
+done_tx:
+
 		free(packet);
 		pss->len = -1;
 		if (pss->final)
 			pss->continuation = 0;
+		/* a fragmented reply keeps rx off until its last fragment */
+		if (pss->tx_len)
+			break;
 		lws_rx_flow_control(wsi, 1);
+		/* a push that was sampled meanwhile goes out next */
+		if (pss->push_len)
+			lws_callback_on_writable(wsi);
 		break;
 
 	case LWS_CALLBACK_RECEIVE:
@@ -289,6 +1381,23 @@ static int polling_period = 100;
 /* address by name on which to listen for incoming TCP/IP connections */
 static char *bindto_name;
 
+/* a client sent Ctrl-C while a command was running */
+static bool server_interrupted;
+
+/* TCP connections are non-blocking: what a client does not take at once
+ * is queued and sent as its socket becomes writable, so a slow client
+ * never stalls the others. Past send_queue_max bytes queued, the writer
+ * waits for the client (backpressure) or, with send_queue_drop, the
+ * connection is dropped. */
+static unsigned int send_queue_max = 4 * 1024 * 1024;
+static bool send_queue_drop;
+
+/* how busy the loop is: the rest of the uptime it spent working */
+METRIC_COUNTER(server_idle_metric, "openocd_server_idle_seconds_total",
+		"time the server loop waited for events");
+METRIC_COUNTER(server_loop_metric, "openocd_server_loop_iterations_total",
+		"passes through the server loop");
+
 static int add_connection(struct service *service, struct command_context *cmd_ctx)
 {
 	socklen_t address_size;
@@ -303,6 +1412,9 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	c->cmd_ctx = copy_command_context(cmd_ctx);
 	c->service = service;
 	c->input_pending = 0;
+	c->out_buf = NULL;
+	c->out_len = 0;
+	c->out_size = 0;
 	c->priv = NULL;
 	c->next = NULL;
 
@@ -311,6 +1423,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 
 		c->fd = accept(service->fd, (struct sockaddr *)&service->sin, &address_size);
 		c->fd_out = c->fd;
+		socket_nonblock(c->fd);
 
 		/* This increases performance dramatically for e.g. GDB load which
 		 * does not have a sliding window protocol.
@@ -379,6 +1492,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	for (p = &service->connections; *p; p = &(*p)->next)
 		;
 	*p = c;
+	server_watch(c->fd, SERVER_FD_CONNECTION, c, true, false);
 
 	if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 		service->max_connections--;
@@ -395,17 +1509,25 @@ static int remove_connection(struct service *service, struct connection *connect
 	while ((c = *p)) {
 		if (c->fd == connection->fd) {
 			service->connection_closed(c);
-			if (service->type == CONNECTION_TCP)
+			if (c->input_pending)
+				server_input_pending--;
+			if (service->type == CONNECTION_TCP) {
+				/* last words, e.g. the reply to a detach, if they fit */
+				connection_flush(c);
+				server_unwatch(c->fd);
 				close_socket(c->fd);
-			else if (service->type == CONNECTION_PIPE) {
+			} else if (service->type == CONNECTION_PIPE) {
 				/* The service will listen to the pipe again */
 				c->service->fd = c->fd;
-			}
+				server_watch(c->fd, SERVER_FD_SERVICE, c->service, true, false);
+			} else
+				server_unwatch(c->fd);
 
 			command_done(c->cmd_ctx);
 
 			/* delete connection */
 			*p = c->next;
+			free(c->out_buf);
 			free(c);
 
 			if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
@@ -547,6 +1669,7 @@ int add_service(char *name,
 	for (p = &services; *p; p = &(*p)->next)
 		;
 	*p = c;
+	server_watch(c->fd, SERVER_FD_SERVICE, c, true, false);
 
 	return ERROR_OK;
 }
@@ -563,8 +1686,10 @@ static int remove_services(void)
 			free(c->name);
 
 		if (c->type == CONNECTION_PIPE) {
-			if (c->fd != -1)
+			if (c->fd != -1) {
+				server_unwatch(c->fd);
 				close(c->fd);
+			}
 		}
 		if (c->port)
 			free(c->port);
@@ -584,6 +1709,155 @@ static int remove_services(void)
 	return ERROR_OK;
 }
 
+/* handle a new connection on a listener */
+static void server_accept(struct service *service, struct command_context *command_context)
+{
+	if (service->max_connections != 0)
+		add_connection(service, command_context);
+	else {
+		if (service->type == CONNECTION_TCP) {
+			struct sockaddr_in sin;
+			socklen_t address_size = sizeof(sin);
+			int tmp_fd;
+			tmp_fd = accept(service->fd,
+					(struct sockaddr *)&service->sin,
+					&address_size);
+			close_socket(tmp_fd);
+		}
+		LOG_INFO(
+			"rejected '%s' connection, no more connections allowed",
+			service->name);
+	}
+}
+
+/* handle activity on a connection, dropping it on errors */
+static void server_input(struct service *service, struct connection *c)
+{
+	int pending = c->input_pending;
+	int retval = service->input(c);
+
+	server_input_pending += c->input_pending - pending;
+	if (retval != ERROR_OK) {
+		if (service->type == CONNECTION_PIPE ||
+				service->type == CONNECTION_STDINOUT) {
+			/* if connection uses a pipe then
+			 * shutdown openocd on error */
+			shutdown_openocd = 1;
+		}
+		remove_connection(service, c);
+		LOG_INFO("dropped '%s' connection",
+			service->name);
+	}
+}
+
+/* send queued output of a writable connection; false if it was dropped */
+static bool server_output(struct service *service, struct connection *c)
+{
+	if (connection_flush(c) == ERROR_OK)
+		return true;
+
+	remove_connection(service, c);
+	LOG_INFO("dropped '%s' connection", service->name);
+	return false;
+}
+
+#if (NUVOTON_CUSTOMIZED)
+/* service the websocket fds found ready */
+static void server_lws_service(struct lws_pollfd *ready, int ready_count)
+{
+	if (ready_count)
+		lws_poll_pass++;
+	for (int i = 0; i < ready_count; i++) {
+		if (lws_service_fd(context, &ready[i]) < 0)
+			shutdown_openocd = 1;
+	}
+}
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+static bool server_event_seen(struct connection *c, struct epoll_event *events, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if ((int)(uint32_t)events[i].data.u64 == c->fd)
+			return true;
+	}
+	return false;
+}
+
+static void server_epoll_dispatch(struct command_context *command_context,
+		struct epoll_event *events, int count)
+{
+#if (NUVOTON_CUSTOMIZED)
+	/* copies, since servicing can add, drop or change entries */
+	struct lws_pollfd ready[MAX_LWS_POLLFDS];
+	int ready_count = 0;
+#endif
+
+	for (int i = 0; i < count; i++) {
+		int fd = (uint32_t)events[i].data.u64;
+		struct server_fd *entry;
+
+		/* skip events for fds closed or reused earlier in this pass */
+		if (fd >= server_fds_size ||
+				server_fds[fd].generation != (uint32_t)(events[i].data.u64 >> 32))
+			continue;
+		entry = &server_fds[fd];
+
+		switch (entry->kind) {
+		case SERVER_FD_SERVICE:
+			/* a pipe whose connection was rejected is not listened to */
+			if (((struct service *)entry->ptr)->fd != fd)
+				server_unwatch(fd);
+			else
+				server_accept(entry->ptr, command_context);
+			break;
+		case SERVER_FD_CONNECTION:
+		{
+			struct connection *c = entry->ptr;
+			if ((events[i].events & EPOLLOUT) && !server_output(c->service, c))
+				break;
+			if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+				server_input(c->service, c);
+			break;
+		}
+#if (NUVOTON_CUSTOMIZED)
+		case SERVER_FD_LWS:
+			for (int j = 0; j < lws_pollfd_count; j++) {
+				if (lws_pollfds[j].fd != fd)
+					continue;
+				ready[ready_count] = lws_pollfds[j];
+				ready[ready_count].revents =
+					(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP) ? LWS_POLLIN : 0) |
+					(events[i].events & EPOLLOUT ? LWS_POLLOUT : 0);
+				ready_count++;
+				break;
+			}
+			break;
+#endif
+		default:
+			break;
+		}
+	}
+
+	/* connections with input still buffered are handled even though
+	 * their fd is quiet; only walk the lists when there are any */
+	if (server_input_pending) {
+		for (struct service *service = services; service; service = service->next) {
+			for (struct connection *c = service->connections; c; ) {
+				struct connection *next = c->next;
+				if (c->input_pending && !server_event_seen(c, events, count))
+					server_input(service, c);
+				c = next;
+			}
+		}
+	}
+
+#if (NUVOTON_CUSTOMIZED)
+	server_lws_service(ready, ready_count);
+#endif
+}
+#endif
+
 int server_loop(struct command_context *command_context)
 {
 	struct service *service;
@@ -592,6 +1866,7 @@ int server_loop(struct command_context *command_context)
 
 	/* used in select() */
 	fd_set read_fds;
+	fd_set write_fds;
 	int fd_max;
 
 	/* used in accept() */
@@ -603,9 +1878,36 @@ int server_loop(struct command_context *command_context)
 #endif
 
 	while (!shutdown_openocd) {
+		/* whatever was interrupted has returned by now */
+		server_interrupted = false;
+		metric_add(&server_loop_metric, 1);
+
+#ifdef HAVE_SYS_EPOLL_H
+		struct epoll_event events[SERVER_MAX_EVENTS];
+		bool use_epoll = server_epoll_fd != -1;
+
+		if (use_epoll) {
+			if (poll_ok)
+				retval = epoll_wait(server_epoll_fd, events, SERVER_MAX_EVENTS, 0);
+			else {
+				int64_t idle_start = timeval_ns();
+				openocd_sleep_prelude();
+				kept_alive();
+				retval = epoll_wait(server_epoll_fd, events, SERVER_MAX_EVENTS,
+						target_timer_callbacks_due_ms(polling_period));
+				openocd_sleep_postlude();
+				metric_add(&server_idle_metric, (timeval_ns() - idle_start) / 1e9);
+			}
+			if (retval == -1 && errno != EINTR) {
+				LOG_ERROR("error during epoll_wait: %s", strerror(errno));
+				exit(-1);
+			}
+		} else {
+#endif
 		/* monitor sockets for activity */
 		fd_max = 0;
 		FD_ZERO(&read_fds);
+		FD_ZERO(&write_fds);
 
 		/* add service and connection fds to read_fds */
 		for (service = services; service; service = service->next) {
@@ -623,27 +1925,46 @@ int server_loop(struct command_context *command_context)
 				for (c = service->connections; c; c = c->next) {
 					/* check for activity on the connection */
 					FD_SET(c->fd, &read_fds);
+					/* and for room for its queued output */
+					if (c->out_len)
+						FD_SET(c->fd, &write_fds);
 					if (c->fd > fd_max)
 						fd_max = c->fd;
 				}
 			}
 		}
 
+#if (NUVOTON_CUSTOMIZED)
+		for (int i = 0; i < lws_pollfd_count; i++) {
+			if (lws_pollfds[i].events & LWS_POLLIN)
+				FD_SET(lws_pollfds[i].fd, &read_fds);
+			if (lws_pollfds[i].events & LWS_POLLOUT)
+				FD_SET(lws_pollfds[i].fd, &write_fds);
+			if (lws_pollfds[i].fd > fd_max)
+				fd_max = lws_pollfds[i].fd;
+		}
+#endif
+
 		struct timeval tv;
 		tv.tv_sec = 0;
 		if (poll_ok) {
 			/* we're just polling this iteration, this is faster on embedded
 			 * hosts */
 			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = socket_select(fd_max + 1, &read_fds, &write_fds, NULL, &tv);
 		} else {
-			/* Every 100ms, can be changed with "poll_period" command */
-			tv.tv_usec = polling_period * 1000;
+			/* Every 100ms, can be changed with "poll_period" command,
+			 * or sooner when a timer callback is due */
+			tv.tv_usec = target_timer_callbacks_due_ms(polling_period) * 1000;
+			/* nothing buffered may wait for the next event */
+			log_flush();
 			/* Only while we're sleeping we'll let others run */
+			int64_t idle_start = timeval_ns();
 			openocd_sleep_prelude();
 			kept_alive();
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = socket_select(fd_max + 1, &read_fds, &write_fds, NULL, &tv);
 			openocd_sleep_postlude();
+			metric_add(&server_idle_metric, (timeval_ns() - idle_start) / 1e9);
 		}
 
 		if (retval == -1) {
@@ -651,22 +1972,27 @@ int server_loop(struct command_context *command_context)
 
 			errno = WSAGetLastError();
 
-			if (errno == WSAEINTR)
+			if (errno == WSAEINTR) {
 				FD_ZERO(&read_fds);
-			else {
+				FD_ZERO(&write_fds);
+			} else {
 				LOG_ERROR("error during select: %s", strerror(errno));
 				exit(-1);
 			}
 #else
 
-			if (errno == EINTR)
+			if (errno == EINTR) {
 				FD_ZERO(&read_fds);
-			else {
+				FD_ZERO(&write_fds);
+			} else {
 				LOG_ERROR("error during select: %s", strerror(errno));
 				exit(-1);
 			}
 #endif
 		}
+#ifdef HAVE_SYS_EPOLL_H
+		}
+#endif
 
 		if (retval == 0) {
 			/* We only execute these callbacks when there was nothing to do or we timed
@@ -675,6 +2001,11 @@ int server_loop(struct command_context *command_context)
 			process_jim_events(command_context);
 
 			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
+			FD_ZERO(&write_fds);
+#if (NUVOTON_CUSTOMIZED)
+			/* let libwebsockets handle its timeouts */
+			lws_service_fd(context, NULL);
+#endif
 
 			/* We timed out/there was nothing to do, timeout rather than poll next time
 			 **/
@@ -691,58 +2022,58 @@ int server_loop(struct command_context *command_context)
 		 */
 		poll_ok = poll_ok || target_got_message();
 
+#ifdef HAVE_SYS_EPOLL_H
+		if (use_epoll) {
+			server_epoll_dispatch(command_context, events, MAX(retval, 0));
+			goto dispatched;
+		}
+#endif
 		for (service = services; service; service = service->next) {
 			/* handle new connections on listeners */
 			if ((service->fd != -1)
-			    && (FD_ISSET(service->fd, &read_fds))) {
-				if (service->max_connections != 0)
-					add_connection(service, command_context);
-				else {
-					if (service->type == CONNECTION_TCP) {
-						struct sockaddr_in sin;
-						socklen_t address_size = sizeof(sin);
-						int tmp_fd;
-						tmp_fd = accept(service->fd,
-								(struct sockaddr *)&service->sin,
-								&address_size);
-						close_socket(tmp_fd);
-					}
-					LOG_INFO(
-						"rejected '%s' connection, no more connections allowed",
-						service->name);
-				}
-			}
+			    && (FD_ISSET(service->fd, &read_fds)))
+				server_accept(service, command_context);
 
 			/* handle activity on connections */
 			if (service->connections) {
 				struct connection *c;
 
 				for (c = service->connections; c; ) {
-					if ((FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
-						retval = service->input(c);
-						if (retval != ERROR_OK) {
-							struct connection *next = c->next;
-							if (service->type == CONNECTION_PIPE ||
-									service->type == CONNECTION_STDINOUT) {
-								/* if connection uses a pipe then
-								 * shutdown openocd on error */
-								shutdown_openocd = 1;
-							}
-							remove_connection(service, c);
-							LOG_INFO("dropped '%s' connection",
-								service->name);
-							c = next;
-							continue;
-						}
+					struct connection *next = c->next;
+					if (FD_ISSET(c->fd, &write_fds) && !server_output(service, c)) {
+						c = next;
+						continue;
 					}
-					c = c->next;
+					if ((FD_ISSET(c->fd, &read_fds)) || c->input_pending)
+						server_input(service, c);
+					c = next;
 				}
 			}
 		}
 #if (NUVOTON_CUSTOMIZED)
-		if (lws_service(context, 10) < 0) {
-			shutdown_openocd = 1;
+		/* service only the websocket fds select() found ready; work on a
+		 * copy since servicing can add, drop or change entries */
+		struct lws_pollfd ready[MAX_LWS_POLLFDS];
+		int ready_count = 0;
+
+		for (int i = 0; i < lws_pollfd_count; i++) {
+			int fd = lws_pollfds[i].fd;
+			short revents = 0;
+
+			if ((lws_pollfds[i].events & LWS_POLLIN) && FD_ISSET(fd, &read_fds))
+				revents |= LWS_POLLIN;
+			if ((lws_pollfds[i].events & LWS_POLLOUT) && FD_ISSET(fd, &write_fds))
+				revents |= LWS_POLLOUT;
+			if (revents) {
+				ready[ready_count] = lws_pollfds[i];
+				ready[ready_count].revents = revents;
+				ready_count++;
+			}
 		}
+		server_lws_service(ready, ready_count);
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+dispatched:
 #endif
 #ifdef _WIN32
 		MSG msg;
@@ -798,6 +2129,13 @@ int server_preinit(void)
 	signal(SIGTERM, sig_handler);
 	signal(SIGABRT, sig_handler);
 
+#ifdef HAVE_SYS_EPOLL_H
+	/* the size is only a hint */
+	server_epoll_fd = epoll_create(SERVER_MAX_EVENTS);
+	if (server_epoll_fd == -1)
+		LOG_DEBUG("epoll unavailable: %s", strerror(errno));
+#endif
+
 	return ERROR_OK;
 }
 
@@ -806,6 +2144,10 @@ int server_init(struct command_context *cmd_ctx)
 	int ret = tcl_init();
 	if (ERROR_OK != ret)
 		return ret;
+
+	ret = metrics_server_init();
+	if (ERROR_OK != ret)
+		return ret;
 #if (NUVOTON_CUSTOMIZED)
 	/* web server url will be http://localhost:5555 */
     int port = 5555;
@@ -843,6 +2185,13 @@ int server_init(struct command_context *cmd_ctx)
 int server_quit(void)
 {
 	remove_services();
+#ifdef HAVE_SYS_EPOLL_H
+	if (server_epoll_fd != -1)
+		server_epoll_disable();
+	free(server_fds);
+	server_fds = NULL;
+	server_fds_size = 0;
+#endif
 #if (NUVOTON_CUSTOMIZED)
 	lws_context_destroy(context);
 	LOG_DEBUG("libwebsockets-openocd-nuvoton exited cleanly");	
@@ -869,16 +2218,171 @@ void exit_on_signal(int sig)
 #endif
 }
 
+/* Peek, without reading, at the TCP connections for a Ctrl-C (0x03) as
+ * the next byte. The byte stays queued, so the connection's own input
+ * handler still sees it once the command is done. */
+void server_check_interrupt(void)
+{
+	struct timeval tv = { 0, 0 };
+	fd_set read_fds;
+	int fd_max = -1;
+
+	if (server_interrupted)
+		return;
+
+	FD_ZERO(&read_fds);
+	for (struct service *service = services; service; service = service->next) {
+		if (service->type != CONNECTION_TCP)
+			continue;
+		for (struct connection *c = service->connections; c; c = c->next) {
+			if (c->fd >= FD_SETSIZE)
+				continue;
+			FD_SET(c->fd, &read_fds);
+			fd_max = MAX(fd_max, c->fd);
+		}
+	}
+	if (fd_max < 0 || socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv) <= 0)
+		return;
+
+	for (struct service *service = services; service; service = service->next) {
+		if (service->type != CONNECTION_TCP)
+			continue;
+		for (struct connection *c = service->connections; c; c = c->next) {
+			char byte;
+
+			if (c->fd >= FD_SETSIZE || !FD_ISSET(c->fd, &read_fds))
+				continue;
+			if (recv(c->fd, &byte, 1, MSG_PEEK) == 1 && byte == 0x03) {
+				LOG_USER("interrupt from '%s' connection, stopping", service->name);
+				server_interrupted = true;
+				return;
+			}
+		}
+	}
+}
+
+bool server_interrupt_requested(void)
+{
+	return server_interrupted;
+}
+
+static bool connection_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/* write what the socket takes now; -1 on errors other than a full socket */
+static int connection_send(struct connection *connection, const void *data, size_t len)
+{
+	int written = write_socket(connection->fd_out, data, len);
+
+	if (written < 0)
+		return connection_would_block() ? 0 : -1;
+	return written;
+}
+
+int connection_flush(struct connection *connection)
+{
+	int written;
+
+	if (!connection->out_len)
+		return ERROR_OK;
+
+	written = connection_send(connection, connection->out_buf, connection->out_len);
+	if (written < 0) {
+		LOG_DEBUG("'%s' connection write failed", connection->service->name);
+		connection->out_len = 0;
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	connection->out_len -= written;
+	memmove(connection->out_buf, connection->out_buf + written, connection->out_len);
+	if (!connection->out_len)
+		server_watch(connection->fd, SERVER_FD_CONNECTION, connection, true, false);
+	return ERROR_OK;
+}
+
+bool connection_output_pending(struct connection *connection)
+{
+	return connection->out_len != 0;
+}
+
+/* wait for the client to take queued output until at most max is left */
+static int connection_drain(struct connection *connection, size_t max)
+{
+	while (connection->out_len > max) {
+		struct timeval tv = { 1, 0 };
+		fd_set write_fds;
+
+		FD_ZERO(&write_fds);
+		FD_SET(connection->fd_out, &write_fds);
+		if (socket_select(connection->fd_out + 1, NULL, &write_fds, NULL, &tv) > 0) {
+			int retval = connection_flush(connection);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		keep_alive();
+	}
+	return ERROR_OK;
+}
+
+static int connection_queue(struct connection *connection, const void *data, size_t len)
+{
+	if (connection->out_len + len > connection->out_size) {
+		size_t size = MAX(connection->out_len + len, 2 * connection->out_size);
+		char *buf = realloc(connection->out_buf, size);
+		if (!buf)
+			return ERROR_FAIL;
+		connection->out_buf = buf;
+		connection->out_size = size;
+	}
+
+	if (!connection->out_len)
+		server_watch(connection->fd, SERVER_FD_CONNECTION, connection, true, true);
+	memcpy(connection->out_buf + connection->out_len, data, len);
+	connection->out_len += len;
+	return ERROR_OK;
+}
+
 int connection_write(struct connection *connection, const void *data, int len)
 {
+	int written = 0;
+
 	if (len == 0) {
 		/* successful no-op. Sockets and pipes behave differently here... */
 		return 0;
 	}
-	if (connection->service->type == CONNECTION_TCP)
-		return write_socket(connection->fd_out, data, len);
-	else
+	if (connection->service->type != CONNECTION_TCP)
 		return write(connection->fd_out, data, len);
+
+	/* keep the order: nothing goes out before what is queued */
+	if (!connection->out_len) {
+		written = connection_send(connection, data, len);
+		if (written < 0 || written == len)
+			return written;
+	}
+
+	if (connection_queue(connection, (const char *)data + written, len - written) != ERROR_OK)
+		return -1;
+
+	if (connection->out_len > send_queue_max) {
+		if (!send_queue_drop)
+			return connection_drain(connection, send_queue_max) == ERROR_OK ? len : -1;
+
+		/* the read of the shut down socket returns 0, so its input
+		 * handler closes the connection */
+		LOG_WARNING("'%s' connection fell %zu bytes behind, dropping it",
+			connection->service->name, connection->out_len);
+		connection->out_len = 0;
+		server_watch(connection->fd, SERVER_FD_CONNECTION, connection, true, false);
+		shutdown(connection->fd, 2);
+		return -1;
+	}
+	return len;
 }
 
 int connection_read(struct connection *connection, void *data, int len)
@@ -918,6 +2422,27 @@ COMMAND_HANDLER(handle_poll_period_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_send_queue_limit_command)
+{
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC >= 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], send_queue_max);
+	if (CMD_ARGC == 2) {
+		if (!strcmp(CMD_ARGV[1], "drop"))
+			send_queue_drop = true;
+		else if (!strcmp(CMD_ARGV[1], "block"))
+			send_queue_drop = false;
+		else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	command_print(CMD_CTX, "send queue limit %u bytes, then %s", send_queue_max,
+		send_queue_drop ? "drop" : "block");
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_bindto_command)
 {
 	switch (CMD_ARGC) {
@@ -949,6 +2474,14 @@ static const struct command_registration server_command_handlers[] = {
 		.usage = "",
 		.help = "set the servers polling period",
 	},
+	{
+		.name = "send_queue_limit",
+		.handler = &handle_send_queue_limit_command,
+		.mode = COMMAND_ANY,
+		.usage = "[bytes ['block'|'drop']]",
+		.help = "set how much output a TCP connection may queue and "
+			"whether a client past it is waited for or dropped",
+	},
 	{
 		.name = "bindto",
 		.handler = &handle_bindto_command,
@@ -970,6 +2503,10 @@ int server_register_commands(struct command_context *cmd_ctx)
 	if (ERROR_OK != retval)
 		return retval;
 
+	retval = metrics_server_register_commands(cmd_ctx);
+	if (ERROR_OK != retval)
+		return retval;
+
 	retval = jsp_register_commands(cmd_ctx);
 	if (ERROR_OK != retval)
 		return retval;
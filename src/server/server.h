@@ -46,6 +46,10 @@ struct connection {
 	struct command_context *cmd_ctx;
 	struct service *service;
 	int input_pending;
+	/* TCP output the socket did not take yet, sent when it is writable */
+	char *out_buf;
+	size_t out_len;
+	size_t out_size;
 	void *priv;
 	struct connection *next;
 };
@@ -82,10 +86,30 @@ void exit_on_signal(int);
 
 int server_loop(struct command_context *command_context);
 
+/**
+ * Called from keep_alive() while a command runs: notes a Ctrl-C that a
+ * GDB or telnet client sent meanwhile, see server_interrupt_requested().
+ */
+void server_check_interrupt(void);
+/**
+ * @returns true once a client asked the running command to stop; long
+ * transfers check this to give up early. Cleared when the command is
+ * done and server_loop() takes over again.
+ */
+bool server_interrupt_requested(void);
+
 int server_register_commands(struct command_context *context);
 
 int connection_write(struct connection *connection, const void *data, int len);
 int connection_read(struct connection *connection, void *data, int len);
+/**
+ * Send what the socket takes of the output connection_write() queued,
+ * without waiting. @returns ERROR_OK, or ERROR_SERVER_REMOTE_CLOSED when
+ * the write failed.
+ */
+int connection_flush(struct connection *connection);
+/** @returns true while output queued by connection_write() waits to go out */
+bool connection_output_pending(struct connection *connection);
 
 /**
  * Used by server_loop(), defined in server_stubs.c
@@ -23,11 +23,19 @@
 #include "tcl_server.h"
 #include <target/target.h>
 #include <helper/binarybuffer.h>
+#include <helper/time_support.h>
+#include <helper/metrics.h>
 
 #define TCL_SERVER_VERSION		"TCL Server 0.1"
 #define TCL_LINE_INITIAL		(4*1024)
 #define TCL_LINE_MAX			(4*1024*1024)
 
+/* notifications are queued and written at most this late */
+#define TCL_NOTIFY_FLUSH_MS		10
+/* queue written at once above this, trace dropped above the max */
+#define TCL_NOTIFY_FLUSH_SIZE		(64*1024)
+#define TCL_NOTIFY_MAX			(4*1024*1024)
+
 struct tcl_connection {
 	int tc_linedrop;
 	int tc_lineoffset;
@@ -37,16 +45,99 @@ struct tcl_connection {
 	enum target_state tc_laststate;
 	bool tc_notify;
 	bool tc_trace;
+	bool tc_trace_binary;	/* trace payload raw, length framed */
+	/* queued notifications, see tcl_notify() */
+	char *tc_notify_buf;
+	size_t tc_notify_len;
+	size_t tc_notify_size;
+	bool tc_notify_timer;
+	size_t tc_trace_lost;	/* bytes dropped on a full queue */
+	/* an event equal to the last one within this window is dropped */
+	unsigned int tc_coalesce_ms;
+	enum target_event tc_last_event;
+	int64_t tc_last_event_ms;
 };
 
 static char *tcl_port;
 
+METRIC_COUNTER(tcl_trace_dropped_metric, "openocd_tcl_trace_dropped_bytes_total",
+		"trace bytes dropped on a full Tcl notification queue");
+
 /* handlers */
 static int tcl_new_connection(struct connection *connection);
 static int tcl_input(struct connection *connection);
 static int tcl_output(struct connection *connection, const void *buf, ssize_t len);
 static int tcl_closed(struct connection *connection);
 
+/* Write the queued notifications out */
+static int tcl_notify_flush(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+	int retval;
+
+	if (tclc->tc_notify_len == 0)
+		return ERROR_OK;
+
+	retval = tcl_output(connection, tclc->tc_notify_buf, tclc->tc_notify_len);
+	tclc->tc_notify_len = 0;
+	return retval;
+}
+
+static int tcl_notify_timer(void *priv)
+{
+	struct connection *connection = priv;
+	struct tcl_connection *tclc = connection->priv;
+
+	tclc->tc_notify_timer = false;
+	return tcl_notify_flush(connection);
+}
+
+/* Queue a notification, the queue goes out within TCL_NOTIFY_FLUSH_MS,
+ * before the next command result or when it grows large. */
+static int tcl_notify(struct connection *connection, const void *data,
+		size_t len, bool droppable)
+{
+	struct tcl_connection *tclc = connection->priv;
+
+	if (tclc->tc_notify_len + len > TCL_NOTIFY_MAX) {
+		if (droppable) {
+			tclc->tc_trace_lost += len;
+			metric_add(&tcl_trace_dropped_metric, len);
+			return ERROR_OK;
+		}
+		int retval = tcl_notify_flush(connection);
+		if (retval != ERROR_OK)
+			return retval;
+		if (len > TCL_NOTIFY_MAX)
+			return tcl_output(connection, data, len);
+	}
+
+	if (tclc->tc_notify_len + len > tclc->tc_notify_size) {
+		size_t size = MAX(tclc->tc_notify_size * 2, tclc->tc_notify_len + len);
+		char *buf = realloc(tclc->tc_notify_buf, size);
+		if (buf == NULL) {
+			int retval = tcl_notify_flush(connection);
+			if (retval != ERROR_OK)
+				return retval;
+			return tcl_output(connection, data, len);
+		}
+		tclc->tc_notify_buf = buf;
+		tclc->tc_notify_size = size;
+	}
+
+	memcpy(tclc->tc_notify_buf + tclc->tc_notify_len, data, len);
+	tclc->tc_notify_len += len;
+
+	if (tclc->tc_notify_len >= TCL_NOTIFY_FLUSH_SIZE)
+		return tcl_notify_flush(connection);
+
+	if (!tclc->tc_notify_timer) {
+		tclc->tc_notify_timer = true;
+		target_register_timer_callback(tcl_notify_timer, TCL_NOTIFY_FLUSH_MS, 0, connection);
+	}
+	return ERROR_OK;
+}
+
 static int tcl_target_callback_event_handler(struct target *target,
 		enum target_event event, void *priv)
 {
@@ -57,15 +148,22 @@ static int tcl_target_callback_event_handler(struct target *target,
 	tclc = connection->priv;
 
 	if (tclc->tc_notify) {
-		snprintf(buf, sizeof(buf), "type target_event event %s\r\n\x1a", target_event_name(event));
-		tcl_output(connection, buf, strlen(buf));
+		int64_t now = timeval_ms();
+
+		if (tclc->tc_coalesce_ms == 0 || event != tclc->tc_last_event ||
+				now - tclc->tc_last_event_ms >= tclc->tc_coalesce_ms) {
+			snprintf(buf, sizeof(buf), "type target_event event %s\r\n\x1a", target_event_name(event));
+			tcl_notify(connection, buf, strlen(buf), false);
+			tclc->tc_last_event = event;
+			tclc->tc_last_event_ms = now;
+		}
 	}
 
 	if (tclc->tc_laststate != target->state) {
 		tclc->tc_laststate = target->state;
 		if (tclc->tc_notify) {
 			snprintf(buf, sizeof(buf), "type target_state state %s\r\n\x1a", target_state_name(target));
-			tcl_output(connection, buf, strlen(buf));
+			tcl_notify(connection, buf, strlen(buf), false);
 		}
 	}
 
@@ -83,7 +181,7 @@ static int tcl_target_callback_reset_handler(struct target *target,
 
 	if (tclc->tc_notify) {
 		snprintf(buf, sizeof(buf), "type target_reset mode %s\r\n\x1a", target_reset_mode_name(reset_mode));
-		tcl_output(connection, buf, strlen(buf));
+		tcl_notify(connection, buf, strlen(buf), false);
 	}
 
 	return ERROR_OK;
@@ -102,15 +200,46 @@ static int tcl_target_callback_trace_handler(struct target *target,
 
 	tclc = connection->priv;
 
-	if (tclc->tc_trace) {
-		hex = malloc(hex_len);
-		buf = malloc(max_len);
-		hexify(hex, (const char *)data, len, hex_len);
-		snprintf(buf, max_len, "%s%s%s", header, hex, trailer);
-		tcl_output(connection, buf, strlen(buf));
+	if (!tclc->tc_trace)
+		return ERROR_OK;
+
+	if (tclc->tc_trace_lost && tclc->tc_notify_len < TCL_NOTIFY_MAX / 2) {
+		char lost[64];
+		snprintf(lost, sizeof(lost), "type target_trace_lost bytes %zu\r\n\x1a",
+				tclc->tc_trace_lost);
+		tclc->tc_trace_lost = 0;
+		tcl_notify(connection, lost, strlen(lost), false);
+	}
+
+	if (tclc->tc_trace_binary) {
+		/* "type target_trace_bin length <n>\r\n", n raw bytes, trailer */
+		char head[64];
+		snprintf(head, sizeof(head), "type target_trace_bin length %zu\r\n", len);
+		size_t head_len = strlen(head);
+
+		buf = malloc(head_len + len + strlen(trailer));
+		if (buf == NULL)
+			return ERROR_FAIL;
+		memcpy(buf, head, head_len);
+		memcpy(buf + head_len, data, len);
+		memcpy(buf + head_len + len, trailer, strlen(trailer));
+		tcl_notify(connection, buf, head_len + len + strlen(trailer), true);
+		free(buf);
+		return ERROR_OK;
+	}
+
+	hex = malloc(hex_len);
+	buf = malloc(max_len);
+	if (hex == NULL || buf == NULL) {
 		free(hex);
 		free(buf);
+		return ERROR_FAIL;
 	}
+	hexify(hex, (const char *)data, len, hex_len);
+	snprintf(buf, max_len, "%s%s%s", header, hex, trailer);
+	tcl_notify(connection, buf, strlen(buf), true);
+	free(hex);
+	free(buf);
 
 	return ERROR_OK;
 }
@@ -242,6 +371,10 @@ static int tcl_input(struct connection *connection)
 		} else {
 			tclc->tc_line[tclc->tc_lineoffset-1] = '\0';
 			command_run_line(connection->cmd_ctx, tclc->tc_line);
+			/* notifications raised so far go before the result */
+			retval = tcl_notify_flush(connection);
+			if (retval != ERROR_OK)
+				return retval;
 			result = Jim_GetString(Jim_GetResult(interp), &reslen);
 			retval = tcl_output(connection, result, reslen);
 			if (retval != ERROR_OK)
@@ -264,6 +397,9 @@ static int tcl_closed(struct connection *connection)
 
 	/* cleanup connection context */
 	if (tclc) {
+		if (tclc->tc_notify_timer)
+			target_unregister_timer_callback(tcl_notify_timer, connection);
+		free(tclc->tc_notify_buf);
 		free(tclc->tc_line);
 		free(tclc);
 		connection->priv = NULL;
@@ -303,6 +439,15 @@ COMMAND_HANDLER(handle_tcl_notifications_command)
 
 	if (connection != NULL && !strcmp(connection->service->name, "tcl")) {
 		tclc = connection->priv;
+		if (CMD_ARGC > 2)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		if (CMD_ARGC == 2) {
+			COMMAND_PARSE_ON_OFF(CMD_ARGV[0], tclc->tc_notify);
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], tclc->tc_coalesce_ms);
+			LOG_INFO("Target Notification output  is %s, window %u ms",
+					tclc->tc_notify ? "enabled" : "disabled", tclc->tc_coalesce_ms);
+			return ERROR_OK;
+		}
 		return CALL_COMMAND_HANDLER(handle_command_parse_bool, &tclc->tc_notify, "Target Notification output ");
 	} else {
 		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
@@ -320,6 +465,14 @@ COMMAND_HANDLER(handle_tcl_trace_command)
 
 	if (connection != NULL && !strcmp(connection->service->name, "tcl")) {
 		tclc = connection->priv;
+		if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "binary")) {
+			tclc->tc_trace = true;
+			tclc->tc_trace_binary = true;
+			command_print(CMD_CTX, "Target trace output is binary");
+			return ERROR_OK;
+		}
+		if (CMD_ARGC == 1)
+			tclc->tc_trace_binary = false;
 		return CALL_COMMAND_HANDLER(handle_command_parse_bool, &tclc->tc_trace, "Target trace output ");
 	} else {
 		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
@@ -341,15 +494,16 @@ static const struct command_registration tcl_command_handlers[] = {
 		.name = "tcl_notifications",
 		.handler = handle_tcl_notifications_command,
 		.mode = COMMAND_EXEC,
-		.help = "Target Notification output",
-		.usage = "[on|off]",
+		.help = "Target Notification output, optionally dropping an event "
+			"repeated within window_ms",
+		.usage = "[on|off [window_ms]]",
 	},
 	{
 		.name = "tcl_trace",
 		.handler = handle_tcl_trace_command,
 		.mode = COMMAND_EXEC,
-		.help = "Target trace output",
-		.usage = "[on|off]",
+		.help = "Target trace output, hex or length framed binary",
+		.usage = "[on|off|binary]",
 	},
 	COMMAND_REGISTRATION_DONE
 };
@@ -27,8 +27,10 @@
 #endif
 
 #include "telnet_server.h"
+#include <target/target.h>
 #include <target/target_request.h>
 #include <helper/configuration.h>
+#include <helper/time_support.h>
 
 static char *telnet_port;
 
@@ -41,23 +43,104 @@ static char *negotiate =
 #define CTRL(c) (c - '@')
 #define TELNET_HISTORY	".openocd_history"
 
+/* Output is batched and sent once per input handled or server loop pass;
+ * while a long command runs, whenever the batch is this large or old. */
+#define TELNET_OUT_FLUSH_SIZE	(4096)
+#define TELNET_OUT_FLUSH_MS		(50)
+
+static void telnet_queue(struct connection *connection, const void *data, int len)
+{
+	struct telnet_connection *t_con = connection->priv;
+
+	if (t_con->out_len + len > t_con->out_size) {
+		int size = MAX(t_con->out_len + len, 2 * t_con->out_size);
+		char *buf = realloc(t_con->out_buf, size);
+		if (buf == NULL) {
+			LOG_ERROR("out of memory, telnet output lost");
+			return;
+		}
+		t_con->out_buf = buf;
+		t_con->out_size = size;
+	}
+
+	if (t_con->out_len == 0)
+		t_con->out_since = timeval_ms();
+	memcpy(t_con->out_buf + t_con->out_len, data, len);
+	t_con->out_len += len;
+}
+
+/* put the command line the log messages erased back */
+static void telnet_restore_prompt(struct connection *connection)
+{
+	struct telnet_connection *t_con = connection->priv;
+	int i;
+
+	t_con->prompt_hidden = false;
+	telnet_queue(connection, t_con->prompt, strlen(t_con->prompt));
+	telnet_queue(connection, t_con->line, t_con->line_size);
+	for (i = t_con->line_size; i > t_con->line_cursor; i--)
+		telnet_queue(connection, "\b", 1);
+}
+
+static int telnet_flush_timer(void *priv);
+
 /* The only way we can detect that the socket is closed is the first time
  * we write to it, we will fail. Subsequent write operations will
  * succeed. Shudder!
  */
-static int telnet_write(struct connection *connection, const void *data,
-	int len)
+static int telnet_flush(struct connection *connection)
 {
 	struct telnet_connection *t_con = connection->priv;
+	int len;
+
+	if (t_con->out_timer) {
+		target_unregister_timer_callback(telnet_flush_timer, connection);
+		t_con->out_timer = false;
+	}
+	if (t_con->prompt_hidden)
+		telnet_restore_prompt(connection);
+
+	len = t_con->out_len;
+	t_con->out_len = 0;
 	if (t_con->closed)
 		return ERROR_SERVER_REMOTE_CLOSED;
-
-	if (connection_write(connection, data, len) == len)
+	if (len == 0 || connection_write(connection, t_con->out_buf, len) == len)
 		return ERROR_OK;
 	t_con->closed = 1;
 	return ERROR_SERVER_REMOTE_CLOSED;
 }
 
+static int telnet_flush_timer(void *priv)
+{
+	struct connection *connection = priv;
+	struct telnet_connection *t_con = connection->priv;
+
+	t_con->out_timer = false;
+	telnet_flush(connection);
+	return ERROR_OK;
+}
+
+static int telnet_write(struct connection *connection, const void *data,
+	int len)
+{
+	struct telnet_connection *t_con = connection->priv;
+	if (t_con->closed)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	telnet_queue(connection, data, len);
+
+	if (t_con->out_len >= TELNET_OUT_FLUSH_SIZE ||
+			timeval_ms() - t_con->out_since >= TELNET_OUT_FLUSH_MS)
+		return telnet_flush(connection);
+
+	/* output of timers and target events goes out on the next pass */
+	if (!t_con->out_timer) {
+		t_con->out_timer = true;
+		target_register_timer_callback(telnet_flush_timer, 0, 0, connection);
+	}
+	return ERROR_OK;
+}
+
 static int telnet_prompt(struct connection *connection)
 {
 	struct telnet_connection *t_con = connection->priv;
@@ -103,28 +186,24 @@ static void telnet_log_callback(void *priv, const char *file, unsigned line,
 	struct telnet_connection *t_con = connection->priv;
 	int i;
 
-	/* if there is no prompt, simply output the message */
-	if (t_con->line_cursor < 0) {
+	/* if there is no prompt, or it is already cleared for an earlier
+	 * message of this batch, simply output the message */
+	if (t_con->line_cursor < 0 || t_con->prompt_hidden) {
 		telnet_outputline(connection, string);
 		return;
 	}
 
 	/* clear the command line */
 	for (i = strlen(t_con->prompt) + t_con->line_size; i > 0; i -= 16)
-		telnet_write(connection, "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", i > 16 ? 16 : i);
+		telnet_queue(connection, "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", i > 16 ? 16 : i);
 	for (i = strlen(t_con->prompt) + t_con->line_size; i > 0; i -= 16)
-		telnet_write(connection, "                ", i > 16 ? 16 : i);
+		telnet_queue(connection, "                ", i > 16 ? 16 : i);
 	for (i = strlen(t_con->prompt) + t_con->line_size; i > 0; i -= 16)
-		telnet_write(connection, "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", i > 16 ? 16 : i);
+		telnet_queue(connection, "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", i > 16 ? 16 : i);
 
-	/* output the message */
+	/* output the message, telnet_flush() puts the command line back */
+	t_con->prompt_hidden = true;
 	telnet_outputline(connection, string);
-
-	/* put the command line to its previous state */
-	telnet_prompt(connection);
-	telnet_write(connection, t_con->line, t_con->line_size);
-	for (i = t_con->line_size; i > t_con->line_cursor; i--)
-		telnet_write(connection, "\b", 1);
 }
 
 static void telnet_load_history(struct telnet_connection *t_con)
@@ -220,6 +299,11 @@ static int telnet_new_connection(struct connection *connection)
 
 	/* initialize telnet connection information */
 	telnet_connection->closed = 0;
+	telnet_connection->out_buf = NULL;
+	telnet_connection->out_len = 0;
+	telnet_connection->out_size = 0;
+	telnet_connection->out_timer = false;
+	telnet_connection->prompt_hidden = false;
 	telnet_connection->line_size = 0;
 	telnet_connection->line_cursor = 0;
 	telnet_connection->option_size = 0;
@@ -251,7 +335,7 @@ static int telnet_new_connection(struct connection *connection)
 
 	log_add_callback(telnet_log_callback, connection);
 
-	return ERROR_OK;
+	return telnet_flush(connection);
 }
 
 static void telnet_clear_line(struct connection *connection,
@@ -321,6 +405,10 @@ static int telnet_input(struct connection *connection)
 		return ERROR_SERVER_REMOTE_CLOSED;
 	}
 
+	/* echo onto the command line, not after the log messages */
+	if (t_con->prompt_hidden)
+		telnet_restore_prompt(connection);
+
 	buf_p = buffer;
 	while (bytes_read) {
 		switch (t_con->state) {
@@ -580,7 +668,7 @@ static int telnet_input(struct connection *connection)
 		buf_p++;
 	}
 
-	return ERROR_OK;
+	return telnet_flush(connection);
 }
 
 static int telnet_connection_closed(struct connection *connection)
@@ -590,6 +678,10 @@ static int telnet_connection_closed(struct connection *connection)
 
 	log_remove_callback(telnet_log_callback, connection);
 
+	/* what is left goes out before the socket is closed */
+	telnet_flush(connection);
+	free(t_con->out_buf);
+
 	if (t_con->prompt) {
 		free(t_con->prompt);
 		t_con->prompt = NULL;
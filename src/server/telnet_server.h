@@ -58,6 +58,14 @@ struct telnet_connection {
 	int next_history;
 	int current_history;
 	int closed;
+	/* output batched by telnet_write(), see telnet_flush() */
+	char *out_buf;
+	int out_len;
+	int out_size;
+	int64_t out_since;
+	bool out_timer;
+	/* log messages erased the prompt, redrawn once on the next flush */
+	bool prompt_hidden;
 };
 
 struct telnet_service {
@@ -206,7 +206,7 @@ struct svf_check_tdo_para {
 	int bit_len;		/* bit length to check */
 };
 
-#define SVF_CHECK_TDO_PARA_SIZE 1024
+#define SVF_CHECK_TDO_PARA_SIZE 8192
 static struct svf_check_tdo_para *svf_check_tdo_para;
 static int svf_check_tdo_para_index;
 
@@ -216,6 +216,9 @@ static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len);
 static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str);
 static int svf_execute_tap(void);
 
+/* stdio buffer size for the SVF file */
+#define SVF_READ_AHEAD (64 * 1024)
+
 static FILE *svf_fd;
 static char *svf_read_line;
 static size_t svf_read_line_size;
@@ -225,11 +228,17 @@ static int svf_line_number;
 static int svf_getline(char **lineptr, size_t *n, FILE *stream);
 
 #define SVF_MAX_BUFFER_SIZE_TO_COMMIT   (1024 * 1024)
+
+/* with -runtest_clocks, RUNTEST waits up to this long become idle clocks */
+#define SVF_MAX_RUNTEST_CLOCK_USEC	(10 * 1000)
 static uint8_t *svf_tdi_buffer, *svf_tdo_buffer, *svf_mask_buffer;
 static int svf_buffer_index, svf_buffer_size ;
 static int svf_quiet;
 static int svf_nil;
 static int svf_ignore_error;
+static int svf_runtest_clocks;
+/* TCK rate used to turn RUNTEST waits into clocks, 0 to keep sleeping */
+static int svf_runtest_khz;
 
 /* Targetting particular tap */
 static int svf_tap_is_specified;
@@ -321,6 +330,343 @@ static void svf_free_xxd_para(struct svf_xxr_para *para)
 	}
 }
 
+/*
+ * Compiled svf cache.
+ *
+ * With -cache the first run records every JTAG operation it queues, with
+ * scan data already packed and the TDO check attached, to <file>.cache.
+ * Later runs of the same file (same content hash and padding) replay that
+ * record straight into the JTAG queue without tokenizing anything.
+ * The cache is only a local speedup and uses host byte order.
+ */
+#define SVF_CACHE_MAGIC		"OCDSVFC1"
+#define SVF_CACHE_SUFFIX	".cache"
+
+enum svf_cache_op {
+	SVF_OP_TLR,
+	SVF_OP_PATHMOVE,
+	SVF_OP_CLOCKS,
+	SVF_OP_SLEEP,
+	SVF_OP_RESET,
+	SVF_OP_DR_SCAN,
+	SVF_OP_IR_SCAN,
+	SVF_OP_EXECUTE,
+	SVF_OP_FREQUENCY,
+	SVF_OP_END,
+};
+
+struct svf_cache_header {
+	char magic[8];
+	uint64_t hash;
+	int32_t hdr_len, hir_len, tdr_len, tir_len;
+	int32_t runtest_khz;
+};
+
+/* followed by the tdi bytes, and the tdo and mask bytes if checked */
+struct svf_cache_scan {
+	uint32_t num_bits;
+	int32_t line_num;
+	uint8_t end_state;
+	uint8_t check;
+};
+
+static int svf_cache_enabled;
+static char *svf_cache_name;
+static char *svf_cache_tmp_name;
+static FILE *svf_cache_in;
+static FILE *svf_cache_out;
+static bool svf_cache_error;
+
+static void svf_cache_put(const void *data, size_t len)
+{
+	if (svf_cache_out == NULL || svf_cache_error || len == 0)
+		return;
+
+	if (fwrite(data, 1, len, svf_cache_out) != len) {
+		LOG_WARNING("svf: cannot write %s, no cache is kept", svf_cache_tmp_name);
+		svf_cache_error = true;
+	}
+}
+
+static void svf_cache_op(uint8_t op, const void *data, size_t len)
+{
+	svf_cache_put(&op, 1);
+	svf_cache_put(data, len);
+}
+
+static int svf_cache_get(void *data, size_t len)
+{
+	if (fread(data, 1, len, svf_cache_in) != len)
+		return ERROR_FAIL;
+	return ERROR_OK;
+}
+
+static void svf_add_tlr(void)
+{
+	svf_cache_op(SVF_OP_TLR, NULL, 0);
+	jtag_add_tlr();
+}
+
+static void svf_add_pathmove(int num_states, const tap_state_t *path)
+{
+	int32_t n = num_states;
+
+	svf_cache_op(SVF_OP_PATHMOVE, &n, sizeof(n));
+	svf_cache_put(path, num_states * sizeof(*path));
+	jtag_add_pathmove(num_states, path);
+}
+
+static void svf_add_clocks(int num_cycles)
+{
+	int32_t n = num_cycles;
+
+	svf_cache_op(SVF_OP_CLOCKS, &n, sizeof(n));
+	jtag_add_clocks(num_cycles);
+}
+
+static void svf_add_sleep(uint32_t us)
+{
+	svf_cache_op(SVF_OP_SLEEP, &us, sizeof(us));
+	jtag_add_sleep(us);
+}
+
+static void svf_add_reset(int trst, int srst)
+{
+	uint8_t rst[2] = { trst, srst };
+
+	svf_cache_op(SVF_OP_RESET, rst, sizeof(rst));
+	jtag_add_reset(trst, srst);
+}
+
+/* queue a scan of the data assembled at svf_buffer_index */
+static void svf_add_scan(bool ir_scan, int num_bits, bool check, tap_state_t end_state)
+{
+	uint8_t *tdi = &svf_tdi_buffer[svf_buffer_index];
+
+	if (svf_cache_out) {
+		struct svf_cache_scan scan = {
+			.num_bits = num_bits,
+			.line_num = svf_line_number,
+			.end_state = end_state,
+			.check = check,
+		};
+		int len = (num_bits + 7) >> 3;
+
+		svf_cache_op(ir_scan ? SVF_OP_IR_SCAN : SVF_OP_DR_SCAN, &scan, sizeof(scan));
+		svf_cache_put(tdi, len);
+		if (check) {
+			svf_cache_put(&svf_tdo_buffer[svf_buffer_index], len);
+			svf_cache_put(&svf_mask_buffer[svf_buffer_index], len);
+		}
+	}
+
+	/* NOTE:  doesn't use SVF-specified state paths */
+	if (ir_scan)
+		jtag_add_plain_ir_scan(num_bits, tdi, check ? tdi : NULL, end_state);
+	else
+		jtag_add_plain_dr_scan(num_bits, tdi, check ? tdi : NULL, end_state);
+}
+
+/* FNV-1a over the whole file, which is left rewound */
+static uint64_t svf_cache_hash(FILE *fd)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	uint8_t buf[4096];
+	size_t n;
+
+	while ((n = fread(buf, 1, sizeof(buf), fd)) > 0) {
+		for (size_t i = 0; i < n; i++) {
+			hash ^= buf[i];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	rewind(fd);
+
+	return hash;
+}
+
+/*
+ * Open a matching cache for replay, or else start recording a new one.
+ * Not having a cache is never an error.
+ */
+static void svf_cache_begin(const char *svf_name)
+{
+	struct svf_cache_header header, found;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SVF_CACHE_MAGIC, sizeof(header.magic));
+	header.hash = svf_cache_hash(svf_fd);
+	header.hdr_len = svf_para.hdr_para.len;
+	header.hir_len = svf_para.hir_para.len;
+	header.tdr_len = svf_para.tdr_para.len;
+	header.tir_len = svf_para.tir_para.len;
+	header.runtest_khz = svf_runtest_khz;
+
+	svf_cache_name = alloc_printf("%s" SVF_CACHE_SUFFIX, svf_name);
+	svf_cache_tmp_name = alloc_printf("%s" SVF_CACHE_SUFFIX ".tmp", svf_name);
+	if (svf_cache_name == NULL || svf_cache_tmp_name == NULL)
+		return;
+
+	svf_cache_in = fopen(svf_cache_name, "rb");
+	if (svf_cache_in) {
+		setvbuf(svf_cache_in, NULL, _IOFBF, SVF_READ_AHEAD);
+		if (svf_cache_get(&found, sizeof(found)) == ERROR_OK
+				&& !memcmp(&found, &header, sizeof(header))) {
+			LOG_USER("svf replaying compiled cache: \"%s\"", svf_cache_name);
+			return;
+		}
+		LOG_INFO("svf: %s is stale, compiling it again", svf_cache_name);
+		fclose(svf_cache_in);
+		svf_cache_in = NULL;
+	}
+
+	svf_cache_error = false;
+	svf_cache_out = fopen(svf_cache_tmp_name, "wb");
+	if (svf_cache_out == NULL) {
+		LOG_WARNING("svf: cannot create %s, no cache is kept", svf_cache_tmp_name);
+		return;
+	}
+	svf_cache_put(&header, sizeof(header));
+}
+
+/* keep a newly recorded cache only if the whole file ran fine */
+static void svf_cache_end(bool ok, int command_num)
+{
+	if (svf_cache_in) {
+		fclose(svf_cache_in);
+		svf_cache_in = NULL;
+	}
+
+	if (svf_cache_out) {
+		int32_t n = command_num;
+
+		svf_cache_op(SVF_OP_END, &n, sizeof(n));
+		if (fclose(svf_cache_out) != 0)
+			svf_cache_error = true;
+		svf_cache_out = NULL;
+
+		if (!ok || svf_cache_error || rename(svf_cache_tmp_name, svf_cache_name) != 0)
+			remove(svf_cache_tmp_name);
+		else
+			LOG_INFO("svf: compiled cache written to %s", svf_cache_name);
+	}
+
+	free(svf_cache_name);
+	svf_cache_name = NULL;
+	free(svf_cache_tmp_name);
+	svf_cache_tmp_name = NULL;
+}
+
+static int svf_cache_replay_scan(bool ir_scan)
+{
+	struct svf_cache_scan scan;
+
+	if (svf_cache_get(&scan, sizeof(scan)) != ERROR_OK)
+		return ERROR_FAIL;
+
+	int len = (scan.num_bits + 7) >> 3;
+	if ((svf_buffer_size - svf_buffer_index) < len) {
+		if (svf_realloc_buffers(svf_buffer_index + len) != ERROR_OK) {
+			LOG_ERROR("not enough memory");
+			return ERROR_FAIL;
+		}
+	}
+
+	if (svf_cache_get(&svf_tdi_buffer[svf_buffer_index], len) != ERROR_OK)
+		return ERROR_FAIL;
+	if (scan.check) {
+		if (svf_cache_get(&svf_tdo_buffer[svf_buffer_index], len) != ERROR_OK
+				|| svf_cache_get(&svf_mask_buffer[svf_buffer_index], len) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	svf_line_number = scan.line_num;
+	svf_add_check_para(scan.check, svf_buffer_index, scan.num_bits);
+	svf_add_scan(ir_scan, scan.num_bits, scan.check, scan.end_state);
+	svf_buffer_index += len;
+
+	return ERROR_OK;
+}
+
+static int svf_cache_replay(struct command_context *cmd_ctx, int *command_num)
+{
+	tap_state_t path[256];
+	uint8_t rst[2];
+	uint32_t us;
+	int32_t n;
+	uint8_t op;
+
+	while (svf_cache_get(&op, 1) == ERROR_OK) {
+		switch (op) {
+		case SVF_OP_TLR:
+			jtag_add_tlr();
+			continue;
+		case SVF_OP_PATHMOVE:
+			if (svf_cache_get(&n, sizeof(n)) != ERROR_OK
+					|| n <= 0 || n > (int32_t)ARRAY_SIZE(path)
+					|| svf_cache_get(path, n * sizeof(*path)) != ERROR_OK)
+				break;
+			jtag_add_pathmove(n, path);
+			continue;
+		case SVF_OP_CLOCKS:
+			if (svf_cache_get(&n, sizeof(n)) != ERROR_OK)
+				break;
+			jtag_add_clocks(n);
+			continue;
+		case SVF_OP_SLEEP:
+			if (svf_cache_get(&us, sizeof(us)) != ERROR_OK)
+				break;
+			jtag_add_sleep(us);
+			continue;
+		case SVF_OP_RESET:
+			if (svf_cache_get(rst, sizeof(rst)) != ERROR_OK)
+				break;
+			jtag_add_reset(rst[0], rst[1]);
+			continue;
+		case SVF_OP_DR_SCAN:
+		case SVF_OP_IR_SCAN:
+			if (svf_cache_replay_scan(op == SVF_OP_IR_SCAN) != ERROR_OK)
+				break;
+			continue;
+		case SVF_OP_EXECUTE:
+			if (svf_execute_tap() != ERROR_OK)
+				return ERROR_FAIL;
+			continue;
+		case SVF_OP_FREQUENCY:
+			if (svf_cache_get(&n, sizeof(n)) != ERROR_OK)
+				break;
+			command_run_linef(cmd_ctx, "adapter_khz %d", (int)n);
+			continue;
+		case SVF_OP_END:
+			if (svf_cache_get(&n, sizeof(n)) != ERROR_OK)
+				break;
+			*command_num = n;
+			return ERROR_OK;
+		default:
+			break;
+		}
+		break;
+	}
+
+	LOG_ERROR("svf: %s is corrupt, delete it and run again", svf_cache_name);
+	return ERROR_FAIL;
+}
+
+/* an adaptive or unknown TCK cannot be used to time a wait */
+static void svf_update_runtest_khz(void)
+{
+	int khz;
+
+	svf_runtest_khz = 0;
+	if (!svf_runtest_clocks)
+		return;
+
+	if (jtag_get_speed_readable(&khz) == ERROR_OK && khz > 0)
+		svf_runtest_khz = khz;
+	else
+		LOG_WARNING("svf: no fixed TCK frequency, RUNTEST waits stay sleeps");
+}
+
 int svf_add_statemove(tap_state_t state_to)
 {
 	tap_state_t state_from = cmd_queue_cur_state;
@@ -331,7 +677,7 @@ int svf_add_statemove(tap_state_t state_to)
 		if (svf_nil)
 			return ERROR_OK;
 
-		jtag_add_tlr();
+		svf_add_tlr();
 		return ERROR_OK;
 	}
 
@@ -343,10 +689,10 @@ int svf_add_statemove(tap_state_t state_to)
 						/* recorded path includes current state ... avoid
 						 *extra TCKs! */
 			if (svf_statemoves[index_var].num_of_moves > 1)
-				jtag_add_pathmove(svf_statemoves[index_var].num_of_moves - 1,
+				svf_add_pathmove(svf_statemoves[index_var].num_of_moves - 1,
 					svf_statemoves[index_var].paths + 1);
 			else
-				jtag_add_pathmove(svf_statemoves[index_var].num_of_moves,
+				svf_add_pathmove(svf_statemoves[index_var].num_of_moves,
 					svf_statemoves[index_var].paths);
 			return ERROR_OK;
 		}
@@ -358,8 +704,9 @@ int svf_add_statemove(tap_state_t state_to)
 COMMAND_HANDLER(handle_svf_command)
 {
 #define SVF_MIN_NUM_OF_OPTIONS 1
-#define SVF_MAX_NUM_OF_OPTIONS 5
+#define SVF_MAX_NUM_OF_OPTIONS 9
 	int command_num = 0;
+	const char *svf_name = NULL;
 	int ret = ERROR_OK;
 	int64_t time_measure_ms;
 	int time_measure_s, time_measure_m;
@@ -378,6 +725,8 @@ COMMAND_HANDLER(handle_svf_command)
 	svf_nil = 0;
 	svf_progress_enabled = 0;
 	svf_ignore_error = 0;
+	svf_cache_enabled = 0;
+	svf_runtest_clocks = 0;
 	for (unsigned int i = 0; i < CMD_ARGC; i++) {
 		if (strcmp(CMD_ARGV[i], "-tap") == 0) {
 			tap = jtag_tap_by_string(CMD_ARGV[i+1]);
@@ -397,15 +746,23 @@ COMMAND_HANDLER(handle_svf_command)
 		else if ((strcmp(CMD_ARGV[i],
 				  "ignore_error") == 0) || (strcmp(CMD_ARGV[i], "-ignore_error") == 0))
 			svf_ignore_error = 1;
+		else if (strcmp(CMD_ARGV[i], "-cache") == 0)
+			svf_cache_enabled = 1;
+		else if (strcmp(CMD_ARGV[i], "-runtest_clocks") == 0)
+			svf_runtest_clocks = 1;
 		else {
+			svf_name = CMD_ARGV[i];
 			svf_fd = fopen(CMD_ARGV[i], "r");
 			if (svf_fd == NULL) {
 				int err = errno;
 				command_print(CMD_CTX, "open(\"%s\"): %s", CMD_ARGV[i], strerror(err));
 				/* no need to free anything now */
 				return ERROR_COMMAND_SYNTAX_ERROR;
-			} else
+			} else {
+				/* the file is read a character at a time, read ahead in large blocks */
+				setvbuf(svf_fd, NULL, _IOFBF, SVF_READ_AHEAD);
 				LOG_USER("svf processing file: \"%s\"", CMD_ARGV[i]);
+			}
 		}
 	}
 
@@ -415,6 +772,8 @@ COMMAND_HANDLER(handle_svf_command)
 	/* get time */
 	time_measure_ms = timeval_ms();
 
+	svf_update_runtest_khz();
+
 	/* init */
 	svf_line_number = 0;
 	svf_command_buffer_size = 0;
@@ -488,7 +847,14 @@ COMMAND_HANDLER(handle_svf_command)
 		}
 	}
 
-	if (svf_progress_enabled) {
+	/* a nil run queues nothing, so there is nothing to record */
+	if (svf_cache_enabled && !svf_nil)
+		svf_cache_begin(svf_name);
+
+	if (svf_cache_in)
+		ret = svf_cache_replay(CMD_CTX, &command_num);
+
+	if (svf_progress_enabled && !svf_cache_in) {
 		/* Count total lines in file. */
 		while (!feof(svf_fd)) {
 			svf_getline(&svf_command_buffer, &svf_command_buffer_size, svf_fd);
@@ -496,7 +862,7 @@ COMMAND_HANDLER(handle_svf_command)
 		}
 		rewind(svf_fd);
 	}
-	while (ERROR_OK == svf_read_command_from_file(svf_fd)) {
+	while (!svf_cache_in && ERROR_OK == svf_read_command_from_file(svf_fd)) {
 		/* Log Output */
 		if (svf_quiet) {
 			if (svf_progress_enabled) {
@@ -542,6 +908,8 @@ COMMAND_HANDLER(handle_svf_command)
 
 free_all:
 
+	svf_cache_end(ret == ERROR_OK, command_num);
+
 	fclose(svf_fd);
 	svf_fd = 0;
 
@@ -903,6 +1271,8 @@ static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
 
 static int svf_execute_tap(void)
 {
+	svf_cache_op(SVF_OP_EXECUTE, NULL, 0);
+
 	if ((!svf_nil) && (ERROR_OK != jtag_execute_queue()))
 		return ERROR_FAIL;
 	else if (ERROR_OK != svf_check_tdo())
@@ -927,7 +1297,6 @@ static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str)
 	/* for XXR */
 	struct svf_xxr_para *xxr_para_tmp;
 	uint8_t **pbuffer_tmp;
-	struct scan_field field;
 	/* for STATE */
 	tap_state_t *path = NULL, state;
 	/* flag padding commands skipped due to -tap command */
@@ -986,9 +1355,11 @@ static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str)
 				svf_para.frequency = atof(argus[1]);
 				/* TODO: set jtag speed to */
 				if (svf_para.frequency > 0) {
-					command_run_linef(cmd_ctx,
-							"adapter_khz %d",
-							(int)svf_para.frequency / 1000);
+					int32_t khz = (int)svf_para.frequency / 1000;
+
+					command_run_linef(cmd_ctx, "adapter_khz %d", (int)khz);
+					svf_cache_op(SVF_OP_FREQUENCY, &khz, sizeof(khz));
+					svf_update_runtest_khz();
 					LOG_DEBUG("\tfrequency = %f", svf_para.frequency);
 				}
 			}
@@ -1199,16 +1570,9 @@ XXR_common:
 					svf_add_check_para(1, svf_buffer_index, i);
 				} else
 					svf_add_check_para(0, svf_buffer_index, i);
-				field.num_bits = i;
-				field.out_value = &svf_tdi_buffer[svf_buffer_index];
-				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
-				if (!svf_nil) {
-					/* NOTE:  doesn't use SVF-specified state paths */
-					jtag_add_plain_dr_scan(field.num_bits,
-							field.out_value,
-							field.in_value,
+				if (!svf_nil)
+					svf_add_scan(false, i, xxr_para_tmp->data_mask & XXR_TDO,
 							svf_para.dr_end_state);
-				}
 
 				svf_buffer_index += (i + 7) >> 3;
 			} else if (SIR == command) {
@@ -1289,16 +1653,9 @@ XXR_common:
 					svf_add_check_para(1, svf_buffer_index, i);
 				} else
 					svf_add_check_para(0, svf_buffer_index, i);
-				field.num_bits = i;
-				field.out_value = &svf_tdi_buffer[svf_buffer_index];
-				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
-				if (!svf_nil) {
-					/* NOTE:  doesn't use SVF-specified state paths */
-					jtag_add_plain_ir_scan(field.num_bits,
-							field.out_value,
-							field.in_value,
+				if (!svf_nil)
+					svf_add_scan(true, i, xxr_para_tmp->data_mask & XXR_TDO,
 							svf_para.ir_end_state);
-				}
 
 				svf_buffer_index += (i + 7) >> 3;
 			}
@@ -1393,12 +1750,20 @@ XXR_common:
 				/* add clocks and/or min wait */
 				if (run_count > 0) {
 					if (!svf_nil)
-						jtag_add_clocks(run_count);
+						svf_add_clocks(run_count);
 				}
 
-				if (min_usec > 0) {
+				if (min_usec > 0 && svf_runtest_khz > 0
+						&& min_usec <= SVF_MAX_RUNTEST_CLOCK_USEC) {
+					/* wait with idle clocks instead, a sleep makes most
+					 * adapters flush their queue and the TDO checks */
+					uint64_t clocks = DIV_ROUND_UP((uint64_t)min_usec * svf_runtest_khz, 1000);
+
+					if (clocks > (uint64_t)run_count && !svf_nil)
+						svf_add_clocks(clocks - run_count);
+				} else if (min_usec > 0) {
 					if (!svf_nil)
-						jtag_add_sleep(min_usec);
+						svf_add_sleep(min_usec);
 				}
 
 				/* move to end_state if necessary */
@@ -1449,10 +1814,10 @@ XXR_common:
 						/* FIXME last state MUST be stable! */
 						if (i > 0) {
 							if (!svf_nil)
-								jtag_add_pathmove(i, path);
+								svf_add_pathmove(i, path);
 						}
 						if (!svf_nil)
-							jtag_add_tlr();
+							svf_add_tlr();
 						num_of_argu -= i + 1;
 						i = -1;
 					}
@@ -1462,7 +1827,7 @@ XXR_common:
 					if (svf_tap_state_is_stable(path[num_of_argu - 1])) {
 						/* last state MUST be stable state */
 						if (!svf_nil)
-							jtag_add_pathmove(num_of_argu, path);
+							svf_add_pathmove(num_of_argu, path);
 						LOG_DEBUG("\tmove to %s by path_move",
 								tap_state_name(path[num_of_argu - 1]));
 					} else {
@@ -1506,12 +1871,12 @@ XXR_common:
 				switch (i_tmp) {
 				case TRST_ON:
 					if (!svf_nil)
-						jtag_add_reset(1, 0);
+						svf_add_reset(1, 0);
 					break;
 				case TRST_Z:
 				case TRST_OFF:
 					if (!svf_nil)
-						jtag_add_reset(0, 0);
+						svf_add_reset(0, 0);
 					break;
 				case TRST_ABSENT:
 					break;
@@ -1569,7 +1934,7 @@ static const struct command_registration svf_command_handlers[] = {
 		.handler = handle_svf_command,
 		.mode = COMMAND_EXEC,
 		.help = "Runs a SVF file.",
-		.usage = "svf [-tap device.tap] <file> [quiet] [nil] [progress] [ignore_error]",
+		.usage = "svf [-tap device.tap] <file> [quiet] [nil] [progress] [ignore_error] [-cache] [-runtest_clocks]",
 	},
 	COMMAND_REGISTRATION_DONE
 };
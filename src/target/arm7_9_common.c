@@ -2506,8 +2506,14 @@ int arm7_9_write_memory_no_opt(struct target *target,
 	return arm7_9->write_memory(target, address, size, count, buffer);
 }
 
+/* Words moved through the DCC between two flushes of the JTAG queue; the
+ * scans of a block are queued back to back, the handshake between blocks
+ * lets the target catch up. */
+#define DCC_BLOCK_WORDS		1024
+
 static int dcc_count;
 static const uint8_t *dcc_buffer;
+static uint8_t *dcc_read_buffer;
 
 static int arm7_9_dcc_completion(struct target *target,
 	uint32_t exit_point,
@@ -2524,33 +2530,82 @@ static int arm7_9_dcc_completion(struct target *target,
 	int little = target->endianness == TARGET_LITTLE_ENDIAN;
 	int count = dcc_count;
 	const uint8_t *buffer = dcc_buffer;
-	if (count > 2) {
-		/* Handle first & last using standard embeddedice_write_reg and the middle ones w/the
-		 * core function repeated. */
+
+	struct embeddedice_reg *ice_reg =
+		arm7_9->eice_cache->reg_list[EICE_COMMS_DATA].arch_info;
+	uint8_t reg_addr = ice_reg->addr & 0x1f;
+	struct jtag_tap *tap;
+	tap = ice_reg->jtag_info->tap;
+
+	while (count > 0) {
+		int block = MIN(count, DCC_BLOCK_WORDS);
+
+		/* The first word uses the standard embeddedice_write_reg, which
+		 * selects the scan chain, the others the core function repeated. */
 		embeddedice_write_reg(&arm7_9->eice_cache->reg_list[EICE_COMMS_DATA],
 			fast_target_buffer_get_u32(buffer, little));
 		buffer += 4;
 
-		struct embeddedice_reg *ice_reg =
-			arm7_9->eice_cache->reg_list[EICE_COMMS_DATA].arch_info;
-		uint8_t reg_addr = ice_reg->addr & 0x1f;
-		struct jtag_tap *tap;
-		tap = ice_reg->jtag_info->tap;
+		if (block > 1) {
+			embeddedice_write_dcc(tap, reg_addr, buffer, little, block - 1);
+			buffer += (block - 1) * 4;
+		}
 
-		embeddedice_write_dcc(tap, reg_addr, buffer, little, count-2);
-		buffer += (count-2)*4;
+		count -= block;
 
-		embeddedice_write_reg(&arm7_9->eice_cache->reg_list[EICE_COMMS_DATA],
-			fast_target_buffer_get_u32(buffer, little));
-	} else {
-		int i;
-		for (i = 0; i < count; i++) {
-			embeddedice_write_reg(&arm7_9->eice_cache->reg_list[EICE_COMMS_DATA],
-				fast_target_buffer_get_u32(buffer, little));
-			buffer += 4;
+		/* flush the block, and wait for the target to take its last word */
+		if (count > 0) {
+			retval = embeddedice_handshake(&arm7_9->jtag_info,
+					EICE_COMM_CTRL_RBIT, 1000);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+
+	retval = target_halt(target);
+	if (retval != ERROR_OK)
+		return retval;
+	return target_wait_state(target, TARGET_HALTED, 500);
+}
+
+static int arm7_9_dcc_read_completion(struct target *target,
+	uint32_t exit_point,
+	int timeout_ms,
+	void *arch_info)
+{
+	int retval = ERROR_OK;
+	struct arm7_9_common *arm7_9 = target_to_arm7_9(target);
+
+	retval = target_wait_state(target, TARGET_DEBUG_RUNNING, 500);
+	if (retval != ERROR_OK)
+		return retval;
+
+	int count = dcc_count;
+	uint8_t *buffer = dcc_read_buffer;
+	uint32_t *data = malloc(DCC_BLOCK_WORDS * sizeof(uint32_t));
+	if (!data)
+		return ERROR_FAIL;
+
+	while (count > 0) {
+		int block = MIN(count, DCC_BLOCK_WORDS);
+
+		/* wait for the first word, the target keeps up with the rest */
+		retval = embeddedice_handshake(&arm7_9->jtag_info,
+				EICE_COMM_CTRL_WBIT, 1000);
+		if (retval == ERROR_OK)
+			retval = embeddedice_receive(&arm7_9->jtag_info, data, block);
+		if (retval != ERROR_OK) {
+			free(data);
+			return retval;
 		}
+
+		target_buffer_set_u32_array(target, buffer, block, data);
+		buffer += block * 4;
+		count -= block;
 	}
 
+	free(data);
+
 	retval = target_halt(target);
 	if (retval != ERROR_OK)
 		return retval;
@@ -2644,6 +2699,120 @@ int arm7_9_bulk_write_memory(struct target *target,
 	return retval;
 }
 
+static const uint32_t dcc_read_code[] = {
+	/* r0 == input, points to memory buffer
+	 * r1 == scratch
+	 * r2 == input, end of memory buffer
+	 */
+
+	/* spin until DCC control (c0) reports the host took the last word */
+	0xee101e10,	/* w: mrc p14, #0, r1, c0, c0 */
+	0xe3110002,	/*    tst r1, #2              */
+	0x1afffffc,	/*    bne w                   */
+
+	/* read word from memory, write to DCC (c1) */
+	0xe4901004,	/*    ldr r1, [r0], #4        */
+	0xee011e10,	/*    mcr p14, #0, r1, c1, c0 */
+
+	/* repeat up to the end, don't read past it */
+	0xe1500002,	/*    cmp r0, r2              */
+	0x1afffff8,	/*    bne w                   */
+	0xeafffffe	/* d: b   d                   */
+};
+
+int arm7_9_bulk_read_memory(struct target *target,
+	uint32_t address,
+	uint32_t count,
+	uint8_t *buffer)
+{
+	int retval;
+	struct arm7_9_common *arm7_9 = target_to_arm7_9(target);
+
+	if (address % 4 != 0)
+		return ERROR_TARGET_UNALIGNED_ACCESS;
+
+	if (!arm7_9->dcc_downloads)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* regrab previously allocated working_area, or allocate a new one */
+	if (!arm7_9->dcc_read_working_area) {
+		uint8_t dcc_code_buf[ARRAY_SIZE(dcc_read_code) * 4];
+
+		/* make sure we have a working area */
+		if (target_alloc_working_area(target, sizeof(dcc_code_buf),
+				&arm7_9->dcc_read_working_area) != ERROR_OK) {
+			LOG_INFO("no working area available, falling back to memory reads");
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+
+		/* copy target instructions to target endianness */
+		target_buffer_set_u32_array(target, dcc_code_buf, ARRAY_SIZE(dcc_read_code),
+				dcc_read_code);
+
+		retval = arm7_9_write_memory_no_opt(target,
+				arm7_9->dcc_read_working_area->address, 4,
+				ARRAY_SIZE(dcc_read_code), dcc_code_buf);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	struct arm_algorithm arm_algo;
+	struct reg_param reg_params[2];
+
+	arm_algo.common_magic = ARM_COMMON_MAGIC;
+	arm_algo.core_mode = ARM_MODE_SVC;
+	arm_algo.core_state = ARM_STATE_ARM;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "r2", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, address + count * 4);
+
+	dcc_count = count;
+	dcc_read_buffer = buffer;
+	retval = armv4_5_run_algorithm_inner(target, 0, NULL, 2, reg_params,
+			arm7_9->dcc_read_working_area->address,
+			arm7_9->dcc_read_working_area->address + sizeof(dcc_read_code),
+			20*1000, &arm_algo, arm7_9_dcc_read_completion);
+
+	if (retval == ERROR_OK) {
+		uint32_t endaddress = buf_get_u32(reg_params[0].value, 0, 32);
+		if (endaddress != (address + count*4)) {
+			LOG_ERROR(
+				"DCC read failed, expected end address 0x%08" PRIx32 " got 0x%0" PRIx32 "",
+				(address + count*4),
+				endaddress);
+			retval = ERROR_FAIL;
+		}
+	}
+
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[0]);
+
+	return retval;
+}
+
+int arm7_9_read_memory_opt(struct target *target,
+	uint32_t address,
+	uint32_t size,
+	uint32_t count,
+	uint8_t *buffer)
+{
+	struct arm7_9_common *arm7_9 = target_to_arm7_9(target);
+	int retval;
+
+	if (size == 4 && count > 32 && arm7_9->bulk_read_memory) {
+		/* Attempt to do a bulk read */
+		retval = arm7_9->bulk_read_memory(target, address, count, buffer);
+
+		if (retval == ERROR_OK)
+			return ERROR_OK;
+	}
+
+	return arm7_9_read_memory(target, address, size, count, buffer);
+}
+
 /**
  * Perform per-target setup that requires JTAG access.
  */
@@ -2881,7 +3050,7 @@ static const struct command_registration arm7_9_any_command_handlers[] = {
 		.handler = handle_arm7_9_dcc_downloads_command,
 		.mode = COMMAND_ANY,
 		.usage = "['enable'|'disable']",
-		.help = "use DCC downloads for larger memory writes",
+		.help = "use DCC downloads for larger memory writes and reads",
 	},
 	COMMAND_REGISTRATION_DONE
 };
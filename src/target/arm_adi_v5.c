@@ -677,6 +677,50 @@ int dap_dp_init(struct adiv5_dap *dap)
 	return retval;
 }
 
+/*
+ * TAR wraps at the autoincrement block boundary, so stepping across a
+ * 1 KB or 2 KB boundary inside the AP's ROM table shows how large the
+ * block is. The probe never leaves the 4 KB table, which caps the result.
+ */
+static void mem_ap_detect_tar_autoincr(struct adiv5_ap *ap)
+{
+	struct adiv5_dap *dap = ap->dap;
+	uint32_t base, tar, data;
+	uint32_t block;
+	int retval;
+
+	retval = dap_queue_ap_read(ap, MEM_AP_REG_BASE, &base);
+	if (retval == ERROR_OK)
+		retval = dap_run(dap);
+	/* only an ADIv5 format base with a present entry is safe to read */
+	if (retval != ERROR_OK || (base & 0x3) != 0x3)
+		return;
+	base &= 0xfffff000;
+
+	for (block = 1 << 12; block > 1 << 10; block >>= 1) {
+		uint32_t addr = base + block / 2 - 4;
+
+		retval = mem_ap_setup_transfer(ap, CSW_32BIT | CSW_ADDRINC_SINGLE, addr);
+		if (retval == ERROR_OK)
+			retval = dap_queue_ap_read(ap, MEM_AP_REG_DRW, &data);
+		if (retval == ERROR_OK)
+			retval = dap_queue_ap_read(ap, MEM_AP_REG_TAR, &tar);
+		if (retval == ERROR_OK)
+			retval = dap_run(dap);
+		if (retval != ERROR_OK) {
+			LOG_DEBUG("MEM_AP TAR autoincrement probe failed");
+			return;
+		}
+
+		/* no wrap at block / 2, so the block is at least this large */
+		if (tar == addr + 4)
+			break;
+	}
+
+	ap->tar_autoincr_block = block;
+	LOG_DEBUG("MEM_AP TAR autoincrement block: %" PRIu32 " bytes", block);
+}
+
 /**
  * Initialize a DAP.  This sets up the power domains, prepares the DP
  * for further use, and arranges to use AP #0 for all AP operations
@@ -731,6 +775,10 @@ int mem_ap_init(struct adiv5_ap *ap)
 	LOG_DEBUG("MEM_AP CFG: large data %d, long address %d, big-endian %d",
 			!!(cfg & 0x04), !!(cfg & 0x02), !!(cfg & 0x01));
 
+	/* a larger block means fewer TAR rewrites in long sequential transfers */
+	if (!ap->tar_autoincr_user && !dap->ti_be_32_quirks)
+		mem_ap_detect_tar_autoincr(ap);
+
 	return ERROR_OK;
 }
 
@@ -1457,6 +1505,36 @@ COMMAND_HANDLER(dap_memaccess_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(dap_tar_autoincr_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct arm *arm = target_to_arm(target);
+	struct adiv5_dap *dap = arm->dap;
+	struct adiv5_ap *ap = &dap->ap[dap->apsel];
+
+	uint32_t block;
+
+	switch (CMD_ARGC) {
+	case 0:
+		break;
+	case 1:
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], block);
+		/* a power of two, and the ADI spec guarantees 1 KB */
+		if (block < (1 << 10) || (block & (block - 1)))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		ap->tar_autoincr_block = block;
+		ap->tar_autoincr_user = true;
+		break;
+	default:
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	command_print(CMD_CTX, "TAR autoincrement block %" PRIu32 " bytes%s",
+			ap->tar_autoincr_block, ap->tar_autoincr_user ? "" : " (detected)");
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(dap_apsel_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -1685,6 +1763,14 @@ static const struct command_registration dap_commands[] = {
 			"bus access [0-255]",
 		.usage = "[cycles]",
 	},
+	{
+		.name = "tar_autoincr",
+		.handler = dap_tar_autoincr_command,
+		.mode = COMMAND_EXEC,
+		.help = "set/get the TAR autoincrement block size of the "
+			"currently selected AP, otherwise found by mem_ap_init",
+		.usage = "[bytes]",
+	},
 	{
 		.name = "ti_be_32_quirks",
 		.handler = dap_ti_be_32_quirks_command,
@@ -175,6 +175,9 @@ struct adiv5_ap {
 	/* Size of TAR autoincrement block, ARM ADI Specification requires at least 10 bits */
 	uint32_t tar_autoincr_block;
 
+	/* true if tar_autoincr_block was set by the user and must not be probed */
+	bool tar_autoincr_user;
+
 	/* true if packed transfers are supported by the MEM-AP */
 	bool packed_transfers;
 
@@ -61,6 +61,78 @@ static const int open_modeflags[12] = {
 	O_RDWR | O_CREAT | O_APPEND | O_BINARY
 };
 
+/* Console output is queued and written after the target has been
+ * resumed, so a slow terminal or pipe no longer keeps the core halted.
+ * Writes to regular files still go out at once, as the target may seek
+ * or read them back. */
+#define SEMIHOSTING_OUT_SIZE		(64 * 1024)
+#define SEMIHOSTING_OUT_FLUSH_MS	10
+/* SYS_WRITE0 reads this much of the string at a time */
+#define SEMIHOSTING_WRITE0_CHUNK	64
+
+static uint8_t semihosting_out[SEMIHOSTING_OUT_SIZE];
+static size_t semihosting_out_len;
+static int semihosting_out_fd = -1;
+
+static void semihosting_out_flush(void)
+{
+	size_t done = 0;
+
+	while (done < semihosting_out_len) {
+		ssize_t n = write(semihosting_out_fd, semihosting_out + done,
+				semihosting_out_len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			LOG_ERROR("semihosting: console output lost: %s", strerror(errno));
+			break;
+		}
+		done += n;
+	}
+	semihosting_out_len = 0;
+}
+
+static int semihosting_out_timer(void *priv)
+{
+	if (semihosting_out_len)
+		semihosting_out_flush();
+
+	return ERROR_OK;
+}
+
+/* write or queue len bytes for fd, returns the bytes not written */
+static int semihosting_write(int fd, const uint8_t *buf, size_t len, int *err)
+{
+	static bool timer;
+	struct stat st;
+
+	*err = 0;
+
+	if (fd != semihosting_out_fd && semihosting_out_len)
+		semihosting_out_flush();
+
+	if (fstat(fd, &st) != 0 || S_ISREG(st.st_mode) || len > SEMIHOSTING_OUT_SIZE) {
+		int result = write(fd, buf, len);
+		*err = errno;
+		return result < 0 ? result : (int)(len - result);
+	}
+
+	if (!timer) {
+		target_register_timer_callback(semihosting_out_timer,
+				SEMIHOSTING_OUT_FLUSH_MS, 1, NULL);
+		atexit(semihosting_out_flush);
+		timer = true;
+	}
+
+	if (semihosting_out_len + len > SEMIHOSTING_OUT_SIZE)
+		semihosting_out_flush();
+	memcpy(semihosting_out + semihosting_out_len, buf, len);
+	semihosting_out_len += len;
+	semihosting_out_fd = fd;
+
+	return 0;
+}
+
 static int do_semihosting(struct target *target)
 {
 	struct arm *arm = target_to_arm(target);
@@ -78,6 +150,11 @@ static int do_semihosting(struct target *target)
 	 * TODO: explore mapping requests to GDB's "File-I/O Remote
 	 * Protocol Extension" ... when GDB is active.
 	 */
+	/* anything but more output may depend on the output queued so far,
+	 * a prompt before SYS_READ for one */
+	if (semihosting_out_len && r0 != 0x03 && r0 != 0x04 && r0 != 0x05)
+		semihosting_out_flush();
+
 	switch (r0) {
 	case 0x01:	/* SYS_OPEN */
 		retval = target_read_memory(target, r1, 4, 3, params);
@@ -126,23 +203,30 @@ static int do_semihosting(struct target *target)
 	case 0x03:	/* SYS_WRITEC */
 		{
 			unsigned char c;
+			int err;
 			retval = target_read_memory(target, r1, 1, 1, &c);
 			if (retval != ERROR_OK)
 				return retval;
-			putchar(c);
+			semihosting_write(STDOUT_FILENO, &c, 1, &err);
 			result = 0;
 		}
 		break;
 
 	case 0x04:	/* SYS_WRITE0 */
 		do {
-			unsigned char c;
-			retval = target_read_memory(target, r1++, 1, 1, &c);
+			/* chunks stay within an aligned block, so the read
+			 * does not run past the string into another region */
+			uint8_t chunk[SEMIHOSTING_WRITE0_CHUNK];
+			uint32_t n = SEMIHOSTING_WRITE0_CHUNK - (r1 % SEMIHOSTING_WRITE0_CHUNK);
+			int err;
+			retval = target_read_buffer(target, r1, n, chunk);
 			if (retval != ERROR_OK)
 				return retval;
-			if (!c)
+			uint8_t *end = memchr(chunk, 0, n);
+			semihosting_write(STDOUT_FILENO, chunk, end ? end - chunk : n, &err);
+			if (end)
 				break;
-			putchar(c);
+			r1 += n;
 		} while (1);
 		result = 0;
 		break;
@@ -165,10 +249,7 @@ static int do_semihosting(struct target *target)
 					free(buf);
 					return retval;
 				}
-				result = write(fd, buf, l);
-				arm->semihosting_errno = errno;
-				if (result >= 0)
-					result = l - result;
+				result = semihosting_write(fd, buf, l, &arm->semihosting_errno);
 				free(buf);
 			}
 		}
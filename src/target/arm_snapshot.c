@@ -0,0 +1,299 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "target.h"
+#include "arm.h"
+#include "register.h"
+#include "arm_snapshot.h"
+#include <helper/binarybuffer.h>
+#include <helper/fileio.h>
+#include <helper/time_support.h>
+#include <server/server.h>
+
+/* Memory is read in pieces of SNAPSHOT_PIECE bytes, up to SNAPSHOT_CHUNK
+ * of them in one target_read_memory_multi(); each batch is written out
+ * before the next one is read, the host file buffer overlaps the two. */
+#define SNAPSHOT_PIECE		4096
+#define SNAPSHOT_CHUNK		(64 * 1024)
+
+/* ELF core layout, written field by field in target byte order */
+#define ELF_EHDR_SIZE		52
+#define ELF_PHDR_SIZE		32
+#define ELF_ET_CORE			4
+#define ELF_EM_ARM			40
+#define ELF_PT_LOAD			1
+#define ELF_PT_NOTE			4
+#define ELF_PF_RWX			7
+#define ELF_NT_PRSTATUS		1
+
+/* struct elf_prstatus of 32-bit ARM Linux, which GDB and BFD take:
+ * pr_cursig at 12, pr_pid at 24, pr_reg (r0..r15, cpsr, orig_r0) at 72 */
+#define PRSTATUS_SIZE		148
+#define PRSTATUS_CURSIG		12
+#define PRSTATUS_PID		24
+#define PRSTATUS_REG		72
+#define NOTE_NAME			"CORE"
+#define NOTE_SIZE			(12 + 8 + PRSTATUS_SIZE)
+
+struct snapshot_region {
+	uint32_t address;
+	uint32_t size;
+};
+
+static int snapshot_read_regs(struct target *target, uint8_t *prstatus)
+{
+	struct arm *arm = target_to_arm(target);
+	struct reg *regs[17];
+
+	for (unsigned int i = 0; i < 16; i++)
+		regs[i] = arm_reg_current(arm, i);
+	/* xPSR on M profile */
+	regs[16] = arm->cpsr;
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(regs); i++) {
+		if (!regs[i])
+			return ERROR_FAIL;
+		if (!regs[i]->valid) {
+			int retval = regs[i]->type->get(regs[i]);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		target_buffer_set_u32(target, prstatus + PRSTATUS_REG + 4 * i,
+			buf_get_u32(regs[i]->value, 0, 32));
+	}
+
+	/* SIGTRAP */
+	target_buffer_set_u16(target, prstatus + PRSTATUS_CURSIG, 5);
+	target_buffer_set_u32(target, prstatus + PRSTATUS_PID, 1);
+	return ERROR_OK;
+}
+
+static void snapshot_phdr(struct target *target, uint8_t *phdr, uint32_t type,
+		uint32_t offset, uint32_t address, uint32_t filesz, uint32_t memsz,
+		uint32_t flags)
+{
+	target_buffer_set_u32(target, phdr + 0, type);
+	target_buffer_set_u32(target, phdr + 4, offset);
+	target_buffer_set_u32(target, phdr + 8, address);
+	target_buffer_set_u32(target, phdr + 12, 0);
+	target_buffer_set_u32(target, phdr + 16, filesz);
+	target_buffer_set_u32(target, phdr + 20, memsz);
+	target_buffer_set_u32(target, phdr + 24, flags);
+	target_buffer_set_u32(target, phdr + 28, 4);
+}
+
+/* ELF header, program headers and, with registers, the PRSTATUS note */
+static uint8_t *snapshot_headers(struct target *target,
+		const struct snapshot_region *regions, unsigned int num,
+		const uint8_t *prstatus, size_t *size)
+{
+	unsigned int phnum = num + (prstatus ? 1 : 0);
+	size_t note_offset = ELF_EHDR_SIZE + phnum * ELF_PHDR_SIZE;
+	size_t offset = note_offset + (prstatus ? NOTE_SIZE : 0);
+	uint8_t *buf, *phdr;
+
+	buf = calloc(1, offset);
+	if (!buf)
+		return NULL;
+
+	memcpy(buf, "\177ELF", 4);
+	buf[4] = 1;		/* ELFCLASS32 */
+	buf[5] = (target->endianness == TARGET_BIG_ENDIAN) ? 2 : 1;
+	buf[6] = 1;		/* EV_CURRENT */
+	target_buffer_set_u16(target, buf + 16, ELF_ET_CORE);
+	target_buffer_set_u16(target, buf + 18, ELF_EM_ARM);
+	target_buffer_set_u32(target, buf + 20, 1);
+	target_buffer_set_u32(target, buf + 28, ELF_EHDR_SIZE);
+	target_buffer_set_u16(target, buf + 40, ELF_EHDR_SIZE);
+	target_buffer_set_u16(target, buf + 42, ELF_PHDR_SIZE);
+	target_buffer_set_u16(target, buf + 44, phnum);
+
+	phdr = buf + ELF_EHDR_SIZE;
+	if (prstatus) {
+		uint8_t *note = buf + note_offset;
+
+		snapshot_phdr(target, phdr, ELF_PT_NOTE, note_offset, 0,
+			NOTE_SIZE, 0, 0);
+		phdr += ELF_PHDR_SIZE;
+
+		target_buffer_set_u32(target, note + 0, sizeof(NOTE_NAME));
+		target_buffer_set_u32(target, note + 4, PRSTATUS_SIZE);
+		target_buffer_set_u32(target, note + 8, ELF_NT_PRSTATUS);
+		memcpy(note + 12, NOTE_NAME, sizeof(NOTE_NAME));
+		memcpy(note + 20, prstatus, PRSTATUS_SIZE);
+	}
+
+	for (unsigned int i = 0; i < num; i++) {
+		snapshot_phdr(target, phdr, ELF_PT_LOAD, offset, regions[i].address,
+			regions[i].size, regions[i].size, ELF_PF_RWX);
+		phdr += ELF_PHDR_SIZE;
+		offset += regions[i].size;
+	}
+
+	*size = note_offset + (prstatus ? NOTE_SIZE : 0);
+	return buf;
+}
+
+/* Read the regions in batches and append each to the file */
+static int snapshot_write_memory(struct target *target, struct fileio *fileio,
+		const struct snapshot_region *regions, unsigned int num)
+{
+	struct target_mem_xfer xfers[SNAPSHOT_CHUNK / SNAPSHOT_PIECE];
+	uint8_t *buffer;
+	unsigned int region = 0;
+	uint32_t done = 0;	/* of the current region */
+	int retval = ERROR_OK;
+
+	buffer = malloc(SNAPSHOT_CHUNK);
+	if (!buffer)
+		return ERROR_FAIL;
+
+	while (region < num) {
+		unsigned int n = 0;
+		size_t fill = 0, written;
+
+		if (server_interrupt_requested()) {
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		while (region < num && n < ARRAY_SIZE(xfers)) {
+			uint32_t address = regions[region].address + done;
+			uint32_t len = regions[region].size - done;
+
+			if (len > SNAPSHOT_PIECE)
+				len = SNAPSHOT_PIECE;
+
+			xfers[n].address = address;
+			xfers[n].buffer = buffer + fill;
+			if (address % 4 == 0 && len % 4 == 0) {
+				xfers[n].size = 4;
+				xfers[n].count = len / 4;
+			} else {
+				xfers[n].size = 1;
+				xfers[n].count = len;
+			}
+			n++;
+			fill += len;
+
+			done += len;
+			if (done == regions[region].size) {
+				region++;
+				done = 0;
+			}
+		}
+
+		retval = target_read_memory_multi(target, xfers, n);
+		if (retval != ERROR_OK)
+			break;
+
+		retval = fileio_write(fileio, fill, buffer, &written);
+		if (retval != ERROR_OK)
+			break;
+
+		keep_alive();
+	}
+
+	free(buffer);
+	return retval;
+}
+
+COMMAND_HANDLER(handle_snapshot_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct arm *arm = target_to_arm(target);
+	struct snapshot_region *regions;
+	struct fileio *fileio;
+	struct duration bench;
+	uint8_t prstatus[PRSTATUS_SIZE] = { 0 };
+	bool have_regs = false;
+	uint8_t *headers;
+	size_t headers_size, written, total = 0;
+	unsigned int num;
+	int retval;
+
+	if (CMD_ARGC < 3 || CMD_ARGC % 2 != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!is_arm(arm)) {
+		command_print(CMD_CTX, "current target isn't an ARM");
+		return ERROR_FAIL;
+	}
+
+	num = (CMD_ARGC - 1) / 2;
+	regions = calloc(num, sizeof(*regions));
+	if (!regions)
+		return ERROR_FAIL;
+
+	for (unsigned int i = 0; i < num; i++) {
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1 + 2 * i], regions[i].address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2 + 2 * i], regions[i].size);
+		total += regions[i].size;
+	}
+
+	duration_start(&bench);
+
+	/* memory is read through the AP while the core runs, registers
+	 * only when it is halted */
+	if (target->state == TARGET_HALTED) {
+		retval = snapshot_read_regs(target, prstatus);
+		if (retval != ERROR_OK) {
+			free(regions);
+			return retval;
+		}
+		have_regs = true;
+	} else
+		LOG_INFO("target not halted, no registers in the snapshot");
+
+	headers = snapshot_headers(target, regions, num,
+			have_regs ? prstatus : NULL, &headers_size);
+	if (!headers) {
+		free(regions);
+		return ERROR_FAIL;
+	}
+
+	retval = fileio_open(&fileio, CMD_ARGV[0], FILEIO_WRITE, FILEIO_BINARY);
+	if (retval == ERROR_OK) {
+		retval = fileio_write(fileio, headers_size, headers, &written);
+		if (retval == ERROR_OK)
+			retval = snapshot_write_memory(target, fileio, regions, num);
+		fileio_close(fileio);
+	}
+
+	free(headers);
+	free(regions);
+
+	if ((ERROR_OK == retval) && (duration_measure(&bench) == ERROR_OK))
+		command_print(CMD_CTX,
+				"snapshot of %zu bytes in %fs (%0.3f KiB/s)", total,
+				duration_elapsed(&bench), duration_kbps(&bench, total));
+
+	return retval;
+}
+
+const struct command_registration arm_snapshot_command_handlers[] = {
+	{
+		.name = "snapshot",
+		.handler = handle_snapshot_command,
+		.mode = COMMAND_EXEC,
+		.help = "Write registers and memory regions to an ELF core file",
+		.usage = "filename address size ['address size' ...]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
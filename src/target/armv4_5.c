@@ -34,6 +34,7 @@
 #include <helper/binarybuffer.h>
 #include "algorithm.h"
 #include "register.h"
+#include "arm_snapshot.h"
 
 /* offsets into armv4_5 core register cache */
 enum {
@@ -1110,6 +1111,9 @@ const struct command_registration arm_command_handlers[] = {
 		.usage = "",
 		.chain = arm_exec_command_handlers,
 	},
+	{
+		.chain = arm_snapshot_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
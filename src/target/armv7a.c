@@ -175,6 +175,148 @@ done:
 	return retval;
 }
 
+/* TTBCR, both TTBRs and CONTEXTIDR, once per halt */
+static int armv7a_tlb_read_context(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	struct armv7a_mmu_common *mmu = &armv7a->armv7a_mmu;
+	struct arm_dpm *dpm = armv7a->arm.dpm;
+	uint32_t ttbcr;
+	int retval;
+
+	retval = dpm->prepare(dpm);
+	if (retval != ERROR_OK)
+		goto done;
+
+	/*  MRC p15,0,<Rt>,c2,c0,2 ; Read CP15 Translation Table Base Control Register*/
+	retval = dpm->instr_read_data_r0(dpm,
+			ARMV4_5_MRC(15, 0, 0, 2, 0, 2),
+			&ttbcr);
+	if (retval != ERROR_OK)
+		goto done;
+
+	for (int i = 0; i < 2; i++) {
+		/*  MRC p15,0,<Rt>,c2,c0,i */
+		retval = dpm->instr_read_data_r0(dpm,
+				ARMV4_5_MRC(15, 0, 0, 2, 0, i),
+				&mmu->tlb_ttbr[i]);
+		if (retval != ERROR_OK)
+			goto done;
+	}
+
+	/*  MRC p15,0,<Rt>,c13,c0,1 ; Read CP15 Context ID Register */
+	retval = dpm->instr_read_data_r0(dpm,
+			ARMV4_5_MRC(15, 0, 0, 13, 0, 1),
+			&mmu->tlb_contextidr);
+
+done:
+	dpm->finish(dpm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if ((mmu->cached == 0) || (mmu->ttbcr != ttbcr)) {
+		retval = armv7a_read_ttbcr(target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	mmu->tlb_ctx_valid = true;
+	return ERROR_OK;
+}
+
+static struct armv7a_tlb_entry *armv7a_tlb_find(struct armv7a_mmu_common *mmu,
+	uint32_t ttb, uint32_t asid, uint32_t va)
+{
+	for (unsigned int i = 0; i < mmu->tlb_count; i++) {
+		struct armv7a_tlb_entry *e = &mmu->tlb[i];
+
+		if (e->ttb == ttb && e->asid == asid && (va & e->mask) == e->va)
+			return e;
+	}
+	return NULL;
+}
+
+static uint32_t armv7a_tlb_ttb(struct armv7a_mmu_common *mmu, uint32_t va)
+{
+	return mmu->tlb_ttbr[(va > mmu->ttbr_range[0]) ? 1 : 0];
+}
+
+/* Translation of va from the host side TLB, *hit is false if there is
+ * none. Costs target accesses only on the first call after a halt. */
+int armv7a_tlb_lookup(struct target *target, uint32_t va, uint32_t *pa,
+	bool *hit)
+{
+	struct armv7a_mmu_common *mmu = &target_to_armv7a(target)->armv7a_mmu;
+	struct armv7a_tlb_entry *e;
+
+	*hit = false;
+	if (!mmu->tlb_ctx_valid) {
+		int retval = armv7a_tlb_read_context(target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	e = armv7a_tlb_find(mmu, armv7a_tlb_ttb(mmu, va),
+			mmu->tlb_contextidr & 0xff, va);
+	if (e) {
+		*pa = e->pa | (va & ~e->mask);
+		*hit = true;
+	}
+	return ERROR_OK;
+}
+
+/* Remember a translation, mask covers the section or page it is in */
+void armv7a_tlb_insert(struct target *target, uint32_t va, uint32_t pa,
+	uint32_t mask)
+{
+	struct armv7a_mmu_common *mmu = &target_to_armv7a(target)->armv7a_mmu;
+	uint32_t ttb, asid;
+	struct armv7a_tlb_entry *e;
+
+	if (!mmu->tlb_ctx_valid)
+		return;
+
+	ttb = armv7a_tlb_ttb(mmu, va);
+	asid = mmu->tlb_contextidr & 0xff;
+	e = armv7a_tlb_find(mmu, ttb, asid, va);
+	if (!e) {
+		if (mmu->tlb_count < ARMV7A_TLB_ENTRIES)
+			e = &mmu->tlb[mmu->tlb_count++];
+		else {
+			e = &mmu->tlb[mmu->tlb_next];
+			mmu->tlb_next = (mmu->tlb_next + 1) % ARMV7A_TLB_ENTRIES;
+		}
+	}
+
+	e->ttb = ttb;
+	e->asid = asid;
+	e->mask = mask;
+	e->va = va & mask;
+	e->pa = pa & mask;
+}
+
+/* The core ran: tables, TTBRs and ASID may all have changed */
+void armv7a_tlb_invalidate(struct target *target)
+{
+	struct armv7a_mmu_common *mmu = &target_to_armv7a(target)->armv7a_mmu;
+
+	mmu->tlb_count = 0;
+	mmu->tlb_next = 0;
+	mmu->tlb_ctx_valid = false;
+}
+
+/* The debugger wrote CP15 register CRn. A new TTBR, TTBCR or CONTEXTIDR
+ * only selects other entries, TLB maintenance drops them all. */
+void armv7a_tlb_cp15_written(struct target *target, uint32_t CRn)
+{
+	struct armv7a_mmu_common *mmu = &target_to_armv7a(target)->armv7a_mmu;
+
+	if (CRn == 2 || CRn == 13)
+		mmu->tlb_ctx_valid = false;
+	else if (CRn == 8)
+		armv7a_tlb_invalidate(target);
+}
+
 /*  method adapted to Cortex-A : reused ARM v4 v5 method */
 int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 {
@@ -242,6 +384,7 @@ int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 	if ((first_lvl_descriptor & 0x40002) == 2) {
 		/* section descriptor */
 		*val = (first_lvl_descriptor & 0xfff00000) | (va & 0x000fffff);
+		armv7a_tlb_insert(target, va, *val, 0xfff00000);
 		return ERROR_OK;
 	} else if ((first_lvl_descriptor & 0x40002) == 0x40002) {
 		/* supersection descriptor */
@@ -250,6 +393,7 @@ int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 			return ERROR_TARGET_TRANSLATION_FAULT;
 		}
 		*val = (first_lvl_descriptor & 0xff000000) | (va & 0x00ffffff);
+		armv7a_tlb_insert(target, va, *val, 0xff000000);
 		return ERROR_OK;
 	}
 
@@ -273,9 +417,11 @@ int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 	if ((second_lvl_descriptor & 0x3) == 1) {
 		/* large page descriptor */
 		*val = (second_lvl_descriptor & 0xffff0000) | (va & 0x0000ffff);
+		armv7a_tlb_insert(target, va, *val, 0xffff0000);
 	} else {
 		/* small page descriptor */
 		*val = (second_lvl_descriptor & 0xfffff000) | (va & 0x00000fff);
+		armv7a_tlb_insert(target, va, *val, 0xfffff000);
 	}
 
 	return ERROR_OK;
@@ -68,6 +68,14 @@ struct armv7a_arch_cache {
 	struct armv7a_cachesize i_size;		/* instruction cache */
 };
 
+/* a range of virtual addresses written by the debugger */
+struct armv7a_cache_range {
+	uint32_t start;
+	uint32_t end;
+};
+
+#define ARMV7A_CACHE_DIRTY_RANGES	16
+
 /* common cache information */
 struct armv7a_cache_common {
 	int info;				/* -1 invalid, else valid */
@@ -82,8 +90,23 @@ struct armv7a_cache_common {
 	/* outer unified cache if some */
 	void *outer_cache;
 	int (*flush_all_data_cache)(struct target *target);
+	/* ranges to clean and invalidate at the next armv7a_cache_sync() */
+	struct armv7a_cache_range dirty[ARMV7A_CACHE_DIRTY_RANGES];
+	unsigned int dirty_count;
+	bool dirty_all;				/* too many ranges, whole caches */
 };
 
+/* a translation found while halted, for the table at ttb and this ASID */
+struct armv7a_tlb_entry {
+	uint32_t ttb;
+	uint32_t asid;
+	uint32_t va;				/* va & mask */
+	uint32_t mask;				/* of the section or page */
+	uint32_t pa;				/* pa & mask */
+};
+
+#define ARMV7A_TLB_ENTRIES	32
+
 struct armv7a_mmu_common {
 	/* following field mmu working way */
 	int32_t cached;     /* 0: not initialized, 1: initialized */
@@ -95,6 +118,14 @@ struct armv7a_mmu_common {
 			uint32_t count, uint8_t *buffer);
 	struct armv7a_cache_common armv7a_cache;
 	uint32_t mmu_enabled;
+
+	/* host side TLB, emptied when the core runs */
+	struct armv7a_tlb_entry tlb[ARMV7A_TLB_ENTRIES];
+	unsigned int tlb_count;
+	unsigned int tlb_next;			/* next one to replace */
+	bool tlb_ctx_valid;			/* ttbr and contextidr read */
+	uint32_t tlb_ttbr[2];
+	uint32_t tlb_contextidr;
 };
 
 struct armv7a_common {
@@ -178,6 +209,12 @@ int armv7a_init_arch_info(struct target *target, struct armv7a_common *armv7a);
 int armv7a_mmu_translate_va_pa(struct target *target, uint32_t va,
 		uint32_t *val, int meminfo);
 int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val);
+int armv7a_tlb_lookup(struct target *target, uint32_t va, uint32_t *pa,
+		bool *hit);
+void armv7a_tlb_insert(struct target *target, uint32_t va, uint32_t pa,
+		uint32_t mask);
+void armv7a_tlb_invalidate(struct target *target);
+void armv7a_tlb_cp15_written(struct target *target, uint32_t CRn);
 
 int armv7a_handle_cache_info_command(struct command_context *cmd_ctx,
 		struct armv7a_cache_common *armv7a_cache);
@@ -367,6 +367,8 @@ int armv7a_l1_i_cache_inval_virt(struct target *target, uint32_t virt,
 			goto done;
 		va_line += linelen;
 	}
+
+	dpm->finish(dpm);
 	return retval;
 
 done:
@@ -406,6 +408,86 @@ int armv7a_cache_auto_flush_on_write(struct target *target, uint32_t virt,
 	return armv7a_cache_flush_virt(target, virt, size);
 }
 
+/*
+ * Note a range written through the core. Its cache lines are cleaned and
+ * invalidated by armv7a_cache_sync() when the core resumes, once for all
+ * the writes since the previous resume, instead of after each write.
+ */
+void armv7a_cache_mark_dirty(struct target *target, uint32_t virt,
+				uint32_t size)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	struct armv7a_cache_common *cache = &armv7a->armv7a_mmu.armv7a_cache;
+	uint32_t linelen = MAX(MAX(cache->dminline, cache->iminline), 4U);
+	uint32_t start, end;
+	unsigned int i;
+
+	if (!size || cache->dirty_all)
+		return;
+
+	/* whole lines, ranges within a line of each other are merged */
+	start = virt & -linelen;
+	end = virt + size - 1;
+	if (end < virt)
+		end = UINT32_MAX;
+	end |= linelen - 1;
+
+	i = 0;
+	while (i < cache->dirty_count) {
+		struct armv7a_cache_range *r = &cache->dirty[i];
+
+		if (start > r->end + 1 + linelen || r->start > end + 1 + linelen) {
+			i++;
+			continue;
+		}
+
+		/* take it into the new range, then look again */
+		start = MIN(start, r->start);
+		end = MAX(end, r->end);
+		*r = cache->dirty[--cache->dirty_count];
+		i = 0;
+	}
+
+	if (cache->dirty_count == ARMV7A_CACHE_DIRTY_RANGES) {
+		cache->dirty_all = true;
+		return;
+	}
+
+	cache->dirty[cache->dirty_count].start = start;
+	cache->dirty[cache->dirty_count].end = end;
+	cache->dirty_count++;
+}
+
+/* Clean and invalidate the data caches and invalidate the instruction
+ * cache for the ranges marked dirty, with the target still halted */
+int armv7a_cache_sync(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	struct armv7a_cache_common *cache = &armv7a->armv7a_mmu.armv7a_cache;
+
+	if (cache->dirty_all) {
+		LOG_DEBUG("flushing all caches");
+		armv7a_l1_d_cache_clean_inval_all(target);
+		arm7a_l2x_flush_all_data(target);
+		armv7a_l1_i_cache_inval_all(target);
+	} else {
+		for (unsigned int i = 0; i < cache->dirty_count; i++) {
+			struct armv7a_cache_range *r = &cache->dirty[i];
+			uint32_t size = r->end - r->start + 1;
+
+			LOG_DEBUG("flushing 0x%08" PRIx32 " size 0x%" PRIx32, r->start, size);
+			armv7a_cache_flush_virt(target, r->start, size);
+			armv7a_l1_i_cache_inval_virt(target, r->start, size);
+		}
+	}
+
+	cache->dirty_count = 0;
+	cache->dirty_all = false;
+
+	/* a cache that is off has nothing to maintain, errors are logged */
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(arm7a_l1_cache_info_cmd)
 {
 	struct target *target = get_current_target(CMD_CTX);
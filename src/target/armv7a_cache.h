@@ -36,6 +36,9 @@ int armv7a_cache_auto_flush_on_write(struct target *target, uint32_t virt,
 int armv7a_cache_auto_flush_all_data(struct target *target);
 int armv7a_cache_flush_virt(struct target *target, uint32_t virt,
 				uint32_t size);
+void armv7a_cache_mark_dirty(struct target *target, uint32_t virt,
+				uint32_t size);
+int armv7a_cache_sync(struct target *target);
 extern const struct command_registration arm7a_cache_command_handlers[];
 
 /* CLIDR cache types */
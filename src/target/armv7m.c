@@ -35,6 +35,7 @@
 
 #include "breakpoints.h"
 #include "armv7m.h"
+#include "armv7m_coverage.h"
 #include "algorithm.h"
 #include "register.h"
 
@@ -131,6 +132,87 @@ static const struct {
 
 #define ARMV7M_NUM_REGS ARRAY_SIZE(armv7m_regs)
 
+/* DCRSR selectors of the registers that can be written without a
+ * read-modify-write, in the same order armv7m_restore_context() uses */
+#define ARMV7M_REGSEL_FPSCR	33
+#define ARMV7M_REGSEL_S0	64
+#define ARMV7M_REGSEL_MAX	96
+
+/**
+ * Writes the dirty core and FPU registers through the core's bulk
+ * register write.  PRIMASK, BASEPRI, FAULTMASK and CONTROL share one
+ * selector and are written first, one by one, since CONTROL picks the
+ * stack pointer that R13 lands in.  Whatever is still dirty on failure
+ * is left for the caller's register by register loop.
+ */
+static int armv7m_restore_context_bulk(struct target *target)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	uint32_t regsel[ARMV7M_REGSEL_MAX];
+	uint32_t values[ARMV7M_REGSEL_MAX];
+	unsigned int count = 0;
+	int i;
+
+	for (i = cache->num_regs - 1; i >= 0; i--) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+
+		if (!r->dirty)
+			continue;
+
+		switch (arm_reg->num) {
+		case ARMV7M_R0 ... ARMV7M_PSP:
+			regsel[count] = arm_reg->num;
+			values[count++] = buf_get_u32(r->value, 0, 32);
+			break;
+		case ARMV7M_D0 ... ARMV7M_D15:
+			regsel[count] = ARMV7M_REGSEL_S0 + 2 * (arm_reg->num - ARMV7M_D0) + 1;
+			values[count++] = buf_get_u32(r->value + 4, 0, 32);
+			regsel[count] = ARMV7M_REGSEL_S0 + 2 * (arm_reg->num - ARMV7M_D0);
+			values[count++] = buf_get_u32(r->value, 0, 32);
+			break;
+		case ARMV7M_FPSCR:
+			regsel[count] = ARMV7M_REGSEL_FPSCR;
+			values[count++] = buf_get_u32(r->value, 0, 32);
+			break;
+		default:
+			armv7m->arm.write_core_reg(target, r, i, ARM_MODE_ANY, r->value);
+			break;
+		}
+	}
+
+	if (!count)
+		return ERROR_OK;
+
+	int retval = armv7m->store_core_reg_list(target, regsel, values, count);
+	if (retval != ERROR_OK) {
+		LOG_DEBUG("bulk register write failed, writing registers one by one");
+		return retval;
+	}
+
+	for (i = cache->num_regs - 1; i >= 0; i--) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+
+		if (!r->dirty)
+			continue;
+
+		switch (arm_reg->num) {
+		case ARMV7M_R0 ... ARMV7M_PSP:
+		case ARMV7M_D0 ... ARMV7M_D15:
+		case ARMV7M_FPSCR:
+			r->valid = 1;
+			r->dirty = 0;
+			break;
+		}
+	}
+
+	LOG_DEBUG("wrote %u core registers in bulk", count);
+
+	return ERROR_OK;
+}
+
 /**
  * Restores target context using the cache of core registers set up
  * by armv7m_build_reg_cache(), calling optional core-specific hooks.
@@ -146,6 +228,9 @@ int armv7m_restore_context(struct target *target)
 	if (armv7m->pre_restore_context)
 		armv7m->pre_restore_context(target);
 
+	if (armv7m->store_core_reg_list)
+		armv7m_restore_context_bulk(target);
+
 	for (i = cache->num_regs - 1; i >= 0; i--) {
 		if (cache->reg_list[i].dirty) {
 			armv7m->arm.write_core_reg(target, &cache->reg_list[i], i,
@@ -339,6 +424,131 @@ int armv7m_run_algorithm(struct target *target,
 	return retval;
 }
 
+/* Save the registers and switch to the core mode the algorithm asks
+ * for, armv7m_algorithm_info->core_mode then holds the mode to go back to */
+static void armv7m_save_algorithm_context(struct target *target,
+	struct armv7m_algorithm *armv7m_algorithm_info)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	enum arm_mode core_mode = armv7m->arm.core_mode;
+
+	/* refresh core register cache
+	 * Not needed if core register cache is always consistent with target process state */
+	for (unsigned i = 0; i < armv7m->arm.core_cache->num_regs; i++) {
+
+		armv7m_algorithm_info->context[i] = buf_get_u32(
+				armv7m->arm.core_cache->reg_list[i].value,
+				0,
+				32);
+	}
+
+	if (armv7m_algorithm_info->core_mode != ARM_MODE_ANY &&
+			armv7m_algorithm_info->core_mode != core_mode) {
+
+		/* we cannot set ARM_MODE_HANDLER, so use ARM_MODE_THREAD instead */
+		if (armv7m_algorithm_info->core_mode == ARM_MODE_HANDLER) {
+			armv7m_algorithm_info->core_mode = ARM_MODE_THREAD;
+			LOG_INFO("ARM_MODE_HANDLER not currently supported, using ARM_MODE_THREAD instead");
+		}
+
+		LOG_DEBUG("setting core_mode: 0x%2.2x", armv7m_algorithm_info->core_mode);
+		buf_set_u32(armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].value,
+			0, 1, armv7m_algorithm_info->core_mode);
+		armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].dirty = 1;
+		armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].valid = 1;
+	}
+
+	/* save previous core mode */
+	armv7m_algorithm_info->core_mode = core_mode;
+}
+
+/* Put back what armv7m_save_algorithm_context() saved, the registers
+ * are written when the core is resumed */
+static void armv7m_restore_algorithm_context(struct target *target,
+	struct armv7m_algorithm *armv7m_algorithm_info)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	for (int i = armv7m->arm.core_cache->num_regs - 1; i >= 0; i--) {
+		uint32_t regvalue;
+		regvalue = buf_get_u32(armv7m->arm.core_cache->reg_list[i].value, 0, 32);
+		if (regvalue != armv7m_algorithm_info->context[i]) {
+			LOG_DEBUG("restoring register %s with value 0x%8.8" PRIx32,
+					armv7m->arm.core_cache->reg_list[i].name,
+				armv7m_algorithm_info->context[i]);
+			buf_set_u32(armv7m->arm.core_cache->reg_list[i].value,
+				0, 32, armv7m_algorithm_info->context[i]);
+			armv7m->arm.core_cache->reg_list[i].valid = 1;
+			armv7m->arm.core_cache->reg_list[i].dirty = 1;
+		}
+	}
+
+	/* restore previous core mode */
+	if (armv7m_algorithm_info->core_mode != armv7m->arm.core_mode) {
+		LOG_DEBUG("restoring core_mode: 0x%2.2x", armv7m_algorithm_info->core_mode);
+		buf_set_u32(armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].value,
+			0, 1, armv7m_algorithm_info->core_mode);
+		armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].dirty = 1;
+		armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].valid = 1;
+	}
+
+	armv7m->arm.core_mode = armv7m_algorithm_info->core_mode;
+}
+
+/**
+ * Opens an algorithm session for loaders that are run many times in a
+ * row.  The context is saved here once; until the session is ended,
+ * runs with the same @a arch_info leave the registers as the algorithm
+ * left them and only write the register parameters that changed.
+ */
+int armv7m_begin_algorithm_session(struct target *target, void *arch_info)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_algorithm *armv7m_algorithm_info = arch_info;
+
+	if (armv7m_algorithm_info->common_magic != ARMV7M_COMMON_MAGIC) {
+		LOG_ERROR("current target isn't an ARMV7M target");
+		return ERROR_TARGET_INVALID;
+	}
+
+	if (target->state != TARGET_HALTED) {
+		LOG_WARNING("target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	if (armv7m->algorithm_session) {
+		LOG_ERROR("BUG: algorithm session already open");
+		return ERROR_FAIL;
+	}
+
+	armv7m_save_algorithm_context(target, armv7m_algorithm_info);
+	armv7m->algorithm_session = armv7m_algorithm_info;
+
+	return ERROR_OK;
+}
+
+/** Closes the session, restoring the context saved when it was opened. */
+int armv7m_end_algorithm_session(struct target *target, void *arch_info)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	if (armv7m->algorithm_session != arch_info) {
+		LOG_ERROR("BUG: no such algorithm session");
+		return ERROR_FAIL;
+	}
+
+	armv7m->algorithm_session = NULL;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_WARNING("target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	armv7m_restore_algorithm_context(target, arch_info);
+
+	return ERROR_OK;
+}
+
 /** Starts a Thumb algorithm in the target. */
 int armv7m_start_algorithm(struct target *target,
 	int num_mem_params, struct mem_param *mem_params,
@@ -348,7 +558,7 @@ int armv7m_start_algorithm(struct target *target,
 {
 	struct armv7m_common *armv7m = target_to_armv7m(target);
 	struct armv7m_algorithm *armv7m_algorithm_info = arch_info;
-	enum arm_mode core_mode = armv7m->arm.core_mode;
+	bool resident = armv7m->algorithm_session == armv7m_algorithm_info;
 	int retval = ERROR_OK;
 
 	/* NOTE: armv7m_run_algorithm requires that each algorithm uses a software breakpoint
@@ -364,15 +574,8 @@ int armv7m_start_algorithm(struct target *target,
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
-	/* refresh core register cache
-	 * Not needed if core register cache is always consistent with target process state */
-	for (unsigned i = 0; i < armv7m->arm.core_cache->num_regs; i++) {
-
-		armv7m_algorithm_info->context[i] = buf_get_u32(
-				armv7m->arm.core_cache->reg_list[i].value,
-				0,
-				32);
-	}
+	if (!resident)
+		armv7m_save_algorithm_context(target, armv7m_algorithm_info);
 
 	for (int i = 0; i < num_mem_params; i++) {
 		/* TODO: Write only out params */
@@ -400,28 +603,14 @@ int armv7m_start_algorithm(struct target *target,
 		}
 
 /*		regvalue = buf_get_u32(reg_params[i].value, 0, 32); */
-		armv7m_set_core_reg(reg, reg_params[i].value);
-	}
-
-	if (armv7m_algorithm_info->core_mode != ARM_MODE_ANY &&
-			armv7m_algorithm_info->core_mode != core_mode) {
-
-		/* we cannot set ARM_MODE_HANDLER, so use ARM_MODE_THREAD instead */
-		if (armv7m_algorithm_info->core_mode == ARM_MODE_HANDLER) {
-			armv7m_algorithm_info->core_mode = ARM_MODE_THREAD;
-			LOG_INFO("ARM_MODE_HANDLER not currently supported, using ARM_MODE_THREAD instead");
-		}
+		/* within a session the register may still hold the value */
+		if (resident && reg->valid &&
+				!buf_cmp(reg->value, reg_params[i].value, reg->size))
+			continue;
 
-		LOG_DEBUG("setting core_mode: 0x%2.2x", armv7m_algorithm_info->core_mode);
-		buf_set_u32(armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].value,
-			0, 1, armv7m_algorithm_info->core_mode);
-		armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].dirty = 1;
-		armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].valid = 1;
+		armv7m_set_core_reg(reg, reg_params[i].value);
 	}
 
-	/* save previous core mode */
-	armv7m_algorithm_info->core_mode = core_mode;
-
 	retval = target_resume(target, 0, entry_point, 1, 1);
 
 	return retval;
@@ -447,7 +636,9 @@ int armv7m_wait_algorithm(struct target *target,
 		return ERROR_TARGET_INVALID;
 	}
 
-	retval = target_wait_state(target, TARGET_HALTED, timeout_ms);
+	retval = target_wait_state_expected(target, TARGET_HALTED, timeout_ms,
+			target->algorithm_expected_ms);
+	target->algorithm_expected_ms = 0;
 	/* If the target fails to halt due to the breakpoint, force a halt */
 	if (retval != ERROR_OK || target->state != TARGET_HALTED) {
 		retval = target_halt(target);
@@ -501,30 +692,9 @@ int armv7m_wait_algorithm(struct target *target,
 		}
 	}
 
-	for (int i = armv7m->arm.core_cache->num_regs - 1; i >= 0; i--) {
-		uint32_t regvalue;
-		regvalue = buf_get_u32(armv7m->arm.core_cache->reg_list[i].value, 0, 32);
-		if (regvalue != armv7m_algorithm_info->context[i]) {
-			LOG_DEBUG("restoring register %s with value 0x%8.8" PRIx32,
-					armv7m->arm.core_cache->reg_list[i].name,
-				armv7m_algorithm_info->context[i]);
-			buf_set_u32(armv7m->arm.core_cache->reg_list[i].value,
-				0, 32, armv7m_algorithm_info->context[i]);
-			armv7m->arm.core_cache->reg_list[i].valid = 1;
-			armv7m->arm.core_cache->reg_list[i].dirty = 1;
-		}
-	}
-
-	/* restore previous core mode */
-	if (armv7m_algorithm_info->core_mode != armv7m->arm.core_mode) {
-		LOG_DEBUG("restoring core_mode: 0x%2.2x", armv7m_algorithm_info->core_mode);
-		buf_set_u32(armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].value,
-			0, 1, armv7m_algorithm_info->core_mode);
-		armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].dirty = 1;
-		armv7m->arm.core_cache->reg_list[ARMV7M_CONTROL].valid = 1;
-	}
-
-	armv7m->arm.core_mode = armv7m_algorithm_info->core_mode;
+	/* the session keeps the algorithm's registers until it ends */
+	if (armv7m->algorithm_session != armv7m_algorithm_info)
+		armv7m_restore_algorithm_context(target, armv7m_algorithm_info);
 
 	return retval;
 }
@@ -681,23 +851,30 @@ int armv7m_init_arch_info(struct target *target, struct armv7m_common *armv7m)
 int armv7m_checksum_memory(struct target *target,
 	uint32_t address, uint32_t count, uint32_t *checksum)
 {
+	struct armv7m_common *armv7m = target_to_armv7m(target);
 	struct working_area *crc_algorithm;
 	struct armv7m_algorithm armv7m_info;
 	struct reg_param reg_params[2];
+	bool fresh;
 	int retval;
 
 	static const uint8_t cortex_m_crc_code[] = {
 #include "../../contrib/loaders/checksum/armv7m_crc.inc"
 	};
 
-	retval = target_alloc_working_area(target, sizeof(cortex_m_crc_code), &crc_algorithm);
+	/* kept loaded while the target stays halted, verify runs it per section */
+	retval = target_alloc_working_area_pinned(target, "armv7m crc",
+			sizeof(cortex_m_crc_code), &armv7m->crc_algorithm, &fresh);
 	if (retval != ERROR_OK)
 		return retval;
+	crc_algorithm = armv7m->crc_algorithm;
 
-	retval = target_write_buffer(target, crc_algorithm->address,
-			sizeof(cortex_m_crc_code), (uint8_t *)cortex_m_crc_code);
-	if (retval != ERROR_OK)
-		goto cleanup;
+	if (fresh) {
+		retval = target_write_buffer(target, crc_algorithm->address,
+				sizeof(cortex_m_crc_code), (uint8_t *)cortex_m_crc_code);
+		if (retval != ERROR_OK)
+			goto cleanup;
+	}
 
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
 	armv7m_info.core_mode = ARM_MODE_THREAD;
@@ -710,8 +887,9 @@ int armv7m_checksum_memory(struct target *target,
 
 	int timeout = 20000 * (1 + (count / (1024 * 1024)));
 
+	/* the bkpt is followed by the 16 word nibble table */
 	retval = target_run_algorithm(target, 0, NULL, 2, reg_params, crc_algorithm->address,
-			crc_algorithm->address + (sizeof(cortex_m_crc_code) - 6),
+			crc_algorithm->address + (sizeof(cortex_m_crc_code) - (16 * 4 + 2)),
 			timeout, &armv7m_info);
 
 	if (retval == ERROR_OK)
@@ -723,7 +901,90 @@ int armv7m_checksum_memory(struct target *target,
 	destroy_reg_param(&reg_params[1]);
 
 cleanup:
-	target_free_working_area(target, crc_algorithm);
+	if (retval != ERROR_OK)
+		target_free_working_area(target, crc_algorithm);
+
+	return retval;
+}
+
+/** Computes the CRC of count chunk_size byte chunks in one algorithm run. */
+int armv7m_checksum_memory_chunks(struct target *target, uint32_t address,
+		uint32_t chunk_size, uint32_t count, uint32_t *checksums)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct working_area *crc_algorithm;
+	struct working_area *results;
+	struct armv7m_algorithm armv7m_info;
+	struct reg_param reg_params[4];
+	bool fresh;
+	int retval;
+
+	static const uint8_t cortex_m_crc_chunks_code[] = {
+#include "../../contrib/loaders/checksum/armv7m_crc_chunks.inc"
+	};
+
+	if (count == 0 || chunk_size == 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	retval = target_alloc_working_area_pinned(target, "armv7m crc chunks",
+			sizeof(cortex_m_crc_chunks_code), &armv7m->crc_chunks_algorithm, &fresh);
+	if (retval != ERROR_OK)
+		return retval;
+	crc_algorithm = armv7m->crc_chunks_algorithm;
+
+	if (fresh) {
+		retval = target_write_buffer(target, crc_algorithm->address,
+				sizeof(cortex_m_crc_chunks_code), (uint8_t *)cortex_m_crc_chunks_code);
+		if (retval != ERROR_OK) {
+			target_free_working_area(target, crc_algorithm);
+			return retval;
+		}
+	}
+
+	retval = target_alloc_working_area(target, count * 4, &results);
+	if (retval != ERROR_OK)
+		return retval;
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, chunk_size);
+	buf_set_u32(reg_params[2].value, 0, 32, count);
+	buf_set_u32(reg_params[3].value, 0, 32, results->address);
+
+	uint64_t total = (uint64_t)chunk_size * count;
+	int timeout = 20000 * (1 + (total / (1024 * 1024)));
+
+	/* the bkpt is followed by the 16 word nibble table */
+	retval = target_run_algorithm(target, 0, NULL, 4, reg_params, crc_algorithm->address,
+			crc_algorithm->address + (sizeof(cortex_m_crc_chunks_code) - (16 * 4 + 2)),
+			timeout, &armv7m_info);
+
+	if (retval == ERROR_OK) {
+		uint8_t *buffer = malloc(count * 4);
+		if (buffer == NULL) {
+			retval = ERROR_FAIL;
+		} else {
+			retval = target_read_buffer(target, results->address, count * 4, buffer);
+			for (uint32_t i = 0; retval == ERROR_OK && i < count; i++)
+				checksums[i] = target_buffer_get_u32(target, buffer + 4 * i);
+			free(buffer);
+		}
+	} else {
+		LOG_ERROR("error executing cortex_m crc algorithm");
+		target_free_working_area(target, crc_algorithm);
+	}
+
+	for (int i = 0; i < 4; i++)
+		destroy_reg_param(&reg_params[i]);
+
+	target_free_working_area(target, results);
 
 	return retval;
 }
@@ -732,24 +993,29 @@ cleanup:
 int armv7m_blank_check_memory(struct target *target,
 	uint32_t address, uint32_t count, uint32_t *blank)
 {
+	struct armv7m_common *armv7m = target_to_armv7m(target);
 	struct working_area *erase_check_algorithm;
 	struct reg_param reg_params[3];
 	struct armv7m_algorithm armv7m_info;
+	bool fresh;
 	int retval;
 
 	static const uint8_t erase_check_code[] = {
 #include "../../contrib/loaders/erase_check/armv7m_erase_check.inc"
 	};
 
-	/* make sure we have a working area */
-	if (target_alloc_working_area(target, sizeof(erase_check_code),
-		&erase_check_algorithm) != ERROR_OK)
+	/* make sure we have a working area, kept for the following sectors */
+	if (target_alloc_working_area_pinned(target, "armv7m erase check",
+			sizeof(erase_check_code), &armv7m->erase_check_algorithm, &fresh) != ERROR_OK)
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	erase_check_algorithm = armv7m->erase_check_algorithm;
 
-	retval = target_write_buffer(target, erase_check_algorithm->address,
-			sizeof(erase_check_code), (uint8_t *)erase_check_code);
-	if (retval != ERROR_OK)
-		goto cleanup;
+	if (fresh) {
+		retval = target_write_buffer(target, erase_check_algorithm->address,
+				sizeof(erase_check_code), (uint8_t *)erase_check_code);
+		if (retval != ERROR_OK)
+			goto cleanup;
+	}
 
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
 	armv7m_info.core_mode = ARM_MODE_THREAD;
@@ -763,6 +1029,9 @@ int armv7m_blank_check_memory(struct target *target,
 	init_reg_param(&reg_params[2], "r2", 32, PARAM_IN_OUT);
 	buf_set_u32(reg_params[2].value, 0, 32, 0xff);
 
+	/* scale with the size like the crc, big sectors on a slow M0 take a while */
+	int timeout = 10000 * (1 + (count / (1024 * 1024)));
+
 	retval = target_run_algorithm(target,
 			0,
 			NULL,
@@ -770,7 +1039,7 @@ int armv7m_blank_check_memory(struct target *target,
 			reg_params,
 			erase_check_algorithm->address,
 			erase_check_algorithm->address + (sizeof(erase_check_code) - 2),
-			10000,
+			timeout,
 			&armv7m_info);
 
 	if (retval == ERROR_OK)
@@ -781,7 +1050,109 @@ int armv7m_blank_check_memory(struct target *target,
 	destroy_reg_param(&reg_params[2]);
 
 cleanup:
-	target_free_working_area(target, erase_check_algorithm);
+	if (retval != ERROR_OK)
+		target_free_working_area(target, erase_check_algorithm);
+
+	return retval;
+}
+
+/** Blank checks a list of blocks, e.g. all sectors of a flash bank, with
+ * one algorithm run per batch of blocks that fits the working area. */
+int armv7m_blank_check_memory_blocks(struct target *target,
+	struct target_memory_check_block *blocks, int num_blocks)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct working_area *erase_check_algorithm;
+	struct working_area *table;
+	struct reg_param reg_params[2];
+	struct armv7m_algorithm armv7m_info;
+	int batch = num_blocks;
+	bool fresh;
+	int retval;
+
+	static const uint8_t erase_check_blocks_code[] = {
+#include "../../contrib/loaders/erase_check/armv7m_erase_check_blocks.inc"
+	};
+
+	if (num_blocks <= 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (target_alloc_working_area_pinned(target, "armv7m erase check blocks",
+			sizeof(erase_check_blocks_code), &armv7m->erase_check_blocks_algorithm,
+			&fresh) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	erase_check_algorithm = armv7m->erase_check_blocks_algorithm;
+
+	if (fresh) {
+		retval = target_write_buffer(target, erase_check_algorithm->address,
+				sizeof(erase_check_blocks_code), (uint8_t *)erase_check_blocks_code);
+		if (retval != ERROR_OK) {
+			target_free_working_area(target, erase_check_algorithm);
+			return retval;
+		}
+	}
+
+	/* three words per block */
+	while (target_alloc_working_area_try(target, batch * 12, &table) != ERROR_OK) {
+		batch /= 2;
+		if (batch == 0)
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	uint8_t *buffer = malloc(batch * 12);
+	if (buffer == NULL) {
+		target_free_working_area(target, table);
+		return ERROR_FAIL;
+	}
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+
+	retval = ERROR_OK;
+	for (int first = 0; retval == ERROR_OK && first < num_blocks; first += batch) {
+		int count = MIN(batch, num_blocks - first);
+		uint64_t total = 0;
+
+		for (int i = 0; i < count; i++) {
+			target_buffer_set_u32(target, buffer + 12 * i, blocks[first + i].address);
+			target_buffer_set_u32(target, buffer + 12 * i + 4, blocks[first + i].size);
+			target_buffer_set_u32(target, buffer + 12 * i + 8, 0);
+			total += blocks[first + i].size;
+		}
+
+		retval = target_write_buffer(target, table->address, count * 12, buffer);
+		if (retval != ERROR_OK)
+			break;
+
+		buf_set_u32(reg_params[0].value, 0, 32, table->address);
+		buf_set_u32(reg_params[1].value, 0, 32, count);
+
+		/* scale with the size like the single block check */
+		int timeout = 10000 * (1 + (total / (1024 * 1024)));
+
+		retval = target_run_algorithm(target, 0, NULL, 2, reg_params,
+				erase_check_algorithm->address,
+				erase_check_algorithm->address + (sizeof(erase_check_blocks_code) - 2),
+				timeout, &armv7m_info);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("error executing cortex_m erase check algorithm");
+			target_free_working_area(target, erase_check_algorithm);
+			break;
+		}
+
+		retval = target_read_buffer(target, table->address, count * 12, buffer);
+		for (int i = 0; retval == ERROR_OK && i < count; i++)
+			blocks[first + i].result = target_buffer_get_u32(target, buffer + 12 * i + 8);
+	}
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+
+	free(buffer);
+	target_free_working_area(target, table);
 
 	return retval;
 }
@@ -828,5 +1199,8 @@ const struct command_registration armv7m_command_handlers[] = {
 	{
 		.chain = dap_command_handlers,
 	},
+	{
+		.chain = armv7m_coverage_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
@@ -29,6 +29,8 @@
 #include "arm.h"
 #include "armv7m_trace.h"
 
+struct armv7m_coverage;
+
 extern const int armv7m_psp_reg_map[];
 extern const int armv7m_msp_reg_map[];
 
@@ -158,9 +160,26 @@ struct armv7m_common {
 
 	struct armv7m_trace_config trace_config;
 
+	/* one-shot coverage points, see armv7m_coverage.c */
+	struct armv7m_coverage *coverage;
+
+	/* pinned checksum and blank check loaders, NULL once freed */
+	struct working_area *crc_algorithm;
+	struct working_area *crc_chunks_algorithm;
+	struct working_area *erase_check_algorithm;
+	struct working_area *erase_check_blocks_algorithm;
+
+	/* arch_info of the open algorithm session, see
+	 * armv7m_begin_algorithm_session() */
+	struct armv7m_algorithm *algorithm_session;
+
 	/* Direct processor core register read and writes */
 	int (*load_core_reg_u32)(struct target *target, uint32_t num, uint32_t *value);
 	int (*store_core_reg_u32)(struct target *target, uint32_t num, uint32_t value);
+	/* Optional: write several registers at once, regsel holds DCRSR
+	 * selectors (0..18 core, 33 FPSCR, 64..95 S0..S31) */
+	int (*store_core_reg_list)(struct target *target, const uint32_t *regsel,
+			const uint32_t *value, unsigned int count);
 
 	int (*examine_debug_reason)(struct target *target);
 	int (*post_debug_entry)(struct target *target);
@@ -218,14 +237,21 @@ int armv7m_wait_algorithm(struct target *target,
 		uint32_t exit_point, int timeout_ms,
 		void *arch_info);
 
+int armv7m_begin_algorithm_session(struct target *target, void *arch_info);
+int armv7m_end_algorithm_session(struct target *target, void *arch_info);
+
 int armv7m_invalidate_core_regs(struct target *target);
 
 int armv7m_restore_context(struct target *target);
 
 int armv7m_checksum_memory(struct target *target,
 		uint32_t address, uint32_t count, uint32_t *checksum);
+int armv7m_checksum_memory_chunks(struct target *target, uint32_t address,
+		uint32_t chunk_size, uint32_t count, uint32_t *checksums);
 int armv7m_blank_check_memory(struct target *target,
 		uint32_t address, uint32_t count, uint32_t *blank);
+int armv7m_blank_check_memory_blocks(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks);
 
 int armv7m_maybe_skip_bkpt_inst(struct target *target, bool *inst_found);
 
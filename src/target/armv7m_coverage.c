@@ -0,0 +1,422 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <target/target.h>
+#include <target/armv7m.h>
+#include <target/breakpoints.h>
+#include <target/register.h>
+#include <target/armv7m_coverage.h>
+#include <helper/fileio.h>
+#include <helper/binarybuffer.h>
+
+/* Thumb BKPT #0; semihosting uses BKPT #0xAB, so the two never mix */
+#define COVERAGE_BKPT		0xBE00
+/* points closer than this share one read and one write, the bytes in
+ * between are written back unchanged */
+#define COVERAGE_RUN_GAP	32
+#define COVERAGE_LINE_MAX	128
+
+/* a span of target memory covering points [first, last] */
+struct coverage_run {
+	uint32_t address;
+	uint32_t first;
+	uint32_t last;
+};
+
+static int coverage_point_cmp(const void *a, const void *b)
+{
+	const struct armv7m_coverage_point *pa = a, *pb = b;
+
+	if (pa->address != pb->address)
+		return pa->address < pb->address ? -1 : 1;
+	return 0;
+}
+
+void armv7m_coverage_free(struct armv7m_coverage *cov)
+{
+	if (!cov)
+		return;
+	free(cov->points);
+	free(cov->orig_instr);
+	free(cov->hit);
+	free(cov);
+}
+
+static bool coverage_is_hit(const struct armv7m_coverage *cov, uint32_t index)
+{
+	return cov->hit[index / 8] & (1 << (index % 8));
+}
+
+/* Install (or remove) the BKPTs of all points that have not been hit.
+ * Points are grouped into runs; every run is read in one scattered
+ * read, patched on the host and written back with one write. */
+static int coverage_patch(struct target *target, struct armv7m_coverage *cov,
+		bool install)
+{
+	struct coverage_run *runs;
+	struct target_mem_xfer *xfers;
+	uint8_t *data;
+	uint32_t nruns = 0, total = 0;
+	int retval;
+
+	runs = malloc(cov->count * sizeof(*runs));
+	xfers = malloc(cov->count * sizeof(*xfers));
+	if (!runs || !xfers) {
+		free(runs);
+		free(xfers);
+		return ERROR_FAIL;
+	}
+
+	for (uint32_t i = 0; i < cov->count; i++) {
+		uint32_t address = cov->points[i].address;
+		if (nruns && address - cov->points[runs[nruns - 1].last].address
+				<= COVERAGE_RUN_GAP) {
+			runs[nruns - 1].last = i;
+			continue;
+		}
+		runs[nruns].address = address;
+		runs[nruns].first = i;
+		runs[nruns].last = i;
+		nruns++;
+	}
+
+	for (uint32_t r = 0; r < nruns; r++) {
+		uint32_t len = cov->points[runs[r].last].address + 2 - runs[r].address;
+		xfers[r].address = runs[r].address;
+		xfers[r].size = 2;
+		xfers[r].count = len / 2;
+		total += len;
+	}
+
+	data = malloc(total);
+	if (!data) {
+		free(runs);
+		free(xfers);
+		return ERROR_FAIL;
+	}
+	for (uint32_t r = 0, offset = 0; r < nruns; r++) {
+		xfers[r].buffer = data + offset;
+		offset += xfers[r].count * 2;
+	}
+
+	retval = target_read_memory_multi(target, xfers, nruns);
+	if (retval != ERROR_OK)
+		goto out;
+
+	for (uint32_t r = 0; r < nruns; r++) {
+		for (uint32_t i = runs[r].first; i <= runs[r].last; i++) {
+			const struct armv7m_coverage_point *p = &cov->points[i];
+			uint8_t *instr = xfers[r].buffer + (p->address - runs[r].address);
+
+			if (coverage_is_hit(cov, p->index))
+				continue;
+			if (install) {
+				cov->orig_instr[p->index] = target_buffer_get_u16(target, instr);
+				target_buffer_set_u16(target, instr, COVERAGE_BKPT);
+			} else
+				target_buffer_set_u16(target, instr, cov->orig_instr[p->index]);
+		}
+	}
+
+	for (uint32_t r = 0; r < nruns; r++) {
+		retval = target_write_memory(target, xfers[r].address, 2,
+				xfers[r].count, xfers[r].buffer);
+		if (retval == ERROR_OK)
+			continue;
+
+		/* take the BKPTs out of the runs already written */
+		for (uint32_t w = 0; install && w < r; w++) {
+			for (uint32_t i = runs[w].first; i <= runs[w].last; i++) {
+				const struct armv7m_coverage_point *p = &cov->points[i];
+				if (!coverage_is_hit(cov, p->index))
+					target_buffer_set_u16(target,
+						xfers[w].buffer + (p->address - runs[w].address),
+						cov->orig_instr[p->index]);
+			}
+			target_write_memory(target, xfers[w].address, 2,
+				xfers[w].count, xfers[w].buffer);
+		}
+		goto out;
+	}
+
+	LOG_DEBUG("%s %" PRIu32 " coverage points in %" PRIu32 " runs, %" PRIu32 " bytes",
+		install ? "installed" : "removed", cov->count, nruns, total);
+
+out:
+	free(data);
+	free(runs);
+	free(xfers);
+	return retval;
+}
+
+int armv7m_coverage_hit(struct target *target, int *retval)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_coverage *cov = armv7m->coverage;
+	struct armv7m_coverage_point key, *p;
+
+	if (!cov || !cov->installed)
+		return 0;
+	if (target->debug_reason != DBG_REASON_BREAKPOINT)
+		return 0;
+
+	key.address = buf_get_u32(armv7m->arm.pc->value, 0, 32);
+	p = bsearch(&key, cov->points, cov->count, sizeof(*p), coverage_point_cmp);
+	if (!p || coverage_is_hit(cov, p->index))
+		return 0;
+
+	/* a breakpoint set since holds our BKPT as its original
+	 * instruction, leave that halt to the debugger */
+	if (breakpoint_find(target, key.address))
+		return 0;
+
+	*retval = target_write_u16(target, key.address, cov->orig_instr[p->index]);
+	if (*retval != ERROR_OK)
+		return 1;
+
+	cov->hit[p->index / 8] |= 1 << (p->index % 8);
+	cov->hits++;
+
+	*retval = target_resume(target, 1, 0, 0, 0);
+	return 1;
+}
+
+static int coverage_load(struct command_context *cmd_ctx, const char *filename,
+		struct armv7m_coverage **result)
+{
+	struct armv7m_coverage *cov;
+	struct fileio *file;
+	char line[COVERAGE_LINE_MAX];
+	uint32_t alloc = 0;
+
+	if (fileio_open(&file, filename, FILEIO_READ, FILEIO_TEXT) != ERROR_OK)
+		return ERROR_FAIL;
+
+	cov = calloc(1, sizeof(*cov));
+	if (!cov) {
+		fileio_close(file);
+		return ERROR_FAIL;
+	}
+
+	while (fileio_fgets(file, sizeof(line), line) == ERROR_OK) {
+		char *end;
+		unsigned long address = strtoul(line, &end, 0);
+
+		/* blank lines and '#' comments */
+		if (end == line)
+			continue;
+
+		if (cov->count == alloc) {
+			uint32_t n = alloc ? 2 * alloc : 256;
+			struct armv7m_coverage_point *points =
+				realloc(cov->points, n * sizeof(*points));
+			if (!points)
+				goto fail;
+			cov->points = points;
+			alloc = n;
+		}
+		/* function symbols carry the Thumb bit */
+		cov->points[cov->count].address = address & ~1UL;
+		cov->points[cov->count].index = cov->count;
+		cov->count++;
+	}
+	fileio_close(file);
+	file = NULL;
+
+	if (cov->count == 0) {
+		command_print(cmd_ctx, "no addresses in %s", filename);
+		goto fail;
+	}
+
+	cov->orig_instr = calloc(cov->count, sizeof(*cov->orig_instr));
+	cov->hit = calloc((cov->count + 7) / 8, 1);
+	if (!cov->orig_instr || !cov->hit)
+		goto fail;
+
+	qsort(cov->points, cov->count, sizeof(*cov->points), coverage_point_cmp);
+	for (uint32_t i = 1; i < cov->count; i++) {
+		if (cov->points[i].address == cov->points[i - 1].address) {
+			command_print(cmd_ctx, "address 0x%8.8" PRIx32 " listed twice",
+				cov->points[i].address);
+			goto fail;
+		}
+	}
+
+	*result = cov;
+	return ERROR_OK;
+
+fail:
+	if (file)
+		fileio_close(file);
+	armv7m_coverage_free(cov);
+	return ERROR_FAIL;
+}
+
+COMMAND_HANDLER(handle_coverage_install_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_coverage *cov;
+	int retval;
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (target->state != TARGET_HALTED) {
+		command_print(CMD_CTX, "target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	if (armv7m->coverage && armv7m->coverage->installed) {
+		command_print(CMD_CTX, "coverage points already installed");
+		return ERROR_FAIL;
+	}
+
+	retval = coverage_load(CMD_CTX, CMD_ARGV[0], &cov);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = coverage_patch(target, cov, true);
+	if (retval != ERROR_OK) {
+		armv7m_coverage_free(cov);
+		return retval;
+	}
+
+	armv7m_coverage_free(armv7m->coverage);
+	armv7m->coverage = cov;
+	cov->installed = true;
+
+	command_print(CMD_CTX, "%" PRIu32 " coverage points installed", cov->count);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_coverage_remove_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_coverage *cov = armv7m->coverage;
+	int retval;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!cov || !cov->installed)
+		return ERROR_OK;
+
+	if (target->state != TARGET_HALTED) {
+		command_print(CMD_CTX, "target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	retval = coverage_patch(target, cov, false);
+	if (retval != ERROR_OK)
+		return retval;
+
+	cov->installed = false;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_coverage_status_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_coverage *cov = armv7m->coverage;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!cov) {
+		command_print(CMD_CTX, "no coverage points loaded");
+		return ERROR_OK;
+	}
+
+	command_print(CMD_CTX, "%" PRIu32 " of %" PRIu32 " points hit%s",
+		cov->hits, cov->count, cov->installed ? "" : ", removed");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_coverage_dump_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_coverage *cov = armv7m->coverage;
+	struct fileio *file;
+	size_t written;
+	int retval;
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!cov) {
+		command_print(CMD_CTX, "no coverage points loaded");
+		return ERROR_FAIL;
+	}
+
+	if (fileio_open(&file, CMD_ARGV[0], FILEIO_WRITE, FILEIO_BINARY) != ERROR_OK)
+		return ERROR_FAIL;
+
+	retval = fileio_write(file, (cov->count + 7) / 8, cov->hit, &written);
+	fileio_close(file);
+
+	return retval;
+}
+
+static const struct command_registration coverage_command_handlers[] = {
+	{
+		.name = "install",
+		.handler = handle_coverage_install_command,
+		.mode = COMMAND_EXEC,
+		.help = "Plant a one-shot breakpoint at every address listed "
+			"in a file, one per line",
+		.usage = "filename",
+	},
+	{
+		.name = "remove",
+		.handler = handle_coverage_remove_command,
+		.mode = COMMAND_EXEC,
+		.help = "Restore the instructions of all points not hit",
+		.usage = "",
+	},
+	{
+		.name = "status",
+		.handler = handle_coverage_status_command,
+		.mode = COMMAND_EXEC,
+		.help = "Show how many points have been hit",
+		.usage = "",
+	},
+	{
+		.name = "dump",
+		.handler = handle_coverage_dump_command,
+		.mode = COMMAND_EXEC,
+		.help = "Write the hit bitmap, bit n for the n-th listed address",
+		.usage = "filename",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration armv7m_coverage_command_handlers[] = {
+	{
+		.name = "coverage",
+		.mode = COMMAND_ANY,
+		.help = "function coverage command group",
+		.usage = "",
+		.chain = coverage_command_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
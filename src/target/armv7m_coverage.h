@@ -0,0 +1,49 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_TARGET_ARMV7M_COVERAGE_H
+#define OPENOCD_TARGET_ARMV7M_COVERAGE_H
+
+#include <target/target.h>
+#include <command.h>
+
+/* Function coverage with one-shot breakpoints: a BKPT is planted at
+ * every address of a list, and the first time one is hit the original
+ * halfword goes back and the core resumes without reporting a halt. */
+
+struct armv7m_coverage_point {
+	uint32_t address;
+	uint32_t index;		/* position in the loaded list */
+};
+
+struct armv7m_coverage {
+	/* sorted by address */
+	struct armv7m_coverage_point *points;
+	uint32_t count;
+	/* per list position */
+	uint16_t *orig_instr;
+	uint8_t *hit;		/* bitmap */
+	uint32_t hits;
+	bool installed;
+};
+
+/* Called on halt like arm_semihosting(): returns 1 when the halt was a
+ * coverage point and has been handled, with *retval set. */
+int armv7m_coverage_hit(struct target *target, int *retval);
+void armv7m_coverage_free(struct armv7m_coverage *cov);
+
+extern const struct command_registration armv7m_coverage_command_handlers[];
+
+#endif /* OPENOCD_TARGET_ARMV7M_COVERAGE_H */
@@ -24,31 +24,258 @@
 #include <target/cortex_m.h>
 #include <target/armv7m_trace.h>
 #include <jtag/interface.h>
+#include <server/server.h>
+#include <helper/time_support.h>
+#include <helper/metrics.h>
+
+/* one adapter read asks for TRACE_CHUNK_SIZE bytes, a poll drains up to
+ * TRACE_BUF_SIZE before passing it on */
+#define TRACE_CHUNK_SIZE	4096
+#define TRACE_BUF_SIZE		(64 * 1024)
+/* polls skipped at most while no trace data arrives; ST-Link keeps
+ * just 1 KiB, a few ms of SWO at 2 MHz */
+#define TRACE_IDLE_SKIP_MAX	3
+
+/* the trace file is written through a large stdio buffer and flushed
+ * every TRACE_FILE_FLUSH_MS, a flush per poll cannot keep up with fast
+ * SWO into a named pipe */
+#define TRACE_FILE_BUF_SIZE	(256 * 1024)
+#define TRACE_FILE_FLUSH_MS	100
+
+static uint8_t trace_buf[TRACE_BUF_SIZE];
+static unsigned int trace_idle_skip, trace_idle_count;
+
+METRIC_COUNTER(itm_overflow_metric, "openocd_itm_overflows_total",
+		"ITM overflow packets, each a loss of trace data");
+
+static void itm_decode_line(struct itm_decoder *dec, unsigned int port)
+{
+	dec->line[port][dec->line_len[port]] = 0;
+	LOG_USER("ITM%u: %s", port, dec->line[port]);
+	dec->line_len[port] = 0;
+}
+
+static void itm_decode_stimulus(struct itm_decoder *dec, unsigned int port,
+		uint32_t value, unsigned int size)
+{
+	for (unsigned int i = 0; i < size; i++, value >>= 8) {
+		char c = value & 0xff;
+
+		if (c == '\n') {
+			itm_decode_line(dec, port);
+			continue;
+		}
+		if (c == '\r' || c == 0)
+			continue;
+
+		dec->line[port][dec->line_len[port]++] = c;
+		if (dec->line_len[port] == ITM_DECODE_LINE_MAX - 1)
+			itm_decode_line(dec, port);
+	}
+}
+
+/* data value packet of a traced variable, returns false for others */
+static bool itm_decode_watch(struct itm_decoder *dec, unsigned int id,
+		uint32_t value, unsigned int size)
+{
+	struct armv7m_trace_config *config =
+		container_of(dec, struct armv7m_trace_config, itm_decoder);
+	struct itm_watch *watch = &config->watch[(id >> 1) & 3];
+	const char *access = (id & 1) ? "write" : "read";
 
-#define TRACE_BUF_SIZE	4096
+	if (!watch->used)
+		return false;
+
+	if (watch->file)
+		fprintf(watch->file, "%" PRIu64 " %s 0x%0*" PRIx32 "\n",
+				dec->timestamp, access, (int)(2 * size), value);
+	else
+		LOG_USER("0x%08" PRIx32 " @%" PRIu64 ": %s 0x%0*" PRIx32,
+				watch->address, dec->timestamp, access, (int)(2 * size), value);
+	return true;
+}
+
+static void itm_decode_hardware(struct itm_decoder *dec, unsigned int id,
+		uint32_t value, unsigned int size)
+{
+	static const char * const exc_fn[] = { "?", "entered", "exited", "returned to" };
+
+	if (id >= 16 && id < 24 && itm_decode_watch(dec, id, value, size))
+		return;
+
+	if (dec->mode != ITM_DECODE_ALL)
+		return;
+
+	switch (id) {
+	case 0:
+		LOG_USER("DWT @%" PRIu64 ": event counters wrapped 0x%02" PRIx32,
+				dec->timestamp, value & 0x3f);
+		break;
+	case 1:
+		LOG_USER("DWT @%" PRIu64 ": exception %" PRIu32 " %s", dec->timestamp,
+				value & 0x1ff, exc_fn[(value >> 12) & 3]);
+		break;
+	case 2:
+		if (size == 4)
+			LOG_USER("DWT @%" PRIu64 ": PC 0x%08" PRIx32, dec->timestamp, value);
+		else
+			LOG_USER("DWT @%" PRIu64 ": PC sample while asleep", dec->timestamp);
+		break;
+	default:
+		if (id >= 8 && id < 16 && (id & 1))
+			LOG_USER("DWT @%" PRIu64 ": comparator %u address 0x%04" PRIx32,
+					dec->timestamp, (id >> 1) & 3, value);
+		else if (id >= 8 && id < 16)
+			LOG_USER("DWT @%" PRIu64 ": comparator %u PC 0x%08" PRIx32,
+					dec->timestamp, (id >> 1) & 3, value);
+		else if (id >= 16 && id < 24)
+			LOG_USER("DWT @%" PRIu64 ": comparator %u %s 0x%0*" PRIx32,
+					dec->timestamp, (id >> 1) & 3, (id & 1) ? "write" : "read",
+					(int)(2 * size), value);
+		break;
+	}
+}
+
+static void itm_decode_packet(struct itm_decoder *dec)
+{
+	uint8_t header = dec->pkt[0];
+	uint32_t value = 0;
+
+	if ((header & 0x0f) == 0) {
+		/* local timestamp, the long form is 7 bits per payload byte */
+		if (header & 0x80) {
+			for (unsigned int i = dec->pkt_len - 1; i > 0; i--)
+				value = (value << 7) | (dec->pkt[i] & 0x7f);
+		} else {
+			value = (header >> 4) & 7;
+		}
+		dec->timestamp += value;
+		return;
+	}
+
+	if (!(header & 3))
+		return;
+
+	/* source packet: 1, 2 or 4 bytes of payload */
+	for (unsigned int i = dec->pkt_len - 1; i > 0; i--)
+		value = (value << 8) | dec->pkt[i];
+	if (header & 4)
+		itm_decode_hardware(dec, header >> 3, value, dec->pkt_len - 1);
+	else if (dec->mode != ITM_DECODE_OFF)
+		itm_decode_stimulus(dec, header >> 3, value, dec->pkt_len - 1);
+}
+
+/* Split the unformatted ITM stream into packets: software source packets
+ * go to per stimulus port lines, hardware source packets are the DWT
+ * events, and local timestamps keep the running time for those. */
+static void itm_decode(struct itm_decoder *dec, const uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		uint8_t b = buf[i];
+
+		if (dec->pkt_len) {
+			dec->pkt[dec->pkt_len++] = b;
+			bool done = dec->pkt_cont ? !(b & 0x80) : --dec->pkt_left == 0;
+			if (done || dec->pkt_len == sizeof(dec->pkt)) {
+				itm_decode_packet(dec);
+				dec->pkt_len = 0;
+			}
+			continue;
+		}
+
+		if (b == 0) {
+			dec->zeros++;
+			continue;
+		}
+		if (b == 0x80 && dec->zeros >= 5) {
+			/* synchronisation packet */
+			dec->zeros = 0;
+			continue;
+		}
+		dec->zeros = 0;
+
+		if (b == 0x70) {
+			LOG_WARNING("ITM overflow, trace data was lost");
+			metric_add(&itm_overflow_metric, 1);
+			continue;
+		}
+
+		dec->pkt[0] = b;
+		if ((b & 0x0f) == 0 && !(b & 0x80)) {
+			/* short local timestamp, no payload */
+			dec->pkt_len = 1;
+			itm_decode_packet(dec);
+			dec->pkt_len = 0;
+		} else if ((b & 0x0f) == 0 || (b & 0x0b) == 0x08 || (b & 0xdf) == 0x94) {
+			/* long local timestamp, extension and global timestamp
+			 * payloads end with the first byte without bit 7 */
+			if ((b & 0x0b) == 0x08 && !(b & 0x80))
+				continue;
+			dec->pkt_len = 1;
+			dec->pkt_cont = true;
+		} else if (b & 3) {
+			dec->pkt_len = 1;
+			dec->pkt_cont = false;
+			dec->pkt_left = (b & 3) == 3 ? 4 : (b & 3);
+		}
+	}
+}
 
 static int armv7m_poll_trace(void *target)
 {
 	struct armv7m_common *armv7m = target_to_armv7m(target);
-	uint8_t buf[TRACE_BUF_SIZE];
-	size_t size = sizeof(buf);
+	size_t total = 0;
 	int retval;
 
-	retval = adapter_poll_trace(buf, &size);
-	if (retval != ERROR_OK || !size)
-		return retval;
+	if (trace_idle_count < trace_idle_skip) {
+		trace_idle_count++;
+		return ERROR_OK;
+	}
+	trace_idle_count = 0;
 
-	target_call_trace_callbacks(target, size, buf);
+	/* keep reading while the adapter fills the chunks, it has more */
+	while (total + TRACE_CHUNK_SIZE <= TRACE_BUF_SIZE) {
+		size_t size = TRACE_CHUNK_SIZE;
+
+		retval = adapter_poll_trace(trace_buf + total, &size);
+		if (retval != ERROR_OK)
+			return retval;
+		total += size;
+		if (size + 1 < TRACE_CHUNK_SIZE)
+			break;
+	}
+
+	if (!total) {
+		trace_idle_skip = MIN(2 * trace_idle_skip + 1, TRACE_IDLE_SKIP_MAX);
+		return ERROR_OK;
+	}
+	trace_idle_skip = 0;
+
+	target_call_trace_callbacks(target, total, trace_buf);
+
+	/* traced variables are decoded even with "itm decode off" */
+	if (armv7m->trace_config.itm_decoder.mode != ITM_DECODE_OFF ||
+			armv7m->trace_config.watch_count)
+		itm_decode(&armv7m->trace_config.itm_decoder, trace_buf, total);
 
 	if (armv7m->trace_config.trace_file != NULL) {
-		if (fwrite(buf, 1, size, armv7m->trace_config.trace_file) == size)
-			fflush(armv7m->trace_config.trace_file);
-		else {
+		if (fwrite(trace_buf, 1, total, armv7m->trace_config.trace_file) != total) {
 			LOG_ERROR("Error writing to the trace destination file");
 			return ERROR_FAIL;
 		}
 	}
 
+	int64_t now = timeval_ms();
+	if (now - armv7m->trace_config.trace_file_flushed_ms >= TRACE_FILE_FLUSH_MS) {
+		if (armv7m->trace_config.trace_file != NULL)
+			fflush(armv7m->trace_config.trace_file);
+		for (unsigned int i = 0; i < ITM_WATCH_MAX; i++) {
+			if (armv7m->trace_config.watch[i].file)
+				fflush(armv7m->trace_config.watch[i].file);
+		}
+		armv7m->trace_config.trace_file_flushed_ms = now;
+	}
+
 	return ERROR_OK;
 }
 
@@ -60,7 +287,8 @@ int armv7m_trace_tpiu_config(struct target *target)
 	int retval;
 
 	target_unregister_timer_callback(armv7m_poll_trace, target);
-
+	trace_idle_skip = 0;
+	trace_idle_count = 0;
 
 	retval = adapter_config_trace(trace_config->config_type == INTERNAL,
 				      trace_config->pin_protocol,
@@ -197,6 +425,8 @@ COMMAND_HANDLER(handle_tpiu_config_command)
 					LOG_ERROR("Can't open trace destination file");
 					return ERROR_FAIL;
 				}
+				setvbuf(armv7m->trace_config.trace_file, NULL, _IOFBF,
+						TRACE_FILE_BUF_SIZE);
 			}
 		}
 		cmd_idx++;
@@ -255,6 +485,106 @@ COMMAND_HANDLER(handle_tpiu_config_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+/* the trace stream is one way, whatever the client sends is dropped */
+static int trace_stream_input(struct connection *connection)
+{
+	uint8_t buf[64];
+
+	int len = connection_read(connection, buf, sizeof(buf));
+	if (len <= 0) {
+		if (len < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	return ERROR_OK;
+}
+
+static int trace_stream_handler(struct target *target, size_t len, uint8_t *data, void *priv)
+{
+	struct connection *connection = priv;
+
+	if (target != connection->service->priv)
+		return ERROR_OK;
+
+	if (connection_write(connection, data, len) != (int)len)
+		LOG_DEBUG("trace stream client is not keeping up");
+
+	return ERROR_OK;
+}
+
+static int trace_stream_new_connection(struct connection *connection)
+{
+	return target_register_trace_callback(trace_stream_handler, connection);
+}
+
+static int trace_stream_closed(struct connection *connection)
+{
+	return target_unregister_trace_callback(trace_stream_handler, connection);
+}
+
+COMMAND_HANDLER(handle_tpiu_stream_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	/* the server has no way to close a single service */
+	if (armv7m->trace_config.stream_port) {
+		LOG_ERROR("The trace is already streamed on port %s",
+				armv7m->trace_config.stream_port);
+		return ERROR_FAIL;
+	}
+
+	armv7m->trace_config.stream_port = strdup(CMD_ARGV[0]);
+	if (!armv7m->trace_config.stream_port)
+		return ERROR_FAIL;
+
+	int retval = add_service("trace", armv7m->trace_config.stream_port,
+			CONNECTION_LIMIT_UNLIMITED, trace_stream_new_connection,
+			trace_stream_input, trace_stream_closed, target);
+	if (retval != ERROR_OK) {
+		free(armv7m->trace_config.stream_port);
+		armv7m->trace_config.stream_port = NULL;
+	}
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_itm_decode_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct itm_decoder *dec = &armv7m->trace_config.itm_decoder;
+	static const char * const modes[] = { "off", "text", "all" };
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int mode;
+
+		for (mode = 0; mode < ARRAY_SIZE(modes); mode++) {
+			if (!strcmp(CMD_ARGV[0], modes[mode]))
+				break;
+		}
+		if (mode == ARRAY_SIZE(modes))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		memset(dec, 0, sizeof(*dec));
+		dec->mode = mode;
+
+		if (mode != ITM_DECODE_OFF && armv7m->trace_config.formatter)
+			LOG_WARNING("The TPIU formatter is on, its frames are not decoded");
+	}
+
+	command_print(CMD_CTX, "itm decode %s", modes[dec->mode]);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_itm_port_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -300,6 +630,126 @@ COMMAND_HANDLER(handle_itm_ports_command)
 		return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_trace_watch_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_trace_config *trace_config = &armv7m->trace_config;
+	enum watchpoint_rw rw = WPT_ACCESS;
+	uint32_t address, length;
+	unsigned int dwt_num;
+	FILE *file = NULL;
+	int retval;
+
+	if (CMD_ARGC == 0) {
+		for (unsigned int i = 0; i < ITM_WATCH_MAX; i++) {
+			struct itm_watch *watch = &trace_config->watch[i];
+			if (watch->used)
+				command_print(CMD_CTX, "DWT%u: 0x%08" PRIx32 ", %" PRIu32 " bytes%s",
+						i, watch->address, watch->length,
+						watch->file ? ", to file" : "");
+		}
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC < 2 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], length);
+	if (CMD_ARGC >= 3) {
+		switch (CMD_ARGV[2][0]) {
+		case 'r':
+			rw = WPT_READ;
+			break;
+		case 'w':
+			rw = WPT_WRITE;
+			break;
+		case 'a':
+			rw = WPT_ACCESS;
+			break;
+		default:
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+	}
+
+	if (CMD_ARGC == 4) {
+		file = fopen(CMD_ARGV[3], "a");
+		if (!file) {
+			LOG_ERROR("Can't open %s: %s", CMD_ARGV[3], strerror(errno));
+			return ERROR_FAIL;
+		}
+	}
+
+	retval = cortex_m_dwt_trace_add(target, address, length, rw, &dwt_num);
+	if (retval != ERROR_OK) {
+		if (file)
+			fclose(file);
+		return retval;
+	}
+
+	trace_config->watch[dwt_num].used = true;
+	trace_config->watch[dwt_num].address = address;
+	trace_config->watch[dwt_num].length = length;
+	trace_config->watch[dwt_num].file = file;
+	trace_config->watch_count++;
+
+	if (trace_config->config_type != INTERNAL)
+		LOG_INFO("Trace is not captured by OpenOCD, events are not decoded");
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_trace_unwatch_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_trace_config *trace_config = &armv7m->trace_config;
+	uint32_t address = 0;
+	int retval = ERROR_OK;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
+
+	for (unsigned int i = 0; i < ITM_WATCH_MAX; i++) {
+		struct itm_watch *watch = &trace_config->watch[i];
+
+		if (!watch->used || (CMD_ARGC == 1 && watch->address != address))
+			continue;
+
+		retval = cortex_m_dwt_trace_remove(target, i);
+		if (watch->file)
+			fclose(watch->file);
+		memset(watch, 0, sizeof(*watch));
+		trace_config->watch_count--;
+		if (retval != ERROR_OK)
+			break;
+	}
+
+	return retval;
+}
+
+static const struct command_registration trace_watch_command_handlers[] = {
+	{
+		.name = "watch",
+		.handler = handle_trace_watch_command,
+		.mode = COMMAND_EXEC,
+		.help = "Trace the accesses to a variable through DWT and ITM "
+			"without halting, or list the traced variables",
+		.usage = "[address length [(r|w|a) [filename]]]",
+	},
+	{
+		.name = "unwatch",
+		.handler = handle_trace_unwatch_command,
+		.mode = COMMAND_EXEC,
+		.help = "Stop tracing a variable, or all of them",
+		.usage = "[address]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration tpiu_command_handlers[] = {
 	{
 		.name = "config",
@@ -311,6 +761,13 @@ static const struct command_registration tpiu_command_handlers[] = {
 		"(sync <port width> | ((manchester | uart) <formatter enable>)) "
 		"<TRACECLKIN freq> [<trace freq>]))",
 	},
+	{
+		.name = "stream",
+		.handler = handle_tpiu_stream_command,
+		.mode = COMMAND_EXEC,
+		.help = "Stream the raw trace captured internally to TCP clients",
+		.usage = "<port>",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -329,10 +786,25 @@ static const struct command_registration itm_command_handlers[] = {
 		.help = "Enable or disable all ITM stimulus ports",
 		.usage = "(0|1|on|off)",
 	},
+	{
+		.name = "decode",
+		.handler = handle_itm_decode_command,
+		.mode = COMMAND_ANY,
+		.help = "Print stimulus port text and optionally DWT events "
+			"from the trace captured internally",
+		.usage = "[off|text|all]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
 const struct command_registration armv7m_trace_command_handlers[] = {
+	{
+		.name = "trace",
+		.mode = COMMAND_ANY,
+		.help = "trace command group",
+		.usage = "",
+		.chain = trace_watch_command_handlers,
+	},
 	{
 		.name = "tpiu",
 		.mode = COMMAND_ANY,
@@ -45,6 +45,45 @@ enum itm_ts_prescaler {
 	ITM_TS_PRESCALE64,	/**< refclock divided by 64 for the timestamp counter */
 };
 
+enum itm_decode_mode {
+	ITM_DECODE_OFF,		/**< the trace stream is passed on raw only */
+	ITM_DECODE_TEXT,	/**< stimulus port text is printed line by line */
+	ITM_DECODE_ALL,		/**< DWT packets are printed as well */
+};
+
+#define ITM_DECODE_PORTS	32
+#define ITM_DECODE_LINE_MAX	128
+
+/** State of the in-process ITM/DWT packet decoder */
+struct itm_decoder {
+	enum itm_decode_mode mode;
+	/** Header and payload of the packet being assembled */
+	uint8_t pkt[8];
+	unsigned int pkt_len;
+	/** Payload bytes still missing, or continuation-bit framed */
+	unsigned int pkt_left;
+	bool pkt_cont;
+	/** Zero bytes in a row, the start of a synchronisation packet */
+	unsigned int zeros;
+	/** Sum of the local timestamps, in timestamp counter ticks */
+	uint64_t timestamp;
+	/** Text of each stimulus port up to the next newline */
+	char line[ITM_DECODE_PORTS][ITM_DECODE_LINE_MAX];
+	unsigned int line_len[ITM_DECODE_PORTS];
+};
+
+/** Data trace names DWT comparators 0 to 3 only */
+#define ITM_WATCH_MAX		4
+
+/** A variable whose accesses are traced, see "trace watch" */
+struct itm_watch {
+	bool used;
+	uint32_t address;
+	uint32_t length;
+	/** Events go here as text lines, to the log when NULL */
+	FILE *file;
+};
+
 struct armv7m_trace_config {
 	/** Currently active trace capture mode */
 	enum trace_config_type config_type;
@@ -75,6 +114,15 @@ struct armv7m_trace_config {
 	unsigned int trace_freq;
 	/** Handle to output trace data in INTERNAL capture mode */
 	FILE *trace_file;
+	/** timeval_ms() of the last trace_file flush */
+	int64_t trace_file_flushed_ms;
+	/** TCP port streaming the raw trace, NULL when not listening */
+	char *stream_port;
+	/** Decoder fed with the raw trace in INTERNAL capture mode */
+	struct itm_decoder itm_decoder;
+	/** Traced variables, by DWT comparator */
+	struct itm_watch watch[ITM_WATCH_MAX];
+	unsigned int watch_count;
 };
 
 extern const struct command_registration armv7m_trace_command_handlers[];
@@ -322,6 +322,137 @@ int avr32_jtag_mwa_write(struct avr32_jtag *jtag_info, int slave,
 	return ERROR_OK;
 }
 
+/*
+ * Block mode: the address and data scans of up to AVR32_MWA_BLOCK words
+ * are queued with their busy bits and executed in one flush. Words from
+ * the first one that saw busy on are sent again; a write also repeats the
+ * word before, its data may have gone to the previous address.
+ */
+static int avr32_jtag_mwa_block(struct avr32_jtag *jtag_info, int slave,
+		uint32_t addr, int count, uint32_t *rdata, const uint32_t *wdata)
+{
+	struct scan_field fields[2];
+	uint8_t addr_buf[4];
+	uint8_t slave_buf[4];
+	uint8_t data_buf[4];
+	uint8_t zero_buf[4] = { 0 };
+	uint8_t addr_busy[AVR32_MWA_BLOCK];
+	uint8_t data_busy[AVR32_MWA_BLOCK];
+	uint8_t in_buf[AVR32_MWA_BLOCK][4];
+	int mode = rdata ? MODE_READ : MODE_WRITE;
+	int done = 0;
+
+	if (avr32_jtag_set_instr(jtag_info, AVR32_INST_MW_ACCESS) != ERROR_OK)
+		return ERROR_FAIL;
+
+	while (done < count) {
+		int n = MIN(count - done, AVR32_MWA_BLOCK);
+		int first;
+
+		for (int i = 0; i < n; i++) {
+			uint32_t word_addr = addr + (done + i) * 4;
+
+			memset(addr_buf, 0, sizeof(addr_buf));
+			memset(slave_buf, 0, sizeof(slave_buf));
+			buf_set_u32(slave_buf, 0, 4, slave);
+			buf_set_u32(addr_buf, 0, 1, mode);
+			buf_set_u32(addr_buf, 1, 30, word_addr >> 2);
+
+			fields[0].num_bits = 31;
+			fields[0].in_value = NULL;
+			fields[0].out_value = addr_buf;
+
+			addr_busy[i] = 0;
+			fields[1].num_bits = 4;
+			fields[1].in_value = &addr_busy[i];
+			fields[1].out_value = slave_buf;
+
+			jtag_add_dr_scan(jtag_info->tap, 2, fields, TAP_IDLE);
+
+			data_busy[i] = 0;
+			if (rdata) {
+				fields[0].num_bits = 32;
+				fields[0].out_value = NULL;
+				fields[0].in_value = in_buf[i];
+
+				fields[1].num_bits = 3;
+				fields[1].in_value = &data_busy[i];
+				fields[1].out_value = NULL;
+			} else {
+				buf_set_u32(data_buf, 0, 32, wdata[done + i]);
+				fields[0].num_bits = 3;
+				fields[0].in_value = &data_busy[i];
+				fields[0].out_value = zero_buf;
+
+				fields[1].num_bits = 32;
+				fields[1].out_value = data_buf;
+				fields[1].in_value = NULL;
+			}
+
+			jtag_add_dr_scan(jtag_info->tap, 2, fields, TAP_IDLE);
+		}
+
+		if (jtag_execute_queue() != ERROR_OK) {
+			LOG_ERROR("%s: block access failed", __func__);
+			return ERROR_FAIL;
+		}
+
+		for (first = 0; first < n; first++) {
+			if (buf_get_u32(&addr_busy[first], 1, 1) ||
+					buf_get_u32(&data_busy[first], 0, 1))
+				break;
+		}
+
+		if (rdata) {
+			for (int i = 0; i < first; i++)
+				rdata[done + i] = buf_get_u32(in_buf[i], 0, 32);
+		}
+
+		if (first == n) {
+			done += n;
+		} else if (rdata ? first > 0 : first > 1) {
+			done += rdata ? first : first - 1;
+		} else {
+			/* no progress, the busy word with busy polling */
+			int retval;
+			int k = done + first;
+			uint32_t word_addr = addr + k * 4;
+
+			LOG_DEBUG("SAB busy at 0x%08" PRIx32, word_addr);
+			if (rdata) {
+				retval = avr32_jtag_mwa_read(jtag_info, slave, word_addr,
+						&rdata[k]);
+			} else {
+				if (k > 0) {
+					retval = avr32_jtag_mwa_write(jtag_info, slave,
+							word_addr - 4, wdata[k - 1]);
+					if (retval != ERROR_OK)
+						return retval;
+				}
+				retval = avr32_jtag_mwa_write(jtag_info, slave, word_addr,
+						wdata[k]);
+			}
+			if (retval != ERROR_OK)
+				return retval;
+			done = k + 1;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+int avr32_jtag_mwa_read_block(struct avr32_jtag *jtag_info, int slave,
+		uint32_t addr, int count, uint32_t *values)
+{
+	return avr32_jtag_mwa_block(jtag_info, slave, addr, count, values, NULL);
+}
+
+int avr32_jtag_mwa_write_block(struct avr32_jtag *jtag_info, int slave,
+		uint32_t addr, int count, const uint32_t *values)
+{
+	return avr32_jtag_mwa_block(jtag_info, slave, addr, count, NULL, values);
+}
+
 int avr32_jtag_exec(struct avr32_jtag *jtag_info, uint32_t inst)
 {
 	int retval;
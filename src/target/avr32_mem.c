@@ -28,18 +28,15 @@ int avr32_jtag_read_memory32(struct avr32_jtag *jtag_info,
 	uint32_t addr, int count, uint32_t *buffer)
 {
 	int i, retval;
-	uint32_t data;
-
-	for (i = 0; i < count; i++) {
-		retval = avr32_jtag_mwa_read(jtag_info, SLAVE_HSB_UNCACHED,
-				addr + i*4, &data);
 
-		if (retval != ERROR_OK)
-			return retval;
+	retval = avr32_jtag_mwa_read_block(jtag_info, SLAVE_HSB_UNCACHED,
+			addr, count, buffer);
+	if (retval != ERROR_OK)
+		return retval;
 
-		/* XXX: Assume AVR32 is BE */
-		buffer[i] = be_to_h_u32((uint8_t *)&data);
-	}
+	/* XXX: Assume AVR32 is BE */
+	for (i = 0; i < count; i++)
+		buffer[i] = be_to_h_u32((uint8_t *)&buffer[i]);
 
 	return ERROR_OK;
 }
@@ -146,20 +143,23 @@ int avr32_jtag_write_memory32(struct avr32_jtag *jtag_info,
 	uint32_t addr, int count, const uint32_t *buffer)
 {
 	int i, retval;
-	uint32_t data;
+	uint32_t *data;
 
-	for (i = 0; i < count; i++) {
-		/* XXX: Assume AVR32 is BE */
-		h_u32_to_be((uint8_t *)&data, buffer[i]);
-		retval = avr32_jtag_mwa_write(jtag_info, SLAVE_HSB_UNCACHED,
-				addr + i*4, data);
+	data = malloc(count * sizeof(uint32_t));
+	if (data == NULL) {
+		LOG_ERROR("%s: out of memory", __func__);
+		return ERROR_FAIL;
+	}
 
-		if (retval != ERROR_OK)
-			return retval;
+	/* XXX: Assume AVR32 is BE */
+	for (i = 0; i < count; i++)
+		h_u32_to_be((uint8_t *)&data[i], buffer[i]);
 
-	}
+	retval = avr32_jtag_mwa_write_block(jtag_info, SLAVE_HSB_UNCACHED,
+			addr, count, data);
 
-	return ERROR_OK;
+	free(data);
+	return retval;
 }
 
 int avr32_jtag_write_memory16(struct avr32_jtag *jtag_info,
@@ -41,6 +41,94 @@ static const char * const watchpoint_rw_strings[] = {
 /* monotonic counter/id-number for breakpoints and watch points */
 static int bpwp_unique_id;
 
+/* Both lists carry an address index: BPWP_HASH_SIZE chains through
+ * hash_next, each in list order, allocated along with the first entry.
+ * Without it (out of memory) lookups walk the list as they used to. */
+#define BPWP_HASH_BITS	8
+#define BPWP_HASH_SIZE	(1 << BPWP_HASH_BITS)
+
+static unsigned int bpwp_hash(uint32_t address)
+{
+	return (address * 0x9E3779B1u) >> (32 - BPWP_HASH_BITS);
+}
+
+static void breakpoint_hash_insert(struct target *target, struct breakpoint *breakpoint)
+{
+	struct breakpoint **p = &target->breakpoint_hash[bpwp_hash(breakpoint->address)];
+
+	while (*p)
+		p = &(*p)->hash_next;
+	breakpoint->hash_next = NULL;
+	*p = breakpoint;
+}
+
+static void breakpoint_index_add(struct target *target, struct breakpoint *breakpoint)
+{
+	if (target->breakpoint_hash) {
+		breakpoint_hash_insert(target, breakpoint);
+		return;
+	}
+
+	target->breakpoint_hash = calloc(BPWP_HASH_SIZE, sizeof(struct breakpoint *));
+	if (target->breakpoint_hash == NULL)
+		return;
+
+	/* the new entry is already on the list */
+	for (breakpoint = target->breakpoints; breakpoint; breakpoint = breakpoint->next)
+		breakpoint_hash_insert(target, breakpoint);
+}
+
+static void breakpoint_index_remove(struct target *target, struct breakpoint *breakpoint)
+{
+	if (target->breakpoint_hash == NULL)
+		return;
+
+	struct breakpoint **p = &target->breakpoint_hash[bpwp_hash(breakpoint->address)];
+
+	while (*p && *p != breakpoint)
+		p = &(*p)->hash_next;
+	if (*p)
+		*p = breakpoint->hash_next;
+}
+
+static void watchpoint_hash_insert(struct target *target, struct watchpoint *watchpoint)
+{
+	struct watchpoint **p = &target->watchpoint_hash[bpwp_hash(watchpoint->address)];
+
+	while (*p)
+		p = &(*p)->hash_next;
+	watchpoint->hash_next = NULL;
+	*p = watchpoint;
+}
+
+static void watchpoint_index_add(struct target *target, struct watchpoint *watchpoint)
+{
+	if (target->watchpoint_hash) {
+		watchpoint_hash_insert(target, watchpoint);
+		return;
+	}
+
+	target->watchpoint_hash = calloc(BPWP_HASH_SIZE, sizeof(struct watchpoint *));
+	if (target->watchpoint_hash == NULL)
+		return;
+
+	for (watchpoint = target->watchpoints; watchpoint; watchpoint = watchpoint->next)
+		watchpoint_hash_insert(target, watchpoint);
+}
+
+static void watchpoint_index_remove(struct target *target, struct watchpoint *watchpoint)
+{
+	if (target->watchpoint_hash == NULL)
+		return;
+
+	struct watchpoint **p = &target->watchpoint_hash[bpwp_hash(watchpoint->address)];
+
+	while (*p && *p != watchpoint)
+		p = &(*p)->hash_next;
+	if (*p)
+		*p = watchpoint->hash_next;
+}
+
 int breakpoint_add_internal(struct target *target,
 	uint32_t address,
 	uint32_t length,
@@ -76,6 +164,7 @@ int breakpoint_add_internal(struct target *target,
 	(*breakpoint_p)->set = 0;
 	(*breakpoint_p)->orig_instr = malloc(length);
 	(*breakpoint_p)->next = NULL;
+	(*breakpoint_p)->pprev = breakpoint_p;
 	(*breakpoint_p)->unique_id = bpwp_unique_id++;
 
 	retval = target_add_breakpoint(target, *breakpoint_p);
@@ -98,6 +187,8 @@ fail:
 			return retval;
 	}
 
+	breakpoint_index_add(target, *breakpoint_p);
+
 	LOG_DEBUG("added %s breakpoint at 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
 		breakpoint_type_strings[(*breakpoint_p)->type],
 		(*breakpoint_p)->address, (*breakpoint_p)->length,
@@ -140,6 +231,7 @@ int context_breakpoint_add_internal(struct target *target,
 	(*breakpoint_p)->set = 0;
 	(*breakpoint_p)->orig_instr = malloc(length);
 	(*breakpoint_p)->next = NULL;
+	(*breakpoint_p)->pprev = breakpoint_p;
 	(*breakpoint_p)->unique_id = bpwp_unique_id++;
 	retval = target_add_context_breakpoint(target, *breakpoint_p);
 	if (retval != ERROR_OK) {
@@ -150,6 +242,8 @@ int context_breakpoint_add_internal(struct target *target,
 		return retval;
 	}
 
+	breakpoint_index_add(target, *breakpoint_p);
+
 	LOG_DEBUG("added %s Context breakpoint at 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
 		breakpoint_type_strings[(*breakpoint_p)->type],
 		(*breakpoint_p)->asid, (*breakpoint_p)->length,
@@ -196,6 +290,7 @@ int hybrid_breakpoint_add_internal(struct target *target,
 	(*breakpoint_p)->set = 0;
 	(*breakpoint_p)->orig_instr = malloc(length);
 	(*breakpoint_p)->next = NULL;
+	(*breakpoint_p)->pprev = breakpoint_p;
 	(*breakpoint_p)->unique_id = bpwp_unique_id++;
 
 
@@ -207,6 +302,7 @@ int hybrid_breakpoint_add_internal(struct target *target,
 		*breakpoint_p = NULL;
 		return retval;
 	}
+	breakpoint_index_add(target, *breakpoint_p);
 	LOG_DEBUG(
 		"added %s Hybrid breakpoint at address 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
 		breakpoint_type_strings[(*breakpoint_p)->type],
@@ -286,42 +382,48 @@ int hybrid_breakpoint_add(struct target *target,
 }
 
 /* free up a breakpoint */
-static void breakpoint_free(struct target *target, struct breakpoint *breakpoint_to_remove)
+static void breakpoint_free(struct target *target, struct breakpoint *breakpoint)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
 	int retval;
 
-	while (breakpoint) {
-		if (breakpoint == breakpoint_to_remove)
-			break;
-		breakpoint_p = &breakpoint->next;
-		breakpoint = breakpoint->next;
-	}
-
-	if (breakpoint == NULL)
-		return;
-
 	retval = target_remove_breakpoint(target, breakpoint);
 
 	LOG_DEBUG("free BPID: %" PRIu32 " --> %d", breakpoint->unique_id, retval);
-	(*breakpoint_p) = breakpoint->next;
+	breakpoint_index_remove(target, breakpoint);
+	*breakpoint->pprev = breakpoint->next;
+	if (breakpoint->next)
+		breakpoint->next->pprev = breakpoint->pprev;
 	free(breakpoint->orig_instr);
 	free(breakpoint);
 }
 
 int breakpoint_remove_internal(struct target *target, uint32_t address)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-
-	while (breakpoint) {
-		if ((breakpoint->address == address) && (breakpoint->asid == 0))
-			break;
-		else if ((breakpoint->address == 0) && (breakpoint->asid == address))
-			break;
-		else if ((breakpoint->address == address) && (breakpoint->asid != 0))
-			break;
-		breakpoint = breakpoint->next;
+	struct breakpoint *breakpoint;
+
+	if (target->breakpoint_hash) {
+		/* the first on the list matching either the address, or the
+		 * asid of a context breakpoint; ids reflect the list order */
+		breakpoint = breakpoint_find(target, address);
+		if (address != 0) {
+			struct breakpoint *context = target->breakpoint_hash[bpwp_hash(0)];
+
+			while (context && (context->address != 0 || context->asid != address))
+				context = context->hash_next;
+			if (context && (breakpoint == NULL || context->unique_id < breakpoint->unique_id))
+				breakpoint = context;
+		}
+	} else {
+		breakpoint = target->breakpoints;
+		while (breakpoint) {
+			if ((breakpoint->address == address) && (breakpoint->asid == 0))
+				break;
+			else if ((breakpoint->address == 0) && (breakpoint->asid == address))
+				break;
+			else if ((breakpoint->address == address) && (breakpoint->asid != 0))
+				break;
+			breakpoint = breakpoint->next;
+		}
 	}
 
 	if (breakpoint) {
@@ -357,6 +459,9 @@ void breakpoint_clear_target_internal(struct target *target)
 		target_name(target));
 	while (target->breakpoints != NULL)
 		breakpoint_free(target, target->breakpoints);
+
+	free(target->breakpoint_hash);
+	target->breakpoint_hash = NULL;
 }
 
 void breakpoint_clear_target(struct target *target)
@@ -377,8 +482,19 @@ void breakpoint_clear_target(struct target *target)
 
 struct breakpoint *breakpoint_find(struct target *target, uint32_t address)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
+	struct breakpoint *breakpoint;
+
+	if (target->breakpoint_hash) {
+		breakpoint = target->breakpoint_hash[bpwp_hash(address)];
+		while (breakpoint) {
+			if (breakpoint->address == address)
+				return breakpoint;
+			breakpoint = breakpoint->hash_next;
+		}
+		return NULL;
+	}
 
+	breakpoint = target->breakpoints;
 	while (breakpoint) {
 		if (breakpoint->address == address)
 			return breakpoint;
@@ -388,6 +504,30 @@ struct breakpoint *breakpoint_find(struct target *target, uint32_t address)
 	return NULL;
 }
 
+static struct watchpoint *watchpoint_find(struct target *target, uint32_t address)
+{
+	struct watchpoint *watchpoint;
+
+	if (target->watchpoint_hash) {
+		watchpoint = target->watchpoint_hash[bpwp_hash(address)];
+		while (watchpoint) {
+			if (watchpoint->address == address)
+				return watchpoint;
+			watchpoint = watchpoint->hash_next;
+		}
+		return NULL;
+	}
+
+	watchpoint = target->watchpoints;
+	while (watchpoint) {
+		if (watchpoint->address == address)
+			return watchpoint;
+		watchpoint = watchpoint->next;
+	}
+
+	return NULL;
+}
+
 int watchpoint_add(struct target *target, uint32_t address, uint32_t length,
 	enum watchpoint_rw rw, uint32_t value, uint32_t mask)
 {
@@ -421,6 +561,7 @@ int watchpoint_add(struct target *target, uint32_t address, uint32_t length,
 	(*watchpoint_p)->value = value;
 	(*watchpoint_p)->mask = mask;
 	(*watchpoint_p)->rw = rw;
+	(*watchpoint_p)->pprev = watchpoint_p;
 	(*watchpoint_p)->unique_id = bpwp_unique_id++;
 
 	retval = target_add_watchpoint(target, *watchpoint_p);
@@ -444,6 +585,8 @@ bye:
 			return retval;
 	}
 
+	watchpoint_index_add(target, *watchpoint_p);
+
 	LOG_DEBUG("added %s watchpoint at 0x%8.8" PRIx32
 		" of length 0x%8.8" PRIx32 " (WPID: %d)",
 		watchpoint_rw_strings[(*watchpoint_p)->rw],
@@ -454,36 +597,22 @@ bye:
 	return ERROR_OK;
 }
 
-static void watchpoint_free(struct target *target, struct watchpoint *watchpoint_to_remove)
+static void watchpoint_free(struct target *target, struct watchpoint *watchpoint)
 {
-	struct watchpoint *watchpoint = target->watchpoints;
-	struct watchpoint **watchpoint_p = &target->watchpoints;
 	int retval;
 
-	while (watchpoint) {
-		if (watchpoint == watchpoint_to_remove)
-			break;
-		watchpoint_p = &watchpoint->next;
-		watchpoint = watchpoint->next;
-	}
-
-	if (watchpoint == NULL)
-		return;
 	retval = target_remove_watchpoint(target, watchpoint);
 	LOG_DEBUG("free WPID: %d --> %d", watchpoint->unique_id, retval);
-	(*watchpoint_p) = watchpoint->next;
+	watchpoint_index_remove(target, watchpoint);
+	*watchpoint->pprev = watchpoint->next;
+	if (watchpoint->next)
+		watchpoint->next->pprev = watchpoint->pprev;
 	free(watchpoint);
 }
 
 void watchpoint_remove(struct target *target, uint32_t address)
 {
-	struct watchpoint *watchpoint = target->watchpoints;
-
-	while (watchpoint) {
-		if (watchpoint->address == address)
-			break;
-		watchpoint = watchpoint->next;
-	}
+	struct watchpoint *watchpoint = watchpoint_find(target, address);
 
 	if (watchpoint)
 		watchpoint_free(target, watchpoint);
@@ -497,6 +626,9 @@ void watchpoint_clear_target(struct target *target)
 		target_name(target));
 	while (target->watchpoints != NULL)
 		watchpoint_free(target, target->watchpoints);
+
+	free(target->watchpoint_hash);
+	target->watchpoint_hash = NULL;
 }
 
 int watchpoint_hit(struct target *target, enum watchpoint_rw *rw, uint32_t *address)
@@ -38,6 +38,8 @@ struct breakpoint {
 	int set;
 	uint8_t *orig_instr;
 	struct breakpoint *next;
+	struct breakpoint **pprev;	/* link pointing at this entry */
+	struct breakpoint *hash_next;
 	uint32_t unique_id;
 	int linked_BRP;
 };
@@ -50,6 +52,8 @@ struct watchpoint {
 	enum watchpoint_rw rw;
 	int set;
 	struct watchpoint *next;
+	struct watchpoint **pprev;	/* link pointing at this entry */
+	struct watchpoint *hash_next;
 	int unique_id;
 };
 
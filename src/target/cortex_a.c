@@ -801,6 +801,34 @@ static int cortex_a_bpwp_disable(struct arm_dpm *dpm, unsigned index_t)
 	return cortex_a_dap_write_memap_register_u32(dpm->arm->target, cr, 0);
 }
 
+/* as dpm_mcr(), and tells armv7a which CP15 register was written */
+static int cortex_a_mcr(struct target *target, int cpnum,
+	uint32_t op1, uint32_t op2, uint32_t CRn, uint32_t CRm,
+	uint32_t value)
+{
+	struct arm_dpm *dpm = target_to_arm(target)->dpm;
+	int retval;
+
+	retval = dpm->prepare(dpm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	LOG_DEBUG("MCR p%d, %d, r0, c%d, c%d, %d", cpnum,
+		(int) op1, (int) CRn,
+		(int) CRm, (int) op2);
+
+	/* read DCC into r0; then write coprocessor register from R0 */
+	retval = dpm->instr_write_data_r0(dpm,
+			ARMV4_5_MCR(cpnum, op1, 0, CRn, CRm, op2),
+			value);
+
+	/* (void) */ dpm->finish(dpm);
+
+	if (cpnum == 15)
+		armv7a_tlb_cp15_written(target, CRn);
+	return retval;
+}
+
 static int cortex_a_dpm_setup(struct cortex_a_common *a, uint32_t didr)
 {
 	struct arm_dpm *dpm = &a->armv7a_common.dpm;
@@ -823,8 +851,11 @@ static int cortex_a_dpm_setup(struct cortex_a_common *a, uint32_t didr)
 	dpm->bpwp_disable = cortex_a_bpwp_disable;
 
 	retval = arm_dpm_setup(dpm);
-	if (retval == ERROR_OK)
+	if (retval == ERROR_OK) {
+		/* see CP15 writes, which may change the translation */
+		a->armv7a_common.arm.mcr = cortex_a_mcr;
 		retval = arm_dpm_initialize(dpm);
+	}
 
 	return retval;
 }
@@ -842,19 +873,59 @@ static struct target *get_cortex_a(struct target *target, int32_t coreid)
 	}
 	return target;
 }
-static int cortex_a_halt(struct target *target);
+static int cortex_a_halt_request(struct target *target);
+static int cortex_a_halt_wait(struct target *target);
+
+/* Run what is queued on the DAPs of the cores marked smp_pending */
+static int cortex_a_smp_flush(struct target *target)
+{
+	int retval = 0;
+	struct target_list *head;
+	struct adiv5_dap *dap = NULL;
+
+	for (head = target->head; head != NULL; head = head->next) {
+		struct armv7a_common *armv7a = target_to_armv7a(head->target);
 
+		if (!target_to_cortex_a(head->target)->smp_pending)
+			continue;
+		if (armv7a->debug_ap->dap != dap) {
+			dap = armv7a->debug_ap->dap;
+			retval += dap_run(dap);
+		}
+	}
+	return retval;
+}
+
+/*
+ * Halt the other cores of the group together: the DRCR halt requests of
+ * all of them go out in one DAP run before waiting for the first one,
+ * so the cores stop within a few cycles of each other.
+ */
 static int cortex_a_halt_smp(struct target *target)
 {
 	int retval = 0;
 	struct target_list *head;
 	struct target *curr;
-	head = target->head;
-	while (head != (struct target_list *)NULL) {
+	int64_t start = timeval_ns();
+
+	for (head = target->head; head != NULL; head = head->next) {
 		curr = head->target;
-		if ((curr != target) && (curr->state != TARGET_HALTED))
-			retval += cortex_a_halt(curr);
-		head = head->next;
+		if ((curr != target) && (curr->state != TARGET_HALTED)) {
+			target_to_cortex_a(curr)->smp_pending = true;
+			retval += cortex_a_halt_request(curr);
+		}
+	}
+
+	retval += cortex_a_smp_flush(target);
+
+	for (head = target->head; head != NULL; head = head->next) {
+		curr = head->target;
+		if (!target_to_cortex_a(curr)->smp_pending)
+			continue;
+		target_to_cortex_a(curr)->smp_pending = false;
+		retval += cortex_a_halt_wait(curr);
+		LOG_DEBUG("core %" PRId32 " halted %" PRId64 " us after the request",
+			curr->coreid, (timeval_ns() - start) / 1000);
 	}
 	return retval;
 }
@@ -944,21 +1015,40 @@ static int cortex_a_poll(struct target *target)
 	return retval;
 }
 
+/* Queue the DRCR write telling the core to halt, it goes out with the
+ * next DAP run */
+static int cortex_a_halt_request(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+
+	return mem_ap_write_u32(armv7a->debug_ap,
+			armv7a->debug_base + CPUDBG_DRCR, DRCR_HALT);
+}
+
 static int cortex_a_halt(struct target *target)
 {
 	int retval = ERROR_OK;
-	uint32_t dscr;
 	struct armv7a_common *armv7a = target_to_armv7a(target);
 
 	/*
 	 * Tell the core to be halted by writing DRCR with 0x1
 	 * and then wait for the core to be halted.
 	 */
-	retval = mem_ap_write_atomic_u32(armv7a->debug_ap,
-			armv7a->debug_base + CPUDBG_DRCR, DRCR_HALT);
+	retval = cortex_a_halt_request(target);
+	if (retval == ERROR_OK)
+		retval = dap_run(armv7a->debug_ap->dap);
 	if (retval != ERROR_OK)
 		return retval;
 
+	return cortex_a_halt_wait(target);
+}
+
+static int cortex_a_halt_wait(struct target *target)
+{
+	int retval = ERROR_OK;
+	uint32_t dscr;
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+
 	/*
 	 * enter halting debug mode
 	 */
@@ -1060,6 +1150,9 @@ static int cortex_a_internal_restore(struct target *target, int current,
 	retval = cortex_a_restore_cp15_control_reg(target);
 	if (retval != ERROR_OK)
 		return retval;
+	/* cache maintenance for what was written while halted, it uses r0 too */
+	armv7a_cache_sync(target);
+	armv7a_tlb_invalidate(target);
 	retval = cortex_a_restore_context(target, handle_breakpoints);
 	if (retval != ERROR_OK)
 		return retval;
@@ -1086,19 +1179,19 @@ static int cortex_a_internal_restore(struct target *target, int current,
 	return retval;
 }
 
-static int cortex_a_internal_restart(struct target *target)
+/*
+ * Restart core and wait for it to be started.  Clear ITRen and sticky
+ * exception flags: see ARMv7 ARM, C5.9.  Split in three so that an SMP
+ * group can have the restart of every core go out in one DAP run.
+ *
+ * REVISIT: for single stepping, we probably want to
+ * disable IRQs by default, with optional override...
+ */
+static int cortex_a_restart_prepare(struct target *target)
 {
 	struct armv7a_common *armv7a = target_to_armv7a(target);
-	struct arm *arm = &armv7a->arm;
 	int retval;
 	uint32_t dscr;
-	/*
-	 * * Restart core and wait for it to be started.  Clear ITRen and sticky
-	 * * exception flags: see ARMv7 ARM, C5.9.
-	 *
-	 * REVISIT: for single stepping, we probably want to
-	 * disable IRQs by default, with optional override...
-	 */
 
 	retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
 			armv7a->debug_base + CPUDBG_DSCR, &dscr);
@@ -1108,16 +1201,26 @@ static int cortex_a_internal_restart(struct target *target)
 	if ((dscr & DSCR_INSTR_COMP) == 0)
 		LOG_ERROR("DSCR InstrCompl must be set before leaving debug!");
 
-	retval = mem_ap_write_atomic_u32(armv7a->debug_ap,
+	return mem_ap_write_atomic_u32(armv7a->debug_ap,
 			armv7a->debug_base + CPUDBG_DSCR, dscr & ~DSCR_ITR_EN);
-	if (retval != ERROR_OK)
-		return retval;
+}
 
-	retval = mem_ap_write_atomic_u32(armv7a->debug_ap,
+/* queued, goes out with the next DAP run */
+static int cortex_a_restart_request(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+
+	return mem_ap_write_u32(armv7a->debug_ap,
 			armv7a->debug_base + CPUDBG_DRCR, DRCR_RESTART |
 			DRCR_CLEAR_EXCEPTIONS);
-	if (retval != ERROR_OK)
-		return retval;
+}
+
+static int cortex_a_restart_wait(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	struct arm *arm = &armv7a->arm;
+	int retval;
+	uint32_t dscr;
 
 	int64_t then = timeval_ms();
 	for (;; ) {
@@ -1142,6 +1245,26 @@ static int cortex_a_internal_restart(struct target *target)
 	return ERROR_OK;
 }
 
+static int cortex_a_internal_restart(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	int retval;
+
+	retval = cortex_a_restart_prepare(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = cortex_a_restart_request(target);
+	if (retval == ERROR_OK)
+		retval = dap_run(armv7a->debug_ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return cortex_a_restart_wait(target);
+}
+
+/* Restore the context of the other halted cores of the group and mark
+ * them for cortex_a_restart_smp() */
 static int cortex_a_restore_smp(struct target *target, int handle_breakpoints)
 {
 	int retval = 0;
@@ -1155,11 +1278,56 @@ static int cortex_a_restore_smp(struct target *target, int handle_breakpoints)
 			/*  resume current address , not in step mode */
 			retval += cortex_a_internal_restore(curr, 1, &address,
 					handle_breakpoints, 0);
-			retval += cortex_a_internal_restart(curr);
+			target_to_cortex_a(curr)->smp_pending = true;
 		}
 		head = head->next;
 
 	}
+
+	/* cortex_a_resume() gives up, restart none of them */
+	if (retval != ERROR_OK) {
+		for (head = target->head; head != NULL; head = head->next)
+			target_to_cortex_a(head->target)->smp_pending = false;
+	}
+	return retval;
+}
+
+/* Restart @a target and the cores cortex_a_restore_smp() marked with
+ * one DAP run carrying all the DRCR writes */
+static int cortex_a_restart_smp(struct target *target)
+{
+	int retval = 0;
+	struct target_list *head;
+	struct target *curr;
+
+	target_to_cortex_a(target)->smp_pending = true;
+
+	for (head = target->head; head != NULL; head = head->next) {
+		curr = head->target;
+		if (!target_to_cortex_a(curr)->smp_pending)
+			continue;
+		int retval2 = cortex_a_restart_prepare(curr);
+		if (retval2 != ERROR_OK) {
+			target_to_cortex_a(curr)->smp_pending = false;
+			retval += retval2;
+		}
+	}
+
+	for (head = target->head; head != NULL; head = head->next) {
+		curr = head->target;
+		if (target_to_cortex_a(curr)->smp_pending)
+			retval += cortex_a_restart_request(curr);
+	}
+
+	retval += cortex_a_smp_flush(target);
+
+	for (head = target->head; head != NULL; head = head->next) {
+		curr = head->target;
+		if (!target_to_cortex_a(curr)->smp_pending)
+			continue;
+		target_to_cortex_a(curr)->smp_pending = false;
+		retval += cortex_a_restart_wait(curr);
+	}
 	return retval;
 }
 
@@ -1182,8 +1350,9 @@ static int cortex_a_resume(struct target *target, int current,
 		retval = cortex_a_restore_smp(target, handle_breakpoints);
 		if (retval != ERROR_OK)
 			return retval;
-	}
-	cortex_a_internal_restart(target);
+		cortex_a_restart_smp(target);
+	} else
+		cortex_a_internal_restart(target);
 
 	if (!debug_execution) {
 		target->state = TARGET_RUNNING;
@@ -1211,6 +1380,9 @@ static int cortex_a_debug_entry(struct target *target)
 
 	LOG_DEBUG("dscr = 0x%08" PRIx32, cortex_a->cpudbg_dscr);
 
+	/* also after a reset, which doesn't go through restore */
+	armv7a_tlb_invalidate(target);
+
 	/* REVISIT surely we should not re-read DSCR !! */
 	retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
 			armv7a->debug_base + CPUDBG_DSCR, &dscr);
@@ -1560,11 +1732,9 @@ static int cortex_a_set_breakpoint(struct target *target,
 		if (retval != ERROR_OK)
 			return retval;
 
-		/* update i-cache at breakpoint location */
-		armv7a_l1_d_cache_inval_virt(target, breakpoint->address,
+		/* update i-cache at breakpoint location, on resume */
+		armv7a_cache_mark_dirty(target, breakpoint->address,
 					breakpoint->length);
-		armv7a_l1_i_cache_inval_virt(target, breakpoint->address,
-						 breakpoint->length);
 
 		breakpoint->set = 0x11;	/* Any nice value but 0 */
 	}
@@ -1807,11 +1977,9 @@ static int cortex_a_unset_breakpoint(struct target *target, struct breakpoint *b
 				return retval;
 		}
 
-		/* update i-cache at breakpoint location */
-		armv7a_l1_d_cache_inval_virt(target, breakpoint->address,
-						 breakpoint->length);
-		armv7a_l1_i_cache_inval_virt(target, breakpoint->address,
-						 breakpoint->length);
+		/* update i-cache at breakpoint location, on resume */
+		armv7a_cache_mark_dirty(target, breakpoint->address,
+					breakpoint->length);
 	}
 	breakpoint->set = 0;
 
@@ -2666,13 +2834,69 @@ out:
  * ap number for every access.
  */
 
+/* Above this size the whole data cache is flushed instead of its lines */
+#define CORTEX_A_MEMAP_FLUSH_ALL	(64 * 1024)
+
+/* Use the memory AP, when it is selected, or automatically while halted */
+static bool cortex_a_use_memap(struct target *target)
+{
+	struct cortex_a_common *cortex_a = target_to_cortex_a(target);
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+
+	if (!armv7a->memory_ap_available)
+		return false;
+
+	if (armv7a->arm.dap->apsel == armv7a->memory_ap->ap_num)
+		return true;
+
+	return cortex_a->memap_mode == CORTEX_A_MEMAP_AUTO &&
+		target->state == TARGET_HALTED;
+}
+
+/* The virtual address of a physical one, when the MMU is off */
+static bool cortex_a_phys_is_virt(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	int mmu_enabled = 0;
+
+	if (armv7a->is_armv7r)
+		return true;
+
+	if (cortex_a_mmu(target, &mmu_enabled) != ERROR_OK)
+		return false;
+
+	return !mmu_enabled;
+}
+
+/*
+ * The memory AP sees memory behind the caches: write back and invalidate
+ * the lines of a range before accessing it, so a read gets what the core
+ * wrote and the core refetches what is written. A physical address is
+ * also the virtual one only with the MMU off, otherwise the whole data
+ * cache is flushed.
+ */
+static void cortex_a_memap_sync(struct target *target, bool phys,
+	uint32_t address, uint32_t size)
+{
+	struct cortex_a_common *cortex_a = target_to_cortex_a(target);
+
+	/* the outer cache is flushed through physical writes, which end up here */
+	if (target->state != TARGET_HALTED || cortex_a->memap_syncing)
+		return;
+
+	cortex_a->memap_syncing = true;
+	if (size > CORTEX_A_MEMAP_FLUSH_ALL || (phys && !cortex_a_phys_is_virt(target)))
+		armv7a_cache_auto_flush_all_data(target);
+	else
+		armv7a_cache_auto_flush_on_write(target, address, size);
+	cortex_a->memap_syncing = false;
+}
+
 static int cortex_a_read_phys_memory(struct target *target,
 	uint32_t address, uint32_t size,
 	uint32_t count, uint8_t *buffer)
 {
 	struct armv7a_common *armv7a = target_to_armv7a(target);
-	struct adiv5_dap *swjdp = armv7a->arm.dap;
-	uint8_t apsel = swjdp->apsel;
 	int retval;
 
 	if (!count || !buffer)
@@ -2681,8 +2905,10 @@ static int cortex_a_read_phys_memory(struct target *target,
 	LOG_DEBUG("Reading memory at real address 0x%" PRIx32 "; size %" PRId32 "; count %" PRId32,
 		address, size, count);
 
-	if (armv7a->memory_ap_available && (apsel == armv7a->memory_ap->ap_num))
+	if (cortex_a_use_memap(target)) {
+		cortex_a_memap_sync(target, true, address, size * count);
 		return mem_ap_read_buf(armv7a->memory_ap, buffer, size, count, address);
+	}
 
 	/* read memory through the CPU */
 	cortex_a_prep_memaccess(target, 1);
@@ -2712,13 +2938,11 @@ static int cortex_a_read_memory_ahb(struct target *target, uint32_t address,
 	uint32_t size, uint32_t count, uint8_t *buffer)
 {
 	int mmu_enabled = 0;
-	uint32_t virt, phys;
+	uint32_t virt = address, phys;
 	int retval;
 	struct armv7a_common *armv7a = target_to_armv7a(target);
-	struct adiv5_dap *swjdp = armv7a->arm.dap;
-	uint8_t apsel = swjdp->apsel;
 
-	if (!armv7a->memory_ap_available || (apsel != armv7a->memory_ap->ap_num))
+	if (!cortex_a_use_memap(target))
 		return target_read_memory(target, address, size, count, buffer);
 
 	/* cortex_a handles unaligned memory access */
@@ -2733,7 +2957,6 @@ static int cortex_a_read_memory_ahb(struct target *target, uint32_t address,
 	}
 
 	if (mmu_enabled) {
-		virt = address;
 		retval = cortex_a_virt2phys(target, virt, &phys);
 		if (retval != ERROR_OK)
 			return retval;
@@ -2746,6 +2969,8 @@ static int cortex_a_read_memory_ahb(struct target *target, uint32_t address,
 	if (!count || !buffer)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	cortex_a_memap_sync(target, false, virt, size * count);
+
 	retval = mem_ap_read_buf(armv7a->memory_ap, buffer, size, count, address);
 
 	return retval;
@@ -2756,8 +2981,6 @@ static int cortex_a_write_phys_memory(struct target *target,
 	uint32_t count, const uint8_t *buffer)
 {
 	struct armv7a_common *armv7a = target_to_armv7a(target);
-	struct adiv5_dap *swjdp = armv7a->arm.dap;
-	uint8_t apsel = swjdp->apsel;
 	int retval;
 
 	if (!count || !buffer)
@@ -2766,8 +2989,10 @@ static int cortex_a_write_phys_memory(struct target *target,
 	LOG_DEBUG("Writing memory to real address 0x%" PRIx32 "; size %" PRId32 "; count %" PRId32, address,
 		size, count);
 
-	if (armv7a->memory_ap_available && (apsel == armv7a->memory_ap->ap_num))
+	if (cortex_a_use_memap(target)) {
+		cortex_a_memap_sync(target, true, address, size * count);
 		return mem_ap_write_buf(armv7a->memory_ap, buffer, size, count, address);
+	}
 
 	/* write memory through the CPU */
 	cortex_a_prep_memaccess(target, 1);
@@ -2780,18 +3005,29 @@ static int cortex_a_write_phys_memory(struct target *target,
 static int cortex_a_write_memory(struct target *target, uint32_t address,
 	uint32_t size, uint32_t count, const uint8_t *buffer)
 {
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	int mmu_enabled = 0;
 	int retval;
 
 	/* cortex_a handles unaligned memory access */
 	LOG_DEBUG("Writing memory at address 0x%" PRIx32 "; size %" PRId32 "; count %" PRId32, address,
 		size, count);
 
-	/* memory writes bypass the caches, must flush before writing */
-	armv7a_cache_auto_flush_on_write(target, address, size * count);
+	/* with the MMU off, memory writes bypass the caches, must flush
+	 * before writing; with it on they go through the data cache, which
+	 * is made coherent with memory and the i-cache on resume */
+	if (!armv7a->is_armv7r)
+		cortex_a_mmu(target, &mmu_enabled);
+	if (!mmu_enabled)
+		armv7a_cache_auto_flush_on_write(target, address, size * count);
 
 	cortex_a_prep_memaccess(target, 0);
 	retval = cortex_a_write_cpu_memory(target, address, size, count, buffer);
 	cortex_a_post_memaccess(target, 0);
+
+	if (armv7a->armv7a_mmu.armv7a_cache.auto_cache_enabled)
+		armv7a_cache_mark_dirty(target, address, size * count);
+
 	return retval;
 }
 
@@ -2799,13 +3035,11 @@ static int cortex_a_write_memory_ahb(struct target *target, uint32_t address,
 	uint32_t size, uint32_t count, const uint8_t *buffer)
 {
 	int mmu_enabled = 0;
-	uint32_t virt, phys;
+	uint32_t virt = address, phys;
 	int retval;
 	struct armv7a_common *armv7a = target_to_armv7a(target);
-	struct adiv5_dap *swjdp = armv7a->arm.dap;
-	uint8_t apsel = swjdp->apsel;
 
-	if (!armv7a->memory_ap_available || (apsel != armv7a->memory_ap->ap_num))
+	if (!cortex_a_use_memap(target))
 		return target_write_memory(target, address, size, count, buffer);
 
 	/* cortex_a handles unaligned memory access */
@@ -2820,7 +3054,6 @@ static int cortex_a_write_memory_ahb(struct target *target, uint32_t address,
 	}
 
 	if (mmu_enabled) {
-		virt = address;
 		retval = cortex_a_virt2phys(target, virt, &phys);
 		if (retval != ERROR_OK)
 			return retval;
@@ -2834,6 +3067,8 @@ static int cortex_a_write_memory_ahb(struct target *target, uint32_t address,
 	if (!count || !buffer)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	cortex_a_memap_sync(target, false, virt, size * count);
+
 	retval = mem_ap_write_buf(armv7a->memory_ap, buffer, size, count, address);
 
 	return retval;
@@ -3244,10 +3479,21 @@ static int cortex_a_virt2phys(struct target *target,
 	struct armv7a_common *armv7a = target_to_armv7a(target);
 	struct adiv5_dap *swjdp = armv7a->arm.dap;
 	uint8_t apsel = swjdp->apsel;
+	bool hit;
+
+	retval = armv7a_tlb_lookup(target, virt, phys, &hit);
+	if (retval != ERROR_OK || hit)
+		return retval;
+
 	if (armv7a->memory_ap_available && (apsel == armv7a->memory_ap->ap_num)) {
+		struct cortex_a_common *cortex_a = target_to_cortex_a(target);
+		bool syncing = cortex_a->memap_syncing;
 		uint32_t ret;
+		/* no cache flush for each read of the table walk */
+		cortex_a->memap_syncing = true;
 		retval = armv7a_mmu_translate_va(target,
 				virt, &ret);
+		cortex_a->memap_syncing = syncing;
 		if (retval != ERROR_OK)
 			goto done;
 		*phys = ret;
@@ -3257,6 +3503,8 @@ static int cortex_a_virt2phys(struct target *target,
 		if (retval != ERROR_OK)
 			goto done;
 		retval = armv7a_mmu_translate_va_pa(target, virt,  phys, 1);
+		if (retval == ERROR_OK)
+			armv7a_tlb_insert(target, virt, *phys, 0xfffff000);
 	}
 done:
 	return retval;
@@ -3394,6 +3642,31 @@ COMMAND_HANDLER(handle_cortex_a_dacrfixup_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_cortex_a_memap_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct cortex_a_common *cortex_a = target_to_cortex_a(target);
+
+	static const Jim_Nvp nvp_memap_modes[] = {
+		{ .name = "auto", .value = CORTEX_A_MEMAP_AUTO },
+		{ .name = "off", .value = CORTEX_A_MEMAP_OFF },
+		{ .name = NULL, .value = -1 },
+	};
+	const Jim_Nvp *n;
+
+	if (CMD_ARGC > 0) {
+		n = Jim_Nvp_name2value_simple(nvp_memap_modes, CMD_ARGV[0]);
+		if (n->name == NULL)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		cortex_a->memap_mode = n->value;
+	}
+
+	n = Jim_Nvp_value2name_simple(nvp_memap_modes, cortex_a->memap_mode);
+	command_print(CMD_CTX, "cortex_a memory AP bulk access %s", n->name);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration cortex_a_exec_command_handlers[] = {
 	{
 		.name = "cache_info",
@@ -3443,6 +3716,14 @@ static const struct command_registration cortex_a_exec_command_handlers[] = {
 			"on memory access",
 		.usage = "['on'|'off']",
 	},
+	{
+		.name = "memap",
+		.handler = handle_cortex_a_memap_command,
+		.mode = COMMAND_ANY,
+		.help = "use the memory AP for bulk and physical memory "
+			"accesses while halted",
+		.usage = "['auto'|'off']",
+	},
 
 	COMMAND_REGISTRATION_DONE
 };
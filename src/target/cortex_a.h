@@ -63,6 +63,11 @@ enum cortex_a_dacrfixup_mode {
 	CORTEX_A_DACRFIXUP_ON
 };
 
+enum cortex_a_memap_mode {
+	CORTEX_A_MEMAP_AUTO,
+	CORTEX_A_MEMAP_OFF
+};
+
 struct cortex_a_brp {
 	int used;
 	int type;
@@ -103,6 +108,13 @@ struct cortex_a_common {
 
 	enum cortex_a_isrmasking_mode isrmasking_mode;
 	enum cortex_a_dacrfixup_mode dacrfixup_mode;
+	/* bulk accesses through the memory AP while halted */
+	enum cortex_a_memap_mode memap_mode;
+	/* no cache maintenance around memory AP accesses, while doing it */
+	bool memap_syncing;
+
+	/* part of the SMP halt or restart being fanned out */
+	bool smp_pending;
 
 	struct armv7a_common armv7a_common;
 
@@ -38,6 +38,7 @@
 #include "register.h"
 #include "arm_opcodes.h"
 #include "arm_semihosting.h"
+#include "armv7m_coverage.h"
 #include <helper/time_support.h>
 
 /* NOTE:  most of this should work fine for the Cortex-M1 and
@@ -127,12 +128,163 @@ static int cortexm_dap_write_coreregister_u32(struct target *target,
 	return retval;
 }
 
+/* Most registers one cortex_m_store_core_reg_list() call is given, S0..S31,
+ * FPSCR and the core registers with room to spare */
+#define CORTEX_M_MAX_REG_LIST	96
+
+/**
+ * Write several core registers with a single DAP run.  Each DCRDR and
+ * DCRSR write is followed by a DHCSR read, which both leaves the core
+ * time to finish the transfer before the next DCRDR write and tells
+ * whether it did; if S_REGRDY was ever clear, the write is reported as
+ * failed and the caller falls back to one register at a time.
+ */
+static int cortex_m_store_core_reg_list(struct target *target,
+		const uint32_t *regsel, const uint32_t *value, unsigned int count)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	uint32_t dhcsr[CORTEX_M_MAX_REG_LIST];
+	uint32_t dcrdr;
+	int retval;
+
+	if (count > CORTEX_M_MAX_REG_LIST)
+		return ERROR_FAIL;
+
+	/* see cortexm_dap_write_coreregister_u32() */
+	if (target->dbg_msg_enabled) {
+		retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DCRDR, &dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRDR, value[i]);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRSR, regsel[i] | DCRSR_WnR);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DHCSR, &dhcsr[i]);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	retval = dap_run(armv7m->debug_ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (target->dbg_msg_enabled) {
+		retval = mem_ap_write_atomic_u32(armv7m->debug_ap, DCB_DCRDR, dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (!(dhcsr[i] & S_REGRDY)) {
+			LOG_DEBUG("register %" PRIu32 " not ready", regsel[i]);
+			return ERROR_FAIL;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* Most FPB comparators a core can have, 127 code and 15 literal */
+#define FP_MAX_COMPARATORS	142
+
+/**
+ * Write the FPB and DWT comparators whose shadow differs from what the
+ * hardware was last given.  While the core is halted, setting and
+ * clearing breakpoints and watchpoints only touches the shadow, so the
+ * remove-all, insert-all of GDB around each stop costs nothing when the
+ * same comparators come back, and the rest goes out here just before
+ * the core is released.  Runs of neighbouring FPB comparators and the
+ * three DWT registers of a comparator go out as one memory write each.
+ */
+int cortex_m_sync_comparators(struct target *target)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = &cortex_m->armv7m;
+	struct cortex_m_fp_comparator *fp = cortex_m->fp_comparator_list;
+	int fp_num = cortex_m->fp_num_code + cortex_m->fp_num_lit;
+	uint8_t buf[4 * FP_MAX_COMPARATORS];
+	int retval;
+
+	for (int i = 0; fp && i < fp_num; ) {
+		if (fp[i].hw_valid && fp[i].fpcr_hw == fp[i].fpcr_value) {
+			i++;
+			continue;
+		}
+
+		int first = i;
+		for (; i < fp_num && !(fp[i].hw_valid && fp[i].fpcr_hw == fp[i].fpcr_value); i++)
+			target_buffer_set_u32(target, buf + 4 * (i - first), fp[i].fpcr_value);
+
+		retval = target_write_memory(target, fp[first].fpcr_address, 4, i - first, buf);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (int j = first; j < i; j++) {
+			fp[j].fpcr_hw = fp[j].fpcr_value;
+			fp[j].hw_valid = true;
+		}
+	}
+
+	for (int i = 0; cortex_m->dwt_comparator_list && i < cortex_m->dwt_num_comp; i++) {
+		struct cortex_m_dwt_comparator *c = cortex_m->dwt_comparator_list + i;
+		bool comp = !c->hw_valid || c->comp_hw != c->comp;
+		bool function = !c->hw_valid || c->function_hw != c->function;
+
+		if (!armv7m->arm.is_armv8m) {
+			if (!comp && !function && c->hw_valid && c->mask_hw == c->mask)
+				continue;
+
+			target_buffer_set_u32(target, buf + 0, c->comp);
+			target_buffer_set_u32(target, buf + 4, c->mask);
+			target_buffer_set_u32(target, buf + 8, c->function);
+			retval = target_write_memory(target, c->dwt_comparator_address, 4, 3, buf);
+		} else {
+			/* no DWT_MASK, the mask is part of DWT_FUNCTION */
+			retval = ERROR_OK;
+			if (comp)
+				retval = target_write_u32(target, c->dwt_comparator_address, c->comp);
+			if (retval == ERROR_OK && function)
+				retval = target_write_u32(target, c->dwt_comparator_address + 8,
+						c->function);
+		}
+		if (retval != ERROR_OK)
+			return retval;
+
+		c->comp_hw = c->comp;
+		c->mask_hw = c->mask;
+		c->function_hw = c->function;
+		c->hw_valid = true;
+	}
+
+	return ERROR_OK;
+}
+
+/* while halted, comparator changes wait for the core to be released */
+static int cortex_m_comparators_changed(struct target *target)
+{
+	if (target->state == TARGET_HALTED)
+		return ERROR_OK;
+
+	return cortex_m_sync_comparators(target);
+}
+
 static int cortex_m_write_debug_halt_mask(struct target *target,
 	uint32_t mask_on, uint32_t mask_off)
 {
 	struct cortex_m_common *cortex_m = target_to_cm(target);
 	struct armv7m_common *armv7m = &cortex_m->armv7m;
 
+	if ((mask_off & C_HALT) && !(mask_on & C_HALT)) {
+		int retval = cortex_m_sync_comparators(target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
 	/* mask off status bits */
 	cortex_m->dcb_dhcsr &= ~((0xFFFF << 16) | mask_off);
 	/* create new register mask */
@@ -171,6 +323,10 @@ static int cortex_m_single_step_core(struct target *target)
 	uint32_t dhcsr_save;
 	int retval;
 
+	retval = cortex_m_sync_comparators(target);
+	if (retval != ERROR_OK)
+		return retval;
+
 	/* backup dhcsr reg */
 	dhcsr_save = cortex_m->dcb_dhcsr;
 
@@ -274,28 +430,14 @@ static int cortex_m_endreset_event(struct target *target)
 
 	cortex_m->fpb_enabled = 1;
 
-	/* Restore FPB registers */
-	for (i = 0; i < cortex_m->fp_num_code + cortex_m->fp_num_lit; i++) {
-		retval = target_write_u32(target, fp_list[i].fpcr_address, fp_list[i].fpcr_value);
-		if (retval != ERROR_OK)
-			return retval;
-	}
-
-	/* Restore DWT registers */
-	for (i = 0; i < cortex_m->dwt_num_comp; i++) {
-		retval = target_write_u32(target, dwt_list[i].dwt_comparator_address + 0,
-				dwt_list[i].comp);
-		if (retval != ERROR_OK)
-			return retval;
-		retval = target_write_u32(target, dwt_list[i].dwt_comparator_address + 4,
-				dwt_list[i].mask);
-		if (retval != ERROR_OK)
-			return retval;
-		retval = target_write_u32(target, dwt_list[i].dwt_comparator_address + 8,
-				dwt_list[i].function);
-		if (retval != ERROR_OK)
-			return retval;
-	}
+	/* Restore FPB and DWT registers */
+	for (i = 0; i < cortex_m->fp_num_code + cortex_m->fp_num_lit; i++)
+		fp_list[i].hw_valid = false;
+	for (i = 0; i < cortex_m->dwt_num_comp; i++)
+		dwt_list[i].hw_valid = false;
+	retval = cortex_m_sync_comparators(target);
+	if (retval != ERROR_OK)
+		return retval;
 	retval = dap_run(swjdp);
 	if (retval != ERROR_OK)
 		return retval;
@@ -546,6 +688,8 @@ static int cortex_m_poll(struct target *target)
 
 			if (arm_semihosting(target, &retval) != 0)
 				return retval;
+			if (armv7m_coverage_hit(target, &retval) != 0)
+				return retval;
 
 			target_call_event_callbacks(target, TARGET_EVENT_HALTED);
 		}
@@ -1152,8 +1296,9 @@ int cortex_m_set_breakpoint(struct target *target, struct breakpoint *breakpoint
 
 		comparator_list[fp_num].used = 1;
 		comparator_list[fp_num].fpcr_value = fpcr_value;
-		target_write_u32(target, comparator_list[fp_num].fpcr_address,
-			comparator_list[fp_num].fpcr_value);
+		retval = cortex_m_comparators_changed(target);
+		if (retval != ERROR_OK)
+			return retval;
 		LOG_DEBUG("fpc_num %i fpcr_value 0x%" PRIx32 "",
 			fp_num,
 			comparator_list[fp_num].fpcr_value);
@@ -1226,8 +1371,9 @@ int cortex_m_unset_breakpoint(struct target *target, struct breakpoint *breakpoi
 		}
 		comparator_list[fp_num].used = 0;
 		comparator_list[fp_num].fpcr_value = 0;
-		target_write_u32(target, comparator_list[fp_num].fpcr_address,
-			comparator_list[fp_num].fpcr_value);
+		retval = cortex_m_comparators_changed(target);
+		if (retval != ERROR_OK)
+			return retval;
 	} else {
 		/* restore original instruction (kept in target endianness) */
 		if (breakpoint->length == 4) {
@@ -1350,13 +1496,9 @@ int cortex_m_set_watchpoint(struct target *target, struct watchpoint *watchpoint
 	watchpoint->set = dwt_num + 1;
 
 	comparator->comp = watchpoint->address;
-	target_write_u32(target, comparator->dwt_comparator_address + 0,
-		comparator->comp);
 
 	if (!armv7m->arm.is_armv8m) {
 		comparator->mask = mask;
-		target_write_u32(target, comparator->dwt_comparator_address + 4,
-			comparator->mask);
 
 		switch (watchpoint->rw) {
 		case WPT_READ:
@@ -1369,8 +1511,6 @@ int cortex_m_set_watchpoint(struct target *target, struct watchpoint *watchpoint
 			comparator->function = 7;
 			break;
 		}
-		target_write_u32(target, comparator->dwt_comparator_address + 8,
-			comparator->function);
 
 		LOG_DEBUG("Watchpoint (ID %d) DWT%d 0x%08x 0x%x 0x%05x",
 			watchpoint->unique_id, dwt_num,
@@ -1405,8 +1545,6 @@ int cortex_m_set_watchpoint(struct target *target, struct watchpoint *watchpoint
 		}
 
 		comparator->function = comparator->function + (mask << 10) + (1 << 4);
-		target_write_u32(target, comparator->dwt_comparator_address + 8,
-			comparator->function);
 
 		LOG_DEBUG("Watchpoint (ID %d) DWT%d 0x%08x 0x%08x",
 			watchpoint->unique_id, dwt_num,
@@ -1414,7 +1552,7 @@ int cortex_m_set_watchpoint(struct target *target, struct watchpoint *watchpoint
 			(unsigned)comparator->function);
 	}
 
-	return ERROR_OK;
+	return cortex_m_comparators_changed(target);
 }
 
 int cortex_m_unset_watchpoint(struct target *target, struct watchpoint *watchpoint)
@@ -1443,12 +1581,10 @@ int cortex_m_unset_watchpoint(struct target *target, struct watchpoint *watchpoi
 	comparator = cortex_m->dwt_comparator_list + dwt_num;
 	comparator->used = 0;
 	comparator->function = 0;
-	target_write_u32(target, comparator->dwt_comparator_address + 8,
-		comparator->function);
 
 	watchpoint->set = false;
 
-	return ERROR_OK;
+	return cortex_m_comparators_changed(target);
 }
 
 int cortex_m_add_watchpoint(struct target *target, struct watchpoint *watchpoint)
@@ -1519,6 +1655,83 @@ int cortex_m_remove_watchpoint(struct target *target, struct watchpoint *watchpo
 	return ERROR_OK;
 }
 
+/**
+ * Set a DWT comparator to send the values read and/or written at
+ * @a address through ITM data trace, without halting.  Only comparators
+ * 0 to 3 can be named by data trace packets.  The comparator taken is
+ * returned in @a dwt_num and counts against the watchpoints.
+ */
+int cortex_m_dwt_trace_add(struct target *target, uint32_t address,
+		uint32_t length, enum watchpoint_rw rw, unsigned int *dwt_num)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = &cortex_m->armv7m;
+	struct cortex_m_dwt_comparator *comparator = NULL;
+	unsigned int mask, num;
+
+	for (mask = 0; mask < 3; mask++) {
+		if ((1u << mask) == length)
+			break;
+	}
+	if (mask == 3 || (address & (length - 1))) {
+		LOG_ERROR("data trace needs an aligned 1, 2 or 4 byte variable");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	for (num = 0; num < 4 && num < (unsigned int)cortex_m->dwt_num_comp; num++) {
+		if (!cortex_m->dwt_comparator_list[num].used) {
+			comparator = cortex_m->dwt_comparator_list + num;
+			break;
+		}
+	}
+	if (!comparator || cortex_m->dwt_comp_available < 1) {
+		LOG_ERROR("no free DWT comparator among the first four");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	comparator->used = 1;
+	comparator->comp = address;
+	if (!armv7m->arm.is_armv8m) {
+		/* data value packet on read and write, read only, write only */
+		static const uint32_t function[] = {
+			[WPT_ACCESS] = 0x2, [WPT_READ] = 0xc, [WPT_WRITE] = 0xd,
+		};
+		comparator->mask = mask;
+		comparator->function = function[rw];
+	} else {
+		/* MATCH of a data address, ACTION data value packet, DATAVSIZE */
+		static const uint32_t match[] = {
+			[WPT_ACCESS] = 4, [WPT_WRITE] = 5, [WPT_READ] = 6,
+		};
+		comparator->mask = mask;
+		comparator->function = match[rw] | (3 << 4) | (mask << 10);
+	}
+
+	cortex_m->dwt_comp_available--;
+	*dwt_num = num;
+
+	LOG_DEBUG("data trace DWT%u 0x%08" PRIx32 " 0x%08" PRIx32, num,
+		comparator->comp, comparator->function);
+
+	return cortex_m_comparators_changed(target);
+}
+
+int cortex_m_dwt_trace_remove(struct target *target, unsigned int dwt_num)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct cortex_m_dwt_comparator *comparator;
+
+	if (dwt_num >= (unsigned int)cortex_m->dwt_num_comp)
+		return ERROR_OK;
+
+	comparator = cortex_m->dwt_comparator_list + dwt_num;
+	comparator->used = 0;
+	comparator->function = 0;
+	cortex_m->dwt_comp_available++;
+
+	return cortex_m_comparators_changed(target);
+}
+
 void cortex_m_enable_watchpoints(struct target *target)
 {
 	struct watchpoint *watchpoint = target->watchpoints;
@@ -1744,6 +1957,7 @@ void cortex_m_deinit_target(struct target *target)
 
 	cortex_m_dwt_free(target);
 	armv7m_free_reg_cache(target);
+	armv7m_coverage_free(cortex_m->armv7m.coverage);
 
 	free(cortex_m);
 }
@@ -1775,9 +1989,32 @@ static int cortex_m_dwt_get_reg(struct reg *reg)
 static int cortex_m_dwt_set_reg(struct reg *reg, uint8_t *buf)
 {
 	struct dwt_reg_state *state = reg->arch_info;
+	struct cortex_m_common *cm = target_to_cm(state->target);
+	uint32_t value = buf_get_u32(buf, 0, reg->size);
+
+	int retval = target_write_u32(state->target, state->addr, value);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* a comparator set up by hand is kept, shadow and hardware agree */
+	uint32_t offset = state->addr - DWT_COMP0;
+	if (state->addr >= DWT_COMP0 && offset / 0x10 < (uint32_t)cm->dwt_num_comp) {
+		struct cortex_m_dwt_comparator *c = cm->dwt_comparator_list + offset / 0x10;
+
+		switch (offset % 0x10) {
+		case 0:
+			c->comp = c->comp_hw = value;
+			break;
+		case 4:
+			c->mask = c->mask_hw = value;
+			break;
+		case 8:
+			c->function = c->function_hw = value;
+			break;
+		}
+	}
 
-	return target_write_u32(state->target, state->addr,
-			buf_get_u32(buf, 0, reg->size));
+	return ERROR_OK;
 }
 
 struct dwt_reg {
@@ -2106,7 +2343,7 @@ int cortex_m_examine(struct target *target)
 			armv7m->arm.core_cache->num_regs = ARMV7M_NUM_CORE_REGS_NOFP;
 		}
 
-		if (!armv7m->stlink) {
+		if (!armv7m->stlink && !armv7m->debug_ap->tar_autoincr_user) {
 			if (i == 3 || i == 4)
 				/* Cortex-M3/M4 have 4096 bytes autoincrement range,
 				 * s. ARM IHI 0031C: MEM-AP 7.2.2 */
@@ -2147,9 +2384,6 @@ int cortex_m_examine(struct target *target)
 			cortex_m->fp_comparator_list[i].type =
 				(i < cortex_m->fp_num_code) ? FPCR_CODE : FPCR_LITERAL;
 			cortex_m->fp_comparator_list[i].fpcr_address = FP_COMP0 + 4 * i;
-
-			/* make sure we clear any breakpoints enabled on the target */
-			target_write_u32(target, cortex_m->fp_comparator_list[i].fpcr_address, 0);
 		}
 		LOG_DEBUG("FPB fpcr 0x%" PRIx32 ", numcode %i, numlit %i",
 			fpcr,
@@ -2160,6 +2394,10 @@ int cortex_m_examine(struct target *target)
 		cortex_m_dwt_free(target);
 		cortex_m_dwt_setup(cortex_m, target);
 
+		/* make sure we clear any breakpoints and watchpoints enabled
+		 * on the target, the shadows start out all zero */
+		cortex_m_sync_comparators(target);
+
 		/* These hardware breakpoints only work for code in flash! */
 		LOG_INFO("%s: hardware has %d breakpoints, %d watchpoints",
 			target_name(target),
@@ -2248,6 +2486,8 @@ static int cortex_m_handle_target_request(void *priv)
 			}
 			target_request(target, request);
 		}
+
+		return target_request_ring_poll(target);
 	}
 
 	return ERROR_OK;
@@ -2283,6 +2523,7 @@ static int cortex_m_init_arch_info(struct target *target,
 
 	armv7m->load_core_reg_u32 = cortex_m_load_core_reg_u32;
 	armv7m->store_core_reg_u32 = cortex_m_store_core_reg_u32;
+	armv7m->store_core_reg_list = cortex_m_store_core_reg_list;
 
 	target_register_timer_callback(cortex_m_handle_target_request, 1, 1, target);
 
@@ -2544,7 +2785,9 @@ struct target_type cortexm_target = {
 	.read_memory = cortex_m_read_memory,
 	.write_memory = cortex_m_write_memory,
 	.checksum_memory = armv7m_checksum_memory,
+	.checksum_memory_chunks = armv7m_checksum_memory_chunks,
 	.blank_check_memory = armv7m_blank_check_memory,
+	.blank_check_memory_blocks = armv7m_blank_check_memory_blocks,
 
 	.run_algorithm = armv7m_run_algorithm,
 	.start_algorithm = armv7m_start_algorithm,
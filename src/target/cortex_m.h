@@ -26,6 +26,7 @@
 #define OPENOCD_TARGET_CORTEX_M_H
 
 #include "armv7m.h"
+#include "breakpoints.h"
 
 #define CORTEX_M_COMMON_MAGIC 0x1A451A45
 
@@ -48,6 +49,7 @@
 
 #define DWT_CTRL	0xE0001000
 #define DWT_CYCCNT	0xE0001004
+#define DWT_PCSR	0xE000101C
 #define DWT_COMP0	0xE0001020
 #define DWT_MASK0	0xE0001024
 #define DWT_FUNCTION0	0xE0001028
@@ -151,11 +153,16 @@
 #define NUC_M23_FLASH_VERSION  0x50003FFC
 #define NUC_M23_FLASH_MSB5     0x20201130 /* most significant bit is 5 */
 
+/* The values of a comparator are a shadow, written to the hardware by
+ * cortex_m_sync_comparators(); the _hw fields hold what it was last
+ * given, valid once hw_valid is set. */
 struct cortex_m_fp_comparator {
 	int used;
 	int type;
 	uint32_t fpcr_value;
 	uint32_t fpcr_address;
+	uint32_t fpcr_hw;
+	bool hw_valid;
 };
 
 struct cortex_m_dwt_comparator {
@@ -164,6 +171,8 @@ struct cortex_m_dwt_comparator {
 	uint32_t mask;
 	uint32_t function;
 	uint32_t dwt_comparator_address;
+	uint32_t comp_hw, mask_hw, function_hw;
+	bool hw_valid;
 };
 
 enum cortex_m_soft_reset_config {
@@ -225,6 +234,10 @@ int cortex_m_add_watchpoint(struct target *target, struct watchpoint *watchpoint
 int cortex_m_remove_watchpoint(struct target *target, struct watchpoint *watchpoint);
 void cortex_m_enable_breakpoints(struct target *target);
 void cortex_m_enable_watchpoints(struct target *target);
+int cortex_m_dwt_trace_add(struct target *target, uint32_t address,
+		uint32_t length, enum watchpoint_rw rw, unsigned int *dwt_num);
+int cortex_m_dwt_trace_remove(struct target *target, unsigned int dwt_num);
+int cortex_m_sync_comparators(struct target *target);
 void cortex_m_dwt_setup(struct cortex_m_common *cm, struct target *target);
 void cortex_m_deinit_target(struct target *target);
 
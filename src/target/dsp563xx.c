@@ -842,8 +842,61 @@ static int dsp563xx_write_register(struct target *target, int num, int force)
 
 static int dsp563xx_save_context(struct target *target)
 {
+	struct dsp563xx_common *dsp563xx = target_to_dsp563xx(target);
+	struct dsp563xx_core_reg *arch_info;
+	bool queued[DSP563XX_NUMCOREREGS] = { false };
+	uint32_t instr;
 	int i, err = ERROR_OK;
 
+	/* registers read with a plain move go through one queue flush,
+	 * the stack, pc and high io ones one by one below; these use the
+	 * values read here */
+	for (i = 0; i < DSP563XX_NUMCOREREGS; i++) {
+		if (dsp563xx->core_cache->reg_list[i].valid)
+			continue;
+
+		arch_info = dsp563xx->core_cache->reg_list[i].arch_info;
+		switch (arch_info->num) {
+			case DSP563XX_REG_IDX_SSH:
+			case DSP563XX_REG_IDX_SSL:
+			case DSP563XX_REG_IDX_PC:
+			case DSP563XX_REG_IDX_IPRC:
+			case DSP563XX_REG_IDX_IPRP:
+			case DSP563XX_REG_IDX_BCR:
+			case DSP563XX_REG_IDX_DCR:
+			case DSP563XX_REG_IDX_AAR0:
+			case DSP563XX_REG_IDX_AAR1:
+			case DSP563XX_REG_IDX_AAR2:
+			case DSP563XX_REG_IDX_AAR3:
+				continue;
+			default:
+				break;
+		}
+
+		/* as dsp563xx_reg_read(), without the flushes */
+		instr = INSTR_MOVEP_REG_HIO(MEM_X, 1, arch_info->eame, 0xfffffc);
+		err = dsp563xx_once_execute_sw_ir(target->tap, 0, instr);
+		if (err != ERROR_OK)
+			return err;
+		err = dsp563xx_once_execute_sw_ir(target->tap, 0, 0x000000);
+		if (err != ERROR_OK)
+			return err;
+		dsp563xx->core_regs[i] = 0;
+		err = dsp563xx_once_reg_read(target->tap, 0, DSP563XX_ONCE_OGDBR,
+				&dsp563xx->core_regs[i]);
+		if (err != ERROR_OK)
+			return err;
+		queued[i] = true;
+	}
+
+	err = dsp563xx_once_execute_queue(target->tap);
+	if (err != ERROR_OK)
+		return err;
+
+	for (i = 0; i < DSP563XX_NUMCOREREGS; i++)
+		if (queued[i])
+			dsp563xx->read_core_reg(target, i);
+
 	for (i = 0; i < DSP563XX_NUMCOREREGS; i++) {
 		err = dsp563xx_read_register(target, i, 0);
 		if (err != ERROR_OK)
@@ -1573,7 +1626,7 @@ static int dsp563xx_read_memory_core(struct target *target,
 	}
 
 	/* flush the jtag queue */
-	err = jtag_execute_queue();
+	err = dsp563xx_once_execute_queue(target->tap);
 	if (err != ERROR_OK)
 		return err;
 
@@ -1757,7 +1810,7 @@ static int dsp563xx_write_memory_core(struct target *target,
 	}
 
 	/* flush the jtag queue */
-	err = jtag_execute_queue();
+	err = dsp563xx_once_execute_queue(target->tap);
 	if (err != ERROR_OK)
 		return err;
 
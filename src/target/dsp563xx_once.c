@@ -199,7 +199,7 @@ int dsp563xx_once_reg_read_ex(struct jtag_tap *tap, int flush, uint8_t reg, uint
 {
 	int err;
 
-	err = dsp563xx_once_ir_exec(tap, 1, reg, 1, 0, 0);
+	err = dsp563xx_once_ir_exec(tap, 0, reg, 1, 0, 0);
 	if (err != ERROR_OK)
 		return err;
 	err = dsp563xx_write_dr_u32(tap, data, 0x00, len, 0);
@@ -216,7 +216,7 @@ int dsp563xx_once_reg_read(struct jtag_tap *tap, int flush, uint8_t reg, uint32_
 {
 	int err;
 
-	err = dsp563xx_once_ir_exec(tap, flush, reg, 1, 0, 0);
+	err = dsp563xx_once_ir_exec(tap, 0, reg, 1, 0, 0);
 	if (err != ERROR_OK)
 		return err;
 	err = dsp563xx_write_dr_u32(tap, data, 0x00, 24, 0);
@@ -233,7 +233,7 @@ int dsp563xx_once_reg_write(struct jtag_tap *tap, int flush, uint8_t reg, uint32
 {
 	int err;
 
-	err = dsp563xx_once_ir_exec(tap, flush, reg, 0, 0, 0);
+	err = dsp563xx_once_ir_exec(tap, 0, reg, 0, 0, 0);
 	if (err != ERROR_OK)
 		return err;
 	err = dsp563xx_write_dr_u32(tap, 0x00, data, 24, 0);
@@ -249,7 +249,7 @@ int dsp563xx_once_execute_sw_ir(struct jtag_tap *tap, int flush, uint32_t opcode
 {
 	int err;
 
-	err = dsp563xx_once_ir_exec(tap, flush, DSP563XX_ONCE_OPDBR, 0, 1, 0);
+	err = dsp563xx_once_ir_exec(tap, 0, DSP563XX_ONCE_OPDBR, 0, 1, 0);
 	if (err != ERROR_OK)
 		return err;
 	err = dsp563xx_write_dr_u32(tap, 0, opcode, 24, 0);
@@ -265,19 +265,14 @@ int dsp563xx_once_execute_dw_ir(struct jtag_tap *tap, int flush, uint32_t opcode
 {
 	int err;
 
-	err = dsp563xx_once_ir_exec(tap, flush, DSP563XX_ONCE_OPDBR, 0, 0, 0);
+	err = dsp563xx_once_ir_exec(tap, 0, DSP563XX_ONCE_OPDBR, 0, 0, 0);
 	if (err != ERROR_OK)
 		return err;
 	err = dsp563xx_write_dr_u32(tap, 0, opcode, 24, 0);
 	if (err != ERROR_OK)
 		return err;
-	if (flush) {
-		err = jtag_execute_queue();
-		if (err != ERROR_OK)
-			return err;
-	}
 
-	err = dsp563xx_once_ir_exec(tap, flush, DSP563XX_ONCE_OPDBR, 0, 1, 0);
+	err = dsp563xx_once_ir_exec(tap, 0, DSP563XX_ONCE_OPDBR, 0, 1, 0);
 	if (err != ERROR_OK)
 		return err;
 	err = dsp563xx_write_dr_u32(tap, 0, operand, 24, 0);
@@ -291,3 +286,26 @@ int dsp563xx_once_execute_dw_ir(struct jtag_tap *tap, int flush, uint32_t opcode
 
 	return ERROR_OK;
 }
+
+/** flush queued transactions, then check the core is still in debug mode */
+int dsp563xx_once_execute_queue(struct jtag_tap *tap)
+{
+	int err;
+	uint32_t once_status = 0;
+
+	/* read last, so it reflects the state after the whole stream */
+	err = dsp563xx_once_reg_read(tap, 0, DSP563XX_ONCE_OSCR, &once_status);
+	if (err != ERROR_OK)
+		return err;
+	err = jtag_execute_queue();
+	if (err != ERROR_OK)
+		return err;
+
+	if ((once_status & DSP563XX_ONCE_OSCR_DEBUG_M) != DSP563XX_ONCE_OSCR_DEBUG_M) {
+		LOG_ERROR("core left debug mode during queued OnCE transactions (OSCR 0x%06" PRIx32 ")",
+			once_status & 0xffffff);
+		return ERROR_TARGET_FAILURE;
+	}
+
+	return ERROR_OK;
+}
@@ -85,5 +85,7 @@ int dsp563xx_once_reg_write(struct jtag_tap *tap, int flush, uint8_t reg, uint32
 int dsp563xx_once_execute_sw_ir(struct jtag_tap *tap, int flush, uint32_t opcode);
 /** double word instruction */
 int dsp563xx_once_execute_dw_ir(struct jtag_tap *tap, int flush, uint32_t opcode, uint32_t operand);
+/** flush queued transactions, then check the core is still in debug mode */
+int dsp563xx_once_execute_queue(struct jtag_tap *tap);
 
 #endif /* OPENOCD_TARGET_DSP563XX_ONCE_H */
@@ -156,14 +156,10 @@ struct reg_cache *etb_build_reg_cache(struct etb *etb)
 	return reg_cache;
 }
 
-static void etb_getbuf(jtag_callback_data_t arg)
-{
-	uint8_t *in = (uint8_t *)arg;
-
-	*((uint32_t *)arg) = buf_get_u32(in, 0, 32);
-}
-
-static int etb_read_ram(struct etb *etb, uint32_t *data, int num_frames)
+/* All frames are queued and go out with one flush; the captured bits
+ * are left as they are and unpacked by the caller, instead of a
+ * callback per frame converting them in place. */
+static int etb_read_ram(struct etb *etb, uint8_t *data, int num_frames)
 {
 	struct scan_field fields[3];
 	int i;
@@ -189,25 +185,17 @@ static int etb_read_ram(struct etb *etb, uint32_t *data, int num_frames)
 
 	jtag_add_dr_scan(etb->tap, 3, fields, TAP_IDLE);
 
-	for (i = 0; i < num_frames; i++) {
-		/* ensure nR/W remains set to read */
-		buf_set_u32(&temp2, 0, 1, 0);
-
-		/* address remains set to 0x4 (RAM data) until we read the last frame */
-		if (i < num_frames - 1)
-			buf_set_u32(&temp1, 0, 7, 4);
-		else
-			buf_set_u32(&temp1, 0, 7, 0);
+	/* address remains set to 0x4 (RAM data) until we read the last frame */
+	uint8_t addr_last = 0;
 
-		fields[0].in_value = (uint8_t *)(data + i);
+	for (i = 0; i < num_frames; i++) {
+		fields[0].in_value = data + 4 * i;
+		if (i == num_frames - 1)
+			fields[1].out_value = &addr_last;
 		jtag_add_dr_scan(etb->tap, 3, fields, TAP_IDLE);
-
-		jtag_add_callback(etb_getbuf, (jtag_callback_data_t)(data + i));
 	}
 
-	jtag_execute_queue();
-
-	return ERROR_OK;
+	return jtag_execute_queue();
 }
 
 static int etb_read_reg_w_check(struct reg *reg,
@@ -521,8 +509,10 @@ static int etb_read_trace(struct etm_context *etm_ctx)
 	struct etb *etb = etm_ctx->capture_driver_priv;
 	int first_frame = 0;
 	int num_frames = etb->ram_depth;
-	uint32_t *trace_data = NULL;
+	uint8_t *trace_data = NULL;
+	unsigned int words, packet_bits;
 	int i, j;
+	int retval;
 
 	etb_read_reg(&etb->reg_cache->reg_list[ETB_STATUS]);
 	etb_read_reg(&etb->reg_cache->reg_list[ETB_RAM_WRITE_POINTER]);
@@ -543,101 +533,63 @@ static int etb_read_trace(struct etm_context *etm_ctx)
 
 	etb_write_reg(&etb->reg_cache->reg_list[ETB_RAM_READ_POINTER], first_frame);
 
+	if (num_frames == 0) {
+		if (etm_ctx->trace_depth > 0)
+			free(etm_ctx->trace_data);
+		etm_ctx->trace_depth = 0;
+		return ERROR_OK;
+	}
+
 	/* read data into temporary array for unpacking */
-	trace_data = malloc(sizeof(uint32_t) * num_frames);
-	etb_read_ram(etb, trace_data, num_frames);
+	trace_data = malloc(4 * num_frames);
+	if (!trace_data)
+		return ERROR_FAIL;
+	retval = etb_read_ram(etb, trace_data, num_frames);
+	if (retval != ERROR_OK) {
+		free(trace_data);
+		return retval;
+	}
+
+	/* A frame holds 3, 2 or 1 trace words for a 4, 8 or 16 bit port.
+	 * Each word is 3 bits of pipestat, the packet and a tracesync bit. */
+	if ((etm_ctx->control & ETM_PORT_WIDTH_MASK) == ETM_PORT_4BIT) {
+		words = 3;
+		packet_bits = 4;
+	} else if ((etm_ctx->control & ETM_PORT_WIDTH_MASK) == ETM_PORT_8BIT) {
+		words = 2;
+		packet_bits = 8;
+	} else {
+		words = 1;
+		packet_bits = 16;
+	}
 
 	if (etm_ctx->trace_depth > 0)
 		free(etm_ctx->trace_data);
 
-	if ((etm_ctx->control & ETM_PORT_WIDTH_MASK) == ETM_PORT_4BIT)
-		etm_ctx->trace_depth = num_frames * 3;
-	else if ((etm_ctx->control & ETM_PORT_WIDTH_MASK) == ETM_PORT_8BIT)
-		etm_ctx->trace_depth = num_frames * 2;
-	else
-		etm_ctx->trace_depth = num_frames;
-
+	etm_ctx->trace_depth = num_frames * words;
 	etm_ctx->trace_data = malloc(sizeof(struct etmv1_trace_data) * etm_ctx->trace_depth);
+	if (!etm_ctx->trace_data) {
+		etm_ctx->trace_depth = 0;
+		free(trace_data);
+		return ERROR_FAIL;
+	}
 
 	for (i = 0, j = 0; i < num_frames; i++) {
-		if ((etm_ctx->control & ETM_PORT_WIDTH_MASK) == ETM_PORT_4BIT) {
-			/* trace word j */
-			etm_ctx->trace_data[j].pipestat = trace_data[i] & 0x7;
-			etm_ctx->trace_data[j].packet = (trace_data[i] & 0x78) >> 3;
-			etm_ctx->trace_data[j].flags = 0;
-			if ((trace_data[i] & 0x80) >> 7)
-				etm_ctx->trace_data[j].flags |= ETMV1_TRACESYNC_CYCLE;
-			if (etm_ctx->trace_data[j].pipestat == STAT_TR) {
-				etm_ctx->trace_data[j].pipestat = etm_ctx->trace_data[j].packet &
-					0x7;
-				etm_ctx->trace_data[j].flags |= ETMV1_TRIGGER_CYCLE;
-			}
-
-			/* trace word j + 1 */
-			etm_ctx->trace_data[j + 1].pipestat = (trace_data[i] & 0x100) >> 8;
-			etm_ctx->trace_data[j + 1].packet = (trace_data[i] & 0x7800) >> 11;
-			etm_ctx->trace_data[j + 1].flags = 0;
-			if ((trace_data[i] & 0x8000) >> 15)
-				etm_ctx->trace_data[j + 1].flags |= ETMV1_TRACESYNC_CYCLE;
-			if (etm_ctx->trace_data[j + 1].pipestat == STAT_TR) {
-				etm_ctx->trace_data[j +
-				1].pipestat = etm_ctx->trace_data[j + 1].packet & 0x7;
-				etm_ctx->trace_data[j + 1].flags |= ETMV1_TRIGGER_CYCLE;
+		uint32_t frame = buf_get_u32(trace_data + 4 * i, 0, 32);
+
+		for (unsigned int w = 0; w < words; w++, j++) {
+			struct etmv1_trace_data *t = &etm_ctx->trace_data[j];
+			unsigned int shift = w * (packet_bits + 4);
+
+			t->pipestat = (frame >> shift) & 0x7;
+			t->packet = (frame >> (shift + 3)) & ((1 << packet_bits) - 1);
+			t->flags = 0;
+			if (frame & (1 << (shift + 3 + packet_bits)))
+				t->flags |= ETMV1_TRACESYNC_CYCLE;
+			if (t->pipestat == STAT_TR) {
+				t->pipestat = t->packet & 0x7;
+				t->flags |= ETMV1_TRIGGER_CYCLE;
 			}
-
-			/* trace word j + 2 */
-			etm_ctx->trace_data[j + 2].pipestat = (trace_data[i] & 0x10000) >> 16;
-			etm_ctx->trace_data[j + 2].packet = (trace_data[i] & 0x780000) >> 19;
-			etm_ctx->trace_data[j + 2].flags = 0;
-			if ((trace_data[i] & 0x800000) >> 23)
-				etm_ctx->trace_data[j + 2].flags |= ETMV1_TRACESYNC_CYCLE;
-			if (etm_ctx->trace_data[j + 2].pipestat == STAT_TR) {
-				etm_ctx->trace_data[j +
-				2].pipestat = etm_ctx->trace_data[j + 2].packet & 0x7;
-				etm_ctx->trace_data[j + 2].flags |= ETMV1_TRIGGER_CYCLE;
-			}
-
-			j += 3;
-		} else if ((etm_ctx->control & ETM_PORT_WIDTH_MASK) == ETM_PORT_8BIT) {
-			/* trace word j */
-			etm_ctx->trace_data[j].pipestat = trace_data[i] & 0x7;
-			etm_ctx->trace_data[j].packet = (trace_data[i] & 0x7f8) >> 3;
-			etm_ctx->trace_data[j].flags = 0;
-			if ((trace_data[i] & 0x800) >> 11)
-				etm_ctx->trace_data[j].flags |= ETMV1_TRACESYNC_CYCLE;
-			if (etm_ctx->trace_data[j].pipestat == STAT_TR) {
-				etm_ctx->trace_data[j].pipestat = etm_ctx->trace_data[j].packet &
-					0x7;
-				etm_ctx->trace_data[j].flags |= ETMV1_TRIGGER_CYCLE;
-			}
-
-			/* trace word j + 1 */
-			etm_ctx->trace_data[j + 1].pipestat = (trace_data[i] & 0x7000) >> 12;
-			etm_ctx->trace_data[j + 1].packet = (trace_data[i] & 0x7f8000) >> 15;
-			etm_ctx->trace_data[j + 1].flags = 0;
-			if ((trace_data[i] & 0x800000) >> 23)
-				etm_ctx->trace_data[j + 1].flags |= ETMV1_TRACESYNC_CYCLE;
-			if (etm_ctx->trace_data[j + 1].pipestat == STAT_TR) {
-				etm_ctx->trace_data[j +
-				1].pipestat = etm_ctx->trace_data[j + 1].packet & 0x7;
-				etm_ctx->trace_data[j + 1].flags |= ETMV1_TRIGGER_CYCLE;
-			}
-
-			j += 2;
-		} else {
-			/* trace word j */
-			etm_ctx->trace_data[j].pipestat = trace_data[i] & 0x7;
-			etm_ctx->trace_data[j].packet = (trace_data[i] & 0x7fff8) >> 3;
-			etm_ctx->trace_data[j].flags = 0;
-			if ((trace_data[i] & 0x80000) >> 19)
-				etm_ctx->trace_data[j].flags |= ETMV1_TRACESYNC_CYCLE;
-			if (etm_ctx->trace_data[j].pipestat == STAT_TR) {
-				etm_ctx->trace_data[j].pipestat = etm_ctx->trace_data[j].packet &
-					0x7;
-				etm_ctx->trace_data[j].flags |= ETMV1_TRIGGER_CYCLE;
-			}
-
-			j += 1;
 		}
 	}
 
@@ -642,55 +642,84 @@ static struct etm_capture_driver *etm_capture_drivers[] = {
 	NULL
 };
 
+static void etm_image_cache_free(struct etm_context *ctx)
+{
+	if (!ctx->image_cache)
+		return;
+	for (int i = 0; i < ctx->image->num_sections; i++)
+		free(ctx->image_cache[i]);
+	free(ctx->image_cache);
+	ctx->image_cache = NULL;
+}
+
+/* Opcodes come from a copy of each image section, read from the file
+ * the first time one of its instructions is needed, rather than from an
+ * image_read_section() per traced instruction. */
 static int etm_read_instruction(struct etm_context *ctx, struct arm_instruction *instruction)
 {
-	int i;
-	int section = -1;
+	struct imagesection *sections;
+	uint32_t offset;
 	size_t size_read;
 	uint32_t opcode;
+	int section = -1;
 	int retval;
 
 	if (!ctx->image)
 		return ERROR_TRACE_IMAGE_UNAVAILABLE;
 
+	if (!ctx->image_cache) {
+		ctx->image_cache = calloc(ctx->image->num_sections, sizeof(*ctx->image_cache));
+		if (!ctx->image_cache)
+			return ERROR_FAIL;
+		ctx->image_section = 0;
+	}
+	sections = ctx->image->sections;
+
+	/* the last instruction is usually in the same section */
+	if (ctx->image_section < ctx->image->num_sections &&
+			sections[ctx->image_section].base_address <= ctx->current_pc &&
+			sections[ctx->image_section].base_address + sections[ctx->image_section].size >
+			ctx->current_pc)
+		section = ctx->image_section;
+
 	/* search for the section the current instruction belongs to */
-	for (i = 0; i < ctx->image->num_sections; i++) {
-		if ((ctx->image->sections[i].base_address <= ctx->current_pc) &&
-			(ctx->image->sections[i].base_address + ctx->image->sections[i].size >
-			ctx->current_pc)) {
+	for (int i = 0; section == -1 && i < ctx->image->num_sections; i++) {
+		if ((sections[i].base_address <= ctx->current_pc) &&
+			(sections[i].base_address + sections[i].size > ctx->current_pc))
 			section = i;
-			break;
-		}
 	}
 
 	if (section == -1) {
 		/* current instruction couldn't be found in the image */
 		return ERROR_TRACE_INSTRUCTION_UNAVAILABLE;
 	}
+	ctx->image_section = section;
 
-	if (ctx->core_state == ARM_STATE_ARM) {
-		uint8_t buf[4];
-		retval = image_read_section(ctx->image, section,
-				ctx->current_pc -
-				ctx->image->sections[section].base_address,
-				4, buf, &size_read);
-		if (retval != ERROR_OK) {
+	if (!ctx->image_cache[section]) {
+		uint8_t *data = malloc(sections[section].size);
+		if (!data)
+			return ERROR_FAIL;
+		retval = image_read_section(ctx->image, section, 0,
+				sections[section].size, data, &size_read);
+		if (retval != ERROR_OK || size_read != sections[section].size) {
+			free(data);
 			LOG_ERROR("error while reading instruction");
 			return ERROR_TRACE_INSTRUCTION_UNAVAILABLE;
 		}
-		opcode = target_buffer_get_u32(ctx->target, buf);
+		ctx->image_cache[section] = data;
+	}
+
+	offset = ctx->current_pc - sections[section].base_address;
+
+	if (ctx->core_state == ARM_STATE_ARM) {
+		if (offset + 4 > sections[section].size)
+			return ERROR_TRACE_INSTRUCTION_UNAVAILABLE;
+		opcode = target_buffer_get_u32(ctx->target, ctx->image_cache[section] + offset);
 		arm_evaluate_opcode(opcode, ctx->current_pc, instruction);
 	} else if (ctx->core_state == ARM_STATE_THUMB) {
-		uint8_t buf[2];
-		retval = image_read_section(ctx->image, section,
-				ctx->current_pc -
-				ctx->image->sections[section].base_address,
-				2, buf, &size_read);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("error while reading instruction");
+		if (offset + 2 > sections[section].size)
 			return ERROR_TRACE_INSTRUCTION_UNAVAILABLE;
-		}
-		opcode = target_buffer_get_u16(ctx->target, buf);
+		opcode = target_buffer_get_u16(ctx->target, ctx->image_cache[section] + offset);
 		thumb_evaluate_opcode(opcode, ctx->current_pc, instruction);
 	} else if (ctx->core_state == ARM_STATE_JAZELLE) {
 		LOG_ERROR("BUG: tracing of jazelle code not supported");
@@ -1671,6 +1700,7 @@ COMMAND_HANDLER(handle_etm_image_command)
 	}
 
 	if (etm_ctx->image) {
+		etm_image_cache_free(etm_ctx);
 		image_close(etm_ctx->image);
 		free(etm_ctx->image);
 		command_print(CMD_CTX, "previously loaded image found and closed");
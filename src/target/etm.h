@@ -170,6 +170,8 @@ struct etm_context {
 	uint32_t control;	/* shadow of ETM_CTRL */
 	int /*arm_state*/ core_state;	/* current core state */
 	struct image *image;		/* source for target opcodes */
+	uint8_t **image_cache;		/* contents of each image section, read on first use */
+	int image_section;		/* section of the last instruction read */
 	uint32_t pipe_index;		/* current trace cycle */
 	uint32_t data_index;		/* cycle holding next data packet */
 	bool data_half;			/* port half on a 16 bit port */
@@ -37,7 +37,9 @@
 #include "armv7m.h"
 #include "cortex_m.h"
 #include "arm_semihosting.h"
+#include "armv7m_coverage.h"
 #include "target_request.h"
+#include <helper/time_support.h>
 
 #define savedDCRDR  dbgbase  /* FIXME: using target->dbgbase to preserve DCRDR */
 
@@ -230,6 +232,17 @@ static int adapter_store_core_reg_u32(struct target *target,
 	return ERROR_OK;
 }
 
+static int adapter_store_core_reg_list(struct target *target,
+		const uint32_t *regsel, const uint32_t *value, unsigned int count)
+{
+	struct hl_interface_s *adapter = target_to_adapter(target);
+
+	if (!adapter->layout->api->write_reg_list)
+		return ERROR_FAIL;
+
+	return adapter->layout->api->write_reg_list(adapter->handle, regsel, count, value);
+}
+
 static int adapter_examine_debug_reason(struct target *target)
 {
 	if ((target->debug_reason != DBG_REASON_DBGRQ)
@@ -308,6 +321,10 @@ static int hl_handle_target_request(void *priv)
 			request |= (data << 24);
 			target_request(target, request);
 		}
+
+		/* messages in the ring take one memory read per poll,
+		 * not a DCC handshake per byte */
+		return target_request_ring_poll(target);
 	}
 
 	return ERROR_OK;
@@ -326,6 +343,7 @@ static int adapter_init_arch_info(struct target *target,
 
 	armv7m->load_core_reg_u32 = adapter_load_core_reg_u32;
 	armv7m->store_core_reg_u32 = adapter_store_core_reg_u32;
+	armv7m->store_core_reg_list = adapter_store_core_reg_list;
 
 	armv7m->examine_debug_reason = adapter_examine_debug_reason;
 	armv7m->stlink = true;
@@ -335,13 +353,25 @@ static int adapter_init_arch_info(struct target *target,
 	return ERROR_OK;
 }
 
+static void adapter_state_report(void *priv, enum target_state state)
+{
+	target_state_report(priv, state);
+}
+
 static int adapter_init_target(struct command_context *cmd_ctx,
 				    struct target *target)
 {
+	struct hl_interface_s *adapter = target_to_adapter(target);
+
 	LOG_DEBUG("%s", __func__);
 
 	armv7m_build_reg_cache(target);
 
+	if (adapter && adapter->layout->api->subscribe_state &&
+			adapter->layout->api->subscribe_state(adapter->handle,
+				adapter_state_report, target) != ERROR_OK)
+		LOG_DEBUG("adapter does not report target states");
+
 	return ERROR_OK;
 }
 
@@ -360,11 +390,133 @@ static int adapter_target_create(struct target *target,
 	return ERROR_OK;
 }
 
+/* DCRSR selectors: 0..18 core, 20 special (CONTROL/FAULTMASK/BASEPRI/PRIMASK),
+ * 33 FPSCR and 64..95 S0..S31 */
+#define ADAPTER_REGSEL_SPECIAL	20
+#define ADAPTER_REGSEL_FPSCR	33
+#define ADAPTER_REGSEL_S0	64
+#define ADAPTER_REGSEL_MAX	96
+
+/* fetch every invalid register through the adapter's bulk register read */
+static int adapter_load_context_bulk(struct target *target)
+{
+	struct hl_interface_s *adapter = target_to_adapter(target);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	uint32_t regsel[ADAPTER_REGSEL_MAX];
+	uint32_t values[ADAPTER_REGSEL_MAX];
+	uint32_t sel_value[ADAPTER_REGSEL_MAX];
+	bool wanted[ADAPTER_REGSEL_MAX] = { false };
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+
+		if (r->valid)
+			continue;
+
+		switch (arm_reg->num) {
+		case ARMV7M_R0 ... ARMV7M_PSP:
+			wanted[arm_reg->num] = true;
+			break;
+		case ARMV7M_PRIMASK:
+		case ARMV7M_BASEPRI:
+		case ARMV7M_FAULTMASK:
+		case ARMV7M_CONTROL:
+			wanted[ADAPTER_REGSEL_SPECIAL] = true;
+			break;
+		case ARMV7M_D0 ... ARMV7M_D15:
+			wanted[ADAPTER_REGSEL_S0 + 2 * (arm_reg->num - ARMV7M_D0)] = true;
+			wanted[ADAPTER_REGSEL_S0 + 2 * (arm_reg->num - ARMV7M_D0) + 1] = true;
+			break;
+		case ARMV7M_FPSCR:
+			wanted[ADAPTER_REGSEL_FPSCR] = true;
+			break;
+		default:
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+	}
+
+	for (unsigned int sel = 0; sel < ADAPTER_REGSEL_MAX; sel++)
+		if (wanted[sel])
+			regsel[count++] = sel;
+
+	if (!count)
+		return ERROR_OK;
+
+	int retval = adapter->layout->api->read_reg_list(adapter->handle, regsel, count, values);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int i = 0; i < count; i++)
+		sel_value[regsel[i]] = values[i];
+
+	for (unsigned int i = 0; i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+		uint32_t special;
+
+		if (r->valid)
+			continue;
+
+		switch (arm_reg->num) {
+		case ARMV7M_R0 ... ARMV7M_PSP:
+			buf_set_u32(r->value, 0, 32, sel_value[arm_reg->num]);
+			break;
+		case ARMV7M_PRIMASK:
+		case ARMV7M_BASEPRI:
+		case ARMV7M_FAULTMASK:
+		case ARMV7M_CONTROL:
+			special = sel_value[ADAPTER_REGSEL_SPECIAL];
+			switch (arm_reg->num) {
+			case ARMV7M_PRIMASK:
+				buf_set_u32(r->value, 0, 32, buf_get_u32((uint8_t *) &special, 0, 1));
+				break;
+			case ARMV7M_BASEPRI:
+				buf_set_u32(r->value, 0, 32, buf_get_u32((uint8_t *) &special, 8, 8));
+				break;
+			case ARMV7M_FAULTMASK:
+				buf_set_u32(r->value, 0, 32, buf_get_u32((uint8_t *) &special, 16, 1));
+				break;
+			case ARMV7M_CONTROL:
+				buf_set_u32(r->value, 0, 32, buf_get_u32((uint8_t *) &special, 24, 2));
+				break;
+			}
+			break;
+		case ARMV7M_D0 ... ARMV7M_D15:
+			buf_set_u32(r->value, 0, 32,
+				sel_value[ADAPTER_REGSEL_S0 + 2 * (arm_reg->num - ARMV7M_D0)]);
+			buf_set_u32(r->value + 4, 0, 32,
+				sel_value[ADAPTER_REGSEL_S0 + 2 * (arm_reg->num - ARMV7M_D0) + 1]);
+			break;
+		case ARMV7M_FPSCR:
+			buf_set_u32(r->value, 0, 32, sel_value[ADAPTER_REGSEL_FPSCR]);
+			break;
+		}
+
+		r->valid = 1;
+		r->dirty = 0;
+	}
+
+	LOG_DEBUG("loaded %u core registers in bulk", count);
+
+	return ERROR_OK;
+}
+
 static int adapter_load_context(struct target *target)
 {
+	struct hl_interface_s *adapter = target_to_adapter(target);
 	struct armv7m_common *armv7m = target_to_armv7m(target);
 	int num_regs = armv7m->arm.core_cache->num_regs;
 
+	if (adapter->layout->api->read_reg_list) {
+		if (adapter_load_context_bulk(target) == ERROR_OK)
+			return ERROR_OK;
+
+		LOG_DEBUG("bulk register read failed, reading registers one by one");
+	}
+
 	for (int i = 0; i < num_regs; i++) {
 
 		struct reg *r = &armv7m->arm.core_cache->reg_list[i];
@@ -463,6 +615,8 @@ static int adapter_poll(struct target *target)
 		} else {
 			if (arm_semihosting(target, &retval) != 0)
 				return retval;
+			if (armv7m_coverage_hit(target, &retval) != 0)
+				return retval;
 
 			target_call_event_callbacks(target, TARGET_EVENT_HALTED);
 		}
@@ -647,7 +801,9 @@ static int adapter_resume(struct target *target, int current,
 					breakpoint->unique_id);
 			cortex_m_unset_breakpoint(target, breakpoint);
 
-			res = adapter->layout->api->step(adapter->handle);
+			res = cortex_m_sync_comparators(target);
+			if (res == ERROR_OK)
+				res = adapter->layout->api->step(adapter->handle);
 
 			if (res != ERROR_OK)
 				return res;
@@ -656,6 +812,10 @@ static int adapter_resume(struct target *target, int current,
 		}
 	}
 
+	res = cortex_m_sync_comparators(target);
+	if (res != ERROR_OK)
+		return res;
+
 	res = adapter->layout->api->run(adapter->handle);
 
 	if (res != ERROR_OK)
@@ -719,6 +879,10 @@ static int adapter_step(struct target *target, int current,
 
 	target_call_event_callbacks(target, TARGET_EVENT_RESUMED);
 
+	res = cortex_m_sync_comparators(target);
+	if (res != ERROR_OK)
+		return res;
+
 	res = adapter->layout->api->step(adapter->handle);
 
 	if (res != ERROR_OK)
@@ -752,6 +916,24 @@ static int adapter_read_memory(struct target *target, uint32_t address,
 	return adapter->layout->api->read_mem(adapter->handle, address, size, count, buffer);
 }
 
+static int adapter_read_memory_multi(struct target *target,
+		const struct target_mem_xfer *xfers, unsigned int num)
+{
+	struct hl_interface_s *adapter = target_to_adapter(target);
+
+	if (adapter->layout->api->read_mem_multi)
+		return adapter->layout->api->read_mem_multi(adapter->handle, xfers, num);
+
+	for (unsigned int i = 0; i < num; i++) {
+		int retval = adapter_read_memory(target, xfers[i].address, xfers[i].size,
+				xfers[i].count, xfers[i].buffer);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 static int adapter_write_memory(struct target *target, uint32_t address,
 		uint32_t size, uint32_t count,
 		const uint8_t *buffer)
@@ -766,6 +948,109 @@ static int adapter_write_memory(struct target *target, uint32_t address,
 	return adapter->layout->api->write_mem(adapter->handle, address, size, count, buffer);
 }
 
+static int adapter_write_buffer_verify(struct target *target, uint32_t address,
+		uint32_t size, const uint8_t *buffer)
+{
+	struct hl_interface_s *adapter = target_to_adapter(target);
+
+	if (!adapter->layout->api->write_mem_verify || address % 4 || size % 4)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	LOG_DEBUG("%s 0x%08" PRIx32 " %" PRIu32, __func__, address, size);
+
+	return adapter->layout->api->write_mem_verify(adapter->handle, address,
+			size / 4, buffer);
+}
+
+static int adapter_update_u32(struct target *target, uint32_t address,
+		uint32_t set, uint32_t clear)
+{
+	struct hl_interface_s *adapter = target_to_adapter(target);
+
+	if (!adapter->layout->api->write_mem_masked)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	return adapter->layout->api->write_mem_masked(adapter->handle, address,
+			set, set | clear);
+}
+
+#define ADAPTER_PCSR_BURST 256
+
+static int adapter_read_pcsr(struct target *target, uint32_t count, uint32_t *val)
+{
+	struct hl_interface_s *adapter = target_to_adapter(target);
+	int retval;
+
+	if (adapter->layout->api->read_mem_fixed)
+		return adapter->layout->api->read_mem_fixed(adapter->handle, DWT_PCSR, count, val);
+
+	/* no batched read, fall back to one word at a time */
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t buf[4];
+
+		retval = adapter->layout->api->read_mem(adapter->handle, DWT_PCSR, 4, 1, buf);
+		if (retval != ERROR_OK)
+			return retval;
+		val[i] = target_buffer_get_u32(target, buf);
+	}
+
+	return ERROR_OK;
+}
+
+/* sample the PC through DWT_PCSR while the core keeps running */
+static int adapter_profiling(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+{
+	uint32_t probe[4];
+	struct timeval timeout, now;
+	int retval;
+
+	if (target->state == TARGET_HALTED) {
+		retval = target_resume(target, 1, 0, 0, 0);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* PCSR reads as zero when not implemented */
+	retval = adapter_read_pcsr(target, ARRAY_SIZE(probe), probe);
+	if (retval != ERROR_OK || !(probe[0] | probe[1] | probe[2] | probe[3])) {
+		LOG_DEBUG("DWT_PCSR not usable, halting the target to sample");
+		return target_profiling_default(target, samples, max_num_samples,
+				num_samples, seconds);
+	}
+
+	gettimeofday(&timeout, NULL);
+	timeval_add_time(&timeout, seconds, 0);
+
+	LOG_INFO("Starting profiling. Sampling DWT_PCSR as fast as we can...");
+
+	uint32_t sample_count = 0;
+	uint32_t burst[ADAPTER_PCSR_BURST];
+	for (;;) {
+		retval = adapter_read_pcsr(target, ARRAY_SIZE(burst), burst);
+		if (retval != ERROR_OK)
+			break;
+
+		for (unsigned int i = 0; i < ARRAY_SIZE(burst) && sample_count < max_num_samples; i++) {
+			/* the core is sleeping or in debug state */
+			if (burst[i] == 0xFFFFFFFF)
+				continue;
+			samples[sample_count++] = burst[i];
+		}
+
+		keep_alive();
+
+		gettimeofday(&now, NULL);
+		if (sample_count >= max_num_samples || timercmp(&now, &timeout, >)) {
+			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+			break;
+		}
+	}
+
+	*num_samples = sample_count;
+	return retval;
+}
+
 static const struct command_registration adapter_command_handlers[] = {
 	{
 		.chain = arm_command_handlers,
@@ -800,9 +1085,14 @@ struct target_type hla_target = {
 	.get_gdb_reg_list = armv7m_get_gdb_reg_list,
 
 	.read_memory = adapter_read_memory,
+	.read_memory_multi = adapter_read_memory_multi,
 	.write_memory = adapter_write_memory,
+	.write_buffer_verify = adapter_write_buffer_verify,
+	.update_u32 = adapter_update_u32,
 	.checksum_memory = armv7m_checksum_memory,
+	.checksum_memory_chunks = armv7m_checksum_memory_chunks,
 	.blank_check_memory = armv7m_blank_check_memory,
+	.blank_check_memory_blocks = armv7m_blank_check_memory_blocks,
 
 	.run_algorithm = armv7m_run_algorithm,
 	.start_algorithm = armv7m_start_algorithm,
@@ -812,4 +1102,5 @@ struct target_type hla_target = {
 	.remove_breakpoint = cortex_m_remove_breakpoint,
 	.add_watchpoint = cortex_m_add_watchpoint,
 	.remove_watchpoint = cortex_m_remove_watchpoint,
+	.profiling = adapter_profiling,
 };
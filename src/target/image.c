@@ -42,6 +42,48 @@
 	((elf->endianness == ELFDATA2LSB) ? \
 	le_to_h_u32((uint8_t *)&field) : be_to_h_u32((uint8_t *)&field))
 
+/* decode 'count' bytes of ASCII hex, returns -1 on a non hex digit */
+static int image_hex_decode(const char *s, uint8_t *out, uint32_t count)
+{
+	static int8_t nibble[256];
+
+	if (nibble['1'] == 0) {
+		memset(nibble, -1, sizeof(nibble));
+		for (int i = 0; i < 10; i++)
+			nibble['0' + i] = i;
+		for (int i = 0; i < 6; i++) {
+			nibble['a' + i] = 10 + i;
+			nibble['A' + i] = 10 + i;
+		}
+	}
+
+	while (count-- > 0) {
+		int hi = nibble[(uint8_t)s[0]];
+		int lo = nibble[(uint8_t)s[1]];
+		if ((hi | lo) < 0)
+			return -1;
+		*out++ = (hi << 4) | lo;
+		s += 2;
+	}
+
+	return 0;
+}
+
+/* parse a big endian hex field of 'digits' (even, max. 8) characters */
+static int image_hex_field(const char *s, unsigned int digits, uint32_t *value)
+{
+	uint8_t bytes[4];
+
+	if (image_hex_decode(s, bytes, digits / 2) < 0)
+		return -1;
+
+	*value = 0;
+	for (unsigned int i = 0; i < digits / 2; i++)
+		*value = (*value << 8) | bytes[i];
+
+	return 0;
+}
+
 static int autodetect_image_type(struct image *image, const char *url)
 {
 	int retval;
@@ -135,6 +177,10 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 		return retval;
 
 	ihex->buffer = malloc(filesize >> 1);
+	if (ihex->buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	cooked_bytes = 0x0;
 	image->num_sections = 0;
 	section[image->num_sections].private = &ihex->buffer[cooked_bytes];
@@ -153,8 +199,10 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 		if (lpszLine[0] == '#')
 			continue;
 
-		if (sscanf(&lpszLine[bytes_read], ":%2" SCNx32 "%4" SCNx32 "%2" SCNx32, &count,
-			&address, &record_type) != 3)
+		if (lpszLine[0] != ':'
+				|| image_hex_field(&lpszLine[1], 2, &count) < 0
+				|| image_hex_field(&lpszLine[3], 4, &address) < 0
+				|| image_hex_field(&lpszLine[7], 2, &record_type) < 0)
 			return ERROR_IMAGE_FORMAT_ERROR;
 		bytes_read += 9;
 
@@ -186,16 +234,14 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 				full_address = (full_address & 0xffff0000) | address;
 			}
 
-			while (count-- > 0) {
-				unsigned value;
-				sscanf(&lpszLine[bytes_read], "%2x", &value);
-				ihex->buffer[cooked_bytes] = (uint8_t)value;
-				cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-				bytes_read += 2;
-				cooked_bytes += 1;
-				section[image->num_sections].size += 1;
-				full_address++;
-			}
+			if (image_hex_decode(&lpszLine[bytes_read], &ihex->buffer[cooked_bytes], count) < 0)
+				return ERROR_IMAGE_FORMAT_ERROR;
+			for (i = 0; i < (int)count; i++)
+				cal_checksum += ihex->buffer[cooked_bytes + i];
+			bytes_read += count * 2;
+			cooked_bytes += count;
+			section[image->num_sections].size += count;
+			full_address += count;
 		} else if (record_type == 1) {	/* End of File Record */
 			/* finish the current section */
 			image->num_sections++;
@@ -211,9 +257,10 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 
 			return ERROR_OK;
 		} else if (record_type == 2) {	/* Linear Address Record */
-			uint16_t upper_address;
+			uint32_t upper_address;
 
-			sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
+			if (image_hex_field(&lpszLine[bytes_read], 4, &upper_address) < 0)
+				return ERROR_IMAGE_FORMAT_ERROR;
 			cal_checksum += (uint8_t)(upper_address >> 8);
 			cal_checksum += (uint8_t)upper_address;
 			bytes_read += 4;
@@ -245,14 +292,16 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 			/* "Start Segment Address Record" will not be supported
 			 * but we must consume it, and do not create an error.  */
 			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
+				if (image_hex_field(&lpszLine[bytes_read], 2, &dummy) < 0)
+					return ERROR_IMAGE_FORMAT_ERROR;
 				cal_checksum += (uint8_t)dummy;
 				bytes_read += 2;
 			}
 		} else if (record_type == 4) {	/* Extended Linear Address Record */
-			uint16_t upper_address;
+			uint32_t upper_address;
 
-			sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
+			if (image_hex_field(&lpszLine[bytes_read], 4, &upper_address) < 0)
+				return ERROR_IMAGE_FORMAT_ERROR;
 			cal_checksum += (uint8_t)(upper_address >> 8);
 			cal_checksum += (uint8_t)upper_address;
 			bytes_read += 4;
@@ -281,7 +330,8 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 		} else if (record_type == 5) {	/* Start Linear Address Record */
 			uint32_t start_address;
 
-			sscanf(&lpszLine[bytes_read], "%8" SCNx32, &start_address);
+			if (image_hex_field(&lpszLine[bytes_read], 8, &start_address) < 0)
+				return ERROR_IMAGE_FORMAT_ERROR;
 			cal_checksum += (uint8_t)(start_address >> 24);
 			cal_checksum += (uint8_t)(start_address >> 16);
 			cal_checksum += (uint8_t)(start_address >> 8);
@@ -295,7 +345,8 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 			return ERROR_IMAGE_FORMAT_ERROR;
 		}
 
-		sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
+		if (image_hex_field(&lpszLine[bytes_read], 2, &checksum) < 0)
+			return ERROR_IMAGE_FORMAT_ERROR;
 
 		if ((uint8_t)checksum != (uint8_t)(~cal_checksum + 1)) {
 			/* checksum failed */
@@ -524,6 +575,10 @@ static int image_mot_buffer_complete_inner(struct image *image,
 		return retval;
 
 	mot->buffer = malloc(filesize >> 1);
+	if (mot->buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	cooked_bytes = 0x0;
 	image->num_sections = 0;
 	section[image->num_sections].private = &mot->buffer[cooked_bytes];
@@ -540,9 +595,10 @@ static int image_mot_buffer_complete_inner(struct image *image,
 		uint32_t bytes_read = 0;
 
 		/* get record type and record length */
-		if (sscanf(&lpszLine[bytes_read], "S%1" SCNx32 "%2" SCNx32, &record_type,
-			&count) != 2)
+		if (lpszLine[0] != 'S' || lpszLine[1] < '0' || lpszLine[1] > '9'
+				|| image_hex_field(&lpszLine[2], 2, &count) < 0)
 			return ERROR_IMAGE_FORMAT_ERROR;
+		record_type = lpszLine[1] - '0';
 
 		bytes_read += 4;
 		cal_checksum += (uint8_t)count;
@@ -552,10 +608,11 @@ static int image_mot_buffer_complete_inner(struct image *image,
 
 		if (record_type == 0) {
 			/* S0 - starting record (optional) */
-			int iValue;
+			uint32_t iValue;
 
 			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2x", &iValue);
+				if (image_hex_field(&lpszLine[bytes_read], 2, &iValue) < 0)
+					return ERROR_IMAGE_FORMAT_ERROR;
 				cal_checksum += (uint8_t)iValue;
 				bytes_read += 2;
 			}
@@ -563,7 +620,8 @@ static int image_mot_buffer_complete_inner(struct image *image,
 			switch (record_type) {
 				case 1:
 					/* S1 - 16 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%4" SCNx32, &address);
+					if (image_hex_field(&lpszLine[bytes_read], 4, &address) < 0)
+						return ERROR_IMAGE_FORMAT_ERROR;
 					cal_checksum += (uint8_t)(address >> 8);
 					cal_checksum += (uint8_t)address;
 					bytes_read += 4;
@@ -572,7 +630,8 @@ static int image_mot_buffer_complete_inner(struct image *image,
 
 				case 2:
 					/* S2 - 24 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%6" SCNx32, &address);
+					if (image_hex_field(&lpszLine[bytes_read], 6, &address) < 0)
+						return ERROR_IMAGE_FORMAT_ERROR;
 					cal_checksum += (uint8_t)(address >> 16);
 					cal_checksum += (uint8_t)(address >> 8);
 					cal_checksum += (uint8_t)address;
@@ -582,7 +641,8 @@ static int image_mot_buffer_complete_inner(struct image *image,
 
 				case 3:
 					/* S3 - 32 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%8" SCNx32, &address);
+					if (image_hex_field(&lpszLine[bytes_read], 8, &address) < 0)
+						return ERROR_IMAGE_FORMAT_ERROR;
 					cal_checksum += (uint8_t)(address >> 24);
 					cal_checksum += (uint8_t)(address >> 16);
 					cal_checksum += (uint8_t)(address >> 8);
@@ -600,6 +660,11 @@ static int image_mot_buffer_complete_inner(struct image *image,
 				 */
 				if (section[image->num_sections].size != 0) {
 					image->num_sections++;
+					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+						/* too many sections */
+						LOG_ERROR("Too many sections found in S19 file");
+						return ERROR_IMAGE_FORMAT_ERROR;
+					}
 					section[image->num_sections].size = 0x0;
 					section[image->num_sections].flags = 0;
 					section[image->num_sections].private =
@@ -609,22 +674,21 @@ static int image_mot_buffer_complete_inner(struct image *image,
 				full_address = address;
 			}
 
-			while (count-- > 0) {
-				unsigned value;
-				sscanf(&lpszLine[bytes_read], "%2x", &value);
-				mot->buffer[cooked_bytes] = (uint8_t)value;
-				cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-				bytes_read += 2;
-				cooked_bytes += 1;
-				section[image->num_sections].size += 1;
-				full_address++;
-			}
+			if (image_hex_decode(&lpszLine[bytes_read], &mot->buffer[cooked_bytes], count) < 0)
+				return ERROR_IMAGE_FORMAT_ERROR;
+			for (i = 0; i < (int)count; i++)
+				cal_checksum += mot->buffer[cooked_bytes + i];
+			bytes_read += count * 2;
+			cooked_bytes += count;
+			section[image->num_sections].size += count;
+			full_address += count;
 		} else if (record_type == 5) {
 			/* S5 is the data count record, we ignore it */
 			uint32_t dummy;
 
 			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
+				if (image_hex_field(&lpszLine[bytes_read], 2, &dummy) < 0)
+					return ERROR_IMAGE_FORMAT_ERROR;
 				cal_checksum += (uint8_t)dummy;
 				bytes_read += 2;
 			}
@@ -648,7 +712,8 @@ static int image_mot_buffer_complete_inner(struct image *image,
 		}
 
 		/* account for checksum, will always be 0xFF */
-		sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
+		if (image_hex_field(&lpszLine[bytes_read], 2, &checksum) < 0)
+			return ERROR_IMAGE_FORMAT_ERROR;
 		cal_checksum += (uint8_t)checksum;
 
 		if (cal_checksum != 0xFF) {
@@ -689,6 +754,36 @@ static int image_mot_buffer_complete(struct image *image)
 	return retval;
 }
 
+/* Parsed ihex and S19 images are kept around, so scripts that program and
+ * verify the same file on board after board don't parse it again.  An
+ * entry is reused when path, size, mtime and a CRC of the file match. */
+#define IMAGE_CACHE_ENTRIES 4
+
+struct image_cache_entry {
+	char *url;
+	enum image_type type;
+	size_t size;
+	time_t mtime;
+	uint32_t crc;
+	uint8_t *buffer;
+	struct imagesection *sections;	/* not relocated */
+	int num_sections;
+	int start_address_set;
+	uint32_t start_address;
+	uint32_t *section_crc;
+	bool *section_crc_valid;
+	int users;
+	unsigned int last_used;
+};
+
+static struct image_cache_entry image_cache[IMAGE_CACHE_ENTRIES];
+static unsigned int image_cache_clock;
+
+static struct image_cache_entry *image_cache_get(struct image *image,
+		const char *url, struct fileio *fileio);
+static struct image_cache_entry *image_cache_put(struct image *image,
+		const char *url, struct fileio *fileio, uint8_t *buffer);
+
 int image_open(struct image *image, const char *url, const char *type_string)
 {
 	int retval = ERROR_OK;
@@ -726,12 +821,19 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			return retval;
 
-		retval = image_ihex_buffer_complete(image);
-		if (retval != ERROR_OK) {
-			LOG_ERROR(
-				"failed buffering IHEX image, check daemon output for additional information");
-			fileio_close(image_ihex->fileio);
-			return retval;
+		image_ihex->buffer = NULL;
+		image_ihex->cache = image_cache_get(image, url, image_ihex->fileio);
+		if (image_ihex->cache) {
+			image_ihex->buffer = image_ihex->cache->buffer;
+		} else {
+			retval = image_ihex_buffer_complete(image);
+			if (retval != ERROR_OK) {
+				LOG_ERROR(
+					"failed buffering IHEX image, check daemon output for additional information");
+				fileio_close(image_ihex->fileio);
+				return retval;
+			}
+			image_ihex->cache = image_cache_put(image, url, image_ihex->fileio, image_ihex->buffer);
 		}
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf;
@@ -777,12 +879,19 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			return retval;
 
-		retval = image_mot_buffer_complete(image);
-		if (retval != ERROR_OK) {
-			LOG_ERROR(
-				"failed buffering S19 image, check daemon output for additional information");
-			fileio_close(image_mot->fileio);
-			return retval;
+		image_mot->buffer = NULL;
+		image_mot->cache = image_cache_get(image, url, image_mot->fileio);
+		if (image_mot->cache) {
+			image_mot->buffer = image_mot->cache->buffer;
+		} else {
+			retval = image_mot_buffer_complete(image);
+			if (retval != ERROR_OK) {
+				LOG_ERROR(
+					"failed buffering S19 image, check daemon output for additional information");
+				fileio_close(image_mot->fileio);
+				return retval;
+			}
+			image_mot->cache = image_cache_put(image, url, image_mot->fileio, image_mot->buffer);
 		}
 	} else if (image->type == IMAGE_BUILDER) {
 		image->num_sections = 0;
@@ -901,6 +1010,62 @@ int image_read_section(struct image *image,
 	return ERROR_OK;
 }
 
+/**
+ * Get a pointer to section data without copying it: file backed images are
+ * mapped, parsed formats return their buffer.  The data may be modified by
+ * the caller (file mappings are private) and stays valid until image_close().
+ * Returns ERROR_IMAGE_TEMPORARILY_UNAVAILABLE when the range can't be
+ * provided this way; use image_read_section() then.
+ */
+int image_map_section(struct image *image, int section, uint32_t offset,
+		uint32_t size, uint8_t **data)
+{
+	struct fileio *fileio;
+	uint32_t file_offset;
+	size_t file_size;
+	uint8_t *map;
+
+	if (offset + size > image->sections[section].size)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	switch (image->type) {
+		case IMAGE_IHEX:
+		case IMAGE_SRECORD:
+		case IMAGE_BUILDER:
+			*data = (uint8_t *)image->sections[section].private + offset;
+			return ERROR_OK;
+		case IMAGE_BINARY:
+		{
+			struct image_binary *image_binary = image->type_private;
+			fileio = image_binary->fileio;
+			file_offset = offset;
+			break;
+		}
+		case IMAGE_ELF:
+		{
+			struct image_elf *elf = image->type_private;
+			Elf32_Phdr *segment = image->sections[section].private;
+
+			/* the zero filled tail of a segment isn't in the file */
+			if (offset + size > field32(elf, segment->p_filesz))
+				return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+			fileio = elf->fileio;
+			file_offset = field32(elf, segment->p_offset) + offset;
+			break;
+		}
+		default:
+			return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+	}
+
+	if (fileio_size(fileio, &file_size) != ERROR_OK
+			|| (uint64_t)file_offset + size > file_size
+			|| fileio_map(fileio, &map) != ERROR_OK)
+		return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+
+	*data = map + file_offset;
+	return ERROR_OK;
+}
+
 int image_add_section(struct image *image, uint32_t base, uint32_t size, int flags, uint8_t const *data)
 {
 	struct imagesection *section;
@@ -949,10 +1114,11 @@ void image_close(struct image *image)
 
 		fileio_close(image_ihex->fileio);
 
-		if (image_ihex->buffer) {
+		if (image_ihex->cache)
+			image_ihex->cache->users--;
+		else if (image_ihex->buffer)
 			free(image_ihex->buffer);
-			image_ihex->buffer = NULL;
-		}
+		image_ihex->buffer = NULL;
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf = image->type_private;
 
@@ -979,10 +1145,11 @@ void image_close(struct image *image)
 
 		fileio_close(image_mot->fileio);
 
-		if (image_mot->buffer) {
+		if (image_mot->cache)
+			image_mot->cache->users--;
+		else if (image_mot->buffer)
 			free(image_mot->buffer);
-			image_mot->buffer = NULL;
-		}
+		image_mot->buffer = NULL;
 	} else if (image->type == IMAGE_BUILDER) {
 		int i;
 
@@ -1003,37 +1170,75 @@ void image_close(struct image *image)
 	}
 }
 
-int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
-{
-	uint32_t crc = 0xffffffff;
-	LOG_DEBUG("Calculating checksum");
-
-	static uint32_t crc32_table[256];
+/* crc32_table[k][i] is the CRC of byte i followed by k zero bytes, so
+ * eight bytes can be folded in with one lookup each (slice-by-8) */
+static uint32_t crc32_table[8][256];
 
+static void image_crc32_init(void)
+{
 	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		int i, j;
+	if (first_init)
+		return;
+
+	/* Initialize the CRC table and the decoding table.  */
+	for (int i = 0; i < 256; i++) {
 		unsigned int c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
+		/* as per gdb */
+		c = i << 24;
+		for (int j = 8; j > 0; --j)
+			c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
+		crc32_table[0][i] = c;
+	}
+
+	for (int k = 1; k < 8; k++)
+		for (int i = 0; i < 256; i++) {
+			uint32_t c = crc32_table[k - 1][i];
+			crc32_table[k][i] = (c << 8) ^ crc32_table[0][c >> 24];
 		}
 
-		first_init = true;
+	first_init = true;
+}
+
+static uint32_t image_crc32(uint32_t crc, const uint8_t *buffer, uint32_t len)
+{
+	while (len >= 8) {
+		/* the polynomial is not reflected, bytes enter MSB first */
+		crc ^= (uint32_t)buffer[0] << 24 | (uint32_t)buffer[1] << 16 |
+			(uint32_t)buffer[2] << 8 | buffer[3];
+		crc = crc32_table[7][crc >> 24] ^
+			crc32_table[6][(crc >> 16) & 255] ^
+			crc32_table[5][(crc >> 8) & 255] ^
+			crc32_table[4][crc & 255] ^
+			crc32_table[3][buffer[4]] ^
+			crc32_table[2][buffer[5]] ^
+			crc32_table[1][buffer[6]] ^
+			crc32_table[0][buffer[7]];
+		buffer += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		/* as per gdb */
+		crc = (crc << 8) ^ crc32_table[0][((crc >> 24) ^ *buffer++) & 255];
 	}
 
+	return crc;
+}
+
+int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
+{
+	uint32_t crc = 0xffffffff;
+	LOG_DEBUG("Calculating checksum");
+
+	image_crc32_init();
+
 	while (nbytes > 0) {
-		int run = nbytes;
+		uint32_t run = nbytes;
 		if (run > 32768)
 			run = 32768;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
+		crc = image_crc32(crc, buffer, run);
+		buffer += run;
 		keep_alive();
 	}
 
@@ -1042,3 +1247,163 @@ int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes, uint32_t *checksu
 	*checksum = crc;
 	return ERROR_OK;
 }
+
+/* CRC of the whole file, leaves the file positioned at its start */
+static int image_file_crc(struct fileio *fileio, uint32_t *crc)
+{
+	uint8_t *chunk = malloc(32768);
+	size_t read_bytes;
+	int retval;
+
+	if (chunk == NULL)
+		return ERROR_FAIL;
+
+	image_crc32_init();
+	*crc = 0xffffffff;
+
+	retval = fileio_seek(fileio, 0);
+	while (retval == ERROR_OK) {
+		retval = fileio_read(fileio, 32768, chunk, &read_bytes);
+		if (retval != ERROR_OK || read_bytes == 0)
+			break;
+		*crc = image_crc32(*crc, chunk, read_bytes);
+	}
+	free(chunk);
+
+	if (retval == ERROR_OK)
+		retval = fileio_seek(fileio, 0);
+	return retval;
+}
+
+static void image_cache_free(struct image_cache_entry *entry)
+{
+	free(entry->url);
+	free(entry->buffer);
+	free(entry->sections);
+	free(entry->section_crc);
+	free(entry->section_crc_valid);
+	memset(entry, 0, sizeof(*entry));
+}
+
+/* fill in the image from the cache, returns NULL if the file isn't cached */
+static struct image_cache_entry *image_cache_get(struct image *image,
+		const char *url, struct fileio *fileio)
+{
+	struct image_cache_entry *entry = NULL;
+	size_t size;
+	time_t mtime;
+	uint32_t crc;
+
+	if (fileio_size(fileio, &size) != ERROR_OK || fileio_mtime(fileio, &mtime) != ERROR_OK)
+		return NULL;
+
+	for (int i = 0; i < IMAGE_CACHE_ENTRIES; i++) {
+		struct image_cache_entry *e = &image_cache[i];
+		if (e->url && e->type == image->type && e->size == size
+				&& e->mtime == mtime && !strcmp(e->url, url)) {
+			entry = e;
+			break;
+		}
+	}
+	if (entry == NULL)
+		return NULL;
+
+	if (image_file_crc(fileio, &crc) != ERROR_OK)
+		return NULL;
+	if (crc != entry->crc) {
+		/* rewritten within the mtime granularity */
+		if (entry->users == 0)
+			image_cache_free(entry);
+		return NULL;
+	}
+
+	image->sections = malloc(sizeof(struct imagesection) * entry->num_sections);
+	if (image->sections == NULL)
+		return NULL;
+	memcpy(image->sections, entry->sections, sizeof(struct imagesection) * entry->num_sections);
+	image->num_sections = entry->num_sections;
+	image->start_address_set = entry->start_address_set;
+	image->start_address = entry->start_address;
+
+	LOG_DEBUG("using cached parse of %s", url);
+	entry->users++;
+	entry->last_used = ++image_cache_clock;
+	return entry;
+}
+
+/* hand a freshly parsed image to the cache, which then owns 'buffer'.
+ * Returns NULL, leaving 'buffer' with the caller, if there is no room. */
+static struct image_cache_entry *image_cache_put(struct image *image,
+		const char *url, struct fileio *fileio, uint8_t *buffer)
+{
+	struct image_cache_entry *entry = NULL;
+	struct image_cache_entry e = { .type = image->type, .buffer = buffer, .users = 1 };
+
+	for (int i = 0; i < IMAGE_CACHE_ENTRIES; i++) {
+		if (image_cache[i].users)
+			continue;
+		if (entry == NULL || image_cache[i].url == NULL
+				|| (entry->url && image_cache[i].last_used < entry->last_used))
+			entry = &image_cache[i];
+	}
+	if (entry == NULL)
+		return NULL;
+
+	if (fileio_size(fileio, &e.size) != ERROR_OK || fileio_mtime(fileio, &e.mtime) != ERROR_OK
+			|| image_file_crc(fileio, &e.crc) != ERROR_OK)
+		return NULL;
+
+	e.url = strdup(url);
+	e.num_sections = image->num_sections;
+	e.sections = malloc(sizeof(struct imagesection) * image->num_sections);
+	e.section_crc = calloc(image->num_sections, sizeof(uint32_t));
+	e.section_crc_valid = calloc(image->num_sections, sizeof(bool));
+	if (e.url == NULL || e.sections == NULL || e.section_crc == NULL || e.section_crc_valid == NULL) {
+		e.buffer = NULL;
+		image_cache_free(&e);
+		return NULL;
+	}
+	memcpy(e.sections, image->sections, sizeof(struct imagesection) * image->num_sections);
+	e.start_address_set = image->start_address_set;
+	e.start_address = image->start_address;
+	e.last_used = ++image_cache_clock;
+
+	if (entry->url)
+		image_cache_free(entry);
+	*entry = e;
+	return entry;
+}
+
+static struct image_cache_entry *image_cache_of(struct image *image)
+{
+	if (image->type == IMAGE_IHEX)
+		return ((struct image_ihex *)image->type_private)->cache;
+	if (image->type == IMAGE_SRECORD)
+		return ((struct image_mot *)image->type_private)->cache;
+	return NULL;
+}
+
+/**
+ * image_calculate_checksum() of a whole section, 'buffer' holding its
+ * data.  The result is remembered for cached images.
+ */
+int image_calculate_section_checksum(struct image *image, int section,
+		uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
+{
+	struct image_cache_entry *entry = image_cache_of(image);
+	int retval;
+
+	if (entry && nbytes == image->sections[section].size
+			&& entry->section_crc_valid[section]) {
+		*checksum = entry->section_crc[section];
+		return ERROR_OK;
+	}
+
+	retval = image_calculate_checksum(buffer, nbytes, checksum);
+	if (retval == ERROR_OK && entry && nbytes == image->sections[section].size) {
+		entry->section_crc[section] = *checksum;
+		entry->section_crc_valid[section] = true;
+	}
+
+	return retval;
+}
@@ -67,9 +67,12 @@ struct image_binary {
 	struct fileio *fileio;
 };
 
+struct image_cache_entry;
+
 struct image_ihex {
 	struct fileio *fileio;
 	uint8_t *buffer;
+	struct image_cache_entry *cache;	/* owner of buffer, if cached */
 };
 
 struct image_memory {
@@ -89,11 +92,14 @@ struct image_elf {
 struct image_mot {
 	struct fileio *fileio;
 	uint8_t *buffer;
+	struct image_cache_entry *cache;	/* owner of buffer, if cached */
 };
 
 int image_open(struct image *image, const char *url, const char *type_string);
 int image_read_section(struct image *image, int section, uint32_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
+int image_map_section(struct image *image, int section, uint32_t offset,
+		uint32_t size, uint8_t **data);
 void image_close(struct image *image);
 
 int image_add_section(struct image *image, uint32_t base, uint32_t size,
@@ -101,6 +107,8 @@ int image_add_section(struct image *image, uint32_t base, uint32_t size,
 
 int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes,
 		uint32_t *checksum);
+int image_calculate_section_checksum(struct image *image, int section,
+		uint8_t *buffer, uint32_t nbytes, uint32_t *checksum);
 
 #define ERROR_IMAGE_FORMAT_ERROR	(-1400)
 #define ERROR_IMAGE_TYPE_UNKNOWN	(-1401)
@@ -65,6 +65,11 @@ static struct reg_cache *lakemont_build_reg_cache
 static int submit_reg_pir(struct target *t, int num);
 static int submit_instruction_pir(struct target *t, int num);
 static int submit_pir(struct target *t, uint64_t op);
+static int transaction_status(struct target *t);
+static int read_mem_block(struct target *t, int instr, uint32_t size,
+			uint32_t addr, uint32_t count, uint8_t *buf);
+static int write_mem_block(struct target *t, int instr, uint32_t size,
+			uint32_t addr, uint32_t count, const uint8_t *buf);
 static int lakemont_get_core_reg(struct reg *reg);
 static int lakemont_set_core_reg(struct reg *reg, uint8_t *buf);
 
@@ -711,6 +716,142 @@ static int write_hw_reg(struct target *t, int reg, uint32_t regval, uint8_t cach
 	return ERROR_OK;
 }
 
+/* write_hw_reg() without the cache and without flushing the scans */
+static int queue_write_hw_reg(struct target *t, int reg, uint32_t regval)
+{
+	uint8_t reg_buf[4];
+	buf_set_u32(reg_buf, 0, 32, regval);
+
+	if (submit_reg_pir(t, reg) != ERROR_OK)
+		return ERROR_FAIL;
+	if (submit_instruction_pir(t, SRAMACCESS) != ERROR_OK)
+		return ERROR_FAIL;
+	scan.out[0] = RDWRPDR;
+	if (irscan(t, scan.out, NULL, LMT_IRLEN) != ERROR_OK)
+		return ERROR_FAIL;
+	if (drscan(t, reg_buf, scan.in, PDR_SIZE) != ERROR_OK)
+		return ERROR_FAIL;
+	return submit_instruction_pir(t, PDR2SRAM);
+}
+
+/* read_hw_reg() without the cache, the value is captured into in
+ * when the scans are flushed */
+static int queue_read_hw_reg(struct target *t, int reg, uint8_t *in)
+{
+	if (submit_reg_pir(t, reg) != ERROR_OK)
+		return ERROR_FAIL;
+	if (submit_instruction_pir(t, SRAMACCESS) != ERROR_OK)
+		return ERROR_FAIL;
+	if (submit_instruction_pir(t, SRAM2PDR) != ERROR_OK)
+		return ERROR_FAIL;
+	scan.out[0] = RDWRPDR;
+	if (irscan(t, scan.out, NULL, LMT_IRLEN) != ERROR_OK)
+		return ERROR_FAIL;
+	if (drscan(t, NULL, in, PDR_SIZE) != ERROR_OK)
+		return ERROR_FAIL;
+	jtag_add_sleep(DELAY_SUBMITPIR);
+	return ERROR_OK;
+}
+
+/* count memory reads of size bytes with instr, the EAX/instr/EDX
+ * sequence of each is queued and a block of MEM_BLOCK of them is
+ * flushed at once, the transaction status is checked per block */
+static int read_mem_block(struct target *t, int instr, uint32_t size,
+			uint32_t addr, uint32_t count, uint8_t *buf)
+{
+	struct x86_32_common *x86_32 = target_to_x86_32(t);
+	uint8_t *pdr;
+	int retval = ERROR_OK;
+
+	pdr = malloc(MEM_BLOCK * 4);
+	if (pdr == NULL) {
+		LOG_ERROR("%s out of memory", __func__);
+		return ERROR_FAIL;
+	}
+
+	while (count > 0) {
+		uint32_t n = (count > MEM_BLOCK) ? MEM_BLOCK : count;
+
+		x86_32->flush = 0; /* dont flush scans till we have a block */
+		for (uint32_t i = 0; i < n && retval == ERROR_OK; i++) {
+			retval = queue_write_hw_reg(t, EAX, addr + i * size);
+			if (retval == ERROR_OK)
+				retval = submit_instruction_pir(t, instr);
+			if (retval == ERROR_OK)
+				retval = queue_read_hw_reg(t, EDX, pdr + i * 4);
+		}
+		x86_32->flush = 1;
+		if (retval != ERROR_OK)
+			break;
+
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK) {
+			LOG_ERROR("%s failed to execute queue", __func__);
+			break;
+		}
+		retval = transaction_status(t);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("%s error on mem read", __func__);
+			break;
+		}
+
+		for (uint32_t i = 0; i < n; i++)
+			memcpy(buf + i * size, pdr + i * 4, size);
+
+		addr += n * size;
+		buf += n * size;
+		count -= n;
+	}
+
+	free(pdr);
+	return retval;
+}
+
+/* as read_mem_block(), for count memory writes */
+static int write_mem_block(struct target *t, int instr, uint32_t size,
+			uint32_t addr, uint32_t count, const uint8_t *buf)
+{
+	struct x86_32_common *x86_32 = target_to_x86_32(t);
+	int retval = ERROR_OK;
+
+	while (count > 0) {
+		uint32_t n = (count > MEM_BLOCK) ? MEM_BLOCK : count;
+
+		x86_32->flush = 0; /* dont flush scans till we have a block */
+		for (uint32_t i = 0; i < n && retval == ERROR_OK; i++) {
+			uint32_t val = 0;
+
+			for (uint32_t j = 0; j < size; j++)
+				val |= (uint32_t)buf[i * size + j] << (j * 8);
+			retval = queue_write_hw_reg(t, EAX, addr + i * size);
+			if (retval == ERROR_OK)
+				retval = queue_write_hw_reg(t, EDX, val);
+			if (retval == ERROR_OK)
+				retval = submit_instruction_pir(t, instr);
+		}
+		x86_32->flush = 1;
+		if (retval != ERROR_OK)
+			break;
+
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK) {
+			LOG_ERROR("%s failed to execute queue", __func__);
+			break;
+		}
+		retval = transaction_status(t);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("%s error on mem write", __func__);
+			break;
+		}
+
+		addr += n * size;
+		buf += n * size;
+		count -= n;
+	}
+
+	return retval;
+}
+
 static bool is_paging_enabled(struct target *t)
 {
 	struct x86_32_common *x86_32 = target_to_x86_32(t);
@@ -843,6 +984,8 @@ int lakemont_init_arch_info(struct target *t, struct x86_32_common *x86_32)
 	x86_32->transaction_status = transaction_status;
 	x86_32->read_hw_reg = read_hw_reg;
 	x86_32->write_hw_reg = write_hw_reg;
+	x86_32->read_mem_block = read_mem_block;
+	x86_32->write_mem_block = write_mem_block;
 	x86_32->sw_bpts_supported = sw_bpts_supported;
 	x86_32->get_num_user_regs = get_num_user_regs;
 	x86_32->is_paging_enabled = is_paging_enabled;
@@ -66,6 +66,7 @@
 #define PM_DSAR			((uint32_t)0x004F9300)
 #define PM_DR7			((uint32_t)0x00000400)
 #define DELAY_SUBMITPIR		0 /* for now 0 is working */
+#define MEM_BLOCK		256 /* memory accesses queued per flush */
 
 /* lakemont tapstatus bits */
 #define TS_PRDY_BIT		((uint32_t)0x00000001)
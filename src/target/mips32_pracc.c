@@ -1040,18 +1040,34 @@ int mips32_pracc_fastdata_xfer(struct mips_ejtag *ejtag_info, struct working_are
 	jmp_code[0] |= UPPER16(source->address);
 	jmp_code[1] |= LOWER16(source->address);
 
-	for (i = 0; i < (int) ARRAY_SIZE(jmp_code); i++) {
-		retval = wait_for_pracc_rw(ejtag_info, &ejtag_ctrl);
+	if (ejtag_info->mode != 0) {
+		/* queued mode: the jump goes out in a single flush */
+		struct pracc_queue_info ctx = {.max_code = ARRAY_SIZE(jmp_code)};
+		pracc_queue_init(&ctx);
+		if (ctx.retval != ERROR_OK)
+			return ctx.retval;
+
+		for (i = 0; i < (int) ARRAY_SIZE(jmp_code); i++)
+			pracc_add(&ctx, 0, jmp_code[i]);
+
+		retval = mips32_pracc_queue_exec(ejtag_info, &ctx, NULL);
+		pracc_queue_free(&ctx);
 		if (retval != ERROR_OK)
 			return retval;
+	} else {
+		for (i = 0; i < (int) ARRAY_SIZE(jmp_code); i++) {
+			retval = wait_for_pracc_rw(ejtag_info, &ejtag_ctrl);
+			if (retval != ERROR_OK)
+				return retval;
 
-		mips_ejtag_set_instr(ejtag_info, EJTAG_INST_DATA);
-		mips_ejtag_drscan_32_out(ejtag_info, jmp_code[i]);
+			mips_ejtag_set_instr(ejtag_info, EJTAG_INST_DATA);
+			mips_ejtag_drscan_32_out(ejtag_info, jmp_code[i]);
 
-		/* Clear the access pending bit (let the processor eat!) */
-		ejtag_ctrl = ejtag_info->ejtag_ctrl & ~EJTAG_CTRL_PRACC;
-		mips_ejtag_set_instr(ejtag_info, EJTAG_INST_CONTROL);
-		mips_ejtag_drscan_32_out(ejtag_info, ejtag_ctrl);
+			/* Clear the access pending bit (let the processor eat!) */
+			ejtag_ctrl = ejtag_info->ejtag_ctrl & ~EJTAG_CTRL_PRACC;
+			mips_ejtag_set_instr(ejtag_info, EJTAG_INST_CONTROL);
+			mips_ejtag_drscan_32_out(ejtag_info, ejtag_ctrl);
+		}
 	}
 
 	/* wait PrAcc pending bit for FASTDATA write */
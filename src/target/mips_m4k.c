@@ -46,6 +46,8 @@ static int mips_m4k_internal_restore(struct target *target, int current,
 static int mips_m4k_halt(struct target *target);
 static int mips_m4k_bulk_write_memory(struct target *target, uint32_t address,
 		uint32_t count, const uint8_t *buffer);
+static int mips_m4k_bulk_read_memory(struct target *target, uint32_t address,
+		uint32_t count, uint8_t *buffer);
 
 static int mips_m4k_examine_debug_reason(struct target *target)
 {
@@ -970,6 +972,14 @@ static int mips_m4k_read_memory(struct target *target, uint32_t address,
 	if (((size == 4) && (address & 0x3u)) || ((size == 2) && (address & 0x1u)))
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
+	if (size == 4 && count > MIPS32_FASTDATA_MIN_WORDS &&
+			(ejtag_info->impcode & EJTAG_IMP_NODMA)) {
+		int retval = mips_m4k_bulk_read_memory(target, address, count, buffer);
+		if (retval == ERROR_OK)
+			return ERROR_OK;
+		LOG_WARNING("Falling back to non-bulk read");
+	}
+
 	/* since we don't know if buffer is aligned, we allocate new mem that is always aligned */
 	void *t = NULL;
 
@@ -1022,7 +1032,7 @@ static int mips_m4k_write_memory(struct target *target, uint32_t address,
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
-	if (size == 4 && count > 32) {
+	if (size == 4 && count > MIPS32_FASTDATA_MIN_WORDS) {
 		int retval = mips_m4k_bulk_write_memory(target, address, count, buffer);
 		if (retval == ERROR_OK)
 			return ERROR_OK;
@@ -1139,16 +1149,15 @@ static int mips_m4k_examine(struct target *target)
 	return ERROR_OK;
 }
 
-static int mips_m4k_bulk_write_memory(struct target *target, uint32_t address,
-		uint32_t count, const uint8_t *buffer)
+/* Set up the working area holding the fastdata handler, shared by bulk
+ * reads and writes.  It must not overlap the range being transferred. */
+static int mips_m4k_fastdata_area(struct target *target, uint32_t address,
+		uint32_t count)
 {
 	struct mips32_common *mips32 = target_to_mips32(target);
 	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
 	struct working_area *fast_data_area;
 	int retval;
-	int write_t = 1;
-
-	LOG_DEBUG("address: 0x%8.8" PRIx32 ", count: 0x%8.8" PRIx32 "", address, count);
 
 	/* check alignment */
 	if (address & 0x3u)
@@ -1174,14 +1183,31 @@ static int mips_m4k_bulk_write_memory(struct target *target, uint32_t address,
 	fast_data_area = mips32->fast_data_area;
 
 	if (address <= fast_data_area->address + fast_data_area->size &&
-			fast_data_area->address <= address + count) {
-		LOG_ERROR("fast_data (0x%8.8" PRIx32 ") is within write area "
+			fast_data_area->address <= address + count * 4) {
+		LOG_ERROR("fast_data (0x%8.8" PRIx32 ") is within transfer area "
 			  "(0x%8.8" PRIx32 "-0x%8.8" PRIx32 ").",
-			  fast_data_area->address, address, address + count);
+			  fast_data_area->address, address, address + count * 4);
 		LOG_ERROR("Change work-area-phys or load_image address!");
 		return ERROR_FAIL;
 	}
 
+	return ERROR_OK;
+}
+
+static int mips_m4k_bulk_write_memory(struct target *target, uint32_t address,
+		uint32_t count, const uint8_t *buffer)
+{
+	struct mips32_common *mips32 = target_to_mips32(target);
+	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
+	int retval;
+	int write_t = 1;
+
+	LOG_DEBUG("address: 0x%8.8" PRIx32 ", count: 0x%8.8" PRIx32 "", address, count);
+
+	retval = mips_m4k_fastdata_area(target, address, count);
+	if (retval != ERROR_OK)
+		return retval;
+
 	/* mips32_pracc_fastdata_xfer requires uint32_t in host endianness, */
 	/* but byte array represents target endianness                      */
 	uint32_t *t = NULL;
@@ -1205,6 +1231,40 @@ static int mips_m4k_bulk_write_memory(struct target *target, uint32_t address,
 	return retval;
 }
 
+static int mips_m4k_bulk_read_memory(struct target *target, uint32_t address,
+		uint32_t count, uint8_t *buffer)
+{
+	struct mips32_common *mips32 = target_to_mips32(target);
+	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
+	int retval;
+	int write_t = 0;
+
+	LOG_DEBUG("address: 0x%8.8" PRIx32 ", count: 0x%8.8" PRIx32 "", address, count);
+
+	retval = mips_m4k_fastdata_area(target, address, count);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* mips32_pracc_fastdata_xfer returns uint32_t in host endianness, */
+	/* but byte array should represent target endianness               */
+	uint32_t *t = malloc(count * sizeof(uint32_t));
+	if (t == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	retval = mips32_pracc_fastdata_xfer(ejtag_info, mips32->fast_data_area, write_t, address,
+			count, t);
+	if (retval == ERROR_OK)
+		target_buffer_set_u32_array(target, buffer, count, t);
+	else
+		LOG_ERROR("Fastdata access Failed");
+
+	free(t);
+
+	return retval;
+}
+
 static int mips_m4k_verify_pointer(struct command_context *cmd_ctx,
 		struct mips_m4k_common *mips_m4k)
 {
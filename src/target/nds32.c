@@ -505,10 +505,45 @@ static struct reg *nds32_reg_current(struct nds32 *nds32, unsigned regnum)
 	return r;
 }
 
+/* Fetch the general registers and $pc in one adapter transaction, so
+ * that reading the context after a halt is served from the cache. */
+static void nds32_prefetch_core_regs(struct nds32 *nds32)
+{
+	struct aice_port_s *aice = target_to_aice(nds32->target);
+	struct reg *regs[PC - R0 + 1];
+	uint32_t num[PC - R0 + 1];
+	uint32_t val[PC - R0 + 1];
+	uint32_t count = 0;
+
+	for (unsigned int i = R0; i <= PC; i++) {
+		struct reg *r = nds32_reg_current(nds32, i);
+		struct nds32_reg *reg_arch_info = r->arch_info;
+
+		if (r->valid || reg_arch_info->enable == false)
+			continue;
+
+		regs[count] = r;
+		num[count++] = nds32->register_map(nds32, reg_arch_info->num);
+	}
+
+	if (count == 0 || aice_read_reg_list(aice, num, val, count) != ERROR_OK)
+		return;
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct nds32_reg *reg_arch_info = regs[i]->arch_info;
+
+		buf_set_u32(reg_arch_info->value, 0, 32, val[i]);
+		regs[i]->valid = true;
+		regs[i]->dirty = false;
+	}
+}
+
 int nds32_full_context(struct nds32 *nds32)
 {
 	uint32_t value, value_ir0;
 
+	nds32_prefetch_core_regs(nds32);
+
 	/* save $pc & $psw */
 	nds32_get_mapped_reg(nds32, PC, &value);
 	nds32_get_mapped_reg(nds32, IR0, &value_ir0);
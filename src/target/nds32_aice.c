@@ -32,6 +32,21 @@ int aice_read_reg_64(struct aice_port_s *aice, uint32_t num, uint64_t *val)
 	return aice->port->api->read_reg_64(aice->coreid, num, val);
 }
 
+int aice_read_reg_list(struct aice_port_s *aice, const uint32_t *num,
+		uint32_t *val, uint32_t count)
+{
+	if (aice->port->api->read_reg_list == NULL) {
+		for (uint32_t i = 0; i < count; i++) {
+			int retval = aice_read_register(aice, num[i], &val[i]);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		return ERROR_OK;
+	}
+
+	return aice->port->api->read_reg_list(aice->coreid, num, val, count);
+}
+
 int aice_write_reg_64(struct aice_port_s *aice, uint32_t num, uint64_t val)
 {
 	if (aice->port->api->write_reg_64 == NULL) {
@@ -23,6 +23,8 @@
 
 int aice_read_reg_64(struct aice_port_s *aice, uint32_t num, uint64_t *val);
 int aice_write_reg_64(struct aice_port_s *aice, uint32_t num, uint64_t val);
+int aice_read_reg_list(struct aice_port_s *aice, const uint32_t *num,
+		uint32_t *val, uint32_t count);
 int aice_read_tlb(struct aice_port_s *aice, uint32_t virtual_address,
 		uint32_t *physical_address);
 int aice_cache_ctl(struct aice_port_s *aice, uint32_t subtype, uint32_t address);
@@ -1343,6 +1343,37 @@ COMMAND_HANDLER(or1k_du_list_command_handler)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(or1k_du_burst_size_command_handler)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct or1k_common *or1k = target_to_or1k(target);
+	struct or1k_du *du_core = or1k_to_du(or1k);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!du_core) {
+		LOG_ERROR("No debug unit selected");
+		return ERROR_FAIL;
+	}
+
+	if (CMD_ARGC == 1) {
+		int burst_size;
+		COMMAND_PARSE_NUMBER(int, CMD_ARGV[0], burst_size);
+		/* the burst command has a 16-bit length field */
+		if (burst_size < 1 || burst_size > 0xffff) {
+			LOG_ERROR("Burst size must be 1 to 65535 words");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		du_core->burst_size = burst_size;
+	}
+
+	command_print(CMD_CTX, "%s debug unit burst size: %d words",
+		      du_core->name, du_core->burst_size);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(or1k_addreg_command_handler)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -1399,6 +1430,13 @@ static const struct command_registration or1k_hw_ip_command_handlers[] = {
 		.usage = "select_tap name",
 		.help = "Display available Debug Unit core",
 	},
+	{
+		"du_burst_size",
+		.handler = or1k_du_burst_size_command_handler,
+		.mode = COMMAND_ANY,
+		.usage = "du_burst_size [words]",
+		.help = "Display or set the memory burst size of the Debug Unit",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
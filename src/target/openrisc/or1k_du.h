@@ -38,6 +38,7 @@ struct or1k_du {
 	const char *name;
 	struct list_head list;
 	int options;
+	int burst_size;		/* words per memory burst */
 
 	int (*or1k_jtag_init)(struct or1k_jtag *jtag_info);
 
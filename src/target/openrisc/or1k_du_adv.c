@@ -135,7 +135,9 @@
 #define BURST_READ_READY		1
 #define MAX_BUS_ERRORS			2
 
-#define MAX_BURST_SIZE			(4 * 1024)
+#define MAX_BURST_SIZE			(4 * 1024)	/* default, in words */
+#define ADBG_MAX_BURST_SIZE		0xffff		/* 16-bit length field */
+#define MAX_PIPELINED_BURSTS		8		/* per JTAG flush */
 
 #define STATUS_BYTES			1
 #define CRC_LEN				4
@@ -420,7 +422,7 @@ static int adbg_ctrl_read(struct or1k_jtag *jtag_info, uint32_t regidx,
  * 32-bit address
  * 16-bit length (of the burst, in words)
  */
-static int adbg_burst_command(struct or1k_jtag *jtag_info, uint32_t opcode,
+static void adbg_queue_burst_command(struct or1k_jtag *jtag_info, uint32_t opcode,
 			      uint32_t address, uint16_t length_words)
 {
 	uint32_t data[2];
@@ -437,6 +439,12 @@ static int adbg_burst_command(struct or1k_jtag *jtag_info, uint32_t opcode,
 	field.in_value = NULL;
 
 	jtag_add_dr_scan(jtag_info->tap, 1, &field, TAP_IDLE);
+}
+
+static int adbg_burst_command(struct or1k_jtag *jtag_info, uint32_t opcode,
+			      uint32_t address, uint16_t length_words)
+{
+	adbg_queue_burst_command(jtag_info, opcode, address, length_words);
 
 	return jtag_execute_queue();
 }
@@ -737,6 +745,234 @@ retry_full_write:
 	return ERROR_OK;
 }
 
+static int adbg_burst_size(void)
+{
+	if (or1k_du_adv.burst_size > 0 && or1k_du_adv.burst_size <= ADBG_MAX_BURST_SIZE)
+		return or1k_du_adv.burst_size;
+	return MAX_BURST_SIZE;
+}
+
+static uint8_t adbg_wb_burst_opcode(int size, bool write)
+{
+	if (size == 1)
+		return write ? DBG_WB_CMD_BWRITE8 : DBG_WB_CMD_BREAD8;
+	else if (size == 2)
+		return write ? DBG_WB_CMD_BWRITE16 : DBG_WB_CMD_BREAD16;
+	return write ? DBG_WB_CMD_BWRITE32 : DBG_WB_CMD_BREAD32;
+}
+
+/* Read the WB error register after a group of bursts, clear it if set.
+ * *error tells if the group has to be done again. */
+static int adbg_wb_check_error(struct or1k_jtag *jtag_info, bool *error)
+{
+	uint32_t err_data[2] = {0, 0};
+	int retval;
+
+	*error = false;
+	if (or1k_du_adv.options & ADBG_USE_HISPEED)
+		return ERROR_OK;
+
+	retval = adbg_ctrl_read(jtag_info, DBG_WB_REG_ERROR, err_data, 1);
+	if (retval != ERROR_OK || !(err_data[0] & 0x1))
+		return retval;
+
+	retval = adbg_ctrl_read(jtag_info, DBG_WB_REG_ERROR, err_data, 33);
+	if (retval != ERROR_OK)
+		return retval;
+
+	LOG_WARNING("WB bus error during pipelined bursts, address 0x%08" PRIx32 ", retrying!",
+		    (err_data[0] >> 1) | (err_data[1] << 31));
+
+	err_data[0] = 1;
+	*error = true;
+	return adbg_ctrl_write(jtag_info, DBG_WB_REG_ERROR, err_data, 1);
+}
+
+/* Burst read of count words from the WB, up to MAX_PIPELINED_BURSTS
+ * bursts are queued before the JTAG queue is flushed. The status bit
+ * and CRC of each are checked afterwards, a failed burst is done again
+ * on its own with adbg_wb_burst_read(). */
+static int adbg_wb_burst_read_pipelined(struct or1k_jtag *jtag_info, int size,
+			      int count, uint32_t start_address, uint8_t *data)
+{
+	int burst_words = adbg_burst_size();
+	int slot_bytes = burst_words * size + CRC_LEN + STATUS_BYTES;
+	uint8_t opcode = adbg_wb_burst_opcode(size, false);
+	int retval = ERROR_OK;
+
+	uint8_t *in_buffer = malloc(MAX_PIPELINED_BURSTS * slot_bytes);
+	if (in_buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	while (count) {
+		int words[MAX_PIPELINED_BURSTS];
+		struct scan_field field;
+		int n = 0, group_words = 0;
+
+		while (n < MAX_PIPELINED_BURSTS && group_words < count) {
+			words[n] = MIN(burst_words, count - group_words);
+
+			adbg_queue_burst_command(jtag_info, opcode,
+				start_address + group_words * size, words[n]);
+
+			field.num_bits = (words[n] * size + CRC_LEN + STATUS_BYTES) * 8;
+			field.out_value = NULL;
+			field.in_value = in_buffer + n * slot_bytes;
+			jtag_add_dr_scan(jtag_info->tap, 1, &field, TAP_IDLE);
+
+			group_words += words[n++];
+		}
+
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			break;
+
+		int offset = 0;
+		for (int i = 0; i < n && retval == ERROR_OK; i++) {
+			uint8_t *slot = in_buffer + i * slot_bytes;
+			int bytes = words[i] * size;
+			uint32_t address = start_address + offset;
+			int shift = find_status_bit(slot, STATUS_BYTES);
+			bool ok = shift >= 0;
+
+			if (ok) {
+				uint32_t crc_read, crc_calc = 0xffffffff;
+
+				buffer_shr(slot, bytes + CRC_LEN + STATUS_BYTES, shift);
+				memcpy(&crc_read, &slot[bytes], 4);
+				for (int j = 0; j < bytes; j++)
+					crc_calc = adbg_compute_crc(crc_calc, slot[j], 8);
+				ok = crc_calc == crc_read;
+			}
+
+			if (ok)
+				memcpy(data + offset, slot, bytes);
+			else {
+				LOG_WARNING("Pipelined burst read at 0x%08" PRIx32 " failed, retrying", address);
+				retval = adbg_wb_burst_read(jtag_info, size, words[i], address,
+							    data + offset);
+			}
+			offset += bytes;
+		}
+		if (retval != ERROR_OK)
+			break;
+
+		bool error;
+		retval = adbg_wb_check_error(jtag_info, &error);
+		if (retval != ERROR_OK)
+			break;
+		if (error) {
+			offset = 0;
+			for (int i = 0; i < n && retval == ERROR_OK; i++) {
+				retval = adbg_wb_burst_read(jtag_info, size, words[i],
+						start_address + offset, data + offset);
+				offset += words[i] * size;
+			}
+			if (retval != ERROR_OK)
+				break;
+		}
+
+		count -= group_words;
+		start_address += group_words * size;
+		data += group_words * size;
+	}
+
+	free(in_buffer);
+	return retval;
+}
+
+/* As adbg_wb_burst_read_pipelined(), for writes: the 'CRC match' bit of
+ * each burst is checked after the flush. */
+static int adbg_wb_burst_write_pipelined(struct or1k_jtag *jtag_info, const uint8_t *data,
+			int size, int count, uint32_t start_address)
+{
+	int burst_words = adbg_burst_size();
+	uint8_t opcode = adbg_wb_burst_opcode(size, true);
+	int retval = ERROR_OK;
+
+	while (count) {
+		int words[MAX_PIPELINED_BURSTS];
+		uint8_t match[MAX_PIPELINED_BURSTS];
+		int n = 0, group_words = 0;
+
+		while (n < MAX_PIPELINED_BURSTS && group_words < count) {
+			const uint8_t *burst_data = data + group_words * size;
+			struct scan_field field[3];
+			uint8_t value = 1;
+
+			words[n] = MIN(burst_words, count - group_words);
+
+			adbg_queue_burst_command(jtag_info, opcode,
+				start_address + group_words * size, words[n]);
+
+			uint32_t crc_calc = 0xffffffff;
+			for (int i = 0; i < words[n] * size; i++)
+				crc_calc = adbg_compute_crc(crc_calc, burst_data[i], 8);
+
+			/* start bit, data and CRC; out values are copied when queued */
+			field[0].num_bits = 1;
+			field[0].out_value = &value;
+			field[0].in_value = NULL;
+			field[1].num_bits = words[n] * size * 8;
+			field[1].out_value = burst_data;
+			field[1].in_value = NULL;
+			field[2].num_bits = 32;
+			field[2].out_value = (uint8_t *)&crc_calc;
+			field[2].in_value = NULL;
+			jtag_add_dr_scan(jtag_info->tap, 3, field, TAP_DRSHIFT);
+
+			/* 'CRC match' bit of this burst */
+			match[n] = 0;
+			field[0].num_bits = 1;
+			field[0].out_value = NULL;
+			field[0].in_value = &match[n];
+			jtag_add_dr_scan(jtag_info->tap, 1, field, TAP_IDLE);
+
+			group_words += words[n++];
+		}
+
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			return retval;
+
+		int offset = 0;
+		for (int i = 0; i < n; i++) {
+			if (!(match[i] & 1)) {
+				LOG_WARNING("Pipelined burst write at 0x%08" PRIx32 " failed, retrying",
+					    start_address + offset);
+				retval = adbg_wb_burst_write(jtag_info, data + offset, size,
+							     words[i], start_address + offset);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			offset += words[i] * size;
+		}
+
+		bool error;
+		retval = adbg_wb_check_error(jtag_info, &error);
+		if (retval != ERROR_OK)
+			return retval;
+		if (error) {
+			offset = 0;
+			for (int i = 0; i < n; i++) {
+				retval = adbg_wb_burst_write(jtag_info, data + offset, size,
+							     words[i], start_address + offset);
+				if (retval != ERROR_OK)
+					return retval;
+				offset += words[i] * size;
+			}
+		}
+
+		count -= group_words;
+		start_address += group_words * size;
+		data += group_words * size;
+	}
+
+	return ERROR_OK;
+}
+
 /* Currently hard set in functions to 32-bits */
 static int or1k_adv_jtag_read_cpu(struct or1k_jtag *jtag_info,
 		uint32_t addr, int count, uint32_t *value)
@@ -882,24 +1118,9 @@ static int or1k_adv_jtag_read_memory(struct or1k_jtag *jtag_info,
 	if (retval != ERROR_OK)
 		return retval;
 
-	int block_count_left = count;
-	uint32_t block_count_address = addr;
-	uint8_t *block_count_buffer = buffer;
-
-	while (block_count_left) {
-
-		int blocks_this_round = (block_count_left > MAX_BURST_SIZE) ?
-			MAX_BURST_SIZE : block_count_left;
-
-		retval = adbg_wb_burst_read(jtag_info, size, blocks_this_round,
-					    block_count_address, block_count_buffer);
-		if (retval != ERROR_OK)
-			return retval;
-
-		block_count_left -= blocks_this_round;
-		block_count_address += size * MAX_BURST_SIZE;
-		block_count_buffer += size * MAX_BURST_SIZE;
-	}
+	retval = adbg_wb_burst_read_pipelined(jtag_info, size, count, addr, buffer);
+	if (retval != ERROR_OK)
+		return retval;
 
 	/* The adv_debug_if always return words and half words in
 	 * little-endian order no matter what the target endian is.
@@ -962,33 +1183,12 @@ static int or1k_adv_jtag_write_memory(struct or1k_jtag *jtag_info,
 		buffer = t;
 	}
 
-	int block_count_left = count;
-	uint32_t block_count_address = addr;
-	uint8_t *block_count_buffer = (uint8_t *)buffer;
-
-	while (block_count_left) {
-
-		int blocks_this_round = (block_count_left > MAX_BURST_SIZE) ?
-			MAX_BURST_SIZE : block_count_left;
-
-		retval = adbg_wb_burst_write(jtag_info, block_count_buffer,
-					     size, blocks_this_round,
-					     block_count_address);
-		if (retval != ERROR_OK) {
-			if (t != NULL)
-				free(t);
-			return retval;
-		}
-
-		block_count_left -= blocks_this_round;
-		block_count_address += size * MAX_BURST_SIZE;
-		block_count_buffer += size * MAX_BURST_SIZE;
-	}
+	retval = adbg_wb_burst_write_pipelined(jtag_info, buffer, size, count, addr);
 
 	if (t != NULL)
 		free(t);
 
-	return ERROR_OK;
+	return retval;
 }
 
 int or1k_adv_jtag_jsp_xfer(struct or1k_jtag *jtag_info,
@@ -1078,6 +1278,7 @@ int or1k_adv_jtag_jsp_xfer(struct or1k_jtag *jtag_info,
 static struct or1k_du or1k_du_adv = {
 	.name                     = "adv",
 	.options                  = NO_OPTION,
+	.burst_size               = MAX_BURST_SIZE,
 	.or1k_jtag_init           = or1k_adv_jtag_init,
 
 	.or1k_is_cpu_running      = or1k_adv_is_cpu_running,
@@ -0,0 +1,554 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/command.h>
+#include <helper/metrics.h>
+#include <jtag/jtag.h>
+#include <server/server.h>
+#include "target.h"
+#include "rtt.h"
+
+/*
+ * The control block, as laid out by the SEGGER RTT target code:
+ *
+ *   char     id[16]          "SEGGER RTT", zero padded
+ *   int32_t  num_up          up (target to host) buffers
+ *   int32_t  num_down        down (host to target) buffers
+ *   followed by num_up, then num_down buffer descriptors of
+ *   uint32_t name, buffer, size, wr_off, rd_off, flags
+ *
+ * The writer of a ring owns wr_off and the reader rd_off, so the host
+ * never races the target on a word.  Channel n is up buffer n together
+ * with down buffer n.
+ */
+#define RTT_ID_MAX			16
+#define RTT_CB_HEADER_SIZE	24
+#define RTT_DESC_SIZE		24
+#define RTT_DESC_WR_OFF		12
+#define RTT_DESC_RD_OFF		16
+#define RTT_MAX_CHANNELS	16
+#define RTT_NAME_MAX		32
+
+/* the control block search reads this much target memory at a time */
+#define RTT_SCAN_CHUNK		1024
+/* bytes taken from one up buffer per poll */
+#define RTT_READ_MAX		4096
+/* client input not yet written to a down buffer */
+#define RTT_DOWN_QUEUE		1024
+/* polls skipped at most while no data moves, the timer ticks every ms */
+#define RTT_IDLE_SKIP_MAX	63
+
+#define RTT_DEFAULT_ID		"SEGGER RTT"
+
+struct rtt_channel {
+	uint32_t desc;			/* address of the buffer descriptor */
+	uint32_t buffer;
+	uint32_t size;
+	char name[RTT_NAME_MAX];
+};
+
+static struct {
+	struct target *target;
+	uint32_t addr;			/* memory searched for the control block */
+	uint32_t size;
+	char id[RTT_ID_MAX + 1];
+	bool configured;
+	bool started;
+	uint32_t cb;
+	unsigned int num_up, num_down;
+	struct rtt_channel up[RTT_MAX_CHANNELS];
+	struct rtt_channel down[RTT_MAX_CHANNELS];
+	/* TCP clients, one per channel, kept across rtt stop and start */
+	struct connection *clients[RTT_MAX_CHANNELS];
+	uint8_t down_queue[RTT_MAX_CHANNELS][RTT_DOWN_QUEUE];
+	unsigned int down_queue_len[RTT_MAX_CHANNELS];
+	unsigned int idle_skip, idle_count;
+} rtt;
+
+static uint8_t rtt_data[RTT_MAX_CHANNELS * RTT_READ_MAX];
+
+METRIC_COUNTER(rtt_dropped_metric, "openocd_rtt_dropped_bytes_total",
+		"RTT input dropped because the target did not read it");
+
+static int rtt_find_cb(struct target *target, uint32_t *cb)
+{
+	size_t id_len = strlen(rtt.id);
+	uint8_t buf[RTT_SCAN_CHUNK + RTT_ID_MAX];
+	int retval;
+
+	/* consecutive chunks overlap so that an ID across the seam is found */
+	for (uint32_t off = 0; off + id_len <= rtt.size; off += RTT_SCAN_CHUNK) {
+		uint32_t len = MIN(RTT_SCAN_CHUNK + id_len - 1, rtt.size - off);
+
+		retval = target_read_buffer(target, rtt.addr + off, len, buf);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (uint32_t i = 0; i + id_len <= len; i++) {
+			if (!memcmp(buf + i, rtt.id, id_len)) {
+				*cb = rtt.addr + off + i;
+				return ERROR_OK;
+			}
+		}
+	}
+
+	return ERROR_FAIL;
+}
+
+static int rtt_read_descs(struct target *target, uint32_t addr,
+		struct rtt_channel *chans, unsigned int num)
+{
+	uint8_t desc[RTT_MAX_CHANNELS * RTT_DESC_SIZE];
+	int retval;
+
+	if (!num)
+		return ERROR_OK;
+
+	retval = target_read_buffer(target, addr, num * RTT_DESC_SIZE, desc);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int i = 0; i < num; i++) {
+		struct rtt_channel *ch = &chans[i];
+		const uint8_t *d = desc + i * RTT_DESC_SIZE;
+		uint32_t name = target_buffer_get_u32(target, d);
+
+		ch->desc = addr + i * RTT_DESC_SIZE;
+		ch->buffer = target_buffer_get_u32(target, d + 4);
+		ch->size = target_buffer_get_u32(target, d + 8);
+
+		memset(ch->name, 0, sizeof(ch->name));
+		if (name && target_read_buffer(target, name, sizeof(ch->name) - 1,
+					(uint8_t *)ch->name) != ERROR_OK)
+			ch->name[0] = 0;
+	}
+
+	return ERROR_OK;
+}
+
+static int rtt_read_channels(struct target *target)
+{
+	uint8_t header[RTT_CB_HEADER_SIZE];
+	int retval;
+
+	retval = target_read_buffer(target, rtt.cb, sizeof(header), header);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint32_t num_up = target_buffer_get_u32(target, header + 16);
+	uint32_t num_down = target_buffer_get_u32(target, header + 20);
+	uint32_t base = rtt.cb + RTT_CB_HEADER_SIZE;
+	/* the down descriptors follow all of the up ones */
+	uint32_t down_base = base + num_up * RTT_DESC_SIZE;
+
+	if (num_up > RTT_MAX_CHANNELS || num_down > RTT_MAX_CHANNELS) {
+		LOG_WARNING("RTT: %" PRIu32 " up and %" PRIu32 " down buffers, "
+				"using the first %d of each", num_up, num_down, RTT_MAX_CHANNELS);
+		num_up = MIN(num_up, RTT_MAX_CHANNELS);
+		num_down = MIN(num_down, RTT_MAX_CHANNELS);
+	}
+
+	retval = rtt_read_descs(target, base, rtt.up, num_up);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = rtt_read_descs(target, down_base, rtt.down, num_down);
+	if (retval != ERROR_OK)
+		return retval;
+
+	rtt.num_up = num_up;
+	rtt.num_down = num_down;
+
+	return ERROR_OK;
+}
+
+/* One poll moves data for every channel with a client: a scattered read
+ * of the ring offsets, a scattered read of the data that is there, and
+ * the offset updates. */
+static int rtt_poll(void *priv)
+{
+	struct target *target = rtt.target;
+	struct target_mem_xfer xfers[4 * RTT_MAX_CHANNELS];
+	uint8_t offsets[2 * RTT_MAX_CHANNELS][8];
+	struct rtt_channel *chans[2 * RTT_MAX_CHANNELS];
+	unsigned int channel[2 * RTT_MAX_CHANNELS];
+	uint32_t avail[RTT_MAX_CHANNELS];
+	unsigned int n = 0, n_up, m = 0;
+	bool moved = false;
+	int retval;
+
+	if (!rtt.started || !is_jtag_poll_safe() || !target_was_examined(target))
+		return ERROR_OK;
+	if (target->state != TARGET_RUNNING && target->state != TARGET_HALTED &&
+			target->state != TARGET_DEBUG_RUNNING)
+		return ERROR_OK;
+
+	if (rtt.idle_count < rtt.idle_skip) {
+		rtt.idle_count++;
+		return ERROR_OK;
+	}
+	rtt.idle_count = 0;
+
+	for (unsigned int c = 0; c < rtt.num_up; c++) {
+		if (rtt.clients[c] && rtt.up[c].size) {
+			chans[n] = &rtt.up[c];
+			channel[n++] = c;
+		}
+	}
+	n_up = n;
+	for (unsigned int c = 0; c < rtt.num_down; c++) {
+		if (rtt.down_queue_len[c] && rtt.down[c].size) {
+			chans[n] = &rtt.down[c];
+			channel[n++] = c;
+		}
+	}
+
+	for (unsigned int i = 0; i < n; i++) {
+		xfers[i].address = chans[i]->desc + RTT_DESC_WR_OFF;
+		xfers[i].size = 4;
+		xfers[i].count = 2;
+		xfers[i].buffer = offsets[i];
+	}
+	retval = n ? target_read_memory_multi(target, xfers, n) : ERROR_OK;
+	if (retval != ERROR_OK) {
+		LOG_DEBUG("RTT: reading the ring offsets failed");
+		return ERROR_OK;
+	}
+
+	/* up buffers: what lies between rd_off and wr_off, in up to two pieces */
+	for (unsigned int i = 0; i < n_up; i++) {
+		struct rtt_channel *ch = chans[i];
+		uint32_t wr = target_buffer_get_u32(target, offsets[i]);
+		uint32_t rd = target_buffer_get_u32(target, offsets[i] + 4);
+		uint8_t *data = rtt_data + i * RTT_READ_MAX;
+
+		avail[i] = 0;
+		if (wr >= ch->size || rd >= ch->size)
+			continue;
+
+		avail[i] = MIN(wr >= rd ? wr - rd : ch->size - rd + wr, RTT_READ_MAX);
+		if (!avail[i])
+			continue;
+
+		uint32_t first = MIN(avail[i], ch->size - rd);
+		xfers[m].address = ch->buffer + rd;
+		xfers[m].size = 1;
+		xfers[m].count = first;
+		xfers[m++].buffer = data;
+		if (avail[i] > first) {
+			xfers[m].address = ch->buffer;
+			xfers[m].size = 1;
+			xfers[m].count = avail[i] - first;
+			xfers[m++].buffer = data + first;
+		}
+	}
+	retval = m ? target_read_memory_multi(target, xfers, m) : ERROR_OK;
+	if (retval != ERROR_OK) {
+		LOG_DEBUG("RTT: reading the up buffers failed");
+		return ERROR_OK;
+	}
+
+	for (unsigned int i = 0; i < n_up; i++) {
+		struct rtt_channel *ch = chans[i];
+		if (!avail[i])
+			continue;
+
+		uint32_t rd = target_buffer_get_u32(target, offsets[i] + 4);
+		retval = target_write_u32(target, ch->desc + RTT_DESC_RD_OFF,
+				(rd + avail[i]) % ch->size);
+		if (retval != ERROR_OK)
+			return ERROR_OK;
+
+		if (connection_write(rtt.clients[channel[i]], rtt_data + i * RTT_READ_MAX,
+					avail[i]) != (int)avail[i])
+			LOG_DEBUG("RTT: client of channel %u is not keeping up", channel[i]);
+		moved = true;
+	}
+
+	/* down buffers: one byte always stays free, wr_off == rd_off is empty */
+	for (unsigned int i = n_up; i < n; i++) {
+		struct rtt_channel *ch = chans[i];
+		unsigned int c = channel[i];
+		uint32_t wr = target_buffer_get_u32(target, offsets[i]);
+		uint32_t rd = target_buffer_get_u32(target, offsets[i] + 4);
+
+		if (wr >= ch->size || rd >= ch->size)
+			continue;
+
+		uint32_t space = rd > wr ? rd - wr - 1 : ch->size - (wr - rd) - 1;
+		uint32_t len = MIN(space, rtt.down_queue_len[c]);
+		if (!len)
+			continue;
+
+		uint32_t first = MIN(len, ch->size - wr);
+		retval = target_write_buffer(target, ch->buffer + wr, first, rtt.down_queue[c]);
+		if (retval == ERROR_OK && len > first)
+			retval = target_write_buffer(target, ch->buffer, len - first,
+					rtt.down_queue[c] + first);
+		if (retval == ERROR_OK)
+			retval = target_write_u32(target, ch->desc + RTT_DESC_WR_OFF,
+					(wr + len) % ch->size);
+		if (retval != ERROR_OK)
+			return ERROR_OK;
+
+		rtt.down_queue_len[c] -= len;
+		memmove(rtt.down_queue[c], rtt.down_queue[c] + len, rtt.down_queue_len[c]);
+		moved = true;
+	}
+
+	/* back off while nothing moves, come back quickly once data flows */
+	if (moved)
+		rtt.idle_skip = 0;
+	else
+		rtt.idle_skip = MIN(2 * rtt.idle_skip + 1, RTT_IDLE_SKIP_MAX);
+
+	return ERROR_OK;
+}
+
+static void rtt_wake(void)
+{
+	rtt.idle_skip = 0;
+	rtt.idle_count = 0;
+}
+
+static int rtt_new_connection(struct connection *connection)
+{
+	unsigned int c = *(unsigned int *)connection->service->priv;
+
+	if (rtt.clients[c]) {
+		LOG_ERROR("RTT channel %u already has a client", c);
+		return ERROR_CONNECTION_REJECTED;
+	}
+
+	rtt.clients[c] = connection;
+	rtt_wake();
+
+	return ERROR_OK;
+}
+
+static int rtt_input(struct connection *connection)
+{
+	unsigned int c = *(unsigned int *)connection->service->priv;
+	uint8_t buf[256];
+
+	int len = connection_read(connection, buf, sizeof(buf));
+	if (len <= 0) {
+		if (len < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	unsigned int room = RTT_DOWN_QUEUE - rtt.down_queue_len[c];
+	if ((unsigned int)len > room) {
+		LOG_WARNING("RTT channel %u: the target does not read its input, "
+				"%u bytes dropped", c, len - room);
+		metric_add(&rtt_dropped_metric, len - room);
+		len = room;
+	}
+	memcpy(rtt.down_queue[c] + rtt.down_queue_len[c], buf, len);
+	rtt.down_queue_len[c] += len;
+	rtt_wake();
+
+	return ERROR_OK;
+}
+
+static int rtt_closed(struct connection *connection)
+{
+	unsigned int c = *(unsigned int *)connection->service->priv;
+
+	if (rtt.clients[c] == connection)
+		rtt.clients[c] = NULL;
+	rtt.down_queue_len[c] = 0;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_setup_command)
+{
+	if (CMD_ARGC < 2 || CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const char *id = CMD_ARGC == 3 ? CMD_ARGV[2] : RTT_DEFAULT_ID;
+	if (!strlen(id) || strlen(id) > RTT_ID_MAX) {
+		LOG_ERROR("The control block ID takes 1 to %d characters", RTT_ID_MAX);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], rtt.addr);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], rtt.size);
+	strcpy(rtt.id, id);
+	rtt.target = get_current_target(CMD_CTX);
+	rtt.configured = true;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_start_command)
+{
+	int retval;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!rtt.configured) {
+		LOG_ERROR("Use 'rtt setup' first");
+		return ERROR_FAIL;
+	}
+
+	/* the target may have been reset and the control block moved */
+	rtt.started = false;
+
+	retval = rtt_find_cb(rtt.target, &rtt.cb);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("No RTT control block '%s' in 0x%08" PRIx32 "..0x%08" PRIx32,
+				rtt.id, rtt.addr, rtt.addr + rtt.size);
+		return ERROR_FAIL;
+	}
+
+	retval = rtt_read_channels(rtt.target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	command_print(CMD_CTX, "RTT control block at 0x%08" PRIx32 ", %u up and %u down buffers",
+			rtt.cb, rtt.num_up, rtt.num_down);
+
+	target_unregister_timer_callback(rtt_poll, NULL);
+	retval = target_register_timer_callback(rtt_poll, 1, 1, NULL);
+	if (retval != ERROR_OK)
+		return retval;
+
+	rtt_wake();
+	rtt.started = true;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_stop_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	rtt.started = false;
+	target_unregister_timer_callback(rtt_poll, NULL);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_channels_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!rtt.started) {
+		LOG_ERROR("RTT is not started");
+		return ERROR_FAIL;
+	}
+
+	for (unsigned int c = 0; c < rtt.num_up; c++)
+		command_print(CMD_CTX, "up %u: \"%s\" %" PRIu32 " bytes", c,
+				rtt.up[c].name, rtt.up[c].size);
+	for (unsigned int c = 0; c < rtt.num_down; c++)
+		command_print(CMD_CTX, "down %u: \"%s\" %" PRIu32 " bytes", c,
+				rtt.down[c].name, rtt.down[c].size);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_server_command)
+{
+	unsigned int *channel;
+	int retval;
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	channel = malloc(sizeof(*channel));
+	if (!channel)
+		return ERROR_FAIL;
+
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], *channel);
+	if (*channel >= RTT_MAX_CHANNELS) {
+		LOG_ERROR("RTT channels are 0 to %d", RTT_MAX_CHANNELS - 1);
+		free(channel);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	/* one client per channel; the service stays until OpenOCD exits */
+	retval = add_service("rtt", CMD_ARGV[0], 1, rtt_new_connection,
+			rtt_input, rtt_closed, channel);
+	if (retval != ERROR_OK)
+		free(channel);
+
+	return retval;
+}
+
+static const struct command_registration rtt_subcommand_handlers[] = {
+	{
+		.name = "setup",
+		.handler = handle_rtt_setup_command,
+		.mode = COMMAND_ANY,
+		.help = "set the memory searched for the RTT control block",
+		.usage = "address size [ID]",
+	},
+	{
+		.name = "start",
+		.handler = handle_rtt_start_command,
+		.mode = COMMAND_EXEC,
+		.help = "find the control block and start moving channel data",
+		.usage = "",
+	},
+	{
+		.name = "stop",
+		.handler = handle_rtt_stop_command,
+		.mode = COMMAND_EXEC,
+		.help = "stop moving channel data",
+		.usage = "",
+	},
+	{
+		.name = "channels",
+		.handler = handle_rtt_channels_command,
+		.mode = COMMAND_EXEC,
+		.help = "list the buffers of the control block",
+		.usage = "",
+	},
+	{
+		.name = "server",
+		.handler = handle_rtt_server_command,
+		.mode = COMMAND_ANY,
+		.help = "connect an RTT channel to a TCP port",
+		.usage = "port channel",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration rtt_command_handlers[] = {
+	{
+		.name = "rtt",
+		.mode = COMMAND_ANY,
+		.help = "Real Time Transfer through target memory",
+		.usage = "",
+		.chain = rtt_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int rtt_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, rtt_command_handlers);
+}
@@ -42,6 +42,8 @@
 #endif
 
 #include <helper/time_support.h>
+#include <helper/tracelog.h>
+#include <helper/perf.h>
 #include <jtag/jtag.h>
 #include <flash/nor/core.h>
 
@@ -54,6 +56,7 @@
 #include "image.h"
 #include "rtos/rtos.h"
 #include "transport/transport.h"
+#include "server/server.h"
 
 /* default halt wait timeout (ms) */
 #define DEFAULT_HALT_TIMEOUT 5000
@@ -66,13 +69,17 @@ static int target_array2mem(Jim_Interp *interp, struct target *target,
 		int argc, Jim_Obj * const *argv);
 static int target_mem2array(Jim_Interp *interp, struct target *target,
 		int argc, Jim_Obj * const *argv);
+static int target_read_memory_bin(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj * const *argv);
+static int target_write_memory_bin(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj * const *argv);
+static int target_mem_batch(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj * const *argv);
 static int target_register_user_commands(struct command_context *cmd_ctx);
 static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
-static int target_profiling_default(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
 /* targets */
 extern struct target_type arm7tdmi_target;
@@ -140,11 +147,32 @@ static struct target_type *target_types[] = {
 
 struct target *all_targets;
 static struct target_event_callback *target_event_callbacks;
-static struct target_timer_callback *target_timer_callbacks;
+/* timer callbacks, a min-heap on their next call time */
+static struct target_timer_callback **target_timer_heap;
+static unsigned int target_timer_count;
+static unsigned int target_timer_heap_size;
+/* callbacks taken off the heap by the pass calling them */
+static struct target_timer_callback *target_timer_firing;
 LIST_HEAD(target_reset_callback_list);
 LIST_HEAD(target_trace_callback_list);
 static const int polling_interval = 100;
 
+PERF_COUNTER(read_memory_perf, "target_read_memory");
+PERF_COUNTER(write_memory_perf, "target_write_memory");
+PERF_COUNTER(run_algorithm_perf, "target_run_algorithm");
+
+/* Background polling adapts to the target state: fast right after a
+ * resume, step or halt request so the halt is seen quickly, backing off
+ * to poll_interval_max while the target keeps running, and rarely while
+ * it sits halted. See "poll_interval". */
+static int poll_interval_min = 10;
+static int poll_interval_max = 100;
+static int poll_interval_halted = 500;
+/* target_call_timer_callbacks_now() polls every target */
+static bool poll_all_now;
+
+static void target_poll_soon(struct target *target);
+
 static const Jim_Nvp nvp_assert[] = {
 	{ .name = "assert", NVP_ASSERT },
 	{ .name = "deassert", NVP_DEASSERT },
@@ -220,6 +248,8 @@ static const Jim_Nvp nvp_target_event[] = {
 	{ .value = TARGET_EVENT_GDB_FLASH_ERASE_START, .name = "gdb-flash-erase-start" },
 	{ .value = TARGET_EVENT_GDB_FLASH_ERASE_END  , .name = "gdb-flash-erase-end" },
 
+	{ .value = TARGET_EVENT_FLASH_PROGRESS, .name = "flash-progress" },
+
 	{ .value = TARGET_EVENT_TRACE_CONFIG, .name = "trace-config" },
 
 	{ .name = NULL, .value = -1 }
@@ -557,6 +587,7 @@ int target_halt(struct target *target)
 	if (retval != ERROR_OK)
 		return retval;
 
+	target_poll_soon(target);
 	target->halt_issued = true;
 	target->halt_issued_time = timeval_ms();
 
@@ -609,10 +640,13 @@ int target_resume(struct target *target, int current, uint32_t address, int hand
 	 * we poll. The CPU can even halt at the current PC as a result of
 	 * a software breakpoint being inserted by (a bug?) the application.
 	 */
+	target->memory_generation++;
 	retval = target->type->resume(target, current, address, handle_breakpoints, debug_execution);
 	if (retval != ERROR_OK)
 		return retval;
 
+	target_poll_soon(target);
+
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_END);
 
 	return retval;
@@ -787,10 +821,15 @@ int target_run_algorithm(struct target *target,
 	}
 
 	target->running_alg = true;
+	target->memory_generation++;
+	tracelog_begin(TRACELOG_TARGET, "run_algorithm", entry_point, timeout_ms);
+	int64_t start = perf_start();
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_param,
 			entry_point, exit_point, timeout_ms, arch_info);
+	perf_stop(&run_algorithm_perf, start);
+	tracelog_end(TRACELOG_TARGET, "run_algorithm", retval);
 	target->running_alg = false;
 
 done:
@@ -827,6 +866,7 @@ int target_start_algorithm(struct target *target,
 	}
 
 	target->running_alg = true;
+	target->memory_generation++;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_params,
@@ -996,6 +1036,12 @@ int target_run_flash_async_algorithm(struct target *target,
 		retval = target_write_u32(target, wp_addr, wp);
 		if (retval != ERROR_OK)
 			break;
+
+		if (server_interrupt_requested()) {
+			LOG_ERROR("flash write interrupted");
+			retval = ERROR_FAIL;
+			break;
+		}
 	}
 
 	if (retval != ERROR_OK) {
@@ -1037,7 +1083,38 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
-	return target->type->read_memory(target, address, size, count, buffer);
+
+	int64_t start = perf_start();
+	int retval = target->type->read_memory(target, address, size, count, buffer);
+	perf_stop(&read_memory_perf, start);
+	return retval;
+}
+
+int target_read_memory_multi(struct target *target,
+		const struct target_mem_xfer *xfers, unsigned int num)
+{
+	int retval;
+
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (num > 1 && target->type->read_memory_multi) {
+		int64_t start = perf_start();
+		retval = target->type->read_memory_multi(target, xfers, num);
+		perf_stop(&read_memory_perf, start);
+		return retval;
+	}
+
+	for (unsigned int i = 0; i < num; i++) {
+		retval = target_read_memory(target, xfers[i].address, xfers[i].size,
+				xfers[i].count, xfers[i].buffer);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
 }
 
 int target_read_phys_memory(struct target *target,
@@ -1065,7 +1142,12 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
-	return target->type->write_memory(target, address, size, count, buffer);
+	target->memory_generation++;
+
+	int64_t start = perf_start();
+	int retval = target->type->write_memory(target, address, size, count, buffer);
+	perf_stop(&write_memory_perf, start);
+	return retval;
 }
 
 int target_write_phys_memory(struct target *target,
@@ -1079,6 +1161,7 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target->memory_generation++;
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1159,6 +1242,8 @@ int target_get_gdb_reg_list(struct target *target,
 int target_step(struct target *target,
 		int current, uint32_t address, int handle_breakpoints)
 {
+	target->memory_generation++;
+	target_poll_soon(target);
 	return target->type->step(target, current, address, handle_breakpoints);
 }
 
@@ -1384,37 +1469,116 @@ int target_register_trace_callback(int (*callback)(struct target *target,
 	return ERROR_OK;
 }
 
+static void target_timer_heap_set(unsigned int i, struct target_timer_callback *cb)
+{
+	target_timer_heap[i] = cb;
+	cb->heap_index = i;
+}
+
+static void target_timer_heap_up(unsigned int i)
+{
+	struct target_timer_callback *cb = target_timer_heap[i];
+
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+		if (!timercmp(&cb->when, &target_timer_heap[parent]->when, <))
+			break;
+		target_timer_heap_set(i, target_timer_heap[parent]);
+		i = parent;
+	}
+	target_timer_heap_set(i, cb);
+}
+
+static void target_timer_heap_down(unsigned int i)
+{
+	struct target_timer_callback *cb = target_timer_heap[i];
+
+	for (;;) {
+		unsigned int child = 2 * i + 1;
+		if (child >= target_timer_count)
+			break;
+		if (child + 1 < target_timer_count &&
+				timercmp(&target_timer_heap[child + 1]->when, &target_timer_heap[child]->when, <))
+			child++;
+		if (!timercmp(&target_timer_heap[child]->when, &cb->when, <))
+			break;
+		target_timer_heap_set(i, target_timer_heap[child]);
+		i = child;
+	}
+	target_timer_heap_set(i, cb);
+}
+
+static int target_timer_heap_push(struct target_timer_callback *cb)
+{
+	if (target_timer_count == target_timer_heap_size) {
+		unsigned int size = target_timer_heap_size ? 2 * target_timer_heap_size : 8;
+		struct target_timer_callback **heap = realloc(target_timer_heap, size * sizeof(*heap));
+		if (heap == NULL)
+			return ERROR_FAIL;
+		target_timer_heap = heap;
+		target_timer_heap_size = size;
+	}
+
+	target_timer_heap_set(target_timer_count++, cb);
+	target_timer_heap_up(cb->heap_index);
+	return ERROR_OK;
+}
+
+static void target_timer_heap_remove(struct target_timer_callback *cb)
+{
+	unsigned int i = cb->heap_index;
+
+	if (--target_timer_count == i)
+		return;
+
+	/* move the last one into the hole and let it settle */
+	struct target_timer_callback *moved = target_timer_heap[target_timer_count];
+	target_timer_heap_set(i, moved);
+	target_timer_heap_up(i);
+	target_timer_heap_down(moved->heap_index);
+}
+
+/* the callback's next call time moved */
+static void target_timer_heap_update(struct target_timer_callback *cb)
+{
+	if (cb->heap_index < target_timer_count && target_timer_heap[cb->heap_index] == cb) {
+		target_timer_heap_up(cb->heap_index);
+		target_timer_heap_down(cb->heap_index);
+	}
+}
+
 int target_register_timer_callback(int (*callback)(void *priv), int time_ms, int periodic, void *priv)
 {
-	struct target_timer_callback **callbacks_p = &target_timer_callbacks;
+	struct target_timer_callback *cb;
 	struct timeval now;
 
 	if (callback == NULL)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	if (*callbacks_p) {
-		while ((*callbacks_p)->next)
-			callbacks_p = &((*callbacks_p)->next);
-		callbacks_p = &((*callbacks_p)->next);
-	}
-
-	(*callbacks_p) = malloc(sizeof(struct target_timer_callback));
-	(*callbacks_p)->callback = callback;
-	(*callbacks_p)->periodic = periodic;
-	(*callbacks_p)->time_ms = time_ms;
-	(*callbacks_p)->removed = false;
+	cb = malloc(sizeof(struct target_timer_callback));
+	if (cb == NULL)
+		return ERROR_FAIL;
+	cb->callback = callback;
+	cb->periodic = periodic;
+	cb->time_ms = time_ms;
+	cb->removed = false;
 
 	gettimeofday(&now, NULL);
-	(*callbacks_p)->when.tv_usec = now.tv_usec + (time_ms % 1000) * 1000;
+	cb->when.tv_usec = now.tv_usec + (time_ms % 1000) * 1000;
 	time_ms -= (time_ms % 1000);
-	(*callbacks_p)->when.tv_sec = now.tv_sec + (time_ms / 1000);
-	if ((*callbacks_p)->when.tv_usec > 1000000) {
-		(*callbacks_p)->when.tv_usec = (*callbacks_p)->when.tv_usec - 1000000;
-		(*callbacks_p)->when.tv_sec += 1;
+	cb->when.tv_sec = now.tv_sec + (time_ms / 1000);
+	if (cb->when.tv_usec > 1000000) {
+		cb->when.tv_usec = cb->when.tv_usec - 1000000;
+		cb->when.tv_sec += 1;
 	}
 
-	(*callbacks_p)->priv = priv;
-	(*callbacks_p)->next = NULL;
+	cb->priv = priv;
+	cb->next = NULL;
+
+	if (target_timer_heap_push(cb) != ERROR_OK) {
+		free(cb);
+		return ERROR_FAIL;
+	}
 
 	return ERROR_OK;
 }
@@ -1485,14 +1649,23 @@ int target_unregister_timer_callback(int (*callback)(void *priv), void *priv)
 	if (callback == NULL)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	for (struct target_timer_callback *c = target_timer_callbacks;
-	     c; c = c->next) {
-		if ((c->callback == callback) && (c->priv == priv)) {
+	/* one being called is freed by the pass calling it */
+	for (struct target_timer_callback *c = target_timer_firing; c; c = c->next) {
+		if (!c->removed && (c->callback == callback) && (c->priv == priv)) {
 			c->removed = true;
 			return ERROR_OK;
 		}
 	}
 
+	for (unsigned int i = 0; i < target_timer_count; i++) {
+		struct target_timer_callback *c = target_timer_heap[i];
+		if ((c->callback == callback) && (c->priv == priv)) {
+			target_timer_heap_remove(c);
+			free(c);
+			return ERROR_OK;
+		}
+	}
+
 	return ERROR_FAIL;
 }
 
@@ -1506,6 +1679,8 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 		target_call_event_callbacks(target, TARGET_EVENT_GDB_HALT);
 	}
 
+	target->memory_generation++;
+
 	LOG_DEBUG("target event %i (%s)", event,
 			Jim_Nvp_value2name_simple(nvp_target_event, event)->name);
 
@@ -1524,6 +1699,8 @@ int target_call_reset_callbacks(struct target *target, enum target_reset_mode re
 {
 	struct target_reset_callback *callback;
 
+	target->memory_generation++;
+
 	LOG_DEBUG("target reset %i (%s)", reset_mode,
 			Jim_Nvp_value2name_simple(nvp_reset_modes, reset_mode)->name);
 
@@ -1557,17 +1734,6 @@ static int target_timer_callback_periodic_restart(
 	return ERROR_OK;
 }
 
-static int target_call_timer_callback(struct target_timer_callback *cb,
-		struct timeval *now)
-{
-	cb->callback(cb->priv);
-
-	if (cb->periodic)
-		return target_timer_callback_periodic_restart(cb, now);
-
-	return target_unregister_timer_callback(cb->callback, cb->priv);
-}
-
 static int target_call_timer_callbacks_check_time(int checktime)
 {
 	static bool callback_processing;
@@ -1583,28 +1749,46 @@ static int target_call_timer_callbacks_check_time(int checktime)
 	struct timeval now;
 	gettimeofday(&now, NULL);
 
-	/* Store an address of the place containing a pointer to the
-	 * next item; initially, that's a standalone "root of the
-	 * list" variable. */
-	struct target_timer_callback **callback = &target_timer_callbacks;
-	while (*callback) {
-		if ((*callback)->removed) {
-			struct target_timer_callback *p = *callback;
-			*callback = (*callback)->next;
-			free(p);
-			continue;
+	/* make every periodic callback due */
+	if (!checktime) {
+		for (unsigned int i = 0; i < target_timer_count; i++) {
+			if (target_timer_heap[i]->periodic)
+				target_timer_heap[i]->when = now;
 		}
+		for (unsigned int i = target_timer_count / 2; i-- > 0; )
+			target_timer_heap_down(i);
+	}
 
-		bool call_it = (*callback)->callback &&
-			((!checktime && (*callback)->periodic) ||
-			 now.tv_sec > (*callback)->when.tv_sec ||
-			 (now.tv_sec == (*callback)->when.tv_sec &&
-			  now.tv_usec >= (*callback)->when.tv_usec));
+	/* Take all due callbacks off the heap first, in time order, so one
+	 * re-armed by its own call waits for the next pass. */
+	struct target_timer_callback **tail = &target_timer_firing;
+	while (target_timer_count > 0 && !timercmp(&now, &target_timer_heap[0]->when, <)) {
+		struct target_timer_callback *cb = target_timer_heap[0];
+		target_timer_heap_remove(cb);
+		cb->next = NULL;
+		*tail = cb;
+		tail = &cb->next;
+	}
+
+	while (target_timer_firing) {
+		struct target_timer_callback *cb = target_timer_firing;
+
+		if (!cb->removed) {
+			cb->callback(cb->priv);
+			if (!cb->periodic)
+				cb->removed = true;
+		}
 
-		if (call_it)
-			target_call_timer_callback(*callback, &now);
+		target_timer_firing = cb->next;
 
-		callback = &(*callback)->next;
+		if (cb->removed) {
+			free(cb);
+			continue;
+		}
+
+		target_timer_callback_periodic_restart(cb, &now);
+		if (target_timer_heap_push(cb) != ERROR_OK)
+			free(cb);
 	}
 
 	callback_processing = false;
@@ -1619,7 +1803,96 @@ int target_call_timer_callbacks(void)
 /* invoke periodic callbacks immediately */
 int target_call_timer_callbacks_now(void)
 {
-	return target_call_timer_callbacks_check_time(0);
+	int retval;
+
+	poll_all_now = true;
+	retval = target_call_timer_callbacks_check_time(0);
+	poll_all_now = false;
+
+	return retval;
+}
+
+static int64_t target_timer_callback_when_ms(struct target_timer_callback *cb)
+{
+	return (int64_t)cb->when.tv_sec * 1000 + cb->when.tv_usec / 1000;
+}
+
+int target_timer_callbacks_due_ms(int limit)
+{
+	int64_t now = timeval_ms();
+	int64_t due = now + limit;
+
+	if (target_timer_count > 0 && target_timer_callback_when_ms(target_timer_heap[0]) < due)
+		due = target_timer_callback_when_ms(target_timer_heap[0]);
+
+	return due > now ? due - now : 0;
+}
+
+/* Set the period of the background polling callback, and with
+ * sooner, also move its next call to no later than time_ms from now. */
+static void handle_target_schedule(int time_ms, bool sooner)
+{
+	struct target_timer_callback *cb = NULL;
+
+	/* it is off the heap while handle_target runs */
+	for (struct target_timer_callback *c = target_timer_firing; c && !cb; c = c->next) {
+		if (c->callback == handle_target && !c->removed)
+			cb = c;
+	}
+	for (unsigned int i = 0; i < target_timer_count && !cb; i++) {
+		if (target_timer_heap[i]->callback == handle_target)
+			cb = target_timer_heap[i];
+	}
+	if (cb == NULL)
+		return;
+
+	cb->time_ms = time_ms;
+	if (sooner) {
+		int64_t when = timeval_ms() + time_ms;
+		if (when < target_timer_callback_when_ms(cb)) {
+			cb->when.tv_sec = when / 1000;
+			cb->when.tv_usec = (when % 1000) * 1000;
+			target_timer_heap_update(cb);
+		}
+	}
+}
+
+/* the state of target is about to change, poll it fast */
+static void target_poll_soon(struct target *target)
+{
+	target->poll_interval = poll_interval_min;
+	target->poll_due = timeval_ms() + poll_interval_min;
+	handle_target_schedule(poll_interval_min, true);
+}
+
+/* pick the time of the next background poll from the target state */
+static void target_poll_schedule(struct target *target, int64_t now)
+{
+	int interval;
+
+	if (target->backoff.times > 0)
+		interval = polling_interval;
+	else if (target->state == TARGET_RUNNING || target->state == TARGET_DEBUG_RUNNING)
+		interval = MIN(MAX(2 * target->poll_interval, poll_interval_min), poll_interval_max);
+	else if (target->state == TARGET_HALTED)
+		interval = poll_interval_halted;
+	else
+		interval = polling_interval;
+
+	target->poll_interval = interval;
+	target->poll_due = now + interval;
+}
+
+void target_state_report(struct target *target, enum target_state state)
+{
+	if (state != target->state) {
+		target_poll_soon(target);
+		return;
+	}
+
+	/* a failing target still needs its polls to be reexamined */
+	if (target->backoff.times == 0)
+		target_poll_schedule(target, timeval_ms());
 }
 
 /* Prints the working area layout for debug purposes */
@@ -1628,9 +1901,10 @@ static void print_wa_layout(struct target *target)
 	struct working_area *c = target->working_areas;
 
 	while (c) {
-		LOG_DEBUG("%c%c 0x%08"PRIx32"-0x%08"PRIx32" (%"PRIu32" bytes)",
-			c->backup ? 'b' : ' ', c->free ? ' ' : '*',
-			c->address, c->address + c->size - 1, c->size);
+		LOG_DEBUG("%c 0x%08"PRIx32"-0x%08"PRIx32" (%"PRIu32" bytes)%s%s",
+			c->free ? ' ' : '*',
+			c->address, c->address + c->size - 1, c->size,
+			c->name ? " pinned " : "", c->name ? c->name : "");
 		c = c->next;
 	}
 }
@@ -1651,19 +1925,12 @@ static void target_split_working_area(struct working_area *area, uint32_t size)
 		new_wa->next = area->next;
 		new_wa->size = area->size - size;
 		new_wa->address = area->address + size;
-		new_wa->backup = NULL;
+		new_wa->name = NULL;
 		new_wa->user = NULL;
 		new_wa->free = true;
 
 		area->next = new_wa;
 		area->size = size;
-
-		/* If backup memory was allocated to this area, it has the wrong size
-		 * now so free it and it will be reallocated if/when needed */
-		if (area->backup) {
-			free(area->backup);
-			area->backup = NULL;
-		}
 	}
 }
 
@@ -1683,23 +1950,70 @@ static void target_merge_working_areas(struct target *target)
 			/* Remove the last */
 			struct working_area *to_be_freed = c->next;
 			c->next = c->next->next;
-			if (to_be_freed->backup)
-				free(to_be_freed->backup);
 			free(to_be_freed);
-
-			/* If backup memory was allocated to the remaining area, it's has
-			 * the wrong size now */
-			if (c->backup) {
-				free(c->backup);
-				c->backup = NULL;
-			}
 		} else {
 			c = c->next;
 		}
 	}
 }
 
-int target_alloc_working_area_try(struct target *target, uint32_t size, struct working_area **area)
+static bool target_working_area_saved(struct target *target, uint32_t word)
+{
+	return target->working_area_backup_valid[word / 32] & (1u << (word % 32));
+}
+
+/* Save the original content of an area before it is handed out. Words
+ * already saved by an earlier allocation are still valid, the areas were
+ * restored when freed, so only the rest is read back. The copy is dropped
+ * when all working areas are freed, i.e. before the target runs. */
+static int target_backup_working_area(struct target *target, struct working_area *area)
+{
+	if (!target->backup_working_area)
+		return ERROR_OK;
+
+	if (target->working_area_backup == NULL) {
+		uint32_t pool_size = 0;
+		for (struct working_area *c = target->working_areas; c; c = c->next)
+			pool_size += c->size;
+
+		target->working_area_backup = malloc(pool_size);
+		target->working_area_backup_valid = calloc(DIV_ROUND_UP(pool_size / 4, 32), sizeof(uint32_t));
+		if (target->working_area_backup == NULL || target->working_area_backup_valid == NULL) {
+			free(target->working_area_backup);
+			free(target->working_area_backup_valid);
+			target->working_area_backup = NULL;
+			target->working_area_backup_valid = NULL;
+			return ERROR_FAIL;
+		}
+	}
+
+	uint32_t first = (area->address - target->working_area) / 4;
+	uint32_t end = first + area->size / 4;
+
+	for (uint32_t i = first; i < end; ) {
+		if (target_working_area_saved(target, i)) {
+			i++;
+			continue;
+		}
+
+		uint32_t j = i;
+		while (j < end && !target_working_area_saved(target, j))
+			j++;
+
+		int retval = target_read_memory(target, target->working_area + 4 * i, 4, j - i,
+				target->working_area_backup + 4 * i);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (; i < j; i++)
+			target->working_area_backup_valid[i / 32] |= 1u << (i % 32);
+	}
+
+	return ERROR_OK;
+}
+
+static int target_alloc_working_area_from(struct target *target, uint32_t size,
+		struct working_area **area, bool top)
 {
 	/* Reevaluate working area address based on MMU state*/
 	if (target->working_areas == NULL) {
@@ -1740,7 +2054,7 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 			new_wa->next = NULL;
 			new_wa->size = target->working_area_size & ~3UL; /* 4-byte align */
 			new_wa->address = target->working_area;
-			new_wa->backup = NULL;
+			new_wa->name = NULL;
 			new_wa->user = NULL;
 			new_wa->free = true;
 		}
@@ -1752,34 +2066,36 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	if (size % 4)
 		size = (size + 3) & (~3UL);
 
-	struct working_area *c = target->working_areas;
+	struct working_area *c = NULL;
 
-	/* Find the first large enough working area */
-	while (c) {
-		if (c->free && c->size >= size)
-			break;
-		c = c->next;
+	/* Find the smallest large enough working area, so that big free
+	 * blocks are kept for big requests. On a tie take the lowest one,
+	 * or the highest one when allocating from the top. */
+	for (struct working_area *w = target->working_areas; w; w = w->next) {
+		if (!w->free || w->size < size)
+			continue;
+		if (c == NULL || w->size < c->size || (top && w->size == c->size))
+			c = w;
 	}
 
 	if (c == NULL)
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
 	/* Split the working area into the requested size */
-	target_split_working_area(c, size);
+	if (top && c->size > size) {
+		target_split_working_area(c, c->size - size);
+		if (c->next == NULL || c->next->size != size)
+			return ERROR_FAIL;
+		c = c->next;
+	} else {
+		target_split_working_area(c, size);
+	}
 
 	LOG_DEBUG("allocated new working area of %"PRIu32" bytes at address 0x%08"PRIx32, size, c->address);
 
-	if (target->backup_working_area) {
-		if (c->backup == NULL) {
-			c->backup = malloc(c->size);
-			if (c->backup == NULL)
-				return ERROR_FAIL;
-		}
-
-		int retval = target_read_memory(target, c->address, 4, c->size / 4, c->backup);
-		if (retval != ERROR_OK)
-			return retval;
-	}
+	int retval = target_backup_working_area(target, c);
+	if (retval != ERROR_OK)
+		return retval;
 
 	/* mark as used, and return the new (reused) area */
 	c->free = false;
@@ -1793,6 +2109,44 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	return ERROR_OK;
 }
 
+int target_alloc_working_area_try(struct target *target, uint32_t size, struct working_area **area)
+{
+	return target_alloc_working_area_from(target, size, area, false);
+}
+
+int target_alloc_working_area_pinned(struct target *target, const char *name,
+		uint32_t size, struct working_area **area, bool *fresh)
+{
+	struct working_area *c;
+
+	for (c = target->working_areas; c; c = c->next) {
+		if (!c->free && c->name && !strcmp(c->name, name))
+			break;
+	}
+
+	if (c && c->size >= size) {
+		c->user = area;
+		*area = c;
+		*fresh = false;
+		return ERROR_OK;
+	}
+
+	if (c) {
+		int retval = target_free_working_area(target, c);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	int retval = target_alloc_working_area_from(target, size, area, true);
+	if (retval != ERROR_OK)
+		return retval;
+
+	(*area)->name = name;
+	*fresh = true;
+
+	return ERROR_OK;
+}
+
 int target_alloc_working_area(struct target *target, uint32_t size, struct working_area **area)
 {
 	int retval;
@@ -1808,8 +2162,9 @@ static int target_restore_working_area(struct target *target, struct working_are
 {
 	int retval = ERROR_OK;
 
-	if (target->backup_working_area && area->backup != NULL) {
-		retval = target_write_memory(target, area->address, 4, area->size / 4, area->backup);
+	if (target->backup_working_area && target->working_area_backup != NULL) {
+		retval = target_write_memory(target, area->address, 4, area->size / 4,
+				target->working_area_backup + (area->address - target->working_area));
 		if (retval != ERROR_OK)
 			LOG_ERROR("failed to restore %"PRIu32" bytes of working area at address 0x%08"PRIx32,
 					area->size, area->address);
@@ -1834,6 +2189,7 @@ static int target_free_working_area_restore(struct target *target, struct workin
 	}
 
 	area->free = true;
+	area->name = NULL;
 
 	LOG_DEBUG("freed %"PRIu32" bytes of working area at address 0x%08"PRIx32,
 			area->size, area->address);
@@ -1867,13 +2223,12 @@ void target_quit(void)
 	}
 	target_event_callbacks = NULL;
 
-	struct target_timer_callback *pt = target_timer_callbacks;
-	while (pt) {
-		struct target_timer_callback *t = pt->next;
-		free(pt);
-		pt = t;
-	}
-	target_timer_callbacks = NULL;
+	for (unsigned int i = 0; i < target_timer_count; i++)
+		free(target_timer_heap[i]);
+	free(target_timer_heap);
+	target_timer_heap = NULL;
+	target_timer_count = 0;
+	target_timer_heap_size = 0;
 
 	for (struct target *target = all_targets;
 	     target; target = target->next) {
@@ -1897,12 +2252,20 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 			if (restore)
 				target_restore_working_area(target, c);
 			c->free = true;
+			c->name = NULL;
 			*c->user = NULL; /* Same as above */
 			c->user = NULL;
 		}
 		c = c->next;
 	}
 
+	/* the target is about to run, was reset or has its working area
+	 * changed: the saved copy goes stale */
+	free(target->working_area_backup);
+	free(target->working_area_backup_valid);
+	target->working_area_backup = NULL;
+	target->working_area_backup_valid = NULL;
+
 	/* Run a merge pass to combine all areas into one */
 	target_merge_working_areas(target);
 
@@ -1968,7 +2331,7 @@ static int target_gdb_fileio_end_default(struct target *target,
 	return ERROR_OK;
 }
 
-static int target_profiling_default(struct target *target, uint32_t *samples,
+int target_profiling_default(struct target *target, uint32_t *samples,
 		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
 	struct timeval timeout, now;
@@ -2045,14 +2408,112 @@ int target_write_buffer(struct target *target, uint32_t address, uint32_t size,
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
-static int target_write_buffer_default(struct target *target, uint32_t address, uint32_t count, const uint8_t *buffer)
+/* Find the region holding address, or NULL, and cut *len where the
+ * answer would change */
+static struct target_mem_region *target_mem_region_span(struct target *target,
+		uint32_t address, uint32_t *len)
+{
+	struct target_mem_region *found = NULL;
+	uint64_t end = (uint64_t)address + *len;
+
+	for (struct target_mem_region *r = target->mem_regions; r; r = r->next) {
+		uint64_t r_end = (uint64_t)r->address + r->size;
+
+		if (address >= r->address && address < r_end) {
+			if (found == NULL) {
+				found = r;
+				end = MIN(end, r_end);
+			}
+		} else if (r->address > address && r->address < end) {
+			end = r->address;
+		}
+	}
+
+	*len = end - address;
+	return found;
+}
+
+bool target_memory_cacheable(struct target *target, uint32_t address, uint32_t size)
+{
+	for (struct target_mem_region *r = target->mem_regions; r; r = r->next) {
+		if ((uint64_t)address < (uint64_t)r->address + r->size
+				&& (uint64_t)r->address < (uint64_t)address + size
+				&& !r->cacheable)
+			return false;
+	}
+	return true;
+}
+
+int target_write_buffer_verify(struct target *target, uint32_t address,
+		uint32_t size, const uint8_t *buffer, bool read_back)
+{
+	int retval;
+
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (size == 0)
+		return ERROR_OK;
+
+	/* the adapter writes words, only where a region doesn't forbid them */
+	if (target->type->write_buffer_verify) {
+		uint32_t len = size;
+		struct target_mem_region *r = target_mem_region_span(target, address, &len);
+
+		if (len == size && (!r || (r->access & TARGET_MEM_ACCESS_32))) {
+			target->memory_generation++;
+			retval = target->type->write_buffer_verify(target, address, size, buffer);
+			if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+				return retval;
+		}
+	}
+
+	retval = target_write_buffer(target, address, size, buffer);
+	if (retval != ERROR_OK || !read_back)
+		return retval;
+
+	uint8_t *data = malloc(size);
+	if (!data)
+		return ERROR_FAIL;
+
+	retval = target_read_buffer(target, address, size, data);
+	if (retval == ERROR_OK) {
+		for (uint32_t i = 0; i < size; i++) {
+			if (data[i] != buffer[i]) {
+				LOG_ERROR("verify failed at 0x%08" PRIx32 ": wrote 0x%02x, read 0x%02x",
+						address + i, buffer[i], data[i]);
+				retval = ERROR_FAIL;
+				break;
+			}
+		}
+	}
+
+	free(data);
+	return retval;
+}
+
+static unsigned int target_mem_widest(unsigned int widths)
+{
+	if (widths & TARGET_MEM_ACCESS_32)
+		return 4;
+	if (widths & TARGET_MEM_ACCESS_16)
+		return 2;
+	return 1;
+}
+
+static int target_write_buffer_widths(struct target *target, uint32_t address, uint32_t count,
+		const uint8_t *buffer, unsigned int widths)
 {
 	uint32_t size;
 
-	/* Align up to maximum 4 bytes. The loop condition makes sure the next pass
+	/* Align up to the widest allowed access. The loop condition makes sure the next pass
 	 * will have something to do with the size we leave to it. */
-	for (size = 1; size < 4 && count >= size * 2 + (address & size); size *= 2) {
+	for (size = 1; size < target_mem_widest(widths) && count >= size * 2 + (address & size); size *= 2) {
 		if (address & size) {
+			if (!(widths & size))
+				goto unaligned;
 			int retval = target_write_memory(target, address, size, 1, buffer);
 			if (retval != ERROR_OK)
 				return retval;
@@ -2066,6 +2527,8 @@ static int target_write_buffer_default(struct target *target, uint32_t address,
 	for (; size > 0; size /= 2) {
 		uint32_t aligned = count - count % size;
 		if (aligned > 0) {
+			if (!(widths & size))
+				goto unaligned;
 			int retval = target_write_memory(target, address, size, aligned / size, buffer);
 			if (retval != ERROR_OK)
 				return retval;
@@ -2075,6 +2538,29 @@ static int target_write_buffer_default(struct target *target, uint32_t address,
 		}
 	}
 
+	return ERROR_OK;
+
+unaligned:
+	LOG_ERROR("no %" PRIu32 "-bit writes allowed at 0x%08" PRIx32, size * 8, address);
+	return ERROR_TARGET_UNALIGNED_ACCESS;
+}
+
+static int target_write_buffer_default(struct target *target, uint32_t address, uint32_t count, const uint8_t *buffer)
+{
+	while (count > 0) {
+		uint32_t len = count;
+		struct target_mem_region *r = target_mem_region_span(target, address, &len);
+
+		int retval = target_write_buffer_widths(target, address, len, buffer,
+				r ? r->access : TARGET_MEM_ACCESS_ANY);
+		if (retval != ERROR_OK)
+			return retval;
+
+		address += len;
+		count -= len;
+		buffer += len;
+	}
+
 	return ERROR_OK;
 }
 
@@ -2106,14 +2592,17 @@ int target_read_buffer(struct target *target, uint32_t address, uint32_t size, u
 	return target->type->read_buffer(target, address, size, buffer);
 }
 
-static int target_read_buffer_default(struct target *target, uint32_t address, uint32_t count, uint8_t *buffer)
+static int target_read_buffer_widths(struct target *target, uint32_t address, uint32_t count,
+		uint8_t *buffer, unsigned int widths)
 {
 	uint32_t size;
 
-	/* Align up to maximum 4 bytes. The loop condition makes sure the next pass
+	/* Align up to the widest allowed access. The loop condition makes sure the next pass
 	 * will have something to do with the size we leave to it. */
-	for (size = 1; size < 4 && count >= size * 2 + (address & size); size *= 2) {
+	for (size = 1; size < target_mem_widest(widths) && count >= size * 2 + (address & size); size *= 2) {
 		if (address & size) {
+			if (!(widths & size))
+				goto unaligned;
 			int retval = target_read_memory(target, address, size, 1, buffer);
 			if (retval != ERROR_OK)
 				return retval;
@@ -2127,6 +2616,8 @@ static int target_read_buffer_default(struct target *target, uint32_t address, u
 	for (; size > 0; size /= 2) {
 		uint32_t aligned = count - count % size;
 		if (aligned > 0) {
+			if (!(widths & size))
+				goto unaligned;
 			int retval = target_read_memory(target, address, size, aligned / size, buffer);
 			if (retval != ERROR_OK)
 				return retval;
@@ -2136,6 +2627,56 @@ static int target_read_buffer_default(struct target *target, uint32_t address, u
 		}
 	}
 
+	return ERROR_OK;
+
+unaligned:
+	LOG_ERROR("no %" PRIu32 "-bit reads allowed at 0x%08" PRIx32, size * 8, address);
+	return ERROR_TARGET_UNALIGNED_ACCESS;
+}
+
+/* In plain memory an unaligned span is read as the whole words around it,
+ * one 32-bit burst instead of byte and halfword pieces at both ends. */
+static int target_read_buffer_widened(struct target *target, struct target_mem_region *r,
+		uint32_t address, uint32_t count, uint8_t *buffer)
+{
+	uint32_t start = address & ~3u;
+	uint64_t end = ((uint64_t)address + count + 3) & ~(uint64_t)3;
+
+	if (start < r->address || end > (uint64_t)r->address + r->size)
+		return ERROR_TARGET_UNALIGNED_ACCESS;
+
+	uint8_t *words = malloc(end - start);
+	if (words == NULL)
+		return ERROR_FAIL;
+
+	int retval = target_read_memory(target, start, 4, (end - start) / 4, words);
+	if (retval == ERROR_OK)
+		memcpy(buffer, words + (address - start), count);
+
+	free(words);
+	return retval;
+}
+
+static int target_read_buffer_default(struct target *target, uint32_t address, uint32_t count, uint8_t *buffer)
+{
+	while (count > 0) {
+		uint32_t len = count;
+		struct target_mem_region *r = target_mem_region_span(target, address, &len);
+		int retval = ERROR_TARGET_UNALIGNED_ACCESS;
+
+		if (r && !r->side_effects && (r->access & TARGET_MEM_ACCESS_32) && ((address | len) & 3))
+			retval = target_read_buffer_widened(target, r, address, len, buffer);
+		if (retval == ERROR_TARGET_UNALIGNED_ACCESS)
+			retval = target_read_buffer_widths(target, address, len, buffer,
+					r ? r->access : TARGET_MEM_ACCESS_ANY);
+		if (retval != ERROR_OK)
+			return retval;
+
+		address += len;
+		count -= len;
+		buffer += len;
+	}
+
 	return ERROR_OK;
 }
 
@@ -2152,6 +2693,7 @@ int target_checksum_memory(struct target *target, uint32_t address, uint32_t siz
 
 	retval = target->type->checksum_memory(target, address, size, &checksum);
 	if (retval != ERROR_OK) {
+		LOG_DEBUG("no on-target checksum, reading %" PRIu32 " bytes back", size);
 		buffer = malloc(size);
 		if (buffer == NULL) {
 			LOG_ERROR("error allocating buffer for section (%" PRId32 " bytes)", size);
@@ -2179,6 +2721,37 @@ int target_checksum_memory(struct target *target, uint32_t address, uint32_t siz
 	return retval;
 }
 
+int target_checksum_memory_chunks(struct target *target, uint32_t address,
+		uint32_t size, uint32_t chunk_size, uint32_t *checksums)
+{
+	uint32_t full = size / chunk_size;
+	int retval = ERROR_FAIL;
+
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (full > 0 && target->type->checksum_memory_chunks)
+		retval = target->type->checksum_memory_chunks(target, address, chunk_size, full, checksums);
+
+	if (retval != ERROR_OK) {
+		for (uint32_t i = 0; i < full; i++) {
+			retval = target_checksum_memory(target, address + i * chunk_size, chunk_size,
+					&checksums[i]);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+
+	/* a shorter last chunk */
+	if (size % chunk_size)
+		return target_checksum_memory(target, address + full * chunk_size, size % chunk_size,
+				&checksums[full]);
+
+	return ERROR_OK;
+}
+
 int target_blank_check_memory(struct target *target, uint32_t address, uint32_t size, uint32_t* blank)
 {
 	int retval;
@@ -2195,6 +2768,28 @@ int target_blank_check_memory(struct target *target, uint32_t address, uint32_t
 	return retval;
 }
 
+int target_blank_check_memory_blocks(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (target->type->blank_check_memory_blocks &&
+			target->type->blank_check_memory_blocks(target, blocks, num_blocks) == ERROR_OK)
+		return ERROR_OK;
+
+	for (int i = 0; i < num_blocks; i++) {
+		int retval = target_blank_check_memory(target, blocks[i].address, blocks[i].size,
+				&blocks[i].result);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 int target_read_u64(struct target *target, uint64_t address, uint64_t *value)
 {
 	uint8_t value_buf[8];
@@ -2331,6 +2926,31 @@ int target_write_u32(struct target *target, uint32_t address, uint32_t value)
 	return retval;
 }
 
+int target_update_u32(struct target *target, uint32_t address,
+		uint32_t set, uint32_t clear)
+{
+	uint32_t value;
+	int retval;
+
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (target->type->update_u32) {
+		target->memory_generation++;
+		retval = target->type->update_u32(target, address, set, clear);
+		if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+			return retval;
+	}
+
+	retval = target_read_u32(target, address, &value);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return target_write_u32(target, address, (value & ~clear) | set);
+}
+
 int target_write_u16(struct target *target, uint32_t address, uint16_t value)
 {
 	int retval;
@@ -2549,8 +3169,11 @@ static int handle_target(void *priv)
 		recursive = 0;
 	}
 
+	int64_t now = timeval_ms();
+	int64_t next_due = now + polling_interval;
+
 	/* Poll targets for state changes unless that's globally disabled.
-	 * Skip targets that are currently disabled.
+	 * Skip targets that are currently disabled, or not due yet.
 	 */
 	for (struct target *target = all_targets;
 			is_jtag_poll_safe() && target;
@@ -2562,9 +3185,15 @@ static int handle_target(void *priv)
 		if (!target->tap->enabled)
 			continue;
 
+		if (!poll_all_now && now < target->poll_due) {
+			next_due = MIN(next_due, target->poll_due);
+			continue;
+		}
+
 		if (target->backoff.times > target->backoff.count) {
 			/* do not poll this time as we failed previously */
 			target->backoff.count++;
+			target->poll_due = now + polling_interval;
 			continue;
 		}
 		target->backoff.count = 0;
@@ -2595,15 +3224,24 @@ static int handle_target(void *priv)
 					target->examined = true;
 					LOG_USER("Examination failed, GDB will be halted. Polling again in %dms",
 						 target->backoff.times * polling_interval);
-					return retval;
+					target_poll_schedule(target, now);
+					next_due = MIN(next_due, target->poll_due);
+					goto done;
 				}
 			}
 
 			/* Since we succeeded, we reset backoff count */
 			target->backoff.times = 0;
 		}
+
+		target_poll_schedule(target, now);
+		next_due = MIN(next_due, target->poll_due);
 	}
 
+done:
+	/* come back when the first target is due */
+	handle_target_schedule(MAX(next_due - now, 1), false);
+
 	return retval;
 }
 
@@ -2756,6 +3394,105 @@ COMMAND_HANDLER(handle_poll_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_poll_interval_command)
+{
+	if (CMD_ARGC != 0 && CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 3) {
+		int min, max, halted;
+
+		COMMAND_PARSE_NUMBER(int, CMD_ARGV[0], min);
+		COMMAND_PARSE_NUMBER(int, CMD_ARGV[1], max);
+		COMMAND_PARSE_NUMBER(int, CMD_ARGV[2], halted);
+		if (min < 1 || max < min || halted < 1) {
+			command_print(CMD_CTX, "need 1 <= min <= max and halted >= 1");
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		poll_interval_min = min;
+		poll_interval_max = max;
+		poll_interval_halted = halted;
+	}
+
+	command_print(CMD_CTX, "poll interval: %d ms after resume, up to %d ms running, %d ms halted",
+		poll_interval_min, poll_interval_max, poll_interval_halted);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_region_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct target_mem_region *r;
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "clear")) {
+		while (target->mem_regions) {
+			r = target->mem_regions;
+			target->mem_regions = r->next;
+			free(r);
+		}
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC >= 2) {
+		uint32_t address, size;
+		unsigned int access = 0;
+		bool side_effects = false;
+		bool cacheable = true;
+
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+		if (size == 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		for (unsigned int i = 2; i < CMD_ARGC; i++) {
+			if (!strcmp(CMD_ARGV[i], "8"))
+				access |= TARGET_MEM_ACCESS_8;
+			else if (!strcmp(CMD_ARGV[i], "16"))
+				access |= TARGET_MEM_ACCESS_16;
+			else if (!strcmp(CMD_ARGV[i], "32"))
+				access |= TARGET_MEM_ACCESS_32;
+			else if (!strcmp(CMD_ARGV[i], "side_effects"))
+				side_effects = true;
+			else if (!strcmp(CMD_ARGV[i], "uncached"))
+				cacheable = false;
+			else
+				return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		r = malloc(sizeof(*r));
+		if (r == NULL)
+			return ERROR_FAIL;
+		r->address = address;
+		r->size = size;
+		r->access = access ? access : TARGET_MEM_ACCESS_ANY;
+		r->side_effects = side_effects;
+		r->cacheable = cacheable && !side_effects;
+		r->next = NULL;
+
+		/* the first region declared for an address wins */
+		struct target_mem_region **p = &target->mem_regions;
+		while (*p)
+			p = &(*p)->next;
+		*p = r;
+	}
+
+	for (r = target->mem_regions; r; r = r->next) {
+		command_print(CMD_CTX, "0x%08" PRIx32 "-0x%08" PRIx32 "%s%s%s%s%s",
+				r->address, (uint32_t)(r->address + r->size - 1),
+				(r->access & TARGET_MEM_ACCESS_8) ? " 8" : "",
+				(r->access & TARGET_MEM_ACCESS_16) ? " 16" : "",
+				(r->access & TARGET_MEM_ACCESS_32) ? " 32" : "",
+				r->side_effects ? " side_effects" : "",
+				(!r->cacheable && !r->side_effects) ? " uncached" : "");
+	}
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_wait_halt_command)
 {
 	if (CMD_ARGC > 1)
@@ -2811,6 +3548,57 @@ int target_wait_state(struct target *target, enum target_state state, int ms)
 	return ERROR_OK;
 }
 
+/* back to back polls for twice the expected time plus this, then polls
+ * a millisecond apart for TARGET_WAIT_YIELD_MS, then ten apart */
+#define TARGET_WAIT_SPIN_MS		5
+#define TARGET_WAIT_YIELD_MS	100
+
+/**
+ * Wait for an algorithm expected to finish after about @a expected_ms.
+ * A short loader is noticed as soon as it halts, a long one neither
+ * keeps the adapter busy with polls nor the host CPU spinning.
+ */
+int target_wait_state_expected(struct target *target, enum target_state state,
+		int ms, int expected_ms)
+{
+	int retval;
+	int64_t start = timeval_ms();
+	int64_t spin_end = start + 2 * expected_ms + TARGET_WAIT_SPIN_MS;
+	int64_t yield_end = spin_end + TARGET_WAIT_YIELD_MS;
+	int64_t cur;
+
+	for (;;) {
+		retval = target_poll(target);
+		if (retval != ERROR_OK)
+			return retval;
+		if (target->state == state)
+			break;
+
+		cur = timeval_ms();
+		if (cur - start > ms) {
+			LOG_ERROR("timed out while waiting for target %s",
+				Jim_Nvp_value2name_simple(nvp_target_state, state)->name);
+			return ERROR_FAIL;
+		}
+
+		if (cur < spin_end) {
+			if (cur - start > 500)
+				keep_alive();
+		} else if (cur < yield_end) {
+			usleep(1000);
+			keep_alive();
+		} else {
+			alive_sleep(10);
+		}
+	}
+
+	LOG_DEBUG("target %s after %" PRId64 " ms, expected %d ms",
+		Jim_Nvp_value2name_simple(nvp_target_state, state)->name,
+		timeval_ms() - start, expected_ms);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_halt_command)
 {
 	LOG_DEBUG("-");
@@ -3062,6 +3850,10 @@ static int target_fill_mem(struct target *target,
 			break;
 		/* avoid GDB timeouts */
 		keep_alive();
+		if (server_interrupt_requested()) {
+			retval = ERROR_FAIL;
+			break;
+		}
 	}
 	free(target_buf);
 
@@ -3147,13 +3939,19 @@ static COMMAND_HELPER(parse_load_image_command_CMD_ARGV, struct image *image,
 
 COMMAND_HANDLER(handle_load_image_command)
 {
-	uint8_t *buffer;
+	uint8_t *buffer, *data;
 	size_t buf_cnt;
 	uint32_t image_size;
 	uint32_t min_address = 0;
 	uint32_t max_address = 0xffffffff;
 	int i;
 	struct image image;
+	bool verify = false;
+
+	if (CMD_ARGC > 1 && strcmp(CMD_ARGV[CMD_ARGC - 1], "verify") == 0) {
+		verify = true;
+		CMD_ARGC--;
+	}
 
 	int retval = CALL_COMMAND_HANDLER(parse_load_image_command_CMD_ARGV,
 			&image, &min_address, &max_address);
@@ -3171,18 +3969,29 @@ COMMAND_HANDLER(handle_load_image_command)
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
+		if (server_interrupt_requested()) {
+			retval = ERROR_FAIL;
 			break;
 		}
 
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+		/* use the section in place when the image can provide it */
+		buffer = NULL;
+		buf_cnt = image.sections[i].size;
+		if (image_map_section(&image, i, 0x0, image.sections[i].size, &data) != ERROR_OK) {
+			buffer = malloc(image.sections[i].size);
+			if (buffer == NULL) {
+				command_print(CMD_CTX,
+							  "error allocating buffer for section (%d bytes)",
+							  (int)(image.sections[i].size));
+				break;
+			}
+
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			data = buffer;
 		}
 
 		uint32_t offset = 0;
@@ -3202,8 +4011,12 @@ COMMAND_HANDLER(handle_load_image_command)
 			if (image.sections[i].base_address + buf_cnt > max_address)
 				length -= (image.sections[i].base_address + buf_cnt)-max_address;
 
-			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
+			if (verify)
+				retval = target_write_buffer_verify(target,
+						image.sections[i].base_address + offset, length, data + offset, true);
+			else
+				retval = target_write_buffer(target,
+						image.sections[i].base_address + offset, length, data + offset);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3229,12 +4042,17 @@ COMMAND_HANDLER(handle_load_image_command)
 
 }
 
+/* dump_image reads this much per target_read_buffer() call */
+#define DUMP_IMAGE_CHUNK (32 * 1024)
+
 COMMAND_HANDLER(handle_dump_image_command)
 {
-	struct fileio *fileio;
+	struct fileio *fileio = NULL;
+	FILE *pipe = NULL;
 	uint8_t *buffer;
 	int retval, retvaltemp;
 	uint32_t address, size;
+	size_t dumped = 0;
 	struct duration bench;
 	struct target *target = get_current_target(CMD_CTX);
 
@@ -3244,36 +4062,79 @@ COMMAND_HANDLER(handle_dump_image_command)
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], address);
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], size);
 
-	uint32_t buf_size = (size > 4096) ? 4096 : size;
+	uint32_t buf_size = (size > DUMP_IMAGE_CHUNK) ? DUMP_IMAGE_CHUNK : size;
 	buffer = malloc(buf_size);
 	if (!buffer)
 		return ERROR_FAIL;
 
-	retval = fileio_open(&fileio, CMD_ARGV[0], FILEIO_WRITE, FILEIO_BINARY);
-	if (retval != ERROR_OK) {
-		free(buffer);
-		return retval;
+	/* "|command" streams the data into a shell command, e.g. "|nc host 4000",
+	 * so a dump can leave the station without a temporary file */
+	if (CMD_ARGV[0][0] == '|') {
+		pipe = popen(CMD_ARGV[0] + 1, "w");
+		if (pipe == NULL) {
+			LOG_ERROR("couldn't run '%s': %s", CMD_ARGV[0] + 1, strerror(errno));
+			free(buffer);
+			return ERROR_FAIL;
+		}
+		retval = ERROR_OK;
+	} else {
+		retval = fileio_open(&fileio, CMD_ARGV[0], FILEIO_WRITE, FILEIO_BINARY);
+		if (retval != ERROR_OK) {
+			free(buffer);
+			return retval;
+		}
 	}
 
 	duration_start(&bench);
 
+	/* The file or pipe buffer of the host holds the last chunk while the
+	 * next one is read, so output and adapter transfers overlap. */
 	while (size > 0) {
 		size_t size_written;
 		uint32_t this_run_size = (size > buf_size) ? buf_size : size;
-		retval = target_read_buffer(target, address, this_run_size, buffer);
-		if (retval != ERROR_OK)
+
+		if (server_interrupt_requested()) {
+			retval = ERROR_FAIL;
 			break;
+		}
 
-		retval = fileio_write(fileio, this_run_size, buffer, &size_written);
+		retval = target_read_buffer(target, address, this_run_size, buffer);
 		if (retval != ERROR_OK)
 			break;
 
+		if (pipe) {
+			size_written = fwrite(buffer, 1, this_run_size, pipe);
+			if (size_written != this_run_size) {
+				LOG_ERROR("couldn't write to '%s'", CMD_ARGV[0] + 1);
+				retval = ERROR_FAIL;
+				break;
+			}
+		} else {
+			retval = fileio_write(fileio, this_run_size, buffer, &size_written);
+			if (retval != ERROR_OK)
+				break;
+		}
+
+		dumped += this_run_size;
 		size -= this_run_size;
 		address += this_run_size;
+		keep_alive();
+	}
+
+	free(buffer);
+
+	if (pipe) {
+		if (pclose(pipe) != 0 && retval == ERROR_OK) {
+			LOG_ERROR("'%s' failed", CMD_ARGV[0] + 1);
+			retval = ERROR_FAIL;
+		}
+		if ((ERROR_OK == retval) && (duration_measure(&bench) == ERROR_OK))
+			command_print(CMD_CTX,
+					"dumped %zu bytes in %fs (%0.3f KiB/s)", dumped,
+					duration_elapsed(&bench), duration_kbps(&bench, dumped));
+		return retval;
 	}
 
-	free(buffer);
-
 	if ((ERROR_OK == retval) && (duration_measure(&bench) == ERROR_OK)) {
 		size_t filesize;
 		retval = fileio_size(fileio, &filesize);
@@ -3293,7 +4154,7 @@ COMMAND_HANDLER(handle_dump_image_command)
 
 static COMMAND_HELPER(handle_verify_image_command_internal, int verify)
 {
-	uint8_t *buffer;
+	uint8_t *buffer, *copy;
 	size_t buf_cnt;
 	uint32_t image_size;
 	int i;
@@ -3336,30 +4197,36 @@ static COMMAND_HELPER(handle_verify_image_command_internal, int verify)
 	int diffs = 0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX,
-					"error allocating buffer for section (%d bytes)",
-					(int)(image.sections[i].size));
-			break;
-		}
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+		/* use the section in place when the image can provide it */
+		copy = NULL;
+		buf_cnt = image.sections[i].size;
+		if (image_map_section(&image, i, 0x0, image.sections[i].size, &buffer) != ERROR_OK) {
+			copy = malloc(image.sections[i].size);
+			if (copy == NULL) {
+				command_print(CMD_CTX,
+						"error allocating buffer for section (%d bytes)",
+						(int)(image.sections[i].size));
+				break;
+			}
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, copy, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(copy);
+				break;
+			}
+			buffer = copy;
 		}
 
 		if (verify) {
 			/* calculate checksum of image */
-			retval = image_calculate_checksum(buffer, buf_cnt, &checksum);
+			retval = image_calculate_section_checksum(&image, i, buffer, buf_cnt, &checksum);
 			if (retval != ERROR_OK) {
-				free(buffer);
+				free(copy);
 				break;
 			}
 
 			retval = target_checksum_memory(target, image.sections[i].base_address, buf_cnt, &mem_checksum);
 			if (retval != ERROR_OK) {
-				free(buffer);
+				free(copy);
 				break;
 			}
 
@@ -3393,7 +4260,7 @@ static COMMAND_HELPER(handle_verify_image_command_internal, int verify)
 							if (diffs++ >= 127) {
 								command_print(CMD_CTX, "More than 128 errors, the rest are not printed.");
 								free(data);
-								free(buffer);
+								free(copy);
 								goto done;
 							}
 						}
@@ -3408,7 +4275,7 @@ static COMMAND_HELPER(handle_verify_image_command_internal, int verify)
 						  buf_cnt);
 		}
 
-		free(buffer);
+		free(copy);
 		image_size += buf_cnt;
 	}
 	if (diffs > 0)
@@ -4068,6 +4935,276 @@ static int target_mem2array(Jim_Interp *interp, struct target *target, int argc,
 	return e;
 }
 
+/* Parse the optional "[width] [phys]" of read_memory_bin/write_memory_bin,
+ * width 0 meaning the widest access alignment allows */
+static int target_memory_bin_options(Jim_Interp *interp, int argc, Jim_Obj *const *argv,
+		uint32_t *width, bool *is_phys)
+{
+	*width = 0;
+	*is_phys = false;
+
+	for (int i = 0; i < argc; i++) {
+		const char *opt = Jim_GetString(argv[i], NULL);
+		long l;
+
+		if (!strcmp(opt, "phys")) {
+			*is_phys = true;
+		} else if (Jim_GetLong(interp, argv[i], &l) == JIM_OK && (l == 8 || l == 16 || l == 32)) {
+			*width = l / 8;
+		} else {
+			Jim_SetResultFormatted(interp, "expected 8/16/32 or phys, got \"%s\"", opt);
+			return JIM_ERR;
+		}
+	}
+
+	return JIM_OK;
+}
+
+static int jim_read_memory_bin(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	struct command_context *context = current_command_context(interp);
+	assert(context != NULL);
+
+	return target_read_memory_bin(interp, get_current_target(context), argc - 1, argv + 1);
+}
+
+/* Return target memory as one binary string, raw bytes in target order */
+static int target_read_memory_bin(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	jim_wide addr, count;
+	uint32_t width;
+	bool is_phys;
+	int retval = ERROR_OK;
+
+	if (argc < 2 || argc > 4) {
+		Jim_WrongNumArgs(interp, 0, argv, "address count [8|16|32] [phys]");
+		return JIM_ERR;
+	}
+
+	if (Jim_GetWide(interp, argv[0], &addr) != JIM_OK
+			|| Jim_GetWide(interp, argv[1], &count) != JIM_OK
+			|| target_memory_bin_options(interp, argc - 2, argv + 2, &width, &is_phys) != JIM_OK)
+		return JIM_ERR;
+
+	if (addr < 0 || addr > UINT32_MAX || count < 0 || addr + count - 1 > UINT32_MAX) {
+		Jim_SetResultFormatted(interp, "address range out of bounds");
+		return JIM_ERR;
+	}
+	if (width && (addr % width || count % width)) {
+		Jim_SetResultFormatted(interp, "address and count must be multiples of %d", (int)width);
+		return JIM_ERR;
+	}
+
+	/* physical accesses have no buffer helper, use what alignment allows */
+	if (is_phys && !width)
+		width = ((addr | count) & 1) ? 1 : ((addr | count) & 2) ? 2 : 4;
+
+	uint8_t *buffer = malloc(count ? count : 1);
+	if (buffer == NULL)
+		return JIM_ERR;
+
+	for (jim_wide done = 0; done < count; ) {
+		uint32_t n = MIN(count - done, 32 * 1024);
+
+		if (is_phys)
+			retval = target_read_phys_memory(target, addr + done, width, n / width, buffer + done);
+		else if (width)
+			retval = target_read_memory(target, addr + done, width, n / width, buffer + done);
+		else
+			retval = target_read_buffer(target, addr + done, n, buffer + done);
+		if (retval != ERROR_OK)
+			break;
+
+		done += n;
+		keep_alive();
+	}
+
+	if (retval != ERROR_OK) {
+		free(buffer);
+		Jim_SetResultFormatted(interp, "read_memory_bin: failed to read memory at 0x%08" PRIx32,
+				(uint32_t)addr);
+		return JIM_ERR;
+	}
+
+	Jim_SetResult(interp, Jim_NewStringObj(interp, (const char *)buffer, count));
+	free(buffer);
+
+	return JIM_OK;
+}
+
+static int jim_write_memory_bin(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	struct command_context *context = current_command_context(interp);
+	assert(context != NULL);
+
+	return target_write_memory_bin(interp, get_current_target(context), argc - 1, argv + 1);
+}
+
+/* Write a binary string, raw bytes in target order, to target memory */
+static int target_write_memory_bin(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	jim_wide addr;
+	uint32_t width;
+	bool is_phys;
+	int count;
+	int retval = ERROR_OK;
+
+	if (argc < 2 || argc > 4) {
+		Jim_WrongNumArgs(interp, 0, argv, "address data [8|16|32] [phys]");
+		return JIM_ERR;
+	}
+
+	if (Jim_GetWide(interp, argv[0], &addr) != JIM_OK
+			|| target_memory_bin_options(interp, argc - 2, argv + 2, &width, &is_phys) != JIM_OK)
+		return JIM_ERR;
+
+	const uint8_t *data = (const uint8_t *)Jim_GetString(argv[1], &count);
+
+	if (addr < 0 || addr > UINT32_MAX || addr + count - 1 > UINT32_MAX) {
+		Jim_SetResultFormatted(interp, "address range out of bounds");
+		return JIM_ERR;
+	}
+	if (width && (addr % width || count % width)) {
+		Jim_SetResultFormatted(interp, "address and length must be multiples of %d", (int)width);
+		return JIM_ERR;
+	}
+
+	if (is_phys && !width)
+		width = ((addr | count) & 1) ? 1 : ((addr | count) & 2) ? 2 : 4;
+
+	for (int done = 0; done < count; ) {
+		uint32_t n = MIN(count - done, 32 * 1024);
+
+		if (is_phys)
+			retval = target_write_phys_memory(target, addr + done, width, n / width, data + done);
+		else if (width)
+			retval = target_write_memory(target, addr + done, width, n / width, data + done);
+		else
+			retval = target_write_buffer(target, addr + done, n, data + done);
+		if (retval != ERROR_OK) {
+			Jim_SetResultFormatted(interp, "write_memory_bin: failed to write memory at 0x%08" PRIx32,
+					(uint32_t)(addr + done));
+			return JIM_ERR;
+		}
+
+		done += n;
+		keep_alive();
+	}
+
+	Jim_SetResult(interp, Jim_NewEmptyStringObj(interp));
+	return JIM_OK;
+}
+
+static int jim_mem_batch(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	struct command_context *context = current_command_context(interp);
+	assert(context != NULL);
+
+	return target_mem_batch(interp, get_current_target(context), argc - 1, argv + 1);
+}
+
+/* longest run of adjacent words merged into one memory access */
+#define MEM_BATCH_RUN_WORDS		256
+
+/* Run a list of {w address value} and {r address} word accesses.  All of
+ * it is parsed before the first access, adjacent words go out as a single
+ * read or write, and the words read come back as one list. */
+static int target_mem_batch(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	if (argc != 1) {
+		Jim_WrongNumArgs(interp, 0, argv, "{{w address value} {r address} ...}");
+		return JIM_ERR;
+	}
+
+	int n = Jim_ListLength(interp, argv[0]);
+	char *ops = malloc(n ? n : 1);
+	uint32_t *addrs = malloc(sizeof(uint32_t) * (n ? n : 1));
+	uint32_t *values = malloc(sizeof(uint32_t) * (n ? n : 1));
+	uint8_t *buffer = malloc(4 * MEM_BATCH_RUN_WORDS);
+	int retval = JIM_ERR;
+
+	if (ops == NULL || addrs == NULL || values == NULL || buffer == NULL)
+		goto out;
+
+	for (int i = 0; i < n; i++) {
+		Jim_Obj *item, *obj;
+		jim_wide addr, value = 0;
+		int len;
+
+		Jim_ListIndex(interp, argv[0], i, &item, JIM_NONE);
+		int items = Jim_ListLength(interp, item);
+		Jim_ListIndex(interp, item, 0, &obj, JIM_NONE);
+		const char *op = obj ? Jim_GetString(obj, &len) : "";
+
+		if (!(strcmp(op, "w") == 0 && items == 3) && !(strcmp(op, "r") == 0 && items == 2)) {
+			Jim_SetResultFormatted(interp, "mem_batch: expected {w address value} "
+					"or {r address}, got \"%#s\"", item);
+			goto out;
+		}
+
+		Jim_ListIndex(interp, item, 1, &obj, JIM_NONE);
+		if (Jim_GetWide(interp, obj, &addr) != JIM_OK)
+			goto out;
+		if (items == 3) {
+			Jim_ListIndex(interp, item, 2, &obj, JIM_NONE);
+			if (Jim_GetWide(interp, obj, &value) != JIM_OK)
+				goto out;
+		}
+		if (addr < 0 || addr > UINT32_MAX - 3 || addr % 4) {
+			Jim_SetResultFormatted(interp, "mem_batch: bad word address in \"%#s\"", item);
+			goto out;
+		}
+
+		ops[i] = op[0];
+		addrs[i] = addr;
+		values[i] = value;
+	}
+
+	Jim_Obj *result = Jim_NewListObj(interp, NULL, 0);
+
+	for (int i = 0; i < n; ) {
+		int count = 1;
+		while (i + count < n && count < MEM_BATCH_RUN_WORDS && ops[i + count] == ops[i]
+				&& addrs[i + count] == addrs[i] + 4 * count)
+			count++;
+
+		int e;
+		if (ops[i] == 'w') {
+			for (int j = 0; j < count; j++)
+				target_buffer_set_u32(target, buffer + 4 * j, values[i + j]);
+			e = target_write_memory(target, addrs[i], 4, count, buffer);
+		} else {
+			e = target_read_memory(target, addrs[i], 4, count, buffer);
+			for (int j = 0; e == ERROR_OK && j < count; j++)
+				Jim_ListAppendElement(interp, result,
+						Jim_NewIntObj(interp, target_buffer_get_u32(target, buffer + 4 * j)));
+		}
+		if (e != ERROR_OK) {
+			Jim_FreeNewObj(interp, result);
+			Jim_SetResultFormatted(interp, "mem_batch: failed to %s memory at 0x%08" PRIx32,
+					ops[i] == 'w' ? "write" : "read", addrs[i]);
+			goto out;
+		}
+
+		i += count;
+		keep_alive();
+	}
+
+	Jim_SetResult(interp, result);
+	retval = JIM_OK;
+
+out:
+	free(ops);
+	free(addrs);
+	free(values);
+	free(buffer);
+
+	return retval;
+}
+
 static int get_int_array_element(Jim_Interp *interp, const char *varname, int idx, uint32_t *val)
 {
 	char *namebuf;
@@ -4281,6 +5418,10 @@ void target_handle_event(struct target *target, enum target_event e)
 {
 	struct target_event_action *teap;
 
+	/* halted and resumed fire all the time, most without a handler */
+	if (!target_has_event_action(target, e))
+		return;
+
 	for (teap = target->event_action; teap != NULL; teap = teap->next) {
 		if (teap->event == e) {
 			LOG_DEBUG("target: (%d) %s (%s) event: %d (%s) action: %s",
@@ -4290,10 +5431,14 @@ void target_handle_event(struct target *target, enum target_event e)
 					   e,
 					   Jim_Nvp_value2name_simple(nvp_target_event, e)->name,
 					   Jim_GetString(teap->body, NULL));
+			/* the body is private to teap, so the script Jim compiles
+			 * on the first run stays attached to it and is reused */
 			if (Jim_EvalObj(teap->interp, teap->body) != JIM_OK) {
 				Jim_MakeErrorMessage(teap->interp);
 				command_print(NULL, "%s\n", Jim_GetString(Jim_GetResult(teap->interp), NULL));
 			}
+			/* one action per event; the handler may have changed the list */
+			break;
 		}
 	}
 }
@@ -4303,13 +5448,7 @@ void target_handle_event(struct target *target, enum target_event e)
  */
 bool target_has_event_action(struct target *target, enum target_event event)
 {
-	struct target_event_action *teap;
-
-	for (teap = target->event_action; teap != NULL; teap = teap->next) {
-		if (teap->event == event)
-			return true;
-	}
-	return false;
+	return (target->event_action_mask >> event) & 1;
 }
 
 enum target_cfg_param {
@@ -4324,6 +5463,7 @@ enum target_cfg_param {
 	TCFG_CHAIN_POSITION,
 	TCFG_DBGBASE,
 	TCFG_RTOS,
+	TCFG_RTOS_CACHE,
 };
 
 static Jim_Nvp nvp_config_opts[] = {
@@ -4338,6 +5478,7 @@ static Jim_Nvp nvp_config_opts[] = {
 	{ .name = "-chain-position",   .value = TCFG_CHAIN_POSITION },
 	{ .name = "-dbgbase",          .value = TCFG_DBGBASE },
 	{ .name = "-rtos",             .value = TCFG_RTOS },
+	{ .name = "-rtos-cache",       .value = TCFG_RTOS_CACHE },
 	{ .name = NULL, .value = -1 }
 };
 
@@ -4452,6 +5593,14 @@ no_params:
 					 */
 					Jim_IncrRefCount(teap->body);
 
+					/* an empty body removes the handler */
+					int body_len;
+					Jim_GetString(teap->body, &body_len);
+					if (body_len)
+						target->event_action_mask |= 1ULL << teap->event;
+					else
+						target->event_action_mask &= ~(1ULL << teap->event);
+
 					if (!replace) {
 						/* add to head of event list */
 						teap->next = target->event_action;
@@ -4612,6 +5761,23 @@ no_params:
 			}
 			/* loop for more */
 			break;
+
+		case TCFG_RTOS_CACHE:
+			if (goi->isconfigure) {
+				const char *s;
+				e = Jim_GetOpt_String(goi, &s, NULL);
+				if (e != JIM_OK)
+					return e;
+				free(target->rtos_cache_file);
+				target->rtos_cache_file = *s ? strdup(s) : NULL;
+			} else {
+				if (goi->argc != 0)
+					goto no_params;
+			}
+			Jim_SetResultString(goi->interp,
+					target->rtos_cache_file ? target->rtos_cache_file : "", -1);
+			/* loop for more */
+			break;
 		}
 	} /* while (goi->argc) */
 
@@ -4874,6 +6040,27 @@ static int jim_target_array2mem(Jim_Interp *interp,
 	return target_array2mem(interp, target, argc - 1, argv + 1);
 }
 
+static int jim_target_read_memory_bin(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_read_memory_bin(interp, target, argc - 1, argv + 1);
+}
+
+static int jim_target_write_memory_bin(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_write_memory_bin(interp, target, argc - 1, argv + 1);
+}
+
+static int jim_target_mem_batch(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_mem_batch(interp, target, argc - 1, argv + 1);
+}
+
 static int jim_target_tap_disabled(Jim_Interp *interp)
 {
 	Jim_SetResultFormatted(interp, "[TAP is disabled]");
@@ -5156,6 +6343,27 @@ static const struct command_registration target_instance_command_handlers[] = {
 			"from target memory",
 		.usage = "arrayname bitwidth address count",
 	},
+	{
+		.name = "read_memory_bin",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_read_memory_bin,
+		.help = "Returns target memory as a binary string",
+		.usage = "address count ['8'|'16'|'32'] ['phys']",
+	},
+	{
+		.name = "write_memory_bin",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_write_memory_bin,
+		.help = "Writes a binary string to target memory",
+		.usage = "address data ['8'|'16'|'32'] ['phys']",
+	},
+	{
+		.name = "mem_batch",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_mem_batch,
+		.help = "Runs a list of word writes and reads, returns the words read",
+		.usage = "{{w address value} {r address} ...}",
+	},
 	{
 		.name = "eventlist",
 		.mode = COMMAND_EXEC,
@@ -5335,11 +6543,13 @@ static int target_create(Jim_GetOptInfo *goi)
 
 	target->dbgmsg          = NULL;
 	target->dbg_msg_enabled = 0;
+	target->dbg_msg_ring    = NULL;
 
 	target->endianness = TARGET_ENDIAN_UNKNOWN;
 
 	target->rtos = NULL;
 	target->rtos_auto_detect = false;
+	target->rtos_cache_file = NULL;
 
 	/* Do the rest as "configure" options */
 	goi->isconfigure = 1;
@@ -5565,11 +6775,14 @@ static const struct command_registration target_subcommand_handlers[] = {
 	COMMAND_REGISTRATION_DONE
 };
 
+/* fast_load delta compares the image with target memory in chunks of this size */
+#define FASTLOAD_CHUNK 4096
+
 struct FastLoad {
 	uint32_t address;
 	uint8_t *data;
 	int length;
-
+	uint32_t *crc;	/* host side checksum of each chunk */
 };
 
 static int fastload_num;
@@ -5582,6 +6795,7 @@ static void free_fastload(void)
 		for (i = 0; i < fastload_num; i++) {
 			if (fastload[i].data)
 				free(fastload[i].data);
+			free(fastload[i].crc);
 		}
 		free(fastload);
 		fastload = NULL;
@@ -5613,6 +6827,7 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 
 	image_size = 0x0;
 	retval = ERROR_OK;
+	free_fastload();
 	fastload_num = image.num_sections;
 	fastload = malloc(sizeof(struct FastLoad)*image.num_sections);
 	if (fastload == NULL) {
@@ -5664,6 +6879,17 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 			memcpy(fastload[i].data, buffer + offset, length);
 			fastload[i].length = length;
 
+			uint32_t chunks = DIV_ROUND_UP(length, FASTLOAD_CHUNK);
+			fastload[i].crc = malloc(chunks * sizeof(uint32_t));
+			if (fastload[i].crc == NULL) {
+				free(buffer);
+				retval = ERROR_FAIL;
+				break;
+			}
+			for (uint32_t c = 0; c < chunks; c++)
+				image_calculate_checksum(fastload[i].data + c * FASTLOAD_CHUNK,
+						MIN(FASTLOAD_CHUNK, length - c * FASTLOAD_CHUNK), &fastload[i].crc[c]);
+
 			image_size += length;
 			command_print(CMD_CTX, "%u bytes written at address 0x%8.8x",
 						  (unsigned int)length,
@@ -5691,10 +6917,68 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 	return retval;
 }
 
+/* Write only the chunks of a fast_load section whose target checksum
+ * differs from the image; *written counts the bytes sent. */
+static int fast_load_section_delta(struct target *target, struct FastLoad *f, int *written)
+{
+	uint32_t chunks = DIV_ROUND_UP(f->length, FASTLOAD_CHUNK);
+	uint32_t *crc;
+	int retval;
+
+	/* the checksum loader would run in, and be overwritten by, the image */
+	if (target->working_area_size && f->address < target->working_area + target->working_area_size
+			&& target->working_area < f->address + f->length) {
+		*written = f->length;
+		return target_write_buffer(target, f->address, f->length, f->data);
+	}
+
+	crc = malloc(chunks * sizeof(uint32_t));
+	if (crc == NULL)
+		return ERROR_FAIL;
+
+	retval = target_checksum_memory_chunks(target, f->address, f->length, FASTLOAD_CHUNK, crc);
+	if (retval != ERROR_OK) {
+		free(crc);
+		*written = f->length;
+		return target_write_buffer(target, f->address, f->length, f->data);
+	}
+
+	*written = 0;
+	for (uint32_t c = 0; c < chunks; ) {
+		if (crc[c] == f->crc[c]) {
+			c++;
+			continue;
+		}
+
+		/* one write for a run of changed chunks */
+		uint32_t end = c + 1;
+		while (end < chunks && crc[end] != f->crc[end])
+			end++;
+
+		uint32_t offset = c * FASTLOAD_CHUNK;
+		uint32_t length = MIN(end * FASTLOAD_CHUNK, (uint32_t)f->length) - offset;
+		retval = target_write_buffer(target, f->address + offset, length, f->data + offset);
+		if (retval != ERROR_OK)
+			break;
+		*written += length;
+		c = end;
+	}
+
+	free(crc);
+	return retval;
+}
+
 COMMAND_HANDLER(handle_fast_load_command)
 {
-	if (CMD_ARGC > 0)
+	bool delta = false;
+
+	if (CMD_ARGC > 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "delta"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		delta = true;
+	}
 	if (fastload == NULL) {
 		LOG_ERROR("No image in memory");
 		return ERROR_FAIL;
@@ -5702,20 +6986,38 @@ COMMAND_HANDLER(handle_fast_load_command)
 	int i;
 	int64_t ms = timeval_ms();
 	int size = 0;
+	int sent = 0;
 	int retval = ERROR_OK;
 	for (i = 0; i < fastload_num; i++) {
 		struct target *target = get_current_target(CMD_CTX);
-		command_print(CMD_CTX, "Write to 0x%08x, length 0x%08x",
-					  (unsigned int)(fastload[i].address),
-					  (unsigned int)(fastload[i].length));
-		retval = target_write_buffer(target, fastload[i].address, fastload[i].length, fastload[i].data);
+		int written = fastload[i].length;
+
+		if (fastload[i].data == NULL)
+			continue;
+
+		if (delta) {
+			retval = fast_load_section_delta(target, &fastload[i], &written);
+			command_print(CMD_CTX, "Write to 0x%08x, length 0x%08x, 0x%08x changed",
+						  (unsigned int)(fastload[i].address),
+						  (unsigned int)(fastload[i].length), (unsigned int)written);
+		} else {
+			command_print(CMD_CTX, "Write to 0x%08x, length 0x%08x",
+						  (unsigned int)(fastload[i].address),
+						  (unsigned int)(fastload[i].length));
+			retval = target_write_buffer(target, fastload[i].address, fastload[i].length, fastload[i].data);
+		}
 		if (retval != ERROR_OK)
 			break;
 		size += fastload[i].length;
+		sent += written;
 	}
 	if (retval == ERROR_OK) {
 		int64_t after = timeval_ms();
-		command_print(CMD_CTX, "Loaded image %f kBytes/s", (float)(size/1024.0)/((float)(after-ms)/1000.0));
+		if (delta)
+			command_print(CMD_CTX, "Loaded image in %" PRId64 " ms, %d of %d bytes written",
+					after - ms, sent, size);
+		else
+			command_print(CMD_CTX, "Loaded image %f kBytes/s", (float)(size/1024.0)/((float)(after-ms)/1000.0));
 	}
 	return retval;
 }
@@ -5729,6 +7031,23 @@ static const struct command_registration target_command_handlers[] = {
 			"or prints table of all targets (no parameters)",
 		.usage = "[target]",
 	},
+	{
+		.name = "poll_interval",
+		.handler = handle_poll_interval_command,
+		.mode = COMMAND_ANY,
+		.help = "set or display the background polling intervals: "
+			"right after resume, the most while running and while halted",
+		.usage = "[min_ms max_ms halted_ms]",
+	},
+	{
+		.name = "mem_region",
+		.handler = handle_mem_region_command,
+		.mode = COMMAND_ANY,
+		.help = "declare a memory region of the current target: the access "
+			"widths it allows, whether reads have side effects and whether "
+			"it may be cached; without arguments list the regions",
+		.usage = "['clear' | address size ['8'] ['16'] ['32'] ['side_effects'] ['uncached']]",
+	},
 	{
 		.name = "target",
 		.mode = COMMAND_CONFIG,
@@ -5986,8 +7305,9 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.handler = handle_fast_load_command,
 		.mode = COMMAND_EXEC,
 		.help = "loads active fast load image to current target "
-			"- mainly for profiling purposes",
-		.usage = "",
+			"- mainly for profiling purposes; with 'delta' only "
+			"the chunks whose checksum differs are written",
+		.usage = "['delta']",
 	},
 	{
 		.name = "profile",
@@ -6139,13 +7459,13 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.handler = handle_load_image_command,
 		.mode = COMMAND_EXEC,
 		.usage = "filename address ['bin'|'ihex'|'elf'|'s19'] "
-			"[min_address] [max_length]",
+			"[min_address] [max_length] ['verify']",
 	},
 	{
 		.name = "dump_image",
 		.handler = handle_dump_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "filename address size",
+		.usage = "(filename|'|'command) address size",
 	},
 	{
 		.name = "verify_image",
@@ -6175,6 +7495,30 @@ static const struct command_registration target_exec_command_handlers[] = {
 			"and write the 8/16/32 bit values",
 		.usage = "arrayname bitwidth address count",
 	},
+	{
+		.name = "read_memory_bin",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_read_memory_bin,
+		.help = "read target memory and return it as one binary string, "
+			"bytes in target order",
+		.usage = "address count ['8'|'16'|'32'] ['phys']",
+	},
+	{
+		.name = "write_memory_bin",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_write_memory_bin,
+		.help = "write one binary string to target memory, "
+			"bytes in target order",
+		.usage = "address data ['8'|'16'|'32'] ['phys']",
+	},
+	{
+		.name = "mem_batch",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_mem_batch,
+		.help = "run a list of 32-bit writes and reads in as few adapter "
+			"transactions as possible, return the words read as a list",
+		.usage = "{{w address value} {r address} ...}",
+	},
 	{
 		.name = "reset_nag",
 		.handler = handle_target_reset_nag,
@@ -96,11 +96,28 @@ struct working_area {
 	uint32_t address;
 	uint32_t size;
 	bool free;
-	uint8_t *backup;
+	const char *name;	/* set for pinned areas */
 	struct working_area **user;
 	struct working_area *next;
 };
 
+/* Access widths, as byte sizes, allowed in a target_mem_region */
+#define TARGET_MEM_ACCESS_8		1
+#define TARGET_MEM_ACCESS_16	2
+#define TARGET_MEM_ACCESS_32	4
+#define TARGET_MEM_ACCESS_ANY	7
+
+/* A memory region declared with "mem_region". Memory outside all regions
+ * is accessed as before: any width, split on alignment only. */
+struct target_mem_region {
+	uint32_t address;
+	uint32_t size;
+	unsigned int access;	/* TARGET_MEM_ACCESS_* widths allowed */
+	bool side_effects;		/* reads have side effects (FIFOs, status registers) */
+	bool cacheable;			/* content only changes when written by us */
+	struct target_mem_region *next;
+};
+
 struct gdb_service {
 	struct target *target;
 	/*  field for smp display  */
@@ -147,7 +164,23 @@ struct target {
 	 */
 	bool running_alg;
 
+	/**
+	 * How long the next algorithm is expected to run in milliseconds,
+	 * 0 if unknown. Flash drivers set it before target_run_algorithm(),
+	 * the wait for the algorithm halting uses it and clears it.
+	 */
+	int algorithm_expected_ms;
+
+	/**
+	 * Bumped by every memory write, resume, step, algorithm run, reset
+	 * and target event. Front ends caching target memory (the GDB
+	 * server's gdb_memory_cache) drop their copy when it changes.
+	 */
+	uint32_t memory_generation;
+
 	struct target_event_action *event_action;
+	/* bit (1 << event) set for events with a non-empty handler */
+	uint64_t event_action_mask;
 
 	int reset_halt;						/* attempt resetting the CPU into the halted mode? */
 	uint32_t working_area;				/* working area (initialised RAM). Evaluated
@@ -159,6 +192,9 @@ struct target {
 	uint32_t working_area_size;			/* size in bytes */
 	uint32_t backup_working_area;		/* whether the content of the working area has to be preserved */
 	struct working_area *working_areas;/* list of allocated working areas */
+	uint8_t *working_area_backup;		/* original content of the working area */
+	uint32_t *working_area_backup_valid;/* one bit per word saved in working_area_backup */
+	struct target_mem_region *mem_regions;	/* declared with "mem_region" */
 	enum target_debug_reason debug_reason;/* reason why the target entered debug state */
 	enum target_endianness endianness;	/* target endianness */
 	/* also see: target_state_name() */
@@ -166,9 +202,12 @@ struct target {
 	struct reg_cache *reg_cache;		/* the first register cache of the target (core regs) */
 	struct breakpoint *breakpoints;		/* list of breakpoints */
 	struct watchpoint *watchpoints;		/* list of watchpoints */
+	struct breakpoint **breakpoint_hash;	/* address index into breakpoints */
+	struct watchpoint **watchpoint_hash;	/* address index into watchpoints */
 	struct trace *trace_info;			/* generic trace information */
 	struct debug_msg_receiver *dbgmsg;	/* list of debug message receivers */
 	uint32_t dbg_msg_enabled;			/* debug message status */
+	struct target_msg_ring *dbg_msg_ring;	/* message ring buffer the target announced */
 	void *arch_info;					/* architecture specific information */
 	struct target *next;				/* next target in list */
 
@@ -184,7 +223,10 @@ struct target {
 	struct rtos *rtos;					/* Instance of Real Time Operating System support */
 	bool rtos_auto_detect;				/* A flag that indicates that the RTOS has been specified as "auto"
 										 * and must be detected when symbols are offered */
+	char *rtos_cache_file;				/* image GDB debugs, the RTOS symbols are kept per its build-id */
 	struct backoff_timer backoff;
+	int poll_interval;					/* ms between background polls in the current state */
+	int64_t poll_due;					/* timeval_ms() of the next background poll */
 	int smp;							/* add some target attributes for smp support */
 	struct target_list *head;
 	/* the gdb service is there in case of smp, we have only one gdb server
@@ -265,6 +307,8 @@ enum target_event {
 	TARGET_EVENT_GDB_FLASH_WRITE_START,
 	TARGET_EVENT_GDB_FLASH_WRITE_END,
 
+	TARGET_EVENT_FLASH_PROGRESS,	/* see flash_progress() */
+
 	TARGET_EVENT_TRACE_CONFIG,
 };
 
@@ -303,7 +347,8 @@ struct target_timer_callback {
 	bool removed;
 	struct timeval when;
 	void *priv;
-	struct target_timer_callback *next;
+	unsigned int heap_index;	/* position in the timer heap */
+	struct target_timer_callback *next;	/* while being fired */
 };
 
 int target_register_commands(struct command_context *cmd_ctx);
@@ -369,6 +414,11 @@ int target_call_timer_callbacks(void);
  * a synchronous command completes.
  */
 int target_call_timer_callbacks_now(void);
+/**
+ * Returns the ms until the next timer callback is due, at most @a limit,
+ * so the server loop sleeps no longer than needed.
+ */
+int target_timer_callbacks_due_ms(int limit);
 
 struct target *get_target_by_num(int num);
 struct target *get_current_target(struct command_context *cmd_ctx);
@@ -526,6 +576,29 @@ int target_read_memory(struct target *target,
 		uint32_t address, uint32_t size, uint32_t count, uint8_t *buffer);
 int target_read_phys_memory(struct target *target,
 		uint32_t address, uint32_t size, uint32_t count, uint8_t *buffer);
+
+/* one region of a target_read_memory_multi() request */
+struct target_mem_xfer {
+	uint32_t address;
+	uint32_t size;
+	uint32_t count;
+	uint8_t *buffer;
+};
+
+/**
+ * Read @a num regions, each like target_read_memory(), in order.  Targets
+ * that can put scattered reads into one adapter transfer do so, the
+ * others get one read_memory call per region.
+ */
+int target_read_memory_multi(struct target *target,
+		const struct target_mem_xfer *xfers, unsigned int num);
+
+/**
+ * Report a @a state of @a target that its adapter saw without being
+ * polled.  A change makes the target be polled right away; the same
+ * state counts as a poll and puts the next background poll off.
+ */
+void target_state_report(struct target *target, enum target_state state);
 /**
  * Write @a count items of @a size bytes to the memory of @a target at
  * the @a address given. @a address must be aligned to @a size
@@ -576,11 +649,36 @@ int target_write_buffer(struct target *target,
 		uint32_t address, uint32_t size, const uint8_t *buffer);
 int target_read_buffer(struct target *target,
 		uint32_t address, uint32_t size, uint8_t *buffer);
+/**
+ * target_write_buffer() with a check of what was written.  Adapters that
+ * can read each word back as part of the write do so at no extra cost;
+ * otherwise the range is read back and compared only if @a read_back.
+ */
+int target_write_buffer_verify(struct target *target, uint32_t address,
+		uint32_t size, const uint8_t *buffer, bool read_back);
+/* false when any byte of the range lies in a region that must not be cached */
+bool target_memory_cacheable(struct target *target, uint32_t address, uint32_t size);
 int target_checksum_memory(struct target *target,
 		uint32_t address, uint32_t size, uint32_t *crc);
+/* The checksum of each chunk_size piece of the range, the last one may be
+ * shorter; checksums needs DIV_ROUND_UP(size, chunk_size) entries. */
+int target_checksum_memory_chunks(struct target *target, uint32_t address,
+		uint32_t size, uint32_t chunk_size, uint32_t *checksums);
 int target_blank_check_memory(struct target *target,
 		uint32_t address, uint32_t size, uint32_t *blank);
+
+struct target_memory_check_block {
+	uint32_t address;
+	uint32_t size;
+	uint32_t result;	/* AND of all bytes, like target_blank_check_memory() */
+};
+
+/* Blank check every block, in as few algorithm runs as the target can */
+int target_blank_check_memory_blocks(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks);
 int target_wait_state(struct target *target, enum target_state state, int ms);
+int target_wait_state_expected(struct target *target, enum target_state state,
+		int ms, int expected_ms);
 
 /**
  * Obtain file-I/O information from target for GDB to do syscall.
@@ -596,6 +694,15 @@ int target_get_gdb_fileio_info(struct target *target, struct gdb_fileio_info *fi
  */
 int target_gdb_fileio_end(struct target *target, int retcode, int fileio_errno, bool ctrl_c);
 
+/**
+ * Sample the PC by halting and resuming the target repeatedly.
+ *
+ * This is the fallback used when target->type->profiling is not set,
+ * exported so non-intrusive implementations can fall back to it.
+ */
+int target_profiling_default(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+
 
 
 /** Return the *name* of this targets current state */
@@ -628,6 +735,17 @@ int target_alloc_working_area(struct target *target,
  */
 int target_alloc_working_area_try(struct target *target,
 		uint32_t size, struct working_area **area);
+/* Allocate a named area that stays allocated across calls, e.g. a resident
+ * loader, its FIFO or its stack. Asking for the same name again returns the
+ * same area, with *fresh false, as long as it is large enough. Pinned areas
+ * are taken from the top of the working area and are released like any
+ * other by target_free_working_area() or target_free_all_working_areas().
+ *
+ * The name must be a string constant, and *area must stay valid for as
+ * long as the area is pinned, like any other user pointer.
+ */
+int target_alloc_working_area_pinned(struct target *target, const char *name,
+		uint32_t size, struct working_area **area, bool *fresh);
 int target_free_working_area(struct target *target, struct working_area *area);
 void target_free_all_working_areas(struct target *target);
 uint32_t target_get_working_area_avail(struct target *target);
@@ -663,6 +781,13 @@ int target_write_u64(struct target *target, uint64_t address, uint64_t value);
 int target_write_u32(struct target *target, uint32_t address, uint32_t value);
 int target_write_u16(struct target *target, uint32_t address, uint16_t value);
 int target_write_u8(struct target *target, uint32_t address, uint8_t value);
+/**
+ * Set the bits @a set and clear the bits @a clear of the word at
+ * @a address; done on the adapter if the target can, read-modify-write
+ * otherwise.
+ */
+int target_update_u32(struct target *target, uint32_t address,
+		uint32_t set, uint32_t clear);
 
 /* Issues USER() statements with target state information */
 int target_arch_state(struct target *target);
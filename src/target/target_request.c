@@ -45,6 +45,16 @@ bool target_got_message(void)
 
 static int charmsg_mode;
 
+#define RING_HEADER_SIZE	12
+#define RING_LINE_MAX		256
+
+struct target_msg_ring {
+	uint32_t address;
+	/* a line the target has not finished yet */
+	char line[RING_LINE_MAX + 1];
+	unsigned int line_len;
+};
+
 static int target_asciimsg(struct target *target, uint32_t length)
 {
 	char *msg = malloc(DIV_ROUND_UP(length + 1, 4) * 4);
@@ -113,6 +123,108 @@ static int target_hexmsg(struct target *target, int size, uint32_t length)
 	return ERROR_OK;
 }
 
+static void target_ring_line(struct target *target, struct target_msg_ring *ring)
+{
+	struct debug_msg_receiver *c = target->dbgmsg;
+
+	ring->line[ring->line_len] = 0;
+	ring->line_len = 0;
+
+	LOG_DEBUG("%s", ring->line);
+
+	while (c) {
+		command_print(c->cmd_ctx, "%s", ring->line);
+		c = c->next;
+	}
+}
+
+static void target_ring_output(struct target *target, const uint8_t *data, uint32_t len)
+{
+	struct target_msg_ring *ring = target->dbg_msg_ring;
+
+	for (uint32_t i = 0; i < len; i++) {
+		if (data[i] == '\n')
+			target_ring_line(target, ring);
+		else if (data[i] != '\r') {
+			ring->line[ring->line_len++] = data[i];
+			if (ring->line_len == RING_LINE_MAX)
+				target_ring_line(target, ring);
+		}
+	}
+}
+
+static int target_ring_announce(struct target *target, uint32_t address)
+{
+	if (address == 0) {
+		free(target->dbg_msg_ring);
+		target->dbg_msg_ring = NULL;
+		return ERROR_OK;
+	}
+
+	if (!target->dbg_msg_ring) {
+		target->dbg_msg_ring = calloc(1, sizeof(*target->dbg_msg_ring));
+		if (!target->dbg_msg_ring)
+			return ERROR_FAIL;
+	}
+	target->dbg_msg_ring->address = address;
+	target->dbg_msg_ring->line_len = 0;
+
+	LOG_DEBUG("message ring at 0x%8.8" PRIx32, address);
+	return ERROR_OK;
+}
+
+int target_request_ring_poll(struct target *target)
+{
+	struct target_msg_ring *ring = target->dbg_msg_ring;
+	uint8_t header[RING_HEADER_SIZE];
+	uint32_t size, head, tail, len;
+	uint8_t *data;
+	int retval;
+
+	if (!ring || !target->dbg_msg_enabled)
+		return ERROR_OK;
+
+	retval = target_read_buffer(target, ring->address, sizeof(header), header);
+	if (retval != ERROR_OK)
+		return retval;
+
+	size = target_buffer_get_u32(target, header);
+	head = target_buffer_get_u32(target, header + 4);
+	tail = target_buffer_get_u32(target, header + 8);
+	if (head == tail)
+		return ERROR_OK;
+	if (head >= size || tail >= size) {
+		LOG_ERROR("message ring at 0x%8.8" PRIx32 " is corrupt, ignoring it", ring->address);
+		return target_ring_announce(target, 0);
+	}
+
+	got_message = true;
+
+	/* everything between tail and head, in up to two reads */
+	len = (head > tail) ? head - tail : size - tail + head;
+	data = malloc(len);
+	if (!data)
+		return ERROR_FAIL;
+	if (head > tail)
+		retval = target_read_buffer(target, ring->address + RING_HEADER_SIZE + tail, len, data);
+	else {
+		retval = target_read_buffer(target, ring->address + RING_HEADER_SIZE + tail,
+				size - tail, data);
+		if (retval == ERROR_OK && head)
+			retval = target_read_buffer(target, ring->address + RING_HEADER_SIZE,
+					head, data + size - tail);
+	}
+
+	/* hand the space back before the output, the target may be waiting */
+	if (retval == ERROR_OK)
+		retval = target_write_u32(target, ring->address + 8, head);
+	if (retval == ERROR_OK)
+		target_ring_output(target, data, len);
+
+	free(data);
+	return retval;
+}
+
 /* handle requests from the target received by a target specific
  * side-band channel (e.g. ARM7/9 DCC)
  */
@@ -143,6 +255,9 @@ int target_request(struct target *target, uint32_t request)
 		case TARGET_REQ_DEBUGCHAR:
 			target_charmsg(target, (request & 0x00ff0000) >> 16);
 			break;
+		case TARGET_REQ_RINGBUF:
+			target_ring_announce(target, request & 0xffffff00);
+			break;
 /*		case TARGET_REQ_SEMIHOSTING:
  *			break;
  */
@@ -32,6 +32,7 @@ typedef enum target_req_cmd {
 	TARGET_REQ_TRACEMSG,
 	TARGET_REQ_DEBUGMSG,
 	TARGET_REQ_DEBUGCHAR,
+	TARGET_REQ_RINGBUF,		/* address of a message ring, see target_request_ring_poll() */
 /*	TARGET_REQ_SEMIHOSTING, */
 } target_req_cmd_t;
 
@@ -41,6 +42,14 @@ struct debug_msg_receiver {
 };
 
 int target_request(struct target *target, uint32_t request);
+/**
+ * Read the messages in the ring buffer the target announced with
+ * TARGET_REQ_RINGBUF, if any. The buffer is in target RAM, 256 byte
+ * aligned: the 32-bit words size, head and tail (offsets of the next
+ * byte the target writes and the host reads) followed by size bytes of
+ * text. The target only moves head, the host only tail.
+ */
+int target_request_ring_poll(struct target *target);
 int delete_debug_msg_receiver(struct command_context *cmd_ctx,
 		struct target *target);
 int target_request_register_commands(struct command_context *cmd_ctx);
@@ -28,6 +28,7 @@
 #include <jim-nvp.h>
 
 struct target;
+struct target_memory_check_block;
 
 /**
  * This holds methods shared between all instances of a given target
@@ -119,6 +120,15 @@ struct target_type {
 	 */
 	int (*write_memory)(struct target *target, uint32_t address,
 			uint32_t size, uint32_t count, const uint8_t *buffer);
+	/* Optional: several read_memory requests in one go, see
+	 * target_read_memory_multi(). */
+	int (*read_memory_multi)(struct target *target,
+			const struct target_mem_xfer *xfers, unsigned int num);
+	/* Optional: set and clear bits of a 32-bit word without the host
+	 * reading it first, see target_update_u32().  Returns
+	 * ERROR_TARGET_RESOURCE_NOT_AVAILABLE when it can't. */
+	int (*update_u32)(struct target *target, uint32_t address,
+			uint32_t set, uint32_t clear);
 
 	/* Default implementation will do some fancy alignment to improve performance, target can override */
 	int (*read_buffer)(struct target *target, uint32_t address,
@@ -127,11 +137,25 @@ struct target_type {
 	/* Default implementation will do some fancy alignment to improve performance, target can override */
 	int (*write_buffer)(struct target *target, uint32_t address,
 			uint32_t size, const uint8_t *buffer);
+	/* Optional: write_buffer with each word read back by the adapter as
+	 * it is written, see target_write_buffer_verify().  Returns
+	 * ERROR_TARGET_RESOURCE_NOT_AVAILABLE for what it can't verify. */
+	int (*write_buffer_verify)(struct target *target, uint32_t address,
+			uint32_t size, const uint8_t *buffer);
 
 	int (*checksum_memory)(struct target *target, uint32_t address,
 			uint32_t count, uint32_t *checksum);
+	/* Optional: checksums of count consecutive chunks of chunk_size bytes
+	 * each, in one go. Without it target_checksum_memory_chunks() does
+	 * one checksum_memory call per chunk. */
+	int (*checksum_memory_chunks)(struct target *target, uint32_t address,
+			uint32_t chunk_size, uint32_t count, uint32_t *checksums);
 	int (*blank_check_memory)(struct target *target, uint32_t address,
 			uint32_t count, uint32_t *blank);
+	/* Optional: blank check of several blocks in one go. Without it
+	 * target_blank_check_memory_blocks() calls blank_check_memory per block. */
+	int (*blank_check_memory_blocks)(struct target *target,
+			struct target_memory_check_block *blocks, int num_blocks);
 
 	/*
 	 * target break-/watchpoint control
@@ -25,6 +25,80 @@
 #include "target_type.h"
 #include "hello.h"
 
+/* memory is kept in pages allocated on first write, unwritten memory
+ * reads as zero */
+#define TESTEE_PAGE_SIZE	4096
+
+struct testee_page {
+	uint32_t address;
+	struct testee_page *next;
+	uint8_t data[TESTEE_PAGE_SIZE];
+};
+
+static struct testee_page *testee_find_page(struct target *target,
+		uint32_t address, bool create)
+{
+	struct testee_page **pages = (struct testee_page **)&target->arch_info;
+	struct testee_page *page;
+
+	address &= ~(TESTEE_PAGE_SIZE - 1);
+	for (page = *pages; page; page = page->next)
+		if (page->address == address)
+			return page;
+
+	if (!create)
+		return NULL;
+
+	page = calloc(1, sizeof(*page));
+	if (!page)
+		return NULL;
+	page->address = address;
+	page->next = *pages;
+	*pages = page;
+	return page;
+}
+
+static int testee_read_memory(struct target *target, uint32_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	uint32_t len = size * count;
+
+	while (len) {
+		uint32_t offset = address % TESTEE_PAGE_SIZE;
+		uint32_t n = MIN(len, TESTEE_PAGE_SIZE - offset);
+		struct testee_page *page = testee_find_page(target, address, false);
+
+		if (page)
+			memcpy(buffer, page->data + offset, n);
+		else
+			memset(buffer, 0, n);
+		address += n;
+		buffer += n;
+		len -= n;
+	}
+	return ERROR_OK;
+}
+
+static int testee_write_memory(struct target *target, uint32_t address,
+		uint32_t size, uint32_t count, const uint8_t *buffer)
+{
+	uint32_t len = size * count;
+
+	while (len) {
+		uint32_t offset = address % TESTEE_PAGE_SIZE;
+		uint32_t n = MIN(len, TESTEE_PAGE_SIZE - offset);
+		struct testee_page *page = testee_find_page(target, address, true);
+
+		if (!page)
+			return ERROR_FAIL;
+		memcpy(page->data + offset, buffer, n);
+		address += n;
+		buffer += n;
+		len -= n;
+	}
+	return ERROR_OK;
+}
+
 static const struct command_registration testee_command_handlers[] = {
 	{
 		.name = "testee",
@@ -40,6 +114,17 @@ static int testee_init(struct command_context *cmd_ctx, struct target *target)
 {
 	return ERROR_OK;
 }
+static void testee_deinit_target(struct target *target)
+{
+	struct testee_page *page = target->arch_info;
+
+	while (page) {
+		struct testee_page *next = page->next;
+		free(page);
+		page = next;
+	}
+	target->arch_info = NULL;
+}
 static int testee_poll(struct target *target)
 {
 	if ((target->state == TARGET_RUNNING) || (target->state == TARGET_DEBUG_RUNNING))
@@ -66,8 +151,11 @@ struct target_type testee_target = {
 	.commands = testee_command_handlers,
 
 	.init_target = &testee_init,
+	.deinit_target = &testee_deinit_target,
 	.poll = &testee_poll,
 	.halt = &testee_halt,
 	.assert_reset = &testee_reset_assert,
 	.deassert_reset = &testee_reset_deassert,
+	.read_memory = &testee_read_memory,
+	.write_memory = &testee_write_memory,
 };
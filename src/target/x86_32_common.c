@@ -167,6 +167,29 @@ int x86_32_common_read_phys_mem(struct target *t, uint32_t phys_address,
 	return ERROR_OK;
 }
 
+/* MEMRD or MEMWR instruction for size, by the CS.D bit:
+ * 1 for a 32 bit code segment, else 16 */
+static int mem_instruction(struct target *t, uint32_t size, bool write)
+{
+	struct x86_32_common *x86_32 = target_to_x86_32(t);
+	bool use32 = (buf_get_u32(x86_32->cache->reg_list[CSAR].value, 0, 32)) & CSAR_D;
+
+	switch (size) {
+		case BYTE:
+			if (write)
+				return use32 ? MEMWRB32 : MEMWRB16;
+			return use32 ? MEMRDB32 : MEMRDB16;
+		case WORD:
+			if (write)
+				return use32 ? MEMWRH32 : MEMWRH16;
+			return use32 ? MEMRDH32 : MEMRDH16;
+		default:
+			if (write)
+				return use32 ? MEMWRW32 : MEMWRW16;
+			return use32 ? MEMRDW32 : MEMRDW16;
+	}
+}
+
 static int read_phys_mem(struct target *t, uint32_t phys_address,
 			uint32_t size, uint32_t count, uint8_t *buffer)
 {
@@ -194,6 +217,11 @@ static int read_phys_mem(struct target *t, uint32_t phys_address,
 		pg_disabled = true;
 	}
 
+	if (x86_32->read_mem_block && (size == BYTE || size == WORD || size == DWORD)) {
+		retval = x86_32->read_mem_block(t, mem_instruction(t, size, false),
+				size, phys_address, count, buffer);
+		count = 0;
+	}
 	for (uint32_t i = 0; i < count; i++) {
 		switch (size) {
 		case BYTE:
@@ -300,6 +328,11 @@ static int write_phys_mem(struct target *t, uint32_t phys_address,
 		}
 		pg_disabled = true;
 	}
+	if (x86_32->write_mem_block && (size == BYTE || size == WORD || size == DWORD)) {
+		retval = x86_32->write_mem_block(t, mem_instruction(t, size, true),
+				size, phys_address, count, buffer);
+		count = 0;
+	}
 	for (uint32_t i = 0; i < count; i++) {
 		switch (size) {
 		case BYTE:
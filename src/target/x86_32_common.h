@@ -240,6 +240,11 @@ struct x86_32_common {
 	int (*read_hw_reg)(struct target *t, int reg, uint32_t *regval, uint8_t cache);
 	int (*write_hw_reg)(struct target *t, int reg,
 				uint32_t regval, uint8_t cache);
+	/* count accesses of size bytes with a MEMRD or MEMWR instruction */
+	int (*read_mem_block)(struct target *t, int instr, uint32_t size,
+				uint32_t addr, uint32_t count, uint8_t *buf);
+	int (*write_mem_block)(struct target *t, int instr, uint32_t size,
+				uint32_t addr, uint32_t count, const uint8_t *buf);
 
 	/* register cache to processor synchronization */
 	int (*read_hw_reg_to_cache)(struct target *target, int num);
@@ -643,7 +643,7 @@ static unsigned int parity(unsigned int v)
 	return (0x6996 >> v) & 1;
 }
 
-static int xscale_load_ic(struct target *target, uint32_t va, uint32_t buffer[8])
+static void xscale_queue_load_ic(struct target *target, uint32_t va, uint32_t buffer[8])
 {
 	struct xscale_common *xscale = target_to_xscale(target);
 	uint8_t packet[4];
@@ -693,7 +693,11 @@ static int xscale_load_ic(struct target *target, uint32_t va, uint32_t buffer[8]
 
 		jtag_add_dr_scan(target->tap, 2, fields, TAP_IDLE);
 	}
+}
 
+static int xscale_load_ic(struct target *target, uint32_t va, uint32_t buffer[8])
+{
+	xscale_queue_load_ic(target, va, buffer);
 	return jtag_execute_queue();
 }
 
@@ -1440,20 +1444,11 @@ static int xscale_step(struct target *target, int current,
 
 }
 
-static int xscale_assert_reset(struct target *target)
+/* assert SRST with Hold reset, Halt mode and Trap Reset set in DCSR */
+static int xscale_hold_reset(struct target *target)
 {
 	struct xscale_common *xscale = target_to_xscale(target);
 
-	/* TODO: apply hw reset signal in not examined state */
-	if (!(target_was_examined(target))) {
-		LOG_WARNING("Reset is not asserted because the target is not examined.");
-		LOG_WARNING("Use a reset button or power cycle the target.");
-		return ERROR_TARGET_NOT_EXAMINED;
-	}
-
-	LOG_DEBUG("target->state: %s",
-		target_state_name(target));
-
 	/* assert reset */
 	jtag_add_reset(0, 1);
 
@@ -1475,7 +1470,62 @@ static int xscale_assert_reset(struct target *target)
 
 	/* select BYPASS, because having DCSR selected caused problems on the PXA27x */
 	xscale_jtag_set_instr(target->tap, ~0, TAP_IDLE);
-	jtag_execute_queue();
+	return jtag_execute_queue();
+}
+
+/* Load the debug handler into the mini-icache, all lines with one flush */
+static int xscale_load_debug_handler(struct target *target)
+{
+	struct xscale_common *xscale = target_to_xscale(target);
+	const uint8_t *buffer = xscale_debug_handler;
+	uint32_t address = xscale->handler_address;
+	unsigned buf_cnt;
+	int retval;
+
+	for (unsigned binary_size = sizeof xscale_debug_handler;
+		binary_size > 0;
+		binary_size -= buf_cnt, buffer += buf_cnt) {
+		uint32_t cache_line[8];
+		unsigned i;
+
+		buf_cnt = binary_size;
+		if (buf_cnt > 32)
+			buf_cnt = 32;
+
+		for (i = 0; i < buf_cnt; i += 4) {
+			/* convert LE buffer to host-endian uint32_t */
+			cache_line[i / 4] = le_to_h_u32(&buffer[i]);
+		}
+
+		for (; i < 32; i += 4)
+			cache_line[i / 4] = 0xe1a08008;
+
+		/* only load addresses other than the reset vectors */
+		if ((address % 0x400) != 0x0)
+			xscale_queue_load_ic(target, address, cache_line);
+
+		address += buf_cnt;
+	}
+
+	retval = jtag_execute_queue();
+	if (retval == ERROR_OK)
+		xscale->handler_resident = true;
+	return retval;
+}
+
+static int xscale_assert_reset(struct target *target)
+{
+	/* TODO: apply hw reset signal in not examined state */
+	if (!(target_was_examined(target))) {
+		LOG_WARNING("Reset is not asserted because the target is not examined.");
+		LOG_WARNING("Use a reset button or power cycle the target.");
+		return ERROR_TARGET_NOT_EXAMINED;
+	}
+
+	LOG_DEBUG("target->state: %s",
+		target_state_name(target));
+
+	xscale_hold_reset(target);
 
 	target->state = TARGET_RESET;
 
@@ -1520,14 +1570,18 @@ static int xscale_deassert_reset(struct target *target)
 	 */
 
 	/*
-	 * REVISIT:  *assumes* we had a SRST+TRST reset so the mini-icache
-	 * contents got invalidated.  Safer to force that, so writing new
-	 * contents can't ever fail..
+	 * The mini-icache keeps its contents across a reset, so a handler
+	 * loaded before is normally still there and only the vectors are
+	 * reloaded. If the handler doesn't report after release of Hold
+	 * reset (power was lost, the lines got invalidated), the reset is
+	 * done again with a full load.
+	 *
+	 * REVISIT:  a full load *assumes* we had a SRST+TRST reset so the
+	 * mini-icache contents got invalidated.  Safer to force that, so
+	 * writing new contents can't ever fail..
 	 */
-	{
-		uint32_t address;
-		unsigned buf_cnt;
-		const uint8_t *buffer = xscale_debug_handler;
+	for (;;) {
+		bool load = !xscale->handler_resident;
 		int retval;
 
 		/* release SRST */
@@ -1549,42 +1603,18 @@ static int xscale_deassert_reset(struct target *target)
 		 * "Special Debug State" for access to registers, memory,
 		 * coprocessors, trace data, etc.
 		 */
-		address = xscale->handler_address;
-		for (unsigned binary_size = sizeof xscale_debug_handler;
-			binary_size > 0;
-			binary_size -= buf_cnt, buffer += buf_cnt) {
-			uint32_t cache_line[8];
-			unsigned i;
-
-			buf_cnt = binary_size;
-			if (buf_cnt > 32)
-				buf_cnt = 32;
-
-			for (i = 0; i < buf_cnt; i += 4) {
-				/* convert LE buffer to host-endian uint32_t */
-				cache_line[i / 4] = le_to_h_u32(&buffer[i]);
-			}
-
-			for (; i < 32; i += 4)
-				cache_line[i / 4] = 0xe1a08008;
-
-			/* only load addresses other than the reset vectors */
-			if ((address % 0x400) != 0x0) {
-				retval = xscale_load_ic(target, address,
-						cache_line);
-				if (retval != ERROR_OK)
-					return retval;
-			}
-
-			address += buf_cnt;
+		if (load) {
+			retval = xscale_load_debug_handler(target);
+			if (retval != ERROR_OK)
+				return retval;
+		} else {
+			xscale_invalidate_ic_line(target, 0x0);
+			xscale_invalidate_ic_line(target, 0xffff0000);
 		}
 
-		retval = xscale_load_ic(target, 0x0,
-				xscale->low_vectors);
-		if (retval != ERROR_OK)
-			return retval;
-		retval = xscale_load_ic(target, 0xffff0000,
-				xscale->high_vectors);
+		xscale_queue_load_ic(target, 0x0, xscale->low_vectors);
+		xscale_queue_load_ic(target, 0xffff0000, xscale->high_vectors);
+		retval = jtag_execute_queue();
 		if (retval != ERROR_OK)
 			return retval;
 
@@ -1601,6 +1631,16 @@ static int xscale_deassert_reset(struct target *target)
 		xscale_write_dcsr(target, 0, 1);
 		target->state = TARGET_RUNNING;
 
+		if (!load) {
+			jtag_add_sleep(10000);
+			if (xscale_read_tx(target, 0) == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
+				LOG_INFO("debug handler not in the mini-icache, loading it");
+				xscale->handler_resident = false;
+				xscale_hold_reset(target);
+				continue;
+			}
+		}
+
 		if (!target->reset_halt) {
 			jtag_add_sleep(10000);
 
@@ -1611,6 +1651,7 @@ static int xscale_deassert_reset(struct target *target)
 			/* resume the target */
 			xscale_resume(target, 1, 0x0, 1, 0);
 		}
+		break;
 	}
 
 	return ERROR_OK;
@@ -3038,9 +3079,11 @@ COMMAND_HANDLER(xscale_handle_debug_handler_command)
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], handler_address);
 
 	if (((handler_address >= 0x800) && (handler_address <= 0x1fef800)) ||
-		((handler_address >= 0xfe000800) && (handler_address <= 0xfffff800)))
+		((handler_address >= 0xfe000800) && (handler_address <= 0xfffff800))) {
+		if (handler_address != xscale->handler_address)
+			xscale->handler_resident = false;
 		xscale->handler_address = handler_address;
-	else {
+	} else {
 		LOG_ERROR(
 			"xscale debug_handler <address> must be between 0x800 and 0x1fef800 or between 0xfe000800 and 0xfffff800");
 		return ERROR_FAIL;
@@ -92,6 +92,8 @@ struct xscale_common {
 
 	/* current state of the debug handler */
 	uint32_t handler_address;
+	/* the handler was loaded into the mini-icache and may still be there */
+	bool handler_resident;
 
 	/* target-endian buffers with exception vectors */
 	uint32_t low_vectors[8];
@@ -121,6 +121,150 @@ TDO  (1);
 
 static int xsvf_fd;
 
+/* The player reads opcodes and operands a byte or a word at a time;
+ * read the file ahead in large blocks instead of one syscall each. */
+#define XSVF_READ_AHEAD 65536
+
+static uint8_t xsvf_read_ahead[XSVF_READ_AHEAD];
+static size_t xsvf_read_ahead_pos, xsvf_read_ahead_len;
+static long xsvf_offset;	/* file offset of the next byte xsvf_read() returns */
+
+static ssize_t xsvf_read(int fd, void *buf, size_t count)
+{
+	uint8_t *out = buf;
+	size_t done = 0;
+
+	while (done < count) {
+		if (xsvf_read_ahead_pos == xsvf_read_ahead_len) {
+			ssize_t len = read(fd, xsvf_read_ahead, sizeof(xsvf_read_ahead));
+			if (len < 0)
+				return done ? (ssize_t)done : -1;
+			if (len == 0)
+				break;
+			xsvf_read_ahead_pos = 0;
+			xsvf_read_ahead_len = len;
+		}
+
+		size_t n = MIN(count - done, xsvf_read_ahead_len - xsvf_read_ahead_pos);
+		memcpy(out + done, xsvf_read_ahead + xsvf_read_ahead_pos, n);
+		xsvf_read_ahead_pos += n;
+		done += n;
+	}
+
+	xsvf_offset += done;
+	return done;
+}
+
+/*
+ * With the 'batch' option, XSDR and XSDRTDO records that cannot be
+ * retried are only queued. Each keeps its own copy of the expected TDO
+ * and mask, and is checked from a queue callback when the queue runs.
+ */
+#define XSVF_BATCH_MAX_BYTES	(256 * 1024)
+
+struct xsvf_pending_scan {
+	struct xsvf_pending_scan *next;
+	long file_offset;
+	int num_bits;
+	uint8_t data[];		/* captured, expected and mask bits */
+};
+
+static struct xsvf_pending_scan *xsvf_pending;
+static struct xsvf_pending_scan **xsvf_pending_tail = &xsvf_pending;
+static size_t xsvf_pending_bytes;
+static long xsvf_mismatch_offset;
+
+static int xsvf_check_pending(jtag_callback_data_t data0, jtag_callback_data_t data1,
+		jtag_callback_data_t data2, jtag_callback_data_t data3)
+{
+	struct xsvf_pending_scan *scan = (struct xsvf_pending_scan *)data0;
+	int len = DIV_ROUND_UP(scan->num_bits, 8);
+
+	if (buf_cmp_mask(scan->data, scan->data + len, scan->data + 2 * len, scan->num_bits)) {
+		LOG_USER("XSDRTDO mismatch at offset %ld", scan->file_offset);
+		xsvf_mismatch_offset = scan->file_offset;
+		return ERROR_JTAG_QUEUE_FAILED;
+	}
+
+	return ERROR_OK;
+}
+
+static int xsvf_queue_scan(struct jtag_tap *tap, int num_bits, const uint8_t *out,
+		const uint8_t *expected, const uint8_t *mask, long file_offset)
+{
+	int len = DIV_ROUND_UP(num_bits, 8);
+	struct xsvf_pending_scan *scan = malloc(sizeof(*scan) + 3 * len);
+
+	if (scan == NULL) {
+		LOG_ERROR("XSVF: out of memory");
+		return ERROR_FAIL;
+	}
+	scan->next = NULL;
+	scan->file_offset = file_offset;
+	scan->num_bits = num_bits;
+	memcpy(scan->data + len, expected, len);
+	memcpy(scan->data + 2 * len, mask, len);
+
+	*xsvf_pending_tail = scan;
+	xsvf_pending_tail = &scan->next;
+	xsvf_pending_bytes += len;
+
+	if (tap == NULL) {
+		jtag_add_plain_dr_scan(num_bits, out, scan->data, TAP_DRPAUSE);
+	} else {
+		struct scan_field field = {
+			.num_bits = num_bits,
+			.out_value = out,
+			.in_value = scan->data,
+		};
+		jtag_add_dr_scan(tap, 1, &field, TAP_DRPAUSE);
+	}
+	jtag_add_callback4(xsvf_check_pending, (jtag_callback_data_t)scan, 0, 0, 0);
+
+	return ERROR_OK;
+}
+
+/* run the queue, which also checks and releases any batched scans;
+ * a mismatch updates *file_offset to the failing record */
+static int xsvf_flush_pending(long *file_offset)
+{
+	xsvf_mismatch_offset = -1;
+
+	int retval = jtag_execute_queue();
+	if (file_offset && xsvf_mismatch_offset >= 0)
+		*file_offset = xsvf_mismatch_offset;
+
+	while (xsvf_pending) {
+		struct xsvf_pending_scan *next = xsvf_pending->next;
+		free(xsvf_pending);
+		xsvf_pending = next;
+	}
+	xsvf_pending_tail = &xsvf_pending;
+	xsvf_pending_bytes = 0;
+
+	return retval;
+}
+
+/* records that can follow a batched scan without running the queue */
+static bool xsvf_batchable(uint8_t opcode, int xrepeat)
+{
+	switch (opcode) {
+	case XSDR:
+	case XSDRTDO:
+		return xrepeat <= 1;
+	case XTDOMASK:
+	case XRUNTEST:
+	case XREPEAT:
+	case XSDRSIZE:
+	case XENDIR:
+	case XENDDR:
+	case XCOMMENT:
+		return true;
+	default:
+		return false;
+	}
+}
+
 /* map xsvf tap state to an openocd "tap_state_t" */
 static tap_state_t xsvf_to_tap(int xsvf_state)
 {
@@ -185,12 +329,16 @@ static tap_state_t xsvf_to_tap(int xsvf_state)
 
 static int xsvf_read_buffer(int num_bits, int fd, uint8_t *buf)
 {
-	int num_bytes;
+	int num_bytes = (num_bits + 7) / 8;
+
+	if (xsvf_read(fd, buf, num_bytes) != num_bytes)
+		return ERROR_XSVF_EOF;
 
-	for (num_bytes = (num_bits + 7) / 8; num_bytes > 0; num_bytes--) {
-		/* reverse the order of bytes as they are read sequentially from file */
-		if (read(fd, buf + num_bytes - 1, 1) < 0)
-			return ERROR_XSVF_EOF;
+	/* reverse the order of bytes as they are read sequentially from file */
+	for (int i = 0, j = num_bytes - 1; i < j; i++, j--) {
+		uint8_t tmp = buf[i];
+		buf[i] = buf[j];
+		buf[j] = tmp;
 	}
 
 	return ERROR_OK;
@@ -224,6 +372,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 	int tdo_mismatch = 0;
 	int result;
 	int verbose = 1;
+	bool batch = false;
 
 	bool collecting_path = false;
 	tap_state_t path[XSTATE_MAX_PATH];
@@ -259,6 +408,8 @@ COMMAND_HANDLER(handle_xsvf_command)
 		command_print(CMD_CTX, "file \"%s\" not found", filename);
 		return ERROR_FAIL;
 	}
+	xsvf_read_ahead_pos = xsvf_read_ahead_len = 0;
+	xsvf_offset = 0;
 
 	/* if this argument is present, then interpret xruntest counts as TCK cycles rather than as
 	 *usecs */
@@ -268,15 +419,30 @@ COMMAND_HANDLER(handle_xsvf_command)
 		++CMD_ARGV;
 	}
 
-	if ((CMD_ARGC > 2) && (strcmp(CMD_ARGV[2], "quiet") == 0))
-		verbose = 0;
+	for (unsigned i = 2; i < CMD_ARGC; i++) {
+		if (strcmp(CMD_ARGV[i], "quiet") == 0)
+			verbose = 0;
+		else if (strcmp(CMD_ARGV[i], "batch") == 0)
+			batch = true;
+	}
 
 	LOG_WARNING("XSVF support in OpenOCD is limited. Consider using SVF instead");
 	LOG_USER("xsvf processing file: \"%s\"", filename);
 
-	while (read(xsvf_fd, &opcode, 1) > 0) {
+	while (xsvf_read(xsvf_fd, &opcode, 1) > 0) {
 		/* record the position of this opcode within the file */
-		file_offset = lseek(xsvf_fd, 0, SEEK_CUR) - 1;
+		file_offset = xsvf_offset - 1;
+
+		/* batched scans must be checked before anything else runs the queue */
+		if (xsvf_pending && !xsvf_batchable(opcode, xrepeat)) {
+			if (xsvf_flush_pending(&file_offset) != ERROR_OK) {
+				tdo_mismatch = 1;
+				/* return the TAPs to a reasonable state */
+				if (svf_add_statemove(TAP_IDLE) == ERROR_OK)
+					jtag_execute_queue();
+				break;
+			}
+		}
 
 		/* maybe collect another state for a pathmove();
 		 * or terminate a path.
@@ -296,7 +462,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 						break;
 					}
 
-					if (read(xsvf_fd, &uc, 1) < 0) {
+					if (xsvf_read(xsvf_fd, &uc, 1) < 0) {
 						do_abort = 1;
 						break;
 					}
@@ -376,7 +542,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t xruntest_buf[4];
 
-				if (read(xsvf_fd, xruntest_buf, 4) < 0) {
+				if (xsvf_read(xsvf_fd, xruntest_buf, 4) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -390,7 +556,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t myrepeat;
 
-				if (read(xsvf_fd, &myrepeat, 1) < 0)
+				if (xsvf_read(xsvf_fd, &myrepeat, 1) < 0)
 					do_abort = 1;
 				else {
 					xrepeat = myrepeat;
@@ -403,7 +569,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t xsdrsize_buf[4];
 
-				if (read(xsvf_fd, xsdrsize_buf, 4) < 0) {
+				if (xsvf_read(xsvf_fd, xsdrsize_buf, 4) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -451,7 +617,22 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				LOG_DEBUG("%s %d", op_name, xsdrsize);
 
-				for (attempt = 0; attempt < limit; ++attempt) {
+				if (batch && limit == 1) {
+					/* nothing to retry, so no need to wait for the result */
+					if (xsvf_queue_scan(tap, xsdrsize, dr_out_buf, dr_in_buf,
+							dr_in_mask, file_offset) != ERROR_OK) {
+						do_abort = 1;
+						break;
+					}
+					if (xsvf_pending_bytes >= XSVF_BATCH_MAX_BYTES
+							&& xsvf_flush_pending(&file_offset) != ERROR_OK) {
+						tdo_mismatch = 1;
+						break;
+					}
+					matched = 1;
+				}
+
+				for (attempt = 0; !matched && attempt < limit; ++attempt) {
 					struct scan_field field;
 
 					if (attempt > 0) {
@@ -499,10 +680,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 					jtag_check_value_mask(&field, dr_in_buf, dr_in_mask);
 
-					free(field.in_value);
-
 					/* LOG_DEBUG("FLUSHING QUEUE"); */
 					result = jtag_execute_queue();
+					free(field.in_value);
 					if (result == ERROR_OK) {
 						matched = 1;
 						break;
@@ -578,7 +758,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				tap_state_t mystate;
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(xsvf_fd, &uc, 1) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -621,7 +801,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 			case XENDIR:
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(xsvf_fd, &uc, 1) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -642,7 +822,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 			case XENDDR:
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(xsvf_fd, &uc, 1) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -671,14 +851,14 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				if (opcode == XSIR) {
 					/* one byte bitcount */
-					if (read(xsvf_fd, short_buf, 1) < 0) {
+					if (xsvf_read(xsvf_fd, short_buf, 1) < 0) {
 						do_abort = 1;
 						break;
 					}
 					bitcount = short_buf[0];
 					LOG_DEBUG("XSIR %d", bitcount);
 				} else {
-					if (read(xsvf_fd, short_buf, 2) < 0) {
+					if (xsvf_read(xsvf_fd, short_buf, 2) < 0) {
 						do_abort = 1;
 						break;
 					}
@@ -731,7 +911,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 				char comment[128];
 
 				do {
-					if (read(xsvf_fd, &uc, 1) < 0) {
+					if (xsvf_read(xsvf_fd, &uc, 1) < 0) {
 						do_abort = 1;
 						break;
 					}
@@ -761,9 +941,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 				tap_state_t end_state;
 				int delay;
 
-				if (read(xsvf_fd, &wait_local, 1) < 0
-					|| read(xsvf_fd, &end, 1) < 0
-					|| read(xsvf_fd, delay_buf, 4) < 0) {
+				if (xsvf_read(xsvf_fd, &wait_local, 1) < 0
+					|| xsvf_read(xsvf_fd, &end, 1) < 0
+					|| xsvf_read(xsvf_fd, delay_buf, 4) < 0) {
 						do_abort = 1;
 						break;
 				}
@@ -806,10 +986,10 @@ COMMAND_HANDLER(handle_xsvf_command)
 				int clock_count;
 				int usecs;
 
-				if (read(xsvf_fd, &wait_local, 1) < 0
-						||  read(xsvf_fd, &end, 1) < 0
-						||  read(xsvf_fd, clock_buf, 4) < 0
-						||  read(xsvf_fd, usecs_buf, 4) < 0) {
+				if (xsvf_read(xsvf_fd, &wait_local, 1) < 0
+						||  xsvf_read(xsvf_fd, &end, 1) < 0
+						||  xsvf_read(xsvf_fd, clock_buf, 4) < 0
+						||  xsvf_read(xsvf_fd, usecs_buf, 4) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -858,7 +1038,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 				*/
 				uint8_t count_buf[4];
 
-				if (read(xsvf_fd, count_buf, 4) < 0) {
+				if (xsvf_read(xsvf_fd, count_buf, 4) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -877,9 +1057,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 				uint8_t clock_buf[4];
 				uint8_t usecs_buf[4];
 
-				if (read(xsvf_fd, &state, 1) < 0
-						|| read(xsvf_fd, clock_buf, 4) < 0
-						|| read(xsvf_fd, usecs_buf, 4) < 0) {
+				if (xsvf_read(xsvf_fd, &state, 1) < 0
+						|| xsvf_read(xsvf_fd, clock_buf, 4) < 0
+						|| xsvf_read(xsvf_fd, usecs_buf, 4) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -963,7 +1143,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t trst_mode;
 
-				if (read(xsvf_fd, &trst_mode, 1) < 0) {
+				if (xsvf_read(xsvf_fd, &trst_mode, 1) < 0) {
 					do_abort = 1;
 					break;
 				}
@@ -997,13 +1177,21 @@ COMMAND_HANDLER(handle_xsvf_command)
 			result = svf_add_statemove(TAP_IDLE);
 			if (result != ERROR_OK)
 				return result;
-			result = jtag_execute_queue();
+			result = xsvf_flush_pending(NULL);
 			if (result != ERROR_OK)
 				return result;
 			break;
 		}
 	}
 
+	if (xsvf_pending && !tdo_mismatch) {
+		if (xsvf_flush_pending(&file_offset) != ERROR_OK) {
+			tdo_mismatch = 1;
+			if (svf_add_statemove(TAP_IDLE) == ERROR_OK)
+				jtag_execute_queue();
+		}
+	}
+
 	if (tdo_mismatch) {
 		command_print(CMD_CTX,
 			"TDO mismatch, somewhere near offset %lu in xsvf file, aborting",
@@ -1013,7 +1201,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 	}
 
 	if (unsupported) {
-		off_t offset = lseek(xsvf_fd, 0, SEEK_CUR) - 1;
+		off_t offset = xsvf_offset - 1;
 		command_print(CMD_CTX,
 			"unsupported xsvf command (0x%02X) at offset %jd, aborting",
 			uc, (intmax_t)offset);
@@ -1049,8 +1237,10 @@ static const struct command_registration xsvf_command_handlers[] = {
 		.help = "Runs a XSVF file.  If 'virt2' is given, xruntest "
 			"counts are interpreted as TCK cycles rather than "
 			"as microseconds.  Without the 'quiet' option, all "
-			"comments, retries, and mismatches will be reported.",
-		.usage = "(tapname|'plain') filename ['virt2'] ['quiet']",
+			"comments, retries, and mismatches will be reported. "
+			"With 'batch', scans that cannot be retried are queued "
+			"and their TDO checked together.",
+		.usage = "(tapname|'plain') filename ['virt2'] ['quiet'] ['batch']",
 	},
 	COMMAND_REGISTRATION_DONE
 };
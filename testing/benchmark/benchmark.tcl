@@ -0,0 +1,351 @@
+# OpenOCD performance benchmark
+#
+# Runs a set of timed scenarios through the Tcl RPC server of a running
+# OpenOCD, writes the results as JSON and compares them with a recorded
+# baseline. See README in this directory.
+#
+# tclsh benchmark.tcl ?-host addr? ?-port n? ?-gdb-port n? ?-settings file?
+#	?-workdir dir? ?-repeat n? ?-tolerance percent? ?-out file?
+#	?-baseline file? ?-record file?
+
+# defaults, a settings file can change any of them
+set host 127.0.0.1
+set port 6666
+set gdb_port 3333
+set workdir [file join [pwd] bench-work]
+set repeat 3
+set default_tolerance 10
+set out ""
+set baseline ""
+set record ""
+
+set scenarios {program verify erase_check gdb_step mem_read mem_write}
+set flash_bank 0
+set flash_base 0x08000000
+set program_sizes {64 256 512}
+set ram_base 0x20000000
+set mem_sizes {1 4 16 64}
+set gdb_steps 100
+
+# %FILE%, %BASE%, %BANK%, %OFFSET% and %SIZE% are replaced before use
+set program_cmd {flash write_image erase %FILE% %BASE% bin}
+set verify_cmd {flash verify_bank %BANK% %FILE% %OFFSET%}
+set erase_check_cmd {flash erase_check %BANK%}
+set mem_read_cmd {dump_image %FILE% %BASE% %SIZE%}
+set mem_write_cmd {load_image %FILE% %BASE% bin}
+
+# per-scenario tolerances in percent, e.g. set tolerance(gdb_step) 25
+array set tolerance {}
+
+proc usage {} {
+	puts "Usage: tclsh benchmark.tcl ?-host addr? ?-port n? ?-gdb-port n?\
+		?-settings file? ?-workdir dir? ?-repeat n? ?-tolerance percent?\
+		?-out file? ?-baseline file? ?-record file?"
+	exit 2
+}
+
+# the settings file comes first, so that options on the command line win
+set idx [lsearch -exact $argv -settings]
+if {$idx >= 0} {
+	source [lindex $argv [expr {$idx + 1}]]
+}
+
+foreach {opt val} $argv {
+	switch -- $opt {
+		-host      { set host $val }
+		-port      { set port $val }
+		-gdb-port  { set gdb_port $val }
+		-settings  { }
+		-workdir   { set workdir [file normalize $val] }
+		-repeat    { set repeat $val }
+		-tolerance { set default_tolerance $val }
+		-out       { set out $val }
+		-baseline  { set baseline $val }
+		-record    { set record $val }
+		default    { usage }
+	}
+}
+if {[llength $argv] % 2} {
+	usage
+}
+
+# Tcl RPC: commands and replies are terminated by 0x1a
+proc ocd_send {cmd} {
+	global sock
+	puts -nonewline $sock "$cmd\x1a"
+	flush $sock
+	set reply ""
+	while {1} {
+		set c [read $sock 1]
+		if {$c eq ""} {
+			error "connection to OpenOCD closed"
+		}
+		if {$c eq "\x1a"} {
+			return $reply
+		}
+		append reply $c
+	}
+}
+
+# run a command in OpenOCD, raise its error here
+proc ocd {cmd} {
+	set rc [ocd_send "set ::bench_rc \[catch {$cmd} ::bench_res\]"]
+	set res [ocd_send {set ::bench_res}]
+	if {$rc != 0} {
+		error $res
+	}
+	return $res
+}
+
+# seconds one command takes, error handling outside of the timed part
+proc timed {cmd} {
+	set start [clock microseconds]
+	set rc [ocd_send "set ::bench_rc \[catch {$cmd} ::bench_res\]"]
+	set elapsed [expr {([clock microseconds] - $start) / 1e6}]
+	if {$rc != 0} {
+		error [ocd_send {set ::bench_res}]
+	}
+	return $elapsed
+}
+
+proc expand {template args} {
+	return [string map $args $template]
+}
+
+# a file of pseudo random data, the same for each run
+proc make_file {kbytes} {
+	global workdir
+	set name [file join $workdir "random_${kbytes}k.bin"]
+	if {[file exists $name] && [file size $name] == $kbytes * 1024} {
+		return $name
+	}
+	expr {srand($kbytes)}
+	set f [open $name w]
+	fconfigure $f -translation binary
+	for {set i 0} {$i < $kbytes * 256} {incr i} {
+		puts -nonewline $f [binary format i [expr {int(rand() * 0x7fffffff)}]]
+	}
+	close $f
+	return $name
+}
+
+proc median {values} {
+	set values [lsort -real $values]
+	return [lindex $values [expr {[llength $values] / 2}]]
+}
+
+# ---- scenarios, each returns a list of metric name and seconds ----
+
+proc bench_program {} {
+	global program_sizes program_cmd flash_base
+	set res {}
+	foreach kb $program_sizes {
+		set file [make_file $kb]
+		lappend res program_${kb}k [timed [expand $program_cmd \
+			%FILE% $file %BASE% $flash_base]]
+	}
+	return $res
+}
+
+proc bench_verify {} {
+	global program_sizes verify_cmd flash_bank flash_base
+	set res {}
+	foreach kb $program_sizes {
+		set file [make_file $kb]
+		# verify what the program scenario wrote, whether it ran or not
+		ocd [expand {flash write_bank %BANK% %FILE% 0} %BANK% $flash_bank %FILE% $file]
+		lappend res verify_${kb}k [timed [expand $verify_cmd \
+			%FILE% $file %BASE% $flash_base %BANK% $flash_bank %OFFSET% 0]]
+	}
+	return $res
+}
+
+proc bench_erase_check {} {
+	global erase_check_cmd flash_bank
+	return [list erase_check [timed [expand $erase_check_cmd %BANK% $flash_bank]]]
+}
+
+proc bench_mem_read {} {
+	global mem_sizes mem_read_cmd ram_base workdir
+	set res {}
+	foreach kb $mem_sizes {
+		set file [file join $workdir "dump_${kb}k.bin"]
+		lappend res mem_read_${kb}k [timed [expand $mem_read_cmd \
+			%FILE% $file %BASE% $ram_base %SIZE% [expr {$kb * 1024}]]]
+	}
+	return $res
+}
+
+proc bench_mem_write {} {
+	global mem_sizes mem_write_cmd ram_base
+	set res {}
+	foreach kb $mem_sizes {
+		set file [make_file $kb]
+		lappend res mem_write_${kb}k [timed [expand $mem_write_cmd \
+			%FILE% $file %BASE% $ram_base]]
+	}
+	return $res
+}
+
+# GDB remote protocol, just enough to single step
+proc gdb_packet {s data} {
+	set sum 0
+	foreach c [split $data ""] {
+		incr sum [scan $c %c]
+	}
+	puts -nonewline $s [format {$%s#%02x} $data [expr {$sum & 0xff}]]
+	flush $s
+}
+
+proc gdb_reply {s} {
+	while {1} {
+		# skip acks up to the start of the packet
+		while {[set c [read $s 1]] ne "\$"} {
+			if {$c eq ""} {
+				error "connection to GDB server closed"
+			}
+		}
+		set data ""
+		while {[set c [read $s 1]] ne "#"} {
+			if {$c eq ""} {
+				error "connection to GDB server closed"
+			}
+			append data $c
+		}
+		read $s 2
+		puts -nonewline $s "+"
+		flush $s
+		# console output comes before the stop reply
+		if {![string match O* $data] || $data eq "OK"} {
+			return $data
+		}
+	}
+}
+
+proc bench_gdb_step {} {
+	global host gdb_port gdb_steps
+	ocd halt
+	set s [socket $host $gdb_port]
+	fconfigure $s -translation binary -buffering none
+	puts -nonewline $s "+"
+	gdb_packet $s "?"
+	gdb_reply $s
+
+	set start [clock microseconds]
+	for {set i 0} {$i < $gdb_steps} {incr i} {
+		gdb_packet $s "s"
+		set reply [gdb_reply $s]
+		if {![regexp {^[ST]} $reply]} {
+			close $s
+			error "step failed: $reply"
+		}
+	}
+	set elapsed [expr {([clock microseconds] - $start) / 1e6}]
+
+	close $s
+	return [list gdb_step [expr {$elapsed / $gdb_steps}]]
+}
+
+# ---- results ----
+
+proc write_json {file results} {
+	global version
+	set f [open $file w]
+	puts $f "\{"
+	puts $f "  \"version\": \"[string map {\\ \\\\ \" \\\"} $version]\","
+	puts $f "  \"date\": \"[clock format [clock seconds] -format %Y-%m-%dT%H:%M:%SZ -gmt 1]\","
+	puts $f "  \"results\": \{"
+	set lines {}
+	foreach name [lsort [dict keys $results]] {
+		lappend lines [format {    "%s": %.6f} $name [dict get $results $name]]
+	}
+	puts $f [join $lines ",\n"]
+	puts $f "  \}"
+	puts $f "\}"
+	close $f
+}
+
+# the numbers of a file written by write_json
+proc read_json {file} {
+	set f [open $file]
+	set text [read $f]
+	close $f
+	set res {}
+	foreach {- name value} [regexp -all -inline {"([a-z0-9_]+)":\s*([-0-9.eE+]+)} $text] {
+		dict set res $name $value
+	}
+	return $res
+}
+
+# ---- main ----
+
+file mkdir $workdir
+if {[catch {set sock [socket $host $port]} err]} {
+	puts stderr "can't connect to OpenOCD at $host:$port: $err"
+	exit 2
+}
+fconfigure $sock -translation binary -buffering none -encoding utf-8
+
+set version [ocd version]
+puts "$version"
+
+set results {}
+set failed {}
+foreach scenario $scenarios {
+	set runs {}
+	for {set r 0} {$r < $repeat} {incr r} {
+		if {[catch {bench_$scenario} res]} {
+			puts "$scenario: failed: $res"
+			lappend failed $scenario
+			break
+		}
+		foreach {name value} $res {
+			dict lappend runs $name $value
+		}
+	}
+	dict for {name values} $runs {
+		dict set results $name [median $values]
+		puts [format "%-20s %12.6f s" $name [dict get $results $name]]
+	}
+}
+close $sock
+
+if {$out ne ""} {
+	write_json $out $results
+}
+if {$record ne ""} {
+	write_json $record $results
+	puts "baseline recorded in $record"
+}
+
+set status 0
+if {$baseline ne ""} {
+	set base [read_json $baseline]
+	puts ""
+	puts [format "%-20s %12s %12s %8s" metric baseline current change]
+	dict for {name ref} $base {
+		if {[info exists tolerance($name)]} {
+			set tol $tolerance($name)
+		} else {
+			set tol $default_tolerance
+		}
+		if {![dict exists $results $name]} {
+			puts [format "%-20s %12.6f %12s %8s  MISSING" $name $ref - -]
+			set status 1
+			continue
+		}
+		set cur [dict get $results $name]
+		set change [expr {$ref > 0 ? ($cur - $ref) * 100.0 / $ref : 0}]
+		set verdict ""
+		if {$change > $tol} {
+			set verdict "  REGRESSION (> $tol%)"
+			set status 1
+		}
+		puts [format "%-20s %12.6f %12.6f %+7.1f%%%s" $name $ref $cur $change $verdict]
+	}
+}
+
+if {[llength $failed] && $baseline eq ""} {
+	set status 1
+}
+exit $status
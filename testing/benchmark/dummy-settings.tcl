@@ -0,0 +1,9 @@
+# benchmark.tcl settings for the dummy harness of dummy.cfg
+#
+# the testee target can't single step, and the faux bank is not in the
+# memory map of the target, so verify reads it through the bank
+
+set scenarios {program verify erase_check mem_read mem_write}
+set flash_bank 0
+set flash_base 0x08000000
+set ram_base 0x20000000